@@ -198,6 +198,67 @@ void Run(fplbase::AssetManager &assetman, FontManager &fontman,
          fplbase::InputSystem &input,
          const std::function<void()> &gui_definition);
 
+/// @struct WorldPanel
+///
+/// @brief A UI panel placed in the world, rendered by `RunWorldPanels()`.
+struct WorldPanel {
+  WorldPanel() : id(kNullHash), canvas_size(mathfu::kZeros2i) {}
+
+  /// @brief A unique ID of the panel, which identifies its retained layout
+  /// across frames.
+  HashedId id;
+
+  /// @brief The size of the panel in pixels.
+  mathfu::vec2i canvas_size;
+
+  /// @brief A matrix placing the panel in the world. It transforms pixel
+  /// coordinates of the panel, with (0, 0) in the top left and `canvas_size` in
+  /// the bottom right, into world space.
+  mathfu::mat4 transform;
+
+  /// @brief A function that defines GUI elements of the panel, like the one
+  /// passed to `Run()`.
+  std::function<void()> gui_definition;
+};
+
+/// @brief Lay out and render many UI panels placed in the world, such as
+/// nameplates, sharing their draw calls.
+///
+/// Each panel still runs its own layout pass and render pass, and handles
+/// events on its own, like a separate `Run()` with `UseExistingProjection()`
+/// and `ApplyCustomTransform()`. It keeps its own layout in the retained
+/// layout mode. Images, backgrounds and text of all panels are transformed
+/// into world space on the CPU and merged into shared draw batches, which are
+/// rendered once after the last panel, so panels sharing shaders and textures
+/// take a few draw calls in total.
+///
+/// Panels are rendered in the given order without depth test, so they should
+/// be sorted from back to front. Scrolling groups are not supported in panels,
+/// and clipped labels, nine-patch images and custom elements are drawn right
+/// away with the transform of their panel. Don't call
+/// `UseExistingProjection()`, `ApplyCustomTransform()` or `SetDepthTest()` in
+/// a panel.
+///
+/// @param[in,out] assetman The AssetManager you want to use textures from.
+/// @param[in] fontman The FontManager to be used by the GUI.
+/// @param[in] input The InputSystem to be used by the GUI.
+/// @param[in] motive_engine A pointer to the MotiveEngine to be used by the GUI
+/// for animation purpose.
+/// @param[in] view_projection The view-projection matrix of the world.
+/// @param[in] panels An array of panels to render.
+/// @param[in] count The # of panels in `panels`.
+void RunWorldPanels(fplbase::AssetManager &assetman, FontManager &fontman,
+                    fplbase::InputSystem &input,
+                    motive::MotiveEngine *motive_engine,
+                    const mathfu::mat4 &view_projection,
+                    const WorldPanel *panels, size_t count);
+
+/// @brief A version of the function above that doesn't use a MotiveEngine.
+void RunWorldPanels(fplbase::AssetManager &assetman, FontManager &fontman,
+                    fplbase::InputSystem &input,
+                    const mathfu::mat4 &view_projection,
+                    const WorldPanel *panels, size_t count);
+
 /// @enum Event
 ///
 /// @brief Event types are returned by most interactive elements. These are
@@ -317,6 +378,15 @@ float GetScale();
 void Image(const fplbase::Texture &texture, float ysize,
            const char *id = kDefaultImageID);
 
+/// @brief Render an image as a GUI element.
+///
+/// @param[in] texture A Texture corresponding to the image that should be
+/// rendered.
+/// @param[in] ysize A float containing the vertical size in virtual resolution.
+/// @param[in] id A HashedId to uniquely identify the image, e.g. computed once
+/// with `ConstHashId()`.
+void Image(const fplbase::Texture &texture, float ysize, HashedId id);
+
 /// @brief Set the Images's tint.
 ///
 /// @param[in] color The RGBA values that get multiplied into the image RGBAs.
@@ -375,6 +445,17 @@ void Label(const char *text, float ysize, const mathfu::vec2 &label_size,
 void HtmlLabel(const char *html, float ysize, const mathfu::vec2 &label_size,
                TextAlignment alignment, const char *id);
 
+/// @brief Render simple HTML text.
+///
+/// @param[in] html A C-string in UTF-8 format to be parsed as HTML and then
+/// displayed.
+/// @param[in] ysize A float containing the vertical size in virtual resolution.
+/// @param[in] label_size The max size of the label in virtual resolution.
+/// @param[in] alignment A text alignment in the label.
+/// @param[in] id A HashedId of the label.
+void HtmlLabel(const char *html, float ysize, const mathfu::vec2 &label_size,
+               TextAlignment alignment, HashedId id);
+
 /// @brief Set the Label's text color.
 ///
 /// @param[in] color A vec4 representing the RGBA values that the text color
@@ -435,6 +516,20 @@ void SetTextOuterColor(const mathfu::vec4 &color, float size,
 /// Default value is 16.0f/255.0f.
 void EnableTextSDF(bool inner_sdf, bool outer_sdf, float threshold);
 
+/// @brief Enable/Disable a multi-channel signed distance field generation with
+/// glyphs.
+/// Multi-channel SDF glyphs are generated from glyph outlines in one size
+/// (FontManager::SetMultiChannelSDFGlyphSize()) and keep sharp corners when
+/// they are rendered in larger sizes, so texts in many sizes share one set of
+/// glyphs in the atlas. Glyphs of bitmap and color fonts are rendered as
+/// usual.
+/// The setting replaces a setting of EnableTextSDF().
+///
+/// @param[in] enable set true to enable the multi-channel SDF generation.
+/// @param[in] threshold Threshold value used in the glyph rendering, in the
+/// same manner as EnableTextSDF().
+void EnableTextMultiChannelSDF(bool enable, float threshold);
+
 /// @brief Enable/Disable the hyphenation in the text label.
 /// @param[in] enable A flag indicate hyphenation state.
 void EnableTextHyphenation(bool enable);
@@ -512,6 +607,21 @@ void SetTextEllipsis(const char *ellipsis);
 Event Edit(float ysize, const mathfu::vec2 &size, const char *id,
            EditStatus *status, std::string *string);
 
+/// @brief Renders an edit text box as a GUI element.
+///
+/// @param[in] ysize A float containing the vertical size in virtual resolution.
+/// @param[in] size A mathfu::vec2 reference to the size of the edit box in
+/// virtual resolution.
+/// @param[in] id A HashedId to uniquely idenitfy this edit box.
+/// @param[in/out] status A pointer to a EditStatus that indicates the status of
+/// Edit widget. Can be nullptr if the caller doesn't require the information.
+/// @param[in/out] string A pointer to a C-string in UTF-8 format that should
+/// be used as the Label for the edit box.
+///
+/// @return Returns the Event type for the Edit widget.
+Event Edit(float ysize, const mathfu::vec2 &size, HashedId id,
+           EditStatus *status, std::string *string);
+
 /// @brief Render an edit text box with a text alignment.
 ///
 /// @param[in] ysize A float containing the vertical size in virtual resolution.
@@ -529,6 +639,22 @@ Event Edit(float ysize, const mathfu::vec2 &size, const char *id,
 Event Edit(float ysize, const mathfu::vec2 &size, TextAlignment alignment,
            const char *id, EditStatus *status, std::string *string);
 
+/// @brief Render an edit text box with a text alignment.
+///
+/// @param[in] ysize A float containing the vertical size in virtual resolution.
+/// @param[in] size A mathfu::vec2 reference to the size of the edit box in
+/// virtual resolution.
+/// @param[in] alignment An alignment of the text in the edit box.
+/// @param[in] id A HashedId to uniquely idenitfy this edit box.
+/// @param[in/out] status A pointer to a EditStatus that indicates the status of
+/// Edit widget. Can be nullptr if the caller doesn't require the information.
+/// @param[in/out] string A pointer to a C-string in UTF-8 format that should
+/// be used as the Label for the edit box.
+///
+/// @return Returns the Event type for the Edit widget.
+Event Edit(float ysize, const mathfu::vec2 &size, TextAlignment alignment,
+           HashedId id, EditStatus *status, std::string *string);
+
 /// @brief Create a group of elements with a given layout and intra-element
 /// spacing.
 ///
@@ -542,6 +668,16 @@ Event Edit(float ysize, const mathfu::vec2 &size, TextAlignment alignment,
 void StartGroup(Layout layout, float spacing = 0,
                 const char *id = kDefaultGroupID);
 
+/// @brief Create a group of elements with a given layout and intra-element
+/// spacing.
+///
+/// @param[in] layout The Layout to be used by the group.
+/// @param[in] spacing A float corresponding to the intra-element spacing for
+/// the group.
+/// @param[in] id A HashedId to uniquely identify this group, e.g. computed once
+/// with `ConstHashId()`.
+void StartGroup(Layout layout, float spacing, HashedId id);
+
 /// @brief Clean up the Group element start by `StartGroup()`.
 ///
 /// @note `StartGroup()` and `EndGroup()` calls must be matched. They may,
@@ -593,6 +729,22 @@ Event CheckEvent(bool check_dragevent_only);
 ///
 void SetDefaultFocus();
 
+/// @brief Enables the spatial keyboard/gamepad navigation.
+///
+/// By default, the directional buttons move the focus to the previous or next
+/// interactive element in the order they are defined, wrapping around at both
+/// ends. In the spatial navigation mode, the focus moves to the nearest
+/// interactive element in the pressed direction, found through a spatial index
+/// of the element rects built in every frame, and stays when there's no
+/// element in that direction.
+///
+/// @param[in] enable `true` to enable the spatial navigation. It's disabled by
+/// default.
+///
+/// @note Unlike most functions in this file, this can be called outside of
+/// `Run()`, and the setting persists across frames.
+void EnableSpatialNavigation(bool enable);
+
 // Call inside of a group that is meant to be like a popup inside of a
 // kLayoutOverlay. It will cause all interactive elements in all groups that
 // precede it to not respond to input.
@@ -619,6 +771,12 @@ void ModalGroup();
 /// element that should capture all pointer events.
 void CapturePointer(const char *element_id);
 
+/// @brief Caputre a pointer event.
+///
+/// @param[in] element_id A HashedId of the element that should capture all
+/// pointer events.
+void CapturePointer(HashedId element_id);
+
 /// @brief Release a pointer capture.
 ///
 /// @note This function is specific to a group, and should be called after
@@ -722,6 +880,53 @@ void StartScroll(const mathfu::vec2 &size, mathfu::vec2 *offset);
 /// @note Call `EndScroll()` right before `EndGroup()`.
 void EndScroll();
 
+/// @brief Make the current group into a scrolling list of items, where only
+/// items visible in the window of "size" are defined.
+///
+/// This works like `StartScroll()` and `EndScroll()` around all the items,
+/// but `item` is called only for items overlapping the scrolling window, plus
+/// a couple of items around it. Other items are replaced with empty space, so
+/// invisible items cost nothing in both the layout and the render pass.
+/// Items are laid out vertically, with the spacing of the current group.
+///
+/// @param[in] size A vec2 corresponding to the size of the window that the
+/// items should be displayed in.
+/// @param[out] offset A vec2 that captures the value of the current scroll
+/// location.
+/// @param[in] item_count The # of items in the list.
+/// @param[in] item_height The height of every item in virtual screen
+/// coordinates. Items shorter than this are padded, and items should not be
+/// taller than this.
+/// @param[in] item The function defining the elements of an item with the
+/// given index, e.g. with `Label()`.
+///
+/// @note Call `VirtualList()` right after `StartGroup()`, instead of
+/// `StartScroll()` and `EndScroll()`.
+void VirtualList(const mathfu::vec2 &size, mathfu::vec2 *offset,
+                 int32_t item_count, float item_height,
+                 const std::function<void(int32_t index)> &item);
+
+/// @brief Make the current group into a scrolling list of items with variable
+/// heights, where only items visible in the window of "size" are defined.
+///
+/// Same as the other `VirtualList()`, with a function returning the height of
+/// each item. The function is called for all items every pass, so it should be
+/// cheap.
+///
+/// @param[in] size A vec2 corresponding to the size of the window that the
+/// items should be displayed in.
+/// @param[out] offset A vec2 that captures the value of the current scroll
+/// location.
+/// @param[in] item_count The # of items in the list.
+/// @param[in] item_height The function returning the height of an item with
+/// the given index in virtual screen coordinates.
+/// @param[in] item The function defining the elements of an item with the
+/// given index.
+void VirtualList(const mathfu::vec2 &size, mathfu::vec2 *offset,
+                 int32_t item_count,
+                 const std::function<float(int32_t index)> &item_height,
+                 const std::function<void(int32_t index)> &item);
+
 /// @brief Make the current group into a slider group that can handle basic
 /// slider behavior. The group will capture/release the pointer as necessary.
 ///
@@ -750,6 +955,19 @@ void CustomElement(const mathfu::vec2 &virtual_size, const char *id,
                                             const mathfu::vec2i &size)>
                        renderer);
 
+/// @brief Create a custom element with a given size.
+///
+/// @param[in] virtual_size The size of the element in virtual screen
+/// coordinates.
+/// @param[in] id A HashedId corresponding to the unique ID for the
+/// CustomElement.
+/// @param[in] renderer The function that is invoked during the render pass
+/// to render the element.
+void CustomElement(const mathfu::vec2 &virtual_size, HashedId id,
+                   const std::function<void(const mathfu::vec2i &pos,
+                                            const mathfu::vec2i &size)>
+                       renderer);
+
 /// @brief Render a Texture to a specific position with a given size.
 ///
 /// @note This is usually called in `CustomElement()`'s callback function.
@@ -901,6 +1119,158 @@ const FlatUIVersion *GetFlatUIVersion();
 /// around UI elements overlap, flickering will occur.
 void SetDepthTest(bool enable);
 
+/// @brief Enables deferred draw batching in the render pass.
+///
+/// When enabled, images, backgrounds, carets and text are not drawn right
+/// away. They are collected during the render pass, and draws sharing the same
+/// shader, texture and text attributes are merged into a few large draw calls
+/// at the end of `Run()`. Draws are only reordered when they don't overlap, so
+/// the rendering result is the same as without batching.
+///
+/// Pending draws are flushed before scrolling groups change the scissor
+/// rectangle, before nine-patch images and before the renderer of a
+/// `CustomElement()` is invoked, so those can be mixed with batched elements.
+///
+/// @param[in] enable `true` to enable draw batching. It's disabled by default.
+///
+/// @note Call this function at the start of a GUI definition, since the setting
+/// is reset every frame.
+/// @warning Drawing with the renderer directly inside a GUI definition (other
+/// than in a `CustomElement()` renderer) would be rendered below batched
+/// elements.
+void EnableDrawBatching(bool enable);
+
+/// @brief Enables the retained layout mode.
+///
+/// In the retained layout mode, `Run()` skips the layout pass and calls the
+/// GUI definition only once for rendering, when the layout is known to be the
+/// same as in the last frame. The layout is retained once two layout passes in
+/// a row produced the same elements and sizes, and it is laid out again when:
+/// - Any pointer is down, moving or scrolling, a gamepad or keyboard is used,
+///   or an element captures the input.
+/// - An element fired an event other than `kEventHover` in the last frame.
+/// - An animation is moving or a sprite is active.
+/// - The window size changed.
+/// - The render pass found elements different from the retained layout.
+///
+/// This mode is intended for mostly static UIs. Call `InvalidateLayout()`
+/// when anything changes the layout of the next frame without changing element
+/// IDs, such as an image with a different size.
+///
+/// @param[in] enable `true` to enable the retained layout mode. It's disabled
+/// by default.
+///
+/// @note Unlike most functions in this file, this can be called outside of
+/// `Run()`, and the setting persists across frames.
+void EnableRetainedLayout(bool enable);
+
+/// @brief Run the layout pass in the next frame in the retained layout mode.
+void InvalidateLayout();
+
+/// @brief Retrieve the # of frames that allocated memory for the layout.
+///
+/// FlatUI keeps the containers of the layout across frames, so frames with the
+/// same or fewer elements than earlier frames don't allocate memory for them.
+/// Tests can check that the count stays the same in steady-state frames.
+///
+/// @return Returns the # of frames that grew the layout containers.
+uint32_t GetLayoutAllocationCount();
+
+/// @struct RenderCacheStats
+///
+/// @brief Usage counters of the render cache.
+struct RenderCacheStats {
+  RenderCacheStats() : hits(0), misses(0) {}
+
+  /// @brief # of frames rendered by drawing the cached UI.
+  uint32_t hits;
+  /// @brief # of frames rendered into the cache.
+  uint32_t misses;
+};
+
+/// @brief Enables the render cache.
+///
+/// With the render cache, the UI is rendered into an offscreen texture, which
+/// is drawn as a single textured quad. The draws of each frame are recorded
+/// and compared with the cached frame, and elements are rendered again only
+/// when any of their positions, texts, textures, colors or glyphs in the font
+/// atlas changed. Combined with `EnableRetainedLayout()`, an idle UI only
+/// costs the GUI definition call and a single quad.
+///
+/// Frames with scrolling groups, nine-patch images or custom elements are
+/// rendered into the texture every frame, since they are drawn immediately.
+/// Frames with depth test enabled are not cached.
+///
+/// @param[in] enable `true` to enable the render cache. `false` disables it
+/// and releases the offscreen texture, so call this before destroying the GL
+/// context.
+///
+/// @note This can be called outside of `Run()`, and the setting persists
+/// across frames.
+void EnableRenderCache(bool enable);
+
+/// @brief Render the UI again in the next frame with the render cache.
+///
+/// Call this when the content of a texture used by the UI changes.
+void InvalidateRenderCache();
+
+/// @brief Retrieve usage counters of the render cache.
+const RenderCacheStats &GetRenderCacheStats();
+
+/// @struct RenderStateStats
+///
+/// @brief Counters of render state changes made by FlatUI, accumulated over
+/// frames until `ResetRenderStateStats()` is called.
+///
+/// FlatUI keeps track of the uniform values of font shaders and of the bound
+/// texture, and skips redundant uploads and binds.
+///
+/// The counters are always collected. Together with
+/// `FontManager::GetTextPipelineStats()`, they can be sampled for telemetry in
+/// release builds.
+struct RenderStateStats {
+  RenderStateStats()
+      : uniform_uploads(0),
+        skipped_uniform_uploads(0),
+        texture_binds(0),
+        skipped_texture_binds(0),
+        shader_binds(0),
+        draw_calls(0),
+        frames(0) {}
+
+  /// @brief # of font shader uniform values uploaded.
+  uint32_t uniform_uploads;
+  /// @brief # of font shader uniform uploads skipped as redundant.
+  uint32_t skipped_uniform_uploads;
+  /// @brief # of textures bound.
+  uint32_t texture_binds;
+  /// @brief # of texture binds skipped since the texture was already bound.
+  uint32_t skipped_texture_binds;
+  /// @brief # of shaders bound, including font shaders.
+  uint32_t shader_binds;
+  /// @brief # of draw calls issued, including deferred draws of the draw
+  /// batching.
+  uint32_t draw_calls;
+  /// @brief # of `Run()` calls counted.
+  uint32_t frames;
+};
+
+/// @brief Retrieve the render state counters of FlatUI.
+///
+/// Counters of a frame are added when `Run()` finishes.
+///
+/// @return Returns the counters accumulated since the last reset.
+const RenderStateStats &GetRenderStateStats();
+
+/// @brief Retrieve the render state counters of the last `Run()` call.
+///
+/// @return Returns the counters of the last frame, whose `frames` is 1 once a
+/// frame finished.
+const RenderStateStats &GetFrameRenderStateStats();
+
+/// @brief Reset the render state counters of FlatUI.
+void ResetRenderStateStats();
+
 namespace details {
 
 /// @class FloatConverter
@@ -997,11 +1367,23 @@ inline int NumActiveSprites(const char *id) {
 /// @param[in] group_id A C-string in UTF-8 format that uniquely identifies an
 ///               animation type.
 /// @param[in] draw A function that tells the program how to draw the sprite
-///                 associated with id.
+///                 associated with id. It's moved into the sprite, so pass
+///                 a temporary to avoid copying it.
 ///
 /// @return Returns the SequenceId assigned to the sprite associated with id.
 SequenceId AddSprite(const char *group_id,
-                     const std::function<bool(SequenceId seq)> &draw);
+                     std::function<bool(SequenceId seq)> draw);
+
+/// @brief This function adds a sprite, which will be drawn and then forgotten
+/// after it is finished firing.
+///
+/// @param[in] group_id A HashedId that uniquely identifies an animation type.
+/// @param[in] draw A function that tells the program how to draw the sprite
+///                 associated with id.
+///
+/// @return Returns the SequenceId assigned to the sprite associated with id.
+SequenceId AddSprite(HashedId group_id,
+                     std::function<bool(SequenceId seq)> draw);
 
 /// @brief Draws all the sprites created with 'group_id' in AddSprite().
 ///
@@ -1009,6 +1391,11 @@ SequenceId AddSprite(const char *group_id,
 ///            animation type.
 void DrawSprites(const char *group_id);
 
+/// @brief Draws all the sprites created with 'group_id' in AddSprite().
+///
+/// @param[in] group_id A HashedId that uniquely identifies an animation type.
+void DrawSprites(HashedId group_id);
+
 /// @brief This function creates a new Motivator if it doesn't already exist
 /// and returns the current value of it.
 ///
@@ -120,6 +120,17 @@ Event TextButton(const char *text, float size, const Margin &margin);
 Event ImageButton(const fplbase::Texture &texture, float size,
                   const Margin &margin, const char *id);
 
+/// @brief A simple button showing a clickable image.
+///
+/// @param[in] texture The Texture of the image to display.
+/// @param[in] size A float indicating the vertical height.
+/// @param[in] margin A Margin around the `texture`.
+/// @param[in] id A HashedId to uniquely identify the button.
+///
+/// @return Returns the Event type for the button.
+Event ImageButton(const fplbase::Texture &texture, float size,
+                  const Margin &margin, HashedId id);
+
 /// @brief A button showing a different image when clicked or not.
 ///
 /// @param[in] up_texture The Texture of the image to display if not clicked.
@@ -133,6 +144,19 @@ Event ToggleImageButton(const fplbase::Texture &up_texture,
                           const fplbase::Texture &down_texture, float size,
                   const Margin &margin, const char *id);
 
+/// @brief A button showing a different image when clicked or not.
+///
+/// @param[in] up_texture The Texture of the image to display if not clicked.
+/// @param[in] down_texture The Texture of the image to display if clicked.
+/// @param[in] size A float indicating the vertical height.
+/// @param[in] margin A Margin around the `texture`.
+/// @param[in] id A HashedId to uniquely identify the button.
+///
+/// @return Returns the Event type for the button.
+Event ToggleImageButton(const fplbase::Texture &up_texture,
+                        const fplbase::Texture &down_texture, float size,
+                        const Margin &margin, HashedId id);
+
 /// @brief A simple button showing clickable text with an image shown beside it.
 ///
 /// @note Uses the colors that are set via `SetHoverClickColor`.
@@ -185,6 +209,21 @@ Event Slider(const fplbase::Texture &tex_bar, const fplbase::Texture &tex_knob,
              const mathfu::vec2 &size, float bar_height, const char *id,
              float *slider_value);
 
+/// @brief A clider to change a numeric value.
+///
+/// @param[in] tex_bar The Texture for the slider.
+/// @param[in] tex_knob The Texture for the knob to move on top of the
+/// `tex_bar`.
+/// @param[in] size A const vec2 reference to specify the whole size, including
+/// the margin, and relative size of the slider.
+/// @param[in] bar_height A float corresponding the the Y ratio of the bar.
+/// @param[in] id A HashedId to uniquely identify the slider.
+/// @param[out] slider_value A pointer to a float between 0.0 and 1.0 inclusive,
+/// which contains the position of the slider.
+Event Slider(const fplbase::Texture &tex_bar, const fplbase::Texture &tex_knob,
+             const mathfu::vec2 &size, float bar_height, HashedId id,
+             float *slider_value);
+
 /// @brief A scrollbar to indicate position in a scroll view.
 ///
 /// @note The background and foreground Textures must be a ninepatch texture.
@@ -204,6 +243,23 @@ Event ScrollBar(const fplbase::Texture &tex_background,
                 const mathfu::vec2 &size, float bar_size, const char *id,
                 float *scroll_value);
 
+/// @brief A scrollbar to indicate position in a scroll view.
+///
+/// @param[in] tex_background A const Texture reference for the background.
+/// @param[in] tex_foreground A const Texture reference for the foreground.
+/// @param[in] size A const vec2 reference to specify the whole size, including
+/// the margin, and the relative size of the scroll bar.
+/// @param[in] bar_size A float corresponding to the size of the scroll bar.
+/// @param[in] id A HashedId to uniquely identify the scroll bar.
+/// @param[out] scroll_value A pointer to a float between 0.0 and 1.0 inclusive,
+/// which contains the position of the slider.
+///
+/// @return Returns the Event type for the scroll bar.
+Event ScrollBar(const fplbase::Texture &tex_background,
+                const fplbase::Texture &tex_foreground,
+                const mathfu::vec2 &size, float bar_size, HashedId id,
+                float *scroll_value);
+
 /// @brief Sets a background color of the widget based on the event status.
 ///
 /// If the event is `kEventIsDown`, the background color used will be the
@@ -228,6 +284,21 @@ void EventBackground(Event event);
 Event CollapsibleGroup(const char *label, float ysize, const Margin &margin,
                        const char *id, const std::function<void()> &contents,
                        bool *expand);
+
+/// @brief A text button that renders extra contents when toggled.
+///
+/// @param[in] label A C-string of text to display on the button.
+/// @param[in] ysize A float indicating the text button's vertical height.
+/// @param[in] margin A Margin that should be placed around the text.
+/// @param[in] id A HashedId that provides the ID for the button.
+/// @param[in] contents A void function that executes while the menu is expanded
+/// @param[out] expand A pointer to a bool that stores whether or not the
+/// group is expanded.
+///
+/// @return Returns the Event type for the button.
+Event CollapsibleGroup(const char *label, float ysize, const Margin &margin,
+                       HashedId id, const std::function<void()> &contents,
+                       bool *expand);
 /// @}
 
 }  // namespace flatui
@@ -21,6 +21,8 @@
 #include "fplbase/asset_manager.h"
 
 #include <functional>
+#include <string>
+#include <vector>
 
 namespace flatui {
 
@@ -197,6 +199,79 @@ void CreateFlatUIFromData(const void* data,
                           fplbase::AssetManager* assetman = nullptr,
                           FlatUIHandler event_handler = nullptr);
 
+/// @cond FLATUI_INTERNAL
+// An element of compiled FlatUI data, bound to the dynamic data, textures and
+// custom widget it uses.
+struct ElementBinding {
+  ElementBinding()
+      : element(nullptr), dynamic(nullptr), custom_widget(nullptr),
+        group_end(0) {
+    textures[0] = textures[1] = nullptr;
+  }
+
+  // The element, or nullptr for the end of a group.
+  const flatui_data::FlatUIElement* element;
+  std::string id;
+  DynamicData* dynamic;
+  // Textures named in the element's `texture` and `texture_secondary` fields.
+  // nullptr when the texture is named by dynamic data instead.
+  const fplbase::Texture* textures[2];
+  const CustomWidget* custom_widget;
+  // For groups, the index of the entry that ends the group.
+  size_t group_end;
+};
+/// @endcond
+
+/// @class CompiledFlatUI
+///
+/// @brief Precompiled FlatUI data, which creates the same GUI as
+/// `CreateFlatUIFromData` with less work per frame.
+///
+/// `Compile` validates the FlatBuffer data, resolves textures named in it
+/// through the `fplbase::AssetManager`, and binds each element to its dynamic
+/// data and custom widget. The elements are flattened into an array, so
+/// `Create` only walks the array and calls the FlatUI functions.
+///
+/// @note Dynamic data and custom widgets must be registered BEFORE calling
+/// `Compile`. Registering new data afterwards requires compiling again, though
+/// values of the registered pointers can change freely between frames.
+class CompiledFlatUI {
+ public:
+  CompiledFlatUI() : assetman_(nullptr) {}
+
+  /// @brief Compile FlatBuffer data.
+  ///
+  /// Elements with missing fields, or textures that can't be found, are
+  /// reported once here and left out of the compiled GUI.
+  ///
+  /// @param[in] data A pointer to the FlatBuffer data to use to create the UI.
+  /// It must outlive this object, since elements keep pointing to it.
+  /// @param[in] assetman An optional parameter, which points to the
+  /// `fplbase::AssetManager` to be used for rendering textures.
+  ///
+  /// @return Returns `false` if the data has no elements to compile.
+  bool Compile(const void* data, fplbase::AssetManager* assetman = nullptr);
+
+  /// @brief Creates the compiled GUI. Typically passed to `flatui::Run()`.
+  ///
+  /// @param[in] event_handler An optional parameter, which acts as a function
+  /// pointer to the Event Handler function that will be called whenever an
+  /// Event occurs in the generated GUI.
+  void Create(const FlatUIHandler& event_handler = nullptr) const;
+
+  /// @brief Discard the compiled data.
+  void Clear();
+
+  /// @return Returns `true` if there is no compiled element.
+  bool empty() const { return elements_.empty(); }
+
+ private:
+  void CompileElement(const flatui_data::FlatUIElement* element);
+
+  std::vector<ElementBinding> elements_;
+  fplbase::AssetManager* assetman_;
+};
+
 /// @brief Called to set the maximum number of errors to output.
 ///
 /// The default is 10. Set to `kNoErrorOutputLimit` to print out every error on
@@ -16,6 +16,7 @@
 #define FONT_BUFFER_H
 
 #include "flatui/internal/flatui_util.h"
+#include "flatui/internal/font_vertex_buffer.h"
 #include "flatui/internal/glyph_cache.h"
 #include "flatui/internal/hb_complex_font.h"
 
@@ -302,7 +303,9 @@ class FontBufferParameters {
             size_.y == other.size_.y &&
             kerning_scale_ == other.kerning_scale_ &&
             line_height_scale_ == other.line_height_scale_ &&
-            flags_value_ == other.flags_value_ && cache_id_ == other.cache_id_);
+            flags_value_ == other.flags_value_ &&
+            cache_id_ == other.cache_id_ &&
+            hyphenation_locale_ == other.hyphenation_locale_);
   }
 
   /// @brief The hash function for FontBufferParameters.
@@ -315,12 +318,18 @@ class FontBufferParameters {
     // Note that font_id_, text_id_ and cache_id_ are already hashed values.
     size_t value = key.cache_id_;
     if (key.cache_id_ == kNullHash) {
+      value = HashCombine<HashedId>(value, key.font_id_);
+      value = HashCombine<HashedId>(value, key.text_id_);
       value = HashCombine<float>(value, key.font_size_);
       value = HashCombine<float>(value, key.kerning_scale_);
       value = HashCombine<float>(value, key.line_height_scale_);
       value = HashCombine<int32_t>(value, key.flags_value_);
       value = HashCombine<int32_t>(value, key.size_.x);
       value = HashCombine<int32_t>(value, key.size_.y);
+      if (!key.hyphenation_locale_.empty()) {
+        value = HashCombine<HashedId>(
+            value, HashId(key.hyphenation_locale_.c_str()));
+      }
     }
     return value;
   }
@@ -333,10 +342,27 @@ class FontBufferParameters {
     }
     return std::tie(lhs.font_id_, lhs.text_id_, lhs.font_size_,
                     lhs.kerning_scale_, lhs.line_height_scale_,
-                    lhs.flags_value_, lhs.size_.x, lhs.size_.y) <
+                    lhs.flags_value_, lhs.size_.x, lhs.size_.y,
+                    lhs.hyphenation_locale_) <
            std::tie(rhs.font_id_, rhs.text_id_, rhs.font_size_,
                     rhs.kerning_scale_, rhs.line_height_scale_,
-                    rhs.flags_value_, rhs.size_.x, rhs.size_.y);
+                    rhs.flags_value_, rhs.size_.x, rhs.size_.y,
+                    rhs.hyphenation_locale_);
+  }
+
+  /// @brief Check if two parameters lay out texts in the same way.
+  ///
+  /// @param[in] other The other FontBufferParameters to compare with.
+  ///
+  /// @return Returns `true` if all parameters except the text id and the
+  /// cache id are equal.
+  bool HasSameLayout(const FontBufferParameters &other) const {
+    return font_id_ == other.font_id_ && font_size_ == other.font_size_ &&
+           size_.x == other.size_.x && size_.y == other.size_.y &&
+           kerning_scale_ == other.kerning_scale_ &&
+           line_height_scale_ == other.line_height_scale_ &&
+           flags_value_ == other.flags_value_ &&
+           hyphenation_locale_ == other.hyphenation_locale_;
   }
 
   /// @return Returns a font hash id.
@@ -378,6 +404,24 @@ class FontBufferParameters {
   /// @return Returns a flag indicating if the hyphenation is enabled.
   bool get_enable_hyphenation_flag() const { return flags_.enable_hyphenation; }
 
+  /// @return Returns the locale used to hyphenate the text, or an empty string
+  /// when the locale of FontManager is used.
+  const std::string &get_hyphenation_locale() const {
+    return hyphenation_locale_;
+  }
+
+  /// @brief Set the locale used to hyphenate the text.
+  ///
+  /// Hyphenation patterns of each locale are opened once and kept in
+  /// FontManager, so texts in different languages can be laid out in the same
+  /// frame without reopening pattern files.
+  ///
+  /// @param[in] locale A locale such as 'en-US', or nullptr to use the locale
+  /// of FontManager.
+  void set_hyphenation_locale(const char *locale) {
+    hyphenation_locale_ = locale ? locale : "";
+  }
+
   /// Retrieve a line length of the text based on given parameters.
   /// a fixed line length (get_size.x) will be used if the text is justified
   /// or right aligned otherwise the line length will be determined by the text
@@ -421,6 +465,8 @@ class FontBufferParameters {
   mathfu::vec2i size_;
   float kerning_scale_;
   float line_height_scale_;
+  // Empty to use the locale of FontManager.
+  std::string hyphenation_locale_;
 
   // A structure that defines bit fields to hold multiple flag values related to
   // the font buffer.
@@ -429,7 +475,7 @@ class FontBufferParameters {
     bool caret_info : 1;
     bool rtl_layout : 1;
     bool enable_hyphenation : 1;
-    GlyphFlags glyph_flags : 2;
+    GlyphFlags glyph_flags : 3;
     TextAlignment text_alignement : 3;
   };
   union {
@@ -608,6 +654,80 @@ struct FontVertex {
   /// @endcond
 };
 
+/// @struct PackedFontVertex
+///
+/// @brief A compact copy of a FontVertex used for rendering, with a 2D
+/// position and UV values normalized to unsigned shorts. It is 12 bytes per
+/// vertex instead of 20 bytes of FontVertex.
+///
+/// The vertex format is `fplbase::kPosition2f, fplbase::kTexCoord2us`. Shaders
+/// of FontVertex work as is, since vertex fetch expands missing position
+/// components and normalizes the UV values.
+struct PackedFontVertex {
+  /// @brief The constructor for a PackedFontVertex.
+  ///
+  /// @param[in] vertex A FontVertex to pack. The `z` position is dropped.
+  explicit PackedFontVertex(const FontVertex &vertex) {
+    position_.data[0] = vertex.position_.data[0];
+    position_.data[1] = vertex.position_.data[1];
+    set_uv(vertex.uv_.data[0], vertex.uv_.data[1]);
+  }
+
+  /// @brief Set UV values, normalizing them to unsigned shorts.
+  void set_uv(float u, float v) {
+    uv_[0] = PackUV(u);
+    uv_[1] = PackUV(v);
+  }
+
+  /// @cond FONT_MANAGER_INTERNAL
+  static uint16_t PackUV(float value) {
+    return static_cast<uint16_t>(
+        mathfu::Clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+  }
+
+  mathfu::vec2_packed position_;
+  uint16_t uv_[2];
+  /// @endcond
+};
+
+/// @struct GlyphInstance
+///
+/// @brief A per glyph record used for instanced rendering, holding the
+/// rectangle of a glyph quad and its UV rectangle normalized to unsigned
+/// shorts. It is 24 bytes per glyph instead of 4 vertices (48 bytes of
+/// PackedFontVertex, 80 bytes of FontVertex).
+///
+/// Quads are expanded in the vertex shader from a shared array of the 4
+/// corners, see FontVertexBuffer::BindInstances().
+struct GlyphInstance {
+  /// @brief The constructor for a GlyphInstance.
+  ///
+  /// @param[in] vertices A pointer to 4 FontVertex of a glyph, in the order
+  /// FontBuffer::AddVertices() emits them.
+  explicit GlyphInstance(const FontVertex *vertices) {
+    auto &top_left = vertices[0];
+    auto &bottom_right = vertices[3];
+    rect_.data[0] = top_left.position_.data[0];
+    rect_.data[1] = top_left.position_.data[1];
+    rect_.data[2] = bottom_right.position_.data[0];
+    rect_.data[3] = bottom_right.position_.data[1];
+    set_uv(mathfu::vec4(top_left.uv_.data[0], top_left.uv_.data[1],
+                        bottom_right.uv_.data[0], bottom_right.uv_.data[1]));
+  }
+
+  /// @brief Set the UV rectangle, normalizing the values to unsigned shorts.
+  void set_uv(const mathfu::vec4 &uv) {
+    for (int32_t i = 0; i < 4; ++i) {
+      uv_[i] = PackedFontVertex::PackUV(uv[i]);
+    }
+  }
+
+  /// @cond FONT_MANAGER_INTERNAL
+  mathfu::vec4_packed rect_;
+  uint16_t uv_[4];
+  /// @endcond
+};
+
 /// @class FontBufferAttributes
 ///
 /// @brief A structure holding attribute information of texts in a FontBuffer.
@@ -712,6 +832,83 @@ class FontBufferAttributes {
   uint32_t color_;
 };
 
+/// @struct GlyphRange
+///
+/// @brief A range of consecutive glyphs in a FontBuffer rendered with the same
+/// atlas slice.
+///
+/// Glyph `i` of a FontBuffer uses vertices `i * 4` to `i * 4 + 3`, so a range
+/// is rendered with `count * 6` of the shared quad indices returned by
+/// GetQuadIndices(), from vertices starting at `start * 4`. Ranges longer than
+/// kMaxQuadIndicesGlyphs are split into multiple draws.
+struct GlyphRange {
+  GlyphRange(uint32_t start, uint32_t count) : start(start), count(count) {}
+
+  /// @brief Index of the first glyph in the range.
+  uint32_t start;
+  /// @brief # of glyphs in the range.
+  uint32_t count;
+};
+
+/// @struct CaretLine
+///
+/// @brief A range of caret positions in a line of a FontBuffer.
+///
+/// Lines are recorded in the order of the layout, so both the caret ranges and
+/// the y positions are sorted, and lines can be looked up with a binary search.
+struct CaretLine {
+  /// @brief Index of the first caret position of the line.
+  uint32_t start;
+  /// @brief Index after the last caret position of the line.
+  uint32_t end;
+  /// @brief Min and max y positions of the carets in the line.
+  int32_t min_y;
+  int32_t max_y;
+};
+
+/// @var kMaxQuadIndicesGlyphs
+///
+/// @brief The max # of glyphs in a draw addressable with 16 bit indices.
+const uint32_t kMaxQuadIndicesGlyphs = 0x10000 / 4;
+
+/// @brief Retrieve indices of quads shared by all FontBuffers.
+///
+/// The array holds `6 * kMaxQuadIndicesGlyphs` indices, 2 triangles per glyph
+/// quad in the vertex order of FontBuffer.
+///
+/// @return Returns a pointer to the shared indices.
+const uint16_t *GetQuadIndices();
+
+/// @struct FontBufferLineState
+///
+/// @brief Layout state at the start of a line in a multi line FontBuffer.
+///
+/// States are recorded while laying out a buffer, so that an edited text can
+/// be laid out again from a line with FontManager::EditBuffer().
+struct FontBufferLineState {
+  /// @brief Byte offset of the first character of the line in the text.
+  uint32_t text_index;
+  /// @brief # of glyphs, caret positions and line starts before the line.
+  uint32_t glyph_count;
+  uint32_t caret_count;
+  uint32_t line_count;
+  /// @brief # of glyphs in each atlas slice before the line.
+  std::vector<uint32_t> slice_glyph_counts;
+  /// @brief Layout position of the line start.
+  mathfu::vec2 pos;
+  /// @brief Position and advance of the last glyph before the line.
+  mathfu::vec2 last_pos;
+  mathfu::vec2 last_advance;
+  /// @brief Max width of lines before the line, in FreeType units.
+  int32_t max_line_width;
+  /// @brief Height of the text including the line.
+  float total_height;
+  /// @brief A caret position is added at the line start.
+  bool first_character;
+  /// @brief Font metrics of lines before the line.
+  FontMetrics metrics;
+};
+
 /// @class FontBufferContext
 /// @brief Temporary buffers used while generating FontBuffer.
 /// Word boundary information. This information is used only with a typography
@@ -725,7 +922,8 @@ class FontBufferContext {
         original_font_(nullptr),
         original_font_size_(0.0f),
         current_font_size_(0.0f),
-        original_base_line_(0) {}
+        original_base_line_(0),
+        resume_line_(nullptr) {}
 
   /// @var Type defining an interator to the attribute map that is tracking
   /// FontBufferAttribute.
@@ -744,6 +942,7 @@ class FontBufferContext {
     original_font_size_ = 0.0f;
     current_font_size_ = 0.0f;
     original_base_line_ = 0;
+    resume_line_ = nullptr;
   }
 
   /// @brief Set attribute to the FontBuffer. The attribute is used while
@@ -788,6 +987,13 @@ class FontBufferContext {
     original_base_line_ = base_line;
   }
 
+  /// @brief A line state to continue a layout from. nullptr for layouts
+  /// starting at the beginning of the buffer.
+  const FontBufferLineState *resume_line() const { return resume_line_; }
+  void set_resume_line(const FontBufferLineState *state) {
+    resume_line_ = state;
+  }
+
  private:
   std::vector<uint32_t> word_boundary_;
   std::vector<uint32_t> word_boundary_caret_;
@@ -802,6 +1008,7 @@ class FontBufferContext {
   float original_font_size_;
   float current_font_size_;
   int32_t original_base_line_;
+  const FontBufferLineState *resume_line_;
 };
 
 /// @struct GlyphInfo
@@ -843,8 +1050,8 @@ class FontBuffer {
 
   /// @var Type defining an interator to the internal map that is tracking all
   /// FontBuffer instances.
-  typedef std::map<FontBufferParameters, std::unique_ptr<FontBuffer>,
-                   FontBufferParameters>::iterator fontbuffer_map_it;
+  typedef std::unordered_map<FontBufferParameters, std::unique_ptr<FontBuffer>,
+                             FontBufferParameters>::iterator fontbuffer_map_it;
 
   /// @brief The default constructor for a FontBuffer.
   FontBuffer()
@@ -854,7 +1061,12 @@ class FontBuffer {
         revision_(0),
         ref_count_(0),
         has_ellipsis_(false),
-        valid_(true) {
+        valid_(true),
+        parameters_(nullptr),
+        last_used_counter_(0),
+        memory_size_(0),
+        vertex_buffer_dirty_(true),
+        bounds_dirty_(true) {
     line_start_indices_.push_back(0);
   }
 
@@ -877,7 +1089,12 @@ class FontBuffer {
         revision_(0),
         ref_count_(0),
         has_ellipsis_(false),
-        valid_(true) {
+        valid_(true),
+        parameters_(nullptr),
+        last_used_counter_(0),
+        memory_size_(0),
+        vertex_buffer_dirty_(true),
+        bounds_dirty_(true) {
     glyph_info_.reserve(size);
     if (caret_info) {
       caret_positions_.reserve(size + 1);
@@ -897,11 +1114,16 @@ class FontBuffer {
     return slices_;
   }
 
-  /// @return Returns the indices array as a const std::vector<uint16_t>.
-  const std::vector<uint16_t> &get_indices(int32_t index) const {
-    return indices_[index];
+  /// @return Returns the ranges of glyphs rendered with the slice as a const
+  /// std::vector<GlyphRange>. The index is the index of the slice in
+  /// get_slices().
+  const std::vector<GlyphRange> &get_glyph_ranges(int32_t index) const {
+    return glyph_ranges_[index];
   }
 
+  /// @return Returns the # of glyphs rendered with the slice.
+  uint32_t GetGlyphCount(int32_t index) const;
+
   /// @return Returns the vertices array as a const std::vector<FontVertex>.
   const std::vector<FontVertex> &get_vertices() const { return vertices_; }
 
@@ -911,6 +1133,56 @@ class FontBuffer {
   /// undefined behavior.
   std::vector<FontVertex> &get_vertices() { return vertices_; }
 
+  /// @return Returns packed copies of the vertices as a const
+  /// std::vector<PackedFontVertex>. The array is empty unless the buffer is
+  /// created with compact vertices enabled in FontManager.
+  const std::vector<PackedFontVertex> &get_packed_vertices() const {
+    return packed_vertices_;
+  }
+
+  /// @return Returns `true` if the FontBuffer has packed vertices to render.
+  bool HasPackedVertices() const { return !packed_vertices_.empty(); }
+
+  /// @brief Create packed copies of the vertices. Call this after the layout
+  /// of the buffer finishes. Following UV updates are applied to both copies.
+  void PackVertices();
+
+  /// @return Returns per glyph instances of the vertices as a const
+  /// std::vector<GlyphInstance>. The array is empty unless the buffer is
+  /// created with glyph instances enabled in FontManager.
+  const std::vector<GlyphInstance> &get_glyph_instances() const {
+    return glyph_instances_;
+  }
+
+  /// @return Returns `true` if the FontBuffer has glyph instances to render.
+  bool HasGlyphInstances() const { return !glyph_instances_.empty(); }
+
+  /// @brief Create a GlyphInstance of each glyph. Call this after the layout
+  /// of the buffer finishes. Following UV updates are applied to both the
+  /// vertices and the instances.
+  void BuildGlyphInstances();
+
+  /// @brief Retrieve a GPU buffer object holding the vertices to render.
+  ///
+  /// The buffer object is created at the first call, and the vertices are
+  /// uploaded again only when they are changed (e.g. UV updates after a glyph
+  /// cache flush), so that buffers rendered every frame don't stream the
+  /// vertices. The buffer object is released with the FontBuffer.
+  ///
+  /// @note Invoke the API in the rendering thread.
+  ///
+  /// @return Returns the FontVertexBuffer holding glyph instances if the
+  /// buffer has them, packed vertices if the buffer has them, the vertices
+  /// otherwise.
+  FontVertexBuffer *GetVertexBuffer() const;
+
+  /// @brief Mark the vertices as changed, so that they are uploaded to the
+  /// vertex buffer again. Call this after modifying get_vertices().
+  void InvalidateVertexBuffer() {
+    vertex_buffer_dirty_ = true;
+    bounds_dirty_ = true;
+  }
+
   /// @return Returns the array of GlyphInfo as a const std::vector<GlyphInfo>.
   const std::vector<GlyphInfo> &get_glyph_info() const { return glyph_info_; }
 
@@ -940,14 +1212,22 @@ class FontBuffer {
   /// @return Returns `true`.
   bool Verify() const {
     assert(vertices_.size() == glyph_info_.size() * kVerticesPerCodePoint);
-    size_t sum_indices = 0;
-    for (size_t i = 0; i < indices_.size(); ++i) {
-      sum_indices += indices_[i].size();
+    assert(glyph_ranges_.size() == slices_.size());
+    size_t sum_glyphs = 0;
+    for (size_t i = 0; i < glyph_ranges_.size(); ++i) {
+      sum_glyphs += GetGlyphCount(static_cast<int32_t>(i));
     }
-    assert(sum_indices == glyph_info_.size() * kIndiciesPerCodePoint);
+    assert(sum_glyphs == glyph_info_.size());
+    (void)sum_glyphs;
     return valid_;
   }
 
+  /// @brief Estimates the memory used by the buffer.
+  ///
+  /// @return Returns the number of bytes allocated by the buffer and its
+  /// arrays.
+  size_t GetMemorySize() const;
+
   /// @brief Retrieve a caret positions with a given index.
   ///
   /// @param[in] index The index of the caret position.
@@ -970,12 +1250,34 @@ class FontBuffer {
   /// If the caret positions array has 0 elements, it will return `false`.
   bool HasCaretPositions() const { return caret_positions_.capacity() != 0; }
 
+  /// @return Returns ranges of caret positions in each line, in the order of
+  /// the lines. Lines without a caret are skipped.
+  const std::vector<CaretLine> &GetCaretLines() const { return caret_lines_; }
+
+  /// @return Returns layout states recorded at line starts of a multi line
+  /// buffer, which FontManager::EditBuffer() resumes layouts from.
+  const std::vector<FontBufferLineState> &get_line_states() const {
+    return line_states_;
+  }
+
+  /// @brief Find the line of a caret position.
+  ///
+  /// @param[in] index The index of the caret position.
+  ///
+  /// @return Returns an index to GetCaretLines(), or -1 if the index is out of
+  /// the caret positions in lines.
+  int32_t FindCaretLine(size_t index) const;
+
   /// @return Returns `true` if the FontBuffer has an ellipsis appended.
   bool HasEllipsis() const { return has_ellipsis_; }
 
   /// @brief Helper to retrieve AABB info for glyph index range.
   /// Note that we return multiple AABB bounds if the glyphs span multiple
   /// lines. Each vec4 is in the format (min_x, min_y, max_x, max_y).
+  ///
+  /// Bounds of glyphs and lines are computed once when the layout finishes,
+  /// so the call only merges them. Call InvalidateVertexBuffer() after
+  /// modifying positions in get_vertices() to update them.
   std::vector<mathfu::vec4> CalculateBounds(int32_t start_index,
                                             int32_t end_index) const;
 
@@ -1003,8 +1305,11 @@ class FontBuffer {
   /// atlas texture from the glyph cache and bind the texture.
   std::vector<FontBufferAttributes> &get_slices() { return slices_; }
 
-  /// @return Returns the indices array as a std::vector<uint16_t>.
-  std::vector<uint16_t> &get_indices(int32_t index) { return indices_[index]; }
+  /// @return Returns the glyph ranges of the slice as a
+  /// std::vector<GlyphRange>.
+  std::vector<GlyphRange> &get_glyph_ranges(int32_t index) {
+    return glyph_ranges_[index];
+  }
 
   /// @brief Sets the FontMetrics metrics parameters for the font
   /// texture.
@@ -1034,11 +1339,15 @@ class FontBuffer {
   /// needs to call `StartRenderPass()` to upload the atlas texture.
   void set_pass(int32_t pass) { pass_ = pass; }
 
-  /// @return Sets an iterator pointing the FontManager's internal map.
-  void set_iterator(fontbuffer_map_it it) { it_map_ = it; }
+  /// @return Sets a pointer to the key of the buffer in the FontManager's
+  /// internal map.
+  void set_parameters(const FontBufferParameters *parameters) {
+    parameters_ = parameters;
+  }
 
-  /// @return Returns an iterator pointing the map in the FontManager.
-  fontbuffer_map_it get_iterator() { return it_map_; }
+  /// @return Returns a pointer to the key of the buffer in the FontManager's
+  /// internal map.
+  const FontBufferParameters *get_parameters() const { return parameters_; }
 
   /// @brief Adds a codepoint and related info of a glyph to the glyph info
   /// array.
@@ -1061,11 +1370,18 @@ class FontBuffer {
   void AddVertices(const mathfu::vec2 &pos, int32_t base_line, float scale,
                    const GlyphCacheEntry &entry);
 
-  /// @brief Adds 4 indices to be used for a glyph rendering to the
-  /// index array.
+  /// @brief Adds a glyph to the glyph ranges of a slice.
+  ///
+  /// @param[in] buffer_idx An index of the slice to render the glyph with.
+  /// @param[in] glyph_index An index of the glyph in the buffer.
+  void AddGlyph(int32_t buffer_idx, uint32_t glyph_index);
+
+  /// @brief Removes the last glyph of the buffer from the glyph ranges of a
+  /// slice.
   ///
-  /// @param[in] buffer_idx An index of the index array to add the indices.
-  void AddIndices(int32_t buffer_idx, int32_t count);
+  /// @return Returns `false` if the last glyph of the buffer isn't rendered
+  /// with the slice.
+  bool RemoveLastGlyph(int32_t buffer_idx);
 
   /// @brief Update underline information of attributed FontBuffer.
   ///
@@ -1130,9 +1446,54 @@ class FontBuffer {
   // @brief Invalidate the FontBuffer.
   void Invalidate() { valid_ = false; }
 
+  /// @brief Compute bounds of every glyph and every line from the vertices.
+  void UpdateBounds() const;
+
+  /// @brief Merge bounds of glyphs in [start, end).
+  /// @return Returns the bounds in the format stored in glyph_bounds_.
+  mathfu::vec4 MergeGlyphBounds(uint32_t start, uint32_t end) const;
+
+  /// @brief Release references and clear contents of the buffer to reuse it
+  /// as a new buffer, keeping capacities of the arrays.
+  ///
+  /// @param[in] size A size of the FontBuffer in a number of glyphs.
+  /// @param[in] caret_info Indicates if the FontBuffer also maintains a caret
+  /// position buffer.
+  void Reset(uint32_t size, bool caret_info);
+
+  /// @brief Record the layout state at the start of a new line.
+  void AddLineState(uint32_t text_index, const mathfu::vec2 &pos,
+                    int32_t max_line_width, float total_height,
+                    bool first_character, const FontMetrics &metrics);
+
+  /// @brief Copy glyphs and caret positions of lines before a recorded line
+  /// of another buffer, with line states up to the line, and set up the
+  /// context to continue the layout.
+  ///
+  /// @param[in] buffer The buffer to copy lines from.
+  /// @param[in] line An index of the line state in the buffer.
+  /// @param[in] context FontBuffer context used to continue the layout.
+  void CopyLines(const FontBuffer &buffer, size_t line,
+                 FontBufferContext *context);
+
   /// @brief Add a reference to the glyph cache row that is referenced in the
   /// FontBuffer.
-  void AddCacheRowReference(GlyphCacheRow *p) { referencing_row_.insert(p); }
+  ///
+  /// @return Returns true if the row wasn't referenced yet. The caller needs
+  /// to add the buffer to the row's references only in that case.
+  bool AddCacheRowReference(GlyphCacheRow *p) {
+    // Consecutive glyphs mostly come from a same row, so check the last one
+    // first.
+    if (!referencing_row_.empty() && referencing_row_.back() == p) {
+      return false;
+    }
+    if (std::find(referencing_row_.begin(), referencing_row_.end(), p) !=
+        referencing_row_.end()) {
+      return false;
+    }
+    referencing_row_.push_back(p);
+    return true;
+  }
 
   /// @brief Release references to the glyph cache row that is referenced in the
   /// FontBuffer.
@@ -1150,19 +1511,28 @@ class FontBuffer {
   // Font metrics information.
   FontMetrics metrics_;
 
-  // Arrays for font indices, vertices and code points.
+  // Arrays for glyph ranges, vertices and code points.
   // They are hold as a separate vector because OpenGL draw call needs them to
   // be a separate array.
 
   // Slices that is used in the FontBuffer.
   std::vector<FontBufferAttributes> slices_;
 
-  // Indices of the font buffer.
-  std::vector<std::vector<uint16_t>> indices_;
+  // Glyph ranges of each slice. Glyphs are rendered with the shared quad
+  // indices, so buffers don't keep index arrays.
+  std::vector<std::vector<GlyphRange>> glyph_ranges_;
 
   // Vertices data of the font buffer.
   std::vector<FontVertex> vertices_;
 
+  // Packed copy of vertices_ for rendering. Empty if compact vertices are not
+  // enabled.
+  std::vector<PackedFontVertex> packed_vertices_;
+
+  // Per glyph instances of vertices_ for instanced rendering. Empty if glyph
+  // instances are not enabled.
+  std::vector<GlyphInstance> glyph_instances_;
+
   // Code points and related mapping information used in the buffer. This array
   // is used to fetch and update UV entries when the glyph cache is flushed.
   std::vector<GlyphInfo> glyph_info_;
@@ -1172,6 +1542,10 @@ class FontBuffer {
   // can include multiple caret positions.
   std::vector<mathfu::vec2i> caret_positions_;
 
+  // Caret ranges of every line, recorded in UpdateLine() to pick carets
+  // without scanning all of them.
+  std::vector<CaretLine> caret_lines_;
+
   // Glyph indices and linked-to address of any links that have been rendered
   // in this FontBuffer. Call FontBuffer::CalculateBounds() to get the
   // bounding boxes for the link text.
@@ -1210,13 +1584,42 @@ class FontBuffer {
   // Start glyph index of every line.
   std::vector<uint32_t> line_start_indices_;
 
-  // Set holding iterators in glyph cache rows. When the buffer is released,
-  // the API releases all glyph rows in the set.
-  std::set<GlyphCacheRow *> referencing_row_;
+  // Layout states at the start of every line but the first one in a multi
+  // line buffer.
+  std::vector<FontBufferLineState> line_states_;
+
+  // Glyph cache rows referenced by the buffer, without duplicates. When the
+  // buffer is released, the API releases all glyph rows in the array.
+  // A buffer references a few rows, so a flat array is cheaper than a set.
+  std::vector<GlyphCacheRow *> referencing_row_;
+
+  // Back reference to the key in the map. When releasing a buffer, the API
+  // uses the key to remove the entry from the map. Unlike iterators, pointers
+  // to elements of the unordered_map stay valid over rehashes.
+  const FontBufferParameters *parameters_;
+
+  // Position in FontManager's LRU list of non-ref-counted buffers.
+  std::list<FontBuffer *>::iterator it_lru_;
+
+  // Glyph cache counter at the last lookup of the buffer. Buffers looked up in
+  // the current or the previous pass are never evicted.
+  uint32_t last_used_counter_;
+
+  // Memory size of the buffer accounted in FontManager's buffer cache.
+  size_t memory_size_;
+
+  // GPU copy of the vertices, created on demand in the rendering thread.
+  mutable std::unique_ptr<FontVertexBuffer> vertex_buffer_;
+
+  // A flag indicating if the vertices need to be uploaded to vertex_buffer_.
+  mutable bool vertex_buffer_dirty_;
 
-  // Back reference to the map. When releasing a buffer, the API uses the
-  // iterator to remove the entry from the map.
-  fontbuffer_map_it it_map_;
+  // Bounds of every glyph and every line, stored as
+  // (min_x, min_y, -max_x, -max_y) so that bounds are merged with a single
+  // vec4::Min(). Updated on demand once the vertices are modified.
+  mutable std::vector<mathfu::vec4_packed> glyph_bounds_;
+  mutable std::vector<mathfu::vec4_packed> line_bounds_;
+  mutable bool bounds_dirty_;
 };
 
 /// @}
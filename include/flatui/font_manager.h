@@ -15,9 +15,12 @@
 #ifndef FONT_MANAGER_H
 #define FONT_MANAGER_H
 
+#include <list>
 #include <memory>
 #include <set>
 #include <sstream>
+#include <thread>
+#include <unordered_map>
 #include "fplbase/renderer.h"
 #include "fplutil/mutex.h"
 #include "flatui/font_buffer.h"
@@ -26,8 +29,11 @@
 #include "flatui/internal/distance_computer.h"
 #include "flatui/internal/glyph_cache.h"
 #include "flatui/internal/flatui_util.h"
+#include "flatui/internal/font_resources.h"
 #include "flatui/internal/hb_complex_font.h"
 #include "flatui/internal/hyphenator.h"
+#include "flatui/internal/layout_context.h"
+#include "flatui/internal/text_pipeline_counters.h"
 
 #if defined(__APPLE__) || defined(__ANDROID__)
 #define FLATUI_SYSTEM_FONT (1)
@@ -51,7 +57,17 @@ namespace flatui {
 
 /// @cond FLATUI_INTERNAL
 // Forward decl.
+class ColorGlyphCache;
 class FaceData;
+class LayoutLock;
+class GlyphDiskCache;
+class FontLoader;
+class GlyphRasterizer;
+class LayoutWorkers;
+class MsdfGenerator;
+class ShapingCache;
+class WordBreakCache;
+class HtmlCache;
 class FontTexture;
 class FontBuffer;
 class FontBufferContext;
@@ -89,6 +105,11 @@ const int32_t kGlyphCacheHeight = 1024;
 /// slices grows up to the value.
 const int32_t kGlyphCacheMaxSlices = 4;
 
+/// @var kMultiChannelSDFGlyphSizeDefault
+///
+/// @brief The default size of glyphs cached with kGlyphFlagsMultiChannelSDF.
+const int32_t kMultiChannelSDFGlyphSizeDefault = 32;
+
 /// @var kDefaultLanguage
 ///
 /// @brief The default language used for a line break.
@@ -104,6 +125,204 @@ const char *const kSystemFont = ".SystemFont";
 static const HashedId kSystemFontId = HashId(kSystemFont);
 #endif  // FLATUI_SYSTEM_FONT
 
+/// @var kFontBufferCacheUnlimited
+///
+/// @brief A FontBuffer cache budget that never evicts buffers.
+const size_t kFontBufferCacheUnlimited = 0;
+
+/// @var kFontBufferPoolSize
+///
+/// @brief The max # of released FontBuffers kept by FontManager to reuse
+/// their allocations for new buffers.
+const size_t kFontBufferPoolSize = 32;
+
+/// @var kFontBufferPoolMaxBufferSize
+///
+/// @brief Released FontBuffers larger than the size in bytes are freed
+/// instead of being kept for reuse.
+const size_t kFontBufferPoolMaxBufferSize = 8 * 1024;
+
+/// @struct FontBufferRequest
+///
+/// @brief A text and its parameters to lay out with FontManager::GetBuffers().
+struct FontBufferRequest {
+  FontBufferRequest() : text(nullptr), length(0) {}
+  FontBufferRequest(const char *text, size_t length,
+                    const FontBufferParameters &parameters)
+      : text(text), length(length), parameters(parameters) {}
+
+  /// @brief A C-string in UTF-8 format with the text for the FontBuffer.
+  const char *text;
+  /// @brief The length of the text string.
+  size_t length;
+  /// @brief The FontBufferParameters for the FontBuffer.
+  FontBufferParameters parameters;
+};
+
+/// @struct FontBufferCacheStats
+///
+/// @brief Usage counters of the FontBuffer cache in FontManager.
+struct FontBufferCacheStats {
+  FontBufferCacheStats()
+      : hits(0), misses(0), evictions(0), num_buffers(0), bytes(0) {}
+
+  /// @brief # of GetBuffer() calls returning a cached buffer.
+  uint32_t hits;
+  /// @brief # of GetBuffer() calls laying out a new buffer.
+  uint32_t misses;
+  /// @brief # of non-ref-counted buffers evicted to fit in the budget.
+  uint32_t evictions;
+  /// @brief # of buffers in the cache.
+  size_t num_buffers;
+  /// @brief Memory used by buffers in the cache, in bytes.
+  size_t bytes;
+};
+
+/// @struct TextPipelineStats
+///
+/// @brief Counters and timers of the text pipeline in FontManager.
+///
+/// Glyph, shaping and upload counters are collected only while
+/// `FontManager::EnableTextPipelineStats()` is on. They are updated with
+/// relaxed atomic operations, and are cheap enough to be enabled in release
+/// builds. Times are in microseconds, summed over all threads.
+struct TextPipelineStats {
+  TextPipelineStats()
+      : glyph_lookups(0),
+        glyph_hits(0),
+        glyph_misses(0),
+        glyph_sets(0),
+        rasterize_time(0),
+        sdf_time(0),
+        shaping_time(0),
+        shaped_runs(0),
+        simple_runs(0),
+        upload_bytes(0),
+        buffer_hits(0),
+        buffer_misses(0),
+        buffer_evictions(0) {}
+
+  /// @brief # of glyph cache look-ups by layouts.
+  uint64_t glyph_lookups;
+  /// @brief # of look-ups finding the glyph in the glyph cache.
+  uint64_t glyph_hits;
+  /// @brief # of look-ups missing the glyph in the glyph cache.
+  uint64_t glyph_misses;
+  /// @brief # of glyphs stored to the glyph cache.
+  uint64_t glyph_sets;
+  /// @brief Time rendering glyph bitmaps with FreeType, including
+  /// asynchronous rasterization workers.
+  uint64_t rasterize_time;
+  /// @brief Time generating distance fields of SDF and multi-channel SDF
+  /// glyphs in the CPU.
+  uint64_t sdf_time;
+  /// @brief Time shaping text runs with HarfBuzz.
+  uint64_t shaping_time;
+  /// @brief # of text runs shaped with HarfBuzz. Runs restored from the
+  /// shaping cache are not counted.
+  uint64_t shaped_runs;
+  /// @brief # of text runs laid out without HarfBuzz, see
+  /// `EnableSimpleTextLayout()`.
+  uint64_t simple_runs;
+  /// @brief Bytes of glyph images uploaded to the atlas textures.
+  uint64_t upload_bytes;
+  /// @brief Counters of the FontBuffer cache, the same as
+  /// `FontBufferCacheStats`, which are always collected.
+  uint64_t buffer_hits;
+  uint64_t buffer_misses;
+  uint64_t buffer_evictions;
+};
+
+/// @var kMemoryBudgetUnlimited
+///
+/// @brief A budget of `FontMemoryBudget` that never triggers evictions.
+const size_t kMemoryBudgetUnlimited = 0;
+
+/// @struct FontMemoryUsage
+///
+/// @brief A breakdown of memory used by FontManager, in bytes.
+struct FontMemoryUsage {
+  FontMemoryUsage()
+      : atlas_monochrome(0),
+        atlas_color(0),
+        atlas_msdf(0),
+        glyph_entries(0),
+        font_buffers(0),
+        mapped_font_data(0),
+        copied_font_data(0),
+        harfbuzz_fonts(0),
+        hyphenation(0),
+        layout_caches(0) {}
+
+  /// @brief Slices of the glyph cache for monochrome and SDF glyphs, color
+  /// glyphs and multi-channel SDF glyphs. Atlas textures use the same size
+  /// in the GPU.
+  size_t atlas_monochrome;
+  size_t atlas_color;
+  size_t atlas_msdf;
+  /// @brief The glyph look-up map and row metadata of the glyph cache.
+  size_t glyph_entries;
+  /// @brief Vertices, indices, carets and other layout data of cached and
+  /// pooled FontBuffers.
+  size_t font_buffers;
+  /// @brief Font file data mapped from files, which the OS can page out.
+  size_t mapped_font_data;
+  /// @brief Font file data copied to the memory.
+  size_t copied_font_data;
+  /// @brief HarfBuzz font instances and codepoint coverage tables of faces.
+  size_t harfbuzz_fonts;
+  /// @brief Hyphenation patterns, mapped or loaded, and the hyphenation
+  /// cache.
+  size_t hyphenation;
+  /// @brief The shaping, word break, HTML and color glyph caches.
+  size_t layout_caches;
+
+  /// @return Returns the sum of all categories.
+  size_t total() const {
+    return atlas_monochrome + atlas_color + atlas_msdf + glyph_entries +
+           font_buffers + mapped_font_data + copied_font_data + harfbuzz_fonts +
+           hyphenation + layout_caches;
+  }
+};
+
+/// @struct FontMemoryBudget
+///
+/// @brief Memory budgets of FontManager, in bytes. When memory exceeds a
+/// budget, FontManager evicts the least recently used contents that are not
+/// used in the current or the previous pass, so the memory may exceed the
+/// budget temporarily. `kMemoryBudgetUnlimited` disables the eviction.
+struct FontMemoryBudget {
+  FontMemoryBudget()
+      : font_buffers(kMemoryBudgetUnlimited),
+        atlas(kMemoryBudgetUnlimited),
+        fallback_font_data(kMemoryBudgetUnlimited) {}
+
+  /// @brief FontBuffers in the cache, the same as
+  /// `FontManager::SetFontBufferCacheBudget()`.
+  size_t font_buffers;
+  /// @brief Slices of the glyph cache. Trailing slices are removed in render
+  /// passes, and at least one slice of each glyph format is kept.
+  size_t atlas;
+  /// @brief Font file data of faces in the system font's fallback list other
+  /// than the first one. Faces are closed, and opened again when a layout
+  /// needs one of their codepoints.
+  size_t fallback_font_data;
+};
+
+/// @enum MemoryTrimLevel
+///
+/// @brief Levels of `FontManager::TrimMemory()`.
+enum MemoryTrimLevel {
+  /// @brief Release FontBuffers and glyph cache slices not used recently and
+  /// close fallback faces. Matches Android's `TRIM_MEMORY_RUNNING_LOW`,
+  /// `TRIM_MEMORY_UI_HIDDEN` and `TRIM_MEMORY_BACKGROUND`.
+  kMemoryTrimLevelModerate = 0,
+  /// @brief Release layout caches and unused hyphenation patterns too.
+  /// Matches Android's `TRIM_MEMORY_RUNNING_CRITICAL`,
+  /// `TRIM_MEMORY_MODERATE` and `TRIM_MEMORY_COMPLETE`.
+  kMemoryTrimLevelComplete = 1,
+};
+
 /// @class FontManager
 ///
 /// @brief FontManager manages font rendering with OpenGL utilizing freetype
@@ -112,8 +331,11 @@ static const HashedId kSystemFontId = HashId(kSystemFont);
 /// It opens speficied OpenType/TrueType font and rasterize to OpenGL texture.
 /// An application can use the generated texture for a text rendering.
 ///
-/// @warning The class is not threadsafe, it's expected to be only used from
-/// within OpenGL rendering thread.
+/// @warning Only layout APIs, such as `GetBuffer()`, `GetHtmlBuffer()` and
+/// `SelectFont()`, can be called from multiple threads. Each thread has its
+/// own selected font, layout state and instances of font faces, so layouts
+/// run in parallel. Other APIs are expected to be only used from within
+/// OpenGL rendering thread.
 class FontManager {
  public:
   /// @brief The default constructor for FontManager.
@@ -130,9 +352,59 @@ class FontManager {
   /// more cache spaces up to the value.
   FontManager(const mathfu::vec2i &cache_size, int32_t max_slices);
 
+  /// @brief Constructor for FontManager with a given cache size and a size of
+  /// SDF scratch buffers.
+  ///
+  /// Generating an SDF glyph uses scratch buffers sized to the glyph. With
+  /// this constructor, the buffers are allocated upfront for glyphs up to
+  /// max_sdf_glyph_size, so that rendering SDF glyphs doesn't allocate them.
+  /// Buffers still grow on demand for larger glyphs.
+  ///
+  /// @param[in] cache_size The size of the cache, in pixels as x & y values.
+  /// @param[in] max_slices The maximum number of cache slices.
+  /// @param[in] max_sdf_glyph_size The largest glyph bitmap size expected for
+  /// SDF glyphs, in pixels without SDF padding.
+  FontManager(const mathfu::vec2i &cache_size, int32_t max_slices,
+              const mathfu::vec2i &max_sdf_glyph_size);
+
+  /// @brief Constructor for FontManager sharing a glyph cache and font faces
+  /// with other FontManagers.
+  ///
+  /// Managers created with the same resources rasterize and upload a glyph
+  /// once, and open a font file once. Fonts still need to be opened in each
+  /// manager to be selected there, which only adds a reference to a face
+  /// opened by another manager. Selected fonts, layout settings and
+  /// FontBuffers stay per manager.
+  ///
+  /// Glyph cache settings, such as `EnableColorGlyph()` or
+  /// `SetGlyphCacheMaxSlices()`, apply to all managers sharing the resources.
+  /// Layouts of the managers run in parallel with each other.
+  ///
+  /// @param[in] resources Resources created with `CreateSharedResources()` or
+  /// retrieved with `GetSharedResources()`.
+  explicit FontManager(const std::shared_ptr<FontResources> &resources);
+
   /// @brief The destructor for FontManager.
+  ///
+  /// Shared resources are released with the last manager using them.
   ~FontManager();
 
+  /// @brief Create a glyph cache and a registry of font faces to share
+  /// between FontManagers.
+  ///
+  /// @param[in] cache_size The size of the cache, in pixels as x & y values.
+  /// @param[in] max_slices The maximum number of cache slices.
+  /// @return Returns a reference counted handle to pass to
+  /// `FontManager(const std::shared_ptr<FontResources> &)`.
+  static std::shared_ptr<FontResources> CreateSharedResources(
+      const mathfu::vec2i &cache_size, int32_t max_slices);
+
+  /// @return Returns the glyph cache and font faces of the manager, to create
+  /// other FontManagers sharing them.
+  std::shared_ptr<FontResources> GetSharedResources() const {
+    return resources_;
+  }
+
   /// @brief Open a font face, TTF, OT font.
   ///
   /// In this version it supports only single face at a time.
@@ -154,6 +426,37 @@ class FontManager {
   /// if the font is opened successfully.
   bool Open(const FontFamily &family);
 
+  /// @brief Open a font face in a background thread.
+  ///
+  /// The font file is loaded and its cmap is read in a worker thread. The
+  /// FreeType face and the harfbuzz font are created when the font is
+  /// published at the start of a following layout pass, or in
+  /// `WaitForFonts()`, and `callback` is called there. Until then, the font
+  /// can't be selected. A font opened with the API is closed with `Close()`
+  /// like fonts opened with `Open()`.
+  /// Fonts that are already open and `kSystemFont` are opened synchronously,
+  /// and `callback` is called before the API returns.
+  ///
+  /// @param[in] family A FontFamily structure indicating font parameters.
+  /// @param[in] callback A function called with `true` when the font is
+  /// opened, or `false` when it failed to open the font. It can be `nullptr`.
+  void OpenAsync(const FontFamily &family,
+                 const std::function<void(bool)> &callback);
+
+  /// @brief Open a font face by name in a background thread.
+  /// @see OpenAsync(const FontFamily &, const std::function<void(bool)> &)
+  void OpenAsync(const char *font_name,
+                 const std::function<void(bool)> &callback);
+
+  /// @brief Wait for fonts being opened by `OpenAsync()` and publish them.
+  void WaitForFonts();
+
+  /// @brief Check if there are fonts being opened in the background.
+  ///
+  /// @return Returns true if some fonts opened by `OpenAsync()` are not
+  /// published yet.
+  bool HasPendingFonts();
+
   /// @brief Discard a font face that has been opened via `Open()`.
   ///
   /// @param[in] font_name A C-string in UTF-8 format representing
@@ -221,6 +524,55 @@ class FontManager {
   FontBuffer *GetBuffer(const char *text, size_t length,
                         const FontBufferParameters &parameters);
 
+  /// @brief Retrieve vertex buffers of multiple texts in one call.
+  ///
+  /// The result is the same as calling `GetBuffer()` for each request in
+  /// order. Glyphs shared by requests are rasterized once. When the
+  /// asynchronous glyph rasterization is enabled, glyph images of the whole
+  /// batch are rendered in parallel by the worker threads, and committed to
+  /// the glyph cache together before the API returns, so the buffers don't
+  /// have blank glyphs.
+  ///
+  /// When the parallel layout is enabled with `EnableParallelLayout()`, texts
+  /// are shaped and broken into lines by the workers in parallel. Glyphs
+  /// missing in the glyph cache are laid out with their metrics, and added to
+  /// the glyph cache afterwards in the order of the requests, so that they are
+  /// placed the same way as the sequential calls. A text is laid out again in
+  /// the calling thread only when the glyph cache is flushed meanwhile, or it
+  /// has glyphs rendered to know their metrics, such as color glyphs.
+  ///
+  /// @param[in] requests An array of texts and parameters to lay out.
+  /// @param[in] count The # of requests.
+  /// @param[out] buffers An array receiving `count` buffers, in the order of
+  /// the requests. An entry is `nullptr` if the text does not fit in the glyph
+  /// cache.
+  void GetBuffers(const FontBufferRequest *requests, size_t count,
+                  FontBuffer **buffers);
+
+  /// @brief Retrieve a vertex buffer for an edited text, reusing lines of the
+  /// buffer of the text before the edit.
+  ///
+  /// Lines of a multi line buffer ending before the line preceding the edit
+  /// are copied from the previous buffer, and only following lines are laid
+  /// out again. When lines can't be reused (e.g. the first lines are edited
+  /// or the glyph cache has been flushed), the text is laid out as
+  /// GetBuffer() does.
+  ///
+  /// @param[in] base_parameters The FontBufferParameters the text before the
+  /// edit was laid out with GetBuffer() or EditBuffer().
+  /// @param[in] text A C-string in UTF-8 format with the edited text.
+  /// @param[in] length The length of the text string.
+  /// @param[in] parameters The FontBufferParameters for the edited text. All
+  /// parameters but the text id need to match base_parameters to reuse lines.
+  /// @param[in] edit_start Byte offset of the first character that differs
+  /// between the texts before and after the edit.
+  ///
+  /// @return Returns `nullptr` if the string does not fit in the glyph cache.
+  FontBuffer *EditBuffer(const FontBufferParameters &base_parameters,
+                         const char *text, size_t length,
+                         const FontBufferParameters &parameters,
+                         size_t edit_start);
+
   /// @brief Retrieve a vertex buffer for basic HTML rendering.
   ///
   /// @param[in] html A C-string in UTF-8 format with the HTML to be rendered.
@@ -282,23 +634,86 @@ class FontManager {
   /// @brief Flush the existing glyph cache contents and start new layout pass.
   ///
   /// Call this API while in a layout pass when the glyph cache is fragmented.
-  // Returns false if the API failed to acquire a mutex when it's running in
-  // multithreaded mode. In that case, make sure the caller invokes the API
-  // repeatedly.
+  /// It waits for layouts running in other threads to finish.
   bool FlushAndUpdate() { return UpdatePass(true); }
 
   /// @brief Flush the existing FontBuffer in the cache.
   ///
   /// Call this API when FontBuffers are not used anymore.
-  void FlushLayout() {
-    for (auto it = map_buffers_.begin(); it != map_buffers_.end(); it++) {
-      // Erase only non-ref-counted buffers.
-      if (!it->first.get_ref_count_flag()) {
-        map_buffers_.erase(it);
-      }
-    }
+  void FlushLayout();
+
+  /// @brief Set a memory budget of the FontBuffer cache.
+  ///
+  /// Non-ref-counted buffers are kept in the cache until they are flushed, so
+  /// that texts laid out every frame are looked up instead of laid out again.
+  /// When buffers in the cache exceed the budget, the least recently used
+  /// non-ref-counted buffers are evicted. Buffers looked up in the current or
+  /// the previous pass are never evicted, so the cache may exceed the budget
+  /// temporarily. Ref-counted buffers are counted in the budget, but are only
+  /// removed with ReleaseBuffer().
+  ///
+  /// Passes are counted by StartRenderPass(), which `flatui::Run()` calls
+  /// every frame. Without it, all buffers stay in the current pass and the
+  /// cache isn't evicted, so call it once per frame when laying out texts
+  /// without `flatui::Run()`.
+  ///
+  /// @param[in] bytes The budget in bytes. `kFontBufferCacheUnlimited`
+  /// (the default) disables the eviction.
+  void SetFontBufferCacheBudget(size_t bytes);
+
+  /// @return Returns the memory budget of the FontBuffer cache in bytes.
+  size_t GetFontBufferCacheBudget() const { return buffer_cache_budget_; }
+
+  /// @return Returns usage counters of the FontBuffer cache.
+  const FontBufferCacheStats &GetFontBufferCacheStats() const {
+    return buffer_cache_stats_;
+  }
+
+  /// @brief Reset hit, miss and eviction counters of the FontBuffer cache.
+  void ResetFontBufferCacheStats();
+
+  /// @brief Enable or disable collecting text pipeline counters and timers.
+  ///
+  /// @param[in] enable `true` to collect them. Disabled by default, which
+  /// keeps the collected values.
+  void EnableTextPipelineStats(bool enable) {
+    text_pipeline_counters_.set_enabled(enable);
   }
 
+  /// @return Returns a snapshot of the text pipeline counters.
+  TextPipelineStats GetTextPipelineStats() const;
+
+  /// @brief Reset the text pipeline counters including FontBuffer cache
+  /// hits, misses and evictions.
+  void ResetTextPipelineStats();
+
+  /// @return Returns a breakdown of memory used by FontManager.
+  FontMemoryUsage GetMemoryUsage() const;
+
+  /// @brief Set memory budgets of FontBuffers, the glyph cache and fallback
+  /// faces of the system font.
+  ///
+  /// FontBuffers and fallback faces are evicted right away, and glyph cache
+  /// slices are removed in the next render pass.
+  ///
+  /// @param[in] budget The budgets. All are unlimited by default.
+  void SetMemoryBudget(const FontMemoryBudget &budget);
+
+  /// @return Returns the memory budgets.
+  FontMemoryBudget GetMemoryBudget() const;
+
+  /// @brief Release memory that is not needed for the current frame, e.g.
+  /// from Android's `onTrimMemory()`.
+  ///
+  /// It works as if all budgets were 0 once: FontBuffers and fallback faces
+  /// not used in the current or the previous pass are released right away,
+  /// and glyph cache slices are removed in the next render pass, since their
+  /// textures are deleted in the rendering thread. Pooled FontBuffers are
+  /// freed too.
+  ///
+  /// @param[in] level The level selecting which caches to release.
+  void TrimMemory(MemoryTrimLevel level);
+
   /// @brief Indicates a start of new render pass.
   ///
   /// Call the API each time the user starts a render pass.
@@ -307,20 +722,26 @@ class FontManager {
   // repeatedly.
   bool StartRenderPass() { return UpdatePass(false); }
 
+  /// @return Returns the revision of the font atlas textures, which changes
+  /// whenever glyphs are uploaded to the atlas.
+  int32_t GetAtlasRevision() const { return current_atlas_revision_; }
+
   /// @return Returns font atlas texture.
   ///
   /// @param[in] slice an index indicating an atlas texture.
   /// An index with kGlyphFormatsColor indicates that the slice is a multi
-  /// channel buffer for color glyphs.
+  /// channel buffer for color glyphs, and kGlyphFormatsMultiChannelSDF for
+  /// multi-channel SDF glyphs.
   fplbase::Texture *GetAtlasTexture(int32_t slice) {
     // Note: We don't need to lock cache_mutex_ because we're just returning
     //       a GL texture in an array. No need to lock the GL thread.
-    if (!(slice & kGlyphFormatsColor)) {
-      return glyph_cache_->get_monochrome_buffer()->get_texture(slice);
-    } else {
-      return glyph_cache_->get_color_buffer()->get_texture(slice &
-                                                           ~kGlyphFormatsColor);
+    auto index = slice & ~kGlyphFormatsMask;
+    if (slice & kGlyphFormatsColor) {
+      return glyph_cache_->get_color_buffer()->get_texture(index);
+    } else if (slice & kGlyphFormatsMultiChannelSDF) {
+      return glyph_cache_->get_msdf_buffer()->get_texture(index);
     }
+    return glyph_cache_->get_monochrome_buffer()->get_texture(index);
   }
 
   /// @brief The user can supply a size selector function to adjust glyph sizes
@@ -335,6 +756,17 @@ class FontManager {
     size_selector_.swap(selector);
   }
 
+  /// @brief Set a size of glyphs cached with kGlyphFlagsMultiChannelSDF.
+  ///
+  /// @param[in] size Multi-channel SDF glyphs are generated from glyph
+  /// outlines in the size regardless of requested sizes, and scaled to the
+  /// requested sizes when they are rendered. Larger sizes keep more details
+  /// of complex glyphs at the cost of atlas space. Default is
+  /// kMultiChannelSDFGlyphSizeDefault.
+  ///
+  /// @note Call this before laying out multi-channel SDF texts.
+  void SetMultiChannelSDFGlyphSize(int32_t size) { msdf_glyph_size_ = size; }
+
   /// @param[in] locale  A C-string corresponding to the of the
   /// language defined in ISO 639 and the country code difined in ISO 3166
   /// separated
@@ -377,27 +809,324 @@ class FontManager {
   /// required for the hyphenation process. On Android,
   /// "/system/usr/hyphen-data" is the default search path.
   ///
-  void SetupHyphenationPatternPath(const char *hyb_path) {
-    if (hyb_path != nullptr) {
-      hyb_path_ = hyb_path;
-    }
-    if (!hyphenation_rule_.empty() && !hyb_path_.empty()) {
-      std::string pattern_file =
-          hyb_path_ + "/hyph-" + hyphenation_rule_ + ".hyb";
-      hyphenator_.Open(pattern_file.c_str());
-    }
+  /// Patterns of each hyphenation rule are opened the first time they're used
+  /// and kept until the path changes.
+  void SetupHyphenationPatternPath(const char *hyb_path);
+
+  /// @brief Hyphenate all words of a paragraph in one call.
+  ///
+  /// Words are separated by whitespace, and hyphenated with the current
+  /// hyphenation pattern. Results of recently hyphenated words are cached, so
+  /// rewrapping a paragraph doesn't hyphenate its words again.
+  ///
+  /// @param[in] text A UTF-8 text of the paragraph.
+  /// @param[in] length The length of the text in bytes.
+  /// @param[out] hyphenation_points Resized to `length`. An entry is 1 when a
+  /// hyphen can be inserted before the byte at the offset, 0 otherwise. Pass
+  /// the same vector again to reuse its memory.
+  void HyphenateParagraph(const char *text, size_t length,
+                          std::vector<uint8_t> *hyphenation_points);
+
+  /// @brief Set the max # of words kept in the hyphenation cache.
+  ///
+  /// 0 disables the cache. Default is 256.
+  ///
+  /// @param[in] size # of words in the cache.
+  void SetHyphenationCacheSize(size_t size) {
+    fplutil::MutexLock lock(*cache_mutex_);
+    hyphenation_cache_.set_capacity(size);
   }
 
   /// @return Returns the current layout direciton.
   TextLayoutDirection GetLayoutDirection() { return layout_direction_; }
 
-  /// @return Returns the current font.
-  HbFont *GetCurrentFont() { return current_font_; }
+  /// @return Returns the font selected in the calling thread. Threads start
+  /// with the font selected in the thread that created the FontManager.
+  HbFont *GetCurrentFont() { return GetLayoutContext()->current_font; }
+
+  /// @brief Release the layout state of the calling thread.
+  ///
+  /// Call this before a thread that laid out texts exits. The state is
+  /// created again if the thread lays out texts afterwards. It does nothing
+  /// in the thread that created the FontManager.
+  void ReleaseLayoutContext();
 
   /// @brief Enable an use of color glyphs in supporting OTF/TTF font.
   /// The API will initialize internal glyph cache for color glyphs.
   void EnableColorGlyph();
 
+  /// @brief Set a packing strategy of glyphs in the glyph cache.
+  ///
+  /// @param[in] packing kGlyphCachePackingSkyline stacks shorter glyphs in
+  /// taller cache rows, which packs glyphs in mixed sizes more densely.
+  /// Default is kGlyphCachePackingRow.
+  ///
+  /// @note Changing the strategy flushes the glyph cache.
+  void SetGlyphCachePacking(GlyphCachePacking packing);
+
+  /// @brief Enable a compaction of the glyph cache.
+  ///
+  /// @param[in] enable When enabled, the glyph cache moves cached glyphs
+  /// between cache rows to free up space before failing to cache a glyph,
+  /// which would flush the entire glyph cache. FontBuffers referencing moved
+  /// glyphs update their UVs when they are retrieved next time.
+  void EnableGlyphCacheCompaction(bool enable);
+
+  /// @brief Set an upload mode of glyph cache textures.
+  ///
+  /// @param[in] mode kGlyphCacheUploadModeSubRect uploads only dirty regions
+  /// of the glyph cache, using multiple rects per atlas slice.
+  /// kGlyphCacheUploadModeAsync streams the regions through pixel buffer
+  /// objects, and FontBuffers report kFontBufferStatusNeedCacheUpdate until
+  /// the uploads complete. It falls back to kGlyphCacheUploadModeSubRect on
+  /// OpenGL ES 2.0. Default is kGlyphCacheUploadModeFullWidth which uploads
+  /// full width scanlines.
+  void SetGlyphCacheUploadMode(GlyphCacheUploadMode mode);
+
+  /// @brief Set the max # of glyph cache slices of each glyph format.
+  ///
+  /// Slices are allocated on demand up to the max. When the max is lowered,
+  /// slices beyond it are removed in a render pass once their glyphs are not
+  /// used in the current or the previous pass. Call it in the rendering
+  /// thread outside of a frame, since textures of slices may be reallocated.
+  ///
+  /// @param[in] max_slices The max # of slices, 1 or larger.
+  void SetGlyphCacheMaxSlices(int32_t max_slices);
+
+  /// @return Returns the max # of glyph cache slices of each glyph format.
+  int32_t GetGlyphCacheMaxSlices() const;
+
+  /// @brief Release glyph cache slices that are not used for a while.
+  ///
+  /// In a render pass, the last slice of each glyph format is removed with its
+  /// texture when none of its glyphs are used for `idle_passes` rendering
+  /// passes, so that the atlas shrinks after a burst of glyphs, e.g. a screen
+  /// showing many scripts. The first slice is always kept.
+  ///
+  /// @param[in] idle_passes # of passes a slice is kept after its last use.
+  /// 0 disables the release. (Default.)
+  void EnableGlyphCacheSliceRelease(int32_t idle_passes);
+
+  /// @brief Enable asynchronous glyph rasterization.
+  ///
+  /// @param[in] num_workers # of worker threads rendering glyph images. When
+  /// enabled, glyphs missing in the glyph cache are laid out with their
+  /// metrics and rendered in the worker threads, and the images are committed
+  /// to the glyph cache in following rendering passes. Glyphs are left blank
+  /// until their images arrive. Bitmap fonts and color glyphs are still
+  /// rendered synchronously. 0 disables the feature. (Default.)
+  void EnableAsyncGlyphRasterization(int32_t num_workers);
+
+  /// @brief Enable parallel layouts of `GetBuffers()`.
+  ///
+  /// @param[in] num_workers # of worker threads laying out texts of a
+  /// `GetBuffers()` call together with the calling thread. Each worker has
+  /// its own layout context and font faces, kept while the workers run. 0
+  /// disables the feature, and requests are laid out in the calling thread.
+  /// (Default.) Needs to be called while no `GetBuffers()` call is running.
+  void EnableParallelLayout(int32_t num_workers);
+
+  /// @brief Check if there are glyph images being rendered asynchronously.
+  ///
+  /// @return Returns true if some glyphs in FontBuffers are still blank.
+  bool HasPendingGlyphs();
+
+  /// @brief Set the max # of text runs kept in the shaping cache.
+  ///
+  /// HarfBuzz output of recently laid out text runs is cached by the text,
+  /// the font, the pixel size, the script, the language and the direction,
+  /// so that texts laid out again with other parameters (e.g. an animated
+  /// label size mapped to the same glyph size, or a changed alignment) skip
+  /// shaping. 0 disables the cache. Default is 256.
+  ///
+  /// @param[in] size # of text runs in the cache.
+  void SetShapingCacheSize(size_t size);
+
+  /// @brief Enable laying out simple text runs without HarfBuzz.
+  ///
+  /// Left-to-right runs of Latin-1 text, in a script shaped without
+  /// script-specific rules (e.g. Latin, Greek, Cyrillic or Han), whose glyphs
+  /// the font doesn't substitute or position other than by pair kerning, are
+  /// laid out from advances and kerning pairs looked up from HarfBuzz once
+  /// per face and size. It makes laying out texts that change often, such as
+  /// numeric counters, cheaper than shaping them, and gives the same result
+  /// unless the font kerns glyphs depending on more than a pair of them.
+  /// Default is `false`.
+  ///
+  /// @param[in] enable Set `true` to lay out simple runs without HarfBuzz.
+  void EnableSimpleTextLayout(bool enable) { simple_text_layout_ = enable; }
+
+  /// @brief Set the max # of texts kept in the word break cache.
+  ///
+  /// Word breaks and font face runs of recently laid out texts are cached, so
+  /// that wrapped texts laid out again with a different size (e.g. a label in
+  /// a resizing panel) only run the line breaker over words, which are
+  /// restored from the shaping cache. 0 disables the cache. Default is 64.
+  ///
+  /// @param[in] size # of texts in the cache.
+  void SetWordBreakCacheSize(size_t size);
+
+  /// @brief Set the max # of HTML strings kept in the HTML cache.
+  ///
+  /// Sections parsed from recently laid out HTML strings are cached, so that
+  /// `GetHtmlBuffer()` calls missing the FontBuffer cache with an unchanged
+  /// HTML skip parsing. 0 disables the cache. Default is 128.
+  ///
+  /// @param[in] size # of HTML strings in the cache.
+  void SetHtmlCacheSize(size_t size);
+
+  /// @brief Set the max # of color glyphs kept in the color glyph cache.
+  ///
+  /// Color glyphs (e.g. emoji) come in a fixed bitmap size from the font, and
+  /// are scaled to each glyph size used. Bitmaps of recently used color glyphs
+  /// and their mipmaps are cached, so that a color glyph shown at a new size
+  /// is scaled from the nearest mip level without loading it from the font.
+  /// 0 disables the cache. Default is 32.
+  ///
+  /// @param[in] size # of color glyphs in the cache.
+  void SetColorGlyphCacheSize(size_t size);
+
+  /// @brief Enable compact vertices in FontBuffers created afterwards.
+  ///
+  /// When enabled, a FontBuffer keeps a packed copy of its vertices
+  /// (PackedFontVertex, 12 bytes per vertex instead of 20) that renderers
+  /// stream to the GPU instead of FontVertex. The FontVertex array is still
+  /// kept for layout queries such as caret positions and underlines.
+  /// Default is `false`.
+  ///
+  /// @param[in] enable Set `true` to enable compact vertices.
+  void EnableCompactVertices(bool enable) { compact_vertices_ = enable; }
+
+  /// @return Returns `true` if compact vertices are enabled.
+  bool CompactVerticesEnabled() const { return compact_vertices_; }
+
+  /// @brief Enable glyph instances in FontBuffers created afterwards.
+  ///
+  /// When enabled, a FontBuffer keeps a GlyphInstance per glyph (24 bytes
+  /// instead of 4 vertices) in its vertex buffer object, and renderers draw
+  /// the glyphs with instanced draws that expand the quads in the vertex
+  /// shader. Glyph cache flushes update only the UV rectangle of instances.
+  /// Glyph instances take precedence over compact vertices, and are rendered
+  /// from vertex buffers whether EnableVertexBuffers() is set or not.
+  /// The FontVertex array is still kept for layout queries.
+  ///
+  /// Instanced draws need OpenGL ES 3.0 or OpenGL 3.3. The call is ignored on
+  /// other platforms, so invoke it after the renderer is initialized.
+  /// Default is `false`.
+  ///
+  /// @param[in] enable Set `true` to enable glyph instances.
+  void EnableGlyphInstances(bool enable);
+
+  /// @return Returns `true` if glyph instances are enabled.
+  bool GlyphInstancesEnabled() const { return glyph_instances_; }
+
+  /// @brief Enable rendering FontBuffers from GPU vertex buffers.
+  ///
+  /// When enabled, renderers draw a FontBuffer from a vertex buffer object
+  /// it owns (FontBuffer::GetVertexBuffer()), which is uploaded only when the
+  /// buffer changes, instead of streaming the vertices every frame. Vertex
+  /// buffers of FontBuffers released or evicted in any thread are deleted in
+  /// the following StartRenderPass(). Default is `false`.
+  ///
+  /// @param[in] enable Set `true` to enable vertex buffers.
+  void EnableVertexBuffers(bool enable) { vertex_buffers_ = enable; }
+
+  /// @return Returns `true` if vertex buffers are enabled.
+  bool VertexBuffersEnabled() const { return vertex_buffers_; }
+
+  /// @brief Load faces of the system font's fallback list on demand.
+  ///
+  /// When enabled, OpenSystemFont() only opens the first face of the fallback
+  /// list. Other faces only have the cmap table of their font read to record
+  /// the codepoints they cover, and are opened when a layout needs one of
+  /// their codepoints.
+  /// Faces that are not used in a layout for `eviction_passes` rendering
+  /// passes are closed again. Call it before opening `kSystemFont`.
+  ///
+  /// @param[in] eviction_passes # of rendering passes a fallback face is kept
+  /// open after its last use. 0 disables the feature. (Default.)
+  void EnableLazySystemFont(int32_t eviction_passes) {
+    system_font_eviction_passes_ = eviction_passes;
+  }
+
+  /// @brief Enable a persistent glyph cache stored in a file.
+  ///
+  /// Glyph images and metrics rendered in the glyph cache are recorded and can
+  /// be written to the file with SaveDiskCache(). In following runs, glyphs
+  /// found in the file are copied to the glyph cache without rendering them
+  /// with FreeType. The file is memory mapped when possible.
+  /// Entries are keyed by the font file contents and SDF glyphs are only
+  /// reused with the same distance computer.
+  ///
+  /// @param[in] file_name A path to the cache file. The file is created when it
+  /// doesn't exist. nullptr disables the disk cache.
+  /// @return Returns true if the disk cache is enabled.
+  bool EnableDiskCache(const char *file_name);
+
+  /// @brief Write glyphs rendered since the disk cache was opened to the file.
+  ///
+  /// @return Returns true if the file is successfully written, or there was
+  /// nothing to write.
+  bool SaveDiskCache();
+
+  /// @brief Write glyphs in the glyph cache to a glyph atlas file.
+  ///
+  /// The file holds images of the glyph cache slices and an index of cached
+  /// glyphs (schemas/glyph_atlas.fbs). It's typically baked offline with
+  /// flatui_atlas_baker and loaded with LoadGlyphAtlas() at startup.
+  /// Only monochrome glyphs are written.
+  ///
+  /// @param[in] file_name A path to the atlas file.
+  /// @return Returns false if the file can't be written, or if some glyphs
+  /// have been evicted from the glyph cache, in which case the cache needs to
+  /// be larger to hold all glyphs.
+  bool SaveGlyphAtlas(const char *file_name);
+
+  /// @brief Load a glyph atlas file written by SaveGlyphAtlas().
+  ///
+  /// Glyphs in the atlas are stored in the glyph cache as pinned glyphs, which
+  /// are never evicted from the cache, so that texts using them are laid out
+  /// without rendering glyphs. Glyphs are keyed by font names, and fonts need
+  /// to be opened with the names used when the atlas was written.
+  ///
+  /// @param[in] file_name A path to the atlas file.
+  /// @return Returns false if the file is invalid or glyphs don't fit in the
+  /// glyph cache.
+  bool LoadGlyphAtlas(const char *file_name);
+
+  /// @brief Render glyphs of a text to the glyph cache ahead of time.
+  ///
+  /// The text is laid out with the current font and discarded, so that
+  /// following GetBuffer() calls with the glyphs don't render them. When
+  /// asynchronous glyph rasterization is enabled, the glyphs are rendered in
+  /// the worker threads.
+  ///
+  /// @param[in] text A UTF8 string of glyphs to render.
+  /// @param[in] size A size of the glyphs in pixels.
+  /// @param[in] flags GlyphFlags the glyphs are used with.
+  /// @return Returns false if no font is selected, or the glyphs don't fit in
+  /// the glyph cache.
+  bool PrewarmGlyphs(const char *text, float size, GlyphFlags flags);
+
+  /// @brief Render glyphs of a text to the glyph cache and pin them.
+  ///
+  /// Works as PrewarmGlyphs(), and the glyphs are placed in pinned rows of the
+  /// glyph cache that are never evicted, e.g. digits of a HUD counter that
+  /// changes every frame. Glyphs already in the cache are moved to pinned
+  /// rows, which requires FontBuffers using them to be reconstructed once.
+  ///
+  /// @param[in] text A UTF8 string of glyphs to pin.
+  /// @param[in] size A size of the glyphs in pixels.
+  /// @param[in] flags GlyphFlags the glyphs are used with.
+  /// @return Returns false if no font is selected, or the glyphs don't fit in
+  /// the glyph cache.
+  bool PinGlyphs(const char *text, float size, GlyphFlags flags);
+
+  /// @brief Unpin all glyphs pinned with PinGlyphs() or LoadGlyphAtlas().
+  ///
+  /// The glyphs stay in the glyph cache and are evicted as regular glyphs.
+  void UnpinGlyphs();
+
   /// @brief Set an ellipsis string used in label/edit widgets.
   ///
   /// @param[in] ellipsis A C-string specifying characters used as an ellipsis.
@@ -426,6 +1155,24 @@ class FontManager {
   /// @brief Factory function for the DistanceComputer.
   static DistanceComputer<uint8_t>*(*DistanceComputerFactory)(void);
 
+  /// @brief Built-in factory functions that can be set to
+  /// DistanceComputerFactory before a FontManager is constructed.
+  ///
+  /// CreateDefaultDistanceComputer() creates a fast propagation based
+  /// computer. (Default.)
+  /// CreateEuclideanDistanceComputer() creates a computer using a linear time
+  /// Euclidean distance transform, whose cost doesn't grow with glyph shapes,
+  /// which suits large glyph sizes better.
+  /// CreateGpuDistanceComputer() creates a computer running the Euclidean
+  /// distance in an OpenGL ES 3.1 / OpenGL 4.3 compute shader. Distance fields
+  /// are computed in `UpdatePass()` of the rendering pass and written to the
+  /// atlas textures directly, and the glyph cache receives them a few frames
+  /// later. Falls back to the CPU Euclidean distance transform where compute
+  /// shaders are not available.
+  static DistanceComputer<uint8_t>* CreateDefaultDistanceComputer();
+  static DistanceComputer<uint8_t>* CreateEuclideanDistanceComputer();
+  static DistanceComputer<uint8_t>* CreateGpuDistanceComputer();
+
  private:
   // Pass indicating rendering pass.
   static const int32_t kRenderPass = -1;
@@ -435,6 +1182,17 @@ class FontManager {
     kErrorTypeSuccess = 0,
     kErrorTypeMissingGlyph,
     kErrorTypeCacheIsFull,
+    // A glyph missing in the glyph cache, whose metrics are known only once
+    // it's rendered, is left to the ordered pass of GetBuffers().
+    kErrorTypeGlyphDeferred,
+  };
+
+  // Results of resolving glyphs of a buffer again after a glyph cache flush.
+  enum UVUpdateResult {
+    kUVUpdateSuccess = 0,
+    kUVUpdateGlyphMoved,  // A glyph is cached in a different slice.
+    kUVUpdateFontClosed,  // A font of a glyph has been closed.
+    kUVUpdateError,       // A glyph couldn't be cached.
   };
 
   // Initialize static data associated with the class.
@@ -459,6 +1217,11 @@ class FontManager {
                          FontBufferContext *context, mathfu::vec2 *pos,
                          FontMetrics *metrics);
 
+  // Helper function to drop glyphs of the shaped run in the layout context
+  // that start beyond the max width from the pen position `pos`.
+  void TruncateGlyphRun(const FontBufferParameters &parameters, float scale,
+                        const mathfu::vec2 &pos);
+
   // Helper function to determine how many entries to remove from the buffer.
   bool NeedToRemoveEntries(const FontBufferParameters &parameters,
                            uint32_t required_width, const FontBuffer *buffer,
@@ -494,23 +1257,86 @@ class FontManager {
   const GlyphCacheEntry *GetCachedEntry(uint32_t code_point, uint32_t y_size,
                                         GlyphFlags flags, ErrorType *error);
 
+  // Reserve a glyph cache entry with the glyph's metrics and queue a job
+  // rendering the glyph image in a worker thread.
+  // Returns nullptr and sets *error in the same condition as GetCachedEntry().
+  const GlyphCacheEntry *ReserveCachedEntry(const FaceData &face_data,
+                                            const GlyphKey &key,
+                                            ErrorType *error);
+
+  // Load a glyph outline and calculate the metrics of its cache entry, the
+  // bitmap origin and the bitmap size without SDF padding.
+  // Returns false and sets *error when the glyph can't be loaded.
+  bool LoadGlyphMetrics(const FaceData &face_data, const GlyphKey &key,
+                        GlyphCacheEntry *entry, mathfu::vec2i *origin,
+                        mathfu::vec2i *bitmap_size, ErrorType *error);
+
+  // Return a placeholder entry of a glyph missing in the glyph cache for the
+  // layout in a GetBuffers() worker, and record the glyph in the context.
+  // Returns nullptr and sets kErrorTypeGlyphDeferred when the glyph needs to
+  // be rendered to know its metrics.
+  const GlyphCacheEntry *GetPlaceholderEntry(const FaceData &face_data,
+                                             const GlyphKey &key,
+                                             ErrorType *error);
+
+  // Generate a multi-channel SDF of a glyph from its outline and store it in
+  // the glyph cache.
+  // Returns nullptr and sets *error in the same condition as GetCachedEntry().
+  const GlyphCacheEntry *GenerateMultiChannelSDF(const FaceData &face_data,
+                                                 const GlyphKey &key,
+                                                 ErrorType *error);
+
+  // Lay out a text in a scratch FontBuffer to render its glyphs to the glyph
+  // cache, flushing the cache once when it's full.
+  // pin: Store the glyphs in pinned rows.
+  bool CacheGlyphs(const char *text, float size, GlyphFlags flags, bool pin);
+
+  // Commit glyph images rendered in worker threads to the glyph cache.
+  void CommitRasterizedGlyphs();
+
+  // Commit distance fields read back from the GPU to the glyph cache.
+  void CommitDistanceFields();
+
+  // Record a glyph image in the disk cache when it's enabled.
+  // stride: Stride of the image in bytes.
+  void AddToDiskCache(HashedId font_hash, const GlyphKey &key,
+                      const GlyphCacheEntry &entry, const uint8_t *image,
+                      int32_t stride);
+
   // Update font manager, check glyph cache if the texture atlas needs to be
   // updated.
   // If start_subpass == true,
   // the API uploads the current atlas texture, flushes cache and starts
   // a sub layout pass. Use the feature when the cache is full and needs to
-  // flushed during a rendering pass.
-  // Returns false if the API failed to acquire a mutex when it's running in
-  // multithreaded mode. In that case, make sure the caller invokes the API
-  // repeatedly.
+  // flushed during a rendering pass. It waits for layouts in other threads.
+  // Otherwise, returns false if the API failed to acquire a mutex when it's
+  // running in multithreaded mode. In that case, make sure the caller invokes
+  // the API repeatedly.
   bool UpdatePass(bool start_subpass);
 
+  // Body of UpdatePass(), run holding the layout lock exclusively and
+  // cache_mutex_.
+  void UpdatePassLocked(bool start_subpass);
+
   // Update UV value in the FontBuffer.
   // Returns nullptr if one of UV values couldn't be updated.
   FontBuffer *UpdateUV(GlyphFlags flags, FontBuffer *buffer);
 
+  // Rewrite UVs of glyphs in place. Fails with kUVUpdateGlyphMoved if a glyph
+  // needs to move to an index buffer of another slice.
+  UVUpdateResult PatchUV(GlyphFlags flags, FontBuffer *buffer);
+
+  // Rebuild index buffers of the buffer along with UVs of glyphs.
+  UVUpdateResult RebuildUV(GlyphFlags flags, FontBuffer *buffer);
+
+  // Look up a cache entry of a glyph in a buffer, switching the current font
+  // to the face of the glyph. `face_id` keeps the current face over calls.
+  const GlyphCacheEntry *ResolveGlyph(const GlyphInfo &info, GlyphFlags flags,
+                                      HashedId *face_id,
+                                      UVUpdateResult *result);
+
   // Convert requested glyph size using SizeSelector if it's set.
-  int32_t ConvertSize(int32_t size);
+  int32_t ConvertSize(int32_t size, GlyphFlags flags);
 
   // Retrieve a caret count in a specific glyph from linebreak and halfbuzz
   // glyph information.
@@ -530,9 +1356,73 @@ class FontManager {
                            mathfu::vec2 *text_pos = nullptr,
                            ErrorType *error = nullptr);
 
+  // GetBuffers() with the parallel layout. Requests not in the buffer cache
+  // are laid out by workers, and registered in the order of the requests.
+  void LayoutBuffersInParallel(const FontBufferRequest *requests, size_t count,
+                               FontBuffer **buffers);
+
+  // Add placeholder glyphs of a buffer laid out by a GetBuffers() worker to
+  // the glyph cache, patch UVs of the buffer and add references to cache rows
+  // the buffer uses. Returns false when the buffer needs to be laid out again,
+  // as the glyph cache epoch changed from `epoch`, or a glyph got metrics
+  // different from its placeholder.
+  // Needs to be called holding cache_mutex_.
+  bool CommitLaidOutBuffer(const FontBufferParameters &parameters,
+                           const std::vector<PlaceholderGlyph> &placeholders,
+                           int32_t epoch, FontBuffer *buffer);
+
+  // Allocate a buffer and lay out a text in it, without registering it. It's
+  // called without cache_mutex_, which the layout acquires when it's needed.
+  // The text is laid out again when glyphs of the buffer may have been evicted
+  // or moved meanwhile, which GlyphCache::get_epoch() tells.
+  std::unique_ptr<FontBuffer> LayoutNewBuffer(
+      const char *text, uint32_t length, const FontBufferParameters &parameters,
+      mathfu::vec2 *text_pos, ErrorType *error);
+
   // Check if the requested buffer already exist in the cache.
   FontBuffer *FindBuffer(const FontBufferParameters &parameters);
 
+  // Register a created buffer to the buffer map with a reference count.
+  // Returns the buffer registered by another thread laying out the same
+  // parameters meanwhile, if any.
+  FontBuffer *RegisterBuffer(const FontBufferParameters &parameters,
+                             std::unique_ptr<FontBuffer> buffer);
+
+  // Remove a buffer from the buffer map.
+  void EraseBuffer(FontBuffer *buffer);
+
+  // Create an empty buffer, reusing a released buffer if available.
+  std::unique_ptr<FontBuffer> AllocateBuffer(uint32_t length,
+                                             bool caret_info);
+
+  // Keep a buffer that is no longer used for AllocateBuffer(), or free it if
+  // the pool is full or the buffer is large.
+  void RecycleBuffer(std::unique_ptr<FontBuffer> buffer);
+
+  // Remove all buffers from the buffer map.
+  void ClearBuffers();
+
+  // Free all buffers kept for AllocateBuffer().
+  void ClearBufferPool();
+
+  // Move the vertex buffer of a buffer going to be freed to
+  // released_vertex_buffers_.
+  void ReleaseVertexBuffer(FontBuffer *buffer);
+
+  // Evict least recently used non-ref-counted buffers until buffers in the map
+  // fit in the budget.
+  void EvictBuffers();
+  void EvictBuffers(size_t budget);
+
+  // Create a buffer of an edited text copying lines of the buffer with the
+  // base parameters before the edit, and laying out the rest of the text.
+  // Returns nullptr if lines of the buffer can't be reused, or the layout
+  // failed with an error.
+  FontBuffer *RelayoutBuffer(const FontBufferParameters &base_parameters,
+                             const char *text, uint32_t length,
+                             const FontBufferParameters &parameters,
+                             size_t edit_start, ErrorType *error);
+
   // Fill in the FontBuffer with the given text.
   FontBuffer *FillBuffer(const char *text, uint32_t length,
                          const FontBufferParameters &parameters,
@@ -543,6 +1433,28 @@ class FontManager {
   // Update language related settings.
   void SetLanguageSettings();
 
+  // Select the hyphenator of a hyphenation rule in the layout context,
+  // opening its pattern file when it's used for the first time.
+  void SelectHyphenator(const std::string &rule);
+
+  // Select the hyphenator used to lay out a buffer.
+  void SelectHyphenator(const FontBufferParameters &parameters);
+
+  // Get the layout context of the calling thread.
+  LayoutContext *GetLayoutContext();
+
+  // Release instances of faces opened by the layout contexts, of a face or of
+  // all faces. Called holding the layout lock exclusively.
+  void ReleaseFaceInstances(const FaceData &face);
+  void ClearFaceInstances();
+
+  // Scope of a layout API call. It holds the layout lock, shared by layouts
+  // and exclusively by APIs changing fonts or settings, points context_ to the
+  // context of the calling thread, and selects the face instances of the
+  // context.
+  class LayoutScope;
+  friend class LayoutScope;
+
   // Hyphenate given string and layout it.
   int32_t Hyphenate(const char *text, size_t length, int32_t available_space,
                     int32_t *rewind);
@@ -563,7 +1475,7 @@ class FontManager {
   /// @param[in] line_height A float representing the line height for a
   /// multi-line text.
   void SetLineHeightScale(float line_height_scale) {
-    line_height_scale_ = line_height_scale;
+    context_->line_height_scale = line_height_scale;
   }
 
   /// @brief Set a kerning scale value.
@@ -571,7 +1483,9 @@ class FontManager {
   /// @param[in] kerning_scale A float representing the kerning scale value
   /// applied to the kerning values retrieved from Harfbuzz used in the text
   /// rendering.
-  void SetKerningScale(float kerning_scale) { kerning_scale_ = kerning_scale; }
+  void SetKerningScale(float kerning_scale) {
+    context_->kerning_scale = kerning_scale;
+  }
 
   /// @brief  Retrieve the system's font fallback list and all fonts in the
   /// list.
@@ -580,10 +1494,11 @@ class FontManager {
   bool OpenSystemFont();
 
   /// @brief  Helper function to check font coverage.
-  /// @param[in] face FreeType face to check font coverage.
+  /// @param[in] face Font face to check font coverage.
   /// @param[out] font_coverage A set updated for the coverage map of the face.
   /// @return true if the specified font has a new glyph entry.
-  bool UpdateFontCoverage(FT_Face face, std::set<FT_ULong> *font_coverage);
+  bool UpdateFontCoverage(const FaceData &face,
+                          CodepointCoverage *font_coverage);
 
 /// @brief Platform specific implementation of a system font access.
 #ifdef __APPLE__
@@ -600,32 +1515,97 @@ class FontManager {
   /// OpenSystemFont().
   bool CloseSystemFont();
 
+  // Publish fonts loaded in the background, and call their callbacks.
+  void CommitOpenedFonts();
+
+  // Register a face of the system font's fallback list with the codepoints
+  // it covers, without opening it. Falls back to Open() when the cmap table
+  // of the font can't be read directly.
+  bool OpenFallbackCoverage(const FontFamily &family);
+
+  // Open a face of the system font's fallback list if it has been unloaded,
+  // and mark it used in the current pass.
+  void LoadSystemFontFace(FaceData *face);
+
+  // Unload faces of the system font's fallback list not used recently.
+  void EvictSystemFontFaces();
+
+  // Unload least recently used faces of the system font's fallback list until
+  // their font data fit in the budget.
+  void TrimSystemFontFaces(size_t budget);
+
+  // Glyph cache and font faces, possibly shared with other managers. Declared
+  // before the members referring to them.
+  std::shared_ptr<FontResources> resources_;
+
   // flag indicating if a font file has loaded.
   bool face_initialized_;
 
-  // Map that keeps opened face data instances.
-  std::unordered_map<std::string, std::unique_ptr<FaceData>> map_faces_;
+  // Map that keeps opened face data instances, in resources_.
+  std::unordered_map<std::string, std::unique_ptr<FaceData>> &map_faces_;
 
   // Used to cache font instances. Refers to memory owned by map_faces_.
-  HbFontCache font_cache_;
-
-  // Pointer to active font face instance.
-  HbFont *current_font_;
+  HbFontCache &font_cache_;
 
   // Cache for a texture atlas + vertex array rendering.
   // Using the FontBufferParameters as keys.
   // The map is used for GetBuffer() API.
-  std::map<FontBufferParameters, std::unique_ptr<FontBuffer>,
-           FontBufferParameters> map_buffers_;
+  std::unordered_map<FontBufferParameters, std::unique_ptr<FontBuffer>,
+                     FontBufferParameters> map_buffers_;
+
+  // Non-ref-counted buffers in map_buffers_, the most recently used first.
+  std::list<FontBuffer *> lru_buffers_;
+
+  // Released buffers kept to reuse their allocations, up to
+  // kFontBufferPoolSize. They hold no glyph cache row references.
+  std::vector<std::unique_ptr<FontBuffer>> buffer_pool_;
+
+  // Vertex buffers of freed FontBuffers, deleted in the render pass of
+  // UpdatePass() since buffers may be freed in any thread. Guarded by
+  // cache_mutex_.
+  std::vector<std::unique_ptr<FontVertexBuffer>> released_vertex_buffers_;
+
+  // Memory budget of map_buffers_ in bytes.
+  size_t buffer_cache_budget_;
+
+  // Memory budgets of glyph cache slices and fallback font data in bytes.
+  size_t atlas_budget_;
+  size_t fallback_font_budget_;
+
+  // Indicates if glyph cache slices are trimmed in the next render pass.
+  bool atlas_trim_pending_;
 
-  // Instance of Freetype library.
-  std::unique_ptr<FT_Library> ft_;
+  // # of passes an idle glyph cache slice is kept, or 0 to keep idle slices.
+  int32_t slice_release_passes_;
 
-  // Harfbuzz buffer.
-  hb_buffer_t *harfbuzz_buf_;
+  // Indicates if created buffers have packed vertices.
+  bool compact_vertices_;
 
-  // Unique pointer to a glyph cache.
-  std::unique_ptr<GlyphCache> glyph_cache_;
+  // Indicates if created buffers have glyph instances.
+  bool glyph_instances_;
+
+  // Indicates if simple text runs are laid out without HarfBuzz.
+  bool simple_text_layout_;
+
+  // Indicates if buffers are rendered from vertex buffer objects.
+  bool vertex_buffers_;
+
+  // Usage counters of map_buffers_.
+  FontBufferCacheStats buffer_cache_stats_;
+
+  // Counters of TextPipelineStats, shared with the glyph cache and glyph
+  // rasterization workers.
+  TextPipelineCounters text_pipeline_counters_;
+
+  // Instance of Freetype library, in resources_.
+  FT_Library *ft_;
+
+  // The glyph cache in resources_.
+  GlyphCache *glyph_cache_;
+
+  // Glyph cache counter after the last UpdatePass(). The counter is ticked
+  // only if no other manager sharing the cache ticked it since then.
+  uint32_t last_update_counter_;
 
   // Current atlas texture's contents revision.
   int32_t current_atlas_revision_;
@@ -639,6 +1619,9 @@ class FontManager {
   // Size selector function object used to adjust a glyph size.
   std::function<int32_t(const int32_t)> size_selector_;
 
+  // Size of glyphs cached with kGlyphFlagsMultiChannelSDF.
+  int32_t msdf_glyph_size_;
+
   // Language of input strings.
   // Used to determine line breaking depending on a language.
   uint32_t script_;
@@ -649,38 +1632,105 @@ class FontManager {
   static const char *language_table_[];
   hb_language_t hb_language_;
 
-  // Line height for a multi line text.
-  float line_height_scale_;
-  float kerning_scale_;
-
-  // Current line width. Needs to be persistent while appending buffers.
-  int32_t line_width_;
-
   // Ellipsis settings.
   std::string ellipsis_;
   EllipsisMode ellipsis_mode_;
 
   // Hyphenation settings.
   std::string hyb_path_;
-  std::string hyphenation_rule_;
-  Hyphenator hyphenator_;
-
-  // Line break info buffer used in libunibreak.
-  std::vector<char> wordbreak_info_;
-
-  // A buffer includes font face index of the current font's faces.
-  std::vector<int32_t> fontface_index_;
+  // The hyphenation rule of the locale set with SetLocale().
+  std::string locale_hyphenation_rule_;
+  // Hyphenators opened for each hyphenation rule, guarded by cache_mutex_ in
+  // layouts.
+  std::unordered_map<std::string, std::unique_ptr<Hyphenator>> hyphenators_;
+  // A hyphenator without patterns, used when no pattern is available.
+  Hyphenator soft_hyphenator_;
+  // Hyphenations of recent words, guarded by cache_mutex_ in layouts.
+  HyphenationCache hyphenation_cache_;
 
   // An instance of signed distance field generator.
   // To avoid redundant initializations, the FontManager holds an instnce of the
   // class.
   std::unique_ptr<DistanceComputer<uint8_t>> sdf_computer_;
 
-  // Mutex guarding glyph cache's buffer access.
+  // Size of SDF scratch buffers to pre-allocate, including padding.
+  mathfu::vec2i sdf_reserve_size_;
+
+  // Generator of multi-channel SDF glyphs.
+  std::unique_ptr<MsdfGenerator> msdf_generator_;
+
+  // Worker threads rendering glyph images when the asynchronous rasterization
+  // is enabled.
+  std::unique_ptr<GlyphRasterizer> glyph_rasterizer_;
+
+  // Worker threads laying out requests of GetBuffers() when the parallel
+  // layout is enabled.
+  std::unique_ptr<LayoutWorkers> layout_workers_;
+
+  // Worker loading fonts opened by OpenAsync(). Created on demand.
+  std::unique_ptr<FontLoader> font_loader_;
+
+  // Persistent glyph cache when enabled with EnableDiskCache().
+  std::unique_ptr<GlyphDiskCache> disk_cache_;
+
+  // Cache of HarfBuzz output of recently laid out text runs.
+  std::unique_ptr<ShapingCache> shaping_cache_;
+
+  // Cache of word breaks of recently laid out texts.
+  std::unique_ptr<WordBreakCache> word_break_cache_;
+
+  // Cache of bitmaps and mipmaps of recently used color glyphs.
+  std::unique_ptr<ColorGlyphCache> color_glyph_cache_;
+
+  // Cache of sections parsed from recently laid out HTML strings.
+  std::unique_ptr<HtmlCache> html_cache_;
+
+  // A cleared image used for glyph cache entries reserved for asynchronous
+  // rasterization.
+  std::vector<uint8_t> placeholder_image_;
+
+  // Mutex guarding glyph cache's buffer access, and caches and fonts shared by
+  // layouts running in parallel, in resources_. The shaping, word break,
+  // hyphenation and HTML caches and the buffer cache have no locks of their
+  // own, and are guarded by it too.
+  //
+  // Locks are acquired in the order of layout_lock_, cache_mutex_ and
+  // context_mutex_. cache_mutex_ is held only around cache look ups and
+  // updates, e.g. per word in UpdateBuffer(). It must not be held while
+  // calling APIs laying out texts or locking layout_lock_, e.g. FillBuffer()
+  // and FlushAndUpdate(), since it's not recursive, and a thread waiting for
+  // the exclusive layout lock holding it would block layouts it waits for.
   fplutil::Mutex *cache_mutex_;
 
-  // A font fallback list retrieved from the current system.
-  std::vector<FontFamily> system_fallback_list_;
+  // Layout state of the thread that created the FontManager, and of other
+  // threads laying out texts.
+  LayoutContext main_context_;
+  std::thread::id main_thread_id_;
+  std::unordered_map<std::thread::id, std::unique_ptr<LayoutContext>>
+      layout_contexts_;
+
+  // Context of the layout running in LayoutScope in the calling thread.
+  static thread_local LayoutContext *context_;
+
+  // Lock of layouts, acquired before cache_mutex_. In resources_. Layouts
+  // hold it shared, and APIs updating fonts or flushing the glyph cache hold
+  // it exclusively. A layout locking it exclusively suspends its shared holds,
+  // so buffers it lays out are checked against the glyph cache epoch before
+  // they are registered, see LayoutNewBuffer().
+  LayoutLock *layout_lock_;
+
+  // Mutex guarding layout_contexts_.
+  fplutil::Mutex *context_mutex_;
+
+  // A font fallback list retrieved from the current system, in resources_.
+  std::vector<FontFamily> &system_fallback_list_;
+
+  // Faces of system_fallback_list_ when they are loaded on demand.
+  std::vector<FaceData *> &system_fallback_faces_;
+
+  // # of passes fallback faces are kept open after their last use, or 0 to
+  // keep all of them open.
+  int32_t system_font_eviction_passes_;
 
   const FlatUIVersion *version_;
 };
@@ -718,8 +1768,17 @@ struct ScriptInfo {
 /// fixed names.
 /// A caller is responsive not to call set_* APIs that specified shader doesn't
 /// support.
+///
+/// The class keeps a shadow copy of the uniform values it uploaded, and skips
+/// uploading a value that is already set to the shader. If anything other than
+/// the FontShader updates the uniforms, call `InvalidateState()`.
 class FontShader {
  public:
+  FontShader()
+      : shader_(nullptr), uniform_uploads_(0), skipped_uniform_uploads_(0) {
+    InvalidateState();
+  }
+
   void set(fplbase::Shader *shader) {
     assert(shader);
     shader_ = shader;
@@ -727,26 +1786,66 @@ class FontShader {
     color_ = shader->FindUniform("color");
     clipping_ = shader->FindUniform("clipping");
     threshold_ = shader->FindUniform("threshold");
+    InvalidateState();
   }
   void set_renderer(fplbase::Renderer *renderer) {
     renderer->SetShader(shader_);
+    // The renderer uploads its own color to the `color` uniform.
+    color_valid_ = false;
   }
 
   void set_position_offset(const mathfu::vec3 &vec) {
     assert(fplbase::ValidUniformHandle(pos_offset_));
+    if (pos_offset_valid_ && Equal(pos_offset_value_, vec)) {
+      skipped_uniform_uploads_++;
+      return;
+    }
     shader_->SetUniform(pos_offset_, vec);
+    pos_offset_value_ = vec;
+    pos_offset_valid_ = true;
+    uniform_uploads_++;
   }
   void set_color(const mathfu::vec4 &vec) {
     assert(fplbase::ValidUniformHandle(color_));
+    if (color_valid_ && Equal(color_value_, vec)) {
+      skipped_uniform_uploads_++;
+      return;
+    }
     shader_->SetUniform(color_, vec);
+    color_value_ = vec;
+    color_valid_ = true;
+    uniform_uploads_++;
   }
   void set_clipping(const mathfu::vec4 &vec) {
     assert(fplbase::ValidUniformHandle(clipping_));
+    if (clipping_valid_ && Equal(clipping_value_, vec)) {
+      skipped_uniform_uploads_++;
+      return;
+    }
     shader_->SetUniform(clipping_, vec);
+    clipping_value_ = vec;
+    clipping_valid_ = true;
+    uniform_uploads_++;
   }
   void set_threshold(float f) {
     assert(fplbase::ValidUniformHandle(threshold_));
+    if (threshold_valid_ && threshold_value_ == f) {
+      skipped_uniform_uploads_++;
+      return;
+    }
     shader_->SetUniform(threshold_, &f, 1);
+    threshold_value_ = f;
+    threshold_valid_ = true;
+    uniform_uploads_++;
+  }
+
+  /// @brief Forget the shadow copy of the uniform values, so that next set_*
+  /// calls upload values to the shader.
+  void InvalidateState() {
+    pos_offset_valid_ = false;
+    color_valid_ = false;
+    clipping_valid_ = false;
+    threshold_valid_ = false;
   }
 
   fplbase::UniformHandle clipping_handle() { return clipping_; }
@@ -754,12 +1853,39 @@ class FontShader {
   fplbase::UniformHandle position_offset_handle() { return pos_offset_; }
   fplbase::UniformHandle threshold_handle() { return threshold_; }
 
+  /// @brief The # of uniform values uploaded to the shader.
+  uint32_t uniform_uploads() const { return uniform_uploads_; }
+  /// @brief The # of uniform uploads skipped since the value was already set.
+  uint32_t skipped_uniform_uploads() const { return skipped_uniform_uploads_; }
+
  private:
+  template <int d>
+  static bool Equal(const mathfu::Vector<float, d> &a,
+                    const mathfu::Vector<float, d> &b) {
+    for (int i = 0; i < d; ++i) {
+      if (a[i] != b[i]) return false;
+    }
+    return true;
+  }
+
   fplbase::Shader *shader_;
   fplbase::UniformHandle pos_offset_;
   fplbase::UniformHandle color_;
   fplbase::UniformHandle clipping_;
   fplbase::UniformHandle threshold_;
+
+  // Shadow copy of the uniform values, valid when the *_valid_ flag is set.
+  mathfu::vec3 pos_offset_value_;
+  mathfu::vec4 color_value_;
+  mathfu::vec4 clipping_value_;
+  float threshold_value_;
+  bool pos_offset_valid_;
+  bool color_valid_;
+  bool clipping_valid_;
+  bool threshold_valid_;
+
+  uint32_t uniform_uploads_;
+  uint32_t skipped_uniform_uploads_;
 };
 /// @}
 
@@ -92,6 +92,19 @@ class HtmlSection {
 /// @return true if the given html is successfully parsed.
 bool ParseHtml(const char *html, std::vector<HtmlSection> *out);
 
+/// @brief Convert HTML into sections in a single pass without building a DOM.
+///
+/// Handles the subset of HTML `ParseHtml()` gives a meaning to: `<a>`, `<b>`,
+/// `<font>`, `<br>`, `<hr>`, `<p>` and headings, plus comments, a doctype,
+/// `<html>`, `<body>` and basic character references. The result is the same
+/// as that of `ParseHtml()`. `ParseHtml()` tries this parser first.
+///
+/// @param html HTML text.
+/// @param out A vector of HTML sections. Cleared when returning false.
+/// @return false if the HTML has other elements or misnested tags, which need
+/// a full HTML parser to recover from.
+bool ParseHtmlSubset(const char *html, std::vector<HtmlSection> *out);
+
 /// @brief Reprocess whitespace the in the manner of an HTML parser.
 ///
 /// Replace intermediate whitespace with a single space.
@@ -128,7 +141,32 @@ std::string &TrimHtmlWhitespace(const char *text, bool trim_leading_whitespace,
 std::vector<mathfu::vec3_packed> GenerateUnderlineVertices(
     const FontBuffer &buffer, const mathfu::vec2 &pos, bool reverse = false);
 
+/// @brief Get the # of vertices `GenerateUnderlineVertices()` generates for
+/// FontBuffer.
+///
+/// @param buffer FontBuffer to generate an underline geometory.
+/// @return The # of vertices of the underline triangle strip, or 0 if the
+/// buffer has no underline.
+size_t GetUnderlineVertexCount(const FontBuffer &buffer);
 
+/// @brief Generate a triangle strip data representing underline geometry for
+/// FontBuffer into caller memory, such as a mapped vertex buffer or a vector
+/// reused across frames.
+///
+/// @param buffer FontBuffer to generate an underline geometory.
+/// @param pos An offset value that is added to generated vertices position.
+/// @param out An array receiving the vertices of the strip, the same as the
+/// ones returned by the other version of `GenerateUnderlineVertices()`.
+/// @param capacity The # of vertices `out` can hold. Use
+/// `GetUnderlineVertexCount()` to size it.
+/// @param reverse Reverse the order of the vertices used, for example to
+/// preserve mesh normals when using kTextLayoutDirectionRTL.
+/// @return The # of vertices written, or 0 when the buffer has no underline
+/// or `capacity` is too small, in which case `out` is untouched.
+size_t GenerateUnderlineVertices(const FontBuffer &buffer,
+                                 const mathfu::vec2 &pos,
+                                 mathfu::vec3_packed *out, size_t capacity,
+                                 bool reverse = false);
 
 /// @brief Generate a triangle mesh data representing padded underline geometry
 /// for FontBuffer. Requires special sdf aa shaders.
@@ -159,6 +197,42 @@ bool GeneratePaddedUnderlineVertices(
     std::vector<mathfu::vec2>* tex_coords, std::vector<uint16_t>* indices,
     bool reverse = false);
 
+/// @brief Get the # of vertices and indices `GeneratePaddedUnderlineVertices()`
+/// generates for FontBuffer.
+///
+/// @param buffer FontBuffer to generate an underline geometory.
+/// @param num_verts Receives the # of positions and texture coordinates.
+/// @param num_indices Receives the # of indices.
+void GetPaddedUnderlineVertexCount(const FontBuffer &buffer,
+                                   size_t *num_verts, size_t *num_indices);
+
+/// @brief Generate a triangle mesh data representing padded underline geometry
+/// for FontBuffer into caller memory, such as mapped vertex and index buffers.
+///
+/// The output is the same as the one of the other version of
+/// `GeneratePaddedUnderlineVertices()`, with indices starting at 0.
+///
+/// @param buffer FontBuffer to generate an underline geometory.
+/// @param pos An offset value that is added to generated vertices position.
+/// @param padding A padding value that is added around each generated underline
+/// segment.
+/// @param positions An array receiving the triangle positions.
+/// @param tex_coords An array receiving the texture coordinates of positions.
+/// @param indices An array receiving the indices of triangles.
+/// @param vertex_capacity The # of elements `positions` and `tex_coords` can
+/// hold.
+/// @param index_capacity The # of elements `indices` can hold. Use
+/// `GetPaddedUnderlineVertexCount()` to size the arrays.
+/// @param reverse Reverse the order of the vertices used, for example to
+/// preserve mesh normals when using kTextLayoutDirectionRTL.
+/// @return A boolean for the success of this function. If false the output
+/// arrays will be untouched.
+bool GeneratePaddedUnderlineVertices(
+    const FontBuffer &buffer, const mathfu::vec2 &pos,
+    const mathfu::vec2 &padding, mathfu::vec3 *positions,
+    mathfu::vec2 *tex_coords, uint16_t *indices, size_t vertex_capacity,
+    size_t index_capacity, bool reverse = false);
+
 }  // namespace flatui
 
 #endif  // FLATUI_FONT_UTIL_H
@@ -108,6 +108,17 @@ class AntialiasDistanceComputer : public DistanceComputer<T, FundamentalType> {
     return;
   }
 
+  void Reserve(const vec2i& size) override {
+    gradients_.Reserve(size);
+    distances_to_edges_.Reserve(size);
+    outer_distances_.Reserve(size);
+    inner_distances_.Reserve(size);
+  }
+
+  uint32_t get_version() const override {
+    return kDistanceComputerVersionAntialias;
+  }
+
  private:
   // Computes the local gradients of an image in the X and Y dimensions and
   // returns them as an Array2<Vector2d>.
@@ -0,0 +1,134 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLATUI_CODEPOINT_COVERAGE_H
+#define FLATUI_CODEPOINT_COVERAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/// @cond FLATUI_INTERNAL
+namespace flatui {
+
+// # of bits of a codepoint addressing an entry in a block of the tables.
+const int32_t kCoverageBlockBits = 8;
+const uint32_t kCoverageBlockSize = 1 << kCoverageBlockBits;
+
+// CodepointCoverage is a set of Unicode codepoints, such as the codepoints
+// covered by a font face's cmap.
+// It's a two level bitmap. Codepoints are grouped into blocks of 256, and only
+// blocks with any codepoint have a bitmap, so a lookup is two array accesses.
+class CodepointCoverage {
+ public:
+  // Add a codepoint. Returns true if it wasn't in the set.
+  bool Insert(uint32_t code_point);
+
+  // Add all codepoints in another set. Returns the # of new codepoints.
+  int32_t Merge(const CodepointCoverage &coverage);
+
+  // Add the codepoints mapped to glyphs by a Unicode subtable of a cmap table,
+  // preferring a format 12 subtable to a format 4 one. Returns false if the
+  // table has no subtable it can read.
+  bool InsertCmap(const void *table, size_t size);
+
+  // Add the codepoints of the cmap table of a face in an OpenType font or
+  // font collection file. Only the table directory and the cmap table are
+  // read, so the face doesn't need to be opened with FreeType.
+  bool InsertFontCmap(const void *font, size_t size, int32_t face_index);
+
+  bool Contains(uint32_t code_point) const {
+    auto block = code_point >> kCoverageBlockBits;
+    if (block >= blocks_.size() || !blocks_[block]) return false;
+    auto &bitmap = bitmaps_[blocks_[block] - 1];
+    auto bit = code_point & (kCoverageBlockSize - 1);
+    return (bitmap.bits[bit >> 5] >> (bit & 31)) & 1;
+  }
+
+  void Clear() {
+    blocks_.clear();
+    bitmaps_.clear();
+  }
+
+  bool empty() const { return bitmaps_.empty(); }
+
+  // Retrieve a size of memory used by the bitmaps.
+  size_t GetMemorySize() const {
+    return blocks_.capacity() * sizeof(uint16_t) +
+           bitmaps_.capacity() * sizeof(Bitmap);
+  }
+
+ private:
+  friend class CodepointFaceMap;
+
+  struct Bitmap {
+    uint32_t bits[kCoverageBlockSize / 32];
+  };
+
+  // Get the bitmap of a block, creating it if needed.
+  Bitmap *GetBitmap(uint32_t block);
+
+  // Indices + 1 to `bitmaps_` for each block, or 0 for empty blocks.
+  std::vector<uint16_t> blocks_;
+  std::vector<Bitmap> bitmaps_;
+};
+
+// CodepointFaceMap maps codepoints to the first face covering them in a list
+// of faces, using the same two level layout as CodepointCoverage.
+class CodepointFaceMap {
+ public:
+  // Build the map from the coverages of faces, in the order of priority.
+  void Build(const std::vector<const CodepointCoverage *> &coverages);
+
+  // Find the index of the first face covering a codepoint.
+  // Returns -1 (kIndexInvalid) if no face covers it.
+  int32_t Find(uint32_t code_point) const {
+    auto block = code_point >> kCoverageBlockBits;
+    if (block < blocks_.size() && blocks_[block]) {
+      auto face =
+          faces_[blocks_[block] - 1]
+              .indices[code_point & (kCoverageBlockSize - 1)];
+      if (face) return face - 1;
+    }
+    return FindOverflow(code_point);
+  }
+
+  // Retrieve a size of memory used by the map.
+  size_t GetMemorySize() const {
+    return blocks_.capacity() * sizeof(uint16_t) +
+           faces_.capacity() * sizeof(FaceBlock) +
+           overflow_.capacity() * sizeof(const CodepointCoverage *);
+  }
+
+ private:
+  // The max # of faces stored in the map. Faces after them are looked up
+  // with their coverages.
+  static const size_t kMaxFaces = 0xff;
+
+  struct FaceBlock {
+    // Face indices + 1 for each codepoint, or 0 when no face covers it.
+    uint8_t indices[kCoverageBlockSize];
+  };
+
+  int32_t FindOverflow(uint32_t code_point) const;
+
+  std::vector<uint16_t> blocks_;
+  std::vector<FaceBlock> faces_;
+  std::vector<const CodepointCoverage *> overflow_;
+};
+
+}  // namespace flatui
+/// @endcond
+
+#endif  // FLATUI_CODEPOINT_COVERAGE_H
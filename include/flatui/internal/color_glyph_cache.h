@@ -0,0 +1,120 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLATUI_COLOR_GLYPH_CACHE_H
+#define FLATUI_COLOR_GLYPH_CACHE_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include "flatui/internal/flatui_util.h"
+
+/// @cond FLATUI_INTERNAL
+namespace flatui {
+
+// Default # of color glyph strikes kept in the cache.
+const size_t kDefaultColorGlyphCacheSize = 32;
+
+// A color glyph bitmap in the fixed strike size of a font, and its mip chain.
+struct ColorGlyphStrike {
+  struct Level {
+    int32_t width;
+    int32_t height;
+    // Packed BGRA pixels, premultiplied as FreeType renders them.
+    std::vector<uint8_t> pixels;
+  };
+
+  // Level 0 is the strike bitmap, and each following level is half the size
+  // of the previous one.
+  std::vector<Level> levels;
+
+  // Metrics of the glyph in the strike size.
+  float bitmap_left;
+  int32_t advance;
+};
+
+// ColorGlyphCache keeps bitmaps of recently used color glyphs in LRU order,
+// so that color glyphs shown at many sizes are loaded from the font once, and
+// each size is scaled from the smallest mip level larger than the size.
+class ColorGlyphCache {
+ public:
+  ColorGlyphCache() : capacity_(kDefaultColorGlyphCacheSize) {}
+
+  // Look up a strike of a glyph. Returns nullptr if it's not in the cache.
+  const ColorGlyphStrike *Find(HashedId font_id, uint32_t code_point);
+
+  // Copy a BGRA bitmap of a glyph and build its mip chain. The least recently
+  // used glyph is evicted when the cache is full. Returns the stored strike,
+  // which is valid until the next Store() call.
+  const ColorGlyphStrike *Store(HashedId font_id, uint32_t code_point,
+                                const uint8_t *bitmap, int32_t width,
+                                int32_t height, int32_t pitch,
+                                float bitmap_left, int32_t advance);
+
+  // Scale a strike to a size. Returns BGRA pixels, or only the alpha channel
+  // when `alpha_only` is set. The image is valid until the next call.
+  const uint8_t *Scale(const ColorGlyphStrike &strike, int32_t width,
+                       int32_t height, bool alpha_only);
+
+  // Remove all entries.
+  void Clear() {
+    map_entries_.clear();
+    lru_entries_.clear();
+  }
+
+  // Getter/Setter of the max # of glyphs in the cache. 0 disables the cache.
+  size_t get_capacity() const { return capacity_; }
+  void set_capacity(size_t capacity);
+
+  // Retrieve # of glyphs in the cache.
+  size_t size() const { return lru_entries_.size(); }
+
+  // Retrieve a size of memory used by entries in the cache and
+  // scratch buffers.
+  size_t GetMemorySize() const;
+
+ private:
+  struct Entry {
+    HashedId key;
+    // The font and the code point are kept to resolve hash collisions.
+    HashedId font_id;
+    uint32_t code_point;
+    ColorGlyphStrike strike;
+  };
+  typedef std::list<Entry>::iterator iterator_entry;
+
+  static HashedId GetKey(HashedId font_id, uint32_t code_point) {
+    return HashId(reinterpret_cast<const char *>(&code_point),
+                  sizeof(code_point), font_id);
+  }
+
+  // Entries in LRU order, the most recently used entry first.
+  std::list<Entry> lru_entries_;
+  std::unordered_map<HashedId, iterator_entry> map_entries_;
+  size_t capacity_;
+
+  // A strike used when the cache is disabled.
+  ColorGlyphStrike uncached_strike_;
+
+  // Scratch buffers of scaled images, kept to reuse the memory.
+  std::vector<uint8_t> scaled_image_;
+  std::vector<uint8_t> alpha_image_;
+};
+
+}  // namespace flatui
+/// @endcond
+
+#endif  // FLATUI_COLOR_GLYPH_CACHE_H
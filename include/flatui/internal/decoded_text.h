@@ -0,0 +1,91 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLATUI_DECODED_TEXT_H
+#define FLATUI_DECODED_TEXT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// @cond FLATUI_INTERNAL
+namespace flatui {
+
+// DecodedText holds codepoints of a UTF-8 text with their byte offsets, so
+// that a layout decodes the text once for line breaking, font face analysis
+// and shaping. Runs of ASCII characters are decoded 16 bytes at a time with
+// SSE2 or NEON where available, 8 bytes at a time otherwise.
+//
+// Only well formed UTF-8 is decoded. When the text has a malformed sequence,
+// the decoding stops and is_well_formed() returns false, so that callers fall
+// back to decoding the text with libunibreak and HarfBuzz, which handle
+// malformed sequences in their own way.
+class DecodedText {
+ public:
+  DecodedText() : text_(nullptr), length_(0), count_(0), well_formed_(false) {}
+
+  // Decode a text, replacing the previous content. The text is referred to
+  // until Clear() is called, to check ranges passed to Contains().
+  void Decode(const char *text, size_t length);
+
+  // Forget the decoded text. The buffers are kept to be reused.
+  void Clear();
+
+  // Check if a byte range is in the decoded text, at codepoint boundaries.
+  bool Contains(const char *text, size_t length) const;
+
+  // Retrieve the index of the codepoint starting at a byte offset of the
+  // text, or the # of codepoints for the end offset.
+  size_t FindCodepoint(size_t offset) const;
+
+  // Set up line break info of libunibreak per byte, the same way as
+  // set_linebreaks_utf8() does for the text followed by a NUL character.
+  // The output has length + 1 elements.
+  void SetLineBreaks(const char *language, std::vector<char> *breaks);
+
+  bool is_well_formed() const { return well_formed_; }
+  const char *get_text() const { return text_; }
+  size_t get_length() const { return length_; }
+
+  // # of codepoints. They are followed by a terminating 0.
+  size_t get_count() const { return count_; }
+  const uint32_t *get_codepoints() const { return codepoints_.data(); }
+
+  // Byte offsets of codepoints, followed by the length of the text.
+  const uint32_t *get_offsets() const { return offsets_.data(); }
+
+ private:
+  const char *text_;
+  size_t length_;
+  size_t count_;
+  bool well_formed_;
+  std::vector<uint32_t> codepoints_;
+  std::vector<uint32_t> offsets_;
+
+  // Line breaks per codepoint, used in SetLineBreaks().
+  std::vector<char> codepoint_breaks_;
+
+  // Disable copy constructor.
+  DecodedText(const DecodedText &);
+  DecodedText &operator=(const DecodedText &);
+};
+
+// Count codepoints of a UTF-8 text.
+// Returns false if the text has a malformed sequence.
+bool CountCodepoints(const char *text, size_t length, size_t *count);
+
+}  // namespace flatui
+/// @endcond
+
+#endif  // FLATUI_DECODED_TEXT_H
@@ -22,6 +22,8 @@ namespace flatui {
 using mathfu::vec2;
 using mathfu::vec2i;
 
+class GpuDistanceComputer;
+
 /// @cond FLATUI_INTERNAL
 // A helper template class to access buffer data with padding.
 template <typename T, typename FundamentalType = T>
@@ -33,31 +35,38 @@ class Grid {
         size_(mathfu::kZeros2i),
         padding_(0),
         stride_(0),
-        inverted_(false),
-        p_(nullptr) {}
+        inverted_(false) {}
   Grid(T* data, const vec2i& size, int32_t padding, size_t stride)
       : data_(data),
         size_(size),
         padding_(padding),
         stride_(static_cast<int32_t>(stride)),
-        inverted_(false),
-        p_(nullptr) {}
+        inverted_(false) {}
 
   // Set up the grid with a buffer allocation.
+  // The buffer only grows, so setting up the grid for sizes up to the largest
+  // one seen doesn't allocate.
   void SetSize(const vec2i& size, T initial_value) {
     size_ = size;
     padding_ = 0;
     stride_ = size.x;
-    if (p_ == nullptr) {
-      p_ = std::unique_ptr<std::vector<T>>(new std::vector<T>());
-    } else {
-      p_->clear();
+    auto count = static_cast<size_t>(size.x * size.y);
+    if (buffer_.size() < count) {
+      buffer_.resize(count);
     }
-    p_->resize(size.x * size.y, initial_value);
-    data_ = &(*p_)[0];
+    std::fill(buffer_.begin(), buffer_.begin() + count, initial_value);
+    data_ = buffer_.data();
     return;
   }
 
+  // Grow the buffer to hold the size without allocating in SetSize().
+  void Reserve(const vec2i& size) {
+    auto count = static_cast<size_t>(size.x * size.y);
+    if (buffer_.size() < count) {
+      buffer_.resize(count);
+    }
+  }
+
   int32_t GetWidth() const { return size_.x + padding_ * 2; }
   int32_t GetHeight() const { return size_.y + padding_ * 2; }
   const vec2i GetSize() const {
@@ -98,9 +107,11 @@ class Grid {
   }
   bool get_invert() const { return inverted_; }
 
-  std::unique_ptr<std::vector<T>> get_buffer() {
-    return p_;
-  };
+  // Raw access to the buffer, used by vectorized kernels that handle the
+  // padding region by themselves.
+  T* get_data() const { return data_; }
+  int32_t get_padding() const { return padding_; }
+  int32_t get_stride() const { return stride_; }
 
  protected:
   T* data_;
@@ -109,12 +120,23 @@ class Grid {
   int32_t stride_;
   bool inverted_;
   T invert_reference_;
-  std::unique_ptr<std::vector<T>> p_;
+  // Buffer owned by the grid, set up with SetSize().
+  std::vector<T> buffer_;
 };
 
 // Represents a large distance during computation.
 static const float kLargeDistance = 1e6;
 
+// Versions of distance computer outputs. SDF glyphs stored in a disk cache are
+// only reused with a computer of the same version, so bump a version when
+// changing the output of a computer.
+const uint32_t kDistanceComputerVersionUnknown = 0;
+const uint32_t kDistanceComputerVersionAntialias = 1;
+const uint32_t kDistanceComputerVersionFastAntialias = 2;
+const uint32_t kDistanceComputerVersionSimdAntialias = 3;
+const uint32_t kDistanceComputerVersionEuclidean = 4;
+const uint32_t kDistanceComputerVersionGpu = 5;
+
 /// @cond FLATUI_INTERNAL
 //
 // The DistanceComputer class implements the main functions to compute signed
@@ -134,6 +156,19 @@ class DistanceComputer {
                        Grid<T, FundamentalType>* dest,
                        GlyphFlags flag) = 0;
 
+  // Pre-allocates scratch buffers for images up to the size, including the
+  // SDF padding, so that Compute() calls for them don't allocate.
+  virtual void Reserve(const vec2i& /*size*/) {}
+
+  // Returns a version of the output. Outputs of computers returning
+  // kDistanceComputerVersionUnknown are not stored in a disk cache.
+  virtual uint32_t get_version() const {
+    return kDistanceComputerVersionUnknown;
+  }
+
+  // Returns the computer if it computes distance fields in the GPU
+  // asynchronously, instead of in Compute() calls.
+  virtual GpuDistanceComputer* get_gpu_computer() { return nullptr; }
 };
 
 }  // namespace flatui
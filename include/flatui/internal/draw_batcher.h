@@ -0,0 +1,144 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLATUI_DRAW_BATCHER_H
+#define FLATUI_DRAW_BATCHER_H
+
+#include <vector>
+#include "flatui/font_manager.h"
+#include "fplbase/renderer.h"
+
+/// @cond FLATUI_INTERNAL
+namespace flatui {
+
+// DrawBatcher defers quads and glyph runs drawn in a render pass, and issues
+// them as a few large draw calls.
+// Draws sharing the same shader, texture and uniforms are merged into one
+// batch. A draw is merged into an earlier batch only when no batch recorded in
+// between overlaps it, so blending results are the same as drawing everything
+// in order.
+class DrawBatcher {
+ public:
+  DrawBatcher()
+      : num_batches_(0),
+        num_draw_calls_(0),
+        num_shader_binds_(0),
+        num_texture_binds_(0),
+        transformed_(false) {}
+
+  // Add a quad drawn with a shader and an optional texture.
+  // The quad uses the same vertex order as glyphs in a FontBuffer.
+  void AddQuad(fplbase::Shader *shader, const fplbase::Texture *texture,
+               const mathfu::vec4 &color, const mathfu::vec2i &pos,
+               const mathfu::vec2i &size, const mathfu::vec4 &uv);
+
+  // Add glyphs in ranges of a FontBuffer's vertices drawn with a font shader.
+  // `offset` is added to the vertex positions, so the font shader's position
+  // offset is not needed to draw the batch. `clip_rect` is in the coordinates
+  // of the vertices and zero when the shader doesn't clip.
+  // `threshold` is used only when the shader has a threshold uniform.
+  void AddGlyphs(FontShader *shader, const fplbase::Texture *texture,
+                 const mathfu::vec4 &color, const mathfu::vec4 &clip_rect,
+                 float threshold, const mathfu::vec3 &offset,
+                 const std::vector<FontVertex> &vertices,
+                 const std::vector<GlyphRange> &ranges);
+
+  // Place following draws in 3D with `transform`, which maps the pixel
+  // coordinates of the draws to world space, so that draws of panels placed
+  // with different transforms are merged. Vertices are transformed when they
+  // are added, and batches are drawn with the `view_projection` matrix set to
+  // the renderer. Overlaps of draws are checked in normalized device
+  // coordinates. Clipped glyphs can't be transformed and need to be drawn
+  // directly.
+  void SetTransform(const mathfu::mat4 &transform,
+                    const mathfu::mat4 &view_projection);
+
+  // Add following draws in the pixel coordinates again.
+  void ResetTransform() { transformed_ = false; }
+
+  // Draw all batches and clear them. Batches are drawn in the order they were
+  // created.
+  void Flush(fplbase::Renderer *renderer);
+
+  // Discard all batches without drawing them.
+  void Clear();
+
+  // Check if there is any draw waiting for a flush.
+  bool empty() const { return num_batches_ == 0; }
+
+  // Calculate a hash of all draws waiting for a flush, including their render
+  // states and vertices.
+  size_t Hash() const;
+
+  // Retrieve the # of draw calls issued by Flush() so far.
+  int32_t get_draw_call_count() const { return num_draw_calls_; }
+
+  // Retrieve the # of shaders and textures bound by Flush() so far.
+  int32_t get_shader_bind_count() const { return num_shader_binds_; }
+  int32_t get_texture_bind_count() const { return num_texture_binds_; }
+
+ private:
+  // The max # of batches to look back for a batch to merge a draw into.
+  static const size_t kMaxLookback = 16;
+
+  struct Batch {
+    // Render states. Either `shader` or `font_shader` is set.
+    fplbase::Shader *shader;
+    FontShader *font_shader;
+    const fplbase::Texture *texture;
+    mathfu::vec4 color;
+    mathfu::vec4 clip_rect;
+    float threshold;
+
+    // Bounding box of all draws in the batch, as (min x, min y, max x, max y).
+    mathfu::vec4 bounds;
+
+    // Vertices of glyph quads drawn with GetQuadIndices().
+    std::vector<FontVertex> vertices;
+  };
+
+  // Find a batch that accepts a draw with the given state and bounds, or
+  // create a new one.
+  Batch *GetBatch(fplbase::Shader *shader, FontShader *font_shader,
+                  const fplbase::Texture *texture, const mathfu::vec4 &color,
+                  const mathfu::vec4 &clip_rect, float threshold,
+                  const mathfu::vec4 &bounds);
+
+  // Calculate bounds of a draw to check overlaps with other batches, from
+  // bounds in pixel coordinates.
+  mathfu::vec4 TransformBounds(const mathfu::vec4 &bounds) const;
+
+  // Add a vertex to a batch, transforming it if necessary.
+  void AddVertex(Batch *batch, float x, float y, float z, float u,
+                 float v) const;
+
+  // Batches are recycled across flushes to keep their vertex storage.
+  // Only the first `num_batches_` entries are in use.
+  std::vector<Batch> batches_;
+  size_t num_batches_;
+  int32_t num_draw_calls_;
+  int32_t num_shader_binds_;
+  int32_t num_texture_binds_;
+
+  // The transform set with SetTransform(), and the transform to normalized
+  // device coordinates.
+  bool transformed_;
+  mathfu::mat4 transform_;
+  mathfu::mat4 screen_transform_;
+};
+
+}  // namespace flatui
+/// @endcond
+
+#endif  // FLATUI_DRAW_BATCHER_H
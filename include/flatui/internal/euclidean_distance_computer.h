@@ -0,0 +1,191 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLATUI_INTERNAL_EUCLIDEAN_DISTANCE_COMPUTER_H
+#define FLATUI_INTERNAL_EUCLIDEAN_DISTANCE_COMPUTER_H
+
+#include <limits>
+#include "flatui/internal/distance_computer.h"
+
+namespace flatui {
+
+// Squared distance used for pixels without a seed.
+static const float kInfiniteSquaredDistance = 1e20f;
+
+// The EuclideanDistanceComputer computes signed distance fields with the
+// separable squared Euclidean distance transform described in
+// "Distance Transforms of Sampled Functions" (Felzenszwalb and Huttenlocher).
+// The transform runs a lower envelope of parabolas over each column and then
+// each row, so the cost is linear in the number of pixels and, unlike the
+// propagation based computers, doesn't depend on the glyph shape or the SDF
+// padding.
+//
+// The result is exact for binary images, and a close approximation for
+// antialiased ones.
+template <typename T, typename FundamentalType = T>
+class EuclideanDistanceComputer
+    : public flatui::DistanceComputer<T, FundamentalType> {
+ public:
+  EuclideanDistanceComputer() {}
+  ~EuclideanDistanceComputer() {}
+
+  void Compute(const Grid<T, FundamentalType>& image,
+               Grid<T, FundamentalType>* dest, GlyphFlags flag) override {
+    auto original_size = image.GetOriginalSize();
+    if (original_size.x == 0 || original_size.y == 0) {
+      return;
+    }
+    auto generate_inner_distance = (flag & kGlyphFlagsInnerSDF) != 0;
+    auto size = image.GetSize();
+    auto width = size.x;
+    auto height = size.y;
+    outer_distances_.resize(width * height);
+    inner_distances_.resize(width * height);
+
+    // Seed squared distances. Each covered pixel is a seed whose edge is
+    // estimated to be 1 - coverage away (0.5 - coverage from its center, plus
+    // 0.5 subtracted from the transformed distance), which matches edge
+    // distance estimates of the other computers. Inner distances use the
+    // inverted coverage.
+    for (auto y = 0; y < height; ++y) {
+      for (auto x = 0; x < width; ++x) {
+        auto i = x + y * width;
+        auto v = GetCoverage(image, vec2i(x, y));
+        outer_distances_[i] =
+            v > 0.0f ? (1.0f - v) * (1.0f - v) : kInfiniteSquaredDistance;
+        inner_distances_[i] = v < 1.0f ? v * v : kInfiniteSquaredDistance;
+      }
+    }
+
+    Transform(&outer_distances_[0], width, height);
+    if (generate_inner_distance) {
+      Transform(&inner_distances_[0], width, height);
+    }
+
+    // Copy the value to the destination buffer, with the same scale and bias
+    // as the other computers.
+    auto mid =
+        static_cast<float>((std::numeric_limits<FundamentalType>::max() +
+                            std::numeric_limits<FundamentalType>::min()) /
+                           2);
+    const float kSDFMultiplier = -16.0f;
+    for (auto y = 0; y < height; ++y) {
+      for (auto x = 0; x < width; ++x) {
+        auto i = x + y * width;
+        auto v = GetCoverage(image, vec2i(x, y));
+        // Fully covered pixels are inside, and have 0 outer distance.
+        auto value = v >= 1.0f ? 0.0f : sqrtf(outer_distances_[i]) - 0.5f;
+        if (generate_inner_distance && v > 0.0f) {
+          value -= sqrtf(inner_distances_[i]) - 0.5f;
+        }
+        value = mathfu::Clamp(
+            value * kSDFMultiplier + mid,
+            static_cast<float>(std::numeric_limits<FundamentalType>::min()),
+            static_cast<float>(std::numeric_limits<FundamentalType>::max()));
+        dest->Set(vec2i(x, y), T(static_cast<FundamentalType>(value)));
+      }
+    }
+  }
+
+  void Reserve(const vec2i& size) override {
+    auto length = std::max(size.x, size.y);
+    outer_distances_.reserve(size.x * size.y);
+    inner_distances_.reserve(size.x * size.y);
+    f_.reserve(length);
+    d_.reserve(length);
+    v_.reserve(length);
+    z_.reserve(length + 1);
+  }
+
+  uint32_t get_version() const override {
+    return kDistanceComputerVersionEuclidean;
+  }
+
+ private:
+  // Returns a pixel value in range of 0.0 - 1.0.
+  float GetCoverage(const Grid<T, FundamentalType>& image,
+                    const vec2i& pos) const {
+    return static_cast<float>(image.Get(pos)) /
+           std::numeric_limits<FundamentalType>::max();
+  }
+
+  // Transform squared distances in the grid, columns first and then rows.
+  void Transform(float* grid, int32_t width, int32_t height) {
+    auto length = std::max(width, height);
+    f_.resize(length);
+    d_.resize(length);
+    v_.resize(length);
+    z_.resize(length + 1);
+    for (auto x = 0; x < width; ++x) {
+      Transform1D(grid + x, width, height);
+    }
+    for (auto y = 0; y < height; ++y) {
+      Transform1D(grid + y * width, 1, width);
+    }
+  }
+
+  // Compute the lower envelope of parabolas rooted at each sample, and sample
+  // it back. Computations are done in double since the infinity seeds cancel
+  // out small integers in float.
+  void Transform1D(float* grid, int32_t stride, int32_t length) {
+    for (auto q = 0; q < length; ++q) {
+      f_[q] = grid[q * stride];
+    }
+    int32_t k = 0;
+    v_[0] = 0;
+    z_[0] = -std::numeric_limits<double>::infinity();
+    z_[1] = std::numeric_limits<double>::infinity();
+    for (auto q = 1; q < length; ++q) {
+      // z_[0] is -infinity, so k doesn't go below 0.
+      auto s = Intersect(q, v_[k]);
+      while (s <= z_[k]) {
+        s = Intersect(q, v_[--k]);
+      }
+      ++k;
+      v_[k] = q;
+      z_[k] = s;
+      z_[k + 1] = std::numeric_limits<double>::infinity();
+    }
+    k = 0;
+    for (auto q = 0; q < length; ++q) {
+      while (z_[k + 1] < q) {
+        ++k;
+      }
+      auto r = v_[k];
+      d_[q] = (q - r) * (q - r) + f_[r];
+    }
+    for (auto q = 0; q < length; ++q) {
+      grid[q * stride] = static_cast<float>(d_[q]);
+    }
+  }
+
+  // Returns an intersection of parabolas rooted at q and r.
+  double Intersect(int32_t q, int32_t r) const {
+    return ((f_[q] + q * q) - (f_[r] + r * r)) / (2.0 * (q - r));
+  }
+
+  // Squared distances to the outer and inner edges.
+  std::vector<float> outer_distances_;
+  std::vector<float> inner_distances_;
+
+  // Scratch buffers of the 1D transform.
+  std::vector<double> f_;
+  std::vector<double> d_;
+  std::vector<int32_t> v_;
+  std::vector<double> z_;
+};
+
+}  // namespace flatui
+
+#endif  // FLATUI_INTERNAL_EUCLIDEAN_DISTANCE_COMPUTER_H
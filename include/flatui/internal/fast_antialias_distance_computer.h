@@ -49,8 +49,6 @@ class FastAntialiasDistanceComputer :
     }
     auto genearate_inner_distance = flag & kGlyphFlagsInnerSDF;
     auto size = image.GetSize();
-    auto width = size.x;
-    auto height = size.y;
     // Compute the local gradients in both dimensions.
     gradients_.SetSize(size, mathfu::kZeros2f);
     distances_to_edges_.SetSize(size, mathfu::kZeros2i);
@@ -82,33 +80,28 @@ class FastAntialiasDistanceComputer :
     }
 
     // Copy the value to the destination buffer.
-    for (auto y = 0; y < height; ++y) {
-      for (auto x = 0; x < width; ++x) {
-        auto pos = vec2i(x, y);
-        // Don't return negative distances.
-        auto mid =
-            static_cast<float>((std::numeric_limits<FundamentalType>::max() +
-                                std::numeric_limits<FundamentalType>::min()) /
-                               2);
-        auto value = distances_->Get(pos);
-        if (genearate_inner_distance) {
-          value = outer_distances_.Get(pos) - value;
-        }
-        const float kSDFMultiplier = -16.0f;
-        value = mathfu::Clamp(
-            value * kSDFMultiplier + mid,
-            static_cast<float>(std::numeric_limits<FundamentalType>::min()),
-            static_cast<float>(std::numeric_limits<FundamentalType>::max()));
-        destination_->Set(pos, T(static_cast<FundamentalType>(value)));
-      }
-    }
+    StoreDistances(genearate_inner_distance != 0);
     return;
   }
 
- private:
+  void Reserve(const vec2i& size) override {
+    gradients_.Reserve(size);
+    distances_to_edges_.Reserve(size);
+    outer_distances_.Reserve(size);
+    inner_distances_.Reserve(size);
+  }
+
+  uint32_t get_version() const override {
+    return kDistanceComputerVersionFastAntialias;
+  }
+
+ protected:
+  // The steps below process one pixel at a time through Grid accessors.
+  // Derived classes may override them with vectorized versions.
+
   // Computes the local gradients of an image in the X and Y dimensions and
   // returns them as an Array2<Vector2d>.
-  void ComputeGradients() {
+  virtual void ComputeGradients() {
     const auto w = image_->GetWidth();
     const auto h = image_->GetHeight();
 
@@ -133,6 +126,32 @@ class FastAntialiasDistanceComputer :
     return;
   }
 
+  // Converts the distances to the destination format and stores them.
+  virtual void StoreDistances(bool inner_distance) {
+    const auto width = image_->GetWidth();
+    const auto height = image_->GetHeight();
+    for (auto y = 0; y < height; ++y) {
+      for (auto x = 0; x < width; ++x) {
+        auto pos = vec2i(x, y);
+        // Don't return negative distances.
+        auto mid =
+            static_cast<float>((std::numeric_limits<FundamentalType>::max() +
+                                std::numeric_limits<FundamentalType>::min()) /
+                               2);
+        auto value = distances_->Get(pos);
+        if (inner_distance) {
+          value = outer_distances_.Get(pos) - value;
+        }
+        const float kSDFMultiplier = -16.0f;
+        value = mathfu::Clamp(
+            value * kSDFMultiplier + mid,
+            static_cast<float>(std::numeric_limits<FundamentalType>::min()),
+            static_cast<float>(std::numeric_limits<FundamentalType>::max()));
+        destination_->Set(pos, T(static_cast<FundamentalType>(value)));
+      }
+    }
+  }
+
   // Applies a 3x3 filter kernel to an image pixel to get the gradients.
   const vec2 FilterPixel(const vec2i& pos) {
     // 3x3 filter kernel. The X gradient uses the array as is and the Y gradient
@@ -153,7 +172,7 @@ class FastAntialiasDistanceComputer :
   }
 
   // Creates and initializes a grid containing the distances.
-  void InitializeDistanceGrid() {
+  virtual void InitializeDistanceGrid() {
     const auto w = image_->GetWidth();
     const auto h = image_->GetHeight();
     for (auto y = 0; y < h; ++y) {
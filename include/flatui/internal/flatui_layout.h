@@ -108,19 +108,56 @@ struct UIElement {
   bool interactive;  // Wants to respond to user input.
 };
 
+// Containers of LayoutManager kept across layouts, so that their capacity
+// carries over and layouts of the same size don't allocate memory.
+struct LayoutStorage {
+  LayoutStorage() : allocation_count(0) {}
+
+  std::vector<UIElement> elements;
+  std::vector<Group> group_stack;
+
+  // # of layouts that had to grow any of the containers.
+  uint32_t allocation_count;
+};
+
 // This holds the transient state while a layout is being performed.
 // Call Run() on an instance to layout a definition.
 // See the FlatUI documentation (or flatui.h) for a more extensive explanation
 // of how this works.
 class LayoutManager : public Group {
  public:
-  LayoutManager(const vec2i &canvas_size)
+  // If `storage` is given, its containers are used for the layout, and
+  // handed back with their capacity when the LayoutManager is destroyed.
+  LayoutManager(const vec2i &canvas_size, LayoutStorage *storage = nullptr)
       : Group(kDirVertical, kAlignLeft, 0, 0),
         layout_pass_(true),
+        element_mismatch_(false),
         canvas_size_(canvas_size),
         virtual_resolution_(FLATUI_DEFAULT_VIRTUAL_RESOLUTION),
-        version_(&MainVersion()) {
+        version_(&MainVersion()),
+        storage_(storage),
+        elements_capacity_(0),
+        group_stack_capacity_(0) {
     SetScale();
+    if (storage_) {
+      elements_.swap(storage_->elements);
+      elements_.clear();
+      group_stack_.swap(storage_->group_stack);
+      group_stack_.clear();
+      elements_capacity_ = elements_.capacity();
+      group_stack_capacity_ = group_stack_.capacity();
+    }
+  }
+
+  ~LayoutManager() {
+    if (storage_) {
+      if (elements_.capacity() > elements_capacity_ ||
+          group_stack_.capacity() > group_stack_capacity_) {
+        storage_->allocation_count++;
+      }
+      elements_.swap(storage_->elements);
+      group_stack_.swap(storage_->group_stack);
+    }
   }
 
   // Changes the virtual resolution (defaults to
@@ -305,11 +342,15 @@ class LayoutManager : public Group {
       // doesn't is if an event handler caused an element to removed.
       auto &element = *element_it_;
       ++element_it_;
-      if (EqualId(element.hash, hash)) return &element;
+      if (EqualId(element.hash, hash)) {
+        if (&element != &*backup) element_mismatch_ = true;
+        return &element;
+      }
     }
     // Didn't find this id at all, which means an event handler just caused
     // this element to be added, so we skip it.
     element_it_ = backup;
+    element_mismatch_ = true;
     return nullptr;
   }
 
@@ -383,6 +424,8 @@ class LayoutManager : public Group {
 
  protected:
   bool layout_pass_;
+  // Set in the second pass when elements don't match the layout pass.
+  bool element_mismatch_;
   std::vector<UIElement> elements_;
   std::vector<UIElement>::iterator element_it_;
   std::vector<Group> group_stack_;
@@ -390,6 +433,11 @@ class LayoutManager : public Group {
   float virtual_resolution_;
   float pixel_scale_;
   const FlatUIVersion *version_;
+
+ private:
+  LayoutStorage *storage_;
+  size_t elements_capacity_;
+  size_t group_stack_capacity_;
 };
 
 }  // namespace flatui
@@ -39,7 +39,7 @@ static HashedId kNullHash = 0;
 /// @var kInitialHashValue
 ///
 /// @brief An initial value of hash calculation.
-static HashedId kInitialHashValue = 0x84222325;
+static const HashedId kInitialHashValue = 0x84222325;
 
 /// @brief Hash a UTF8 string with a length into a `HashId`.
 ///
@@ -76,6 +76,26 @@ inline HashedId HashId(const char *id, HashedId hash = kInitialHashValue) {
   return HashId(id, static_cast<int32_t>(length), hash);
 }
 
+/// @brief Hash a C-string into a `HashId` at compile time.
+///
+/// This gives the same hash as `HashId()`, and can be used to compute IDs of
+/// string literals once, e.g.
+/// `static constexpr HashedId kOkButton = ConstHashId("ok_button");`, so that
+/// they are not hashed again in each pass of every frame.
+///
+/// @warning Unlike `HashId()`, this function can't assert if the `id` collides
+/// with `kNullHash`.
+///
+/// @param[in] id A C-string representing the ID to hash.
+///
+/// @return Returns the HashId corresponding to the `id`.
+constexpr HashedId ConstHashId(const char *id,
+                               HashedId hash = kInitialHashValue) {
+  return *id ? ConstHashId(id + 1, (hash ^ static_cast<uint8_t>(*id)) *
+                                       static_cast<HashedId>(0x000001b3))
+             : hash;
+}
+
 /// @brief Returns a hash that XORs the high and low bits of seq.
 ///
 /// @param[in] seq A number that could start from 0 and increase with every
@@ -170,8 +190,16 @@ inline bool EqualId(HashedId hash1, HashedId hash2) {
 /// http://www.boost.org/doc/libs/1_37_0/doc/html/hash/reference.html#boost.hash_combine
 template <class T>
 inline size_t HashCombine(size_t seed, const T &v) {
-  return static_cast<size_t>(HashValue(*reinterpret_cast<const int32_t *>(&v)) +
-                             0x9e3779b9 + (seed << 6) + (seed >> 2));
+  // Read up to 32 bits of the value byte by byte, so that values smaller than
+  // an int32_t (e.g. bool) are not over-read. The value is randomized the same
+  // way as HashValue(), without the kNullHash assertion as 0 is a valid input.
+  uint32_t i = 0;
+  auto bytes = reinterpret_cast<const uint8_t *>(&v);
+  for (size_t b = 0; b < sizeof(v) && b < sizeof(i); ++b) {
+    i |= static_cast<uint32_t>(bytes[b]) << (b * 8);
+  }
+  auto hash = static_cast<size_t>(static_cast<HashedId>(i * 2654435761u));
+  return seed ^ (hash + 0x9e3779b9 + (seed << 6) + (seed >> 2));
 }
 
 }  // namespace flatui
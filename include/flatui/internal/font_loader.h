@@ -0,0 +1,91 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLATUI_FONT_LOADER_H
+#define FLATUI_FONT_LOADER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "flatui/font_buffer.h"
+#include "flatui/internal/hb_complex_font.h"
+
+/// @cond FLATUI_INTERNAL
+namespace flatui {
+
+// A request to open a font in a worker thread.
+// The worker loads the font file and records its coverage in `face`, and the
+// FontManager creates the FreeType face and the harfbuzz font afterwards.
+struct FontLoadJob {
+  explicit FontLoadJob(const FontFamily &font_family)
+      : family(font_family), face(new FaceData()), succeeded(false) {}
+
+  // Release the font file data of a face that is not published.
+  ~FontLoadJob() {
+    if (face) face->Close();
+  }
+
+  FontFamily family;
+  std::unique_ptr<FaceData> face;
+  std::function<void(bool)> callback;
+  bool succeeded;
+};
+
+// FontLoader loads font files in a worker thread.
+// The worker has its own FT_Library, which is only used for temporary faces
+// to read the cmap of fonts.
+class FontLoader {
+ public:
+  FontLoader();
+  ~FontLoader();
+
+  // Queue a job. Jobs are processed in the order they are queued.
+  void Enqueue(std::unique_ptr<FontLoadJob> job);
+
+  // Retrieve jobs finished since the last call.
+  void GetCompletedJobs(std::vector<std::unique_ptr<FontLoadJob>> *jobs);
+
+  // Wait until all queued jobs are finished.
+  void Wait();
+
+  // Returns true if there are jobs to be processed or retrieved.
+  bool HasPendingJobs();
+
+ private:
+  // Entry point of the worker thread.
+  void Run();
+
+  // Guards all members below except for `ft_`, which is only touched by the
+  // worker.
+  std::mutex mutex_;
+  std::condition_variable job_condition_;
+  std::condition_variable idle_condition_;
+  std::deque<std::unique_ptr<FontLoadJob>> queue_;
+  std::vector<std::unique_ptr<FontLoadJob>> completed_;
+  bool busy_;
+  bool terminate_;
+
+  FT_Library ft_;
+  std::thread thread_;
+};
+
+}  // namespace flatui
+/// @endcond
+
+#endif  // FLATUI_FONT_LOADER_H
@@ -0,0 +1,162 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLATUI_FONT_RESOURCES_H
+#define FLATUI_FONT_RESOURCES_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "fplutil/mutex.h"
+#include "flatui/font_buffer.h"
+#include "flatui/internal/glyph_cache.h"
+#include "flatui/internal/hb_complex_font.h"
+
+/// @cond FLATUI_INTERNAL
+namespace flatui {
+
+// Lock of layouts and of the fonts and settings they use. Layouts hold it
+// shared, and APIs opening or closing fonts, trimming caches or updating the
+// glyph cache hold it exclusively. Both are recursive, and the thread holding
+// it exclusively may hold it shared too.
+//
+// A thread holding it shared may lock it exclusively, e.g. to flush the glyph
+// cache in a layout. Its shared holds are suspended until the layouts of other
+// threads finish or wait for the lock too. So a flush may run while another
+// thread waiting for the lock has laid out a part of a buffer. Layouts check
+// GlyphCache::get_epoch() before registering a buffer and lay out the text
+// again when it changed, instead of keeping glyph cache entries across the
+// exclusive hold.
+//
+// It's acquired before cache_mutex in FontResources, which is acquired before
+// FontManager's mutex of layout contexts. A thread must not lock it, shared or
+// exclusively, holding cache_mutex.
+class LayoutLock {
+ public:
+  LayoutLock();
+
+  void LockShared();
+  void UnlockShared();
+
+  void Lock();
+  // Lock it exclusively only if no other thread holds it.
+  bool TryLock();
+  void Unlock();
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable condition_;
+
+  // The thread holding the lock exclusively, and its # of holds.
+  std::thread::id writer_;
+  int32_t writer_count_;
+
+  // # of shared holds in all threads not waiting for the exclusive lock, and
+  // in each thread.
+  int32_t readers_;
+  std::unordered_map<std::thread::id, int32_t> reader_counts_;
+
+  // Disable copy constructor.
+  LayoutLock(const LayoutLock &);
+  LayoutLock &operator=(const LayoutLock &);
+};
+
+// Scoped exclusive hold of a LayoutLock, like fplutil::MutexLock and
+// MutexTryLock.
+class ExclusiveLayoutLock {
+ public:
+  ExclusiveLayoutLock() : lock_(nullptr) {}
+  explicit ExclusiveLayoutLock(LayoutLock &lock) : lock_(&lock) {
+    lock_->Lock();
+  }
+  ~ExclusiveLayoutLock() {
+    if (lock_ != nullptr) lock_->Unlock();
+  }
+
+  bool Try(LayoutLock &lock) {
+    assert(lock_ == nullptr);
+    if (!lock.TryLock()) return false;
+    lock_ = &lock;
+    return true;
+  }
+
+ private:
+  LayoutLock *lock_;
+
+  // Disable copy constructor.
+  ExclusiveLayoutLock(const ExclusiveLayoutLock &);
+  ExclusiveLayoutLock &operator=(const ExclusiveLayoutLock &);
+};
+
+// FontResources holds the state FontManagers can share: the FreeType library,
+// the registry of opened faces with their HarfBuzz fonts, and the glyph cache
+// with its textures. Each FontManager keeps its own layout state, FontBuffers
+// and caches of laid out text, and refers to the resources through a
+// shared_ptr, so they are released with the last manager using them.
+//
+// FontManagers sharing resources lay out texts in parallel holding the layout
+// lock shared, and guard glyph cache accesses with cache_mutex. Their render
+// passes have to run in the thread owning the GL context, like a single
+// FontManager's.
+struct FontResources {
+  // Defined in font_manager.cpp, which has the FreeType API.
+  FontResources(const mathfu::vec2i &cache_size, int32_t max_slices);
+  ~FontResources();
+
+  // Instance of Freetype library.
+  FT_Library ft;
+
+  // Map that keeps opened face data instances. Faces are ref counted across
+  // all managers.
+  std::unordered_map<std::string, std::unique_ptr<FaceData>> faces;
+
+  // Used to cache font instances. Refers to memory owned by faces.
+  HbFontCache font_cache;
+
+  // A font fallback list retrieved from the current system.
+  std::vector<FontFamily> system_fallback_list;
+
+  // Faces of system_fallback_list when they are loaded on demand.
+  std::vector<FaceData *> system_fallback_faces;
+
+  // Glyph cache shared by the managers. Its counter is ticked once per pass of
+  // any manager, see FontManager::UpdatePass().
+  std::unique_ptr<GlyphCache> glyph_cache;
+
+  // Mutex guarding glyph cache's buffer access, and the fonts and caches
+  // shared by layouts running in parallel.
+  fplutil::Mutex cache_mutex;
+
+  // Lock of layouts of all managers. It's acquired before cache_mutex.
+  LayoutLock layout_lock;
+
+  // The thread that created the resources. Its layouts use the faces of
+  // FaceData, while layouts in other threads open FaceInstances.
+  std::thread::id thread_id;
+
+ private:
+  // Disable copy constructor.
+  FontResources(const FontResources &);
+  FontResources &operator=(const FontResources &);
+};
+
+}  // namespace flatui
+/// @endcond
+
+#endif  // FLATUI_FONT_RESOURCES_H
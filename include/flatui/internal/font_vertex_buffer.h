@@ -0,0 +1,82 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLATUI_FONT_VERTEX_BUFFER_H
+#define FLATUI_FONT_VERTEX_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+
+/// @cond FLATUI_INTERNAL
+namespace flatui {
+
+// FontVertexBuffer keeps vertices of a FontBuffer in a GPU buffer object, so
+// that buffers rendered every frame upload their vertices only when they
+// change. Glyphs are drawn with a quad index buffer object shared by all
+// FontVertexBuffers, with the same indices as GetQuadIndices().
+// Buffers holding GlyphInstances are drawn with instanced draws instead.
+// The class is implemented with OpenGL APIs and all APIs need to be invoked in
+// the rendering thread.
+class FontVertexBuffer {
+ public:
+  FontVertexBuffer();
+  ~FontVertexBuffer();
+
+  // Upload vertices to the buffer object, growing it if necessary.
+  void Update(const void *vertices, size_t size);
+
+  // Bind the buffer object and the quad indices with a vertex format, either
+  // PackedFontVertex or FontVertex.
+  void Bind(bool packed_vertices);
+
+  // Draw glyphs in a range with the bound buffer. Ranges exceeding the quad
+  // indices are split into multiple draws.
+  void Draw(uint32_t start_glyph, uint32_t glyph_count);
+
+  // Unbind the buffer object and the quad indices.
+  void Unbind();
+
+  // Bind the buffer object holding GlyphInstances and the shared quad
+  // corners, for shaders expanding glyph quads from instances. The corner
+  // (0 or 1 for each axis) is fed to the kAttributeTexCoordAlt attribute, the
+  // glyph rectangle to kAttributePosition and the UV rectangle to
+  // kAttributeTexCoord.
+  void BindInstances();
+
+  // Draw glyphs in a range with the bound instances, as triangle strips.
+  void DrawInstances(uint32_t start_glyph, uint32_t glyph_count);
+
+  // Unbind the buffer object and the quad corners.
+  void UnbindInstances();
+
+  // Check if instanced draws are supported by the renderer.
+  static bool IsInstancingSupported();
+
+  // Retrieve the size of the buffer object in bytes.
+  size_t get_capacity() const { return capacity_; }
+
+ private:
+  // Point vertex attributes of the bound buffer at a glyph.
+  void SetVertexPointers(uint32_t start_glyph);
+
+  uint32_t handle_;
+  size_t capacity_;
+  // The vertex format selected with Bind().
+  bool packed_vertices_;
+};
+
+}  // namespace flatui
+/// @endcond
+
+#endif  // FLATUI_FONT_VERTEX_BUFFER_H
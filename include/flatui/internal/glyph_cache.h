@@ -16,13 +16,16 @@
 #define GLYPH_CACH_H
 
 #include <assert.h>
+#include <algorithm>
 #include <list>
 #include <map>
-#include <set>
+#include <string>
 #include <tuple>
 #include <unordered_map>
+#include <vector>
 
 #include "flatui_util.h"
+#include "text_pipeline_counters.h"
 #include "fplbase/texture.h"
 #include "fplbase/utilities.h"
 #include "mathfu/constants.h"
@@ -43,15 +46,24 @@ namespace flatui {
 // The purpose of this design is to cache as many glyphs and to achieve high
 // caching perfomance estimating same size of glphys tends to be stored in a
 // cache at same time. (e.g. Caching a string in a same size.)
+// When glyphs in various sizes are mixed, kGlyphCachePackingSkyline packing
+// can be selected. In the mode, shorter glyphs are stacked in a taller row
+// following a skyline of the row, instead of leaving the space unused.
 //
-// When looking up a cached entry, the API looks up unordered_map which is O(1)
-// operation.
+// When looking up a cached entry, the API looks up an open addressing hash
+// table (GlyphCacheEntryMap) which is O(1) operation.
 // If there is no cached entry for given code point, the caller needs to invoke
 // Set() API to fill in a cache.
 // Set() operation takes
 // O(log N (N=# of rows)) when there is a room in the cache for the request,
 // + O(N (N=# of rows)) to look up and evict least recently used row with
 // sufficient height.
+// When no single row is tall enough, adjacent rows that are not used in
+// current rendering cycle are flushed and merged into one row (O(N log N)).
+// Optionally, the cache can also compact rows by moving glyphs of a row into
+// free space of other rows. The freed up row can be merged with adjacent rows
+// and moved glyphs don't need to be re-rendered. FontBuffers referencing moved
+// glyphs update their UVs as they do after row flushes.
 
 // Enable tracking stats in Debug build.
 #ifdef _DEBUG
@@ -65,6 +77,7 @@ class GlyphCacheRow;
 class GlyphCacheEntry;
 class GlyphKey;
 class GlyphCacheBufferBase;
+class GlyphCacheUploader;
 template <typename T>
 class GlyphCacheBuffer;
 
@@ -81,12 +94,48 @@ enum GlyphFlags {
   kGlyphFlagsNone = 0,      // Normal glyph.
   kGlyphFlagsOuterSDF = 1,  // Glyph image with an outer SDF information.
   kGlyphFlagsInnerSDF = 2,  // Glyph image with an inner SDF information.
+  // Glyph image with a multi-channel SDF generated from the glyph outline.
+  // The glyph is cached in one size and scaled to any size.
+  kGlyphFlagsMultiChannelSDF = 4,
 };
 
+// Packing strategies of glyphs in a cache row.
+enum GlyphCachePacking {
+  // Glyphs are stored from left to right in a row with a same or smaller
+  // height. (Default.)
+  kGlyphCachePackingRow = 0,
+  // Each row maintains a skyline and glyphs shorter than the row are stacked
+  // on top of each other, so that mixed glyph sizes are packed more densely.
+  kGlyphCachePackingSkyline = 1,
+};
+
+// Modes of atlas texture uploads.
+enum GlyphCacheUploadMode {
+  // A bounding rect of dirty regions is tracked per slice and uploaded with
+  // full width scanlines. (Default.)
+  kGlyphCacheUploadModeFullWidth = 0,
+  // Multiple disjoint dirty rects are tracked per slice and each of them is
+  // uploaded through a packed staging buffer, which reduces upload bandwidth.
+  kGlyphCacheUploadModeSubRect = 1,
+  // Same as kGlyphCacheUploadModeSubRect, but dirty rects are streamed through
+  // double buffered pixel buffer objects so that uploads don't stall the
+  // rendering thread. Falls back to kGlyphCacheUploadModeSubRect when pixel
+  // buffer objects are not available (e.g. OpenGL ES 2.0).
+  kGlyphCacheUploadModeAsync = 2,
+};
+
+// Max number of dirty rects tracked per slice with
+// kGlyphCacheUploadModeSubRect. When the number exceeds, rects are merged.
+const size_t kGlyphCacheMaxDirtyRects = 8;
+
 // Flags that indicates glyph cache image format.
 enum GlyphFormats {
   kGlyphFormatsMono = 0,            // Single channel monochrome glyph.
   kGlyphFormatsColor = 0x80000000,  // Color glyph.
+  // Multi-channel SDF glyph.
+  kGlyphFormatsMultiChannelSDF = 0x40000000,
+  // Bits of a slice index indicating the format of the slice.
+  kGlyphFormatsMask = 0xc0000000,
 };
 
 const float kSDFThresholdDefault = 16.0f / 255.0f;
@@ -110,9 +159,13 @@ struct GlyphCacheStats {
   int32_t lookup_;     // Number of cache look-up happened.
   int32_t hit_;        // Number of cache hit happened during cache look-up.
   int32_t row_flush_;  // Number of cache row flush happened.
+  int32_t row_merge_;  // Number of cache row merge happened.
+  int32_t row_compaction_;  // Number of rows freed up by the compaction.
   int32_t set_fail_;   // Occurance of cache look up failure.
                        // This would involve full cache flush.
-#endif                 // GLYPH_CACHE_STATS
+  int32_t used_area_;  // Atlas area reserved by cached glyphs in pixels.
+  int32_t total_area_;  // Total area of allocated atlas slices in pixels.
+#endif                  // GLYPH_CACHE_STATS
 };
 
 // Class that includes glyph parameters.
@@ -146,14 +199,32 @@ class GlyphKey {
   }
 
   // Hash function.
-  size_t operator()(const GlyphKey &key) const {
+  size_t operator()(const GlyphKey &key) const { return key.Hash(); }
+
+  // Retrieve a hash value of the key.
+  // The code point, size and flags are packed into a 64 bit word and mixed
+  // with the font id, so that glyphs of a same font spread over the table.
+  size_t Hash() const {
     // Note that font_id_ is an already hashed value.
-    auto value = HashCombine<uint32_t>(key.font_id_, key.code_point_);
-    value = HashCombine<uint32_t>(value, key.glyph_size_);
-    value = HashCombine<int32_t>(value, key.flags_);
-    return value;
+    uint64_t value = (static_cast<uint64_t>(code_point_) << 32) |
+                     (static_cast<uint64_t>(glyph_size_) << 3) |
+                     static_cast<uint64_t>(flags_ & 0x7);
+    value ^= static_cast<uint64_t>(font_id_) * 0x9e3779b97f4a7c15ULL;
+    // 64 bit finalizer of MurmurHash3.
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return static_cast<size_t>(value);
   }
 
+  // Getters.
+  HashedId get_font_id() const { return font_id_; }
+  uint32_t get_code_point() const { return code_point_; }
+  uint32_t get_glyph_size() const { return glyph_size_; }
+  GlyphFlags get_flags() const { return flags_; }
+
  private:
   HashedId font_id_;
   uint32_t code_point_;
@@ -164,14 +235,16 @@ class GlyphKey {
 // Cache entry for a glyph.
 class GlyphCacheEntry {
  public:
-  // Typedef for cache entry map's iterator.
-  typedef std::map<GlyphKey, std::unique_ptr<GlyphCacheEntry>,
-                   GlyphKey>::iterator iterator;
+  // Typedef for a reference to an entry in the cache entry map.
+  // Entries are pooled in GlyphCacheEntryMap and the pointer stays valid until
+  // the entry is erased from the map.
+  typedef GlyphCacheEntry *iterator;
   typedef std::list<GlyphCacheRow>::iterator iterator_row;
 
   GlyphCacheEntry()
       : code_point_(0), size_(0, 0), offset_(0.f, 0.f), advance_(0, 0),
-        color_glyph_(false) {}
+        color_glyph_(false), multi_channel_sdf_(false),
+        gpu_resident_(false) {}
 
   // Setter/Getter of code point.
   // Code point is an entry in a font file, not a direct transform of Unicode.
@@ -208,10 +281,23 @@ class GlyphCacheEntry {
   bool get_color_glyph() const { return color_glyph_; }
   void set_color_glyph(bool b) { color_glyph_ = b; }
 
+  // Setter/Getter of multi-channel SDF information. Multi-channel SDF glyphs
+  // are stored in a RGBA buffer of their own.
+  bool get_multi_channel_sdf() const { return multi_channel_sdf_; }
+  void set_multi_channel_sdf(bool b) { multi_channel_sdf_ = b; }
+
+  // Getter of GPU resident state. The image of a GPU resident glyph is only
+  // in the atlas texture, until it's stored with GlyphCache::UpdateImage().
+  bool get_gpu_resident() const { return gpu_resident_; }
+
  private:
   // Friend class, GlyphCache needs an access to internal variables of the
   // class.
   friend class GlyphCache;
+  friend class GlyphCacheEntryMap;
+
+  // A key of the entry in the cache entry map.
+  GlyphKey key_;
 
   // Code point of the glyph.
   uint32_t code_point_;
@@ -242,6 +328,12 @@ class GlyphCacheEntry {
 
   // Flag indicating if the glyph is color glyph.
   bool color_glyph_;
+
+  // Flag indicating if the glyph is a multi-channel SDF glyph.
+  bool multi_channel_sdf_;
+
+  // Flag indicating if the glyph's image is only in the atlas texture.
+  bool gpu_resident_;
 };
 
 // Single row in a cache. A row correspond to a horizontal slice of a texture.
@@ -251,16 +343,23 @@ class GlyphCacheEntry {
 // One cache row contains multiple GlyphCacheEntry with a same or smaller
 // height. GlyphCacheEntry entries are stored from left to right and not evicted
 // per glyph, but entire row at once for a performance reason.
+// With kGlyphCachePackingSkyline, the row tracks a skyline of reserved areas
+// and entries shorter than the row are stacked in the row as well.
 // GlyphCacheRow is an internal class for GlyphCache.
 class GlyphCacheRow {
  public:
-  GlyphCacheRow() { Initialize(0, 0, mathfu::vec2i(0, 0)); }
+  GlyphCacheRow() : packing_(kGlyphCachePackingRow) {
+    Initialize(0, 0, mathfu::vec2i(0, 0));
+  }
   // Constructor with an arguments.
   // slice : an index indicating a glyph cache slice.
   // y_pos : vertical position of the row in the buffer.
   // witdh : width of the row. Typically same value of the buffer width.
   // height : height of the row.
-  GlyphCacheRow(int32_t slice, int32_t y_pos, const mathfu::vec2i &size) {
+  // packing : packing strategy of glyphs in the row.
+  GlyphCacheRow(int32_t slice, int32_t y_pos, const mathfu::vec2i &size,
+                GlyphCachePacking packing = kGlyphCachePackingRow)
+      : packing_(packing) {
     Initialize(slice, y_pos, size);
   }
   ~GlyphCacheRow() {}
@@ -269,25 +368,44 @@ class GlyphCacheRow {
   void Initialize(int32_t slice, int32_t y_pos, const mathfu::vec2i &size) {
     slice_ = slice;
     last_used_counter_ = 0;
+    pinned_ = false;
     y_pos_ = y_pos;
     remaining_width_ = size.x;
+    used_area_ = 0;
     size_ = size;
     cached_entries_.clear();
+    skyline_.clear();
+    if (packing_ == kGlyphCachePackingSkyline) {
+      SkylineNode node = {0, size.x, 0};
+      skyline_.push_back(node);
+    }
   }
 
   // Check if the row has a room for a requested width and height.
   bool DoesFit(const mathfu::vec2i &size) const {
+    if (packing_ == kGlyphCachePackingSkyline) {
+      int32_t y;
+      return FindSkylinePosition(size, &y) >= 0;
+    }
     return !(size.x > remaining_width_ || size.y > size_.y);
   }
 
   // Reserve an area in the row.
-  int32_t Reserve(const GlyphCacheEntry::iterator it,
-                  const mathfu::vec2i &size) {
+  // Returns a position of the reserved area relative to the row origin.
+  mathfu::vec2i Reserve(const GlyphCacheEntry::iterator it,
+                        const mathfu::vec2i &size) {
     assert(DoesFit(size));
 
     // Update row info.
-    int32_t pos = size_.x - remaining_width_;
-    remaining_width_ -= size.x;
+    mathfu::vec2i pos(size_.x - remaining_width_, 0);
+    if (packing_ == kGlyphCachePackingSkyline) {
+      auto index = FindSkylinePosition(size, &pos.y);
+      pos.x = skyline_[index].x;
+      AddSkylineNode(index, pos, size);
+    } else {
+      remaining_width_ -= size.x;
+    }
+    used_area_ += size.x * size.y;
     cached_entries_.push_back(it);
     return pos;
   }
@@ -308,9 +426,20 @@ class GlyphCacheRow {
   int32_t get_slice() const { return slice_; }
   void set_slice(int32_t slice) { slice_ = slice; }
 
+  // Setter/Getter of the pinned state. Pinned rows hold pinned glyphs only and
+  // are never evicted. The state is cleared when the row is initialized.
+  bool get_pinned() const { return pinned_; }
+  void set_pinned(bool pinned) { pinned_ = pinned; }
+
   // Getter of cached glyphs.
   size_t get_num_glyphs() const { return cached_entries_.size(); }
 
+  // Getter of number of FontBuffers referencing the row.
+  size_t get_num_references() const { return ref_.size(); }
+
+  // Getter of the area reserved by cached glyphs in the row.
+  int32_t get_used_area() const { return used_area_; }
+
   // Setter/Getter of iterator to row LRU.
   const std::list<GlyphCacheEntry::iterator_row>::iterator get_it_lru_row()
       const {
@@ -335,12 +464,22 @@ class GlyphCacheRow {
   std::vector<GlyphCacheEntry::iterator> &get_cached_entries() {
     return cached_entries_;
   }
+  const std::vector<GlyphCacheEntry::iterator> &get_cached_entries() const {
+    return cached_entries_;
+  }
 
-  // Add a reference to the glyph cache row.
-  void AddRef(FontBuffer *p) { ref_.insert(p); }
+  // Add a reference to the glyph cache row. The caller needs to make sure the
+  // buffer isn't referencing the row yet (FontBuffer::AddCacheRowReference()).
+  void AddRef(FontBuffer *p) { ref_.push_back(p); }
 
   // Release a reference from the glyph cache row.
-  void Release(FontBuffer *p) { ref_.erase(p); }
+  void Release(FontBuffer *p) {
+    auto it = std::find(ref_.begin(), ref_.end(), p);
+    if (it != ref_.end()) {
+      *it = ref_.back();
+      ref_.pop_back();
+    }
+  }
 
   // Invalidate FontBuffers that are referencing the cache row when the row
   // becomes invalid.
@@ -349,15 +488,53 @@ class GlyphCacheRow {
   // Release a reference to the row from existing FontBuffers.
   void ReleaseReferencesFromFontBuffers();
 
+  // Retrieve a size of memory used by the row, including its skyline and
+  // tracked entries and references.
+  size_t GetMemorySize() const {
+    return sizeof(*this) + skyline_.capacity() * sizeof(SkylineNode) +
+           cached_entries_.capacity() * sizeof(GlyphCacheEntry::iterator) +
+           ref_.capacity() * sizeof(FontBuffer *);
+  }
+
  private:
+  // A horizontal segment of the skyline.
+  // y is a top of reserved areas in the segment relative to the row origin.
+  struct SkylineNode {
+    int32_t x;
+    int32_t width;
+    int32_t y;
+  };
+
+  // Find the lowest position in the skyline that fits a requested size.
+  // Returns an index of the skyline node where the area starts and stores a
+  // vertical position of the area to y, or -1 if the area doesn't fit.
+  int32_t FindSkylinePosition(const mathfu::vec2i &size, int32_t *y) const;
+
+  // Add a skyline node for an area reserved at the node with a given index.
+  void AddSkylineNode(int32_t index, const mathfu::vec2i &pos,
+                      const mathfu::vec2i &size);
+
   // Last used counter value of the entry. The value is used to determine
   // if the entry can be evicted from the cache.
   uint32_t last_used_counter_;
 
+  // Flag indicating if the row holds pinned glyphs.
+  bool pinned_;
+
   // Remaining width of the row.
   // As new contents are added to the row, remaining width decreases.
   int32_t remaining_width_;
 
+  // Area reserved by cached entries in the row.
+  int32_t used_area_;
+
+  // Packing strategy of the row.
+  GlyphCachePacking packing_;
+
+  // Skyline of the row, sorted by x position. Only used with
+  // kGlyphCachePackingSkyline.
+  std::vector<SkylineNode> skyline_;
+
   // Index indicating a glyph cache slice.
   int32_t slice_;
 
@@ -378,15 +555,20 @@ class GlyphCacheRow {
   // When flushing the row, entries in the map is removed using the vector.
   std::vector<GlyphCacheEntry::iterator> cached_entries_;
 
-  // Set holding pointers of FontBuffer that is referencing the cache row.
-  std::set<FontBuffer *> ref_;
+  // Pointers of FontBuffers referencing the cache row, in no particular
+  // order. A flat array avoids a node allocation per reference.
+  std::vector<FontBuffer *> ref_;
 };
 
 // The base class of GlyphCacheBuffer.
 // The class maintains cache rows.
 class GlyphCacheBufferBase {
  public:
-  GlyphCacheBufferBase() : max_slices_(0), dirty_(false) {
+  GlyphCacheBufferBase()
+      : max_slices_(0),
+        dirty_(false),
+        packing_(kGlyphCachePackingRow),
+        upload_mode_(kGlyphCacheUploadModeFullWidth) {
     size_ = mathfu::kZeros2i;
   }
   virtual ~GlyphCacheBufferBase() {}
@@ -395,7 +577,9 @@ class GlyphCacheBufferBase {
                           int32_t max_slices);
   const mathfu::vec2i &get_size() const { return size_; }
 
-  bool FindRow(int32_t req_width, int32_t req_height,
+  // Find a row that has a room for a requested size. Rows holding glyphs are
+  // only used when their pinned state matches 'pinned'.
+  bool FindRow(int32_t req_width, int32_t req_height, bool pinned,
                GlyphCacheEntry::iterator_row *it_found);
 
   // Insert new row to the row list with a given size.
@@ -406,11 +590,20 @@ class GlyphCacheBufferBase {
   // Update the row LRU list.
   void UpdateRowLRU(std::list<GlyphCacheEntry::iterator_row>::iterator it);
 
+  // Flush adjacent rows that are not used in current rendering cycle and merge
+  // them into one row with 'req_height' or larger height.
+  // Among candidates, rows holding the least number of glyphs are merged.
+  // Returns true if the rows are merged.
+  bool MergeRows(int32_t req_height);
+
   // Update dirty rect.
   void UpdateDirtyRect(int32_t slice, const mathfu::vec4i &rect);
 
-  // Getter of dirty rect.
-  const mathfu::vec4i &get_dirty_rect(int32_t slice) const {
+  // Mark entire slices dirty.
+  void SetDirtyAll();
+
+  // Getter of dirty rects.
+  const std::vector<mathfu::vec4i> &get_dirty_rects(int32_t slice) const {
     return dirty_rects_[slice];
   }
 
@@ -420,6 +613,31 @@ class GlyphCacheBufferBase {
   }
   void set_dirty_state(bool dirty) { dirty_ = dirty; }
 
+  // Getter/Setter of the packing strategy.
+  // The strategy is applied to rows created after the call.
+  GlyphCachePacking get_packing() const { return packing_; }
+  void set_packing(GlyphCachePacking packing) { packing_ = packing; }
+
+  // Retrieve an area reserved by cached glyphs in the buffer.
+  int32_t GetUsedArea() const;
+
+  // Getter of rows in the buffer.
+  const std::list<GlyphCacheRow> &get_rows() const { return list_row_; }
+
+  // Turn pinned rows into regular rows.
+  void UnpinRows();
+
+  // Retrieve the number of glyphs in pinned rows.
+  size_t GetNumPinnedGlyphs() const;
+
+  // Retrieve a size of memory used by rows, their look-up structures and
+  // dirty rects of the buffer.
+  size_t GetRowMemorySize() const;
+
+  // Getter/Setter of the upload mode.
+  GlyphCacheUploadMode get_upload_mode() const { return upload_mode_; }
+  void set_upload_mode(GlyphCacheUploadMode mode) { upload_mode_ = mode; }
+
   // Virtual functions to retrieve buffer parameters.
   virtual fplbase::TextureFormat get_texture_format() = 0;
   virtual int32_t get_num_slices() const = 0;
@@ -430,9 +648,20 @@ class GlyphCacheBufferBase {
   virtual void ClearPaddingRegion(const mathfu::vec3i &pos,
                                   const mathfu::vec2i &padding,
                                   const GlyphCacheEntry *entry) = 0;
-  virtual void ResolveDirtyRect() = 0;
+  virtual size_t ResolveDirtyRect() = 0;
 
  protected:
+  // Check if the row can be flushed in current rendering cycle.
+  bool IsEvictable(const GlyphCacheRow &row) const;
+
+  // Find a row other than 'exclude' that already holds glyphs and has a room
+  // for a requested size. Rows in 'scratch' are used instead of actual rows to
+  // simulate multiple reservations.
+  bool FindRowToMove(
+      const mathfu::vec2i &req_size, const GlyphCacheRow *exclude,
+      std::map<GlyphCacheRow *, GlyphCacheRow> *scratch,
+      GlyphCacheEntry::iterator_row *it_found);
+
   // list of rows in the cache.
   std::list<GlyphCacheRow> list_row_;
 
@@ -456,8 +685,14 @@ class GlyphCacheBufferBase {
   // atlas texture needs to be uploaded.
   bool dirty_;
 
-  // Dirty region in the buffer.
-  std::vector<mathfu::vec4i> dirty_rects_;
+  // Dirty regions in the buffer for each slice.
+  std::vector<std::vector<mathfu::vec4i> > dirty_rects_;
+
+  // Packing strategy of glyphs in rows.
+  GlyphCachePacking packing_;
+
+  // Upload mode of dirty regions.
+  GlyphCacheUploadMode upload_mode_;
 
   // Pointer to the cache class to retrieve cache system parameters.
   GlyphCache *cache_;
@@ -466,6 +701,8 @@ class GlyphCacheBufferBase {
 template <typename T>
 class GlyphCacheBuffer : public GlyphCacheBufferBase {
  public:
+  GlyphCacheBuffer() : format_(kGlyphFormatsMono) {}
+
   virtual void Initialize(GlyphCache *cache, const mathfu::vec2i &size,
                           int32_t max_slices) {
     GlyphCacheBufferBase::Initialize(cache, size, max_slices);
@@ -531,7 +768,7 @@ class GlyphCacheBuffer : public GlyphCacheBufferBase {
     // Increase the buffer size.
     int32_t new_index = static_cast<int32_t>(buffers_.size());
     buffers_.resize(new_index + 1);
-    dirty_rects_.resize(new_index + 1, mathfu::kZeros4i);
+    dirty_rects_.resize(new_index + 1);
 
     // Allocate the glyph cache buffer.
     // A buffer format can be 8/32 bpp (32 bpp is mostly used for Emoji).
@@ -553,34 +790,95 @@ class GlyphCacheBuffer : public GlyphCacheBufferBase {
 
   // Pre allocate texture structure.
   void AllocateTextureInfo() {
-    for (auto i = 0; i < max_slices_; ++i) {
+    for (auto i = static_cast<int32_t>(textures_.size()); i < max_slices_;
+         ++i) {
       textures_.push_back(
           fplbase::Texture(nullptr, get_texture_format(),
                            fplbase::kTextureFlagsClampToEdge));
     }
   }
 
+  // Remove the last slice of the buffer and its texture when glyphs in the
+  // slice are not pinned and have not been used for 'idle_cycles' rendering
+  // cycles. Glyphs in the slice are flushed. The first slice is never removed.
+  // 'idle_cycles' needs to be 1 or larger, so that FontBuffers rendered in the
+  // current cycle keep their slices.
+  // Returns true if the slice is removed.
+  bool RemoveLastSlice(uint32_t idle_cycles);
+
+  // Change the max # of slices. Slices beyond the max are not removed.
+  void set_max_slices(int32_t max_slices) {
+    max_slices_ = max_slices;
+    AllocateTextureInfo();
+  }
+
+  // Retrieve a size of memory used by the slices and the staging buffer.
+  // Textures of the slices use the same size in the GPU.
+  size_t GetMemorySize() const {
+    return buffers_.size() * size_.x * size_.y * sizeof(T) +
+           staging_buffer_.capacity() * sizeof(T);
+  }
+
   // Resolve the dirty state of the cache. If the cache has any dirty rect,
   // the API copies the rect to the texture using FPLBase API.
-  void ResolveDirtyRect() {
+  // Returns the # of bytes uploaded.
+  size_t ResolveDirtyRect() {
+    size_t bytes = 0;
     auto slices = get_num_slices();
     for (auto i = 0; i < slices; ++i) {
-      auto rect = get_dirty_rect(i);
-      if (!fplbase::ValidTextureHandle(textures_[i].id())) {
-        // Give a texture size but don't have to clear the texture here.
-        textures_[i].LoadFromMemory(nullptr, get_size(), get_texture_format());
-      }
-      if (rect.z - rect.x > 0 && rect.w - rect.y > 0) {
-        textures_[i].UpdateTexture(
-            0, get_texture_format(), 0, rect.y, get_size().x, rect.w - rect.y,
-            get(i) + get_element_size() * get_size().x * rect.y);
+      AllocateTexture(i);
+      auto &rects = dirty_rects_[i];
+      for (auto it = rects.begin(); it != rects.end(); ++it) {
+        auto rect = *it;
+        if (rect.z - rect.x <= 0 || rect.w - rect.y <= 0) {
+          continue;
+        }
+        if (upload_mode_ == kGlyphCacheUploadModeFullWidth ||
+            rect.z - rect.x == size_.x) {
+          // Upload full width scanlines directly from the buffer.
+          textures_[i].UpdateTexture(
+              0, get_texture_format(), 0, rect.y, size_.x, rect.w - rect.y,
+              get(i) + get_element_size() * size_.x * rect.y);
+          bytes += size_.x * (rect.w - rect.y) * sizeof(T);
+        } else {
+          bytes += UploadSubRect(i, rect);
+        }
       }
+      rects.clear();
     }
     set_dirty_state(false);
+    return bytes;
+  }
+
+  // Retrieve a size of the staging memory required to upload dirty rects.
+  size_t GetStagingSize() const {
+    size_t size = 0;
+    for (size_t i = 0; i < dirty_rects_.size(); ++i) {
+      auto &rects = dirty_rects_[i];
+      for (auto it = rects.begin(); it != rects.end(); ++it) {
+        auto rect = AlignUploadRect(*it);
+        if (rect.z - rect.x > 0 && rect.w - rect.y > 0) {
+          size += (rect.z - rect.x) * (rect.w - rect.y) * sizeof(T);
+        }
+      }
+    }
+    return size;
   }
 
+  // Copy dirty rects to the staging memory at the offset and queue uploads
+  // to the uploader. The offset is advanced by the copied size.
+  void StageDirtyRects(GlyphCacheUploader *uploader, uint8_t *staging,
+                       size_t *offset);
+
   bool PurgeCache(int32_t req_height);
 
+  // Move all glyphs in the least recently used row that can be moved into other
+  // rows, and free up the row.
+  // Unlike row flushes, rows used in current rendering cycle can be compacted
+  // too. Rows referenced by reference counting FontBuffers are not moved.
+  // Returns true if a row is freed up.
+  bool CompactRow();
+
   void Reset() {
     // Release reference from FontBuffers to GlyphCacheRows.
     auto begin = list_row_.begin();
@@ -621,19 +919,222 @@ class GlyphCacheBuffer : public GlyphCacheBufferBase {
     return fplbase::kFormatLuminance;
   }
 
-  // Retrieve the buffer format.
+  // Getter/Setter of the buffer format.
+  // 8 bit buffers are treated as a monochrome buffer (used for regular and
+  // SDF glyphs), and 32 bit buffers as a color buffer by default.
   GlyphFormats buffer_format() {
-    if (sizeof(T) > 1) {
-      // 8 bit buffers are treated as a monochrome buffer (used for regular and
-      // SDF glyphs).
-      return kGlyphFormatsColor;
+    if (format_ != kGlyphFormatsMono) {
+      return format_;
     }
-    return kGlyphFormatsMono;
+    return sizeof(T) > 1 ? kGlyphFormatsColor : kGlyphFormatsMono;
   }
+  void set_buffer_format(GlyphFormats format) { format_ = format; }
 
  private:
+  // Expand a dirty rect horizontally to 4 bytes boundaries so that scanlines
+  // are aligned regardless of GL_UNPACK_ALIGNMENT setting.
+  mathfu::vec4i AlignUploadRect(const mathfu::vec4i &rect) const {
+    const int32_t align = std::max(1, 4 / static_cast<int32_t>(sizeof(T)));
+    return mathfu::vec4i(rect.x & ~(align - 1), rect.y,
+                         std::min(size_.x, (rect.z + align - 1) & ~(align - 1)),
+                         rect.w);
+  }
+
+  // Copy an aligned rect in the slice to packed memory.
+  void CopyRect(int32_t slice, const mathfu::vec4i &rect, T *dest) const {
+    const int32_t width = rect.z - rect.x;
+    auto src = buffers_[slice].get() + rect.x + rect.y * size_.x;
+    for (int32_t y = 0; y < rect.w - rect.y; ++y) {
+      memcpy(dest + y * width, src + y * size_.x, width * sizeof(T));
+    }
+  }
+
+  // Upload a region of the slice through the staging buffer.
+  // Returns the # of bytes uploaded.
+  size_t UploadSubRect(int32_t slice, const mathfu::vec4i &dirty_rect) {
+    auto rect = AlignUploadRect(dirty_rect);
+    staging_buffer_.resize((rect.z - rect.x) * (rect.w - rect.y));
+    CopyRect(slice, rect, staging_buffer_.data());
+    textures_[slice].UpdateTexture(0, get_texture_format(), rect.x, rect.y,
+                                   rect.z - rect.x, rect.w - rect.y,
+                                   staging_buffer_.data());
+    return staging_buffer_.size() * sizeof(T);
+  }
+
+  // Allocate the texture of the slice if it's not allocated yet.
+  void AllocateTexture(int32_t slice) {
+    if (!fplbase::ValidTextureHandle(textures_[slice].id())) {
+      // Give a texture size but don't have to clear the texture here.
+      textures_[slice].LoadFromMemory(nullptr, get_size(),
+                                      get_texture_format());
+    }
+  }
+
+  // Move all glyphs in the row to other rows. Returns false without moving any
+  // glyph if all of them don't fit to other rows.
+  bool MoveEntries(GlyphCacheEntry::iterator_row row);
+
+  // Copy a glyph image in the buffer to another position.
+  void MoveImage(const mathfu::vec3i &src, const mathfu::vec3i &dest,
+                 const mathfu::vec2i &size) {
+    auto src_buffer = buffers_[src.z].get();
+    auto dest_buffer = buffers_[dest.z].get();
+    for (int32_t y = 0; y < size.y; ++y) {
+      memcpy(dest_buffer + dest.x + (dest.y + y) * size_.x,
+             src_buffer + src.x + (src.y + y) * size_.x, size.x * sizeof(T));
+    }
+  }
+
   std::vector<std::unique_ptr<T[]> > buffers_;
   std::vector<fplbase::Texture> textures_;
+
+  // Staging buffer to upload sub regions of buffers.
+  std::vector<T> staging_buffer_;
+
+  // Format of the buffer set with set_buffer_format().
+  GlyphFormats format_;
+};
+
+// Open addressing hash table holding GlyphCacheEntry keyed by GlyphKey.
+// The table stores a key and a pointer per slot and resolves collisions with
+// linear probing. Erased slots are back-shifted so that look-ups never need to
+// skip tombstones.
+// Entries are allocated from pooled blocks and recycled when they are erased,
+// so that caching and evicting glyphs doesn't allocate memory per entry, and
+// pointers to entries stay valid while rows are referencing them.
+class GlyphCacheEntryMap {
+ public:
+  GlyphCacheEntryMap() : size_(0) {}
+
+  // Look up an entry with a given key.
+  // Returns nullptr if the key is not in the map.
+  GlyphCacheEntry *Find(const GlyphKey &key) const;
+
+  // Insert a copy of the entry with a given key.
+  // The key must not be in the map.
+  GlyphCacheEntry *Insert(const GlyphKey &key, const GlyphCacheEntry &entry);
+
+  // Erase an entry returned by Insert() and return it to the pool.
+  void Erase(GlyphCacheEntry *entry);
+
+  // Erase all entries. Pooled blocks are kept for a later use.
+  void Clear();
+
+  // Number of entries in the map.
+  size_t size() const { return size_; }
+
+  // Retrieve a size of memory used by the slots and pooled entries.
+  size_t GetMemorySize() const {
+    return slots_.capacity() * sizeof(Slot) +
+           blocks_.size() * kEntriesPerBlock * sizeof(GlyphCacheEntry) +
+           free_entries_.capacity() * sizeof(GlyphCacheEntry *);
+  }
+
+ private:
+  struct Slot {
+    Slot() : entry(nullptr) {}
+    GlyphKey key;
+    GlyphCacheEntry *entry;
+  };
+
+  // Initial number of slots. Needs to be power of 2.
+  static const size_t kInitialSlots = 256;
+  // Number of entries allocated at once in the pool.
+  static const size_t kEntriesPerBlock = 128;
+
+  // Retrieve an index of the slot holding the key, or an empty slot where the
+  // key should be inserted.
+  size_t FindSlot(const GlyphKey &key) const;
+
+  // Double the number of slots and re-insert existing entries.
+  void Grow();
+
+  // Retrieve an unused entry from the pool.
+  GlyphCacheEntry *AllocateEntry();
+
+  // Slots of the table. Max load factor of the table is 1/2.
+  std::vector<Slot> slots_;
+
+  // Number of entries in the map.
+  size_t size_;
+
+  // Pooled blocks of entries.
+  std::vector<std::unique_ptr<GlyphCacheEntry[]> > blocks_;
+
+  // Entries in the pool that are not in use.
+  std::vector<GlyphCacheEntry *> free_entries_;
+};
+
+// Streams dirty regions of the glyph cache to atlas textures through double
+// buffered pixel buffer objects. Texture updates are issued from a buffer
+// object, so that the driver can copy pixels asynchronously, and a fence is
+// inserted after them. A staging buffer is reused only after its fence is
+// signaled.
+// The class is implemented with OpenGL ES 3.0 / OpenGL APIs and all APIs need
+// to be invoked in the rendering thread.
+class GlyphCacheUploader {
+ public:
+  GlyphCacheUploader();
+  ~GlyphCacheUploader();
+
+  // Check if pixel buffer objects are supported in current renderer.
+  static bool IsSupported();
+
+  // Map a staging buffer with a given size.
+  // Returns nullptr if the staging buffer is still in use.
+  uint8_t *Map(size_t size);
+
+  // Queue a texture upload from the mapped staging buffer. 'rect' is a region
+  // in the texture and 'offset' is a position of packed pixels in the staging
+  // buffer.
+  void Upload(fplbase::Texture *texture, fplbase::TextureFormat format,
+              const mathfu::vec4i &rect, size_t offset);
+
+  // Unmap the staging buffer, issue queued uploads and insert a fence.
+  // The revision is reported by get_completed_revision() after uploads are
+  // completed.
+  // Returns false if contents of the staging buffer have been lost and the
+  // uploads are discarded.
+  bool Submit(int32_t revision);
+
+  // Check fences of submitted uploads.
+  // Returns true if there are no uploads in flight.
+  bool Poll();
+
+  // Returns true if there are uploads in flight.
+  bool get_pending() const;
+
+  // Getter of a cache revision whose uploads are completed.
+  int32_t get_completed_revision() const { return completed_revision_; }
+
+ private:
+  struct UploadRequest {
+    fplbase::Texture *texture;
+    fplbase::TextureFormat format;
+    mathfu::vec4i rect;
+    size_t offset;
+  };
+
+  struct StagingBuffer {
+    uint32_t handle;
+    size_t capacity;
+    // Fence of uploads issued from the buffer. nullptr when the buffer is
+    // available.
+    void *fence;
+    int32_t revision;
+  };
+
+  static const int32_t kNumStagingBuffers = 2;
+
+  StagingBuffer staging_buffers_[kNumStagingBuffers];
+
+  // Index of the staging buffer used for next uploads.
+  int32_t current_;
+
+  // Uploads queued to the mapped staging buffer.
+  std::vector<UploadRequest> requests_;
+
+  int32_t completed_revision_;
 };
 
 class GlyphCache {
@@ -642,7 +1143,9 @@ class GlyphCache {
   // width: width of the glyph cache texture. Rounded up to power of 2.
   // height: height of the glyph cache texture. Rounded up to power of 2.
   // max_slices: max number of slices in the cache.
-  GlyphCache(const mathfu::vec2i &size, int32_t max_slices);
+  // packing: packing strategy of glyphs in cache rows.
+  GlyphCache(const mathfu::vec2i &size, int32_t max_slices,
+             GlyphCachePacking packing = kGlyphCachePackingRow);
   ~GlyphCache() {};
 
   // Look up a cached entries.
@@ -657,43 +1160,150 @@ class GlyphCache {
   const GlyphCacheEntry *Set(const void *const image, const GlyphKey &key,
                              const GlyphCacheEntry &entry);
 
+  // Replace an image of an entry already in the cache, e.g. a glyph image
+  // rasterized asynchronously after its region was reserved by Set().
+  // The image needs to have the reserved size.
+  // Return value: false if the entry has been evicted, or its size doesn't
+  // match.
+  bool UpdateImage(const GlyphKey &key, const mathfu::vec2i &size,
+                   const void *const image);
+
+  // Mark an entry whose image is generated in the atlas texture by the GPU,
+  // so that the buffer doesn't have the image until it's stored with
+  // UpdateImage(). GPU resident glyphs are not moved by row compactions, nor
+  // saved in atlases.
+  // Return value: false if the entry is not in the cache.
+  bool SetGpuResident(const GlyphKey &key);
+
+  // Look up a GPU resident entry without marking it used.
+  // Return value: nullptr if the entry is not in the cache, or its image has
+  // been stored.
+  const GlyphCacheEntry *FindGpuResident(const GlyphKey &key) const;
+
+  // Set an entry to the cache in a pinned row.
+  // Pinned rows are not evicted, merged nor compacted, and pinned glyphs are
+  // stored again after Flush(), so that they stay in the cache until they are
+  // unpinned.
+  // An entry already cached in a regular row is moved to a pinned row.
+  // Return value: A pointer to inserted entry. nullptr if there is no room in
+  // the cache.
+  const GlyphCacheEntry *SetPinned(const void *const image, const GlyphKey &key,
+                                   const GlyphCacheEntry &entry);
+
+  // Move a cached entry to a pinned row with its current image.
+  // Note that FontBuffers referencing the entry need to be reconstructed
+  // when the entry is moved.
+  // Return value: A pointer to the pinned entry. nullptr if the entry is not
+  // in the cache, or there is no room in the cache.
+  const GlyphCacheEntry *Pin(const GlyphKey &key);
+
+  // Turn all pinned glyphs into regular glyphs, which can be evicted.
+  void UnpinAll();
+
+  // Serialize monochrome glyphs in the cache and images of the atlas slices
+  // to a GlyphAtlas FlatBuffer (schemas/glyph_atlas.fbs).
+  void SaveAtlas(std::string *data) const;
+
+  // Load glyphs in a GlyphAtlas FlatBuffer created by SaveAtlas() to the cache
+  // as pinned glyphs.
+  // Return value: false if the buffer is invalid or glyphs don't fit in the
+  // cache.
+  bool LoadPinnedAtlas(const void *data, size_t size);
+
+  // Retrieve the number of pinned glyphs.
+  size_t GetNumPinnedGlyphs() const {
+    return buffers_.GetNumPinnedGlyphs() + color_buffers_.GetNumPinnedGlyphs() +
+           msdf_buffers_.GetNumPinnedGlyphs();
+  }
+
   // Flush all cache entries.
+  // Pinned glyphs are stored again after the flush.
   bool Flush();
 
   // Increment a cycle counter of the cache.
   // Invoke this API for each rendering cycle.
   // The counter is used to determine which cache entries can be evicted when
   // cache entries are full.
-  void Update() { counter_++; }
+  void Update() {
+    counter_++;
+    epoch_++;
+  }
 
   // Resolve dirty rects in the glyph cache. The API invoke FPLBase API to
   // update textures.
-  void ResolveDirtyRect() {
-    buffers_.ResolveDirtyRect();
-    color_buffers_.ResolveDirtyRect();
-  }
+  // With kGlyphCacheUploadModeAsync, uploads may be deferred and completed in
+  // later rendering cycles. get_uploaded_revision() returns a revision of the
+  // cache reflected in the textures.
+  void ResolveDirtyRect();
 
   // Return dirty state of the glyph cache.
+  // The cache stays dirty while asynchronous uploads are in flight.
   bool get_dirty_state() const {
-    return buffers_.get_dirty_state() || color_buffers_.get_dirty_state();
+    return buffers_.get_dirty_state() || color_buffers_.get_dirty_state() ||
+           msdf_buffers_.get_dirty_state() ||
+           (uploader_ != nullptr && uploader_->get_pending());
   }
 
   // Return number of cache slices in the cache.
   int32_t get_num_slices() const {
-    return buffers_.get_num_slices() + color_buffers_.get_num_slices();
+    return buffers_.get_num_slices() + color_buffers_.get_num_slices() +
+           msdf_buffers_.get_num_slices();
   }
 
   // Return number of the max cache slices in the cache.
   int32_t get_num_max_slices() const {
-    return buffers_.get_num_max_slices() + color_buffers_.get_num_max_slices();
+    return buffers_.get_num_max_slices() + color_buffers_.get_num_max_slices() +
+           msdf_buffers_.get_num_max_slices();
+  }
+
+  // Retrieve a size of memory used by slices of all buffers.
+  size_t GetAtlasMemorySize() const {
+    return buffers_.GetMemorySize() + color_buffers_.GetMemorySize() +
+           msdf_buffers_.GetMemorySize();
+  }
+
+  // Retrieve a size of memory used by the entry look-up map and rows.
+  size_t GetMetadataMemorySize() const {
+    return map_entries_.GetMemorySize() + buffers_.GetRowMemorySize() +
+           color_buffers_.GetRowMemorySize() + msdf_buffers_.GetRowMemorySize();
   }
 
+  // Remove trailing slices of buffers, multi-channel SDF and color ones
+  // first, until slices fit in the budget in bytes. Slices holding glyphs
+  // used in the current or the previous rendering cycle are kept, so the
+  // cache may exceed the budget. Textures of the removed slices are deleted,
+  // so invoke the API in the rendering thread.
+  // Returns the # of removed slices.
+  int32_t TrimSlices(size_t budget);
+
+  // Remove trailing slices of buffers beyond the max # of slices, and
+  // trailing slices whose glyphs have not been used for 'idle_cycles'
+  // rendering cycles. 0 keeps idle slices. Invoke the API in the rendering
+  // thread.
+  // Returns the # of removed slices.
+  int32_t ReleaseIdleSlices(uint32_t idle_cycles);
+
+  // Getter/Setter of the max # of slices per buffer. A raised max lets
+  // buffers allocate more slices on demand. With a lowered max, slices
+  // beyond it are removed by ReleaseIdleSlices() once they are not used in
+  // the current and the previous cycle.
+  int32_t get_max_slices() const { return max_slices_; }
+  void set_max_slices(int32_t max_slices);
+
   // Retrieve a cycle counter of the cache.
   uint32_t get_counter() const { return counter_; }
 
   // Debug API to show cache statistics.
   const GlyphCacheStats &Status();
 
+  // Set counters receiving glyph sets and upload bytes of the cache.
+  void set_pipeline_counters(TextPipelineCounters *counters) {
+    pipeline_counters_ = counters;
+  }
+  TextPipelineCounters *get_pipeline_counters() const {
+    return pipeline_counters_;
+  }
+
   // Enable color glyph cache in the cache.
   void EnableColorGlyph();
 
@@ -702,27 +1312,90 @@ class GlyphCache {
   // Getter of allocated glyph cache.
   GlyphCacheBuffer<uint8_t> *get_monochrome_buffer() { return &buffers_; }
   GlyphCacheBuffer<uint32_t> *get_color_buffer() { return &color_buffers_; }
+  GlyphCacheBuffer<uint32_t> *get_msdf_buffer() { return &msdf_buffers_; }
 
   // Getter of the counters.
   int32_t get_revision() const { return revision_; }
   int32_t get_last_flush_revision() const { return last_flushed_revision_; }
+  int32_t get_epoch() const { return epoch_; }
+  int32_t get_uploaded_revision() const { return uploaded_revision_; }
 
   // Getter of the cache size.
   const mathfu::vec2i &get_size() const { return size_; }
 
+  // Getter/Setter of the packing strategy.
+  // Changing the strategy flushes the cache.
+  GlyphCachePacking get_packing() const { return buffers_.get_packing(); }
+  void set_packing(GlyphCachePacking packing);
+
   // Getter/Setter of the glyph padding
   const mathfu::vec2i &get_padding() const { return padding_; }
   void set_padding(const mathfu::vec2i &padding) { padding_ = padding; }
 
+  // Getter/Setter of the upload mode of atlas textures.
+  GlyphCacheUploadMode get_upload_mode() const {
+    return buffers_.get_upload_mode();
+  }
+  void set_upload_mode(GlyphCacheUploadMode mode);
+
+  // Getter/Setter of the compaction flag.
+  // When the flag is set, the cache tries to move glyphs between rows to free
+  // up space before failing Set().
+  bool get_compaction() const { return compaction_; }
+  void set_compaction(bool compaction) { compaction_ = compaction; }
+
+  // Getter/Setter of the pinning mode.
+  // While the mode is set, entries stored with Set() go to pinned rows.
+  bool get_pinning() const { return pinning_; }
+  void set_pinning(bool pinning) { pinning_ = pinning; }
+
  private:
   // Friend class, GlyphCacheBuffer needs an access to internal variables of the
   // class.
+  friend class GlyphCacheBufferBase;
   template <typename T>
   friend class GlyphCacheBuffer;
 
   // Flush cached entries in the buffer.
   void FlushCachedEntries(std::vector<GlyphCacheEntry::iterator> &entries);
 
+  // Retrieve a size of the area reserved in a row for the entry.
+  mathfu::vec2i GetReservedSize(const GlyphCacheEntry &entry) const;
+
+  // Store the glyph image of the entry at a given position and link the entry
+  // to the row.
+  void PlaceEntry(GlyphCacheEntry *entry, GlyphCacheBufferBase *buffer,
+                  GlyphCacheEntry::iterator_row it_row,
+                  const mathfu::vec2i &row_pos, const void *const image);
+
+  // Erase an entry from the look-up map and its row.
+  void UnlinkEntry(GlyphCacheEntry *entry);
+
+  // Copy the image of a cached entry.
+  void CopyEntryImage(const GlyphCacheEntry &entry,
+                      std::vector<uint8_t> *image) const;
+
+  // A pinned glyph, its metrics and a copy of its image, kept while the cache
+  // is flushed. The entry itself is not stored since it has SIMD aligned
+  // members.
+  struct PinnedGlyph {
+    GlyphKey key;
+    uint32_t code_point;
+    mathfu::vec2i size;
+    mathfu::vec2 offset;
+    mathfu::vec2i advance;
+    bool color_glyph;
+    bool multi_channel_sdf;
+    std::vector<uint8_t> image;
+  };
+
+  // Copy glyphs in pinned rows of the buffer out of the cache.
+  void SavePinnedGlyphs(const GlyphCacheBufferBase &buffer,
+                        std::vector<PinnedGlyph> *glyphs) const;
+
+  // Store glyphs saved with SavePinnedGlyphs() to the cache again.
+  void RestorePinnedGlyphs(const std::vector<PinnedGlyph> &glyphs);
+
 #ifdef GLYPH_CACHE_STATS
   void ResetStats();
 #endif  // GLYPH_CACHE_STATS
@@ -746,6 +1419,10 @@ class GlyphCache {
   // EnableColorGlyphs() API is invoked.
   GlyphCacheBuffer<uint32_t> color_buffers_;
 
+  // Cache buffer for multi-channel SDF glyphs. The buffer is initialized when
+  // the first multi-channel SDF glyph is stored.
+  GlyphCacheBuffer<uint32_t> msdf_buffers_;
+
   // Max number of cache buffers. As a buffer gets full, the glyph cache tries
   // to increase number of cache buffers up to the number;
   int32_t max_slices_;
@@ -756,7 +1433,7 @@ class GlyphCache {
   // id, glyph size etc.
   // Note that the code point is an index in the font file and not a Unicode
   // value.
-  std::map<GlyphKey, std::unique_ptr<GlyphCacheEntry>, GlyphKey> map_entries_;
+  GlyphCacheEntryMap map_entries_;
 
   // Revision of the buffer.
   // Each time one or more cache entry is evicted, a revision of the cache is
@@ -770,8 +1447,32 @@ class GlyphCache {
   // A cache revision when the cache is flushed last time.
   int32_t last_flushed_revision_;
 
+  // Incremented when entries used in the current cycle may be evicted or
+  // moved: by a flush, a compaction, an unlinked entry, or a new cycle, after
+  // which rows used so far may be flushed to store new glyphs. Evictions of
+  // rows not used in the cycle don't change it. Entries looked up by a layout
+  // are valid while the epoch stays, so FontManager checks it before
+  // registering a buffer laid out while other threads updated the cache.
+  int32_t epoch_;
+
+  // Flag indicating Set() is storing a pinned glyph.
+  bool pinning_;
+
+  // Flag indicating if the compaction is enabled.
+  bool compaction_;
+
+  // A cache revision reflected in the atlas textures.
+  int32_t uploaded_revision_;
+
+  // Uploader for kGlyphCacheUploadModeAsync. Created in the rendering thread
+  // at the first upload.
+  std::unique_ptr<GlyphCacheUploader> uploader_;
+
   // Variables to track usage stats.
   GlyphCacheStats stats_;
+
+  // Counters of the owner's text pipeline. May be nullptr.
+  TextPipelineCounters *pipeline_counters_;
 };
 
 // The API tries to increase a buffer size up to specified slice first and if
@@ -780,6 +1481,8 @@ class GlyphCache {
 // (Note that rows used by 'reference counting' FontBuffers are never evicted)
 // Rows are stored in the queue in the order of it's size (and LRU if there are
 // multiple rows in the same size).
+// When no single row can be evicted, it tries to merge adjacent rows and then
+// to compact rows if the compaction is enabled.
 // API returns true if it allocates new buffer or the purge operation was
 // successful. Otherwise the API returns false which would initiate multi pass
 // glyph rendering in FlatUI (or the user may needs to increase cache size in
@@ -796,8 +1499,9 @@ bool GlyphCacheBuffer<T>::PurgeCache(int32_t req_height) {
   // height from LRU list.
   for (auto row_it = lru_row_.begin(); row_it != lru_row_.end(); ++row_it) {
     auto &row = *row_it;
-    if (row->get_last_used_counter() == cache_->get_counter()) {
-      // The row is being used in current rendering cycle.
+    if (row->get_last_used_counter() == cache_->get_counter() ||
+        row->get_pinned()) {
+      // The row is being used in current rendering cycle or pinned.
       // We can not evict the row.
       continue;
     }
@@ -812,9 +1516,148 @@ bool GlyphCacheBuffer<T>::PurgeCache(int32_t req_height) {
       return true;
     }
   }
+
+  // Try to merge adjacent rows.
+  if (MergeRows(req_height)) {
+    return true;
+  }
+
+  // As a last resort, move glyphs to free up rows and try again.
+  // Each time a row is freed up, number of rows that hold glyphs decreases so
+  // that the recursion terminates.
+  if (cache_->get_compaction()) {
+    return CompactRow();
+  }
+  return false;
+}
+
+template <typename T>
+void GlyphCacheBuffer<T>::StageDirtyRects(GlyphCacheUploader *uploader,
+                                          uint8_t *staging, size_t *offset) {
+  auto slices = get_num_slices();
+  for (auto i = 0; i < slices; ++i) {
+    AllocateTexture(i);
+    auto &rects = dirty_rects_[i];
+    for (auto it = rects.begin(); it != rects.end(); ++it) {
+      auto rect = AlignUploadRect(*it);
+      if (rect.z - rect.x <= 0 || rect.w - rect.y <= 0) {
+        continue;
+      }
+      CopyRect(i, rect, reinterpret_cast<T *>(staging + *offset));
+      uploader->Upload(&textures_[i], get_texture_format(), rect, *offset);
+      *offset += (rect.z - rect.x) * (rect.w - rect.y) * sizeof(T);
+    }
+    rects.clear();
+  }
+  set_dirty_state(false);
+}
+
+template <typename T>
+bool GlyphCacheBuffer<T>::RemoveLastSlice(uint32_t idle_cycles) {
+  auto slices = get_num_slices();
+  if (slices <= 1) {
+    return false;
+  }
+  auto slice = static_cast<int32_t>((slices - 1) | buffer_format());
+  for (auto it = list_row_.begin(); it != list_row_.end(); ++it) {
+    if (it->get_slice() != slice || !it->get_num_glyphs()) {
+      continue;
+    }
+    if (it->get_pinned() ||
+        cache_->get_counter() - it->get_last_used_counter() <= idle_cycles) {
+      return false;
+    }
+  }
+
+  // Flush and remove rows in the slice.
+  for (auto it = list_row_.begin(); it != list_row_.end();) {
+    auto row = it++;
+    if (row->get_slice() != slice) {
+      continue;
+    }
+    if (row->get_num_glyphs()) {
+      row->InvalidateReferencingBuffers();
+      cache_->FlushCachedEntries(row->get_cached_entries());
+    }
+    row->ReleaseReferencesFromFontBuffers();
+    lru_row_.erase(row->get_it_lru_row());
+    map_row_.erase(row->get_it_row_height_map());
+    list_row_.erase(row);
+  }
+
+  buffers_.pop_back();
+  dirty_rects_.pop_back();
+  textures_[slices - 1].Delete();
+  return true;
+}
+
+template <typename T>
+bool GlyphCacheBuffer<T>::CompactRow() {
+  for (auto row_it = lru_row_.begin(); row_it != lru_row_.end(); ++row_it) {
+    auto row = *row_it;
+    if (!row->get_num_glyphs() || row->get_num_references() ||
+        row->get_pinned()) {
+      continue;
+    }
+    if (MoveEntries(row)) {
+#ifdef GLYPH_CACHE_STATS
+      cache_->stats_.row_compaction_++;
+#endif  // GLYPH_CACHE_STATS
+      return true;
+    }
+  }
   return false;
 }
 
+template <typename T>
+bool GlyphCacheBuffer<T>::MoveEntries(GlyphCacheEntry::iterator_row row) {
+  // Find destination rows of all entries first.
+  auto &entries = row->get_cached_entries();
+  std::map<GlyphCacheRow *, GlyphCacheRow> scratch;
+  std::vector<GlyphCacheEntry::iterator_row> dest_rows(entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    // The buffer doesn't have images of GPU resident glyphs to move.
+    if (entries[i]->get_gpu_resident() ||
+        !FindRowToMove(cache_->GetReservedSize(*entries[i]), &*row, &scratch,
+                       &dest_rows[i])) {
+      return false;
+    }
+  }
+
+  // Now move glyphs. Reservations in actual rows result in same positions as
+  // the simulation.
+  for (size_t i = 0; i < entries.size(); ++i) {
+    auto entry = entries[i];
+    auto src = entry->get_pos();
+    src.z &= ~kGlyphFormatsMask;
+    auto row_pos =
+        dest_rows[i]->Reserve(entry, cache_->GetReservedSize(*entry));
+    cache_->PlaceEntry(entry, this, dest_rows[i], row_pos, nullptr);
+    auto dest = entry->get_pos();
+    dest.z &= ~kGlyphFormatsMask;
+    MoveImage(src, dest, entry->get_size());
+
+    // Glyphs in use must stay in the cache in current rendering cycle.
+    if (row->get_last_used_counter() == cache_->get_counter()) {
+      dest_rows[i]->set_last_used_counter(cache_->get_counter());
+    }
+  }
+  row->Initialize(row->get_slice(), row->get_y_pos(), row->get_size());
+
+  // Moved entries have new UVs. Let FontBuffers update them.
+  // Only ref counting FontBuffers are recorded in row references, and rows
+  // with references are never moved, so the buffers using the moved entries
+  // can't be told apart from others. All buffers re-resolve their glyphs
+  // instead, which patches UVs in place for glyphs staying in their slices.
+  // That is much cheaper than the flush of the whole cache that the compaction
+  // replaces, which also rasterizes all glyphs again, and compactions only
+  // happen when no row can be evicted nor merged. The flatui_benchmarks
+  // GlyphCacheCompaction case measures frames with compactions and flushes.
+  cache_->last_flushed_revision_ = cache_->counter_;
+  cache_->epoch_++;
+  return true;
+}
+
 /// @endcond
 
 }  // namespace flatui
@@ -0,0 +1,130 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLATUI_GLYPH_DISK_CACHE_H
+#define FLATUI_GLYPH_DISK_CACHE_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "flatui/internal/glyph_cache.h"
+
+/// @cond FLATUI_INTERNAL
+namespace flatui {
+
+// GlyphDiskCache persists rendered glyph images and their metrics in a file so
+// that glyphs rendered in a previous run can be restored without FreeType and
+// SDF generation.
+//
+// The file is memory mapped when possible and images are copied straight from
+// the mapping. Glyphs added in the current run are kept in memory until
+// Save() writes all entries back to the file.
+//
+// Entries are keyed by a GlyphKey whose font id is a hash of the font file
+// contents (instead of the font name), so that a modified font file doesn't
+// hit stale entries. SDF entries are only valid for a distance computer
+// version matching the one the file was written with.
+//
+// The file is written in the native byte order and is not meant to be shared
+// across platforms. Only monochrome glyphs are stored.
+class GlyphDiskCache {
+ public:
+  GlyphDiskCache();
+  ~GlyphDiskCache();
+
+  // Open a cache file. A missing file isn't an error, and a new file is
+  // created by Save().
+  // sdf_version: A version of the distance computer. SDF entries written with
+  // other versions are discarded.
+  bool Open(const char *file_name, uint32_t sdf_version);
+
+  // Release the file. Entries added since Save() are discarded.
+  void Close();
+
+  // Look up an entry of a glyph. Returns a pointer to the glyph image and sets
+  // the glyph metrics to the entry when found, nullptr otherwise.
+  // The image is valid until the cache is closed or saved.
+  const uint8_t *Find(HashedId font_hash, const GlyphKey &key,
+                      GlyphCacheEntry *entry) const;
+
+  // Add a glyph image to the cache. The image is copied. Entries already in
+  // the cache are not updated.
+  // stride: Stride of the image in bytes.
+  void Add(HashedId font_hash, const GlyphKey &key,
+           const GlyphCacheEntry &entry, const uint8_t *image,
+           int32_t stride);
+
+  // Write all entries in the file, and map it again.
+  bool Save();
+
+  // Returns true if there are entries that aren't in the file yet.
+  bool is_dirty() const { return !added_records_.empty(); }
+
+  // # of entries in the cache.
+  size_t get_num_entries() const { return map_records_.size(); }
+
+ private:
+  // Header of the cache file.
+  struct Header {
+    uint32_t magic;
+    uint32_t format_version;
+    uint32_t sdf_version;
+    uint32_t num_records;
+  };
+
+  // An entry in the cache file. Followed by images of all entries.
+  struct Record {
+    HashedId font_hash;
+    uint32_t code_point;
+    uint32_t glyph_size;
+    uint32_t flags;
+    int32_t size[2];
+    float offset[2];
+    int32_t advance[2];
+    // An offset of the image from the beginning of the image area.
+    uint32_t image_offset;
+  };
+
+  // Returns a key of a record in the map.
+  static GlyphKey GetKey(const Record &record);
+
+  // Retrieve a record and its image with an index in map_records_.
+  const Record &GetRecord(size_t index) const;
+  const uint8_t *GetImage(size_t index) const;
+
+  std::string file_name_;
+  uint32_t sdf_version_;
+
+  // Contents of the file, either mapped or loaded to file_data_.
+  const void *mapped_data_;
+  int32_t mapped_size_;
+  std::string file_data_;
+  const Record *records_;
+  size_t num_records_;
+  const uint8_t *images_;
+
+  // Entries added since the file was opened.
+  std::vector<Record> added_records_;
+  std::vector<uint8_t> added_images_;
+
+  // Map from keys to indices of records. Indices less than num_records_ refer
+  // records in the file, others refer added_records_.
+  std::unordered_map<GlyphKey, size_t, GlyphKey> map_records_;
+};
+
+}  // namespace flatui
+/// @endcond
+
+#endif  // FLATUI_GLYPH_DISK_CACHE_H
@@ -0,0 +1,148 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLATUI_GLYPH_RASTERIZER_H
+#define FLATUI_GLYPH_RASTERIZER_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "flatui/internal/distance_computer.h"
+#include "flatui/internal/glyph_cache.h"
+
+// Forward decls for FreeType.
+typedef struct FT_LibraryRec_ *FT_Library;
+typedef struct FT_FaceRec_ *FT_Face;
+
+/// @cond FLATUI_INTERNAL
+namespace flatui {
+
+// A request to rasterize a glyph in a worker thread.
+// The layout already reserved a region in the glyph cache for the glyph with
+// its metrics, the worker renders the glyph image in the region's size and the
+// result is committed to the glyph cache afterwards.
+struct GlyphRasterJob {
+  // Key of the glyph cache entry that receives the image.
+  GlyphKey key;
+
+  // Font file data and a face index in the file. The data is owned by the
+  // FaceData and needs to be kept until the job is finished.
+  const void *font_data;
+  int32_t font_data_size;
+  int32_t face_index;
+
+  // A bitmap origin of the glyph in pixels that is used for the reserved
+  // region, and a size of the bitmap without SDF padding.
+  mathfu::vec2i origin;
+  mathfu::vec2i bitmap_size;
+
+  // A size of the reserved region.
+  mathfu::vec2i size;
+
+  // Metrics of the reserved entry and a hash of the font contents, used to
+  // record the image in a disk cache.
+  GlyphCacheEntry entry;
+  HashedId font_hash;
+
+  // Rasterized image in the reserved size. Valid when succeeded is true.
+  std::unique_ptr<uint8_t[]> image;
+  bool succeeded;
+};
+
+// GlyphRasterizer runs FreeType glyph rendering and SDF generation in a pool of
+// worker threads. FreeType isn't thread safe across faces sharing an
+// FT_Library, so each worker has its own library instance and opens its own
+// FT_Face for a font on demand.
+class GlyphRasterizer {
+ public:
+  // num_workers: # of worker threads to create.
+  // factory: A factory function of DistanceComputer used for SDF glyphs.
+  // Each worker creates its own instance since the computer is not reentrant.
+  // sdf_reserve_size: A size of SDF glyph images including padding that
+  // workers pre-allocate scratch buffers for.
+  // counters: Counters receiving rasterization and SDF times. May be nullptr.
+  GlyphRasterizer(int32_t num_workers,
+                  DistanceComputer<uint8_t> *(*factory)(void),
+                  const mathfu::vec2i &sdf_reserve_size,
+                  TextPipelineCounters *counters = nullptr);
+  ~GlyphRasterizer();
+
+  // Queue a job. The job is processed by one of the workers.
+  void Enqueue(std::unique_ptr<GlyphRasterJob> job);
+
+  // Retrieve jobs finished since the last call.
+  void GetCompletedJobs(std::vector<std::unique_ptr<GlyphRasterJob>> *jobs);
+
+  // Wait until all queued jobs are finished.
+  void Wait();
+
+  // Cancel queued jobs using the specified font data and release workers'
+  // faces opened with the data. Needs to be called before the font data is
+  // released.
+  void CloseFont(const void *font_data);
+
+  // Returns true if there are jobs to be processed or retrieved.
+  bool HasPendingJobs();
+
+  int32_t get_num_workers() const {
+    return static_cast<int32_t>(workers_.size());
+  }
+
+ private:
+  struct Worker {
+    std::thread thread;
+    FT_Library ft;
+    std::unordered_map<const void *, FT_Face> faces;
+    std::unique_ptr<DistanceComputer<uint8_t>> sdf_computer;
+    // Scratch buffer used for an SDF source image.
+    std::vector<uint8_t> scratch;
+  };
+
+  // Entry point of worker threads.
+  void Run(Worker *worker);
+
+  // Render a glyph of the job with a worker's resources.
+  bool Rasterize(Worker *worker, GlyphRasterJob *job);
+
+  // Retrieve a worker's face for the job, opening it if necessary.
+  FT_Face GetFace(Worker *worker, const GlyphRasterJob &job);
+
+  // Guards all members below, except for worker's resources that are only
+  // touched by the worker itself, or while all workers are idle.
+  // fplutil::Mutex has no condition variable for idle workers and Wait() to
+  // sleep on, so the pool uses std:: primitives. Locks shared with the rest of
+  // FontManager, such as cache_mutex_, stay fplutil::Mutex.
+  std::mutex mutex_;
+  std::condition_variable job_condition_;
+  std::condition_variable idle_condition_;
+  std::deque<std::unique_ptr<GlyphRasterJob>> queue_;
+  std::vector<std::unique_ptr<GlyphRasterJob>> completed_;
+  int32_t busy_;
+  bool terminate_;
+
+  // Counters of the owner's text pipeline, updated by workers.
+  TextPipelineCounters *counters_;
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+}  // namespace flatui
+/// @endcond
+
+#endif  // FLATUI_GLYPH_RASTERIZER_H
@@ -0,0 +1,158 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLATUI_INTERNAL_GPU_DISTANCE_COMPUTER_H
+#define FLATUI_INTERNAL_GPU_DISTANCE_COMPUTER_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "flatui/internal/distance_computer.h"
+#include "flatui/internal/euclidean_distance_computer.h"
+#include "flatui/internal/glyph_cache.h"
+
+/// @cond FLATUI_INTERNAL
+namespace flatui {
+
+// A glyph whose distance field is computed by GpuDistanceComputer.
+struct GpuDistanceJob {
+  // Key of the glyph cache entry that receives the distance field.
+  GlyphKey key;
+
+  // Metrics of the reserved entry and a hash of the font contents, used to
+  // record the image in a disk cache.
+  GlyphCacheEntry entry;
+  HashedId font_hash;
+
+  // A size of the glyph bitmap, and a size of the reserved region including
+  // SDF padding.
+  mathfu::vec2i bitmap_size;
+  mathfu::vec2i size;
+
+  // Offset of the bitmap in the source images.
+  size_t source_offset;
+
+  // Distance field read back from the GPU in the reserved size.
+  std::unique_ptr<uint8_t[]> image;
+};
+
+// GpuDistanceComputer computes distance fields of glyphs with an OpenGL ES 3.1
+// / OpenGL 4.3 compute shader.
+// Layouts queue glyph bitmaps with Enqueue() after reserving their regions in
+// the glyph cache. Dispatch(), invoked in the rendering thread, computes the
+// distance fields in one dispatch and copies them to the atlas textures in the
+// GPU, so the glyphs can be rendered in the same rendering pass. The results
+// are read back asynchronously afterwards to keep the glyph cache buffer in
+// sync with the textures.
+//
+// The compute shader evaluates the same distance as EuclideanDistanceComputer
+// by a brute force search around each pixel, which is used as a fallback where
+// compute shaders are not available, and for Compute() calls from the
+// DistanceComputer interface (e.g. asynchronous glyph rasterization workers).
+class GpuDistanceComputer : public DistanceComputer<uint8_t> {
+ public:
+  GpuDistanceComputer();
+  ~GpuDistanceComputer();
+
+  // Compute a distance field in the CPU.
+  void Compute(const Grid<uint8_t>& image, Grid<uint8_t>* dest,
+               GlyphFlags flag) override {
+    fallback_.Compute(image, dest, flag);
+  }
+
+  void Reserve(const vec2i& size) override { fallback_.Reserve(size); }
+
+  uint32_t get_version() const override {
+    return kDistanceComputerVersionGpu;
+  }
+
+  GpuDistanceComputer* get_gpu_computer() override { return this; }
+
+  // Returns false once compute shaders turned out to be unavailable. Glyphs
+  // need to be computed with Compute() afterwards.
+  bool get_supported() const { return supported_; }
+
+  // Queue a glyph. The bitmap is copied, and its distance field is computed
+  // with the next Dispatch() call. The job needs key, entry, font_hash,
+  // bitmap_size and size set.
+  void Enqueue(std::unique_ptr<GpuDistanceJob> job, const uint8_t* bitmap,
+               int32_t pitch);
+
+  // Compute distance fields of queued glyphs and write them to textures of
+  // glyph cache entries with GPU resident images. Glyphs evicted from the
+  // cache are discarded. Needs to be invoked in the rendering thread after the
+  // glyph cache's dirty rects are resolved.
+  void Dispatch(GlyphCache* cache);
+
+  // Retrieve glyphs whose distance fields are read back. Needs to be invoked
+  // in the rendering thread.
+  void GetCompletedJobs(std::vector<std::unique_ptr<GpuDistanceJob>>* jobs);
+
+  // Returns true if there are glyphs queued or being read back.
+  bool HasPendingJobs();
+
+ private:
+  // Glyphs computed in one dispatch, which are read back together.
+  struct Batch {
+    std::vector<std::unique_ptr<GpuDistanceJob>> jobs;
+    // Offsets of the jobs' distance fields in the output buffer.
+    std::vector<size_t> offsets;
+    uint32_t buffer;
+    size_t size;
+    void* fence;
+  };
+
+  // Check if compute shaders are available, and build the program.
+  // Returns false if they aren't.
+  bool InitializeProgram();
+
+  // Compute queued jobs in the CPU when compute shaders are not available.
+  void ComputeInCPU();
+
+  // Compute a job's distance field in the CPU from its bitmap.
+  void ComputeJob(GpuDistanceJob* job, const uint8_t* source);
+
+  // Read back batches whose dispatches are finished.
+  void PollBatches();
+
+  // Guards queue_ and sources_, which are filled in layout threads.
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<GpuDistanceJob>> queue_;
+  std::vector<uint8_t> sources_;
+
+  // Batches being computed, in the order of dispatches.
+  std::vector<Batch> batches_;
+  std::vector<std::unique_ptr<GpuDistanceJob>> completed_;
+
+  // OpenGL objects. Created in the first Dispatch() call.
+  uint32_t program_;
+  uint32_t job_buffer_;
+  uint32_t source_buffer_;
+  std::vector<uint32_t> free_buffers_;
+
+  // False once compute shaders turned out to be unsupported. Read in layout
+  // threads.
+  std::atomic<bool> supported_;
+  bool initialized_;
+
+  // Computer used where the GPU doesn't compute distances.
+  EuclideanDistanceComputer<uint8_t> fallback_;
+};
+
+}  // namespace flatui
+/// @endcond
+
+#endif  // FLATUI_INTERNAL_GPU_DISTANCE_COMPUTER_H
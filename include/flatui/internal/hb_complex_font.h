@@ -15,7 +15,11 @@
 #ifndef FPL_HB_COMPLEX_FONT_H
 #define FPL_HB_COMPLEX_FONT_H
 
+#include <memory>
 #include <unordered_map>
+#include <vector>
+#include "flatui/internal/codepoint_coverage.h"
+#include "flatui/internal/decoded_text.h"
 
 /// @cond FLATUI_INTERNAL
 // Forward decls for FreeType & Harfbuzz
@@ -34,6 +38,7 @@ typedef int32_t hb_bool_t;
 
 namespace flatui {
 // Forward decl.
+class FaceData;
 class FontFamily;
 
 // Fixed point precision used in harfbuzz.
@@ -42,6 +47,158 @@ const int32_t kHbFixedPointPrecision = 10;
 // Fixed point precision used in Freetype.
 const int32_t kFtFixedPointPrecision = 16;
 
+/// @class SimpleGlyphTable
+///
+/// @brief Glyphs of Latin-1 code points of a face that HarfBuzz lays out
+/// without substituting or positioning them, other than by pair kerning.
+///
+/// Runs of such glyphs are laid out with their advances and the kerning
+/// between them, both looked up from HarfBuzz once and cached, rather than
+/// shaping the runs.
+class SimpleGlyphTable {
+ public:
+  /// @brief The number of code points in the table, covering Latin-1.
+  static const uint32_t kNumCodePoints = 256;
+
+  SimpleGlyphTable();
+  ~SimpleGlyphTable();
+
+  /// @brief Look up glyphs of the face, and the glyphs substituted or
+  /// positioned by lookups of the font enabled by default.
+  ///
+  /// @param[in] face The FreeType face.
+  /// @param[in] font The harfbuzz font of the face.
+  void Initialize(FT_Face face, hb_font_t *font);
+
+  /// @return Returns the glyph of a code point, or 0 if the code point needs
+  /// shaping.
+  hb_codepoint_t GetGlyph(uint32_t code_point) const {
+    return code_point < kNumCodePoints ? glyphs_[code_point] : 0;
+  }
+
+  /// @brief Get the advance of a code point's glyph, looked up on demand.
+  ///
+  /// @param[in] font The harfbuzz font, set to the size.
+  /// @param[in] size The pixel size of the font.
+  /// @param[in] code_point A code point with a glyph in the table.
+  hb_position_t GetAdvance(hb_font_t *font, uint32_t size,
+                           uint32_t code_point);
+
+  /// @brief Get the kerning between glyphs of two code points, shaping the
+  /// pair on demand.
+  ///
+  /// @param[in] font The harfbuzz font, set to the size.
+  /// @param[in] buffer A buffer with the segment properties of the run.
+  /// @param[in] size The pixel size of the font.
+  /// @param[in] left A code point with a glyph in the table.
+  /// @param[in] right A code point with a glyph in the table following left.
+  /// @param[out] kerning The adjustment of the left glyph's advance.
+  /// @return Returns false if the pair needs shaping.
+  bool GetKerning(hb_font_t *font, hb_buffer_t *buffer, uint32_t size,
+                  uint32_t left, uint32_t right, hb_position_t *kerning);
+
+  /// @return Returns a size of memory used by the table.
+  size_t GetMemorySize() const;
+
+ private:
+  // Glyphs of code points, or 0 for code points needing shaping.
+  hb_codepoint_t glyphs_[kNumCodePoints];
+
+  // Indicates if the font may kern pairs of glyphs.
+  bool kerning_;
+
+  // Advances of glyphs for each pixel size, or kUnknownPosition.
+  std::unordered_map<uint32_t, std::vector<hb_position_t>> advances_;
+
+  // Kerning for pairs of code points keyed by MakePairKey(), or
+  // kUnknownPosition for pairs needing shaping.
+  std::unordered_map<uint32_t, hb_position_t> kerning_pairs_;
+
+  // Buffer shaping pairs of glyphs.
+  hb_buffer_t *pair_buffer_;
+
+  // Disable copy constructor.
+  SimpleGlyphTable(const SimpleGlyphTable &);
+  SimpleGlyphTable &operator=(const SimpleGlyphTable &);
+};
+
+/// @class FaceInstance
+///
+/// @brief A FreeType face and a harfbuzz font opened from the font file data
+/// of a FaceData, and the size they are set to.
+///
+/// A FreeType face can't be sized or load glyphs in multiple threads at the
+/// same time. A FaceData has its own instance, and layouts in other threads
+/// open their instances of the face in FaceInstances.
+class FaceInstance {
+ public:
+  FaceInstance();
+  ~FaceInstance();
+
+  /// @brief Create the FreeType face and the harfbuzz font of the loaded font
+  /// file data of a face.
+  ///
+  /// @param[in] ft A FreeType library instance.
+  /// @param[in] face The FaceData of the font file data.
+  /// @return Returns 0 if the face is opened, or a FreeType error.
+  int32_t Open(FT_Library ft, const FaceData &face);
+
+  /// @brief Release the FreeType face and the harfbuzz font.
+  void Close();
+
+  /// @brief Set font size to the face.
+  /// @param[in] size Face size in pixels.
+  void SetSize(uint32_t size);
+
+  /// @brief Get font size of the face.
+  uint32_t GetSize() const { return current_size_; }
+
+  /// @brief Get glyphs of the face laid out without shaping, looked up on the
+  /// first call after the face is opened.
+  ///
+  /// @return Returns nullptr if the face isn't open.
+  SimpleGlyphTable *GetSimpleGlyphTable();
+
+  /// @return Returns the size of memory used by the simple glyph table.
+  size_t get_simple_glyph_table_size() const {
+    return simple_glyphs_ ? simple_glyphs_->GetMemorySize() : 0;
+  }
+
+  int32_t get_scale() const { return scale_; }
+  FT_Face get_face() const { return face_; }
+  hb_font_t *get_hb_font() const { return harfbuzz_font_; }
+
+ private:
+  /// @var face_
+  ///
+  /// @brief freetype's fontface instance.
+  FT_Face face_;
+
+  /// @var harfbuzz_font_
+  ///
+  /// @brief harfbuzz's font information instance.
+  hb_font_t *harfbuzz_font_;
+
+  /// @var scale_
+  ///
+  /// @brief Scale applied for a layout.
+  int32_t scale_;
+
+  /// @var current_size_
+  ///
+  /// @brief Current font size.
+  uint32_t current_size_;
+
+  /// @var simple_glyphs_
+  ///
+  /// @brief Glyphs laid out without shaping, created on demand.
+  std::unique_ptr<SimpleGlyphTable> simple_glyphs_;
+
+  // Disable copy constructor.
+  FaceInstance(const FaceInstance &);
+  FaceInstance &operator=(const FaceInstance &);
+};
+
 /// @class FaceData
 ///
 /// @brief The font face instance data opened via the `Open()` API.
@@ -52,14 +209,14 @@ class FaceData {
  public:
   /// @brief The default constructor for FaceData.
   FaceData()
-      : face_(nullptr),
-        mapped_data_(nullptr),
+      : mapped_data_(nullptr),
         font_size_(0),
+        face_index_(0),
         font_id_(kNullHash),
-        scale_(1 << kHbFixedPointPrecision),
-        current_size_(0),
-        harfbuzz_font_(nullptr),
-        ref_count_(0) {}
+        font_hash_(kNullHash),
+        load_id_(0),
+        ref_count_(0),
+        last_used_(0) {}
 
   /// @brief The destructor for FaceData.
   ///
@@ -82,11 +239,63 @@ class FaceData {
   /// @return true if the specified font is successfully opened.
   bool Open(FT_Library ft, const FontFamily &family);
 
+  /// @brief Load the font file data, the first step of `Open()`.
+  ///
+  /// It doesn't use FreeType, and can run in a worker thread.
+  ///
+  /// @param[in] family A FontFamily structure specifying a font name to open.
+  /// @return true if the font file is successfully loaded.
+  bool LoadFile(const FontFamily &family);
+
+  /// @brief Record the codepoints covered by the face of loaded font file
+  /// data, using a temporary FreeType face so that `Initialize()` can skip it.
+  ///
+  /// @param[in] ft A FreeType library instance. It can be a worker thread's
+  /// instance, since the face is closed before it returns.
+  /// @param[in] family A FontFamily structure passed to `LoadFile()`.
+  /// @return true if the face is successfully opened.
+  bool LoadCoverage(FT_Library ft, const FontFamily &family);
+
+  /// @brief Record the codepoints covered by a face reading only the cmap
+  /// table of the font, without loading the font file data or creating a
+  /// FreeType face. The face stays unloaded until `Open()` is called.
+  ///
+  /// @param[in] family A FontFamily structure specifying a font name to open.
+  /// @return true if the cmap table is successfully read.
+  bool LoadCmap(const FontFamily &family);
+
+  /// @brief Create the FreeType face and the harfbuzz font of loaded font
+  /// file data, the second step of `Open()`.
+  ///
+  /// @param[in] ft A FreeType library instance.
+  /// @param[in] family A FontFamily structure passed to `LoadFile()`.
+  /// @return true if the face is successfully opened.
+  bool Initialize(FT_Library ft, const FontFamily &family);
+
   /// @brief Close the FaceData.
   void Close();
 
+  /// @brief Release the FreeType face, the harfbuzz font and the font file
+  /// data, keeping the coverage and IDs of the face so that it can be opened
+  /// again with `Open()` when it's needed.
+  void Unload();
+
+  /// @return Returns true if the FreeType face is open.
+  bool is_loaded() const { return instance_.get_face() != nullptr; }
+
+  /// @brief Get the instance of the face used by layouts in the calling
+  /// thread: the instance in the FaceInstances selected in the thread, or
+  /// the FaceData's own instance.
+  FaceInstance *GetInstance() const;
+
+  /// @return Returns the size of memory used by the simple glyph table.
+  size_t get_simple_glyph_table_size() const {
+    return instance_.get_simple_glyph_table_size();
+  }
+
   /// @brief Open specified font by name and return the mapped data.
-  /// Current implementation works on iOS.
+  /// Current implementation works on macOS/iOS, where the font data is
+  /// converted from CGFont once and mapped from the app's cache directory.
   /// @return Returns a mapped pointer. nullptr when failed to map the
   /// file.
   ///
@@ -106,32 +315,49 @@ class FaceData {
   /// @param[out] dest A string that font data will be loaded into.
   bool OpenFontByName(const char *font_name, std::string *dest);
 
-  /// @brief Set font size to the facedata.
-  /// @param[in] size Face size in pixels.
-  void SetSize(uint32_t size);
-
-  /// @brief Get font size to the facedata.
-  uint32_t GetSize() const { return current_size_; }
+  /// @brief Copy the cmap table of a font specified by name.
+  /// Current implementation works on macOS/iOS, where the table is copied
+  /// from CGFont without converting the whole font.
+  /// @return Returns true if the table is copied successfully.
+  ///
+  /// @param[in] font_name A font name to load.
+  /// @param[out] dest A string that the table will be copied into.
+  bool OpenCmapByName(const char *font_name, std::string *dest);
 
   // Getter/Setters.
-  int32_t get_scale() const { return scale_; }
-  void set_scale(int32_t scale) { scale_ = scale; }
-
-  FT_Face get_face() const { return face_; }
+  // The face of the FaceData's own instance, to read the metrics of the face.
+  FT_Face get_face() const { return instance_.get_face(); }
   HashedId get_font_id() const { return font_id_; }
-  hb_font_t *get_hb_font() const { return harfbuzz_font_; }
+  HashedId get_font_hash() const { return font_hash_; }
   int32_t get_font_size() const { return font_size_; }
+  int32_t get_face_index() const { return face_index_; }
+  /// @return Returns an ID identifying each load of the face.
+  uint32_t get_load_id() const { return load_id_; }
+  const CodepointCoverage &get_coverage() const { return coverage_; }
+  const void *get_font_data() const {
+    return mapped_data_ ? mapped_data_ : font_data_.c_str();
+  }
+  /// @return Returns the size of the font file data mapped from the file.
+  size_t get_mapped_data_size() const {
+    return mapped_data_ ? static_cast<size_t>(font_size_) : 0;
+  }
+  /// @return Returns the size of the font file data copied to the memory.
+  size_t get_copied_data_size() const { return font_data_.capacity(); }
   void set_font_id(HashedId id) { font_id_ = id; }
+  uint32_t get_last_used() const { return last_used_; }
+  void set_last_used(uint32_t counter) { last_used_ = counter; }
 
   // Reference counting.
   int32_t AddRef() { return ++ref_count_; }
   int32_t Release() { return --ref_count_; }
 
  private:
-  /// @var face_
+  friend class FaceInstances;
+
+  /// @var instance_
   ///
-  /// @brief freetype's fontface instance.
-  FT_Face face_;
+  /// @brief The FreeType face and the harfbuzz font of the FaceData.
+  mutable FaceInstance instance_;
 
   /// @var font_data_
   ///
@@ -142,29 +368,39 @@ class FaceData {
   std::string font_data_;
   int32_t font_size_;
 
+  /// @var face_index_
+  ///
+  /// @brief Index of the face in the font file.
+  int32_t face_index_;
+
   /// @var font_id_
   /// @brief Hashed value of the font face.
   HashedId font_id_;
 
-  /// @var scale_
-  ///
-  /// @brief Scale applied for a layout.
-  int32_t scale_;
+  /// @var font_hash_
+  /// @brief Hashed value of the font file contents and the face index.
+  HashedId font_hash_;
 
-  /// @var current_size_
+  /// @var load_id_
   ///
-  /// @brief Current font size.
-  uint32_t current_size_;
+  /// @brief ID of the last load of the face, unique in the process, so that
+  /// FaceInstances open the face again when it's reloaded.
+  uint32_t load_id_;
 
-  /// @var harfbuzz_font_
+  /// @var coverage_
   ///
-  /// @brief harfbuzz's font information instance.
-  hb_font_t *harfbuzz_font_;
+  /// @brief Codepoints covered by the cmap of the face.
+  CodepointCoverage coverage_;
 
   /// @var ref_count_
   ///
   /// @brief Reference counter.
   int32_t ref_count_;
+
+  /// @var last_used_
+  ///
+  /// @brief Glyph cache counter when the face was last used in a layout.
+  uint32_t last_used_;
 };
 
 class HbFont;
@@ -249,7 +485,9 @@ class HbFont {
   /// @brief Get a pointer to the harfbuzz font structure.
   ///
   /// @return Returns a pointer to hb_font_t structure.
-  virtual hb_font_t *GetHbFont() { return face_data_->get_hb_font(); }
+  virtual hb_font_t *GetHbFont() {
+    return face_data_->GetInstance()->get_hb_font();
+  }
 
   /// @brief Check if the font is a complex font with multiple font faces.
   ///
@@ -262,6 +500,22 @@ class HbFont {
   /// @brief Get an ID of the the current font face.
   virtual HashedId GetCurrentFaceId() const { return GetFontId(); }
 
+  /// @brief Get a size of memory used by the instance, excluding faces.
+  virtual size_t GetMemorySize() const { return sizeof(*this); }
+
+  /// @brief Lay out a text run in the current face without shaping it, when
+  /// the run is in Latin-1 and its glyphs are only kerned by the font.
+  ///
+  /// The buffer is filled as `hb_shape()` would do for a left-to-right run.
+  ///
+  /// @param[in] text A C-string in UTF-8 format.
+  /// @param[in] length The length of the text in bytes.
+  /// @param[in,out] buffer An empty harfbuzz buffer with the segment
+  /// properties of the run.
+  /// @return Returns false, leaving the buffer empty, if the run needs
+  /// shaping.
+  bool LayoutSimpleRun(const char *text, size_t length, hb_buffer_t *buffer);
+
  private:
   /// @var face_data_
   ///
@@ -302,8 +556,22 @@ class HbFont {
 /// The class inherits HbFont as a public base class.
 class HbComplexFont : public HbFont {
  public:
-  HbComplexFont()
-      : complex_font_id_(kNullHash), current_face_index_(0), pixel_size_(0) {}
+  /// @brief The current face and the size of a complex font in layouts of a
+  /// thread.
+  struct State {
+    State() : font_id(kNullHash), face_index(0), pixel_size(0) {}
+
+    /// @brief ID of the font the state belongs to.
+    HashedId font_id;
+
+    /// @brief Index of the current font face.
+    int32_t face_index;
+
+    /// @brief Pixel size of the complex font.
+    uint32_t pixel_size;
+  };
+
+  HbComplexFont() : complex_font_id_(kNullHash) {}
   virtual ~HbComplexFont() {};
 
   /// @brief Create an instance of HbFont. If a HbFont with same FaceData has
@@ -325,14 +593,14 @@ class HbComplexFont : public HbFont {
 
   /// @brief Overriding virtual methods.
   void SetPixelSize(uint32_t size);
-  uint32_t GetPixelSize() const { return pixel_size_; }
+  uint32_t GetPixelSize() const { return GetState()->pixel_size; }
   int32_t GetBaseLine(int32_t size) const;
   mathfu::vec2i GetUnderline(int32_t size) const;
 
   const FaceData &GetFaceData() const;
   HashedId GetFontId() const { return complex_font_id_; }
 
-  hb_font_t *GetHbFont() { return faces_[current_face_index_]->get_hb_font(); }
+  hb_font_t *GetHbFont() { return GetFaceData().GetInstance()->get_hb_font(); }
   bool IsComplexFont() { return true; }
 
   /// @brief Analyze given text stream and construct a vector holding font face
@@ -341,12 +609,26 @@ class HbComplexFont : public HbFont {
   int32_t AnalyzeFontFaceRun(const char *text, size_t length,
                              std::vector<int32_t> *font_data_index) const;
 
+  /// @brief A version of AnalyzeFontFaceRun() taking a well formed text that
+  /// is already decoded.
+  int32_t AnalyzeFontFaceRun(const DecodedText &text,
+                             std::vector<int32_t> *font_data_index) const;
+
   void SetCurrentFaceIndex(int32_t index);
-  HashedId GetCurrentFaceId() const {
-    return faces_[current_face_index_]->get_font_id();
+  FaceData *GetFace(int32_t index) const {
+    return faces_[index < 0 ? 0 : index];
+  }
+  HashedId GetCurrentFaceId() const { return GetFaceData().get_font_id(); }
+  size_t GetMemorySize() const {
+    return sizeof(*this) + faces_.capacity() * sizeof(FaceData *) +
+           face_map_.GetMemorySize();
   }
 
  private:
+  // Get the state used by layouts in the calling thread: the state in the
+  // FaceInstances selected in the thread, or state_.
+  State *GetState() const;
+
   void OverrideCallbacks(int32_t i);
 
   /// @brief HarfBuzz callback functions. They need to be a static member
@@ -395,20 +677,83 @@ class HbComplexFont : public HbFont {
   /// @brief A vector of FreeType faces used in the complex font.
   std::vector<FaceData *> faces_;
 
+  /// @var face_map_
+  ///
+  /// @brief A map from codepoints to the first face in `faces_` covering them.
+  CodepointFaceMap face_map_;
+
   /// @var complex_font_id_
   ///
   /// @brief Font ID derived from an array of FreeType face data.
   HashedId complex_font_id_;
 
-  /// @var current_face_index_
+  /// @var state_
   ///
-  /// @brief Index of the current font face.
-  int32_t current_face_index_;
+  /// @brief The current face and the size, when no FaceInstances are
+  /// selected.
+  mutable State state_;
+};
+
+/// @class FaceInstances
+///
+/// @brief Instances of faces and states of complex fonts used by layouts in
+/// a thread, so that layouts run in parallel in multiple threads.
+///
+/// Instances are opened with a FreeType library of their own, on demand, from
+/// the font file data of FaceData, as GlyphRasterizer workers do. They are
+/// opened again when the FaceData is reloaded.
+class FaceInstances {
+ public:
+  FaceInstances();
+  ~FaceInstances();
 
-  /// @var pixel_size_
+  /// @brief Select the instances used by fonts in the calling thread.
   ///
-  /// @brief Pixel sizse of the complex font.
-  uint32_t pixel_size_;
+  /// @param[in] instances The instances, or nullptr to use the instances of
+  /// FaceData.
+  /// @return Returns the instances previously selected.
+  static FaceInstances *Select(FaceInstances *instances);
+
+  /// @return Returns the instances selected in the calling thread, or
+  /// nullptr.
+  static FaceInstances *GetSelected();
+
+  /// @brief Get the instance of a loaded face, opening it on demand.
+  ///
+  /// @return Returns the FaceData's own instance if the face can't be opened.
+  FaceInstance *Get(const FaceData &face);
+
+  /// @brief Get the state of a complex font, created on demand.
+  HbComplexFont::State *GetState(const HbComplexFont &font);
+
+  /// @brief Release the instance of a face.
+  void Release(const FaceData &face);
+
+  /// @brief Release all instances and the FreeType library.
+  void Clear();
+
+  /// @return Returns a size of memory used by the instances, excluding
+  /// FreeType faces.
+  size_t GetMemorySize() const;
+
+ private:
+  struct Instance {
+    std::unique_ptr<FaceInstance> instance;
+    uint32_t load_id;
+  };
+
+  // FreeType library the instances are opened with, initialized on demand.
+  FT_Library ft_;
+
+  // Instances of faces.
+  std::unordered_map<const FaceData *, Instance> faces_;
+
+  // States of complex fonts.
+  std::unordered_map<const HbComplexFont *, HbComplexFont::State> fonts_;
+
+  // Disable copy constructor.
+  FaceInstances(const FaceInstances &);
+  FaceInstances &operator=(const FaceInstances &);
 };
 
 }  // namespace flatui
@@ -33,6 +33,13 @@
 #ifndef FLATUI_HYPHENATOR_H
 #define FLATUI_HYPHENATOR_H
 
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "flatui/internal/flatui_util.h"
+
 namespace flatui {
 #ifdef __ANDROID__
 const char* const kAndroidDefaultHybPath = "/system/usr/hyphen-data";
@@ -43,6 +50,7 @@ struct Header;
 class Hyphenator {
  public:
   Hyphenator() : pattern_data_(nullptr), size_(0) {}
+  ~Hyphenator() { Close(); }
 
   // Compute the hyphenation of a word, storing the hyphenation in result
   // vector. Each entry in the vector is a "hyphen edit" to be applied at the
@@ -53,11 +61,36 @@ class Hyphenator {
   // "hy-phen".
   void Hyphenate(const uint8_t* word, size_t len, std::vector<uint8_t>* result);
 
+  // A range of a word in a text, in bytes.
+  struct WordRange {
+    size_t start;
+    size_t length;
+  };
+
+  // Compute the hyphenation of words in a text in one call.
+  // Results of the words are stored back to back in `results`, in the same
+  // format as Hyphenate(). `offsets` receives the index of each word's result
+  // in `results`, followed by the size of `results`. Both vectors are cleared
+  // first, so their memory is reused when they are passed again.
+  void HyphenateWords(const uint8_t* text, const std::vector<WordRange>& words,
+                      std::vector<uint8_t>* results,
+                      std::vector<size_t>* offsets);
+
   // Open Hyphenation pattern binary file (.hyb).
   bool Open(const char* hyb_name);
   bool Close();
 
+  // Retrieve a size of memory used by the patterns, whether they are mapped
+  // or loaded, and scratch buffers.
+  size_t GetMemorySize() const {
+    return size_ + alpha_codes_.capacity() * sizeof(uint16_t);
+  }
+
  private:
+  // Append the hyphenation of a word to result.
+  void AppendHyphenation(const uint8_t* word, size_t len,
+                         std::vector<uint8_t>* result);
+
   // apply soft hyphens only, ignoring patterns
   void HyphenateSoft(const uint8_t* word, size_t len,
                      std::vector<uint8_t>* result);
@@ -71,8 +104,9 @@ class Hyphenator {
 
   // calculate hyphenation from patterns, assuming alphabet lookup has already
   // been done
+  // `result` has codes.size() - 2 entries.
   void HyphenateFromCodes(const std::vector<uint16_t>& codes,
-                          std::vector<uint8_t>* result);
+                          uint8_t* result);
 
   // TODO(hakuro): these should become parameters, as they might vary by locale,
   // screen size, and possibly explicit user control.
@@ -87,6 +121,68 @@ class Hyphenator {
   const uint8_t* pattern_data_;
   int32_t size_;
   std::string pattern_file_;
+
+  // Alphabet codes of the word being hyphenated, kept to reuse the memory.
+  std::vector<uint16_t> alpha_codes_;
+};
+
+// Default # of words kept in the hyphenation cache.
+const size_t kDefaultHyphenationCacheSize = 256;
+
+// HyphenationCache keeps hyphenation results of recently hyphenated words in
+// LRU order, keyed by the word and the hyphenation rule (language), so that
+// rewrapping a paragraph doesn't walk the pattern trie again.
+class HyphenationCache {
+ public:
+  HyphenationCache() : capacity_(kDefaultHyphenationCacheSize) {}
+  ~HyphenationCache() {}
+
+  // Copy a cached hyphenation result of the word.
+  // Returns false if the word is not in the cache.
+  bool Restore(const char* word, size_t length, const std::string& language,
+               std::vector<uint8_t>* result);
+
+  // Store a hyphenation result of the word. The least recently used word is
+  // evicted when the cache is full.
+  void Store(const char* word, size_t length, const std::string& language,
+             const uint8_t* result, size_t count);
+
+  // Remove all entries.
+  void Clear() {
+    map_entries_.clear();
+    lru_entries_.clear();
+  }
+
+  // Getter/Setter of the max # of words in the cache. 0 disables the cache.
+  size_t get_capacity() const { return capacity_; }
+  void set_capacity(size_t capacity);
+
+  // Retrieve # of words in the cache.
+  size_t size() const { return lru_entries_.size(); }
+
+  // Retrieve a size of memory used by entries in the cache.
+  size_t GetMemorySize() const;
+
+ private:
+  struct Entry {
+    HashedId key;
+    // The word and the language are kept to resolve hash collisions.
+    std::string word;
+    std::string language;
+    std::vector<uint8_t> result;
+  };
+  typedef std::list<Entry>::iterator iterator_entry;
+
+  static HashedId GetKey(const char* word, size_t length,
+                         const std::string& language) {
+    return HashId(language.c_str(),
+                  HashId(word, static_cast<int32_t>(length)));
+  }
+
+  // Entries in LRU order, the most recently used entry first.
+  std::list<Entry> lru_entries_;
+  std::unordered_map<HashedId, iterator_entry> map_entries_;
+  size_t capacity_;
 };
 }  // namespace flatui
 
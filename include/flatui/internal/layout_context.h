@@ -0,0 +1,105 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLATUI_LAYOUT_CONTEXT_H
+#define FLATUI_LAYOUT_CONTEXT_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "flatui/internal/decoded_text.h"
+#include "flatui/internal/glyph_cache.h"
+#include "flatui/internal/hb_complex_font.h"
+#include "flatui/internal/hyphenator.h"
+
+/// @cond FLATUI_INTERNAL
+namespace flatui {
+
+// A glyph missing in the glyph cache, laid out by a GetBuffers() worker with a
+// placeholder entry. The entry has the metrics of the glyph and no position
+// in the atlas.
+struct PlaceholderGlyph {
+  GlyphKey key;
+  HashedId face_id;
+  GlyphCacheEntry entry;
+};
+
+// LayoutContext holds the state of text layouts in a thread: the selected
+// font, settings of the buffer being laid out, and scratch buffers reused
+// across layouts. FontManager keeps one context per thread laying out texts,
+// so that threads don't see fonts selected or buffers filled by other threads,
+// and lay out texts in parallel.
+struct LayoutContext {
+  // Defined in font_manager.cpp, which has the HarfBuzz API.
+  LayoutContext();
+  ~LayoutContext();
+
+  // Font selected with FontManager::SelectFont() in the thread.
+  HbFont *current_font;
+
+  // Settings of the buffer being laid out.
+  float line_height_scale;
+  float kerning_scale;
+
+  // Current line width. Needs to be persistent while appending buffers.
+  int32_t line_width;
+
+  // Set while GetBuffers() workers lay out texts. Glyphs missing in the
+  // glyph cache are laid out with placeholder entries, instead of being added
+  // to the cache.
+  bool defer_glyphs;
+
+  // Placeholder glyphs of the layout in the order of their first use, and
+  // their indices by keys.
+  std::vector<PlaceholderGlyph> placeholder_glyphs;
+  std::unordered_map<GlyphKey, size_t, GlyphKey> placeholder_indices;
+
+  // Harfbuzz buffer.
+  hb_buffer_t *harfbuzz_buf;
+
+  // Line break info buffer used in libunibreak.
+  std::vector<char> wordbreak_info;
+
+  // A buffer includes font face index of the current font's faces.
+  std::vector<int32_t> fontface_index;
+
+  // Codepoints of the text being laid out by FontManager::FillBuffer(),
+  // decoded once for line breaking, font face analysis and shaping. It's
+  // cleared when the word breaks of the text are restored from the cache.
+  DecodedText decoded_text;
+
+  // Buffers reused across hyphenations.
+  std::vector<uint8_t> hyphenation_result;
+  std::vector<size_t> hyphenation_offsets;
+  std::vector<Hyphenator::WordRange> hyphenation_words;
+  std::string hyphenating_str;
+
+  // The hyphenation rule and the hyphenator selected for the layout.
+  std::string hyphenation_rule;
+  Hyphenator *hyphenator;
+
+  // Instances of font faces, opened by layouts in threads other than the one
+  // that created the font resources.
+  FaceInstances face_instances;
+
+ private:
+  LayoutContext(const LayoutContext &);
+  LayoutContext &operator=(const LayoutContext &);
+};
+
+}  // namespace flatui
+/// @endcond
+
+#endif  // FLATUI_LAYOUT_CONTEXT_H
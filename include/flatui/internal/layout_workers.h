@@ -0,0 +1,75 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLATUI_LAYOUT_WORKERS_H
+#define FLATUI_LAYOUT_WORKERS_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// @cond FLATUI_INTERNAL
+namespace flatui {
+
+// LayoutWorkers runs tasks of a batch of texts in a pool of worker threads.
+// Workers keep running between batches, so that layout contexts and font
+// faces FontManager opens for each thread are reused by following batches.
+class LayoutWorkers {
+ public:
+  // num_workers: # of worker threads to create.
+  explicit LayoutWorkers(int32_t num_workers);
+  ~LayoutWorkers();
+
+  // Call `task` with each index in [0, count). Indices are distributed to the
+  // workers and the calling thread, and the call returns when all tasks are
+  // finished. Batches from multiple threads run one at a time.
+  void Run(size_t count, const std::function<void(size_t)> &task);
+
+  int32_t get_num_workers() const {
+    return static_cast<int32_t>(threads_.size());
+  }
+
+ private:
+  // Entry point of worker threads.
+  void Work();
+
+  // Run tasks of the current batch until all indices are taken. `lock` holds
+  // mutex_, it's released while a task is running.
+  void RunTasks(std::unique_lock<std::mutex> *lock);
+
+  // Serializes batches.
+  std::mutex run_mutex_;
+
+  // Guards all members below. Workers sleep on condition variables, which
+  // fplutil::Mutex doesn't have, so std:: primitives are used in the same way
+  // as GlyphRasterizer.
+  std::mutex mutex_;
+  std::condition_variable task_condition_;
+  std::condition_variable idle_condition_;
+  const std::function<void(size_t)> *task_;
+  size_t count_;
+  size_t next_;
+  int32_t busy_;
+  bool terminate_;
+
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace flatui
+/// @endcond
+
+#endif  // FLATUI_LAYOUT_WORKERS_H
@@ -119,6 +119,7 @@ class MicroEdit {
   void Reset() {
     initial_string_.clear();
     wordbreak_info_.clear();
+    character_offsets_.clear();
     editing_text_.clear();
     input_text_selection_start_ = 0;
     input_text_selection_length_ = 0;
@@ -144,6 +145,14 @@ class MicroEdit {
   // Update a character index information in the UTF8 buffer.
   void UpdateWordBreakInfo();
 
+  // Update the word breaking info and character offsets after replacing
+  // `removed` bytes at `start` of the text with `inserted` bytes.
+  // Only the paragraph around the edited span is passed to libunibreak.
+  void UpdateWordBreakInfo(size_t start, size_t removed, size_t inserted);
+
+  // Get the index of the first character starting at or after `offset` bytes.
+  int32_t GetCharacterIndex(size_t offset) const;
+
   // Update an index in the wordbreak info buffer to corresponding caret
   // position.
   void UpdateWordBreakIndex();
@@ -167,13 +176,13 @@ class MicroEdit {
   // Remove the specified number of text after the caret position.
   void RemoveText(int32_t num_remove);
 
-  // Helper for Pick() API.
+  // Helpers for Pick() API.
+  // Both look up the caret lines of the FontBuffer with a binary search.
+  // PickRow() returns the index of the first line with a caret at or below
+  // the pointer, or the # of lines if there is no such line.
   int32_t PickColumn(const mathfu::vec2i &pointer_position,
-                     std::vector<mathfu::vec2i>::const_iterator start_it,
-                     std::vector<mathfu::vec2i>::const_iterator end_it);
-  void PickRow(const mathfu::vec2i &pointer_position,
-               std::vector<mathfu::vec2i>::const_iterator *start_it,
-               std::vector<mathfu::vec2i>::const_iterator *end_it);
+                     const CaretLine &line);
+  int32_t PickRow(const mathfu::vec2i &pointer_position);
 
   int32_t caret_pos_;
   int32_t wordbreak_index_;
@@ -194,6 +203,10 @@ class MicroEdit {
   // Word breaking info retrieved by libUnibreak.
   std::vector<char> wordbreak_info_;
 
+  // Byte offsets of each character in the text, used to map caret positions
+  // to the text without scanning it.
+  std::vector<int32_t> character_offsets_;
+
   // Editing text in IME.
   bool in_text_input_;
   std::string input_text_;
@@ -222,6 +235,10 @@ class MicroEdit {
 
   // A pointer to the FontBuffer.
   const FontBuffer *buffer_;
+
+  // Tests compare the word breaking info updated around edits with the one of
+  // the whole text.
+  friend class FlatUIMicroEditTest;
 };
 /// @endcond
 
@@ -0,0 +1,156 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLATUI_INTERNAL_MSDF_GENERATOR_H
+#define FLATUI_INTERNAL_MSDF_GENERATOR_H
+
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+#include "mathfu/constants.h"
+#include "mathfu/glsl_mappings.h"
+
+// Forward decls for FreeType.
+typedef struct FT_Outline_ FT_Outline;
+
+/// @cond FLATUI_INTERNAL
+namespace flatui {
+
+// Channels of an edge in a multi-channel distance field. Each edge of a shape
+// is assigned two or three channels, so that the channels of edges meeting at
+// a corner differ, and the median of the channels keeps the corner sharp.
+enum MsdfEdgeColor {
+  kMsdfEdgeColorBlack = 0,
+  kMsdfEdgeColorRed = 1,
+  kMsdfEdgeColorGreen = 2,
+  kMsdfEdgeColorYellow = 3,
+  kMsdfEdgeColorBlue = 4,
+  kMsdfEdgeColorMagenta = 5,
+  kMsdfEdgeColorCyan = 6,
+  kMsdfEdgeColorWhite = 7,
+};
+
+// Bytes per pixel of a multi-channel distance field (RGBA).
+const int32_t kMsdfChannels = 4;
+
+// A segment of a contour: a line, a quadratic or a cubic Bezier curve.
+struct MsdfEdge {
+  // A distance from a point to the edge. Distances with a same magnitude are
+  // ordered by the dot product of the edge direction and the direction to the
+  // point, so that the edge the point faces is preferred.
+  struct Distance {
+    float distance;
+    float dot;
+    bool operator<(const Distance &other) const {
+      auto a = fabsf(distance);
+      auto b = fabsf(other.distance);
+      return a < b || (a == b && dot < other.dot);
+    }
+  };
+
+  // Position and direction of the edge at a parameter in [0, 1].
+  mathfu::vec2 Point(float t) const;
+  mathfu::vec2 Direction(float t) const;
+
+  // Signed distance to the nearest point of the edge. The sign indicates the
+  // side of the edge. *param receives the parameter of the nearest point,
+  // which is out of [0, 1] when the nearest point is an end point.
+  Distance GetDistance(const mathfu::vec2 &p, float *param) const;
+
+  // Turn the distance to an end point into a distance to the tangent line
+  // extended from the end point, so that distances of adjacent pixels stay
+  // continuous around corners.
+  void ToPseudoDistance(const mathfu::vec2 &p, float param,
+                        Distance *distance) const;
+
+  // Split the edge at a parameter into two edges with a same degree.
+  void Split(float t, MsdfEdge *first, MsdfEdge *second) const;
+
+  // 1 for a line, 2 for a quadratic and 3 for a cubic curve.
+  int32_t degree;
+  mathfu::vec2 points[4];
+  int32_t color;
+};
+
+// MsdfGenerator generates a multi-channel signed distance field of a shape
+// from its outline, following "Shape Decomposition for Multi-channel Distance
+// Fields" by Viktor Chlumsky.
+// Each of the RGB channels holds a distance to a subset of the edges, and the
+// median of the channels reconstructs the shape with sharp corners even when
+// the field is magnified, so that one cached glyph size serves every scale.
+// The alpha channel holds the true signed distance to the shape.
+// Distances are encoded in the same scale and bias as single channel SDF
+// glyphs (kGlyphFlagsInnerSDF | kGlyphFlagsOuterSDF), so the edge is at 0.5,
+// and inside of the shape has larger values.
+class MsdfGenerator {
+ public:
+  MsdfGenerator() : colored_(false) {}
+
+  // Remove all contours of the shape.
+  void Clear();
+
+  // Build a shape with contours in pixel coordinates of the output image.
+  // A contour starts with MoveTo() and is closed implicitly.
+  void MoveTo(const mathfu::vec2 &p);
+  void LineTo(const mathfu::vec2 &p);
+  void QuadraticTo(const mathfu::vec2 &control, const mathfu::vec2 &p);
+  void CubicTo(const mathfu::vec2 &control1, const mathfu::vec2 &control2,
+               const mathfu::vec2 &p);
+
+  // Build a shape from a FreeType outline. `origin` is a position in the
+  // outline in pixels mapped to the top left corner of the output image.
+  // Returns false if the outline can't be decomposed.
+  bool LoadOutline(const FT_Outline &outline, const mathfu::vec2 &origin);
+
+  // Generate the distance field of the shape into an RGBA image with `size`.
+  // Pixels far from the shape are clamped to 0 outside, 255 inside.
+  // stride: Stride of the image in pixels.
+  void Generate(uint8_t *dest, const mathfu::vec2i &size, int32_t stride);
+
+  // Retrieve # of edges in the shape.
+  size_t get_num_edges() const { return edges_.size(); }
+
+ private:
+  // Assign channels to edges, switching them at corners of each contour.
+  void ColorEdges();
+
+  // Flatten channels of pixels whose interpolation with a neighbor would
+  // produce an edge that doesn't exist in the shape.
+  void CorrectErrors(const mathfu::vec2i &size);
+
+  // Add an edge to the current contour.
+  void AddEdge(int32_t degree, const mathfu::vec2 *points);
+
+  // Close the current contour with a line if it's open.
+  void CloseContour();
+
+  // Edges of all contours, and the index of the first edge of each contour.
+  std::vector<MsdfEdge> edges_;
+  std::vector<size_t> contours_;
+  mathfu::vec2 current_;
+
+  // Flag indicating channels are assigned to the edges.
+  bool colored_;
+
+  // Scratch buffers of RGBA distances of each pixel in pixels, and pixels
+  // flattened by the error correction.
+  std::vector<float> distances_;
+  std::vector<size_t> clashes_;
+};
+
+}  // namespace flatui
+/// @endcond
+
+#endif  // FLATUI_INTERNAL_MSDF_GENERATOR_H
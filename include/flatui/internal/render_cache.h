@@ -0,0 +1,77 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLATUI_RENDER_CACHE_H
+#define FLATUI_RENDER_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include "mathfu/glsl_mappings.h"
+
+/// @cond FLATUI_INTERNAL
+namespace flatui {
+
+// RenderCache keeps a rendered UI in an offscreen texture, so that frames
+// rendering the same content can draw the texture instead of the elements.
+// The texture holds colors with premultiplied alpha, so it needs to be drawn
+// with the premultiplied alpha blending.
+// The class is implemented with OpenGL APIs and all APIs need to be invoked in
+// the rendering thread.
+class RenderCache {
+ public:
+  RenderCache();
+
+  // The offscreen target needs to be released with Release() while the GL
+  // context is alive.
+  ~RenderCache() {}
+
+  // Start rendering into the offscreen target of the given size, creating it
+  // if needed. The bound framebuffer and the viewport are saved, and the
+  // target is cleared. The content becomes invalid until End() is called.
+  // Returns false if the offscreen target isn't available.
+  bool Begin(const mathfu::vec2i &size);
+
+  // Finish rendering into the offscreen target and restore the framebuffer and
+  // the viewport. `content_hash` identifies the rendered content.
+  void End(size_t content_hash);
+
+  // Bind the texture of the offscreen target to the texture unit 0.
+  void BindTexture() const;
+
+  // Check if the rendered content has the given hash.
+  bool IsValid(const mathfu::vec2i &size, size_t content_hash) const {
+    return valid_ && size.x == size_.x && size.y == size_.y &&
+           content_hash == content_hash_;
+  }
+
+  // Discard the rendered content.
+  void Invalidate() { valid_ = false; }
+
+  // Delete the offscreen target.
+  void Release();
+
+ private:
+  uint32_t framebuffer_;
+  uint32_t texture_;
+  mathfu::vec2i size_;
+  int32_t saved_framebuffer_;
+  int32_t saved_viewport_[4];
+  size_t content_hash_;
+  bool valid_;
+};
+
+}  // namespace flatui
+/// @endcond
+
+#endif  // FLATUI_RENDER_CACHE_H
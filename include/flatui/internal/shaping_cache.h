@@ -0,0 +1,250 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLATUI_SHAPING_CACHE_H
+#define FLATUI_SHAPING_CACHE_H
+
+#include <hb.h>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "flatui/font_util.h"
+#include "flatui/internal/flatui_util.h"
+
+/// @cond FLATUI_INTERNAL
+namespace flatui {
+
+// Default # of text runs kept in the shaping cache.
+const size_t kDefaultShapingCacheSize = 256;
+
+// A key of a shaped text run. Everything that changes HarfBuzz output for the
+// run is in the key, so that FontBufferParameters such as alignment, line
+// height and kerning scale don't cause re-shaping.
+struct ShapingKey {
+  ShapingKey()
+      : text_hash(kNullHash),
+        font_id(kNullHash),
+        face_id(kNullHash),
+        pixel_size(0),
+        script(HB_SCRIPT_INVALID),
+        direction(HB_DIRECTION_INVALID),
+        language(nullptr) {}
+
+  bool operator==(const ShapingKey &other) const {
+    return text_hash == other.text_hash && font_id == other.font_id &&
+           face_id == other.face_id && pixel_size == other.pixel_size &&
+           script == other.script && direction == other.direction &&
+           language == other.language;
+  }
+
+  // Hash function of the key.
+  size_t operator()(const ShapingKey &key) const {
+    size_t value = key.text_hash;
+    value = HashCombine<HashedId>(value, key.font_id);
+    value = HashCombine<HashedId>(value, key.face_id);
+    value = HashCombine<uint32_t>(value, key.pixel_size);
+    value = HashCombine<hb_script_t>(value, key.script);
+    value = HashCombine<hb_direction_t>(value, key.direction);
+    return value;
+  }
+
+  HashedId text_hash;
+  // Id of the font (or the font family), and the face selected in the font.
+  HashedId font_id;
+  HashedId face_id;
+  uint32_t pixel_size;
+  hb_script_t script;
+  hb_direction_t direction;
+  hb_language_t language;
+};
+
+// ShapingCache keeps glyph infos and positions produced by hb_shape() for
+// recently laid out text runs in LRU order, so that texts laid out again with
+// different layout parameters restore the glyphs instead of shaping them.
+class ShapingCache {
+ public:
+  ShapingCache() : capacity_(kDefaultShapingCacheSize) {}
+  ~ShapingCache() {}
+
+  // Copy a shaped result of the text to an empty hb_buffer_t.
+  // Returns false if the text is not in the cache.
+  bool Restore(const ShapingKey &key, const char *text, size_t length,
+               hb_buffer_t *buffer);
+
+  // Store the shaped result in the buffer. The least recently used run is
+  // evicted when the cache is full.
+  void Store(const ShapingKey &key, const char *text, size_t length,
+             hb_buffer_t *buffer);
+
+  // Remove all entries.
+  void Clear() {
+    map_entries_.clear();
+    lru_entries_.clear();
+  }
+
+  // Getter/Setter of the max # of text runs in the cache. 0 disables the
+  // cache.
+  size_t get_capacity() const { return capacity_; }
+  void set_capacity(size_t capacity);
+
+  // Retrieve # of text runs in the cache.
+  size_t size() const { return lru_entries_.size(); }
+
+  // Retrieve a size of memory used by entries in the cache.
+  size_t GetMemorySize() const;
+
+ private:
+  struct Entry {
+    ShapingKey key;
+    // The text is kept to resolve hash collisions.
+    std::string text;
+    std::vector<hb_glyph_info_t> infos;
+    std::vector<hb_glyph_position_t> positions;
+  };
+  typedef std::list<Entry>::iterator iterator_entry;
+
+  // Entries in LRU order, the most recently used entry first.
+  std::list<Entry> lru_entries_;
+  std::unordered_map<ShapingKey, iterator_entry, ShapingKey> map_entries_;
+  size_t capacity_;
+};
+
+// Default # of texts kept in the word break cache.
+const size_t kDefaultWordBreakCacheSize = 64;
+
+// WordBreakCache keeps results of the libunibreak pass and the font face run
+// analysis of recently laid out texts in LRU order. Together with the
+// ShapingCache holding shaped words, relayouts of a text with a changed size
+// (e.g. a wrapped label in a resizing panel) only re-run the line breaker
+// over the cached words.
+class WordBreakCache {
+ public:
+  WordBreakCache() : capacity_(kDefaultWordBreakCacheSize) {}
+  ~WordBreakCache() {}
+
+  // Copy cached word breaks and font face indices of the text.
+  // Returns false if the text is not in the cache.
+  bool Restore(const char *text, size_t length, const std::string &language,
+               HashedId font_id, std::vector<char> *wordbreak_info,
+               std::vector<int32_t> *fontface_index, int32_t *num_runs);
+
+  // Store word breaks and font face indices of the text. The least recently
+  // used text is evicted when the cache is full.
+  void Store(const char *text, size_t length, const std::string &language,
+             HashedId font_id, const std::vector<char> &wordbreak_info,
+             const std::vector<int32_t> &fontface_index, int32_t num_runs);
+
+  // Remove all entries.
+  void Clear() {
+    map_entries_.clear();
+    lru_entries_.clear();
+  }
+
+  // Getter/Setter of the max # of texts in the cache. 0 disables the cache.
+  size_t get_capacity() const { return capacity_; }
+  void set_capacity(size_t capacity);
+
+  // Retrieve # of texts in the cache.
+  size_t size() const { return lru_entries_.size(); }
+
+  // Retrieve a size of memory used by entries in the cache.
+  size_t GetMemorySize() const;
+
+ private:
+  struct Entry {
+    HashedId key;
+    // The text and the parameters are kept to resolve hash collisions.
+    std::string text;
+    std::string language;
+    HashedId font_id;
+    std::vector<char> wordbreak_info;
+    std::vector<int32_t> fontface_index;
+    int32_t num_runs;
+  };
+  typedef std::list<Entry>::iterator iterator_entry;
+
+  static HashedId GetKey(const char *text, size_t length,
+                         const std::string &language, HashedId font_id) {
+    return HashId(language.c_str(),
+                  HashId(text, static_cast<int32_t>(length), font_id));
+  }
+
+  // Entries in LRU order, the most recently used entry first.
+  std::list<Entry> lru_entries_;
+  std::unordered_map<HashedId, iterator_entry> map_entries_;
+  size_t capacity_;
+};
+
+// Default # of HTML strings kept in the HTML cache.
+const size_t kDefaultHtmlCacheSize = 128;
+
+// HtmlCache keeps HtmlSections parsed from recently laid out HTML strings in
+// LRU order, so that an HTML laid out again (e.g. with a new size, or after
+// its FontBuffer was evicted) skips the Gumbo parse and the whitespace
+// trimming. Sections are shared, so they stay valid for a caller while the
+// entry is evicted.
+class HtmlCache {
+ public:
+  typedef std::shared_ptr<const std::vector<HtmlSection>> SectionsPtr;
+
+  HtmlCache() : capacity_(kDefaultHtmlCacheSize) {}
+  ~HtmlCache() {}
+
+  // Look up sections of the HTML. Returns nullptr if the HTML is not in the
+  // cache.
+  SectionsPtr Find(const char *html);
+
+  // Store sections parsed from the HTML. The least recently used HTML is
+  // evicted when the cache is full.
+  void Store(const char *html, const SectionsPtr &sections);
+
+  // Remove all entries.
+  void Clear() {
+    map_entries_.clear();
+    lru_entries_.clear();
+  }
+
+  // Getter/Setter of the max # of HTML strings in the cache. 0 disables the
+  // cache.
+  size_t get_capacity() const { return capacity_; }
+  void set_capacity(size_t capacity);
+
+  // Retrieve # of HTML strings in the cache.
+  size_t size() const { return lru_entries_.size(); }
+
+  // Retrieve a size of memory used by entries in the cache.
+  size_t GetMemorySize() const;
+
+ private:
+  struct Entry {
+    HashedId key;
+    // The HTML is kept to resolve hash collisions.
+    std::string html;
+    SectionsPtr sections;
+  };
+  typedef std::list<Entry>::iterator iterator_entry;
+
+  // Entries in LRU order, the most recently used entry first.
+  std::list<Entry> lru_entries_;
+  std::unordered_map<HashedId, iterator_entry> map_entries_;
+  size_t capacity_;
+};
+
+}  // namespace flatui
+/// @endcond
+
+#endif  // FLATUI_SHAPING_CACHE_H
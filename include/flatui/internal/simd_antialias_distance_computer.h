@@ -0,0 +1,62 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLATUI_INTERNAL_SIMD_ANTIALIAS_DISTANCE_COMPUTER_H
+#define FLATUI_INTERNAL_SIMD_ANTIALIAS_DISTANCE_COMPUTER_H
+
+#include "flatui/internal/fast_antialias_distance_computer.h"
+
+namespace flatui {
+
+// The SimdAntialiasDistanceComputer is a FastAntialiasDistanceComputer with
+// the per pixel passes (the gradient filter, the initial edge distance
+// approximation and the final quantization) processing 4 pixels at a time
+// with SSE2 or NEON. The distance propagation is shared with the base class.
+//
+// The kernels evaluate the same expressions in the same order as the scalar
+// code, so the output is identical except when a compiler contracts
+// multiply-adds in either version differently. The difference is within 1 in
+// the 8 bit output in that case.
+class SimdAntialiasDistanceComputer
+    : public FastAntialiasDistanceComputer<uint8_t> {
+ public:
+  SimdAntialiasDistanceComputer() {}
+  ~SimdAntialiasDistanceComputer() {}
+
+  // Returns true if vectorized kernels are available on the running CPU.
+  // When false, the computer falls back to the scalar passes.
+  static bool IsSupported();
+
+  void Reserve(const vec2i& size) override {
+    FastAntialiasDistanceComputer<uint8_t>::Reserve(size);
+    image_values_.reserve(size.x * size.y);
+  }
+
+  uint32_t get_version() const override {
+    return kDistanceComputerVersionSimdAntialias;
+  }
+
+ protected:
+  void ComputeGradients() override;
+  void InitializeDistanceGrid() override;
+  void StoreDistances(bool inner_distance) override;
+
+ private:
+  // The source image including its padding region, converted to floats.
+  std::vector<float> image_values_;
+};
+
+}  // namespace flatui
+
+#endif  // FLATUI_INTERNAL_SIMD_ANTIALIAS_DISTANCE_COMPUTER_H
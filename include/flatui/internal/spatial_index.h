@@ -0,0 +1,82 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLATUI_SPATIAL_INDEX_H
+#define FLATUI_SPATIAL_INDEX_H
+
+#include <unordered_map>
+#include <vector>
+#include "flatui/internal/flatui_util.h"
+#include "mathfu/constants.h"
+
+/// @cond FLATUI_INTERNAL
+namespace flatui {
+
+// SpatialIndex is a uniform grid of element rects on the canvas.
+// It's used to find the nearest element in a direction without scanning all
+// elements. Rects outside of the canvas are put in the cells at its border.
+// The storage is kept across Clear() calls, so rebuilding the index every
+// frame doesn't allocate memory once it's warmed up.
+class SpatialIndex {
+ public:
+  SpatialIndex()
+      : cell_size_(mathfu::kOnes2i), grid_size_(mathfu::kZeros2i) {}
+
+  // Remove all rects, and set up the grid to cover `canvas_size`.
+  void Clear(const mathfu::vec2i &canvas_size);
+
+  // Add a rect of an element. When an ID is added more than once, the last
+  // rect is used to look up the element.
+  void Insert(HashedId hash, const mathfu::vec2i &pos,
+              const mathfu::vec2i &size);
+
+  // Check if an element is in the index.
+  bool Contains(HashedId hash) const {
+    return item_map_.find(hash) != item_map_.end();
+  }
+
+  // Find the element nearest to the element `hash` in `direction`.
+  // Elements are compared with the distance between their centers along the
+  // direction, plus twice the distance perpendicular to it, so elements in
+  // line with the current one are preferred.
+  // Returns kNullHash if there is no element in the direction, or `hash` is
+  // not in the index.
+  HashedId FindNeighbor(HashedId hash, const mathfu::vec2i &direction) const;
+
+ private:
+  // # of cells in each axis of the grid.
+  static const int32_t kCellsPerAxis = 32;
+
+  struct Item {
+    HashedId hash;
+    mathfu::vec2i min;
+    mathfu::vec2i max;
+  };
+
+  // Get the cell containing `point`, clamped to the grid.
+  mathfu::vec2i CellOf(const mathfu::vec2i &point) const;
+
+  std::vector<Item> items_;
+  // Indices to `items_` of rects overlapping each cell, in row major order.
+  std::vector<std::vector<int32_t>> cells_;
+  // Map from element IDs to indices to `items_`.
+  std::unordered_map<HashedId, int32_t> item_map_;
+  mathfu::vec2i cell_size_;
+  mathfu::vec2i grid_size_;
+};
+
+}  // namespace flatui
+/// @endcond
+
+#endif  // FLATUI_SPATIAL_INDEX_H
@@ -0,0 +1,105 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLATUI_INTERNAL_TEXT_PIPELINE_COUNTERS_H
+#define FLATUI_INTERNAL_TEXT_PIPELINE_COUNTERS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+
+/// @cond FLATUI_INTERNAL
+namespace flatui {
+
+// Counters backing TextPipelineStats of FontManager.
+// They are updated from layout threads, the rendering thread and glyph
+// rasterization workers, so each counter is an atomic updated with relaxed
+// ordering. While the counters are disabled, an update costs a single relaxed
+// load of the enabled flag.
+class TextPipelineCounters {
+ public:
+  enum Counter {
+    kGlyphLookups,
+    kGlyphHits,
+    kGlyphMisses,
+    kGlyphSets,
+    kRasterizeTime,
+    kSdfTime,
+    kShapingTime,
+    kShapedRuns,
+    kSimpleRuns,
+    kUploadBytes,
+    kNumCounters,
+  };
+
+  TextPipelineCounters() : enabled_(false) { Reset(); }
+
+  bool get_enabled() const { return enabled_.load(std::memory_order_relaxed); }
+  void set_enabled(bool enable) {
+    enabled_.store(enable, std::memory_order_relaxed);
+  }
+
+  // Add a value to a counter if the counters are enabled.
+  void Add(Counter counter, uint64_t value = 1) {
+    if (get_enabled()) {
+      counters_[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+  }
+
+  uint64_t Get(Counter counter) const {
+    return counters_[counter].load(std::memory_order_relaxed);
+  }
+
+  void Reset() {
+    for (int32_t i = 0; i < kNumCounters; ++i) {
+      counters_[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+ private:
+  std::atomic<bool> enabled_;
+  std::atomic<uint64_t> counters_[kNumCounters];
+};
+
+// Adds microseconds elapsed in the scope to a time counter. The clock is read
+// only when the counters are enabled at the start of the scope.
+class ScopedTextPipelineTimer {
+ public:
+  ScopedTextPipelineTimer(TextPipelineCounters *counters,
+                          TextPipelineCounters::Counter counter)
+      : counters_(counters != nullptr && counters->get_enabled() ? counters
+                                                                  : nullptr),
+        counter_(counter) {
+    if (counters_ != nullptr) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+  ~ScopedTextPipelineTimer() {
+    if (counters_ != nullptr) {
+      auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start_);
+      counters_->Add(counter_, static_cast<uint64_t>(elapsed.count()));
+    }
+  }
+
+ private:
+  TextPipelineCounters *counters_;
+  TextPipelineCounters::Counter counter_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace flatui
+/// @endcond
+
+#endif  // FLATUI_INTERNAL_TEXT_PIPELINE_COUNTERS_H
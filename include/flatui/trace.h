@@ -0,0 +1,118 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FLATUI_TRACE_H
+#define FLATUI_TRACE_H
+
+#include <atomic>
+#include "flatui/internal/flatui_util.h"
+
+/// @brief Namespace for FlatUI library.
+namespace flatui {
+
+/// @file
+/// @addtogroup flatui_trace
+/// @{
+
+/// @class TraceListener
+///
+/// @brief Interface receiving trace events of FlatUI, to forward them to a
+/// profiler such as Perfetto, Tracy or systrace.
+///
+/// FlatUI emits a begin and an end event around the layout and render passes
+/// of `Run()`, labels and custom elements, `CreateFlatUIFromData()`, and
+/// FontManager's layouts, glyph rasterizations and atlas uploads.
+/// Events are emitted from the threads running the traced work, including
+/// layout threads of FontManager. Events of a thread are properly nested.
+class TraceListener {
+ public:
+  virtual ~TraceListener() {}
+
+  /// @brief Called at the start of a traced scope.
+  ///
+  /// @param[in] name A static string naming the scope, such as
+  /// "FlatUI::RenderPass". It stays valid after the call.
+  /// @param[in] id An ID tagging the scope, such as the HashedId of an element
+  /// or a label, the text ID of a FontBuffer or a glyph index. `kNullHash`
+  /// if the scope has no ID.
+  virtual void BeginEvent(const char *name, HashedId id) = 0;
+
+  /// @brief Called at the end of the last scope begun in the thread.
+  ///
+  /// @param[in] name The name passed to the matching `BeginEvent()`.
+  virtual void EndEvent(const char *name) = 0;
+};
+
+/// @brief Set a listener receiving trace events.
+///
+/// Without a listener (the default), a traced scope costs a relaxed atomic
+/// load and a branch. Define `FLATUI_DISABLE_TRACE` when building FlatUI to
+/// compile the scopes out.
+///
+/// @param[in] listener The listener, or `nullptr` to stop tracing. It needs to
+/// outlive FlatUI and FontManager calls in flight when it's replaced.
+void SetTraceListener(TraceListener *listener);
+
+/// @return Returns the listener set with `SetTraceListener()`.
+TraceListener *GetTraceListener();
+
+/// @}
+
+/// @cond FLATUI_INTERNAL
+// The listener set with SetTraceListener().
+extern std::atomic<TraceListener *> trace_listener;
+
+// Emits a begin event at construction and an end event at destruction when a
+// listener is set at construction.
+class TraceScope {
+ public:
+  explicit TraceScope(const char *name, HashedId id = kNullHash)
+      : listener_(trace_listener.load(std::memory_order_relaxed)),
+        name_(name) {
+    if (listener_ != nullptr) {
+      listener_->BeginEvent(name, id);
+    }
+  }
+  ~TraceScope() {
+    if (listener_ != nullptr) {
+      listener_->EndEvent(name_);
+    }
+  }
+
+ private:
+  TraceListener *listener_;
+  const char *name_;
+
+  // Disable copy constructor.
+  TraceScope(const TraceScope &);
+  TraceScope &operator=(const TraceScope &);
+};
+/// @endcond
+
+}  // namespace flatui
+
+/// @cond FLATUI_INTERNAL
+// Trace the rest of the enclosing scope.
+#ifdef FLATUI_DISABLE_TRACE
+#define FLATUI_TRACE_SCOPE(name, id)
+#else
+#define FLATUI_TRACE_CONCAT_EXPAND(a, b) a##b
+#define FLATUI_TRACE_CONCAT(a, b) FLATUI_TRACE_CONCAT_EXPAND(a, b)
+#define FLATUI_TRACE_SCOPE(name, id)                            \
+  ::flatui::TraceScope FLATUI_TRACE_CONCAT(flatui_trace_scope_, \
+                                           __LINE__)(name, id)
+#endif  // FLATUI_DISABLE_TRACE
+/// @endcond
+
+#endif  // FLATUI_TRACE_H
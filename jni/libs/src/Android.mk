@@ -50,18 +50,35 @@ LOCAL_C_INCLUDES := \
 LOCAL_CPPFLAGS := -std=c++11
 
 LOCAL_SRC_FILES := \
+  src/codepoint_coverage.cpp \
+  src/color_glyph_cache.cpp \
+  src/decoded_text.cpp \
+  src/draw_batcher.cpp \
   src/flatui.cpp \
   src/flatui_common.cpp \
   src/flatui_serialization.cpp \
   src/font_buffer.cpp \
+  src/font_loader.cpp \
   src/font_manager.cpp \
   src/font_systemfont.cpp \
   src/font_util.cpp \
+  src/font_vertex_buffer.cpp \
   src/glyph_cache.cpp \
+  src/glyph_cache_uploader.cpp \
+  src/glyph_disk_cache.cpp \
+  src/glyph_rasterizer.cpp \
+  src/gpu_distance_computer.cpp \
   src/hb_complex_font.cpp \
   src/hyphenator.cpp \
+  src/layout_workers.cpp \
   src/micro_edit.cpp \
+  src/msdf_generator.cpp \
+  src/render_cache.cpp \
   src/script_table.cpp \
+  src/shaping_cache.cpp \
+  src/simd_antialias_distance_computer.cpp \
+  src/spatial_index.cpp \
+  src/trace.cpp \
   src/version.cpp
 
 LOCAL_STATIC_LIBRARIES := \
@@ -77,7 +94,9 @@ LOCAL_STATIC_LIBRARIES := \
 
 FLATUI_SCHEMA_DIR := $(FLATUI_DIR)/schemas
 FLATUI_SCHEMA_INCLUDE_DIRS := $(DEPENDENCIES_FPLBASE_DIR)/schemas
-FLATUI_SCHEMA_FILES := $(FLATUI_SCHEMA_DIR)/flatui.fbs
+FLATUI_SCHEMA_FILES := \
+  $(FLATUI_SCHEMA_DIR)/flatui.fbs \
+  $(FLATUI_SCHEMA_DIR)/glyph_atlas.fbs
 
 FLATBUFFERS_FLATC_ARGS := --gen-mutable
 
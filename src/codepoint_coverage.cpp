@@ -0,0 +1,252 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+
+#include <cstring>
+
+#include "internal/codepoint_coverage.h"
+
+namespace flatui {
+
+// # of blocks covering all Unicode codepoints.
+static const uint32_t kNumBlocks = 0x110000 >> kCoverageBlockBits;
+
+const size_t CodepointFaceMap::kMaxFaces;
+
+static int32_t CountBits(uint32_t bits) {
+  int32_t count = 0;
+  for (; bits; bits &= bits - 1) count++;
+  return count;
+}
+
+CodepointCoverage::Bitmap *CodepointCoverage::GetBitmap(uint32_t block) {
+  if (block >= blocks_.size()) blocks_.resize(block + 1, 0);
+  if (!blocks_[block]) {
+    Bitmap bitmap;
+    memset(&bitmap, 0, sizeof(bitmap));
+    bitmaps_.push_back(bitmap);
+    blocks_[block] = static_cast<uint16_t>(bitmaps_.size());
+  }
+  return &bitmaps_[blocks_[block] - 1];
+}
+
+bool CodepointCoverage::Insert(uint32_t code_point) {
+  auto block = code_point >> kCoverageBlockBits;
+  if (block >= kNumBlocks) return false;
+  auto bitmap = GetBitmap(block);
+  auto bit = code_point & (kCoverageBlockSize - 1);
+  auto mask = 1u << (bit & 31);
+  auto &bits = bitmap->bits[bit >> 5];
+  if (bits & mask) return false;
+  bits |= mask;
+  return true;
+}
+
+int32_t CodepointCoverage::Merge(const CodepointCoverage &coverage) {
+  int32_t new_code_points = 0;
+  for (uint32_t block = 0; block < coverage.blocks_.size(); ++block) {
+    if (!coverage.blocks_[block]) continue;
+    auto &src = coverage.bitmaps_[coverage.blocks_[block] - 1];
+    auto dest = GetBitmap(block);
+    for (size_t i = 0; i < kCoverageBlockSize / 32; ++i) {
+      new_code_points += CountBits(src.bits[i] & ~dest->bits[i]);
+      dest->bits[i] |= src.bits[i];
+    }
+  }
+  return new_code_points;
+}
+
+// Values in OpenType tables are big endian.
+static uint16_t ReadUint16(const uint8_t *p) {
+  return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+static uint32_t ReadUint32(const uint8_t *p) {
+  return (static_cast<uint32_t>(p[0]) << 24) |
+         (static_cast<uint32_t>(p[1]) << 16) |
+         (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+// Tags of a font collection header and of the cmap table.
+static const uint32_t kCollectionTag = 0x74746366;  // 'ttcf'
+static const uint32_t kCmapTag = 0x636d6170;        // 'cmap'
+static const uint32_t kMaxCodepoint = 0x10ffff;
+
+// Add the codepoints of a segmented coverage (format 12) subtable.
+static bool InsertCmapFormat12(const uint8_t *p, size_t size,
+                               CodepointCoverage *coverage) {
+  const size_t kHeaderSize = 16;
+  const size_t kGroupSize = 12;
+  if (size < kHeaderSize) return false;
+  auto num_groups = ReadUint32(p + 12);
+  if (num_groups > (size - kHeaderSize) / kGroupSize) return false;
+  for (uint32_t i = 0; i < num_groups; ++i) {
+    auto group = p + kHeaderSize + i * kGroupSize;
+    auto start = ReadUint32(group);
+    auto end = std::min(ReadUint32(group + 4), kMaxCodepoint);
+    auto glyph = ReadUint32(group + 8);
+    for (auto c = start; c <= end; ++c) {
+      // Codepoints mapped to the missing glyph aren't covered.
+      if (glyph + (c - start)) coverage->Insert(c);
+    }
+  }
+  return true;
+}
+
+// Add the codepoints of a segment mapping to delta values (format 4)
+// subtable.
+static bool InsertCmapFormat4(const uint8_t *p, size_t size,
+                              CodepointCoverage *coverage) {
+  const size_t kHeaderSize = 14;
+  if (size < kHeaderSize) return false;
+  size_t num_segments = ReadUint16(p + 6) / 2;
+  size_t ends = kHeaderSize;
+  size_t starts = ends + num_segments * 2 + 2;
+  size_t deltas = starts + num_segments * 2;
+  size_t range_offsets = deltas + num_segments * 2;
+  if (range_offsets + num_segments * 2 > size) return false;
+  for (size_t i = 0; i < num_segments; ++i) {
+    uint32_t end = ReadUint16(p + ends + i * 2);
+    uint32_t start = ReadUint16(p + starts + i * 2);
+    auto delta = ReadUint16(p + deltas + i * 2);
+    auto range_offset = ReadUint16(p + range_offsets + i * 2);
+    for (auto c = start; c <= end && c != 0xffff; ++c) {
+      uint32_t glyph = 0;
+      if (!range_offset) {
+        glyph = (c + delta) & 0xffff;
+      } else {
+        // The range offset is relative to its own entry.
+        auto offset = range_offsets + i * 2 + range_offset + (c - start) * 2;
+        if (offset + 2 > size) break;
+        glyph = ReadUint16(p + offset);
+        if (glyph) glyph = (glyph + delta) & 0xffff;
+      }
+      if (glyph) coverage->Insert(c);
+    }
+  }
+  return true;
+}
+
+bool CodepointCoverage::InsertCmap(const void *table, size_t size) {
+  auto p = static_cast<const uint8_t *>(table);
+  const size_t kHeaderSize = 4;
+  const size_t kRecordSize = 8;
+  if (size < kHeaderSize) return false;
+  size_t num_records = ReadUint16(p + 2);
+  if (kHeaderSize + num_records * kRecordSize > size) return false;
+
+  // Find a Unicode subtable. Format 12 ones cover codepoints out of the BMP.
+  const uint8_t *subtable = nullptr;
+  size_t subtable_size = 0;
+  uint16_t subtable_format = 0;
+  for (size_t i = 0; i < num_records; ++i) {
+    auto record = p + kHeaderSize + i * kRecordSize;
+    auto platform = ReadUint16(record);
+    auto encoding = ReadUint16(record + 2);
+    auto offset = ReadUint32(record + 4);
+    auto unicode =
+        platform == 0 || (platform == 3 && (encoding == 1 || encoding == 10));
+    if (!unicode || offset + 2 > size) continue;
+    auto format = ReadUint16(p + offset);
+    if ((format == 12 && subtable_format != 12) ||
+        (format == 4 && subtable_format == 0)) {
+      subtable = p + offset;
+      subtable_size = size - offset;
+      subtable_format = format;
+    }
+  }
+  if (subtable_format == 12) {
+    return InsertCmapFormat12(subtable, subtable_size, this);
+  } else if (subtable_format == 4) {
+    return InsertCmapFormat4(subtable, subtable_size, this);
+  }
+  return false;
+}
+
+bool CodepointCoverage::InsertFontCmap(const void *font, size_t size,
+                                       int32_t face_index) {
+  auto p = static_cast<const uint8_t *>(font);
+  const size_t kDirectorySize = 12;
+  const size_t kRecordSize = 16;
+
+  // Find the table directory of the face in a collection.
+  size_t directory = 0;
+  if (size >= kDirectorySize && ReadUint32(p) == kCollectionTag) {
+    auto num_faces = ReadUint32(p + 8);
+    if (face_index < 0 || static_cast<uint32_t>(face_index) >= num_faces ||
+        kDirectorySize + (face_index + 1) * 4 > size) {
+      return false;
+    }
+    directory = ReadUint32(p + kDirectorySize + face_index * 4);
+  }
+  if (directory + kDirectorySize > size) return false;
+  size_t num_tables = ReadUint16(p + directory + 4);
+  auto records = directory + kDirectorySize;
+  if (records + num_tables * kRecordSize > size) return false;
+
+  for (size_t i = 0; i < num_tables; ++i) {
+    auto record = p + records + i * kRecordSize;
+    if (ReadUint32(record) != kCmapTag) continue;
+    auto offset = ReadUint32(record + 8);
+    auto length = ReadUint32(record + 12);
+    if (offset > size || length > size - offset) return false;
+    return InsertCmap(p + offset, length);
+  }
+  return false;
+}
+
+void CodepointFaceMap::Build(
+    const std::vector<const CodepointCoverage *> &coverages) {
+  blocks_.clear();
+  faces_.clear();
+  overflow_.clear();
+
+  auto num_faces = std::min(coverages.size(), kMaxFaces);
+  for (size_t face = 0; face < num_faces; ++face) {
+    auto &coverage = *coverages[face];
+    for (uint32_t block = 0; block < coverage.blocks_.size(); ++block) {
+      if (!coverage.blocks_[block]) continue;
+      if (block >= blocks_.size()) blocks_.resize(block + 1, 0);
+      if (!blocks_[block]) {
+        FaceBlock face_block;
+        memset(&face_block, 0, sizeof(face_block));
+        faces_.push_back(face_block);
+        blocks_[block] = static_cast<uint16_t>(faces_.size());
+      }
+
+      // Faces earlier in the list have priority, so only fill the entries
+      // not covered yet.
+      auto &bitmap = coverage.bitmaps_[coverage.blocks_[block] - 1];
+      auto &indices = faces_[blocks_[block] - 1].indices;
+      for (uint32_t bit = 0; bit < kCoverageBlockSize; ++bit) {
+        if (!indices[bit] && (bitmap.bits[bit >> 5] >> (bit & 31)) & 1) {
+          indices[bit] = static_cast<uint8_t>(face + 1);
+        }
+      }
+    }
+  }
+  overflow_.assign(coverages.begin() + num_faces, coverages.end());
+}
+
+int32_t CodepointFaceMap::FindOverflow(uint32_t code_point) const {
+  for (size_t i = 0; i < overflow_.size(); ++i) {
+    if (overflow_[i]->Contains(code_point)) {
+      return static_cast<int32_t>(kMaxFaces + i);
+    }
+  }
+  return -1;
+}
+
+}  // namespace flatui
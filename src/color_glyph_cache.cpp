@@ -0,0 +1,190 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "precompiled.h"
+
+#include "internal/color_glyph_cache.h"
+
+// STB_image to resize color glyphs.
+// Disable warnings in STB_image_resize.
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4100)  // Disable 'unused reference' warning.
+#else
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#endif /* _MSC_VER */
+#include "stb_image_resize.h"
+// Pop warning status.
+#ifdef _MSC_VER
+#pragma warning(pop)
+#else
+#pragma GCC diagnostic pop
+#endif
+
+namespace flatui {
+
+// Bytes per pixel of BGRA bitmaps.
+static const int32_t kColorGlyphChannels = 4;
+
+// Mip levels smaller than this height aren't generated.
+static const int32_t kMinColorGlyphMipHeight = 8;
+
+// Build a level half the size of `src` with a 2x2 box filter. Averaging is
+// correct for premultiplied pixels.
+static void BuildMipLevel(const ColorGlyphStrike::Level &src,
+                          ColorGlyphStrike::Level *dest) {
+  dest->width = std::max(src.width / 2, 1);
+  dest->height = std::max(src.height / 2, 1);
+  dest->pixels.resize(dest->width * dest->height * kColorGlyphChannels);
+  auto src_stride = src.width * kColorGlyphChannels;
+  auto p = dest->pixels.data();
+  for (int32_t y = 0; y < dest->height; ++y) {
+    auto y0 = std::min(y * 2, src.height - 1);
+    auto y1 = std::min(y * 2 + 1, src.height - 1);
+    for (int32_t x = 0; x < dest->width; ++x) {
+      auto x0 = std::min(x * 2, src.width - 1) * kColorGlyphChannels;
+      auto x1 = std::min(x * 2 + 1, src.width - 1) * kColorGlyphChannels;
+      auto row0 = src.pixels.data() + y0 * src_stride;
+      auto row1 = src.pixels.data() + y1 * src_stride;
+      for (int32_t c = 0; c < kColorGlyphChannels; ++c) {
+        *p++ = static_cast<uint8_t>(
+            (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >>
+            2);
+      }
+    }
+  }
+}
+
+const ColorGlyphStrike *ColorGlyphCache::Find(HashedId font_id,
+                                              uint32_t code_point) {
+  auto it = map_entries_.find(GetKey(font_id, code_point));
+  if (it == map_entries_.end()) {
+    return nullptr;
+  }
+  auto &entry = *it->second;
+  if (entry.font_id != font_id || entry.code_point != code_point) {
+    return nullptr;
+  }
+
+  // Mark the entry as most recently used.
+  lru_entries_.splice(lru_entries_.begin(), lru_entries_, it->second);
+  return &entry.strike;
+}
+
+const ColorGlyphStrike *ColorGlyphCache::Store(
+    HashedId font_id, uint32_t code_point, const uint8_t *bitmap,
+    int32_t width, int32_t height, int32_t pitch, float bitmap_left,
+    int32_t advance) {
+  ColorGlyphStrike *strike;
+  if (capacity_ == 0) {
+    strike = &uncached_strike_;
+  } else {
+    auto key = GetKey(font_id, code_point);
+    auto it = map_entries_.find(key);
+    if (it != map_entries_.end()) {
+      // Replace an entry whose glyph collided with the key.
+      lru_entries_.erase(it->second);
+      map_entries_.erase(it);
+    } else if (lru_entries_.size() >= capacity_) {
+      map_entries_.erase(lru_entries_.back().key);
+      lru_entries_.pop_back();
+    }
+    lru_entries_.push_front(Entry());
+    auto &entry = lru_entries_.front();
+    entry.key = key;
+    entry.font_id = font_id;
+    entry.code_point = code_point;
+    map_entries_[key] = lru_entries_.begin();
+    strike = &entry.strike;
+  }
+
+  strike->bitmap_left = bitmap_left;
+  strike->advance = advance;
+  strike->levels.resize(1);
+  auto &base = strike->levels[0];
+  base.width = width;
+  base.height = height;
+  auto stride = width * kColorGlyphChannels;
+  base.pixels.resize(stride * height);
+  for (int32_t y = 0; y < height; ++y) {
+    memcpy(base.pixels.data() + y * stride, bitmap + y * pitch, stride);
+  }
+
+  // Generate mip levels down to a height scaled glyphs rarely go below.
+  while (strike->levels.back().height / 2 >= kMinColorGlyphMipHeight) {
+    strike->levels.push_back(ColorGlyphStrike::Level());
+    BuildMipLevel(strike->levels[strike->levels.size() - 2],
+                  &strike->levels.back());
+  }
+  return strike;
+}
+
+const uint8_t *ColorGlyphCache::Scale(const ColorGlyphStrike &strike,
+                                      int32_t width, int32_t height,
+                                      bool alpha_only) {
+  // Scale from the smallest level that is still larger than the size, so the
+  // filter reads as few pixels as possible without losing detail.
+  size_t index = 0;
+  while (index + 1 < strike.levels.size() &&
+         strike.levels[index + 1].height >= height) {
+    ++index;
+  }
+  auto &level = strike.levels[index];
+  const uint8_t *image;
+  if (level.width == width && level.height == height) {
+    image = level.pixels.data();
+  } else {
+    scaled_image_.resize(width * height * kColorGlyphChannels);
+    stbir_resize_uint8(level.pixels.data(), level.width, level.height, 0,
+                       scaled_image_.data(), width, height, 0,
+                       kColorGlyphChannels);
+    image = scaled_image_.data();
+  }
+  if (!alpha_only) {
+    return image;
+  }
+
+  // Extract alpha channel.
+  alpha_image_.resize(width * height);
+  auto src = image + kColorGlyphChannels - 1;
+  for (size_t i = 0; i < alpha_image_.size();
+       ++i, src += kColorGlyphChannels) {
+    alpha_image_[i] = *src;
+  }
+  return alpha_image_.data();
+}
+
+void ColorGlyphCache::set_capacity(size_t capacity) {
+  capacity_ = capacity;
+  while (lru_entries_.size() > capacity_) {
+    map_entries_.erase(lru_entries_.back().key);
+    lru_entries_.pop_back();
+  }
+}
+
+size_t ColorGlyphCache::GetMemorySize() const {
+  size_t size = scaled_image_.capacity() + alpha_image_.capacity();
+  for (auto it = lru_entries_.begin(); it != lru_entries_.end(); ++it) {
+    size += sizeof(*it) +
+            it->strike.levels.capacity() * sizeof(ColorGlyphStrike::Level);
+    auto &levels = it->strike.levels;
+    for (auto level = levels.begin(); level != levels.end(); ++level) {
+      size += level->pixels.capacity();
+    }
+  }
+  return size;
+}
+
+}  // namespace flatui
@@ -0,0 +1,244 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+
+#include <algorithm>
+#include <cstring>
+#include "internal/decoded_text.h"
+#include "linebreak.h"
+
+// vmaxvq_u8() used to test ASCII bytes is only available on AArch64.
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FLATUI_SIMD_SSE2 (1)
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FLATUI_SIMD_NEON (1)
+#endif
+
+namespace flatui {
+
+namespace {
+
+#if defined(FLATUI_SIMD_SSE2) || defined(FLATUI_SIMD_NEON)
+// # of bytes tested at once for a run of ASCII characters.
+const size_t kAsciiBlockSize = 16;
+#else
+const size_t kAsciiBlockSize = 8;
+#endif  // FLATUI_SIMD_SSE2 || FLATUI_SIMD_NEON
+
+// Check if a block of kAsciiBlockSize bytes only has ASCII characters.
+inline bool IsAsciiBlock(const uint8_t *s) {
+#if defined(FLATUI_SIMD_SSE2)
+  auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+  return _mm_movemask_epi8(v) == 0;
+#elif defined(FLATUI_SIMD_NEON)
+  return vmaxvq_u8(vld1q_u8(s)) < 0x80;
+#else
+  uint64_t v;
+  memcpy(&v, s, sizeof(v));
+  return (v & 0x8080808080808080ULL) == 0;
+#endif  // FLATUI_SIMD_SSE2
+}
+
+// Widen a block of ASCII characters to codepoints, and store their offsets
+// starting at `offset`.
+inline void DecodeAsciiBlock(const uint8_t *s, uint32_t offset,
+                             uint32_t *codepoints, uint32_t *offsets) {
+#if defined(FLATUI_SIMD_SSE2)
+  auto zero = _mm_setzero_si128();
+  auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+  auto lo = _mm_unpacklo_epi8(v, zero);
+  auto hi = _mm_unpackhi_epi8(v, zero);
+  auto out = reinterpret_cast<__m128i *>(codepoints);
+  _mm_storeu_si128(out, _mm_unpacklo_epi16(lo, zero));
+  _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo, zero));
+  _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi, zero));
+  _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi, zero));
+  auto base =
+      _mm_add_epi32(_mm_set1_epi32(static_cast<int32_t>(offset)),
+                    _mm_set_epi32(3, 2, 1, 0));
+  auto step = _mm_set1_epi32(4);
+  auto offset_out = reinterpret_cast<__m128i *>(offsets);
+  for (int32_t i = 0; i < 4; ++i) {
+    _mm_storeu_si128(offset_out + i, base);
+    base = _mm_add_epi32(base, step);
+  }
+#elif defined(FLATUI_SIMD_NEON)
+  auto v = vld1q_u8(s);
+  auto lo = vmovl_u8(vget_low_u8(v));
+  auto hi = vmovl_u8(vget_high_u8(v));
+  vst1q_u32(codepoints, vmovl_u16(vget_low_u16(lo)));
+  vst1q_u32(codepoints + 4, vmovl_u16(vget_high_u16(lo)));
+  vst1q_u32(codepoints + 8, vmovl_u16(vget_low_u16(hi)));
+  vst1q_u32(codepoints + 12, vmovl_u16(vget_high_u16(hi)));
+  static const uint32_t kSteps[4] = {0, 1, 2, 3};
+  auto base = vaddq_u32(vdupq_n_u32(offset), vld1q_u32(kSteps));
+  auto step = vdupq_n_u32(4);
+  for (int32_t i = 0; i < 4; ++i) {
+    vst1q_u32(offsets + i * 4, base);
+    base = vaddq_u32(base, step);
+  }
+#else
+  for (size_t i = 0; i < kAsciiBlockSize; ++i) {
+    codepoints[i] = s[i];
+    offsets[i] = offset + static_cast<uint32_t>(i);
+  }
+#endif  // FLATUI_SIMD_SSE2
+}
+
+inline bool IsContinuation(uint8_t c) { return (c & 0xC0) == 0x80; }
+
+// Decode a UTF-8 sequence at `s`, which has `remaining` bytes.
+// Returns the length of the sequence, or 0 if it's malformed: a truncated
+// sequence, an overlong encoding, a surrogate or a value beyond U+10FFFF.
+size_t DecodeSequence(const uint8_t *s, size_t remaining, uint32_t *codepoint) {
+  auto c = s[0];
+  if (c < 0x80) {
+    *codepoint = c;
+    return 1;
+  }
+  if (c < 0xC2 || c > 0xF4) {
+    return 0;
+  }
+  if (c < 0xE0) {
+    if (remaining < 2 || !IsContinuation(s[1])) return 0;
+    *codepoint = ((c & 0x1F) << 6) | (s[1] & 0x3F);
+    return 2;
+  }
+  if (c < 0xF0) {
+    if (remaining < 3 || !IsContinuation(s[1]) || !IsContinuation(s[2]) ||
+        (c == 0xE0 && s[1] < 0xA0) || (c == 0xED && s[1] >= 0xA0)) {
+      return 0;
+    }
+    *codepoint = ((c & 0x0F) << 12) | ((s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+    return 3;
+  }
+  if (remaining < 4 || !IsContinuation(s[1]) || !IsContinuation(s[2]) ||
+      !IsContinuation(s[3]) || (c == 0xF0 && s[1] < 0x90) ||
+      (c == 0xF4 && s[1] >= 0x90)) {
+    return 0;
+  }
+  *codepoint = ((c & 0x07) << 18) | ((s[1] & 0x3F) << 12) |
+               ((s[2] & 0x3F) << 6) | (s[3] & 0x3F);
+  return 4;
+}
+
+}  // namespace
+
+void DecodedText::Decode(const char *text, size_t length) {
+  text_ = text;
+  length_ = length;
+  count_ = 0;
+  well_formed_ = true;
+
+  // A text has at most one codepoint per byte, and the terminating 0.
+  if (codepoints_.size() < length + 1) {
+    codepoints_.resize(length + 1);
+    offsets_.resize(length + 1);
+  }
+  auto s = reinterpret_cast<const uint8_t *>(text);
+  auto codepoints = codepoints_.data();
+  auto offsets = offsets_.data();
+  size_t i = 0;
+  while (i < length) {
+    if (length - i >= kAsciiBlockSize && IsAsciiBlock(s + i)) {
+      DecodeAsciiBlock(s + i, static_cast<uint32_t>(i), codepoints + count_,
+                       offsets + count_);
+      i += kAsciiBlockSize;
+      count_ += kAsciiBlockSize;
+      continue;
+    }
+    auto size = DecodeSequence(s + i, length - i, codepoints + count_);
+    if (!size) {
+      well_formed_ = false;
+      break;
+    }
+    offsets[count_++] = static_cast<uint32_t>(i);
+    i += size;
+  }
+  codepoints[count_] = 0;
+  offsets[count_] = static_cast<uint32_t>(i);
+}
+
+void DecodedText::Clear() {
+  text_ = nullptr;
+  length_ = 0;
+  count_ = 0;
+  well_formed_ = false;
+}
+
+bool DecodedText::Contains(const char *text, size_t length) const {
+  if (!well_formed_ || text < text_ || text + length > text_ + length_) {
+    return false;
+  }
+  auto start = static_cast<size_t>(text - text_);
+  auto first = FindCodepoint(start);
+  auto last = FindCodepoint(start + length);
+  return offsets_[first] == start && offsets_[last] == start + length;
+}
+
+size_t DecodedText::FindCodepoint(size_t offset) const {
+  auto offsets = offsets_.data();
+  return std::lower_bound(offsets, offsets + count_, offset) - offsets;
+}
+
+void DecodedText::SetLineBreaks(const char *language,
+                                std::vector<char> *breaks) {
+  assert(well_formed_);
+  // Break info of the terminating 0 is computed as well, to match the info
+  // set_linebreaks_utf8() computes for a 0 terminated text.
+  codepoint_breaks_.resize(count_ + 1);
+  set_linebreaks_utf32(reinterpret_cast<const utf32_t *>(codepoints_.data()),
+                       count_ + 1, language, &codepoint_breaks_[0]);
+
+  // Breaks per byte have the info of a codepoint at its last byte, and
+  // LINEBREAK_INSIDEACHAR at other bytes.
+  breaks->resize(length_ + 1);
+  auto out = breaks->data();
+  for (size_t i = 0; i < count_; ++i) {
+    auto end = offsets_[i + 1] - 1;
+    for (auto j = offsets_[i]; j < end; ++j) {
+      out[j] = LINEBREAK_INSIDEACHAR;
+    }
+    out[end] = codepoint_breaks_[i];
+  }
+  out[length_] = codepoint_breaks_[count_];
+}
+
+bool CountCodepoints(const char *text, size_t length, size_t *count) {
+  auto s = reinterpret_cast<const uint8_t *>(text);
+  size_t n = 0;
+  size_t i = 0;
+  while (i < length) {
+    if (length - i >= kAsciiBlockSize && IsAsciiBlock(s + i)) {
+      i += kAsciiBlockSize;
+      n += kAsciiBlockSize;
+      continue;
+    }
+    uint32_t codepoint;
+    auto size = DecodeSequence(s + i, length - i, &codepoint);
+    if (!size) {
+      return false;
+    }
+    i += size;
+    n++;
+  }
+  *count = n;
+  return true;
+}
+
+}  // namespace flatui
@@ -0,0 +1,244 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "flatui/font_manager.h"
+#include "fplbase/render_utils.h"
+#include "internal/draw_batcher.h"
+
+namespace flatui {
+
+using mathfu::vec2;
+using mathfu::vec3;
+using mathfu::vec4;
+using mathfu::mat4;
+
+static bool Equal(const vec4 &a, const vec4 &b) {
+  return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+}
+
+static bool Overlap(const vec4 &a, const vec4 &b) {
+  return a.x < b.z && b.x < a.z && a.y < b.w && b.y < a.w;
+}
+
+void DrawBatcher::SetTransform(const mat4 &transform,
+                               const mat4 &view_projection) {
+  transformed_ = true;
+  transform_ = transform;
+  screen_transform_ = view_projection * transform;
+}
+
+vec4 DrawBatcher::TransformBounds(const vec4 &bounds) const {
+  if (!transformed_) return bounds;
+
+  // Project corners of the bounds, which are on a plane in world space.
+  auto min = vec2(std::numeric_limits<float>::max());
+  auto max = vec2(-std::numeric_limits<float>::max());
+  const vec2 kCorners[] = {bounds.xy(), vec2(bounds.x, bounds.w),
+                           vec2(bounds.z, bounds.y), bounds.zw()};
+  for (size_t i = 0; i < 4; ++i) {
+    auto p = screen_transform_ * vec4(kCorners[i].x, kCorners[i].y, 0.0f, 1.0f);
+    if (p.w <= 0.0f) {
+      // A corner is behind the camera. Treat the draw as covering the screen.
+      return vec4(vec2(-std::numeric_limits<float>::max()),
+                  vec2(std::numeric_limits<float>::max()));
+    }
+    auto ndc = p.xy() / p.w;
+    min = vec2::Min(min, ndc);
+    max = vec2::Max(max, ndc);
+  }
+  return vec4(min, max);
+}
+
+void DrawBatcher::AddVertex(Batch *batch, float x, float y, float z, float u,
+                            float v) const {
+  if (transformed_) {
+    auto p = transform_ * vec4(x, y, z, 1.0f);
+    x = p.x;
+    y = p.y;
+    z = p.z;
+  }
+  batch->vertices.push_back(FontVertex(x, y, z, u, v));
+}
+
+DrawBatcher::Batch *DrawBatcher::GetBatch(
+    fplbase::Shader *shader, FontShader *font_shader,
+    const fplbase::Texture *texture, const vec4 &color, const vec4 &clip_rect,
+    float threshold, const vec4 &bounds) {
+  // Look for a batch with the same states. Stop at the first batch overlapping
+  // the draw, since the draw has to be rendered on top of it.
+  for (size_t i = num_batches_, lookback = 0; i > 0 && lookback < kMaxLookback;
+       --i, ++lookback) {
+    auto &batch = batches_[i - 1];
+    if (batch.shader == shader && batch.font_shader == font_shader &&
+        batch.texture == texture && Equal(batch.color, color) &&
+        Equal(batch.clip_rect, clip_rect) && batch.threshold == threshold) {
+      batch.bounds = vec4(vec2::Min(batch.bounds.xy(), bounds.xy()),
+                          vec2::Max(batch.bounds.zw(), bounds.zw()));
+      return &batch;
+    }
+    if (Overlap(batch.bounds, bounds)) break;
+  }
+
+  // Start a new batch, recycling a previously used one if possible.
+  if (num_batches_ == batches_.size()) {
+    batches_.resize(num_batches_ + 1);
+  }
+  auto &batch = batches_[num_batches_++];
+  batch.shader = shader;
+  batch.font_shader = font_shader;
+  batch.texture = texture;
+  batch.color = color;
+  batch.clip_rect = clip_rect;
+  batch.threshold = threshold;
+  batch.bounds = bounds;
+  batch.vertices.clear();
+  return &batch;
+}
+
+void DrawBatcher::AddQuad(fplbase::Shader *shader,
+                          const fplbase::Texture *texture, const vec4 &color,
+                          const mathfu::vec2i &pos, const mathfu::vec2i &size,
+                          const vec4 &uv) {
+  auto p0 = vec2(pos);
+  auto p1 = vec2(pos + size);
+  auto batch =
+      GetBatch(shader, nullptr, texture, color, mathfu::kZeros4f, 0.0f,
+               TransformBounds(vec4(vec2::Min(p0, p1), vec2::Max(p0, p1))));
+  AddVertex(batch, p0.x, p0.y, 0.0f, uv.x, uv.y);
+  AddVertex(batch, p0.x, p1.y, 0.0f, uv.x, uv.w);
+  AddVertex(batch, p1.x, p0.y, 0.0f, uv.z, uv.y);
+  AddVertex(batch, p1.x, p1.y, 0.0f, uv.z, uv.w);
+}
+
+void DrawBatcher::AddGlyphs(FontShader *shader,
+                            const fplbase::Texture *texture, const vec4 &color,
+                            const vec4 &clip_rect, float threshold,
+                            const vec3 &offset,
+                            const std::vector<FontVertex> &vertices,
+                            const std::vector<GlyphRange> &ranges) {
+  if (ranges.empty()) return;
+
+  // Calculate bounds of the glyphs to check overlaps with other batches.
+  auto min = vec2(std::numeric_limits<float>::max());
+  auto max = vec2(-std::numeric_limits<float>::max());
+  for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+    auto begin = vertices.begin() + it->start * kVerticesPerGlyph;
+    auto end = begin + it->count * kVerticesPerGlyph;
+    for (auto v = begin; v != end; ++v) {
+      auto p = vec2(v->position_.data[0], v->position_.data[1]);
+      min = vec2::Min(min, p);
+      max = vec2::Max(max, p);
+    }
+  }
+  auto bounds = vec4(min + offset.xy(), max + offset.xy());
+
+  // Clipped glyphs can't expand beyond the clip rect.
+  if (clip_rect.z != 0.0f && clip_rect.w != 0.0f) {
+    assert(!transformed_);
+    bounds = vec4(vec2::Max(bounds.xy(), clip_rect.xy()),
+                  vec2::Min(bounds.zw(), clip_rect.zw()));
+  }
+
+  auto batch = GetBatch(nullptr, shader, texture, color, clip_rect, threshold,
+                        TransformBounds(bounds));
+  for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+    auto begin = vertices.begin() + it->start * kVerticesPerGlyph;
+    auto end = begin + it->count * kVerticesPerGlyph;
+    for (auto v = begin; v != end; ++v) {
+      AddVertex(batch, v->position_.data[0] + offset.x,
+                v->position_.data[1] + offset.y,
+                v->position_.data[2] + offset.z, v->uv_.data[0],
+                v->uv_.data[1]);
+    }
+  }
+}
+
+void DrawBatcher::Flush(fplbase::Renderer *renderer) {
+  const fplbase::Attribute kFormat[] = {fplbase::kPosition3f,
+                                        fplbase::kTexCoord2f, fplbase::kEND};
+  auto quad_indices = GetQuadIndices();
+  for (size_t i = 0; i < num_batches_; ++i) {
+    auto &batch = batches_[i];
+    if (batch.vertices.empty()) continue;
+
+    if (batch.font_shader) {
+      auto shader = batch.font_shader;
+      shader->set_renderer(renderer);
+      shader->set_position_offset(mathfu::kZeros3f);
+      if (fplbase::ValidUniformHandle(shader->color_handle())) {
+        shader->set_color(batch.color);
+      }
+      if (fplbase::ValidUniformHandle(shader->threshold_handle())) {
+        shader->set_threshold(batch.threshold);
+      }
+      if (fplbase::ValidUniformHandle(shader->clipping_handle())) {
+        shader->set_clipping(batch.clip_rect);
+      }
+    } else {
+      renderer->set_color(batch.color);
+      renderer->SetShader(batch.shader);
+    }
+    num_shader_binds_++;
+    if (batch.texture) {
+      batch.texture->Set(0);
+      num_texture_binds_++;
+    }
+
+    // Split the batch into draws addressable with 16 bit indices.
+    auto glyph_count =
+        static_cast<uint32_t>(batch.vertices.size() / kVerticesPerGlyph);
+    for (uint32_t start = 0; start < glyph_count;
+         start += kMaxQuadIndicesGlyphs) {
+      auto count = std::min(glyph_count - start, kMaxQuadIndicesGlyphs);
+      fplbase::RenderArray(
+          fplbase::Mesh::kTriangles,
+          static_cast<int>(count * kIndicesPerGlyph), kFormat,
+          sizeof(FontVertex),
+          reinterpret_cast<const char *>(
+              &batch.vertices[start * kVerticesPerGlyph]),
+          quad_indices);
+      num_draw_calls_++;
+    }
+  }
+  Clear();
+}
+
+size_t DrawBatcher::Hash() const {
+  size_t hash = HashCombine<size_t>(0, num_batches_);
+  for (size_t i = 0; i < num_batches_; ++i) {
+    auto &batch = batches_[i];
+    hash = HashCombine(hash, batch.shader);
+    hash = HashCombine(hash, batch.font_shader);
+    hash = HashCombine(hash, batch.texture);
+    for (int j = 0; j < 4; ++j) {
+      hash = HashCombine(hash, batch.color[j]);
+      hash = HashCombine(hash, batch.clip_rect[j]);
+    }
+    hash = HashCombine(hash, batch.threshold);
+    hash = HashCombine(
+        hash, HashId(reinterpret_cast<const char *>(batch.vertices.data()),
+                     static_cast<int32_t>(batch.vertices.size() *
+                                          sizeof(FontVertex))));
+  }
+  return hash;
+}
+
+void DrawBatcher::Clear() { num_batches_ = 0; }
+
+}  // namespace flatui
@@ -15,10 +15,14 @@
 #include "flatui/flatui.h"
 #include <cstring>
 #include "flatui/font_util.h"
+#include "flatui/internal/draw_batcher.h"
 #include "flatui/internal/flatui_layout.h"
 #include "flatui/internal/flatui_util.h"
 #include "flatui/internal/hb_complex_font.h"
 #include "flatui/internal/micro_edit.h"
+#include "flatui/internal/render_cache.h"
+#include "flatui/internal/spatial_index.h"
+#include "flatui/trace.h"
 #include "fplbase/render_utils.h"
 #include "fplbase/utilities.h"
 #include "motive/engine.h"
@@ -45,9 +49,20 @@ enum FontShaderType {
   kFontShaderTypeDefault = 0,
   kFontShaderTypeSdf,
   kFontShaderTypeColor,
+  kFontShaderTypeMsdf,
   kFontShaderTypeCount,
 };
 
+// State of the render cache in a render pass.
+enum RenderCacheState {
+  // Elements are rendered to the current framebuffer.
+  kRenderCacheOff = 0,
+  // Draws are recorded, to be compared with the cached content at the end.
+  kRenderCacheRecording,
+  // Elements are rendered into the render cache.
+  kRenderCacheRendering,
+};
+
 // Since the largest type we currently expose in the external API is
 // mathfu::vec4, our max dimensions is 4. If this changes, the code inside of
 // StartAnimation and Animatable should be adjusted to use std::vectors instead
@@ -57,6 +72,7 @@ static const float kScrollSpeedDragDefault = 2.0f;
 static const float kScrollSpeedWheelDefault = 16.0f;
 static const float kScrollSpeedGamepadDefault = 0.1f;
 static const int32_t kDragStartThresholdDefault = 8;
+static const int32_t kVirtualListMarginItems = 2;
 static const int32_t kPointerIndexInvalid = -1;
 static const int32_t kElementIndexInvalid = -1;
 static const vec2i kDragStartPoisitionInvalid = vec2i(-1, -1);
@@ -64,17 +80,24 @@ static const vec2i kDragStartPoisitionInvalid = vec2i(-1, -1);
 static const uint32_t kDefaultGroupHashedId = HashId(kDefaultGroupID);
 #endif
 
+// Animations are kept in a vector sorted by `id`. The motivators only refer
+// to motive's processors, which store and update all motivators of a type
+// together in MotiveEngine::AdvanceFrame().
 struct Anim {
+  Anim() : id(kNullHash), called_last_frame(false) {}
+  HashedId id;
   bool called_last_frame;
   motive::MotivatorNf motivator;
 };
 
+inline bool operator<(const Anim &anim, HashedId id) { return anim.id < id; }
+
 struct Sprite {
   Sprite() : sequence_number(0), called_last_frame(false), group_hash(0) {}
-  Sprite(const std::function<bool(SequenceId seq)> &draw,
+  Sprite(std::function<bool(SequenceId seq)> &&draw,
          SequenceId sequence_number, bool called_last_frame,
          HashedId group_hash)
-      : draw(draw),
+      : draw(std::move(draw)),
         sequence_number(sequence_number),
         called_last_frame(called_last_frame),
         group_hash(group_hash) {}
@@ -131,13 +154,28 @@ class InternalState : public LayoutManager {
   InternalState(fplbase::AssetManager &assetman, FontManager &fontman,
                 fplbase::InputSystem &input,
                 motive::MotiveEngine *motive_engine)
-      : LayoutManager(assetman.renderer().window_size()),
+      : LayoutManager(assetman.renderer().window_size(),
+                      &persistent_.layout_storage_),
         default_projection_(true),
         depth_test_(false),
+        draw_batching_(false),
+        layout_retained_(false),
+        retained_state_(&persistent_.screen_layout_),
+        world_panel_index_(0),
+        world_panel_count_(0),
+        render_cache_state_(kRenderCacheOff),
+        input_idle_(false),
+        bound_texture_(nullptr),
+        batcher_draw_calls_(persistent_.draw_batcher_.get_draw_call_count()),
+        batcher_shader_binds_(
+            persistent_.draw_batcher_.get_shader_bind_count()),
+        batcher_texture_binds_(
+            persistent_.draw_batcher_.get_texture_bind_count()),
         matman_(assetman),
         renderer_(assetman.renderer()),
         input_(input),
         fontman_(fontman),
+        instanced_shaders_loaded_(false),
         motive_engine_(motive_engine),
         clip_position_(mathfu::kZeros2i),
         clip_size_(mathfu::kZeros2i),
@@ -175,6 +213,12 @@ class InternalState : public LayoutManager {
       pointer_delta_[i] = input_.get_pointers()[i].mousedelta;
     }
 
+    // No pointer is down, moving or scrolling in this frame.
+    auto wheel_delta = input_.mousewheel_delta();
+    input_idle_ = flush_pointer_capture && pointer_delta_[0].x == 0 &&
+                  pointer_delta_[0].y == 0 && wheel_delta.x == 0 &&
+                  wheel_delta.y == 0;
+
     // If no pointer is active, flush the pointer capture status.
     if (flush_pointer_capture) {
       persistent_.dragging_pointer_ = kPointerIndexInvalid;
@@ -207,6 +251,10 @@ class InternalState : public LayoutManager {
         matman_.LoadShader("shaders/font_color"));
     font_shaders_[kFontShaderTypeColor][1].set(
         matman_.LoadShader("shaders/font_clipping_color"));
+    font_shaders_[kFontShaderTypeMsdf][0].set(
+        matman_.LoadShader("shaders/font_msdf"));
+    font_shaders_[kFontShaderTypeMsdf][1].set(
+        matman_.LoadShader("shaders/font_clipping_msdf"));
 
     image_color_ = mathfu::kOnes4f;
     text_color_ = mathfu::kOnes4f;
@@ -229,80 +277,456 @@ class InternalState : public LayoutManager {
     }
   }
 
-  ~InternalState() { state = nullptr; }
+  ~InternalState() {
+    // Drop draws left by a render pass that didn't finish. Draws of world
+    // panels are kept until the last panel renders them.
+    if (!IsWorldPanel() || IsLastWorldPanel()) {
+      persistent_.draw_batcher_.Clear();
+      persistent_.draw_batcher_.ResetTransform();
+    }
+
+    // Add counters of the frame to the render state stats.
+    auto &stats = frame_stats_;
+    for (int i = 0; i < kFontShaderTypeCount; ++i) {
+      for (int j = 0; j < 2; ++j) {
+        stats.uniform_uploads +=
+            font_shaders_[i][j].uniform_uploads() +
+            font_instanced_shaders_[i][j].uniform_uploads();
+        stats.skipped_uniform_uploads +=
+            font_shaders_[i][j].skipped_uniform_uploads() +
+            font_instanced_shaders_[i][j].skipped_uniform_uploads();
+      }
+    }
+    auto &batcher = persistent_.draw_batcher_;
+    stats.draw_calls += batcher.get_draw_call_count() - batcher_draw_calls_;
+    stats.shader_binds +=
+        batcher.get_shader_bind_count() - batcher_shader_binds_;
+    stats.texture_binds +=
+        batcher.get_texture_bind_count() - batcher_texture_binds_;
+    // World panels of a frame add up to the stats of a single frame.
+    bool first = !IsWorldPanel() || world_panel_index_ == 0;
+    stats.frames = first ? 1 : 0;
+
+    auto &total = persistent_.render_state_stats_;
+    total.uniform_uploads += stats.uniform_uploads;
+    total.skipped_uniform_uploads += stats.skipped_uniform_uploads;
+    total.texture_binds += stats.texture_binds;
+    total.skipped_texture_binds += stats.skipped_texture_binds;
+    total.shader_binds += stats.shader_binds;
+    total.draw_calls += stats.draw_calls;
+    total.frames += stats.frames;
+    auto &frame = persistent_.frame_render_state_stats_;
+    if (first) {
+      frame = stats;
+    } else {
+      frame.uniform_uploads += stats.uniform_uploads;
+      frame.skipped_uniform_uploads += stats.skipped_uniform_uploads;
+      frame.texture_binds += stats.texture_binds;
+      frame.skipped_texture_binds += stats.skipped_texture_binds;
+      frame.shader_binds += stats.shader_binds;
+      frame.draw_calls += stats.draw_calls;
+    }
+    state = nullptr;
+  }
+
+  static RenderStateStats &render_state_stats() {
+    return persistent_.render_state_stats_;
+  }
+
+  static const RenderStateStats &frame_render_state_stats() {
+    return persistent_.frame_render_state_stats_;
+  }
+
+  static uint32_t layout_allocation_count() {
+    return persistent_.layout_storage_.allocation_count;
+  }
+
+  static const RenderCacheStats &render_cache_stats() {
+    return persistent_.render_cache_stats_;
+  }
 
   // Override the use of a default projection matrix and canvas size.
   void UseExistingProjection(const vec2i &canvas_size) {
+    FlushDrawBatch();
     canvas_size_ = canvas_size;
     default_projection_ = false;
   }
 
   void ApplyCustomTransform(const mat4 &imvp) {
-    if (layout_pass_) {
-      for (int i = 0; i <= pointer_max_active_index_; i++) {
-        auto clip_pos =
-            vec2(pointer_pos_[i]) / vec2(renderer_.window_size()) * 2.0f - 1.0f;
-        clip_pos.y *= -1;  // Mouse coords are LH, clip space is RH.
-        // Get two 3d positions at the pointer position to form a ray
-        auto obj_pos1 = imvp * vec4(vec2(clip_pos), vec2(-0.5f, 1.0f));
-        auto obj_pos2 = imvp * vec4(vec2(clip_pos), vec2(0.5f, 1.0f));
-        // (inverse) perspective divide.
-        obj_pos1 /= obj_pos1.w;
-        obj_pos2 /= obj_pos2.w;
-        auto ray = obj_pos2 - obj_pos1;
-        // Find where the ray intersects object-space plane Z=0.
-        auto t = (0.0f - obj_pos1.z) / ray.z;
-        auto on_plane = t * ray.xy() + obj_pos1.xy();
-        pointer_pos_[i] = vec2i(on_plane + 0.5f);
-        // Back into LH UI pixels.
-        pointer_pos_[i].y = canvas_size_.y - pointer_pos_[i].y;
-        // TODO(wvo): transform delta relative to current pointer_pos_ ?
+    FlushDrawBatch();
+    // Pointers are transformed in the first pass, which is the render pass
+    // when the layout is retained.
+    if (layout_pass_ || layout_retained_) TransformPointers(imvp, true);
+  }
+
+  // Map pointers onto the plane Z=0 of the object space of `imvp`, the inverse
+  // model-view-projection matrix. Object space is converted into UI pixels by
+  // flipping Y if `flip_y` is true.
+  void TransformPointers(const mat4 &imvp, bool flip_y) {
+    for (int i = 0; i <= pointer_max_active_index_; i++) {
+      auto clip_pos =
+          vec2(pointer_pos_[i]) / vec2(renderer_.window_size()) * 2.0f - 1.0f;
+      clip_pos.y *= -1;  // Mouse coords are LH, clip space is RH.
+      // Get two 3d positions at the pointer position to form a ray
+      auto obj_pos1 = imvp * vec4(vec2(clip_pos), vec2(-0.5f, 1.0f));
+      auto obj_pos2 = imvp * vec4(vec2(clip_pos), vec2(0.5f, 1.0f));
+      // (inverse) perspective divide.
+      obj_pos1 /= obj_pos1.w;
+      obj_pos2 /= obj_pos2.w;
+      auto ray = obj_pos2 - obj_pos1;
+      // Find where the ray intersects object-space plane Z=0.
+      auto t = (0.0f - obj_pos1.z) / ray.z;
+      auto on_plane = t * ray.xy() + obj_pos1.xy();
+      pointer_pos_[i] = vec2i(on_plane + 0.5f);
+      // Back into LH UI pixels.
+      if (flip_y) pointer_pos_[i].y = canvas_size_.y - pointer_pos_[i].y;
+      // TODO(wvo): transform delta relative to current pointer_pos_ ?
+    }
+  }
+
+  // Set up the state to lay out and render a world panel, which is the
+  // `index`th of `count` panels rendered in a row.
+  void SetWorldPanel(const WorldPanel &panel, const mat4 &view_projection,
+                     size_t index, size_t count) {
+    world_panel_index_ = index;
+    world_panel_count_ = count;
+    world_transform_ = panel.transform;
+    world_view_projection_ = view_projection;
+    canvas_size_ = panel.canvas_size;
+    default_projection_ = false;
+    retained_state_ = &persistent_.panel_layouts_[panel.id];
+    retained_state_->used = true;
+    // Panel pixels are mapped into the world by the panel transform as is.
+    TransformPointers((view_projection * panel.transform).Inverse(), false);
+  }
+
+  bool IsWorldPanel() const { return world_panel_count_ != 0; }
+  bool IsLastWorldPanel() const {
+    return world_panel_index_ + 1 == world_panel_count_;
+  }
+
+  // Forget retained layouts of panels that weren't rendered in this frame.
+  static void FinishWorldPanels() {
+    auto &states = persistent_.panel_layouts_;
+    for (auto it = states.begin(); it != states.end();) {
+      if (it->second.used) {
+        it->second.used = false;
+        ++it;
+      } else {
+        it = states.erase(it);
       }
     }
   }
 
   void SetDepthTest(bool enable) { depth_test_ = enable; }
 
+  void EnableDrawBatching(bool enable) {
+    // Draws collected so far are rendered before the setting changes.
+    if (!enable) FlushDrawBatch();
+    draw_batching_ = enable;
+  }
+
+  // Render draws deferred by the draw batching. This needs to be called before
+  // anything changing render states shared by the draws, such as the scissor
+  // rect and the projection, and before rendering outside of FlatUI.
+  void FlushDrawBatch() {
+    if (!persistent_.draw_batcher_.empty()) {
+      // Recorded draws can't be compared once they are rendered, so the
+      // frame is rendered into the render cache from here.
+      if (render_cache_state_ == kRenderCacheRecording) BeginRenderCache();
+      if (IsWorldPanel()) {
+        // Vertices of world panels are in world space.
+        auto mvp = renderer_.model_view_projection();
+        renderer_.set_model_view_projection(world_view_projection_);
+        persistent_.draw_batcher_.Flush(&renderer_);
+        renderer_.set_model_view_projection(mvp);
+      } else {
+        persistent_.draw_batcher_.Flush(&renderer_);
+      }
+      InvalidateTextureBinding();
+    }
+  }
+
+  // Prepare for a draw that is not deferred by the draw batcher.
+  void FlushForImmediateDraw() {
+    if (render_cache_state_ == kRenderCacheRecording) BeginRenderCache();
+    FlushDrawBatch();
+  }
+
+  // Check if draws need to be deferred to the draw batcher.
+  bool DeferDraws() const {
+    return draw_batching_ || render_cache_state_ == kRenderCacheRecording ||
+           IsWorldPanel();
+  }
+
+  static void EnableRenderCache(bool enable) {
+    persistent_.render_cache_enabled_ = enable;
+    if (!enable) persistent_.render_cache_.Release();
+  }
+
+  static void InvalidateRenderCache() {
+    persistent_.render_cache_.Invalidate();
+  }
+
+  // Start rendering elements into the render cache.
+  void BeginRenderCache() {
+    render_cache_state_ = kRenderCacheOff;
+    saved_projection_ = renderer_.model_view_projection();
+    if (!persistent_.render_cache_.Begin(canvas_size_)) return;
+    render_cache_state_ = kRenderCacheRendering;
+    // Render with pixel coordinates of the canvas into the cache.
+    renderer_.set_model_view_projection(mathfu::mat4::Ortho(
+        0.0f, static_cast<float>(canvas_size_.x),
+        static_cast<float>(canvas_size_.y), 0.0f, -1.0f, 1.0f));
+  }
+
+  // Calculate a hash of the frame recorded in the draw batcher.
+  size_t RenderCacheHash() const {
+    auto hash = persistent_.draw_batcher_.Hash();
+    hash = HashCombine(hash, canvas_size_.x);
+    hash = HashCombine(hash, canvas_size_.y);
+    return HashCombine(hash, fontman_.GetAtlasRevision());
+  }
+
+  // Finish the render pass, rendering deferred draws and the render cache.
+  void FinishRenderPass() {
+    size_t hash = 0;
+    bool reusable = false;
+    if (render_cache_state_ == kRenderCacheRecording) {
+      hash = RenderCacheHash();
+      if (persistent_.render_cache_.IsValid(canvas_size_, hash)) {
+        // Same content as the cache, drop the recorded draws.
+        persistent_.draw_batcher_.Clear();
+        persistent_.render_cache_stats_.hits++;
+      } else {
+        BeginRenderCache();
+        reusable = true;
+      }
+    }
+
+    // Draws of world panels are merged with the following panels.
+    if (!IsWorldPanel() || IsLastWorldPanel()) FlushDrawBatch();
+
+    if (render_cache_state_ == kRenderCacheRendering) {
+      persistent_.render_cache_stats_.misses++;
+      persistent_.render_cache_.End(hash);
+      // A frame with immediate draws can't be verified to be the same.
+      if (!reusable) persistent_.render_cache_.Invalidate();
+      renderer_.set_model_view_projection(saved_projection_);
+    }
+
+    if (render_cache_state_ != kRenderCacheOff) {
+      // Draw the cached UI as a single quad.
+      renderer_.SetBlendMode(fplbase::kBlendModePreMultipliedAlpha);
+      renderer_.set_color(mathfu::kOnes4f);
+      renderer_.SetShader(image_shader_);
+      persistent_.render_cache_.BindTexture();
+      InvalidateTextureBinding();
+      fplbase::RenderAAQuadAlongX(mathfu::kZeros3f,
+                                  vec3(vec2(canvas_size_), 0.0f),
+                                  vec2(0.0f, 1.0f), vec2(1.0f, 0.0f));
+      frame_stats_.shader_binds++;
+      frame_stats_.texture_binds++;
+      frame_stats_.draw_calls++;
+      renderer_.SetBlendMode(fplbase::kBlendModeAlpha);
+      render_cache_state_ = kRenderCacheOff;
+    }
+  }
+
+  // Bind a texture to the texture unit 0, unless it's bound already.
+  void BindTexture(const Texture *tex) {
+    auto &stats = frame_stats_;
+    if (tex == bound_texture_) {
+      stats.skipped_texture_binds++;
+      return;
+    }
+    tex->Set(0);
+    bound_texture_ = tex;
+    stats.texture_binds++;
+  }
+
+  // Forget the bound texture after something outside of BindTexture() may
+  // have changed the binding.
+  void InvalidateTextureBinding() { bound_texture_ = nullptr; }
+
   // Set up an ortho camera for all 2D elements, with (0, 0) in the top left,
   // and the bottom right the windows size in pixels.
   // This is currently hardcoded to use overlay on top of the entire GL window.
   // If that ever changes, we also need to change our use of glScissor below.
   void SetOrtho() {
+    FlushDrawBatch();
     auto ortho_mat = mathfu::mat4::Ortho(
         0.0f, static_cast<float>(canvas_size_.x),
         static_cast<float>(canvas_size_.y), 0.0f, -1.0f, 1.0f);
     renderer_.set_model_view_projection(ortho_mat);
   }
 
+  static void EnableRetainedLayout(bool enable) {
+    persistent_.retained_layout_ = enable;
+    if (!enable) {
+      persistent_.screen_layout_ = RetainedLayoutState();
+      persistent_.panel_layouts_.clear();
+    }
+  }
+
+  static void InvalidateLayout() {
+    persistent_.screen_layout_.invalidated = true;
+    auto &states = persistent_.panel_layouts_;
+    for (auto it = states.begin(); it != states.end(); ++it) {
+      it->second.invalidated = true;
+    }
+  }
+
+  static void EnableSpatialNavigation(bool enable) {
+    persistent_.spatial_navigation_ = enable;
+    if (!enable) persistent_.spatial_index_ = SpatialIndex();
+  }
+
+  // Check if the layout retained from an earlier frame is still valid for
+  // this frame. Any input, running animation or sprite may change the layout.
+  bool CanRetainLayout() const {
+    auto &retained = *retained_state_;
+    if (!persistent_.retained_layout_ || !retained.stable ||
+        retained.invalidated) {
+      return false;
+    }
+    auto window_size = renderer_.window_size();
+    if (window_size.x != retained.window_size.x ||
+        window_size.y != retained.window_size.y) {
+      return false;
+    }
+    if (!input_idle_ || !persistent_.is_last_event_pointer_type ||
+        persistent_.input_capture_ != kNullHash ||
+        persistent_.mouse_capture_ != kNullHash ||
+        persistent_.dragging_pointer_ != kPointerIndexInvalid) {
+      return false;
+    }
+    if (!persistent_.sprites.empty()) return false;
+    for (auto it = persistent_.animations.begin();
+         it != persistent_.animations.end(); ++it) {
+      if (it->motivator.TargetTime() > 0) return false;
+    }
+    return true;
+  }
+
+  // Reuse the layout of an earlier frame instead of running the layout pass,
+  // if possible. Returns true if the layout has been restored.
+  bool RestoreLayout() {
+    bool retain = CanRetainLayout();
+    // Events fired in this frame invalidate the layout of the next frame.
+    auto &retained = *retained_state_;
+    retained.invalidated = false;
+    if (!retain) return false;
+
+    elements_ = retained.elements;
+    canvas_size_ = retained.canvas_size;
+    virtual_resolution_ = retained.virtual_resolution;
+    pixel_scale_ = retained.pixel_scale;
+    default_projection_ = retained.default_projection;
+    depth_test_ = retained.depth_test;
+    layout_retained_ = true;
+    return true;
+  }
+
+  // Keep the layout computed in the layout pass for following frames. The
+  // layout is reused only once two layout passes in a row produced the same
+  // elements.
+  void RetainLayout() {
+    size_t hash = HashCombine<size_t>(0, elements_.size());
+    for (auto it = elements_.begin(); it != elements_.end(); ++it) {
+      hash = HashCombine(hash, it->hash);
+      hash = HashCombine(hash, it->size.x);
+      hash = HashCombine(hash, it->size.y);
+      hash = HashCombine(hash, it->extra_size.x);
+      hash = HashCombine(hash, it->extra_size.y);
+      hash = HashCombine(hash, it->interactive);
+    }
+    auto &retained = *retained_state_;
+    retained.stable = hash == retained.hash;
+    retained.hash = hash;
+    if (retained.stable) {
+      retained.elements = elements_;
+      retained.window_size = renderer_.window_size();
+      retained.canvas_size = canvas_size_;
+      retained.virtual_resolution = virtual_resolution_;
+      retained.pixel_scale = pixel_scale_;
+      retained.default_projection = default_projection_;
+      retained.depth_test = depth_test_;
+    }
+  }
+
+  // Drop the retained layout if the render pass didn't visit the same
+  // elements as the retained layout.
+  void FinishRetainedLayout() {
+    if (!layout_retained_) return;
+    if (element_mismatch_ ||
+        (!elements_.empty() && element_it_ + 1 != elements_.end())) {
+      retained_state_->stable = false;
+    }
+  }
+
   // Switch from the layout pass to the render pass.
   void StartRenderPass() {
+    if (persistent_.retained_layout_ && !layout_retained_) RetainLayout();
+
     // Do nothing if there is no elements.
     if (!StartSecondPass()) return;
 
     // Update font manager if they need to upload font atlas texture.
     fontman_.StartRenderPass();
+    InvalidateTextureBinding();
 
     CheckGamePadNavigation();
+    if (persistent_.spatial_navigation_) {
+      persistent_.spatial_index_.Clear(canvas_size_);
+    }
 
     if (default_projection_) SetOrtho();
+
+    if (IsWorldPanel()) {
+      // Immediate draws are rendered with the panel transform, and deferred
+      // draws are transformed into world space as they are added.
+      renderer_.set_model_view_projection(world_view_projection_ *
+                                          world_transform_);
+      persistent_.draw_batcher_.SetTransform(world_transform_,
+                                             world_view_projection_);
+    }
+
+    // Record the frame to compare it with the render cache. UIs with depth
+    // test are placed in 3D, and can't be cached without depth.
+    if (persistent_.render_cache_enabled_ && !depth_test_ && !IsWorldPanel()) {
+      render_cache_state_ = kRenderCacheRecording;
+    }
   }
 
-  void RenderQuad(Shader *sh, const vec4 &color, const vec2i &pos,
-                  const vec2i &size, const vec4 &uv) {
+  // Render a quad with a shader and an optional texture.
+  void RenderQuad(Shader *sh, const Texture *tex, const vec4 &color,
+                  const vec2i &pos, const vec2i &size, const vec4 &uv) {
+    if (DeferDraws()) {
+      persistent_.draw_batcher_.AddQuad(sh, tex, color, pos, size, uv);
+      return;
+    }
+    if (tex) BindTexture(tex);
     renderer_.set_color(color);
     renderer_.SetShader(sh);
     fplbase::RenderAAQuadAlongX(vec3(vec2(pos), 0), vec3(vec2(pos + size), 0),
                                 uv.xy(), uv.zw());
+    frame_stats_.shader_binds++;
+    frame_stats_.draw_calls++;
+  }
+
+  void RenderQuad(Shader *sh, const Texture *tex, const vec4 &color,
+                  const vec2i &pos, const vec2i &size) {
+    RenderQuad(sh, tex, color, pos, size, vec4(0, 0, 1, 1));
   }
 
   void RenderQuad(Shader *sh, const vec4 &color, const vec2i &pos,
                   const vec2i &size) {
-    RenderQuad(sh, color, pos, size, vec4(0, 0, 1, 1));
+    RenderQuad(sh, nullptr, color, pos, size);
   }
 
   // An image element.
-  void Image(const Texture &texture, float ysize, const char *id) {
-    auto hash = HashId(id);
+  void Image(const Texture &texture, float ysize, HashedId hash) {
     if (layout_pass_) {
       auto virtual_image_size = vec2(
           texture.original_size().x * ysize / texture.original_size().y, ysize);
@@ -314,8 +738,7 @@ class InternalState : public LayoutManager {
     } else {
       auto element = NextElement(hash);
       if (element) {
-        texture.Set(0);
-        RenderQuad(image_shader_, image_color_, Position(*element),
+        RenderQuad(image_shader_, &texture, image_color_, Position(*element),
                    element->size);
         Advance(element->size);
       }
@@ -323,9 +746,9 @@ class InternalState : public LayoutManager {
   }
 
   Event Edit(float ysize, const mathfu::vec2 &edit_size,
-             TextAlignment alignment, const char *id, EditStatus *status,
+             TextAlignment alignment, HashedId hash, EditStatus *status,
              std::string *text) {
-    auto hash = HashId(id);
+    FLATUI_TRACE_SCOPE("FlatUI::Edit", hash);
     StartGroup(GetDirection(kLayoutHorizontalBottom),
                GetAlignment(kLayoutHorizontalBottom), 0, hash);
     EditStatus edit_status = kEditStatusNone;
@@ -360,9 +783,32 @@ class InternalState : public LayoutManager {
         enable_hyphenation_,
         fontman_.GetLayoutDirection() == kTextLayoutDirectionRTL,
         text_kerning_scale_, text_line_height_scale_);
-    auto buffer =
-        fontman_.GetBuffer(ui_text->c_str(), ui_text->length(), parameter);
+    FontBuffer *buffer = nullptr;
+    if (edit_status == kEditStatusInEdit &&
+        !(parameter == persistent_.edit_parameter_) &&
+        parameter.HasSameLayout(persistent_.edit_parameter_)) {
+      // The text has been edited. Find the first changed character and
+      // relayout lines from there.
+      auto &edit_text = persistent_.edit_text_;
+      size_t edit_start = 0;
+      while (edit_start < edit_text.length() &&
+             edit_start < ui_text->length() &&
+             edit_text[edit_start] == (*ui_text)[edit_start]) {
+        ++edit_start;
+      }
+      buffer = fontman_.EditBuffer(persistent_.edit_parameter_,
+                                   ui_text->c_str(), ui_text->length(),
+                                   parameter, edit_start);
+    } else {
+      buffer =
+          fontman_.GetBuffer(ui_text->c_str(), ui_text->length(), parameter);
+    }
     assert(buffer);
+    if (edit_status == kEditStatusInEdit &&
+        !(parameter == persistent_.edit_parameter_)) {
+      persistent_.edit_text_ = *ui_text;
+      persistent_.edit_parameter_ = parameter;
+    }
 
     // Check if the editbox is an auto expanding edit box.
     if (physical_label_size.x == 0) {
@@ -516,6 +962,7 @@ class InternalState : public LayoutManager {
 
   void Label(const char *text, float ysize, const vec2 &label_size,
              TextAlignment alignment, HashedId label_id = kNullHash) {
+    FLATUI_TRACE_SCOPE("FlatUI::Label", label_id);
     auto parameter = CalculateLabelFontBufferParameters(text, ysize, label_size,
                                                         alignment, kNullHash);
 
@@ -527,9 +974,10 @@ class InternalState : public LayoutManager {
   }
 
   void HtmlLabel(const char *html, float ysize, const mathfu::vec2 &label_size,
-                 TextAlignment alignment, const char *id) {
+                 TextAlignment alignment, HashedId hash) {
+    FLATUI_TRACE_SCOPE("FlatUI::HtmlLabel", hash);
     auto parameter = CalculateLabelFontBufferParameters(html, ysize, label_size,
-                                                        alignment, HashId(id));
+                                                        alignment, hash);
 
     // Set text color.
     renderer_.set_color(text_color_);
@@ -539,47 +987,87 @@ class InternalState : public LayoutManager {
     Label(*buffer, parameter, vec4i(vec2i(0, 0), buffer->get_size()));
   }
 
+  // Retrieve a shader drawing glyph instances, loading the shaders at the
+  // first call.
+  FontShader *GetInstancedFontShader(FontShaderType type, bool clipping) {
+    if (!instanced_shaders_loaded_) {
+      static const char *kShaderNames[kFontShaderTypeCount][2] = {
+          {"shaders/font_instanced", "shaders/font_clipping_instanced"},
+          {"shaders/font_sdf_instanced",
+           "shaders/font_clipping_sdf_instanced"},
+          {"shaders/font_color_instanced",
+           "shaders/font_clipping_color_instanced"},
+          {"shaders/font_msdf_instanced",
+           "shaders/font_clipping_msdf_instanced"},
+      };
+      for (int i = 0; i < kFontShaderTypeCount; ++i) {
+        for (int j = 0; j < 2; ++j) {
+          font_instanced_shaders_[i][j].set(
+              matman_.LoadShader(kShaderNames[i][j]));
+        }
+      }
+      instanced_shaders_loaded_ = true;
+    }
+    return &font_instanced_shaders_[type][clipping ? 1 : 0];
+  }
+
   void DrawFontBuffer(const FontBuffer &buffer, const vec2 &pos,
                       const mathfu::vec4 &clip_rect, bool use_sdf,
                       bool render_outer_color) {
     auto &slices = buffer.get_slices();
-    auto current_format = fplbase::kFormatAuto;
+    // Format bits of the current slice, which select a shader.
+    uint32_t current_format = ~0U;
     bool clipping = clip_rect.z != 0.0f && clip_rect.w != 0.0f;
+    // The clip rect of glyphs is in pixels, and isn't transformed with
+    // vertices of a world panel.
+    bool defer_draws = DeferDraws() && !(IsWorldPanel() && clipping);
+    if (!defer_draws && IsWorldPanel()) FlushForImmediateDraw();
     FontShader *current_shader = nullptr;
     vec4 color = mathfu::kZeros4f;
 
+    float threshold = 0.0f;
+
     for (size_t i = 0; i < slices.size(); ++i) {
       auto texture = fontman_.GetAtlasTexture(slices.at(i).get_slice_index());
-      texture->Set(0);
+      if (!defer_draws) BindTexture(texture);
 
-      if (current_format != texture->format()) {
-        current_format = texture->format();
+      auto format = slices.at(i).get_slice_index() & kGlyphFormatsMask;
+      if (current_format != format) {
+        current_format = format;
 
         // Switch shaders based on drawing conditions.
         FontShaderType shader_type =
-            current_format == fplbase::kFormat8888
+            format == kGlyphFormatsColor
                 ? kFontShaderTypeColor
-                : use_sdf ? kFontShaderTypeSdf : kFontShaderTypeDefault;
+                : format == kGlyphFormatsMultiChannelSDF
+                      ? kFontShaderTypeMsdf
+                      : use_sdf ? kFontShaderTypeSdf : kFontShaderTypeDefault;
 
         // Color glyph doesn't support outer_color.
         if (shader_type == kFontShaderTypeColor && render_outer_color) continue;
 
-        current_shader = &font_shaders_[shader_type][clipping ? 1 : 0];
-        current_shader->set_renderer(&renderer_);
+        // Deferred draws are batched with vertices, don't draw instances.
+        current_shader =
+            buffer.HasGlyphInstances() && !defer_draws
+                ? GetInstancedFontShader(shader_type, clipping)
+                : &font_shaders_[shader_type][clipping ? 1 : 0];
 
         // Set shader specific parameters.
         color = text_color_;
-        current_shader->set_position_offset(vec3(pos, 0.0f));
         if (use_sdf) {
           if (render_outer_color) {
             color = text_outer_color_;
-            current_shader->set_threshold(text_outer_color_size_);
+            threshold = text_outer_color_size_;
           } else {
-            current_shader->set_threshold(sdf_threshold_);
+            threshold = sdf_threshold_;
           }
         }
-        if (clipping) {
-          current_shader->set_clipping(clip_rect);
+        if (!defer_draws) {
+          current_shader->set_renderer(&renderer_);
+          frame_stats_.shader_binds++;
+          current_shader->set_position_offset(vec3(pos, 0.0f));
+          if (use_sdf) current_shader->set_threshold(threshold);
+          if (clipping) current_shader->set_clipping(clip_rect);
         }
       }
 
@@ -591,36 +1079,84 @@ class InternalState : public LayoutManager {
                        ((c & 0xff0000) >> 16) * 1.0f / 255.0f,
                        ((c & 0xff00) >> 8) * 1.0f / 255.0f,
                        (c & 0xff) * 1.0f / 255.0f);
-          current_shader->set_color(color);
-        } else {
-          // Use system set color.
-          current_shader->set_color(color);
         }
+        if (!defer_draws) current_shader->set_color(color);
       }
 
       const fplbase::Attribute kFormat[] = {
           fplbase::kPosition3f, fplbase::kTexCoord2f, fplbase::kEND};
-      auto &indices = buffer.get_indices(static_cast<int32_t>(i));
-      if (!indices.empty()) {
-        RenderArray(
-            Mesh::kTriangles, static_cast<int>(indices.size()), kFormat,
-            sizeof(FontVertex),
-            reinterpret_cast<const char *>(buffer.get_vertices().data()),
-            indices.data());
+      const fplbase::Attribute kPackedFormat[] = {
+          fplbase::kPosition2f, fplbase::kTexCoord2us, fplbase::kEND};
+      // Glyph ranges are rendered with the shared quad indices.
+      auto &ranges = buffer.get_glyph_ranges(static_cast<int32_t>(i));
+      if (ranges.empty()) {
+        // Nothing to draw.
+      } else if (defer_draws) {
+        // Defer the glyphs with the label position baked into the vertices.
+        // The clip rect is relative to the label, so it's moved as well.
+        auto glyph_clip_rect =
+            clipping ? clip_rect + vec4(pos, pos) : mathfu::kZeros4f;
+        persistent_.draw_batcher_.AddGlyphs(
+            current_shader, texture, color, glyph_clip_rect,
+            use_sdf ? threshold : 0.0f, vec3(pos, 0.0f), buffer.get_vertices(),
+            ranges);
+      } else if (buffer.HasGlyphInstances()) {
+        // Expand quads of glyph instances in the vertex shader.
+        auto vertex_buffer = buffer.GetVertexBuffer();
+        vertex_buffer->BindInstances();
+        for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+          vertex_buffer->DrawInstances(it->start, it->count);
+        }
+        vertex_buffer->UnbindInstances();
+        frame_stats_.draw_calls += static_cast<uint32_t>(ranges.size());
+      } else if (fontman_.VertexBuffersEnabled()) {
+        // Draw from the retained vertex buffer of the FontBuffer.
+        auto vertex_buffer = buffer.GetVertexBuffer();
+        vertex_buffer->Bind(buffer.HasPackedVertices());
+        for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+          vertex_buffer->Draw(it->start, it->count);
+        }
+        vertex_buffer->Unbind();
+        frame_stats_.draw_calls += static_cast<uint32_t>(ranges.size());
+      } else {
+        // Draws are rebased to the first vertex of the range, and split into
+        // draws addressable with the 16 bit quad indices.
+        auto quad_indices = GetQuadIndices();
+        auto packed = buffer.HasPackedVertices();
+        auto stride = packed ? sizeof(PackedFontVertex) : sizeof(FontVertex);
+        auto vertices =
+            packed ? reinterpret_cast<const char *>(
+                         buffer.get_packed_vertices().data())
+                   : reinterpret_cast<const char *>(
+                         buffer.get_vertices().data());
+        for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+          for (uint32_t start = 0; start < it->count;
+               start += kMaxQuadIndicesGlyphs) {
+            auto count = std::min(it->count - start, kMaxQuadIndicesGlyphs);
+            auto first_vertex = (it->start + start) * kVerticesPerGlyph;
+            RenderArray(Mesh::kTriangles,
+                        static_cast<int>(count * kIndicesPerGlyph),
+                        packed ? kPackedFormat : kFormat,
+                        static_cast<int>(stride),
+                        vertices + first_vertex * stride, quad_indices);
+            frame_stats_.draw_calls++;
+          }
+        }
       }
 
       if (slices.at(i).get_underline()) {
         // Draw underlines.
-        auto regions = slices.at(i).get_underline_info();
+        auto &regions = slices.at(i).get_underline_info();
         for (size_t i = 0; i < regions.size(); ++i) {
-          auto info = regions[i];
-          auto start_pos = buffer.get_vertices()
-                               .at(info.start_vertex_index_ * kVerticesPerGlyph)
-                               .position_;
-          auto end_pos = buffer.get_vertices()
-                             .at(info.end_vertex_index_ * kVerticesPerGlyph +
-                                 kVerticesPerGlyph - 1)
-                             .position_;
+          auto &info = regions[i];
+          auto &start_pos =
+              buffer.get_vertices()
+                  .at(info.start_vertex_index_ * kVerticesPerGlyph)
+                  .position_;
+          auto &end_pos = buffer.get_vertices()
+                              .at(info.end_vertex_index_ * kVerticesPerGlyph +
+                                  kVerticesPerGlyph - 1)
+                              .position_;
           auto p = vec2i(start_pos.data[0] + pos.x, info.y_pos_.x + pos.y);
           // NOTE: Use abs value for a size to account with RTL.
           auto size = vec2i(std::abs(end_pos.data[0] - start_pos.data[0]),
@@ -643,7 +1179,10 @@ class InternalState : public LayoutManager {
     } else {
       // Check if texture atlas needs to be updated.
       if (buffer.get_pass() > 0) {
+        // Glyphs of deferred draws may move when the atlas is updated.
+        FlushDrawBatch();
         fontman_.StartRenderPass();
+        InvalidateTextureBinding();
       }
 
       auto element = NextElement(hash);
@@ -667,7 +1206,8 @@ class InternalState : public LayoutManager {
           end.y -= buffer.metrics().external_leading();
 
           if (parameter.get_glyph_flags() &
-              (kGlyphFlagsInnerSDF | kGlyphFlagsOuterSDF)) {
+              (kGlyphFlagsInnerSDF | kGlyphFlagsOuterSDF |
+               kGlyphFlagsMultiChannelSDF)) {
             if (text_outer_color_size_ != 0.0f) {
               // Render shadow.
               DrawFontBuffer(buffer, vec2(pos) + text_outer_color_offset,
@@ -680,7 +1220,8 @@ class InternalState : public LayoutManager {
         } else {
           // Regular font rendering.
           if (parameter.get_glyph_flags() &
-              (kGlyphFlagsInnerSDF | kGlyphFlagsOuterSDF)) {
+              (kGlyphFlagsInnerSDF | kGlyphFlagsOuterSDF |
+               kGlyphFlagsMultiChannelSDF)) {
             if (text_outer_color_size_ != 0.0f) {
               // Render shadow.
               DrawFontBuffer(buffer, vec2(pos) + text_outer_color_offset,
@@ -706,20 +1247,43 @@ class InternalState : public LayoutManager {
   void RenderTexture(const Texture &tex, const vec2i &pos, const vec2i &size,
                      const vec4 &color) {
     if (!layout_pass_) {
-      tex.Set(0);
-      RenderQuad(image_shader_, color, pos, size);
+      RenderQuad(image_shader_, &tex, color, pos, size);
     }
   }
 
   void RenderTextureNinePatch(const Texture &tex, const vec4 &patch_info,
                               const vec2i &pos, const vec2i &size) {
     if (!layout_pass_) {
-      tex.Set(0);
+      // Nine patches are rendered right away, on top of earlier draws.
+      FlushForImmediateDraw();
+      BindTexture(&tex);
       renderer_.set_color(mathfu::kOnes4f);
       renderer_.SetShader(image_shader_);
       fplbase::RenderAAQuadAlongXNinePatch(vec3(vec2(pos), 0),
                                            vec3(vec2(pos + size), 0),
                                            tex.size(), patch_info);
+      frame_stats_.shader_binds++;
+      frame_stats_.draw_calls++;
+    }
+  }
+
+  // Generic element with user supplied renderer. The renderer may draw with
+  // any render states, so deferred draws are rendered before it.
+  void CustomElement(
+      const vec2 &virtual_size, HashedId hash,
+      const std::function<void(const vec2i &pos, const vec2i &size)> renderer) {
+    FLATUI_TRACE_SCOPE("FlatUI::CustomElement", hash);
+    if (!layout_pass_) FlushForImmediateDraw();
+    Element(virtual_size, hash, renderer);
+    if (!layout_pass_) {
+      // The renderer may bind textures and update uniforms of font shaders.
+      InvalidateTextureBinding();
+      for (int i = 0; i < kFontShaderTypeCount; ++i) {
+        font_shaders_[i][0].InvalidateState();
+        font_shaders_[i][1].InvalidateState();
+        font_instanced_shaders_[i][0].InvalidateState();
+        font_instanced_shaders_[i][1].InvalidateState();
+      }
     }
   }
 
@@ -751,6 +1315,7 @@ class InternalState : public LayoutManager {
       // placement use another technique alltogether (render to texture,
       // glClipPlane, or stencil buffer).
       assert(default_projection_);
+      FlushForImmediateDraw();
       renderer_.ScissorOn(
           vec2i(position_.x, canvas_size_.y - position_.y - psize.y), psize);
 
@@ -846,10 +1411,78 @@ class InternalState : public LayoutManager {
       for (int i = 0; i <= pointer_max_active_index_; i++) {
         clip_mouse_inside_[i] = true;
       }
+      FlushForImmediateDraw();
       renderer_.ScissorOff();
     }
   }
 
+  // A virtualized list in a scrolling group. Only items inside the scrolling
+  // window (plus a margin) are defined. Invisible items are replaced with
+  // spacers, so the scroll extents are the same as with all items.
+  // `item_start(i)` returns the physical position of the item i, with
+  // `item_start(count)` the total length of the items.
+  void VirtualListWithPositions(
+      const vec2 &size, vec2 *virtual_offset, int32_t count,
+      const std::function<int32_t(int32_t)> &item_start,
+      const std::function<void(int32_t index)> &item) {
+    // Find visible items with the offset before StartScroll() scrolls it in
+    // the render pass, so both passes define the same items.
+    auto offset = VirtualToPhysical(*virtual_offset).y;
+    auto window = VirtualToPhysical(size).y;
+    auto first = FindItem(count, item_start, offset, true);
+    auto last = FindItem(count, item_start, offset + window, false);
+    first = std::max(first - kVirtualListMarginItems, 0);
+    last = std::min(last + kVirtualListMarginItems, count);
+
+    auto spacing = spacing_;
+    StartScroll(size, virtual_offset);
+    auto hash = elements_[element_idx_].hash;
+    if (first > 0) {
+      Spacer(vec2i(0, item_start(first) - spacing), HashId("top", hash));
+    }
+    for (auto i = first; i < last; ++i) {
+      // Each item is at least as tall as given, to keep the spacers right.
+      auto item_hash =
+          HashId(reinterpret_cast<const char *>(&i), sizeof(i), hash);
+      StartGroup(kDirOverlay, kAlignLeft, 0, item_hash);
+      Spacer(vec2i(0, item_start(i + 1) - item_start(i) - spacing),
+             HashId("strut", item_hash));
+      StartGroup(kDirVertical, kAlignLeft, 0, HashId("item", item_hash));
+      item(i);
+      EndGroup();
+      EndGroup();
+    }
+    if (last < count) {
+      Spacer(vec2i(0, item_start(count) - item_start(last) - spacing),
+             HashId("bottom", hash));
+    }
+    EndScroll();
+  }
+
+  void VirtualList(const vec2 &size, vec2 *virtual_offset, int32_t count,
+                   float item_height,
+                   const std::function<void(int32_t index)> &item) {
+    auto pitch = VirtualToPhysical(vec2(0.0f, item_height)).y + spacing_;
+    VirtualListWithPositions(size, virtual_offset, count,
+                             [pitch](int32_t i) { return i * pitch; }, item);
+  }
+
+  void VirtualList(const vec2 &size, vec2 *virtual_offset, int32_t count,
+                   const std::function<float(int32_t index)> &item_height,
+                   const std::function<void(int32_t index)> &item) {
+    // Accumulate item positions to search them.
+    auto &starts = persistent_.virtual_list_starts_;
+    starts.resize(count + 1);
+    starts[0] = 0;
+    for (int32_t i = 0; i < count; ++i) {
+      starts[i + 1] = starts[i] +
+                      VirtualToPhysical(vec2(0.0f, item_height(i))).y +
+                      spacing_;
+    }
+    VirtualListWithPositions(size, virtual_offset, count,
+                             [&starts](int32_t i) { return starts[i]; }, item);
+  }
+
   void StartSlider(Direction direction, float scroll_margin, float *value) {
     auto event = CheckEvent(false);
     if (!layout_pass_) {
@@ -906,29 +1539,32 @@ class InternalState : public LayoutManager {
 
   void EndSlider() {}
 
-  // The hashmap stores the internal animation state for the API
+  // `animations` stores the internal animation state for the API
   // call to `Animatable(id)`. To conserve memory space, the
   // internal state for `id` will be removed if `Animatable(id)`
-  // was not called in the previous frame.
+  // was not called in the previous frame. Animations and sprites are
+  // compacted in place, keeping their order.
   void Clean() {
-    for (auto it = persistent_.animations.begin();
-         it != persistent_.animations.end();) {
-      if (it->second.called_last_frame) {
-        it->second.called_last_frame = false;
-        ++it;
-      } else {
-        it = persistent_.animations.erase(it);
-      }
+    auto &animations = persistent_.animations;
+    size_t num_animations = 0;
+    for (size_t i = 0; i < animations.size(); ++i) {
+      if (!animations[i].called_last_frame) continue;
+      animations[i].called_last_frame = false;
+      // Assigning transfers the motivator.
+      if (num_animations != i) animations[num_animations] = animations[i];
+      num_animations++;
     }
-    for (auto it = persistent_.sprites.begin();
-         it != persistent_.sprites.end();) {
-      if (it->called_last_frame) {
-        it->called_last_frame = false;
-        ++it;
-      } else {
-        it = persistent_.sprites.erase(it);
-      }
+    animations.erase(animations.begin() + num_animations, animations.end());
+
+    auto &sprites = persistent_.sprites;
+    size_t num_sprites = 0;
+    for (size_t i = 0; i < sprites.size(); ++i) {
+      if (!sprites[i].called_last_frame) continue;
+      sprites[i].called_last_frame = false;
+      if (num_sprites != i) sprites[num_sprites] = std::move(sprites[i]);
+      num_sprites++;
     }
+    sprites.erase(sprites.begin() + num_sprites, sprites.end());
     persistent_.pending_targets.clear();
   }
 
@@ -938,14 +1574,20 @@ class InternalState : public LayoutManager {
   // If no state currently exists for `id` because
   // `Animatable(id)` was not called the previous frame,
   // return nullptr.
+  // The returned pointer is valid until the next CreateAnim() or Clean().
   static Anim *FindAnim(HashedId id) {
-    auto it = persistent_.animations.find(id);
-    return it != persistent_.animations.end() ? &(it->second) : nullptr;
+    auto &animations = persistent_.animations;
+    auto it = std::lower_bound(animations.begin(), animations.end(), id);
+    return it != animations.end() && it->id == id ? &*it : nullptr;
   }
 
   Anim *CreateAnim(HashedId id, const float *starting_values,
                    const float *starting_velocities, int dimensions) {
-    Anim *anim = &persistent_.animations[id];
+    auto &animations = persistent_.animations;
+    auto it = animations.insert(
+        std::lower_bound(animations.begin(), animations.end(), id), Anim());
+    Anim *anim = &*it;
+    anim->id = id;
     anim->motivator.Initialize(
         motive::ConstInit(starting_values, starting_velocities), motive_engine_,
         dimensions);
@@ -1075,29 +1717,33 @@ class InternalState : public LayoutManager {
     return num_active_sprites;
   }
 
-  SequenceId AddSprite(const char *group_id,
-                       const std::function<bool(SequenceId seq)> &draw) {
+  SequenceId AddSprite(HashedId group_hash,
+                       std::function<bool(SequenceId seq)> &&draw) {
     assert(motive_engine_);
-    HashedId group_hash = HashId(group_id);
-    persistent_.sprites.push_back(
-        Sprite(draw, persistent_.sprite_sequence_number, false, group_hash));
+    persistent_.sprites.push_back(Sprite(std::move(draw),
+                                         persistent_.sprite_sequence_number,
+                                         false, group_hash));
     return persistent_.sprite_sequence_number++;
   }
 
-  void DrawSprites(const char *group_id) {
-    HashedId group_hash = HashId(group_id);
-    auto it = persistent_.sprites.begin();
-    while (it != persistent_.sprites.end()) {
-      if (it->group_hash == group_hash) {
-        bool done_drawing = it->draw(it->sequence_number);
-        if (done_drawing && !layout_pass_) {
-          it = persistent_.sprites.erase(it);
-          continue;
-        }
-        it->called_last_frame = true;
+  // Sprites done drawing are removed by compacting the vector in place.
+  // Draw functions may add sprites and grow the vector, so entries are
+  // accessed by index and each function is moved out while it runs.
+  void DrawSprites(HashedId group_hash) {
+    auto &sprites = persistent_.sprites;
+    size_t num_sprites = 0;
+    for (size_t i = 0; i < sprites.size(); ++i) {
+      if (sprites[i].group_hash == group_hash) {
+        auto draw = std::move(sprites[i].draw);
+        bool done_drawing = draw(sprites[i].sequence_number);
+        if (done_drawing && !layout_pass_) continue;
+        sprites[i].draw = std::move(draw);
+        sprites[i].called_last_frame = true;
       }
-      ++it;
+      if (num_sprites != i) sprites[num_sprites] = std::move(sprites[i]);
+      num_sprites++;
     }
+    sprites.erase(sprites.begin() + num_sprites, sprites.end());
   }
 
   // Set scroll speed of the scroll group.
@@ -1181,6 +1827,8 @@ class InternalState : public LayoutManager {
   }
 
   Event FireEvent(size_t element_idx, Event e) {
+    // Event handlers may change the layout of the next frame.
+    if (e & ~kEventHover) retained_state_->invalidated = true;
     latest_event_ = e;
     latest_event_element_idx_ = element_idx;
     if (global_listener_) global_listener_(elements_[element_idx].hash, e);
@@ -1209,6 +1857,9 @@ class InternalState : public LayoutManager {
       // Check if this is an inactive part of an overlay.
       if (element.interactive) {
         auto hash = element.hash;
+        if (persistent_.spatial_navigation_ && !check_dragevent_only) {
+          persistent_.spatial_index_.Insert(hash, position_, size_);
+        }
         // pointer_max_active_index_ is typically 0, so loop not expensive.
         for (int i = 0; i <= pointer_max_active_index_; i++) {
           if ((CanReceivePointerEvent(hash) && clip_mouse_inside_[i] &&
@@ -1333,7 +1984,8 @@ class InternalState : public LayoutManager {
 
   void CheckGamePadNavigation() {
     // Update state.
-    int dir = GetNavigationDirection();
+    auto dir2d = GetNavigationDirection2D();
+    int dir = dir2d.y ? dir2d.y : dir2d.x;
 
     // Gamepad/keyboard navigation only happens when the keyboard is not
     // captured.
@@ -1346,6 +1998,17 @@ class InternalState : public LayoutManager {
       CaptureInput(kNullHash, true);
     }
 
+    // In the spatial navigation mode, move to the nearest element in the
+    // direction, using the element rects of the last frame. The focus stays
+    // at the edge of the UI.
+    if (dir && persistent_.spatial_navigation_ &&
+        persistent_.spatial_index_.Contains(persistent_.input_focus_)) {
+      auto next = persistent_.spatial_index_.FindNeighbor(
+          persistent_.input_focus_, dir2d);
+      if (next != kNullHash) persistent_.input_focus_ = next;
+      return;
+    }
+
     // Now find the current element, and move to the next.
     if (dir) {
       for (auto it = elements_.begin(); it != elements_.end(); ++it) {
@@ -1436,8 +2099,7 @@ class InternalState : public LayoutManager {
 
   void ImageBackground(const Texture &tex) {
     if (!layout_pass_) {
-      tex.Set(0);
-      RenderQuad(image_shader_, mathfu::kOnes4f, position_, GroupSize());
+      RenderQuad(image_shader_, &tex, mathfu::kOnes4f, position_, GroupSize());
     }
   }
 
@@ -1452,6 +2114,12 @@ class InternalState : public LayoutManager {
     sdf_threshold_ = threshold;
   }
 
+  // Enable/Disable multi-channel SDF generation.
+  void EnableTextMultiChannelSDF(bool enable, float threshold) {
+    glyph_flags_ = enable ? kGlyphFlagsMultiChannelSDF : kGlyphFlagsNone;
+    sdf_threshold_ = threshold;
+  }
+
   // Enable/Disable hyphenation.
   void EnableTextHyphenation(bool enable) {
     enable_hyphenation_ = enable;
@@ -1517,12 +2185,109 @@ class InternalState : public LayoutManager {
  private:
   vec2i GetPointerDelta() { return pointer_delta_[0]; }
 
+  // An invisible element with a physical size.
+  void Spacer(const vec2i &size, HashedId hash) {
+    if (layout_pass_) {
+      NewElement(size, hash);
+      Extend(size);
+    } else {
+      auto element = NextElement(hash);
+      if (element) Advance(element->size);
+    }
+  }
+
+  // Binary search items of a VirtualList for a physical position. Returns the
+  // first item ending after `pos` if `end` is true, or the first item starting
+  // at or after `pos` otherwise. Returns `count` if there is none.
+  static int32_t FindItem(int32_t count,
+                          const std::function<int32_t(int32_t)> &item_start,
+                          int32_t pos, bool end) {
+    int32_t low = 0;
+    int32_t high = count;
+    while (low < high) {
+      auto mid = low + (high - low) / 2;
+      auto found = end ? item_start(mid + 1) > pos : item_start(mid) >= pos;
+      if (found) {
+        high = mid;
+      } else {
+        low = mid + 1;
+      }
+    }
+    return low;
+  }
+
   vec2i GetPointerPosition() { return pointer_pos_[0]; }
 
+  // A layout retained across frames. `stable` is set when the last two layout
+  // passes produced elements with the same `hash`. The elements and the states
+  // set in the layout pass are kept to be reused.
+  struct RetainedLayoutState {
+    RetainedLayoutState()
+        : invalidated(false),
+          stable(false),
+          used(false),
+          hash(0),
+          window_size(mathfu::kZeros2i),
+          canvas_size(mathfu::kZeros2i),
+          virtual_resolution(0.0f),
+          pixel_scale(0.0f),
+          default_projection(true),
+          depth_test(false) {}
+
+    bool invalidated;
+    bool stable;
+    // Set when a world panel was rendered in this frame.
+    bool used;
+    size_t hash;
+    std::vector<UIElement> elements;
+    vec2i window_size;
+    vec2i canvas_size;
+    float virtual_resolution;
+    float pixel_scale;
+    bool default_projection;
+    bool depth_test;
+  };
+
   bool default_projection_;
 
   bool depth_test_;
 
+  // If true, draws in the render pass are deferred to the draw batcher.
+  bool draw_batching_;
+
+  // If true, the layout pass is skipped and the layout of an earlier frame is
+  // used for the render pass.
+  bool layout_retained_;
+
+  // Retained layout used by this run, which is either the one of the screen
+  // UI or the one of a world panel.
+  RetainedLayoutState *retained_state_;
+
+  // World panel rendered in this run, if world_panel_count_ isn't 0.
+  size_t world_panel_index_;
+  size_t world_panel_count_;
+  mat4 world_transform_;
+  mat4 world_view_projection_;
+
+  // State of the render cache, and the projection to restore after rendering
+  // into the cache.
+  RenderCacheState render_cache_state_;
+  mat4 saved_projection_;
+
+  // If true, no pointer is active and no pointer moved in this frame.
+  bool input_idle_;
+
+  // The texture bound with BindTexture(), or nullptr if unknown.
+  const Texture *bound_texture_;
+
+  // Render state counters of the frame, and counters of the draw batcher at
+  // the start of the frame. They are added to the persistent counters when
+  // the frame finishes.
+  RenderStateStats frame_stats_;
+  int32_t batcher_draw_calls_;
+  int32_t batcher_shader_binds_;
+  int32_t batcher_texture_binds_;
+
   fplbase::AssetManager &matman_;
   fplbase::Renderer &renderer_;
   InputSystem &input_;
@@ -1530,6 +2295,10 @@ class InternalState : public LayoutManager {
   Shader *image_shader_;
   Shader *color_shader_;
   FontShader font_shaders_[kFontShaderTypeCount][2];
+  // Shaders expanding quads of glyph instances, loaded at the first draw of a
+  // FontBuffer with glyph instances.
+  FontShader font_instanced_shaders_[kFontShaderTypeCount][2];
+  bool instanced_shaders_loaded_;
   motive::MotiveEngine *motive_engine_;
 
   // Expensive rendering commands can check if they're inside this rect to
@@ -1587,7 +2356,10 @@ class InternalState : public LayoutManager {
     PersistentState()
         : is_last_event_pointer_type(true),
           initialized(false),
-          sprite_sequence_number(0) {
+          sprite_sequence_number(0),
+          retained_layout_(false),
+          render_cache_enabled_(false),
+          spatial_navigation_(false) {
       // This is effectively a global, so no memory allocation or other
       // complex initialization here.
       for (int i = 0; i < InputSystem::kMaxSimultanuousPointers; i++) {
@@ -1614,6 +2386,11 @@ class InternalState : public LayoutManager {
     // Simple text edit handler for an edit box.
     MicroEdit text_edit_;
 
+    // The text and the parameters of the FontBuffer last laid out for the
+    // edit box in edit, used to relayout lines after an edit only.
+    std::string edit_text_;
+    FontBufferParameters edit_parameter_;
+
     // Keep tracking a pointer position of a drag start.
     vec2i drag_start_position_;
     int32_t dragging_pointer_;
@@ -1624,8 +2401,8 @@ class InternalState : public LayoutManager {
     // If true, then InternalState has been initialized.
     bool initialized;
 
-    // HashMap for storing animations.
-    std::unordered_map<HashedId, Anim> animations;
+    // Animations sorted by their IDs.
+    std::vector<Anim> animations;
 
     // HashMap for storing animations.
     std::unordered_map<HashedId, PendingTarget> pending_targets;
@@ -1635,6 +2412,36 @@ class InternalState : public LayoutManager {
 
     // Variable to keep track of how many sprites have been added.
     SequenceId sprite_sequence_number;
+
+    // Draws deferred in the render pass. The batcher is kept across frames to
+    // reuse its vertex storage.
+    DrawBatcher draw_batcher_;
+
+    // Counters of render state changes, and counters of the last frame.
+    RenderStateStats render_state_stats_;
+    RenderStateStats frame_render_state_stats_;
+
+    // Retained layout mode, with the retained layout of the screen UI and
+    // the ones of world panels by their IDs.
+    bool retained_layout_;
+    RetainedLayoutState screen_layout_;
+    std::unordered_map<HashedId, RetainedLayoutState> panel_layouts_;
+
+    // Containers of the layout and of InternalState, kept across frames so
+    // that steady-state frames don't allocate memory for them.
+    LayoutStorage layout_storage_;
+    // Item positions of a VirtualList with variable item heights.
+    std::vector<int32_t> virtual_list_starts_;
+
+    // Render cache mode keeping the rendered UI in an offscreen texture.
+    bool render_cache_enabled_;
+    RenderCache render_cache_;
+    RenderCacheStats render_cache_stats_;
+
+    // Spatial navigation mode. Rects of interactive elements are collected in
+    // the render pass, and used to navigate in the next frame.
+    bool spatial_navigation_;
+    SpatialIndex spatial_index_;
   } persistent_;
 
   // Disable copy constructor.
@@ -1656,10 +2463,14 @@ void Run(fplbase::AssetManager &assetman, FontManager &fontman,
   state->Clean();
 
   // Run two passes, one for layout, one for rendering.
-  // First pass:
-  gui_definition();
+  // First pass, skipped when the layout of an earlier frame is retained:
+  if (!internal_state.RestoreLayout()) {
+    FLATUI_TRACE_SCOPE("FlatUI::LayoutPass", kNullHash);
+    gui_definition();
+  }
 
   // Second pass:
+  FLATUI_TRACE_SCOPE("FlatUI::RenderPass", kNullHash);
   internal_state.StartRenderPass();
 
   auto &renderer = assetman.renderer();
@@ -1670,6 +2481,11 @@ void Run(fplbase::AssetManager &assetman, FontManager &fontman,
 
   gui_definition();
 
+  // Render draws deferred by the draw batching and the render cache.
+  internal_state.FinishRenderPass();
+
+  internal_state.FinishRetainedLayout();
+
   internal_state.CheckGamePadFocus();
 }
 
@@ -1679,12 +2495,62 @@ void Run(fplbase::AssetManager &assetman, FontManager &fontman,
   Run(assetman, fontman, input, NULL, gui_definition);
 }
 
+void RunWorldPanels(fplbase::AssetManager &assetman, FontManager &fontman,
+                    fplbase::InputSystem &input,
+                    motive::MotiveEngine *motive_engine,
+                    const mathfu::mat4 &view_projection,
+                    const WorldPanel *panels, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    auto &panel = panels[i];
+    InternalState internal_state(assetman, fontman, input, motive_engine);
+    internal_state.SetWorldPanel(panel, view_projection, i, count);
+
+    // Animations of all panels are cleaned once per frame.
+    if (i == 0) state->Clean();
+
+    if (!internal_state.RestoreLayout()) {
+      FLATUI_TRACE_SCOPE("FlatUI::LayoutPass", panel.id);
+      panel.gui_definition();
+    }
+
+    FLATUI_TRACE_SCOPE("FlatUI::RenderPass", panel.id);
+    internal_state.StartRenderPass();
+
+    // Panels are drawn in their order without depth test.
+    auto &renderer = assetman.renderer();
+    renderer.SetBlendMode(fplbase::kBlendModeAlpha);
+    renderer.SetDepthFunction(fplbase::kDepthFunctionDisabled);
+
+    panel.gui_definition();
+
+    // Deferred draws of all panels are rendered by the last panel.
+    internal_state.FinishRenderPass();
+
+    internal_state.FinishRetainedLayout();
+
+    internal_state.CheckGamePadFocus();
+  }
+  InternalState::FinishWorldPanels();
+}
+
+void RunWorldPanels(fplbase::AssetManager &assetman, FontManager &fontman,
+                    fplbase::InputSystem &input,
+                    const mathfu::mat4 &view_projection,
+                    const WorldPanel *panels, size_t count) {
+  RunWorldPanels(assetman, fontman, input, NULL, view_projection, panels,
+                 count);
+}
+
 InternalState *Gui() {
   assert(state);
   return state;
 }
 
 void Image(const Texture &texture, float size, const char *id) {
+  Gui()->Image(texture, size, HashId(id));
+}
+
+void Image(const Texture &texture, float size, HashedId id) {
   Gui()->Image(texture, size, id);
 }
 
@@ -1709,16 +2575,32 @@ void Label(const char *text, float font_size, const vec2 &size,
 
 void HtmlLabel(const char *html, float ysize, const mathfu::vec2 &label_size,
                TextAlignment alignment, const char *id) {
+  Gui()->HtmlLabel(html, ysize, label_size, alignment, HashId(id));
+}
+
+void HtmlLabel(const char *html, float ysize, const mathfu::vec2 &label_size,
+               TextAlignment alignment, HashedId id) {
   Gui()->HtmlLabel(html, ysize, label_size, alignment, id);
 }
 
 Event Edit(float ysize, const mathfu::vec2 &size, const char *id,
            EditStatus *status, std::string *string) {
+  return Gui()->Edit(ysize, size, kTextAlignmentLeft, HashId(id), status,
+                     string);
+}
+
+Event Edit(float ysize, const mathfu::vec2 &size, HashedId id,
+           EditStatus *status, std::string *string) {
   return Gui()->Edit(ysize, size, kTextAlignmentLeft, id, status, string);
 }
 
 Event Edit(float ysize, const mathfu::vec2 &size, TextAlignment alignment,
            const char *id, EditStatus *status, std::string *string) {
+  return Gui()->Edit(ysize, size, alignment, HashId(id), status, string);
+}
+
+Event Edit(float ysize, const mathfu::vec2 &size, TextAlignment alignment,
+           HashedId id, EditStatus *status, std::string *string) {
   return Gui()->Edit(ysize, size, alignment, id, status, string);
 }
 
@@ -1727,6 +2609,10 @@ void StartGroup(Layout layout, float spacing, const char *id) {
                     HashId(id));
 }
 
+void StartGroup(Layout layout, float spacing, HashedId id) {
+  Gui()->StartGroup(GetDirection(layout), GetAlignment(layout), spacing, id);
+}
+
 void EndGroup() { Gui()->EndGroup(); }
 
 void SetMargin(const Margin &margin) { Gui()->SetMargin(margin); }
@@ -1737,6 +2623,18 @@ void StartScroll(const vec2 &size, vec2 *offset) {
 
 void EndScroll() { Gui()->EndScroll(); }
 
+void VirtualList(const vec2 &size, vec2 *offset, int32_t item_count,
+                 float item_height,
+                 const std::function<void(int32_t index)> &item) {
+  Gui()->VirtualList(size, offset, item_count, item_height, item);
+}
+
+void VirtualList(const vec2 &size, vec2 *offset, int32_t item_count,
+                 const std::function<float(int32_t index)> &item_height,
+                 const std::function<void(int32_t index)> &item) {
+  Gui()->VirtualList(size, offset, item_count, item_height, item);
+}
+
 void StartSlider(Direction direction, float scroll_margin, float *value) {
   Gui()->StartSlider(direction, scroll_margin, value);
 }
@@ -1746,7 +2644,13 @@ void EndSlider() { Gui()->EndSlider(); }
 void CustomElement(
     const vec2 &virtual_size, const char *id,
     const std::function<void(const vec2i &pos, const vec2i &size)> renderer) {
-  Gui()->Element(virtual_size, id, renderer);
+  Gui()->CustomElement(virtual_size, HashId(id), renderer);
+}
+
+void CustomElement(
+    const vec2 &virtual_size, HashedId id,
+    const std::function<void(const vec2i &pos, const vec2i &size)> renderer) {
+  Gui()->CustomElement(virtual_size, id, renderer);
 }
 
 void RenderTexture(const Texture &tex, const vec2i &pos, const vec2i &size) {
@@ -1767,6 +2671,10 @@ void EnableTextSDF(bool inner_sdf, bool outer_sdf, float threshold) {
   Gui()->EnableTextSDF(inner_sdf, outer_sdf, threshold);
 }
 
+void EnableTextMultiChannelSDF(bool enable, float threshold) {
+  Gui()->EnableTextMultiChannelSDF(enable, threshold);
+}
+
 void EnableTextHyphenation(bool enable) {
   Gui()->EnableTextHyphenation(enable);
 }
@@ -1840,6 +2748,44 @@ void UseExistingProjection(const vec2i &canvas_size) {
 
 void SetDepthTest(bool enable) { Gui()->SetDepthTest(enable); }
 
+void EnableDrawBatching(bool enable) { Gui()->EnableDrawBatching(enable); }
+
+const RenderStateStats &GetRenderStateStats() {
+  return InternalState::render_state_stats();
+}
+
+const RenderStateStats &GetFrameRenderStateStats() {
+  return InternalState::frame_render_state_stats();
+}
+
+void EnableRetainedLayout(bool enable) {
+  InternalState::EnableRetainedLayout(enable);
+}
+
+void InvalidateLayout() { InternalState::InvalidateLayout(); }
+
+void EnableSpatialNavigation(bool enable) {
+  InternalState::EnableSpatialNavigation(enable);
+}
+
+void EnableRenderCache(bool enable) {
+  InternalState::EnableRenderCache(enable);
+}
+
+void InvalidateRenderCache() { InternalState::InvalidateRenderCache(); }
+
+uint32_t GetLayoutAllocationCount() {
+  return InternalState::layout_allocation_count();
+}
+
+const RenderCacheStats &GetRenderCacheStats() {
+  return InternalState::render_cache_stats();
+}
+
+void ResetRenderStateStats() {
+  InternalState::render_state_stats() = RenderStateStats();
+}
+
 mathfu::vec2i VirtualToPhysical(const mathfu::vec2 &v) {
   return Gui()->VirtualToPhysical(v);
 }
@@ -1854,6 +2800,8 @@ void CapturePointer(const char *element_id) {
   Gui()->CapturePointer(HashId(element_id));
 }
 
+void CapturePointer(HashedId element_id) { Gui()->CapturePointer(element_id); }
+
 void ReleasePointer() { Gui()->CapturePointer(kNullHash); }
 
 void SetScrollSpeed(float scroll_speed_drag, float scroll_speed_wheel,
@@ -1908,10 +2856,16 @@ double AnimationTimeRemaining(HashedId id) {
 int NumActiveSprites(HashedId id) { return Gui()->NumActiveSprites(id);}
 
 SequenceId AddSprite(const char *id,
-                     const std::function<bool(SequenceId seq)> &draw) {
-  return Gui()->AddSprite(id, draw);
+                     std::function<bool(SequenceId seq)> draw) {
+  return Gui()->AddSprite(HashId(id), std::move(draw));
 }
 
-void DrawSprites(const char *id) { Gui()->DrawSprites(id); }
+SequenceId AddSprite(HashedId id, std::function<bool(SequenceId seq)> draw) {
+  return Gui()->AddSprite(id, std::move(draw));
+}
+
+void DrawSprites(const char *id) { Gui()->DrawSprites(HashId(id)); }
+
+void DrawSprites(HashedId id) { Gui()->DrawSprites(id); }
 
 }  // namespace flatui
@@ -41,6 +41,11 @@ void EventBackground(Event event) {
 
 Event ImageButton(const Texture &texture, float size, const Margin &margin,
                   const char *id) {
+  return ImageButton(texture, size, margin, HashId(id));
+}
+
+Event ImageButton(const Texture &texture, float size, const Margin &margin,
+                  HashedId id) {
   StartGroup(kLayoutVerticalLeft, size, id);
   SetMargin(margin);
   auto event = CheckEvent();
@@ -53,6 +58,12 @@ Event ImageButton(const Texture &texture, float size, const Margin &margin,
 Event ToggleImageButton(const fplbase::Texture &up_texture,
                           const fplbase::Texture &down_texture,
                           float size, const Margin &margin, const char *id) {
+  return ToggleImageButton(up_texture, down_texture, size, margin, HashId(id));
+}
+
+Event ToggleImageButton(const fplbase::Texture &up_texture,
+                        const fplbase::Texture &down_texture, float size,
+                        const Margin &margin, HashedId id) {
   StartGroup(kLayoutVerticalLeft, size, id);
   SetMargin(margin);
   auto event = CheckEvent();
@@ -129,6 +140,11 @@ Event CheckBox(const Texture &texture_checked, const Texture &texture_unchecked,
 
 Event Slider(const Texture &tex_bar, const Texture &tex_knob, const vec2 &size,
              float bar_height, const char *id, float *slider_value) {
+  return Slider(tex_bar, tex_knob, size, bar_height, HashId(id), slider_value);
+}
+
+Event Slider(const Texture &tex_bar, const Texture &tex_knob, const vec2 &size,
+             float bar_height, HashedId id, float *slider_value) {
   StartGroup(kLayoutHorizontalBottom, 0, id);
   StartSlider(kDirHorizontal, size.y * 0.5f, slider_value);
   auto event = CheckEvent();
@@ -160,6 +176,13 @@ Event Slider(const Texture &tex_bar, const Texture &tex_knob, const vec2 &size,
 Event ScrollBar(const Texture &tex_background, const Texture &tex_foreground,
                 const vec2 &size, float bar_size, const char *id,
                 float *scroll_value) {
+  return ScrollBar(tex_background, tex_foreground, size, bar_size, HashId(id),
+                   scroll_value);
+}
+
+Event ScrollBar(const Texture &tex_background, const Texture &tex_foreground,
+                const vec2 &size, float bar_size, HashedId id,
+                float *scroll_value) {
   StartGroup(kLayoutHorizontalBottom, 0, id);
   Direction direction;
   int32_t dimension;
@@ -201,6 +224,12 @@ Event ScrollBar(const Texture &tex_background, const Texture &tex_foreground,
 Event CollapsibleGroup(const char *label, float ysize, const Margin &margin,
                        const char *id, const std::function<void()> &contents,
                        bool *expand) {
+  return CollapsibleGroup(label, ysize, margin, HashId(id), contents, expand);
+}
+
+Event CollapsibleGroup(const char *label, float ysize, const Margin &margin,
+                       HashedId id, const std::function<void()> &contents,
+                       bool *expand) {
   StartGroup(kLayoutVerticalLeft, 0, id);
   SetMargin(margin);
   Event event = TextButton(label, ysize, margin);
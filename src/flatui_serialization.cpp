@@ -17,6 +17,7 @@
 #include <stdarg.h>
 #include <unordered_map>
 
+#include "flatui/trace.h"
 #include "fplbase/flatbuffer_utils.h"
 #include "fplbase/utilities.h"
 
@@ -90,11 +91,11 @@ static bool HasValidAssetManager(const fplbase::AssetManager* assetman,
 }
 
 // Helper function to check if the AssetManager has a Texture, and return
-// it through the `texture` parameter.
+// a pointer to it through the `texture` parameter.
 static bool GetTextureFromAssetManager(const char* texture_name,
                                        const char* widget_id,
                                        fplbase::AssetManager* assetman,
-                                       fplbase::Texture* texture) {
+                                       const fplbase::Texture** texture) {
   if (!HasValidAssetManager(assetman, widget_id)) return false;
 
   auto tex = assetman->FindTexture(texture_name);
@@ -104,6 +105,21 @@ static bool GetTextureFromAssetManager(const char* texture_name,
     return false;
   }
 
+  *texture = tex;
+  return true;
+}
+
+// Helper function to check if the AssetManager has a Texture, and return
+// a copy of it through the `texture` parameter.
+static bool GetTextureFromAssetManager(const char* texture_name,
+                                       const char* widget_id,
+                                       fplbase::AssetManager* assetman,
+                                       fplbase::Texture* texture) {
+  const fplbase::Texture* tex = nullptr;
+  if (!GetTextureFromAssetManager(texture_name, widget_id, assetman, &tex)) {
+    return false;
+  }
+
   *texture = *tex;
   return true;
 }
@@ -409,31 +425,78 @@ void RegisterCustomWidget(const uint32_t& type, CustomWidget widget) {
   custom_elements[type] = widget;
 }
 
+// Fill in the binding of an element to the dynamic data and the custom widget
+// registered with it. Textures are left to be looked up by their names.
+static void BindElement(const FlatUIElement* element,
+                        ElementBinding* binding) {
+  binding->element = element;
+  binding->id = element->id()->str();
+  binding->dynamic = GetDynamicData(binding->id);
+  binding->textures[0] = nullptr;
+  binding->textures[1] = nullptr;
+  auto widget = custom_elements.find(element->type());
+  binding->custom_widget =
+      widget == custom_elements.end() ? nullptr : &widget->second;
+  binding->group_end = 0;
+}
+
+// Return the dynamic data bound to an element, if it has the given `type`.
+static DynamicData* GetDynamicData(const ElementBinding& binding,
+                                   DynamicData::DynamicDataType type) {
+  auto dynamic = binding.dynamic;
+  return dynamic != nullptr && dynamic->type == type ? dynamic : nullptr;
+}
+
+// Return the texture #`index` of an element. It's either resolved when the
+// element was compiled, or looked up with `texture_name`.
+static const fplbase::Texture* GetTexture(const ElementBinding& binding,
+                                          int index, const char* texture_name,
+                                          AssetManager* assetman) {
+  if (binding.textures[index] != nullptr) return binding.textures[index];
+
+  const fplbase::Texture* texture = nullptr;
+  GetTextureFromAssetManager(texture_name, binding.id.c_str(), assetman,
+                             &texture);
+  return texture;
+}
+
 // Call the appropriate function, if it exists.
-static void CreateCustomWidget(const FlatUIElement* element,
+static void CreateCustomWidget(const ElementBinding& binding,
                                AssetManager* assetman,
-                               FlatUIHandler event_handler) {
-  auto widget = custom_elements.find(element->type());
-  if (widget == custom_elements.end()) {
+                               const FlatUIHandler& event_handler) {
+  if (binding.custom_widget == nullptr) {
     Error("Custom widget with type \"%u\" was not registered.",
-          element->type());
+          binding.element->type());
     return;
   }
 
-  auto output_data = GetDynamicData(element->id()->str());
-  widget->second(element, assetman, event_handler, output_data);
+  (*binding.custom_widget)(binding.element, assetman, event_handler,
+                           binding.dynamic);
 }
 
-static void CreateGroup(const FlatUIElement* element, AssetManager* assetman,
-                        FlatUIHandler event_handler) {
+static void CreateCustomWidget(const FlatUIElement* element,
+                               AssetManager* assetman,
+                               FlatUIHandler event_handler) {
+  ElementBinding binding;
+  BindElement(element, &binding);
+  CreateCustomWidget(binding, assetman, event_handler);
+}
+
+// Start the group of an element. Returns false if the group can't be started,
+// in which case its children and EndGroup() must be skipped.
+static bool StartGroupElement(const ElementBinding& binding) {
+  auto element = binding.element;
+  auto int_data = GetDynamicData(binding, DynamicData::kIntData);
+  auto float_data = GetDynamicData(binding, DynamicData::kFloatData);
+  auto vec2_data = GetDynamicData(binding, DynamicData::kVec2Data);
+
   Layout layout = kLayoutHorizontalTop;  // Dummy value for initialization.
   if (element->layout() == flatui_data::Layout_None) {
-    if (HasDynamicData(element->id()->str(), DynamicData::kIntData)) {
-      layout = static_cast<Layout>(
-          *GetDynamicData(element->id()->str())->data.int_data);
+    if (int_data != nullptr) {
+      layout = static_cast<Layout>(*int_data->data.int_data);
     } else {
-      MissingFieldError("layout", element->id()->str());
-      return;
+      MissingFieldError("layout", binding.id);
+      return false;
     }
   } else {
     layout = static_cast<Layout>(element->layout());
@@ -441,35 +504,33 @@ static void CreateGroup(const FlatUIElement* element, AssetManager* assetman,
 
   float spacing = element->spacing();
   if (spacing == 0.0f) {
-    if (HasDynamicData(element->id()->str(), DynamicData::kFloatData)) {
-      spacing = *GetDynamicData(element->id()->str())->data.float_data;
+    if (float_data != nullptr) {
+      spacing = *float_data->data.float_data;
     }
   }
 
   int horizontal = element->horizontal();
   if (horizontal == 0) {
-    if (HasDynamicData(element->id()->str(), DynamicData::kIntData)) {
-      horizontal = *GetDynamicData(element->id()->str())->data.int_data;
+    if (int_data != nullptr) {
+      horizontal = *int_data->data.int_data;
     }
   }
 
   int vertical = element->vertical();
   if (vertical == 0) {
-    if (horizontal != 0 &&
-        HasDynamicData(element->id()->str(), DynamicData::kIntData)) {
-      vertical = *GetDynamicData(element->id()->str())->data.int_data;
+    if (horizontal != 0 && int_data != nullptr) {
+      vertical = *int_data->data.int_data;
     }
   }
 
-  flatui::StartGroup(layout, spacing, element->id()->c_str());
+  flatui::StartGroup(layout, spacing, binding.id.c_str());
 
   if (horizontal != 0 && vertical != 0) {
     if (element->offset() == nullptr) {
-      if (HasDynamicData(element->id()->str(), DynamicData::kVec2Data)) {
-        flatui::PositionGroup(
-            static_cast<Alignment>(horizontal),
-            static_cast<Alignment>(vertical),
-            *GetDynamicData(element->id()->str())->data.vec2_data);
+      if (vec2_data != nullptr) {
+        flatui::PositionGroup(static_cast<Alignment>(horizontal),
+                              static_cast<Alignment>(vertical),
+                              *vec2_data->data.vec2_data);
       }
     } else {
       flatui::PositionGroup(static_cast<Alignment>(horizontal),
@@ -481,6 +542,14 @@ static void CreateGroup(const FlatUIElement* element, AssetManager* assetman,
   if (element->is_modal_group()) {
     flatui::ModalGroup();
   }
+  return true;
+}
+
+static void CreateGroup(const FlatUIElement* element, AssetManager* assetman,
+                        FlatUIHandler event_handler) {
+  ElementBinding binding;
+  BindElement(element, &binding);
+  if (!StartGroupElement(binding)) return;
 
   auto child_elements = element->elements();
   if (child_elements != nullptr) {
@@ -492,46 +561,54 @@ static void CreateGroup(const FlatUIElement* element, AssetManager* assetman,
   flatui::EndGroup();
 }
 
-static void CreateImage(const FlatUIElement* element, AssetManager* assetman) {
+static void CreateImage(const ElementBinding& binding,
+                        AssetManager* assetman) {
+  auto element = binding.element;
   const char* texture_name = nullptr;
   if (element->texture() == nullptr) {
-    if (HasDynamicData(element->id()->str(), DynamicData::kStringData)) {
-      texture_name =
-          GetDynamicData(element->id()->str())->data.string_data->c_str();
+    auto string_data = GetDynamicData(binding, DynamicData::kStringData);
+    if (string_data != nullptr) {
+      texture_name = string_data->data.string_data->c_str();
     } else {
-      MissingFieldError("texture", element->id()->str());
+      MissingFieldError("texture", binding.id);
       return;
     }
   } else {
     texture_name = element->texture()->c_str();
   }
 
-  fplbase::Texture texture;
-  if (!GetTextureFromAssetManager(texture_name, element->id()->c_str(),
-                                  assetman, &texture)) {
-    return;
-  }
+  auto texture = GetTexture(binding, 0, texture_name, assetman);
+  if (texture == nullptr) return;
 
   float ysize = element->ysize();
   if (ysize < 0.0f) {
-    if (HasDynamicData(element->id()->str(), DynamicData::kFloatData)) {
-      ysize = *GetDynamicData(element->id()->str())->data.float_data;
+    auto float_data = GetDynamicData(binding, DynamicData::kFloatData);
+    if (float_data != nullptr) {
+      ysize = *float_data->data.float_data;
     } else {
-      MissingFieldError("ysize", element->id()->str());
+      MissingFieldError("ysize", binding.id);
       return;
     }
   }
 
-  flatui::Image(texture, ysize);
+  flatui::Image(*texture, ysize);
 }
 
-static void CreateLabel(const FlatUIElement* element) {
+static void CreateImage(const FlatUIElement* element, AssetManager* assetman) {
+  ElementBinding binding;
+  BindElement(element, &binding);
+  CreateImage(binding, assetman);
+}
+
+static void CreateLabel(const ElementBinding& binding) {
+  auto element = binding.element;
   const char* text = nullptr;
   if (element->text() == nullptr) {
-    if (HasDynamicData(element->id()->str(), DynamicData::kStringData)) {
-      text = GetDynamicData(element->id()->str())->data.string_data->c_str();
+    auto string_data = GetDynamicData(binding, DynamicData::kStringData);
+    if (string_data != nullptr) {
+      text = string_data->data.string_data->c_str();
     } else {
-      MissingFieldError("text", element->id()->str());
+      MissingFieldError("text", binding.id);
       return;
     }
   } else {
@@ -540,18 +617,18 @@ static void CreateLabel(const FlatUIElement* element) {
 
   float ysize = element->ysize();
   if (ysize < 0.0f) {
-    if (HasDynamicData(element->id()->str(), DynamicData::kFloatData)) {
-      ysize = *GetDynamicData(element->id()->str())->data.float_data;
+    auto float_data = GetDynamicData(binding, DynamicData::kFloatData);
+    if (float_data != nullptr) {
+      ysize = *float_data->data.float_data;
     } else {
-      MissingFieldError("ysize", element->id()->str());
+      MissingFieldError("ysize", binding.id);
       return;
     }
   }
 
-  if (element->size_2f() == nullptr &&
-      HasDynamicData(element->id()->str(), DynamicData::kVec2Data)) {
-    flatui::Label(text, ysize,
-                  *GetDynamicData(element->id()->str())->data.vec2_data);
+  auto vec2_data = GetDynamicData(binding, DynamicData::kVec2Data);
+  if (element->size_2f() == nullptr && vec2_data != nullptr) {
+    flatui::Label(text, ysize, *vec2_data->data.vec2_data);
   } else if (element->size_2f() == nullptr) {
     flatui::Label(text, ysize);
   } else {
@@ -559,6 +636,12 @@ static void CreateLabel(const FlatUIElement* element) {
   }
 }
 
+static void CreateLabel(const FlatUIElement* element) {
+  ElementBinding binding;
+  BindElement(element, &binding);
+  CreateLabel(binding);
+}
+
 static Margin CreateMargin(const flatui_data::Margin* margin) {
   if (margin == nullptr) {
     return Margin(0.0f);
@@ -580,14 +663,15 @@ static Margin CreateMargin(const flatui_data::Margin* margin) {
   return Margin(0.0f);
 }
 
-static void CreateSetVirtualResolution(const FlatUIElement* element) {
-  float vr = element->virtual_resolution();
+static void CreateSetVirtualResolution(const ElementBinding& binding) {
+  float vr = binding.element->virtual_resolution();
 
   if (vr < 0.0f) {
-    if (HasDynamicData(element->id()->str(), DynamicData::kFloatData)) {
-      vr = *GetDynamicData(element->id()->str())->data.float_data;
+    auto float_data = GetDynamicData(binding, DynamicData::kFloatData);
+    if (float_data != nullptr) {
+      vr = *float_data->data.float_data;
     } else {
-      MissingFieldError("virtual_resolution", element->id()->str());
+      MissingFieldError("virtual_resolution", binding.id);
       return;
     }
   }
@@ -595,56 +679,70 @@ static void CreateSetVirtualResolution(const FlatUIElement* element) {
   flatui::SetVirtualResolution(vr);
 }
 
-static void CreateImageButton(const FlatUIElement* element,
+static void CreateSetVirtualResolution(const FlatUIElement* element) {
+  ElementBinding binding;
+  BindElement(element, &binding);
+  CreateSetVirtualResolution(binding);
+}
+
+static void CreateImageButton(const ElementBinding& binding,
                               AssetManager* assetman,
-                              FlatUIHandler event_handler) {
+                              const FlatUIHandler& event_handler) {
+  auto element = binding.element;
   float size = element->size();
   if (size < 0.0f) {
-    if (HasDynamicData(element->id()->str(), DynamicData::kFloatData)) {
-      size = *GetDynamicData(element->id()->str())->data.float_data;
+    auto float_data = GetDynamicData(binding, DynamicData::kFloatData);
+    if (float_data != nullptr) {
+      size = *float_data->data.float_data;
     } else {
-      MissingFieldError("size", element->id()->str());
+      MissingFieldError("size", binding.id);
       return;
     }
   }
 
   const char* texture_name = nullptr;
   if (element->texture() == nullptr) {
-    if (HasDynamicData(element->id()->str(), DynamicData::kStringData)) {
-      texture_name =
-          GetDynamicData(element->id()->str())->data.string_data->c_str();
+    auto string_data = GetDynamicData(binding, DynamicData::kStringData);
+    if (string_data != nullptr) {
+      texture_name = string_data->data.string_data->c_str();
     } else {
-      MissingFieldError("texture", element->id()->str());
+      MissingFieldError("texture", binding.id);
       return;
     }
   } else {
     texture_name = element->texture()->c_str();
   }
 
-  fplbase::Texture texture;
-  if (!GetTextureFromAssetManager(texture_name, element->id()->c_str(),
-                                  assetman, &texture)) {
-    return;
-  }
+  auto texture = GetTexture(binding, 0, texture_name, assetman);
+  if (texture == nullptr) return;
 
-  Event e = flatui::ImageButton(texture, size, CreateMargin(element->margin()),
-                                element->id()->c_str());
+  Event e = flatui::ImageButton(*texture, size, CreateMargin(element->margin()),
+                                binding.id.c_str());
 
   if (event_handler != nullptr) {
-    event_handler(e, element->id()->str(),
-                  GetDynamicData(element->id()->str()));
+    event_handler(e, binding.id, binding.dynamic);
   }
 }
 
-static void CreateTextButton(const FlatUIElement* element,
+static void CreateImageButton(const FlatUIElement* element,
+                              AssetManager* assetman,
+                              FlatUIHandler event_handler) {
+  ElementBinding binding;
+  BindElement(element, &binding);
+  CreateImageButton(binding, assetman, event_handler);
+}
+
+static void CreateTextButton(const ElementBinding& binding,
                              AssetManager* assetman,
-                             FlatUIHandler event_handler) {
+                             const FlatUIHandler& event_handler) {
+  auto element = binding.element;
+  auto string_data = GetDynamicData(binding, DynamicData::kStringData);
   const char* text = nullptr;
   if (element->text() == nullptr) {
-    if (HasDynamicData(element->id()->str(), DynamicData::kStringData)) {
-      text = GetDynamicData(element->id()->str())->data.string_data->c_str();
+    if (string_data != nullptr) {
+      text = string_data->data.string_data->c_str();
     } else {
-      MissingFieldError("text", element->id()->str());
+      MissingFieldError("text", binding.id);
       return;
     }
   } else {
@@ -653,20 +751,19 @@ static void CreateTextButton(const FlatUIElement* element,
 
   float size = element->size();
   if (size < 0.0f) {
-    if (HasDynamicData(element->id()->str(), DynamicData::kFloatData)) {
-      size = *GetDynamicData(element->id()->str())->data.float_data;
+    auto float_data = GetDynamicData(binding, DynamicData::kFloatData);
+    if (float_data != nullptr) {
+      size = *float_data->data.float_data;
     } else {
-      MissingFieldError("size", element->id()->str());
+      MissingFieldError("size", binding.id);
       return;
     }
   }
 
   const char* texture_name = nullptr;
   if (element->texture() == nullptr) {
-    if (HasDynamicData(element->id()->str(), DynamicData::kStringData) &&
-        element->text() != nullptr) {
-      texture_name =
-          GetDynamicData(element->id()->str())->data.string_data->c_str();
+    if (string_data != nullptr && element->text() != nullptr) {
+      texture_name = string_data->data.string_data->c_str();
     } else {
       texture_name = nullptr;
     }
@@ -676,20 +773,18 @@ static void CreateTextButton(const FlatUIElement* element,
 
   Event e = kEventNone;
   if (texture_name != nullptr) {
-    fplbase::Texture texture;
-    if (!GetTextureFromAssetManager(texture_name, element->id()->c_str(),
-                                    assetman, &texture)) {
-      return;
-    }
+    auto texture = GetTexture(binding, 0, texture_name, assetman);
+    if (texture == nullptr) return;
 
     int button_property = element->property();
     if (button_property == flatui_data::ButtonProperty_Disabled) {
-      if (HasDynamicData(element->id()->str(), DynamicData::kIntData)) {
-        button_property = *GetDynamicData(element->id()->str())->data.int_data;
+      auto int_data = GetDynamicData(binding, DynamicData::kIntData);
+      if (int_data != nullptr) {
+        button_property = *int_data->data.int_data;
       }
     }
 
-    e = flatui::TextButton(texture, CreateMargin(element->texture_margin()),
+    e = flatui::TextButton(*texture, CreateMargin(element->texture_margin()),
                            text, size, CreateMargin(element->margin()),
                            static_cast<ButtonProperty>(button_property));
   } else {
@@ -697,194 +792,340 @@ static void CreateTextButton(const FlatUIElement* element,
   }
 
   if (event_handler != nullptr) {
-    event_handler(e, element->id()->str(),
-                  GetDynamicData(element->id()->str()));
+    event_handler(e, binding.id, binding.dynamic);
   }
 }
 
-static void CreateEdit(const FlatUIElement* element,
-                       FlatUIHandler event_handler) {
-  if (!HasDynamicData(element->id()->str(), DynamicData::kStringData)) {
+static void CreateTextButton(const FlatUIElement* element,
+                             AssetManager* assetman,
+                             FlatUIHandler event_handler) {
+  ElementBinding binding;
+  BindElement(element, &binding);
+  CreateTextButton(binding, assetman, event_handler);
+}
+
+static void CreateEdit(const ElementBinding& binding,
+                       const FlatUIHandler& event_handler) {
+  auto element = binding.element;
+  auto dynamic = GetDynamicData(binding, DynamicData::kStringData);
+  if (dynamic == nullptr) {
     Error(
         "\"Edit\" with ID \"%s\" requires a string dynamic data to be"
         " registered with it.",
-        element->id()->c_str());
+        binding.id.c_str());
     return;
   }
 
-  auto dynamic = GetDynamicData(element->id()->str());
   std::string* edit_output = dynamic->data.string_data;
   EditStatus status;
 
   Event e =
       flatui::Edit(element->ysize(), fplbase::LoadVec2(element->size_2f()),
-                   element->id()->c_str(), &status, edit_output);
+                   binding.id.c_str(), &status, edit_output);
   if (event_handler != nullptr) {
-    event_handler(e, element->id()->str(), dynamic);
+    event_handler(e, binding.id, dynamic);
   }
 }
 
-static void CreateCheckBox(const FlatUIElement* element, AssetManager* assetman,
-                           FlatUIHandler event_handler) {
-  if (!HasDynamicData(element->id()->str(), DynamicData::kBoolData)) {
+static void CreateEdit(const FlatUIElement* element,
+                       FlatUIHandler event_handler) {
+  ElementBinding binding;
+  BindElement(element, &binding);
+  CreateEdit(binding, event_handler);
+}
+
+static void CreateCheckBox(const ElementBinding& binding,
+                           AssetManager* assetman,
+                           const FlatUIHandler& event_handler) {
+  auto element = binding.element;
+  auto dynamic = GetDynamicData(binding, DynamicData::kBoolData);
+  if (dynamic == nullptr) {
     Error(
         "\"CheckBox\" with ID \"%s\" requires a bool dynamic data to be"
         " registered with it.",
-        element->id()->c_str());
+        binding.id.c_str());
     return;
   }
 
-  fplbase::Texture texture_checked, texture_unchecked;
-  if (!GetTextureFromAssetManager(element->texture()->c_str(),
-                                  element->id()->c_str(), assetman,
-                                  &texture_checked) ||
-      !GetTextureFromAssetManager(element->texture_secondary()->c_str(),
-                                  element->id()->c_str(), assetman,
-                                  &texture_unchecked)) {
-    return;
-  }
+  auto texture_checked =
+      GetTexture(binding, 0, element->texture()->c_str(), assetman);
+  if (texture_checked == nullptr) return;
+  auto texture_unchecked =
+      GetTexture(binding, 1, element->texture_secondary()->c_str(), assetman);
+  if (texture_unchecked == nullptr) return;
 
-  auto dynamic = GetDynamicData(element->id()->str());
   bool* check_box_output = dynamic->data.bool_data;
 
-  Event e = flatui::CheckBox(texture_checked, texture_unchecked,
+  Event e = flatui::CheckBox(*texture_checked, *texture_unchecked,
                              element->text()->c_str(), element->size(),
                              CreateMargin(element->margin()), check_box_output);
 
   if (event_handler != nullptr) {
-    event_handler(e, element->id()->str(), dynamic);
+    event_handler(e, binding.id, dynamic);
   }
 }
 
-static void CreateScrollBar(const FlatUIElement* element,
+static void CreateCheckBox(const FlatUIElement* element, AssetManager* assetman,
+                           FlatUIHandler event_handler) {
+  ElementBinding binding;
+  BindElement(element, &binding);
+  CreateCheckBox(binding, assetman, event_handler);
+}
+
+static void CreateScrollBar(const ElementBinding& binding,
                             AssetManager* assetman,
-                            FlatUIHandler event_handler) {
-  if (!HasDynamicData(element->id()->str(), DynamicData::kFloatData)) {
+                            const FlatUIHandler& event_handler) {
+  auto element = binding.element;
+  auto dynamic = GetDynamicData(binding, DynamicData::kFloatData);
+  if (dynamic == nullptr) {
     Error(
         "\"ScrollBar\" with ID \"%s\" requires a float dynamic data to be"
         " registered with it.",
-        element->id()->c_str());
+        binding.id.c_str());
     return;
   }
 
-  fplbase::Texture texture_bg, texture_fg;
-  if (!GetTextureFromAssetManager(element->texture()->c_str(),
-                                  element->id()->c_str(), assetman,
-                                  &texture_bg) ||
-      !GetTextureFromAssetManager(element->texture_secondary()->c_str(),
-                                  element->id()->c_str(), assetman,
-                                  &texture_fg)) {
-    return;
-  }
+  auto texture_bg =
+      GetTexture(binding, 0, element->texture()->c_str(), assetman);
+  if (texture_bg == nullptr) return;
+  auto texture_fg =
+      GetTexture(binding, 1, element->texture_secondary()->c_str(), assetman);
+  if (texture_fg == nullptr) return;
 
-  auto dynamic = GetDynamicData(element->id()->str());
   float* scroll_bar_output = dynamic->data.float_data;
 
   Event e = flatui::ScrollBar(
-      texture_bg, texture_fg, fplbase::LoadVec2(element->size_2f()),
-      element->bar_size(), element->id()->c_str(), scroll_bar_output);
+      *texture_bg, *texture_fg, fplbase::LoadVec2(element->size_2f()),
+      element->bar_size(), binding.id.c_str(), scroll_bar_output);
 
   if (event_handler != nullptr) {
-    event_handler(e, element->id()->str(), dynamic);
+    event_handler(e, binding.id, dynamic);
   }
 }
 
-static void CreateSlider(const FlatUIElement* element, AssetManager* assetman,
-                         FlatUIHandler event_handler) {
-  if (!HasDynamicData(element->id()->str(), DynamicData::kFloatData)) {
+static void CreateScrollBar(const FlatUIElement* element,
+                            AssetManager* assetman,
+                            FlatUIHandler event_handler) {
+  ElementBinding binding;
+  BindElement(element, &binding);
+  CreateScrollBar(binding, assetman, event_handler);
+}
+
+static void CreateSlider(const ElementBinding& binding, AssetManager* assetman,
+                         const FlatUIHandler& event_handler) {
+  auto element = binding.element;
+  auto dynamic = GetDynamicData(binding, DynamicData::kFloatData);
+  if (dynamic == nullptr) {
     Error(
         "\"Slider\" with ID \"%s\" requires a float dynamic data to be"
         " registered with it.",
-        element->id()->c_str());
+        binding.id.c_str());
     return;
   }
 
-  fplbase::Texture texture_bar, texture_knob;
-  if (!GetTextureFromAssetManager(element->texture()->c_str(),
-                                  element->id()->c_str(), assetman,
-                                  &texture_bar) ||
-      !GetTextureFromAssetManager(element->texture_secondary()->c_str(),
-                                  element->id()->c_str(), assetman,
-                                  &texture_knob)) {
-    return;
-  }
+  auto texture_bar =
+      GetTexture(binding, 0, element->texture()->c_str(), assetman);
+  if (texture_bar == nullptr) return;
+  auto texture_knob =
+      GetTexture(binding, 1, element->texture_secondary()->c_str(), assetman);
+  if (texture_knob == nullptr) return;
 
-  auto dynamic = GetDynamicData(element->id()->str());
   float* slider_output = dynamic->data.float_data;
 
   Event e = flatui::Slider(
-      texture_bar, texture_knob, fplbase::LoadVec2(element->size_2f()),
-      element->bar_size(), element->id()->c_str(), slider_output);
+      *texture_bar, *texture_knob, fplbase::LoadVec2(element->size_2f()),
+      element->bar_size(), binding.id.c_str(), slider_output);
 
   if (event_handler != nullptr) {
-    event_handler(e, element->id()->str(), dynamic);
+    event_handler(e, binding.id, dynamic);
   }
 }
 
-// Helper function to map from FlatUIElement's enum to a FlatUI function.
-static void MapElement(const FlatUIElement* element, AssetManager* assetman,
-                       FlatUIHandler event_handler) {
-  if (!CheckElements(element, RequiredFields(element))) {
-    return;
-  }
+static void CreateSlider(const FlatUIElement* element, AssetManager* assetman,
+                         FlatUIHandler event_handler) {
+  ElementBinding binding;
+  BindElement(element, &binding);
+  CreateSlider(binding, assetman, event_handler);
+}
 
-  switch (element->type()) {
+// Helper function to map from a bound FlatUIElement's enum to a FlatUI
+// function. Groups are handled by the callers, since their children are
+// visited differently when mapping and when running compiled data.
+static void CreateElement(const ElementBinding& binding,
+                          AssetManager* assetman,
+                          const FlatUIHandler& event_handler) {
+  switch (binding.element->type()) {
     case flatui_data::Type_CheckBox:
-      CreateCheckBox(element, assetman, event_handler);
+      CreateCheckBox(binding, assetman, event_handler);
       break;
     case flatui_data::Type_Edit:
-      CreateEdit(element, event_handler);
-      break;
-    case flatui_data::Type_Group:
-      CreateGroup(element, assetman, event_handler);
+      CreateEdit(binding, event_handler);
       break;
     case flatui_data::Type_Image:
-      CreateImage(element, assetman);
+      CreateImage(binding, assetman);
       break;
     case flatui_data::Type_ImageButton:
-      CreateImageButton(element, assetman, event_handler);
+      CreateImageButton(binding, assetman, event_handler);
       break;
     case flatui_data::Type_Label:
-      CreateLabel(element);
+      CreateLabel(binding);
       break;
     case flatui_data::Type_ScrollBar:
-      CreateScrollBar(element, assetman, event_handler);
+      CreateScrollBar(binding, assetman, event_handler);
       break;
     case flatui_data::Type_SetVirtualResolution:
-      CreateSetVirtualResolution(element);
+      CreateSetVirtualResolution(binding);
       break;
     case flatui_data::Type_Slider:
-      CreateSlider(element, assetman, event_handler);
+      CreateSlider(binding, assetman, event_handler);
       break;
     case flatui_data::Type_TextButton:
-      CreateTextButton(element, assetman, event_handler);
+      CreateTextButton(binding, assetman, event_handler);
       break;
     default:  // Handle custom registered widgets.
-      CreateCustomWidget(element, assetman, event_handler);
+      CreateCustomWidget(binding, assetman, event_handler);
   }
 }
 
-void CreateFlatUIFromData(const void* flatui_data, AssetManager* assetman,
-                          FlatUIHandler event_handler) {
-  if (flatui_data == nullptr) {
-    Error(
-        "\"CreateFlatUIFromData\" requires that \"flatui_data\" is not a"
-        " \"nullptr\".");
+// Helper function to map from FlatUIElement's enum to a FlatUI function.
+static void MapElement(const FlatUIElement* element, AssetManager* assetman,
+                       FlatUIHandler event_handler) {
+  if (!CheckElements(element, RequiredFields(element))) {
+    return;
+  }
+
+  if (element->type() == flatui_data::Type_Group) {
+    CreateGroup(element, assetman, event_handler);
     return;
   }
 
+  ElementBinding binding;
+  BindElement(element, &binding);
+  CreateElement(binding, assetman, event_handler);
+}
+
+// Check the root table of FlatUI data, and return its elements if it's valid.
+static const flatbuffers::Vector<flatbuffers::Offset<FlatUIElement>>*
+GetRootElements(const void* flatui_data) {
   auto flatui_elements = GetFlatUI(flatui_data)->elements();
 
   if (flatui_elements == nullptr || flatui_elements->Length() == 0) {
     Error(
         "Required field \"elements\" is missing, or empty, for \"FlatUI\" "
         "root table.");
+    return nullptr;
+  }
+  return flatui_elements;
+}
+
+void CreateFlatUIFromData(const void* flatui_data, AssetManager* assetman,
+                          FlatUIHandler event_handler) {
+  FLATUI_TRACE_SCOPE("FlatUI::CreateFlatUIFromData", kNullHash);
+  if (flatui_data == nullptr) {
+    Error(
+        "\"CreateFlatUIFromData\" requires that \"flatui_data\" is not a"
+        " \"nullptr\".");
     return;
   }
 
+  auto flatui_elements = GetRootElements(flatui_data);
+  if (flatui_elements == nullptr) return;
+
   for (unsigned int i = 0; i < flatui_elements->Length(); i++) {
     MapElement(flatui_elements->Get(i), assetman, event_handler);
   }
 }
 
+bool CompiledFlatUI::Compile(const void* flatui_data, AssetManager* assetman) {
+  Clear();
+  assetman_ = assetman;
+
+  if (flatui_data == nullptr) {
+    Error(
+        "\"CompiledFlatUI::Compile\" requires that \"flatui_data\" is not a"
+        " \"nullptr\".");
+    return false;
+  }
+
+  auto flatui_elements = GetRootElements(flatui_data);
+  if (flatui_elements == nullptr) return false;
+
+  for (unsigned int i = 0; i < flatui_elements->Length(); i++) {
+    CompileElement(flatui_elements->Get(i));
+  }
+  return true;
+}
+
+void CompiledFlatUI::CompileElement(const FlatUIElement* element) {
+  // Elements that fail the checks are never rendered, so they are dropped.
+  if (!CheckElements(element, RequiredFields(element))) {
+    return;
+  }
+
+  ElementBinding binding;
+  BindElement(element, &binding);
+
+  // Resolve textures named in the FlatBuffer. Other textures are named by
+  // dynamic data, which may change every frame.
+  int num_textures = 0;
+  switch (element->type()) {
+    case flatui_data::Type_Image:
+    case flatui_data::Type_ImageButton:
+    case flatui_data::Type_TextButton:
+      num_textures = 1;
+      break;
+    case flatui_data::Type_CheckBox:
+    case flatui_data::Type_ScrollBar:
+    case flatui_data::Type_Slider:
+      num_textures = 2;
+      break;
+    default:
+      break;
+  }
+  const flatbuffers::String* texture_names[] = {element->texture(),
+                                                element->texture_secondary()};
+  for (int i = 0; i < num_textures; ++i) {
+    if (texture_names[i] == nullptr) continue;
+    if (!GetTextureFromAssetManager(texture_names[i]->c_str(),
+                                    binding.id.c_str(), assetman_,
+                                    &binding.textures[i])) {
+      return;
+    }
+  }
+
+  auto index = elements_.size();
+  elements_.push_back(binding);
+  if (element->type() != flatui_data::Type_Group) return;
+
+  // Children of a group are followed by an entry without an element, which
+  // ends the group.
+  auto child_elements = element->elements();
+  if (child_elements != nullptr) {
+    for (unsigned int i = 0; i < child_elements->Length(); i++) {
+      CompileElement(child_elements->Get(i));
+    }
+  }
+  elements_[index].group_end = elements_.size();
+  elements_.push_back(ElementBinding());
+}
+
+void CompiledFlatUI::Create(const FlatUIHandler& event_handler) const {
+  FLATUI_TRACE_SCOPE("FlatUI::CompiledFlatUI::Create", kNullHash);
+  for (size_t i = 0; i < elements_.size(); ++i) {
+    auto& binding = elements_[i];
+    if (binding.element == nullptr) {
+      flatui::EndGroup();
+    } else if (binding.element->type() == flatui_data::Type_Group) {
+      if (!StartGroupElement(binding)) i = binding.group_end;
+    } else {
+      CreateElement(binding, assetman_, event_handler);
+    }
+  }
+}
+
+void CompiledFlatUI::Clear() {
+  elements_.clear();
+  assetman_ = nullptr;
+}
+
 }  // flatui
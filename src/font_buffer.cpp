@@ -62,25 +62,62 @@ int32_t FontBuffer::GetBufferIndex(int32_t slice, FontBufferContext *context) {
     // Resize index buffers.
     it->second = static_cast<int32_t>(slices_.size());
     slices_.push_back(it->first);
-    indices_.resize(it->second + 1);
+    glyph_ranges_.resize(it->second + 1);
   }
   // Update the attribute stack.
   if (attr_history.empty() || it != attr_history.back()) {
     attr_history.push_back(it);
   }
-  assert(it->second < static_cast<int32_t>(indices_.size()));
+  assert(it->second < static_cast<int32_t>(glyph_ranges_.size()));
   return it->second;
 }
 
-void FontBuffer::AddIndices(int32_t buffer_idx, int32_t count) {
-  // Construct indices array.
-  assert(buffer_idx < static_cast<int32_t>(indices_.size()));
-  const uint16_t kIndices[] = {0, 1, 2, 1, 3, 2};
-  auto &indices = get_indices(buffer_idx);
-  for (size_t j = 0; j < FPL_ARRAYSIZE(kIndices); ++j) {
-    auto index = kIndices[j];
-    indices.push_back(static_cast<unsigned short>(index + count * 4));
+const uint16_t *GetQuadIndices() {
+  static const std::vector<uint16_t> quad_indices = [] {
+    const uint16_t kIndices[] = {0, 1, 2, 1, 3, 2};
+    std::vector<uint16_t> indices;
+    indices.reserve(kMaxQuadIndicesGlyphs * FPL_ARRAYSIZE(kIndices));
+    for (uint32_t i = 0; i < kMaxQuadIndicesGlyphs; ++i) {
+      for (size_t j = 0; j < FPL_ARRAYSIZE(kIndices); ++j) {
+        indices.push_back(static_cast<uint16_t>(kIndices[j] + i * 4));
+      }
+    }
+    return indices;
+  }();
+  return quad_indices.data();
+}
+
+void FontBuffer::AddGlyph(int32_t buffer_idx, uint32_t glyph_index) {
+  assert(buffer_idx < static_cast<int32_t>(glyph_ranges_.size()));
+  auto &ranges = get_glyph_ranges(buffer_idx);
+  if (!ranges.empty() &&
+      ranges.back().start + ranges.back().count == glyph_index) {
+    // Extend the last range.
+    ranges.back().count++;
+  } else {
+    ranges.push_back(GlyphRange(glyph_index, 1));
+  }
+}
+
+bool FontBuffer::RemoveLastGlyph(int32_t buffer_idx) {
+  auto &ranges = get_glyph_ranges(buffer_idx);
+  if (ranges.empty() || ranges.back().start + ranges.back().count !=
+                            glyph_info_.size()) {
+    return false;
+  }
+  if (!--ranges.back().count) {
+    ranges.pop_back();
   }
+  return true;
+}
+
+uint32_t FontBuffer::GetGlyphCount(int32_t index) const {
+  uint32_t count = 0;
+  auto &ranges = glyph_ranges_[index];
+  for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+    count += it->count;
+  }
+  return count;
 }
 
 void FontBuffer::UpdateUnderline(int32_t buffer_idx, int32_t vertex_index,
@@ -117,6 +154,56 @@ void FontBuffer::UpdateUV(int32_t index, const mathfu::vec4 &uv) {
   vertices_[index * 4 + 1].uv_ = mathfu::vec2(uv.x, uv.w);
   vertices_[index * 4 + 2].uv_ = mathfu::vec2(uv.z, uv.y);
   vertices_[index * 4 + 3].uv_ = uv.zw();
+  vertex_buffer_dirty_ = true;
+  if (HasPackedVertices()) {
+    packed_vertices_[index * 4].set_uv(uv.x, uv.y);
+    packed_vertices_[index * 4 + 1].set_uv(uv.x, uv.w);
+    packed_vertices_[index * 4 + 2].set_uv(uv.z, uv.y);
+    packed_vertices_[index * 4 + 3].set_uv(uv.z, uv.w);
+  }
+  if (HasGlyphInstances()) {
+    glyph_instances_[index].set_uv(uv);
+  }
+}
+
+void FontBuffer::PackVertices() {
+  packed_vertices_.clear();
+  packed_vertices_.reserve(vertices_.size());
+  for (auto it = vertices_.begin(); it != vertices_.end(); ++it) {
+    packed_vertices_.push_back(PackedFontVertex(*it));
+  }
+  vertex_buffer_dirty_ = true;
+}
+
+void FontBuffer::BuildGlyphInstances() {
+  glyph_instances_.clear();
+  glyph_instances_.reserve(vertices_.size() / 4);
+  for (size_t i = 0; i + 4 <= vertices_.size(); i += 4) {
+    glyph_instances_.push_back(GlyphInstance(&vertices_[i]));
+  }
+  vertex_buffer_dirty_ = true;
+}
+
+FontVertexBuffer *FontBuffer::GetVertexBuffer() const {
+  if (!vertex_buffer_) {
+    vertex_buffer_.reset(new FontVertexBuffer());
+  }
+  if (vertex_buffer_dirty_) {
+    if (HasGlyphInstances()) {
+      vertex_buffer_->Update(
+          glyph_instances_.data(),
+          glyph_instances_.size() * sizeof(GlyphInstance));
+    } else if (HasPackedVertices()) {
+      vertex_buffer_->Update(
+          packed_vertices_.data(),
+          packed_vertices_.size() * sizeof(PackedFontVertex));
+    } else {
+      vertex_buffer_->Update(vertices_.data(),
+                             vertices_.size() * sizeof(FontVertex));
+    }
+    vertex_buffer_dirty_ = false;
+  }
+  return vertex_buffer_.get();
 }
 
 void FontBuffer::AddCaretPosition(const mathfu::vec2 &pos) {
@@ -129,6 +216,16 @@ void FontBuffer::AddCaretPosition(int32_t x, int32_t y) {
   caret_positions_.push_back(mathfu::vec2i(x, y));
 }
 
+int32_t FontBuffer::FindCaretLine(size_t index) const {
+  auto it = std::upper_bound(
+      caret_lines_.begin(), caret_lines_.end(), index,
+      [](size_t i, const CaretLine &line) { return i < line.end; });
+  if (it == caret_lines_.end() || index < it->start) {
+    return -1;
+  }
+  return static_cast<int32_t>(it - caret_lines_.begin());
+}
+
 void FontBuffer::AddWordBoundary(const FontBufferParameters &parameters,
                                  FontBufferContext *context) {
   if (parameters.get_text_alignment() & kTextAlignmentJustify) {
@@ -249,6 +346,21 @@ void FontBuffer::UpdateLine(const FontBufferParameters &parameters,
     }
   }
 
+  // Record caret positions of the line.
+  if (HasCaretPositions() &&
+      context->line_start_caret_index() < caret_positions_.size()) {
+    CaretLine line;
+    line.start = context->line_start_caret_index();
+    line.end = static_cast<uint32_t>(caret_positions_.size());
+    line.min_y = caret_positions_[line.start].y;
+    line.max_y = line.min_y;
+    for (auto idx = line.start + 1; idx < line.end; ++idx) {
+      line.min_y = std::min(line.min_y, caret_positions_[idx].y);
+      line.max_y = std::max(line.max_y, caret_positions_[idx].y);
+    }
+    caret_lines_.push_back(line);
+  }
+
   // Update current line information.
   line_start_indices_.push_back(static_cast<uint32_t>(glyph_info_.size()));
   context->set_lastline_must_break(false);
@@ -280,24 +392,193 @@ float FontBuffer::AdjustCurrentLine(const FontBufferParameters &parameters,
   return offset;
 }
 
-static void VertexExtents(const FontVertex *v, vec2 *min_position,
-                          vec2 *max_position) {
-  // Get extents of the glyph.
+void FontBuffer::AddLineState(uint32_t text_index, const mathfu::vec2 &pos,
+                              int32_t max_line_width, float total_height,
+                              bool first_character,
+                              const FontMetrics &metrics) {
+  FontBufferLineState state;
+  state.text_index = text_index;
+  state.glyph_count = static_cast<uint32_t>(glyph_info_.size());
+  state.caret_count = static_cast<uint32_t>(caret_positions_.size());
+  state.line_count = static_cast<uint32_t>(line_start_indices_.size());
+  for (size_t i = 0; i < glyph_ranges_.size(); ++i) {
+    state.slice_glyph_counts.push_back(GetGlyphCount(static_cast<int32_t>(i)));
+  }
+  state.pos = pos;
+  state.last_pos = last_pos_;
+  state.last_advance = last_advance_;
+  state.max_line_width = max_line_width;
+  state.total_height = total_height;
+  state.first_character = first_character;
+  state.metrics = metrics;
+  line_states_.push_back(state);
+}
+
+void FontBuffer::CopyLines(const FontBuffer &buffer, size_t line,
+                           FontBufferContext *context) {
+  auto &state = buffer.line_states_[line];
+
+  // Slices are only appended during a layout, so slices used by the lines
+  // are at the front.
+  auto num_slices = state.slice_glyph_counts.size();
+  slices_.assign(buffer.slices_.begin(), buffer.slices_.begin() + num_slices);
+  glyph_ranges_.resize(num_slices);
+  for (size_t i = 0; i < num_slices; ++i) {
+    // Copy ranges up to the glyph count of the slice.
+    auto &ranges = glyph_ranges_[i];
+    auto glyph_count = state.slice_glyph_counts[i];
+    ranges.clear();
+    for (auto it = buffer.glyph_ranges_[i].begin(); glyph_count > 0; ++it) {
+      ranges.push_back(GlyphRange(it->start, std::min(it->count, glyph_count)));
+      glyph_count -= ranges.back().count;
+    }
+    // Register the slice so that following glyphs in the slice are added to
+    // the same index buffer.
+    context->LookUpAttribute(slices_[i])->second = static_cast<int32_t>(i);
+  }
+  vertices_.assign(
+      buffer.vertices_.begin(),
+      buffer.vertices_.begin() + state.glyph_count * kVerticesPerCodePoint);
+  glyph_info_.assign(buffer.glyph_info_.begin(),
+                     buffer.glyph_info_.begin() + state.glyph_count);
+  if (HasCaretPositions()) {
+    caret_positions_.assign(
+        buffer.caret_positions_.begin(),
+        buffer.caret_positions_.begin() + state.caret_count);
+    caret_lines_.clear();
+    for (auto it = buffer.caret_lines_.begin();
+         it != buffer.caret_lines_.end() && it->end <= state.caret_count;
+         ++it) {
+      caret_lines_.push_back(*it);
+    }
+  }
+  line_start_indices_.assign(
+      buffer.line_start_indices_.begin(),
+      buffer.line_start_indices_.begin() + state.line_count);
+  // The state of the line itself is kept, as the layout resumes after its
+  // line break.
+  line_states_.assign(buffer.line_states_.begin(),
+                      buffer.line_states_.begin() + line + 1);
+  last_pos_ = state.last_pos;
+  last_advance_ = state.last_advance;
+
+  // Copied glyphs reference the same glyph cache rows.
+  for (auto it = buffer.referencing_row_.begin();
+       it != buffer.referencing_row_.end(); ++it) {
+    if (AddCacheRowReference(*it)) {
+      (*it)->AddRef(this);
+    }
+  }
+
+  context->set_line_start_caret_index(state.caret_count);
+  context->set_resume_line(&state);
+}
+
+void FontBuffer::Reset(uint32_t size, bool caret_info) {
+  ReleaseCacheRowReference();
+  metrics_ = FontMetrics();
+  slices_.clear();
+  glyph_ranges_.clear();
+  vertices_.clear();
+  packed_vertices_.clear();
+  glyph_instances_.clear();
+  glyph_info_.clear();
+  glyph_info_.reserve(size);
+  caret_positions_.clear();
+  if (caret_info) {
+    caret_positions_.reserve(size + 1);
+  }
+  caret_lines_.clear();
+  links_.clear();
+  size_ = mathfu::kZeros2i;
+  last_pos_ = mathfu::kZeros2f;
+  last_advance_ = mathfu::kZeros2f;
+  revision_ = 0;
+  ref_count_ = 0;
+  has_ellipsis_ = false;
+  valid_ = true;
+  line_start_indices_.assign(1, 0);
+  line_states_.clear();
+  parameters_ = nullptr;
+  last_used_counter_ = 0;
+  memory_size_ = 0;
+  // The vertex buffer is kept to reuse its GPU allocation.
+  vertex_buffer_dirty_ = true;
+  bounds_dirty_ = true;
+}
+
+size_t FontBuffer::GetMemorySize() const {
+  auto size = sizeof(*this) + slices_.capacity() * sizeof(slices_[0]) +
+              glyph_ranges_.capacity() * sizeof(glyph_ranges_[0]) +
+              vertices_.capacity() * sizeof(vertices_[0]) +
+              packed_vertices_.capacity() * sizeof(packed_vertices_[0]) +
+              glyph_instances_.capacity() * sizeof(glyph_instances_[0]) +
+              glyph_info_.capacity() * sizeof(glyph_info_[0]) +
+              caret_positions_.capacity() * sizeof(caret_positions_[0]) +
+              caret_lines_.capacity() * sizeof(caret_lines_[0]) +
+              line_start_indices_.capacity() * sizeof(line_start_indices_[0]) +
+              line_states_.capacity() * sizeof(line_states_[0]) +
+              links_.capacity() * sizeof(links_[0]) +
+              referencing_row_.capacity() * sizeof(GlyphCacheRow *) +
+              glyph_bounds_.capacity() * sizeof(glyph_bounds_[0]) +
+              line_bounds_.capacity() * sizeof(line_bounds_[0]);
+  for (auto it = glyph_ranges_.begin(); it != glyph_ranges_.end(); ++it) {
+    size += it->capacity() * sizeof(GlyphRange);
+  }
+  for (auto it = line_states_.begin(); it != line_states_.end(); ++it) {
+    size += it->slice_glyph_counts.capacity() * sizeof(uint32_t);
+  }
+  for (auto it = links_.begin(); it != links_.end(); ++it) {
+    size += it->link.capacity();
+  }
+  return size;
+}
+
+void FontBuffer::UpdateBounds() const {
+  const float kInfinity = std::numeric_limits<float>::infinity();
+  auto glyph_count = vertices_.size() / kVerticesPerCodePoint;
+  glyph_bounds_.resize(glyph_count);
+  for (size_t i = 0; i < glyph_count; ++i) {
+    auto v = &vertices_[kVerticesPerCodePoint * i];
+    vec4 bounds(kInfinity);
+    for (auto j = 0; j < kVerticesPerCodePoint; ++j) {
+      auto &position = v[j].position_.data;
+      bounds = vec4::Min(bounds, vec4(position[0], position[1], -position[0],
+                                      -position[1]));
+    }
+    bounds.Pack(&glyph_bounds_[i]);
+  }
+
+  // line_start_indices_ holds the start of the first line followed by the end
+  // of every line.
+  line_bounds_.resize(line_start_indices_.size() - 1);
+  for (size_t line = 0; line < line_bounds_.size(); ++line) {
+    auto end = std::min(line_start_indices_[line + 1],
+                        static_cast<uint32_t>(glyph_count));
+    auto start = std::min(line_start_indices_[line], end);
+    MergeGlyphBounds(start, end).Pack(&line_bounds_[line]);
+  }
+  bounds_dirty_ = false;
+}
+
+vec4 FontBuffer::MergeGlyphBounds(uint32_t start, uint32_t end) const {
+  // Two accumulators let vectorized min operations overlap.
   const float kInfinity = std::numeric_limits<float>::infinity();
-  vec2 min(kInfinity);
-  vec2 max(-kInfinity);
-  for (auto i = 0; i < FontBuffer::kVerticesPerCodePoint; ++i) {
-    const vec2 position(v[i].position_.data);
-    min = vec2::Min(min, position);
-    max = vec2::Max(max, position);
-  }
-  *min_position = min;
-  *max_position = max;
+  vec4 bounds0(kInfinity);
+  vec4 bounds1(kInfinity);
+  auto i = start;
+  for (; i + 1 < end; i += 2) {
+    bounds0 = vec4::Min(bounds0, vec4(glyph_bounds_[i]));
+    bounds1 = vec4::Min(bounds1, vec4(glyph_bounds_[i + 1]));
+  }
+  if (i < end) {
+    bounds0 = vec4::Min(bounds0, vec4(glyph_bounds_[i]));
+  }
+  return vec4::Min(bounds0, bounds1);
 }
 
 std::vector<vec4> FontBuffer::CalculateBounds(int32_t start_index,
                                               int32_t end_index) const {
-  const float kInfinity = std::numeric_limits<float>::infinity();
   std::vector<vec4> extents;
 
   start_index = std::max(0, start_index);
@@ -308,45 +589,43 @@ std::vector<vec4> FontBuffer::CalculateBounds(int32_t start_index,
   const uint32_t end =
       std::min(static_cast<uint32_t>(vertices_.size()) / kVerticesPerCodePoint,
                static_cast<uint32_t>(end_index));
+  assert(start <= end && end <= line_start_indices_.back());
+  if (line_start_indices_.size() < 2) {
+    // No line has been laid out.
+    const float kInfinity = std::numeric_limits<float>::infinity();
+    extents.push_back(vec4(vec2(kInfinity), vec2(-kInfinity)));
+    return extents;
+  }
+  if (bounds_dirty_ ||
+      glyph_bounds_.size() != vertices_.size() / kVerticesPerCodePoint) {
+    UpdateBounds();
+  }
 
   // Find `line` such that line_start_indices[line] is the *end* index of
   // start's line.
-  assert(start <= end && end <= line_start_indices_.back());
-  uint32_t line = 0;
-  while (line_start_indices_[line] <= start) ++line;
-
-  // Prime the loop with the first glyph.
-  vec2 min(kInfinity);
-  vec2 max(-kInfinity);
-  for (auto i = start; i < end; ++i) {
-    // If i is on the next line, output the current extents.
-    const bool is_new_line = line_start_indices_[line] == i;
-    if (is_new_line) {
-      // Record the extents for the current line.
-      extents.push_back(vec4(min, max));
-
-      // Reset the extents for the next line.
-      min = vec2(kInfinity);
-      max = vec2(-kInfinity);
-
-      // Advance to the next line.
-      line++;
-      assert(line < line_start_indices_.size());
-    }
-
-    // Get extents of the next glyph.
-    vec2 glyph_min;
-    vec2 glyph_max;
-    VertexExtents(&vertices_[kVerticesPerCodePoint * i], &glyph_min,
-                  &glyph_max);
-
-    // Update our current bounds.
-    min = vec2::Min(min, glyph_min);
-    max = vec2::Max(min, glyph_max);
+  uint32_t line = 1;
+  while (line < line_start_indices_.size() - 1 &&
+         line_start_indices_[line] <= start) {
+    ++line;
   }
 
-  // Record the extents for the last line.
-  extents.push_back(vec4(min, max));
+  // Record the extents for every line, using the line bounds when the range
+  // covers the entire line.
+  auto i = start;
+  for (;;) {
+    auto line_end = std::min(end, line_start_indices_[line]);
+    vec4 bounds = i == line_start_indices_[line - 1] &&
+                          line_end == line_start_indices_[line]
+                      ? vec4(line_bounds_[line - 1])
+                      : MergeGlyphBounds(i, line_end);
+    extents.push_back(vec4(bounds.xy(), -bounds.zw()));
+    if (end <= line_start_indices_[line] ||
+        line + 1 >= line_start_indices_.size()) {
+      break;
+    }
+    i = line_end;
+    line++;
+  }
   return extents;
 }
 
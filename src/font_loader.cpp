@@ -0,0 +1,105 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "font_manager.h"
+#include "fplbase/utilities.h"
+#include "internal/font_loader.h"
+
+using fplbase::LogError;
+
+namespace flatui {
+
+FontLoader::FontLoader() : busy_(false), terminate_(false), ft_(nullptr) {
+  FT_Error err = FT_Init_FreeType(&ft_);
+  if (err) {
+    LogError("Can't initialize freetype. FT_Error:%d\n", err);
+    ft_ = nullptr;
+  }
+  thread_ = std::thread(&FontLoader::Run, this);
+}
+
+FontLoader::~FontLoader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    terminate_ = true;
+    queue_.clear();
+  }
+  job_condition_.notify_all();
+  thread_.join();
+  completed_.clear();
+  if (ft_) {
+    FT_Done_FreeType(ft_);
+  }
+}
+
+void FontLoader::Enqueue(std::unique_ptr<FontLoadJob> job) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(job));
+  }
+  job_condition_.notify_one();
+}
+
+void FontLoader::GetCompletedJobs(
+    std::vector<std::unique_ptr<FontLoadJob>> *jobs) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &job : completed_) {
+    jobs->push_back(std::move(job));
+  }
+  completed_.clear();
+}
+
+void FontLoader::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_condition_.wait(lock, [this] { return queue_.empty() && !busy_; });
+}
+
+bool FontLoader::HasPendingJobs() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return !queue_.empty() || busy_ || !completed_.empty();
+}
+
+void FontLoader::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    job_condition_.wait(lock, [this] { return terminate_ || !queue_.empty(); });
+    if (terminate_) {
+      break;
+    }
+    auto job = std::move(queue_.front());
+    queue_.pop_front();
+    busy_ = true;
+
+    // Load the font without holding the lock.
+    lock.unlock();
+    job->succeeded = job->face->LoadFile(job->family);
+    if (job->succeeded && ft_) {
+      job->succeeded = job->face->LoadCoverage(ft_, job->family);
+    }
+    lock.lock();
+
+    completed_.push_back(std::move(job));
+    busy_ = false;
+    if (queue_.empty()) {
+      idle_condition_.notify_all();
+    }
+  }
+}
+
+}  // namespace flatui
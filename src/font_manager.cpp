@@ -17,6 +17,7 @@
 // Freetype2 header
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include FT_OUTLINE_H
 
 // Harfbuzz header
 #include <hb.h>
@@ -26,6 +27,13 @@
 #include "font_manager.h"
 #include "fplbase/fpl_common.h"
 #include "fplbase/utilities.h"
+#include "internal/color_glyph_cache.h"
+#include "internal/font_loader.h"
+#include "internal/glyph_disk_cache.h"
+#include "internal/glyph_rasterizer.h"
+#include "internal/layout_workers.h"
+#include "internal/msdf_generator.h"
+#include "internal/shaping_cache.h"
 
 // libUnibreak header
 #include <unibreakdef.h>
@@ -34,28 +42,13 @@
 // font_manager is now using fast version of the distance computer.
 #define FONT_MANAGER_FAST_SDF_GENERATOR (1)
 #ifdef FONT_MANAGER_FAST_SDF_GENERATOR
-#include "flatui/internal/fast_antialias_distance_computer.h"
+#include "flatui/internal/simd_antialias_distance_computer.h"
 #else
 #include "flatui/internal/antialias_distance_computer.h"
 #endif
-
-// STB_image to resize PNG glyph.
-// Disable warnings in STB_image_resize.
-#ifdef _MSC_VER
-#pragma warning(push)
-#pragma warning(disable : 4100)  // Disable 'unused reference' warning.
-#else
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-variable"
-#pragma GCC diagnostic ignored "-Wunused-parameter"
-#endif /* _MSC_VER */
-#include "stb_image_resize.h"
-// Pop warning status.
-#ifdef _MSC_VER
-#pragma warning(pop)
-#else
-#pragma GCC diagnostic pop
-#endif
+#include "flatui/internal/euclidean_distance_computer.h"
+#include "flatui/internal/gpu_distance_computer.h"
+#include "flatui/trace.h"
 
 using fplbase::LogInfo;
 using fplbase::LogError;
@@ -66,16 +59,6 @@ using mathfu::vec4;
 
 namespace flatui {
 
-namespace {
-  DistanceComputer<uint8_t>* CreateAntialiasDistanceComputer() {
-#ifdef FONT_MANAGER_FAST_SDF_GENERATOR
-    return new FastAntialiasDistanceComputer<uint8_t>();
-#else
-    return new AntialiasDistanceComputer<uint8_t>();
-#endif
-  }
-}
-
 // Constants.
 static const FontBufferAttributes kHtmlLinkAttributes(true, 0x0000FFFF);
 
@@ -192,73 +175,228 @@ class WordEnumerator {
 };
 
 DistanceComputer<uint8_t>*(*FontManager::DistanceComputerFactory)(void) =
-  &CreateAntialiasDistanceComputer;
+  &FontManager::CreateDefaultDistanceComputer;
 
-FontManager::FontManager() {
-  // Initialize variables and libraries.
-  Initialize();
+DistanceComputer<uint8_t>* FontManager::CreateDefaultDistanceComputer() {
+#ifdef FONT_MANAGER_FAST_SDF_GENERATOR
+  // Use vectorized kernels when the CPU supports them.
+  if (SimdAntialiasDistanceComputer::IsSupported()) {
+    return new SimdAntialiasDistanceComputer();
+  }
+  return new FastAntialiasDistanceComputer<uint8_t>();
+#else
+  return new AntialiasDistanceComputer<uint8_t>();
+#endif
+}
 
-  // Initialize glyph cache.
-  fplutil::MutexLock lock(*cache_mutex_);
-  glyph_cache_.reset(
-      new GlyphCache(mathfu::vec2i(kGlyphCacheWidth, kGlyphCacheHeight),
-                     kGlyphCacheMaxSlices));
+DistanceComputer<uint8_t>* FontManager::CreateEuclideanDistanceComputer() {
+  return new EuclideanDistanceComputer<uint8_t>();
+}
+
+DistanceComputer<uint8_t>* FontManager::CreateGpuDistanceComputer() {
+  return new GpuDistanceComputer();
+}
+
+FontResources::FontResources(const mathfu::vec2i &cache_size,
+                             int32_t max_slices)
+    : ft(nullptr),
+      glyph_cache(new GlyphCache(cache_size, max_slices)),
+      cache_mutex(fplutil::Mutex::kModeNonRecursive),
+      thread_id(std::this_thread::get_id()) {
+  FT_Error err = FT_Init_FreeType(&ft);
+  if (err) {
+    // Error! Please fix me.
+    LogError("Can't initialize freetype. FT_Error:%d\n", err);
+    assert(0);
+  }
+}
+
+FontResources::~FontResources() {
+  // Clear font faces before the library they are opened with.
+  system_fallback_faces.clear();
+  faces.clear();
+
+  assert(ft != nullptr);
+  FT_Done_FreeType(ft);
+}
+
+LayoutLock::LayoutLock() : writer_count_(0), readers_(0) {}
+
+void LayoutLock::LockShared() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto id = std::this_thread::get_id();
+  auto &count = reader_counts_[id];
+  if (!count) {
+    condition_.wait(lock,
+                    [&] { return writer_count_ == 0 || writer_ == id; });
+  }
+  ++count;
+  ++readers_;
+}
+
+void LayoutLock::UnlockShared() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = reader_counts_.find(std::this_thread::get_id());
+  assert(it != reader_counts_.end());
+  if (!--it->second) {
+    reader_counts_.erase(it);
+  }
+  --readers_;
+  condition_.notify_all();
+}
+
+void LayoutLock::Lock() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto id = std::this_thread::get_id();
+  if (writer_count_ && writer_ == id) {
+    ++writer_count_;
+    return;
+  }
+
+  // Suspend shared holds of the thread while waiting, so that threads in
+  // layouts locking it exclusively at the same time don't wait each other.
+  auto it = reader_counts_.find(id);
+  auto own = it != reader_counts_.end() ? it->second : 0;
+  readers_ -= own;
+  if (own) {
+    condition_.notify_all();
+  }
+  condition_.wait(lock, [&] { return writer_count_ == 0 && readers_ == 0; });
+  readers_ += own;
+  writer_ = id;
+  writer_count_ = 1;
+}
+
+bool LayoutLock::TryLock() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto id = std::this_thread::get_id();
+  if (writer_count_ && writer_ == id) {
+    ++writer_count_;
+    return true;
+  }
+  auto it = reader_counts_.find(id);
+  auto own = it != reader_counts_.end() ? it->second : 0;
+  if (writer_count_ || readers_ != own) {
+    return false;
+  }
+  writer_ = id;
+  writer_count_ = 1;
+  return true;
+}
+
+void LayoutLock::Unlock() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  assert(writer_count_ && writer_ == std::this_thread::get_id());
+  if (!--writer_count_) {
+    writer_ = std::thread::id();
+    condition_.notify_all();
+  }
+}
+
+thread_local LayoutContext *FontManager::context_ = nullptr;
+
+std::shared_ptr<FontResources> FontManager::CreateSharedResources(
+    const mathfu::vec2i &cache_size, int32_t max_slices) {
+  return std::make_shared<FontResources>(cache_size, max_slices);
 }
 
-FontManager::FontManager(const mathfu::vec2i &cache_size, int32_t max_slices) {
+FontManager::FontManager()
+    : FontManager(CreateSharedResources(
+          mathfu::vec2i(kGlyphCacheWidth, kGlyphCacheHeight),
+          kGlyphCacheMaxSlices)) {}
+
+FontManager::FontManager(const mathfu::vec2i &cache_size, int32_t max_slices)
+    : FontManager(CreateSharedResources(cache_size, max_slices)) {}
+
+FontManager::FontManager(const mathfu::vec2i &cache_size, int32_t max_slices,
+                         const mathfu::vec2i &max_sdf_glyph_size)
+    : FontManager(CreateSharedResources(cache_size, max_slices)) {
+  // Pre-allocate SDF scratch buffers for the glyph size with padding.
+  sdf_reserve_size_ =
+      max_sdf_glyph_size +
+      mathfu::vec2i(kGlyphCachePaddingSDF * 2, kGlyphCachePaddingSDF * 2);
+  sdf_computer_->Reserve(sdf_reserve_size_);
+}
+
+FontManager::FontManager(const std::shared_ptr<FontResources> &resources)
+    : resources_(resources),
+      map_faces_(resources->faces),
+      font_cache_(resources->font_cache),
+      ft_(&resources->ft),
+      glyph_cache_(resources->glyph_cache.get()),
+      cache_mutex_(&resources->cache_mutex),
+      layout_lock_(&resources->layout_lock),
+      system_fallback_list_(resources->system_fallback_list),
+      system_fallback_faces_(resources->system_fallback_faces) {
   // Initialize variables and libraries.
   Initialize();
 
-  // Initialize glyph cache.
   fplutil::MutexLock lock(*cache_mutex_);
-  glyph_cache_.reset(new GlyphCache(cache_size, max_slices));
+  last_update_counter_ = glyph_cache_->get_counter();
+  glyph_cache_->set_pipeline_counters(&text_pipeline_counters_);
 }
 
 FontManager::~FontManager() {
-  // Clear font faces.
-  map_faces_.clear();
-  delete cache_mutex_;
+  // Stop workers before releasing fonts they may refer.
+  layout_workers_.reset();
+  glyph_rasterizer_.reset();
+  font_loader_.reset();
 
-  // Destroy the harfbuzz buffer.
-  hb_buffer_destroy(harfbuzz_buf_);
-  harfbuzz_buf_ = nullptr;
+  {
+    // Release glyph cache rows referenced by buffers, as other managers may
+    // use the cache.
+    ExclusiveLayoutLock layout_lock(*layout_lock_);
+    fplutil::MutexLock lock(*cache_mutex_);
+    ClearBuffers();
+    ClearBufferPool();
+    released_vertex_buffers_.clear();
+
+    // Close face instances while the font data is still open.
+    ClearFaceInstances();
+    if (glyph_cache_->get_pipeline_counters() == &text_pipeline_counters_) {
+      glyph_cache_->set_pipeline_counters(nullptr);
+    }
+  }
+  delete context_mutex_;
 
-  assert(ft_ != nullptr);
-  FT_Done_FreeType(*ft_);
+  // Font faces are released with the resources.
 }
 
 void FontManager::Initialize() {
   // Initialize variables.
   sdf_computer_ =
     std::unique_ptr<DistanceComputer<uint8_t>>(DistanceComputerFactory());
+  sdf_reserve_size_ = mathfu::kZeros2i;
   face_initialized_ = false;
   current_atlas_revision_ = 0;
   atlas_last_flush_revision_ = kNeverFlushed;
   current_pass_ = 0;
-  line_height_scale_ = kLineHeightDefault;
-  kerning_scale_ = kLineHeightDefault;
-  current_font_ = nullptr;
   version_ = &FontVersion();
+  main_context_.hyphenator = &soft_hyphenator_;
+  context_mutex_ = new fplutil::Mutex(fplutil::Mutex::kModeNonRecursive);
+  main_thread_id_ = std::this_thread::get_id();
   SetLocale(kDefaultLanguage);
-  cache_mutex_ = new fplutil::Mutex(fplutil::Mutex::kModeNonRecursive);
-  line_width_ = 0;
   ellipsis_mode_ = kEllipsisModeTruncateCharacter;
+  buffer_cache_budget_ = kFontBufferCacheUnlimited;
+  atlas_budget_ = kMemoryBudgetUnlimited;
+  fallback_font_budget_ = kMemoryBudgetUnlimited;
+  atlas_trim_pending_ = false;
+  slice_release_passes_ = 0;
+  compact_vertices_ = false;
+  glyph_instances_ = false;
+  simple_text_layout_ = false;
+  vertex_buffers_ = false;
+  system_font_eviction_passes_ = 0;
+  msdf_glyph_size_ = kMultiChannelSDFGlyphSizeDefault;
 
 #ifdef __ANDROID__
   hyb_path_ = kAndroidDefaultHybPath;
 #endif  //__ANDROID__
 
-  std::unique_ptr<FT_Library> freetype_lib(new FT_Library);
-  ft_ = std::move(freetype_lib);
-  FT_Error err = FT_Init_FreeType(ft_.get());
-  if (err) {
-    // Error! Please fix me.
-    LogError("Can't initialize freetype. FT_Error:%d\n", err);
-    assert(0);
-  }
-
-  // Create a buffer for harfbuzz.
-  harfbuzz_buf_ = hb_buffer_create();
+  shaping_cache_.reset(new ShapingCache());
+  word_break_cache_.reset(new WordBreakCache());
+  color_glyph_cache_.reset(new ColorGlyphCache());
+  html_cache_.reset(new HtmlCache());
 
   // Initialize libunibreak
   init_linebreak();
@@ -266,8 +404,112 @@ void FontManager::Initialize() {
 
 void FontManager::Terminate() {}
 
+LayoutContext::LayoutContext()
+    : current_font(nullptr),
+      line_height_scale(kLineHeightDefault),
+      kerning_scale(kKerningScaleDefault),
+      line_width(0),
+      defer_glyphs(false),
+      harfbuzz_buf(hb_buffer_create()),
+      hyphenator(nullptr) {}
+
+LayoutContext::~LayoutContext() { hb_buffer_destroy(harfbuzz_buf); }
+
+class FontManager::LayoutScope {
+ public:
+  // Layouts hold the lock shared, and APIs changing fonts, settings or caches
+  // layouts use hold it exclusively.
+  explicit LayoutScope(FontManager *manager, bool exclusive = false)
+      : lock_(manager->layout_lock_),
+        exclusive_(exclusive),
+        previous_context_(context_) {
+    auto context = manager->GetLayoutContext();
+    if (exclusive_) {
+      lock_->Lock();
+    } else {
+      lock_->LockShared();
+    }
+    context_ = context;
+
+    // Layouts in the thread that created the resources use the faces of
+    // FaceData. Other threads use faces of their own, since FreeType faces
+    // can't be used in parallel.
+    auto own_faces =
+        std::this_thread::get_id() == manager->resources_->thread_id;
+    previous_instances_ =
+        FaceInstances::Select(own_faces ? nullptr : &context->face_instances);
+  }
+  ~LayoutScope() {
+    FaceInstances::Select(previous_instances_);
+    context_ = previous_context_;
+    if (exclusive_) {
+      lock_->Unlock();
+    } else {
+      lock_->UnlockShared();
+    }
+  }
+
+ private:
+  LayoutLock *lock_;
+  bool exclusive_;
+  // The context and the instances to restore, when layout APIs are nested.
+  LayoutContext *previous_context_;
+  FaceInstances *previous_instances_;
+};
+
+LayoutContext *FontManager::GetLayoutContext() {
+  auto id = std::this_thread::get_id();
+  if (id == main_thread_id_) {
+    return &main_context_;
+  }
+  {
+    fplutil::MutexLock lock(*context_mutex_);
+    auto it = layout_contexts_.find(id);
+    if (it != layout_contexts_.end()) {
+      return it->second.get();
+    }
+  }
+
+  // Threads start with the font selected in the main thread. Wait for a
+  // layout possibly selecting it.
+  ExclusiveLayoutLock layout_lock(*layout_lock_);
+  std::unique_ptr<LayoutContext> context(new LayoutContext());
+  context->current_font = main_context_.current_font;
+  context->hyphenator = &soft_hyphenator_;
+  fplutil::MutexLock lock(*context_mutex_);
+  auto &entry = layout_contexts_[id];
+  entry = std::move(context);
+  return entry.get();
+}
+
+void FontManager::ReleaseLayoutContext() {
+  // Wait for a layout running with the context.
+  ExclusiveLayoutLock layout_lock(*layout_lock_);
+  fplutil::MutexLock lock(*context_mutex_);
+  layout_contexts_.erase(std::this_thread::get_id());
+}
+
+void FontManager::ReleaseFaceInstances(const FaceData &face) {
+  main_context_.face_instances.Release(face);
+  fplutil::MutexLock lock(*context_mutex_);
+  for (auto it = layout_contexts_.begin(); it != layout_contexts_.end();
+       ++it) {
+    it->second->face_instances.Release(face);
+  }
+}
+
+void FontManager::ClearFaceInstances() {
+  main_context_.face_instances.Clear();
+  fplutil::MutexLock lock(*context_mutex_);
+  for (auto it = layout_contexts_.begin(); it != layout_contexts_.end();
+       ++it) {
+    it->second->face_instances.Clear();
+  }
+}
+
 FontBuffer *FontManager::GetBuffer(const char *text, size_t length,
                                    const FontBufferParameters &parameter) {
+  LayoutScope scope(this);
   ErrorType buffer_error = kErrorTypeSuccess;
   auto buffer = CreateBuffer(text, static_cast<uint32_t>(length), parameter,
                              /* text_pos = */ nullptr, &buffer_error);
@@ -289,6 +531,169 @@ FontBuffer *FontManager::GetBuffer(const char *text, size_t length,
   return buffer;
 }
 
+void FontManager::GetBuffers(const FontBufferRequest *requests, size_t count,
+                             FontBuffer **buffers) {
+  if (layout_workers_) {
+    LayoutBuffersInParallel(requests, count, buffers);
+  } else {
+    LayoutScope scope(this);
+    for (size_t i = 0; i < count; ++i) {
+      auto &request = requests[i];
+      buffers[i] = GetBuffer(request.text, request.length, request.parameters);
+    }
+  }
+
+  // Render glyph images queued by the batch, and commit them in one step.
+  if (glyph_rasterizer_) {
+    glyph_rasterizer_->Wait();
+    fplutil::MutexLock lock(*cache_mutex_);
+    CommitRasterizedGlyphs();
+  }
+}
+
+void FontManager::LayoutBuffersInParallel(const FontBufferRequest *requests,
+                                          size_t count, FontBuffer **buffers) {
+  // Look up buffers in the cache in the order of the requests. Requests
+  // repeating parameters of another request are left to the ordered pass,
+  // which finds the buffer laid out for the first one.
+  std::vector<size_t> pending;
+  HbFont *font;
+  int32_t epoch;
+  {
+    LayoutScope scope(this);
+    font = context_->current_font;
+    std::unordered_map<FontBufferParameters, size_t, FontBufferParameters>
+        first_requests;
+    fplutil::MutexLock lock(*cache_mutex_);
+    for (size_t i = 0; i < count; ++i) {
+      auto &parameters = requests[i].parameters;
+      buffers[i] = FindBuffer(parameters);
+      if (buffers[i] == nullptr &&
+          first_requests.insert(std::make_pair(parameters, i)).second) {
+        pending.push_back(i);
+      }
+    }
+    epoch = glyph_cache_->get_epoch();
+  }
+
+  // Workers shape and break lines of the texts with their own contexts.
+  // Glyphs missing in the glyph cache are laid out with placeholder entries,
+  // which are recorded with the buffer.
+  struct LaidOutBuffer {
+    std::unique_ptr<FontBuffer> buffer;
+    std::vector<PlaceholderGlyph> placeholders;
+  };
+  std::vector<LaidOutBuffer> laid_out(pending.size());
+  layout_workers_->Run(pending.size(), [&](size_t index) {
+    auto &request = requests[pending[index]];
+    LayoutScope scope(this);
+    context_->current_font = font;
+    context_->defer_glyphs = true;
+    ErrorType error = kErrorTypeSuccess;
+    laid_out[index].buffer =
+        LayoutNewBuffer(request.text, static_cast<uint32_t>(request.length),
+                        request.parameters, nullptr, &error);
+    laid_out[index].placeholders.swap(context_->placeholder_glyphs);
+    context_->placeholder_glyphs.clear();
+    context_->placeholder_indices.clear();
+    context_->defer_glyphs = false;
+  });
+
+  // Add the placeholder glyphs to the glyph cache and register the buffers in
+  // the order of the requests. The others are laid out in this thread.
+  LayoutScope scope(this);
+  size_t next = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (buffers[i] != nullptr) {
+      continue;
+    }
+    auto &request = requests[i];
+    if (next < pending.size() && pending[next] == i) {
+      auto &result = laid_out[next++];
+      if (result.buffer != nullptr) {
+        fplutil::MutexLock lock(*cache_mutex_);
+        if (CommitLaidOutBuffer(request.parameters, result.placeholders, epoch,
+                                result.buffer.get())) {
+          buffers[i] = RegisterBuffer(request.parameters,
+                                      std::move(result.buffer));
+          continue;
+        }
+        RecycleBuffer(std::move(result.buffer));
+      }
+    }
+    buffers[i] = GetBuffer(request.text, request.length, request.parameters);
+  }
+}
+
+bool FontManager::CommitLaidOutBuffer(
+    const FontBufferParameters &parameters,
+    const std::vector<PlaceholderGlyph> &placeholders, int32_t epoch,
+    FontBuffer *buffer) {
+  // Glyphs the layout found in the glyph cache may have been evicted or moved
+  // since.
+  if (glyph_cache_->get_epoch() != epoch) {
+    return false;
+  }
+  auto current_font = context_->current_font;
+  auto current_size = context_->current_font->GetPixelSize();
+  auto flags = parameters.get_glyph_flags();
+
+  // Add the glyphs in the order the layout used them. The vertices of the
+  // buffer have the placeholder metrics, so the glyphs need to get the same.
+  auto result = kUVUpdateSuccess;
+  auto face_id = kNullHash;
+  for (auto it = placeholders.begin(); it != placeholders.end(); ++it) {
+    GlyphInfo info(it->face_id, it->key.get_code_point(),
+                   static_cast<float>(it->key.get_glyph_size()));
+    auto cache = ResolveGlyph(info, flags, &face_id, &result);
+    if (cache == nullptr || cache->get_size() != it->entry.get_size() ||
+        cache->get_offset() != it->entry.get_offset() ||
+        cache->get_advance() != it->entry.get_advance()) {
+      result = kUVUpdateError;
+      break;
+    }
+  }
+  // Adding glyphs may move glyphs with a compaction.
+  if (glyph_cache_->get_epoch() != epoch) {
+    result = kUVUpdateError;
+  }
+
+  // Placeholders have no position in the atlas, so patch UVs of the buffer.
+  if (result == kUVUpdateSuccess && !placeholders.empty()) {
+    result = PatchUV(flags, buffer);
+    if (result == kUVUpdateGlyphMoved) {
+      result = RebuildUV(flags, buffer);
+    }
+  }
+
+  // Workers don't reference cache rows, since the buffer isn't registered
+  // while the glyph cache is updated by other layouts.
+  if (result == kUVUpdateSuccess && parameters.get_ref_count_flag()) {
+    auto &glyph_info = buffer->get_glyph_info();
+    face_id = kNullHash;
+    for (auto it = glyph_info.begin(); it != glyph_info.end(); ++it) {
+      auto cache = ResolveGlyph(*it, flags, &face_id, &result);
+      if (cache == nullptr) {
+        break;
+      }
+      auto row = cache->get_row();
+      if (buffer->AddCacheRowReference(&*row)) {
+        row->AddRef(buffer);
+      }
+    }
+  }
+
+  // Restore font.
+  context_->current_font = current_font;
+  context_->current_font->SetPixelSize(current_size);
+
+  if (result != kUVUpdateSuccess) {
+    return false;
+  }
+  buffer->set_revision(glyph_cache_->get_revision());
+  return true;
+}
+
 void FontManager::SetFontProperties(const HtmlSection &font_section,
                                     FontBufferParameters *param,
                                     FontBufferContext *ctx) {
@@ -296,7 +701,7 @@ void FontManager::SetFontProperties(const HtmlSection &font_section,
   if (face != "") {
     SelectFont(face);
   } else {
-    current_font_ = ctx->original_font();
+    context_->current_font = ctx->original_font();
   }
   bool has_link = !font_section.link().empty();
   // Set the attributes for either link (underlined & blue),
@@ -320,6 +725,8 @@ void FontManager::SetFontProperties(const HtmlSection &font_section,
 
 FontBuffer *FontManager::GetHtmlBuffer(const char *html,
                                        const FontBufferParameters &parameters) {
+  LayoutScope scope(this);
+  HtmlCache::SectionsPtr html_sections;
   {
     // Acquire cache mutex.
     fplutil::MutexLock lock(*cache_mutex_);
@@ -329,6 +736,7 @@ FontBuffer *FontManager::GetHtmlBuffer(const char *html,
     if (buffer != nullptr) {
       return buffer;
     }
+    html_sections = html_cache_->Find(html);
   }
 
   if (parameters.get_cache_id() == kNullHash) {
@@ -337,33 +745,45 @@ FontBuffer *FontManager::GetHtmlBuffer(const char *html,
         "to have correct linked list set up.");
   }
 
-  // Convert HTML into subsections that have the same formatting.
-  std::vector<HtmlSection> html_sections;
-  const bool parsed = ParseHtml(html, &html_sections);
-  if (!parsed) {
-    fplbase::LogError("Failed to parse HTML.");
-    return nullptr;
+  // Convert HTML into subsections that have the same formatting, unless the
+  // HTML was parsed recently.
+  if (!html_sections) {
+    std::shared_ptr<std::vector<HtmlSection>> parsed_sections(
+        new std::vector<HtmlSection>());
+    const bool parsed = ParseHtml(html, parsed_sections.get());
+    if (!parsed) {
+      fplbase::LogError("Failed to parse HTML.");
+      return nullptr;
+    }
+    html_sections = parsed_sections;
+    fplutil::MutexLock lock(*cache_mutex_);
+    html_cache_->Store(html, html_sections);
   }
 
   // Otherwise create new buffer.
   FontBufferContext ctx;
   ctx.set_appending_buffer(true);
-  ctx.set_original_font(current_font_);
+  ctx.set_original_font(context_->current_font);
   ctx.set_original_font_size(parameters.get_font_size());
   ctx.set_current_font_size(parameters.get_font_size());
 
   mathfu::vec2 pos = GetStartPosition(parameters);
   ErrorType buffer_error = kErrorTypeSuccess;
-  FontBuffer *buffer = CreateBuffer("", 0, parameters, &pos, &buffer_error);
+  auto buffer = LayoutNewBuffer("", 0, parameters, &pos, &buffer_error);
   if (buffer == nullptr) {
     fplbase::LogError("Failed to create buffer (%d).", buffer_error);
     return nullptr;
   }
+  int32_t epoch;
+  {
+    fplutil::MutexLock lock(*cache_mutex_);
+    epoch = glyph_cache_->get_epoch();
+  }
 
   // Use non-const version of the parameter for a font size change.
   auto param = parameters;
-  for (size_t i = 0; i < html_sections.size(); ++i) {
-    auto &s = html_sections[i];
+  for (size_t i = 0; i < html_sections->size(); ++i) {
+    auto &s = (*html_sections)[i];
 
     // Get the glyph index before appending text.
     const int32_t start_glyph_index = buffer->get_glyph_count();
@@ -372,9 +792,8 @@ FontBuffer *FontManager::GetHtmlBuffer(const char *html,
 
     // Append text as per usual.
     if (s.text().length()) {
-      fplutil::MutexLock lock(*cache_mutex_);
-      FillBuffer(s.text().c_str(), s.text().length(), param, buffer, &ctx,
-                 &pos);
+      FillBuffer(s.text().c_str(), s.text().length(), param, buffer.get(),
+                 &ctx, &pos);
     }
 
     // Record link info.
@@ -393,17 +812,38 @@ FontBuffer *FontManager::GetHtmlBuffer(const char *html,
   ctx.set_lastline_must_break(true);
   buffer->UpdateLine(param, layout_direction_, &ctx);
 
-  return buffer;
+  // Register the buffer once all sections are laid out, so that other threads
+  // don't find it partially filled.
+  {
+    fplutil::MutexLock lock(*cache_mutex_);
+    if (glyph_cache_->get_epoch() == epoch) {
+      return RegisterBuffer(parameters, std::move(buffer));
+    }
+
+    // Glyphs laid out may have been evicted or moved, see LayoutNewBuffer().
+    RecycleBuffer(std::move(buffer));
+  }
+  return GetHtmlBuffer(html, parameters);
 }
 
 FontBuffer *FontManager::FindBuffer(const FontBufferParameters &parameters) {
   auto it = map_buffers_.find(parameters);
   if (it != map_buffers_.end()) {
+    buffer_cache_stats_.hits++;
+
     // Update current pass.
     if (current_pass_ != kRenderPass) {
       it->second->set_pass(current_pass_);
     }
 
+    // Mark the buffer as most recently used.
+    auto buffer = it->second.get();
+    buffer->last_used_counter_ = glyph_cache_->get_counter();
+    if (!parameters.get_ref_count_flag()) {
+      lru_buffers_.splice(lru_buffers_.begin(), lru_buffers_,
+                          buffer->it_lru_);
+    }
+
     // Update UV of the buffer
     auto ret = UpdateUV(parameters.get_glyph_flags(), it->second.get());
 
@@ -413,6 +853,7 @@ FontBuffer *FontManager::FindBuffer(const FontBufferParameters &parameters) {
     }
     return ret;
   }
+  buffer_cache_stats_.misses++;
   return nullptr;
 }
 
@@ -430,31 +871,69 @@ FontBuffer *FontManager::CreateBuffer(const char *text, uint32_t length,
                                       const FontBufferParameters &parameters,
                                       mathfu::vec2 *text_pos,
                                       ErrorType *error) {
-  // Acquire cache mutex.
-  fplutil::MutexLock lock(*cache_mutex_);
+  {
+    // Acquire cache mutex.
+    fplutil::MutexLock lock(*cache_mutex_);
 
-  // Check cache if we already have a FontBuffer generated.
-  auto ret = FindBuffer(parameters);
-  if (ret != nullptr) {
-    return ret;
+    // Check cache if we already have a FontBuffer generated.
+    auto ret = FindBuffer(parameters);
+    if (ret != nullptr) {
+      return ret;
+    }
   }
 
   // Otherwise, create new FontBuffer.
+  auto buffer = LayoutNewBuffer(text, length, parameters, text_pos, error);
+  if (buffer == nullptr) {
+    return nullptr;
+  }
+  fplutil::MutexLock lock(*cache_mutex_);
+  return RegisterBuffer(parameters, std::move(buffer));
+}
 
-  // Create FontBuffer with derived string length.
-  std::unique_ptr<FontBuffer> buffer(
-      new FontBuffer(length, parameters.get_caret_info_flag()));
+std::unique_ptr<FontBuffer> FontManager::LayoutNewBuffer(
+    const char *text, uint32_t length, const FontBufferParameters &parameters,
+    mathfu::vec2 *text_pos, ErrorType *error) {
+  auto start_pos = text_pos != nullptr ? *text_pos : vec2();
+  for (;;) {
+    // Create FontBuffer with derived string length.
+    std::unique_ptr<FontBuffer> buffer;
+    int32_t epoch;
+    {
+      fplutil::MutexLock lock(*cache_mutex_);
+      buffer = AllocateBuffer(length, parameters.get_caret_info_flag());
+      epoch = glyph_cache_->get_epoch();
+    }
 
-  // Set initial attribute.
-  FontBufferContext ctx;
-  ctx.SetAttribute(FontBufferAttributes());
-  line_width_ = 0;
+    // Set initial attribute.
+    FontBufferContext ctx;
+    ctx.SetAttribute(FontBufferAttributes());
+    context_->line_width = 0;
 
-  if (!FillBuffer(text, length, parameters, buffer.get(), &ctx, text_pos,
-                  error)) {
-    return nullptr;
+    // The layout runs in parallel with layouts in other threads.
+    auto filled = FillBuffer(text, length, parameters, buffer.get(), &ctx,
+                             text_pos, error);
+    fplutil::MutexLock lock(*cache_mutex_);
+    if (!filled) {
+      RecycleBuffer(std::move(buffer));
+      return nullptr;
+    }
+    if (glyph_cache_->get_epoch() == epoch) {
+      return buffer;
+    }
+
+    // Glyphs laid out may have been evicted or moved, e.g. by another thread
+    // flushing the glyph cache while this thread waited for the exclusive
+    // layout lock. Lay out the text again rather than registering the buffer.
+    RecycleBuffer(std::move(buffer));
+    if (text_pos != nullptr) {
+      *text_pos = start_pos;
+    }
   }
+}
 
+FontBuffer *FontManager::RegisterBuffer(const FontBufferParameters &parameters,
+                                        std::unique_ptr<FontBuffer> buffer) {
   // Initialize reference counter.
   buffer->set_ref_count(1);
 
@@ -466,107 +945,525 @@ FontBuffer *FontManager::CreateBuffer(const char *text, uint32_t length,
   // Verify the buffer.
   assert(buffer->Verify());
 
+  // The layout has finished, pack vertices for rendering.
+  if (glyph_instances_) {
+    buffer->BuildGlyphInstances();
+  } else if (compact_vertices_) {
+    buffer->PackVertices();
+  }
+
+  // Compute glyph bounds once, so that CalculateBounds() calls only merge them.
+  buffer->UpdateBounds();
+
   // Insert the created entry to the hash map.
   auto insert = map_buffers_.insert(
       std::pair<FontBufferParameters, std::unique_ptr<FontBuffer>>(
-          parameters, std::move(buffer)));
+          parameters, nullptr));
+  if (!insert.second) {
+    // Another thread has registered a buffer with the parameters while the
+    // buffer was laid out, or a buffer failed to update is still in the map.
+    RecycleBuffer(std::move(buffer));
+    auto ret = insert.first->second.get();
+    if (parameters.get_ref_count_flag()) {
+      ret->set_ref_count(ret->get_ref_count() + 1);
+    }
+    return ret;
+  }
+  insert.first->second = std::move(buffer);
 
   // Set up a back reference from the buffer to the map.
-  insert.first->second->set_iterator(insert.first);
-  return insert.first->second.get();
+  auto ret = insert.first->second.get();
+  ret->set_parameters(&insert.first->first);
+
+  // Account the buffer in the cache budget.
+  ret->last_used_counter_ = glyph_cache_->get_counter();
+  ret->memory_size_ = ret->GetMemorySize();
+  buffer_cache_stats_.bytes += ret->memory_size_;
+  buffer_cache_stats_.num_buffers = map_buffers_.size();
+  if (!parameters.get_ref_count_flag()) {
+    lru_buffers_.push_front(ret);
+    ret->it_lru_ = lru_buffers_.begin();
+  }
+  EvictBuffers();
+  return ret;
 }
 
-FontBuffer *FontManager::FillBuffer(const char *text, uint32_t length,
-                                    const FontBufferParameters &parameters,
-                                    FontBuffer *buffer,
-                                    FontBufferContext *context,
-                                    mathfu::vec2 *text_pos, ErrorType *error) {
-  auto size = parameters.get_size();
-  auto multi_line = parameters.get_multi_line_setting();
-  auto caret_info = parameters.get_caret_info_flag();
-  auto ysize = static_cast<int32_t>(parameters.get_font_size());
-  auto converted_ysize = ConvertSize(ysize);
-  float scale = ysize / static_cast<float>(converted_ysize);
+void FontManager::EraseBuffer(FontBuffer *buffer) {
+  if (!buffer->get_parameters()->get_ref_count_flag()) {
+    lru_buffers_.erase(buffer->it_lru_);
+  }
+  buffer_cache_stats_.bytes -= buffer->memory_size_;
 
-  // Update text metrices.
-  SetLineHeightScale(parameters.get_line_height_scale());
-  SetKerningScale(parameters.get_kerning_scale());
+  auto it = map_buffers_.find(*buffer->get_parameters());
+  auto released = std::move(it->second);
+  map_buffers_.erase(it);
+  buffer_cache_stats_.num_buffers = map_buffers_.size();
+  RecycleBuffer(std::move(released));
+}
 
-  // Set freetype settings.
-  current_font_->SetPixelSize(converted_ysize);
+std::unique_ptr<FontBuffer> FontManager::AllocateBuffer(uint32_t length,
+                                                        bool caret_info) {
+  if (buffer_pool_.empty()) {
+    return std::unique_ptr<FontBuffer>(new FontBuffer(length, caret_info));
+  }
+  auto buffer = std::move(buffer_pool_.back());
+  buffer_pool_.pop_back();
+  buffer->Reset(length, caret_info);
+  return buffer;
+}
 
-  // Retrieve word breaking information using libunibreak.
-  auto buffer_length = length ? length + 1 : 0;
-  wordbreak_info_.resize(buffer_length);
-  if (length) {
-    // We tweak the last byte of libunibreak's output rather than always to have
-    // LINEBREAK_MUSTBREAK but can be either ALLOWBREAK or MUSTBREAK to work
-    // with the appending FontBuffers feature.
-    // libUnibreak won't access out of range of 'text' as it's expected 0
-    // terminated string.
-    set_linebreaks_utf8(reinterpret_cast<const utf8_t *>(text), buffer_length,
-                        language_.c_str(), &wordbreak_info_[0]);
-    // Dispose the last element and update the last element.
-    wordbreak_info_.pop_back();
-    if (wordbreak_info_.back() != LINEBREAK_MUSTBREAK) {
-      wordbreak_info_.back() = LINEBREAK_ALLOWBREAK;
-    }
-  }
-  if (current_font_->IsComplexFont()) {
-    // Analyze the text and set up an array of font face indices.
-    auto font = reinterpret_cast<HbComplexFont *>(current_font_);
-    if (font->AnalyzeFontFaceRun(text, length, &fontface_index_) > 1) {
-      // If we need to switch faces for the text, take a multi line path.
-      multi_line = true;
-    }
-  } else {
-    fontface_index_.clear();
+void FontManager::RecycleBuffer(std::unique_ptr<FontBuffer> buffer) {
+  // Large buffers are freed, since pooled buffers are out of the cache budget.
+  if (buffer_pool_.size() >= kFontBufferPoolSize ||
+      buffer->GetMemorySize() > kFontBufferPoolMaxBufferSize) {
+    ReleaseVertexBuffer(buffer.get());
+    return;
   }
-  WordEnumerator word_enum(wordbreak_info_, fontface_index_, multi_line);
+  // Release rows now, so that evicted rows don't reach pooled buffers.
+  buffer->ReleaseCacheRowReference();
+  buffer_pool_.push_back(std::move(buffer));
+}
 
-  // Initialize font metrics parameters.
-  int32_t max_line_width = 0;
-  // Height calculation needs to use ysize before conversion.
-  float total_height = ysize;
-  bool first_character = true;
-  auto line_height = ysize * line_height_scale_;
-  FontMetrics initial_metrics;
-  int32_t base_line = context->original_base_line();
-  if (!base_line) {
-    // The context has not been set yet. Initialize metrics.
-    base_line = current_font_->GetBaseLine(ysize);
-    context->set_original_base_line(base_line);
-    initial_metrics =
-        FontMetrics(base_line, 0, base_line, base_line - ysize, 0);
-  } else {
-    // Appending FontBuffers, restore parameters from existing context and
-    // buffer.
-    initial_metrics = buffer->metrics();
-    max_line_width = buffer->get_size().x * kFreeTypeUnit;
-    total_height = static_cast<float>(buffer->get_size().y);
+void FontManager::ClearBuffers() {
+  for (auto it = map_buffers_.begin(); it != map_buffers_.end(); ++it) {
+    ReleaseVertexBuffer(it->second.get());
+  }
+  lru_buffers_.clear();
+  map_buffers_.clear();
+  buffer_cache_stats_.bytes = 0;
+  buffer_cache_stats_.num_buffers = 0;
+}
 
-    if (context->current_font_size() != ysize) {
-      // Adjust glyph positions in current line?
-      auto offset = buffer->AdjustCurrentLine(parameters, context);
-      if (text_pos != nullptr) {
-        text_pos->y += offset;
-      }
-      context->set_current_font_size(ysize);
-    }
+void FontManager::ClearBufferPool() {
+  for (auto it = buffer_pool_.begin(); it != buffer_pool_.end(); ++it) {
+    ReleaseVertexBuffer(it->get());
   }
+  buffer_pool_.clear();
+}
 
-  // Set up positions.
-  const mathfu::vec2 pos_start = GetStartPosition(parameters);
-  mathfu::vec2 pos = pos_start;
-  if (text_pos != nullptr) {
-    pos = *text_pos;
+void FontManager::ReleaseVertexBuffer(FontBuffer *buffer) {
+  // The GL buffer can't be deleted here, since buffers may be released in a
+  // thread without a GL context.
+  if (buffer->vertex_buffer_) {
+    released_vertex_buffers_.push_back(std::move(buffer->vertex_buffer_));
   }
+}
 
-  // Find words and layout them.
-  while (word_enum.Advance()) {
-    // Set font face index for current word.
-    current_font_->SetCurrentFaceIndex(word_enum.GetCurrentFaceIndex());
-    bool layout_success = false;
+void FontManager::EvictBuffers() {
+  if (buffer_cache_budget_ == kFontBufferCacheUnlimited) {
+    return;
+  }
+  EvictBuffers(buffer_cache_budget_);
+}
+
+void FontManager::EvictBuffers(size_t budget) {
+  auto counter = glyph_cache_->get_counter();
+  while (buffer_cache_stats_.bytes > budget && !lru_buffers_.empty()) {
+    // Keep buffers used in the current and the previous pass, since callers
+    // may still hold pointers to them (e.g. buffers looked up in a layout pass
+    // and rendered in the following render pass).
+    auto buffer = lru_buffers_.back();
+    if (counter - buffer->last_used_counter_ <= 1) {
+      break;
+    }
+    EraseBuffer(buffer);
+    buffer_cache_stats_.evictions++;
+  }
+}
+
+void FontManager::FlushLayout() {
+  // Acquire cache mutex.
+  fplutil::MutexLock lock(*cache_mutex_);
+
+  // Erase only non-ref-counted buffers.
+  while (!lru_buffers_.empty()) {
+    EraseBuffer(lru_buffers_.back());
+  }
+}
+
+void FontManager::SetFontBufferCacheBudget(size_t bytes) {
+  fplutil::MutexLock lock(*cache_mutex_);
+  buffer_cache_budget_ = bytes;
+  EvictBuffers();
+}
+
+void FontManager::ResetFontBufferCacheStats() {
+  fplutil::MutexLock lock(*cache_mutex_);
+  buffer_cache_stats_.hits = 0;
+  buffer_cache_stats_.misses = 0;
+  buffer_cache_stats_.evictions = 0;
+}
+
+TextPipelineStats FontManager::GetTextPipelineStats() const {
+  auto &counters = text_pipeline_counters_;
+  TextPipelineStats stats;
+  stats.glyph_lookups = counters.Get(TextPipelineCounters::kGlyphLookups);
+  stats.glyph_hits = counters.Get(TextPipelineCounters::kGlyphHits);
+  stats.glyph_misses = counters.Get(TextPipelineCounters::kGlyphMisses);
+  stats.glyph_sets = counters.Get(TextPipelineCounters::kGlyphSets);
+  stats.rasterize_time = counters.Get(TextPipelineCounters::kRasterizeTime);
+  stats.sdf_time = counters.Get(TextPipelineCounters::kSdfTime);
+  stats.shaping_time = counters.Get(TextPipelineCounters::kShapingTime);
+  stats.shaped_runs = counters.Get(TextPipelineCounters::kShapedRuns);
+  stats.simple_runs = counters.Get(TextPipelineCounters::kSimpleRuns);
+  stats.upload_bytes = counters.Get(TextPipelineCounters::kUploadBytes);
+
+  fplutil::MutexLock lock(*cache_mutex_);
+  stats.buffer_hits = buffer_cache_stats_.hits;
+  stats.buffer_misses = buffer_cache_stats_.misses;
+  stats.buffer_evictions = buffer_cache_stats_.evictions;
+  return stats;
+}
+
+void FontManager::ResetTextPipelineStats() {
+  text_pipeline_counters_.Reset();
+  ResetFontBufferCacheStats();
+}
+
+FontMemoryUsage FontManager::GetMemoryUsage() const {
+  ExclusiveLayoutLock layout_lock(*layout_lock_);
+  fplutil::MutexLock lock(*cache_mutex_);
+  FontMemoryUsage usage;
+
+  // Glyph cache.
+  auto &cache = *glyph_cache_;
+  usage.atlas_monochrome = cache.get_monochrome_buffer()->GetMemorySize();
+  usage.atlas_color = cache.get_color_buffer()->GetMemorySize();
+  usage.atlas_msdf = cache.get_msdf_buffer()->GetMemorySize();
+  usage.glyph_entries = glyph_cache_->GetMetadataMemorySize();
+
+  // FontBuffers. Sizes are computed again since buffers in the cache may have
+  // grown after they were registered.
+  for (auto it = map_buffers_.begin(); it != map_buffers_.end(); ++it) {
+    usage.font_buffers += it->second->GetMemorySize();
+  }
+  for (auto it = buffer_pool_.begin(); it != buffer_pool_.end(); ++it) {
+    usage.font_buffers += (*it)->GetMemorySize();
+  }
+
+  // Fonts.
+  for (auto it = map_faces_.begin(); it != map_faces_.end(); ++it) {
+    usage.mapped_font_data += it->second->get_mapped_data_size();
+    usage.copied_font_data += it->second->get_copied_data_size();
+    usage.harfbuzz_fonts += it->second->get_coverage().GetMemorySize() +
+                            it->second->get_simple_glyph_table_size();
+  }
+  for (auto it = font_cache_.begin(); it != font_cache_.end(); ++it) {
+    usage.harfbuzz_fonts += it->second->GetMemorySize();
+  }
+  usage.harfbuzz_fonts += main_context_.face_instances.GetMemorySize();
+  {
+    fplutil::MutexLock context_lock(*context_mutex_);
+    for (auto it = layout_contexts_.begin(); it != layout_contexts_.end();
+         ++it) {
+      usage.harfbuzz_fonts += it->second->face_instances.GetMemorySize();
+    }
+  }
+
+  // Hyphenation.
+  for (auto it = hyphenators_.begin(); it != hyphenators_.end(); ++it) {
+    usage.hyphenation += it->second->GetMemorySize();
+  }
+  usage.hyphenation += hyphenation_cache_.GetMemorySize();
+
+  usage.layout_caches =
+      shaping_cache_->GetMemorySize() + word_break_cache_->GetMemorySize() +
+      html_cache_->GetMemorySize() + color_glyph_cache_->GetMemorySize();
+  return usage;
+}
+
+void FontManager::SetMemoryBudget(const FontMemoryBudget &budget) {
+  ExclusiveLayoutLock layout_lock(*layout_lock_);
+  fplutil::MutexLock lock(*cache_mutex_);
+  buffer_cache_budget_ = budget.font_buffers;
+  atlas_budget_ = budget.atlas;
+  fallback_font_budget_ = budget.fallback_font_data;
+  EvictBuffers();
+  if (fallback_font_budget_ != kMemoryBudgetUnlimited) {
+    TrimSystemFontFaces(fallback_font_budget_);
+  }
+}
+
+FontMemoryBudget FontManager::GetMemoryBudget() const {
+  FontMemoryBudget budget;
+  budget.font_buffers = buffer_cache_budget_;
+  budget.atlas = atlas_budget_;
+  budget.fallback_font_data = fallback_font_budget_;
+  return budget;
+}
+
+void FontManager::TrimMemory(MemoryTrimLevel level) {
+  ExclusiveLayoutLock layout_lock(*layout_lock_);
+  fplutil::MutexLock lock(*cache_mutex_);
+  EvictBuffers(0);
+  ClearBufferPool();
+  TrimSystemFontFaces(0);
+
+  // Faces of layout threads are opened again when they are used.
+  ClearFaceInstances();
+
+  // Atlas textures are deleted in the rendering thread.
+  atlas_trim_pending_ = true;
+
+  if (level >= kMemoryTrimLevelComplete) {
+    shaping_cache_->Clear();
+    word_break_cache_->Clear();
+    html_cache_->Clear();
+    color_glyph_cache_->Clear();
+    hyphenation_cache_.Clear();
+
+    // Hyphenators are opened again when their rules are selected, which
+    // layouts do before hyphenating texts.
+    hyphenators_.clear();
+  }
+}
+
+FontBuffer *FontManager::EditBuffer(
+    const FontBufferParameters &base_parameters, const char *text,
+    size_t length, const FontBufferParameters &parameters, size_t edit_start) {
+  LayoutScope scope(this);
+  {
+    // Acquire cache mutex.
+    fplutil::MutexLock lock(*cache_mutex_);
+
+    auto ret = FindBuffer(parameters);
+    if (ret != nullptr) {
+      return ret;
+    }
+  }
+  ErrorType error = kErrorTypeSuccess;
+  auto ret = RelayoutBuffer(base_parameters, text,
+                            static_cast<uint32_t>(length), parameters,
+                            edit_start, &error);
+  if (ret != nullptr) {
+    return ret;
+  }
+
+  // Lay out the whole text when lines can't be reused.
+  return GetBuffer(text, length, parameters);
+}
+
+FontBuffer *FontManager::RelayoutBuffer(
+    const FontBufferParameters &base_parameters, const char *text,
+    uint32_t length, const FontBufferParameters &parameters,
+    size_t edit_start, ErrorType *error) {
+  LayoutScope scope(this);
+  std::unique_ptr<FontBuffer> new_buffer;
+  FontBufferContext ctx;
+  size_t line = 0;
+  uint32_t text_index = 0;
+  mathfu::vec2 pos = mathfu::kZeros2f;
+  int32_t flush_revision = 0;
+  {
+    // Copy the lines before the edit under the lock, since the base buffer
+    // may be released in other threads.
+    fplutil::MutexLock lock(*cache_mutex_);
+    auto it = map_buffers_.find(base_parameters);
+    if (it == map_buffers_.end()) {
+      return nullptr;
+    }
+    auto buffer = it->second.get();
+    if (!buffer->valid_ || !buffer->links_.empty() ||
+        GetFontBufferStatus(*buffer) == kFontBufferStatusNeedReconstruct ||
+        !buffer->get_parameters()->HasSameLayout(parameters) ||
+        edit_start > length) {
+      return nullptr;
+    }
+
+    // Find the line with the edit. The line before it is laid out again too,
+    // since the edit may move words back to it.
+    auto &line_states = buffer->line_states_;
+    while (line < line_states.size() &&
+           line_states[line].text_index <= edit_start) {
+      ++line;
+    }
+    if (line < 2) {
+      // The first or the second line is edited. Nothing to reuse.
+      return nullptr;
+    }
+    line -= 2;
+
+    new_buffer = AllocateBuffer(length, parameters.get_caret_info_flag());
+    ctx.SetAttribute(FontBufferAttributes());
+    new_buffer->CopyLines(*buffer, line, &ctx);
+
+    auto &state = line_states[line];
+    text_index = state.text_index;
+    pos = state.pos;
+    flush_revision = glyph_cache_->get_last_flush_revision();
+  }
+  context_->line_width = 0;
+
+  if (!FillBuffer(text + text_index, length - text_index, parameters,
+                  new_buffer.get(), &ctx, &pos, error)) {
+    fplutil::MutexLock lock(*cache_mutex_);
+    RecycleBuffer(std::move(new_buffer));
+    return nullptr;
+  }
+
+  // Line states of the relaid out lines are relative to the text index.
+  auto &new_states = new_buffer->line_states_;
+  for (auto i = line + 1; i < new_states.size(); ++i) {
+    new_states[i].text_index += text_index;
+  }
+  fplutil::MutexLock lock(*cache_mutex_);
+  if (glyph_cache_->get_last_flush_revision() != flush_revision) {
+    // Copied glyphs may have been evicted while laying out following lines.
+    new_buffer->set_revision(glyph_cache_->get_last_flush_revision());
+  }
+  return RegisterBuffer(parameters, std::move(new_buffer));
+}
+
+FontBuffer *FontManager::FillBuffer(const char *text, uint32_t length,
+                                    const FontBufferParameters &parameters,
+                                    FontBuffer *buffer,
+                                    FontBufferContext *context,
+                                    mathfu::vec2 *text_pos, ErrorType *error) {
+  FLATUI_TRACE_SCOPE("FontManager::FillBuffer", parameters.get_text_id());
+  auto size = parameters.get_size();
+  auto multi_line = parameters.get_multi_line_setting();
+  auto caret_info = parameters.get_caret_info_flag();
+  auto ysize = static_cast<int32_t>(parameters.get_font_size());
+  auto converted_ysize = ConvertSize(ysize, parameters.get_glyph_flags());
+  float scale = ysize / static_cast<float>(converted_ysize);
+
+  // Update text metrices.
+  SetLineHeightScale(parameters.get_line_height_scale());
+  SetKerningScale(parameters.get_kerning_scale());
+
+  // Set freetype settings.
+  context_->current_font->SetPixelSize(converted_ysize);
+
+  if (parameters.get_enable_hyphenation_flag()) {
+    SelectHyphenator(parameters);
+  }
+
+  // Word breaks of texts laid out recently are restored from the cache, so
+  // that resized texts only need to break lines again.
+  int32_t num_runs = 1;
+  auto &decoded_text = context_->decoded_text;
+  decoded_text.Clear();
+  auto restored = false;
+  if (length) {
+    // Caches are shared by layouts in all threads.
+    fplutil::MutexLock lock(*cache_mutex_);
+    restored = word_break_cache_->Restore(
+        text, length, language_, context_->current_font->GetFontId(),
+        &context_->wordbreak_info, &context_->fontface_index, &num_runs);
+  }
+  if (!restored) {
+    // Decode the text once for line breaking, font face analysis and
+    // shaping of its words.
+    decoded_text.Decode(text, length);
+
+    // Retrieve word breaking information using libunibreak.
+    auto buffer_length = length ? length + 1 : 0;
+    context_->wordbreak_info.resize(buffer_length);
+    if (length) {
+      // We tweak the last byte of libunibreak's output rather than always to
+      // have LINEBREAK_MUSTBREAK but can be either ALLOWBREAK or MUSTBREAK to
+      // work with the appending FontBuffers feature.
+      // libUnibreak won't access out of range of 'text' as it's expected 0
+      // terminated string.
+      if (decoded_text.is_well_formed()) {
+        decoded_text.SetLineBreaks(language_.c_str(),
+                                   &context_->wordbreak_info);
+      } else {
+        set_linebreaks_utf8(reinterpret_cast<const utf8_t *>(text),
+                            buffer_length, language_.c_str(),
+                            &context_->wordbreak_info[0]);
+      }
+      // Dispose the last element and update the last element.
+      context_->wordbreak_info.pop_back();
+      if (context_->wordbreak_info.back() != LINEBREAK_MUSTBREAK) {
+        context_->wordbreak_info.back() = LINEBREAK_ALLOWBREAK;
+      }
+    }
+    if (context_->current_font->IsComplexFont()) {
+      // Analyze the text and set up an array of font face indices.
+      auto font = reinterpret_cast<HbComplexFont *>(context_->current_font);
+      num_runs = decoded_text.is_well_formed()
+                     ? font->AnalyzeFontFaceRun(decoded_text,
+                                                &context_->fontface_index)
+                     : font->AnalyzeFontFaceRun(text, length,
+                                                &context_->fontface_index);
+    } else {
+      context_->fontface_index.clear();
+    }
+    if (length) {
+      fplutil::MutexLock lock(*cache_mutex_);
+      word_break_cache_->Store(text, length, language_,
+                               context_->current_font->GetFontId(),
+                               context_->wordbreak_info,
+                               context_->fontface_index, num_runs);
+    }
+  }
+  if (num_runs > 1) {
+    // If we need to switch faces for the text, take a multi line path.
+    multi_line = true;
+  }
+  WordEnumerator word_enum(context_->wordbreak_info, context_->fontface_index,
+                           multi_line);
+
+  // Initialize font metrics parameters.
+  int32_t max_line_width = 0;
+  // Height calculation needs to use ysize before conversion.
+  float total_height = ysize;
+  bool first_character = true;
+  auto line_height = ysize * context_->line_height_scale;
+  FontMetrics initial_metrics;
+  int32_t base_line = context->original_base_line();
+  if (!base_line) {
+    // The context has not been set yet. Initialize metrics.
+    base_line = context_->current_font->GetBaseLine(ysize);
+    context->set_original_base_line(base_line);
+    initial_metrics =
+        FontMetrics(base_line, 0, base_line, base_line - ysize, 0);
+  } else {
+    // Appending FontBuffers, restore parameters from existing context and
+    // buffer.
+    initial_metrics = buffer->metrics();
+    max_line_width = buffer->get_size().x * kFreeTypeUnit;
+    total_height = static_cast<float>(buffer->get_size().y);
+
+    if (context->current_font_size() != ysize) {
+      // Adjust glyph positions in current line?
+      auto offset = buffer->AdjustCurrentLine(parameters, context);
+      if (text_pos != nullptr) {
+        text_pos->y += offset;
+      }
+      context->set_current_font_size(ysize);
+    }
+  }
+
+  // Continue the layout from a recorded line start of an edited text.
+  auto resume_line = context->resume_line();
+  if (resume_line != nullptr) {
+    initial_metrics = resume_line->metrics;
+    max_line_width = resume_line->max_line_width;
+    total_height = resume_line->total_height;
+    first_character = resume_line->first_character;
+  }
+
+  // Set up positions.
+  const mathfu::vec2 pos_start = GetStartPosition(parameters);
+  mathfu::vec2 pos = pos_start;
+  if (text_pos != nullptr) {
+    pos = *text_pos;
+  }
+
+  // Find words and layout them.
+  while (word_enum.Advance()) {
+    // Set font face index for current word.
+    auto face_index = word_enum.GetCurrentFaceIndex();
+    if (!system_fallback_faces_.empty() &&
+        context_->current_font->IsComplexFont()) {
+      fplutil::MutexLock lock(*cache_mutex_);
+      LoadSystemFontFace(static_cast<HbComplexFont *>(context_->current_font)
+                             ->GetFace(face_index));
+    }
+    context_->current_font->SetCurrentFaceIndex(face_index);
+    bool layout_success = false;
 
     auto max_width = size.x * kFreeTypeUnit;
     if (!multi_line) {
@@ -614,7 +1511,7 @@ FontBuffer *FontManager::FillBuffer(const char *text, uint32_t length,
       auto word_width = static_cast<int32_t>(
           LayoutText(text + word_enum.GetCurrentWordIndex(),
                      word_enum.GetCurrentWordLength(), max_width / scale,
-                     line_width_ / scale, last_line,
+                     context_->line_width / scale, last_line,
                      parameters.get_enable_hyphenation_flag(), &rewind) *
           scale);
       layout_success = word_width > 0;
@@ -623,16 +1520,21 @@ FontBuffer *FontManager::FillBuffer(const char *text, uint32_t length,
         word_enum.Rewind(rewind);
       }
 
-      if (context->lastline_must_break() ||
-          ((line_width_ + word_width) > max_width && size.x) ||
-          !layout_success) {
+      // The first word of a resumed line has already been placed at the line
+      // start.
+      auto resuming_line = resume_line != nullptr;
+      resume_line = nullptr;
+      if (!resuming_line &&
+          (context->lastline_must_break() ||
+           ((context_->line_width + word_width) > max_width && size.x) ||
+           !layout_success)) {
         auto new_pos = vec2(pos_start.x, pos.y + line_height);
         first_character = context->lastline_must_break();
         if (last_line && !caret_info) {
           if (context->lastline_must_break()) {
             // Previous line was a line break and also the last_line, so don't
             // print this text that was supposed to go on the last+1 line.
-            hb_buffer_clear_contents(harfbuzz_buf_);
+            hb_buffer_clear_contents(context_->harfbuzz_buf);
           }
           // Else the text width exceeds given width, so still print the text on
           // the same line and add an ellipsis if it's speficied.
@@ -646,13 +1548,19 @@ FontBuffer *FontManager::FillBuffer(const char *text, uint32_t length,
           // Update alignment after an ellipsis is appended.
           context->set_lastline_must_break(true);
           buffer->UpdateLine(parameters, layout_direction_, context);
-          hb_buffer_clear_contents(harfbuzz_buf_);
+          hb_buffer_clear_contents(context_->harfbuzz_buf);
           break;
         }
         // Line break.
         total_height += line_height;
         buffer->UpdateLine(parameters, layout_direction_, context);
         pos = new_pos;
+        if (!context->appending_buffer()) {
+          // Record the line start for incremental relayouts.
+          buffer->AddLineState(word_enum.GetCurrentWordIndex(), pos,
+                               max_line_width, total_height, first_character,
+                               initial_metrics);
+        }
 
         if (word_width > max_width &&
             !parameters.get_enable_hyphenation_flag()) {
@@ -664,13 +1572,13 @@ FontBuffer *FontManager::FillBuffer(const char *text, uint32_t length,
               s.c_str());
         }
         // Reset the line width.
-        line_width_ = word_width;
+        context_->line_width = word_width;
       } else {
-        line_width_ += word_width;
+        context_->line_width += word_width;
       }
       // In case of the layout is left/center aligned, max line width is
       // adjusted based on layout results.
-      max_line_width = std::max(max_line_width, line_width_);
+      max_line_width = std::max(max_line_width, context_->line_width);
       context->set_lastline_must_break(word_enum.CurrentWordMustBreak());
     }
 
@@ -692,7 +1600,7 @@ FontBuffer *FontManager::FillBuffer(const char *text, uint32_t length,
     buffer->AddWordBoundary(parameters, context);
 
     // Cleanup buffer contents.
-    hb_buffer_clear_contents(harfbuzz_buf_);
+    hb_buffer_clear_contents(context_->harfbuzz_buf);
   }
 
   // Add the last caret.
@@ -707,7 +1615,10 @@ FontBuffer *FontManager::FillBuffer(const char *text, uint32_t length,
   }
 
   // Set buffer revision using glyph cache revision.
-  buffer->set_revision(glyph_cache_->get_revision());
+  {
+    fplutil::MutexLock lock(*cache_mutex_);
+    buffer->set_revision(glyph_cache_->get_revision());
+  }
 
   // Setup size.
   buffer->set_size(vec2i(max_line_width / kFreeTypeUnit, total_height));
@@ -735,11 +1646,12 @@ void FontManager::ReleaseBuffer(FontBuffer *buffer) {
     buffer->ReleaseCacheRowReference();
 
     // Remove an instance of the buffer.
-    map_buffers_.erase(buffer->get_iterator());
+    EraseBuffer(buffer);
   }
 }
 
 void FontManager::RemapBuffers(bool flush_cache) {
+  LayoutScope scope(this, true);
   // Acquire cache mutex.
   fplutil::MutexLock lock(*cache_mutex_);
 
@@ -761,13 +1673,21 @@ FontManager::ErrorType FontManager::UpdateBuffer(
     int32_t base_line, FontBuffer *buffer, FontBufferContext *context,
     mathfu::vec2 *pos, FontMetrics *metrics) {
   auto ysize = static_cast<int32_t>(parameters.get_font_size());
-  auto converted_ysize = ConvertSize(ysize);
+  auto converted_ysize = ConvertSize(ysize, parameters.get_glyph_flags());
   float scale = ysize / static_cast<float>(converted_ysize);
 
   // Retrieve layout info.
   uint32_t glyph_count;
-  auto glyph_info = hb_buffer_get_glyph_infos(harfbuzz_buf_, &glyph_count);
-  auto glyph_pos = hb_buffer_get_glyph_positions(harfbuzz_buf_, &glyph_count);
+  auto glyph_info =
+      hb_buffer_get_glyph_infos(context_->harfbuzz_buf, &glyph_count);
+  auto glyph_pos =
+      hb_buffer_get_glyph_positions(context_->harfbuzz_buf, &glyph_count);
+
+  // Glyph cache entries may be set or moved by layouts in other threads, so
+  // the word's glyphs are looked up and added holding the lock.
+  fplutil::MutexLock lock(*cache_mutex_);
+  // Count glyph cache accesses of the layout in this manager's stats.
+  glyph_cache_->set_pipeline_counters(&text_pipeline_counters_);
 
   for (size_t i = 0; i < glyph_count; ++i) {
     auto code_point = glyph_info[i].codepoint;
@@ -779,13 +1699,14 @@ FontManager::ErrorType FontManager::UpdateBuffer(
                                 parameters.get_glyph_flags(), &glyph_error);
     if (cache == nullptr) {
       // Cleanup buffer contents.
-      hb_buffer_clear_contents(harfbuzz_buf_);
+      hb_buffer_clear_contents(context_->harfbuzz_buf);
       return glyph_error;
     }
 
     mathfu::vec2 pos_advance =
         mathfu::vec2(
-            static_cast<float>(glyph_pos[i].x_advance) * kerning_scale_,
+            static_cast<float>(glyph_pos[i].x_advance) *
+                context_->kerning_scale,
             static_cast<float>(-glyph_pos[i].y_advance)) *
         scale / static_cast<float>(kFreeTypeUnit);
     // Advance positions before rendering in RTL.
@@ -797,20 +1718,23 @@ FontManager::ErrorType FontManager::UpdateBuffer(
     if (cache->get_size().x && cache->get_size().y) {
       // Add the code point to the buffer. This information is used when
       // re-fetching UV information when the texture atlas is updated.
-      buffer->AddGlyphInfo(current_font_->GetCurrentFaceId(), code_point,
-                           converted_ysize);
+      buffer->AddGlyphInfo(context_->current_font->GetCurrentFaceId(),
+                           code_point, converted_ysize);
 
       // Calculate internal/external leading value and expand a buffer if
       // necessary.
       FontMetrics new_metrics;
-      if (UpdateMetrics(static_cast<int32_t>(cache->get_offset().y),
-                        cache->get_size().y, *metrics, &new_metrics)) {
+      // Metrics are in the requested size, while the glyph is cached in the
+      // converted size.
+      if (UpdateMetrics(static_cast<int32_t>(cache->get_offset().y * scale),
+                        static_cast<int32_t>(cache->get_size().y * scale),
+                        *metrics, &new_metrics)) {
         *metrics = new_metrics;
       }
 
       // Expand buffer if necessary.
       auto buffer_idx = buffer->GetBufferIndex(cache->get_pos().z, context);
-      buffer->AddIndices(buffer_idx, buffer->get_glyph_count());
+      buffer->AddGlyph(buffer_idx, buffer->get_glyph_count());
 
       // Construct intermediate vertices array.
       // The vertices array is update in the render pass with correct
@@ -823,14 +1747,16 @@ FontManager::ErrorType FontManager::UpdateBuffer(
       if (buffer->get_slices().at(buffer_idx).get_underline()) {
         buffer->UpdateUnderline(
             buffer_idx, (buffer->get_vertices().size() - 1) / kVerticesPerGlyph,
-            current_font_->GetUnderline(ysize) + vec2i(pos->y, 0));
+            context_->current_font->GetUnderline(ysize) + vec2i(pos->y, 0));
       }
 
-      // Update references if the buffer is ref counting buffer.
-      if (parameters.get_ref_count_flag()) {
+      // Update references if the buffer is ref counting buffer. Buffers laid
+      // out by GetBuffers() workers add them once the glyphs are committed.
+      if (parameters.get_ref_count_flag() && !context_->defer_glyphs) {
         auto row = cache->get_row();
-        row->AddRef(buffer);
-        buffer->AddCacheRowReference(&*row);
+        if (buffer->AddCacheRowReference(&*row)) {
+          row->AddRef(buffer);
+        }
       }
     }
 
@@ -878,10 +1804,12 @@ FontManager::ErrorType FontManager::AppendEllipsis(
 
   auto max_width = parameters.get_size().x * kFreeTypeUnit;
   auto ysize = static_cast<int32_t>(parameters.get_font_size());
-  auto converted_ysize = ConvertSize(ysize);
+  auto converted_ysize = ConvertSize(ysize, parameters.get_glyph_flags());
   float scale = ysize / static_cast<float>(converted_ysize);
 
-  // Dump current string to the buffer.
+  // Dump current string to the buffer, except glyphs beyond the max width,
+  // which would be removed right away.
+  TruncateGlyphRun(parameters, scale, *pos);
   ErrorType buffer_error = UpdateBuffer(word_enum, parameters, base_line,
                                         buffer, context, pos, metrics);
   if (buffer_error != kErrorTypeSuccess) {
@@ -889,7 +1817,7 @@ FontManager::ErrorType FontManager::AppendEllipsis(
   }
 
   // Calculate ellipsis string information.
-  hb_buffer_clear_contents(harfbuzz_buf_);
+  hb_buffer_clear_contents(context_->harfbuzz_buf);
   auto ellipsis_width = LayoutText(ellipsis_.c_str(), ellipsis_.length()) *
                         scale;
   if (ellipsis_width > max_width) {
@@ -909,11 +1837,42 @@ FontManager::ErrorType FontManager::AppendEllipsis(
   }
 
   // Cleanup buffer contents.
-  hb_buffer_clear_contents(harfbuzz_buf_);
+  hb_buffer_clear_contents(context_->harfbuzz_buf);
 
   return kErrorTypeSuccess;
 }
 
+void FontManager::TruncateGlyphRun(const FontBufferParameters &parameters,
+                                   float scale, const mathfu::vec2 &pos) {
+  // Width left in the line from the pen position, measured the same way as
+  // NeedToRemoveEntries().
+  auto line_width = layout_direction_ == kTextLayoutDirectionRTL
+                        ? GetStartPosition(parameters).x - pos.x
+                        : pos.x;
+  auto available_width = parameters.get_size().x - line_width;
+
+  // Glyphs starting beyond the width end beyond it as well, so
+  // RemoveEntries() would remove them. Cut the run with the shaped advances
+  // before the glyphs are looked up in the glyph cache.
+  uint32_t glyph_count;
+  auto glyph_info =
+      hb_buffer_get_glyph_infos(context_->harfbuzz_buf, &glyph_count);
+  auto glyph_pos =
+      hb_buffer_get_glyph_positions(context_->harfbuzz_buf, &glyph_count);
+  auto advance_scale =
+      context_->kerning_scale * scale / static_cast<float>(kFreeTypeUnit);
+  auto width = 0.0f;
+  for (uint32_t i = 0; i < glyph_count; ++i) {
+    // Cut only at a cluster boundary to keep marks with their base glyphs.
+    if (width >= available_width &&
+        (!i || glyph_info[i].cluster != glyph_info[i - 1].cluster)) {
+      hb_buffer_set_length(context_->harfbuzz_buf, i);
+      return;
+    }
+    width += static_cast<float>(glyph_pos[i].x_advance) * advance_scale;
+  }
+}
+
 bool FontManager::NeedToRemoveEntries(const FontBufferParameters &parameters,
                                       uint32_t required_width,
                                       const FontBuffer *buffer,
@@ -956,7 +1915,6 @@ void FontManager::RemoveEntries(const FontBufferParameters &parameters,
                                 uint32_t required_width, FontBuffer *buffer,
                                 FontBufferContext *context, mathfu::vec2 *pos) {
   // Determine how many letters to remove.
-  const int32_t kLastElementIndex = -2;
   auto &vertices = buffer->get_vertices();
   // entry_index starts 1 past the index of the last glyph.
   auto entry_index = vertices.size() / kVerticesPerGlyph;
@@ -980,24 +1938,16 @@ void FontManager::RemoveEntries(const FontBufferParameters &parameters,
 
   auto entries_to_remove =
       static_cast<int32_t>(vertices.size() / kVerticesPerGlyph - entry_index);
-  auto removing_index =
-      static_cast<int32_t>(vertices.size()) + kLastElementIndex;
   auto latest_attribute = context->attribute_history().back();
 
-  if (removing_index <= 0) {
+  if (vertices.empty()) {
     return;
   }
   while (entries_to_remove-- > 0) {
-    // Remove indices.
+    // Remove the glyph from the glyph ranges.
     auto buffer_idx = latest_attribute->second;
-    auto &indices = buffer->get_indices(buffer_idx);
-    if (indices.back() == removing_index) {
-      for (size_t j = 0; j < kIndicesPerGlyph; ++j) {
-        indices.pop_back();
-      }
-      removing_index -= kVerticesPerGlyph;
-    } else {
-      // There is no indices to remove in the index buffer.
+    if (!buffer->RemoveLastGlyph(buffer_idx)) {
+      // The glyph is not rendered with the slice.
       // Switch to prior buffer.
       context->attribute_history().pop_back();
       latest_attribute = context->attribute_history().back();
@@ -1071,74 +2021,132 @@ int32_t FontManager::GetCaretPosCount(const WordEnumerator &word_enum,
 
 FontBuffer *FontManager::UpdateUV(GlyphFlags flags, FontBuffer *buffer) {
   if (GetFontBufferStatus(*buffer) == kFontBufferStatusNeedReconstruct) {
+    glyph_cache_->set_pipeline_counters(&text_pipeline_counters_);
     // Cache revision has been updated.
     // Some referencing glyph cache entries might have been evicted.
     // So we need to check glyph cache entries again while we can still use
     // layout information.
+    auto current_font = context_->current_font;
+    auto current_size = context_->current_font->GetPixelSize();
+
+    // Glyphs are usually cached in the same slices again, so patch UVs in
+    // place first, and only rebuild index buffers when a glyph moved.
+    auto result = PatchUV(flags, buffer);
+    if (result == kUVUpdateGlyphMoved) {
+      result = RebuildUV(flags, buffer);
+    }
 
-    // Set freetype settings.
-    FontBufferContext ctx;
-    auto current_font = current_font_;
-    auto current_size = current_font_->GetPixelSize();
-
-    // Keep original buffer.
-    std::vector<std::vector<uint16_t>> original_indices =
-        std::move(buffer->indices_);
-    std::vector<FontBufferAttributes> original_slices =
-        std::move(buffer->slices_);
-    auto &glyph_info = buffer->get_glyph_info();
+    // Restore font.
+    context_->current_font = current_font;
+    context_->current_font->SetPixelSize(current_size);
 
-    auto current_face_id = kNullHash;
-    for (size_t j = 0; j < original_indices.size(); ++j) {
-      // Set up attributes and fonts.
-      auto attr = original_slices[j];
-      attr.slice_index_ = kIndexInvalid;
-      ctx.SetAttribute(attr);
-
-      auto indices = original_indices[j];
-      for (size_t i = 0; i < indices.size(); i += kIndicesPerGlyph) {
-        // Reconstruct indices.
-        auto index = indices[i] / kVerticesPerGlyph;
-        auto &info = glyph_info.at(index);
-
-        if (current_face_id != info.face_id_) {
-          current_font_ = HbFont::Open(info.face_id_, &font_cache_);
-          if (current_font_ == nullptr) {
-            fplbase::LogError("A font in use has been closed! fontID:%d",
-                              info.face_id_);
-            return buffer;
-          }
-          current_face_id = info.face_id_;
+    if (result == kUVUpdateError) {
+      return nullptr;
+    }
+    if (result == kUVUpdateSuccess) {
+      // Update revision.
+      buffer->set_revision(glyph_cache_->get_revision());
+    }
+  }
+
+  return buffer;
+}
+
+FontManager::UVUpdateResult FontManager::PatchUV(GlyphFlags flags,
+                                                 FontBuffer *buffer) {
+  auto &glyph_info = buffer->get_glyph_info();
+  auto current_face_id = kNullHash;
+  for (size_t j = 0; j < buffer->glyph_ranges_.size(); ++j) {
+    auto slice = buffer->slices_[j].get_slice_index();
+    auto &ranges = buffer->glyph_ranges_[j];
+    for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+      for (auto index = it->start; index < it->start + it->count; ++index) {
+        auto result = kUVUpdateSuccess;
+        auto cache = ResolveGlyph(glyph_info.at(index), flags,
+                                  &current_face_id, &result);
+        if (cache == nullptr) {
+          return result;
+        }
+        if (cache->get_pos().z != slice) {
+          return kUVUpdateGlyphMoved;
         }
-        current_font_->SetPixelSize(info.size_);
+        buffer->UpdateUV(static_cast<int32_t>(index), cache->get_uv());
+      }
+    }
+  }
+  return kUVUpdateSuccess;
+}
+
+FontManager::UVUpdateResult FontManager::RebuildUV(GlyphFlags flags,
+                                                   FontBuffer *buffer) {
+  FontBufferContext ctx;
 
-        ErrorType glyph_error = kErrorTypeSuccess;
-        auto cache = GetCachedEntry(info.code_point_, info.size_, flags,
-                                    &glyph_error);
+  // Slices are rebuilt, so recorded lines don't match the buffer anymore.
+  buffer->line_states_.clear();
+
+  // Keep original buffer.
+  std::vector<std::vector<GlyphRange>> original_ranges =
+      std::move(buffer->glyph_ranges_);
+  std::vector<FontBufferAttributes> original_slices =
+      std::move(buffer->slices_);
+  auto &glyph_info = buffer->get_glyph_info();
+
+  auto current_face_id = kNullHash;
+  for (size_t j = 0; j < original_ranges.size(); ++j) {
+    // Set up attributes and fonts.
+    auto attr = original_slices[j];
+    attr.slice_index_ = kIndexInvalid;
+    ctx.SetAttribute(attr);
+
+    auto &ranges = original_ranges[j];
+    for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+      for (auto index = it->start; index < it->start + it->count; ++index) {
+        auto result = kUVUpdateSuccess;
+        auto cache = ResolveGlyph(glyph_info.at(index), flags,
+                                  &current_face_id, &result);
         if (cache == nullptr) {
-          return nullptr;
+          return result;
         }
 
         // Expand buffer if necessary.
         auto buffer_idx = buffer->GetBufferIndex(cache->get_pos().z, &ctx);
-        buffer->AddIndices(buffer_idx, index);
+        buffer->AddGlyph(buffer_idx, index);
 
         // Update UV.
         buffer->UpdateUV(static_cast<int32_t>(index), cache->get_uv());
       }
     }
-    // Update revision.
-    buffer->set_revision(glyph_cache_->get_revision());
+  }
+  return kUVUpdateSuccess;
+}
 
-    // Restore font.
-    current_font_ = current_font;
-    current_font_->SetPixelSize(current_size);
+const GlyphCacheEntry *FontManager::ResolveGlyph(const GlyphInfo &info,
+                                                 GlyphFlags flags,
+                                                 HashedId *face_id,
+                                                 UVUpdateResult *result) {
+  if (*face_id != info.face_id_) {
+    context_->current_font = HbFont::Open(info.face_id_, &font_cache_);
+    if (context_->current_font == nullptr) {
+      fplbase::LogError("A font in use has been closed! fontID:%d",
+                        info.face_id_);
+      *result = kUVUpdateFontClosed;
+      return nullptr;
+    }
+    *face_id = info.face_id_;
   }
+  context_->current_font->SetPixelSize(info.size_);
 
-  return buffer;
+  ErrorType glyph_error = kErrorTypeSuccess;
+  auto cache =
+      GetCachedEntry(info.code_point_, info.size_, flags, &glyph_error);
+  if (cache == nullptr) {
+    *result = kUVUpdateError;
+  }
+  return cache;
 }
 
 bool FontManager::Open(const FontFamily &family) {
+  LayoutScope scope(this, true);
   const char *font_name = family.get_name().c_str();
   auto it = map_faces_.find(font_name);
   if (it != map_faces_.end()) {
@@ -1147,6 +2155,16 @@ bool FontManager::Open(const FontFamily &family) {
     LogInfo("Specified font '%s' is already opened.", font_name);
 #endif  // FLATUI_VERBOSE_LOGGING
     it->second->AddRef();
+
+    // The font may have been opened by another manager sharing the faces.
+    // The system font isn't selected by default, as when it's opened.
+    auto select = !face_initialized_;
+#if defined(FLATUI_SYSTEM_FONT)
+    select = select && it->second->get_font_id() != kSystemFontId;
+#endif  // FLATUI_SYSTEM_FONT
+    if (select) {
+      face_initialized_ = SelectFont(family);
+    }
     return true;
   }
 
@@ -1186,43 +2204,145 @@ bool FontManager::Open(const FontFamily &family) {
   return true;
 }
 
-bool FontManager::Close(const FontFamily &family) {
-  auto it = map_faces_.find(family.get_name());
-  if (it == map_faces_.end()) {
-    return false;
-  }
-  if (it->second->Release()) {
-    return true;
-  }
-
+void FontManager::OpenAsync(const FontFamily &family,
+                            const std::function<void(bool)> &callback) {
+  // Fonts already opened only need a reference, and the system font opens a
+  // fallback list of fonts.
+  auto synchronous = map_faces_.find(family.get_name()) != map_faces_.end();
 #if defined(FLATUI_SYSTEM_FONT)
-  if (it->second->get_font_id() == kSystemFontId) {
-    // Close the system font.
-    CloseSystemFont();
-  }
+  synchronous = synchronous || family.get_name() == kSystemFont;
 #endif  // FLATUI_SYSTEM_FONT
-
-  // Acquire cache mutex.
-  fplutil::MutexLock lock(*cache_mutex_);
-
-  // Clean up face instance data.
-  HbFont::Close(*it->second, &font_cache_);
-  it->second->Close();
-
-  // Flush the texture cache.
-  map_buffers_.clear();
-  map_faces_.erase(it);
-
-  if (!map_faces_.size()) {
-    face_initialized_ = false;
+  if (synchronous) {
+    auto ret = Open(family);
+    if (callback) callback(ret);
+    return;
   }
 
-  return true;
+  if (!font_loader_) {
+    font_loader_.reset(new FontLoader());
+  }
+  std::unique_ptr<FontLoadJob> job(new FontLoadJob(family));
+  job->callback = callback;
+  font_loader_->Enqueue(std::move(job));
 }
 
-bool FontManager::Open(const char *font_name) {
+void FontManager::OpenAsync(const char *font_name,
+                            const std::function<void(bool)> &callback) {
   FontFamily family(font_name);
-  return Open(family);
+  OpenAsync(family, callback);
+}
+
+void FontManager::WaitForFonts() {
+  if (!font_loader_) {
+    return;
+  }
+  font_loader_->Wait();
+  CommitOpenedFonts();
+}
+
+bool FontManager::HasPendingFonts() {
+  return font_loader_ && font_loader_->HasPendingJobs();
+}
+
+void FontManager::CommitOpenedFonts() {
+  if (!font_loader_) {
+    return;
+  }
+  std::vector<std::unique_ptr<FontLoadJob>> jobs;
+  font_loader_->GetCompletedJobs(&jobs);
+  if (jobs.empty()) {
+    return;
+  }
+  // Layouts are blocked only when there are fonts to commit.
+  LayoutScope scope(this, true);
+
+  {
+    // Acquire cache mutex.
+    fplutil::MutexLock lock(*cache_mutex_);
+    for (auto &job : jobs) {
+      auto &font_name = job->family.get_name();
+      auto it = map_faces_.find(font_name);
+      if (it != map_faces_.end()) {
+        // The font has been opened while it was loaded.
+        it->second->AddRef();
+        job->succeeded = true;
+        continue;
+      }
+      if (!job->succeeded || !job->face->Initialize(*ft_, job->family)) {
+        job->succeeded = false;
+        continue;
+      }
+
+      auto face = job->face.get();
+      face->AddRef();
+      map_faces_[font_name] = std::move(job->face);
+
+      // Register the font face to the cache.
+      HbFont::Open(*face, &font_cache_);
+    }
+  }
+
+  // Callbacks may use the font manager, so they run without the lock.
+  for (auto &job : jobs) {
+    if (job->succeeded && !face_initialized_) {
+      // Set first opened font as a default font.
+      face_initialized_ = SelectFont(job->family);
+    }
+    if (job->callback) {
+      job->callback(job->succeeded);
+    }
+  }
+}
+
+bool FontManager::Close(const FontFamily &family) {
+  LayoutScope scope(this, true);
+  auto it = map_faces_.find(family.get_name());
+  if (it == map_faces_.end()) {
+    return false;
+  }
+  if (it->second->Release()) {
+    return true;
+  }
+
+#if defined(FLATUI_SYSTEM_FONT)
+  if (it->second->get_font_id() == kSystemFontId) {
+    // Close the system font.
+    CloseSystemFont();
+  }
+#endif  // FLATUI_SYSTEM_FONT
+
+  // Acquire cache mutex.
+  fplutil::MutexLock lock(*cache_mutex_);
+
+  // Cancel glyph rasterizations using the font.
+  if (glyph_rasterizer_) {
+    glyph_rasterizer_->CloseFont(it->second->get_font_data());
+  }
+
+  // Clean up face instance data.
+  HbFont::Close(*it->second, &font_cache_);
+  ClearFaceInstances();
+  it->second->Close();
+
+  // Flush the texture cache.
+  ClearBuffers();
+  map_faces_.erase(it);
+
+  // A font reopened with the name may have different glyphs.
+  shaping_cache_->Clear();
+  word_break_cache_->Clear();
+  color_glyph_cache_->Clear();
+
+  if (!map_faces_.size()) {
+    face_initialized_ = false;
+  }
+
+  return true;
+}
+
+bool FontManager::Open(const char *font_name) {
+  FontFamily family(font_name);
+  return Open(family);
 }
 
 bool FontManager::Close(const char *font_name) {
@@ -1231,6 +2351,7 @@ bool FontManager::Close(const char *font_name) {
 }
 
 bool FontManager::SelectFont(const FontFamily &family) {
+  LayoutScope scope(this);
   auto it = map_faces_.find(family.get_name());
   if (it == map_faces_.end()) {
     LogError("SelectFont error: '%s'", family.get_name().c_str());
@@ -1244,11 +2365,14 @@ bool FontManager::SelectFont(const FontFamily &family) {
   }
 #endif  // FLATUI_SYSTEM_FONT
 
-  current_font_ = HbFont::Open(*it->second.get(), &font_cache_);
-  return current_font_ != nullptr;
+  // The font cache is shared by layouts in all threads.
+  fplutil::MutexLock lock(*cache_mutex_);
+  context_->current_font = HbFont::Open(*it->second.get(), &font_cache_);
+  return context_->current_font != nullptr;
 }
 
 bool FontManager::SelectFont(const FontFamily *font_families, int32_t count) {
+  LayoutScope scope(this);
 #if defined(FLATUI_SYSTEM_FONT)
   // Open single font file.
   if (count == 1 && strcmp(font_families[0].get_name().c_str(), kSystemFont)) {
@@ -1260,9 +2384,12 @@ bool FontManager::SelectFont(const FontFamily *font_families, int32_t count) {
   for (auto i = 0; i < count; ++i) {
     id = HashId(font_families[i].get_name().c_str(), id);
   }
-  current_font_ = HbFont::Open(id, &font_cache_);
+  {
+    fplutil::MutexLock lock(*cache_mutex_);
+    context_->current_font = HbFont::Open(id, &font_cache_);
+  }
 
-  if (current_font_ == nullptr) {
+  if (context_->current_font == nullptr) {
     std::vector<FaceData *> v;
     for (auto i = 0; i < count; ++i) {
 #if defined(FLATUI_SYSTEM_FONT)
@@ -1298,9 +2425,10 @@ bool FontManager::SelectFont(const FontFamily *font_families, int32_t count) {
       }
 #endif
     }
-    current_font_ = HbComplexFont::Open(id, &v, &font_cache_);
+    fplutil::MutexLock lock(*cache_mutex_);
+    context_->current_font = HbComplexFont::Open(id, &v, &font_cache_);
   }
-  return current_font_ != nullptr;
+  return context_->current_font != nullptr;
 }
 
 bool FontManager::SelectFont(const char *font_name) {
@@ -1319,25 +2447,84 @@ bool FontManager::SelectFont(const char *font_names[], int32_t count) {
 void FontManager::StartLayoutPass() {
   // Reset pass.
   current_pass_ = 0;
+
+  // Fonts opened in the background are available from this layout pass.
+  CommitOpenedFonts();
 }
 
 bool FontManager::UpdatePass(bool start_subpass) {
-  // Guard glyph cache buffer access. Do nothing when the lock failed.
+  if (start_subpass) {
+    // A flush requested in a layout waits for layouts in other threads, since
+    // the layout can't continue without it.
+    ExclusiveLayoutLock layout_lock(*layout_lock_);
+    fplutil::MutexLock lock(*cache_mutex_);
+    UpdatePassLocked(true);
+    return true;
+  }
+
+  // Wait for layouts in other threads, and guard glyph cache buffer access.
+  // Do nothing when the lock failed.
+  ExclusiveLayoutLock layout_lock;
+  if (!layout_lock.Try(*layout_lock_)) {
+    return false;
+  }
   fplutil::MutexTryLock lock;
   if (!lock.Try(*cache_mutex_)) {
     return false;
   }
+  UpdatePassLocked(false);
+  return true;
+}
+
+void FontManager::UpdatePassLocked(bool start_subpass) {
+  glyph_cache_->set_pipeline_counters(&text_pipeline_counters_);
+
+  // Increment a cycle counter in glyph cache, once per pass of the managers
+  // sharing it: skip it if another manager ticked since our last pass.
+  if (last_update_counter_ == glyph_cache_->get_counter()) {
+    glyph_cache_->Update();
+  }
+  last_update_counter_ = glyph_cache_->get_counter();
 
-  // Increment a cycle counter in glyph cache.
-  glyph_cache_->Update();
+  // Close fallback fonts that have not been used recently.
+  EvictSystemFontFaces();
+
+  // Remove glyph cache slices exceeding the budget or the max, and idle ones,
+  // but only in the render pass since their textures are deleted.
+  if (!start_subpass) {
+    if (atlas_trim_pending_ || atlas_budget_ != kMemoryBudgetUnlimited) {
+      glyph_cache_->TrimSlices(atlas_trim_pending_ ? 0 : atlas_budget_);
+      atlas_trim_pending_ = false;
+    }
+    glyph_cache_->ReleaseIdleSlices(
+        static_cast<uint32_t>(slice_release_passes_));
+
+    // Vertex buffers of released FontBuffers are deleted in the rendering
+    // thread as well.
+    released_vertex_buffers_.clear();
+  }
+
+  // Store glyph images rendered asynchronously.
+  CommitRasterizedGlyphs();
+  CommitDistanceFields();
 
   // Resolve glyph cache's dirty rects, but only if we're in the render pass
   // (current_pass_ hasn't been updated yet, so use !start_subpass).
   if (glyph_cache_->get_dirty_state() && !start_subpass) {
+    FLATUI_TRACE_SCOPE("FontManager::UploadAtlas", kNullHash);
     glyph_cache_->ResolveDirtyRect();
-    // Cache texture is updated. Update counters as well.
-    current_atlas_revision_ = glyph_cache_->get_revision();
-    atlas_last_flush_revision_ = glyph_cache_->get_last_flush_revision();
+  }
+  // Cache texture may be updated or flushed, also by other managers sharing
+  // it. Update counters as well.
+  if (!start_subpass) {
+    current_atlas_revision_ = glyph_cache_->get_uploaded_revision();
+  }
+  atlas_last_flush_revision_ = glyph_cache_->get_last_flush_revision();
+
+  // Generate SDF of glyphs queued to the GPU in the uploaded textures.
+  auto gpu_computer = sdf_computer_->get_gpu_computer();
+  if (gpu_computer != nullptr && !start_subpass) {
+    gpu_computer->Dispatch(glyph_cache_);
   }
 
   if (start_subpass) {
@@ -1353,36 +2540,124 @@ bool FontManager::UpdatePass(bool start_subpass) {
     // Reset pass.
     current_pass_ = kRenderPass;
   }
-  return true;
+}
+
+// Check if HarfBuzz shapes text in the script without script-specific rules,
+// so that simple runs can be laid out without it.
+static bool IsSimpleScript(uint32_t script) {
+  switch (script) {
+    case HB_SCRIPT_COMMON:
+    case HB_SCRIPT_INHERITED:
+    case HB_SCRIPT_UNKNOWN:
+    case HB_SCRIPT_LATIN:
+    case HB_SCRIPT_GREEK:
+    case HB_SCRIPT_CYRILLIC:
+    case HB_SCRIPT_HAN:
+    case HB_SCRIPT_HIRAGANA:
+    case HB_SCRIPT_KATAKANA:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Add codepoints of a range of a decoded text to an empty HarfBuzz buffer.
+// Clusters are set to byte offsets in the range, as hb_buffer_add_utf8() does.
+static void AddDecodedText(const DecodedText &decoded_text, const char *text,
+                           size_t length, hb_buffer_t *buffer) {
+  auto start = static_cast<size_t>(text - decoded_text.get_text());
+  auto first = decoded_text.FindCodepoint(start);
+  auto count =
+      static_cast<int32_t>(decoded_text.FindCodepoint(start + length) - first);
+  hb_buffer_add_codepoints(buffer, decoded_text.get_codepoints() + first,
+                           count, 0, count);
+  uint32_t info_count;
+  auto info = hb_buffer_get_glyph_infos(buffer, &info_count);
+  auto offsets = decoded_text.get_offsets() + first;
+  for (uint32_t i = 0; i < info_count; ++i) {
+    info[i].cluster = offsets[i] - static_cast<uint32_t>(start);
+  }
 }
 
 int32_t FontManager::LayoutText(const char *text, size_t length,
                                 int32_t max_width, int32_t current_width,
                                 bool last_line, bool enable_hyphenation,
                                 int32_t *rewind) {
+  FLATUI_TRACE_SCOPE("FontManager::LayoutText", kNullHash);
   // Update language settings.
   SetLanguageSettings();
 
-  // Layout the text.
-  hb_buffer_add_utf8(harfbuzz_buf_, text, static_cast<uint32_t>(length), 0,
-                     static_cast<int32_t>(length));
-  hb_shape(current_font_->GetHbFont(), harfbuzz_buf_, nullptr, 0);
-  if (layout_direction_ == kTextLayoutDirectionRTL) {
-    hb_buffer_reverse(harfbuzz_buf_);
+  // Lay out simple runs without shaping them, or the text reusing the shaped
+  // result when the run is cached. Both are only done for a cleared buffer.
+  auto cleared = !hb_buffer_get_length(context_->harfbuzz_buf);
+  auto simple_run = simple_text_layout_ && length && cleared &&
+                    layout_direction_ == kTextLayoutDirectionLTR &&
+                    IsSimpleScript(script_) &&
+                    context_->current_font->LayoutSimpleRun(
+                        text, length, context_->harfbuzz_buf);
+  if (simple_run) {
+    text_pipeline_counters_.Add(TextPipelineCounters::kSimpleRuns);
+  }
+  ShapingKey key;
+  // The capacity isn't checked here since it's changed under the lock. The
+  // cache doesn't keep runs when it's disabled.
+  auto use_shaping_cache = !simple_run && length && cleared;
+  if (use_shaping_cache) {
+    key.text_hash = HashId(text, static_cast<int32_t>(length));
+    key.font_id = context_->current_font->GetFontId();
+    key.face_id = context_->current_font->GetCurrentFaceId();
+    key.pixel_size = context_->current_font->GetPixelSize();
+    key.script = static_cast<hb_script_t>(script_);
+    key.direction = layout_direction_ == kTextLayoutDirectionRTL
+                        ? HB_DIRECTION_RTL
+                        : HB_DIRECTION_LTR;
+    key.language = hb_language_;
+  }
+  auto restored = false;
+  if (use_shaping_cache) {
+    // The cache is shared by layouts in all threads.
+    fplutil::MutexLock lock(*cache_mutex_);
+    restored =
+        shaping_cache_->Restore(key, text, length, context_->harfbuzz_buf);
+  }
+  if (!simple_run && !restored) {
+    if (cleared && context_->decoded_text.Contains(text, length)) {
+      AddDecodedText(context_->decoded_text, text, length,
+                     context_->harfbuzz_buf);
+    } else {
+      hb_buffer_add_utf8(context_->harfbuzz_buf, text,
+                         static_cast<uint32_t>(length), 0,
+                         static_cast<int32_t>(length));
+    }
+    {
+      ScopedTextPipelineTimer timer(&text_pipeline_counters_,
+                                    TextPipelineCounters::kShapingTime);
+      hb_shape(context_->current_font->GetHbFont(), context_->harfbuzz_buf,
+               nullptr, 0);
+    }
+    text_pipeline_counters_.Add(TextPipelineCounters::kShapedRuns);
+    if (layout_direction_ == kTextLayoutDirectionRTL) {
+      hb_buffer_reverse(context_->harfbuzz_buf);
+    }
+    if (use_shaping_cache) {
+      fplutil::MutexLock lock(*cache_mutex_);
+      shaping_cache_->Store(key, text, length, context_->harfbuzz_buf);
+    }
   }
 
   // Retrieve layout info.
   uint32_t glyph_count;
   hb_glyph_info_t *glyph_info =
-      hb_buffer_get_glyph_infos(harfbuzz_buf_, &glyph_count);
+      hb_buffer_get_glyph_infos(context_->harfbuzz_buf, &glyph_count);
   hb_glyph_position_t *glyph_pos =
-      hb_buffer_get_glyph_positions(harfbuzz_buf_, &glyph_count);
+      hb_buffer_get_glyph_positions(context_->harfbuzz_buf, &glyph_count);
 
   // Retrieve a width of the string.
   float string_width = 0.0f;
   auto available_space = max_width - current_width;
   for (uint32_t i = 0; i < glyph_count; ++i) {
-    auto advance = static_cast<float>(glyph_pos[i].x_advance) * kerning_scale_;
+    auto advance =
+        static_cast<float>(glyph_pos[i].x_advance) * context_->kerning_scale;
     if (max_width && string_width + advance > max_width) {
       // If a single word exceeds the max width, the word is forced to
       // linebreak.
@@ -1390,15 +2665,15 @@ int32_t FontManager::LayoutText(const char *text, size_t length,
       // Find a string length that fits to an avaialble space AND the available
       // space can have at least one letter.
       while (string_width > available_space &&
-             available_space >=
-                 static_cast<float>(glyph_pos[0].x_advance) * kerning_scale_) {
+             available_space >= static_cast<float>(glyph_pos[0].x_advance) *
+                                    context_->kerning_scale) {
         --i;
-        string_width -=
-            static_cast<float>(glyph_pos[i].x_advance) * kerning_scale_;
+        string_width -= static_cast<float>(glyph_pos[i].x_advance) *
+                        context_->kerning_scale;
       }
       if (i <= 0) {
         // If there is no space for even one letter, don't render anything.
-        hb_buffer_set_length(harfbuzz_buf_, 0);
+        hb_buffer_set_length(context_->harfbuzz_buf, 0);
         // But, still progress past that one letter to prevent infinite looping.
         *rewind = static_cast<int32_t>(length - 1);
         return 0;
@@ -1406,7 +2681,7 @@ int32_t FontManager::LayoutText(const char *text, size_t length,
 
       // Calculate # of characters to rewind.
       *rewind = static_cast<int32_t>(length - glyph_info[i].cluster);
-      hb_buffer_set_length(harfbuzz_buf_, i);
+      hb_buffer_set_length(context_->harfbuzz_buf, i);
       break;
     }
 
@@ -1422,11 +2697,21 @@ int32_t FontManager::LayoutText(const char *text, size_t length,
 
 int32_t FontManager::Hyphenate(const char *text, size_t length,
                                int32_t available_space, int32_t *rewind) {
-  std::vector<uint8_t> result;
-  hyphenator_.Hyphenate(reinterpret_cast<const uint8_t *>(text), length,
-                        &result);
+  auto &result = context_->hyphenation_result;
+  {
+    // Hyphenators and the cache are shared by layouts in all threads.
+    fplutil::MutexLock lock(*cache_mutex_);
+    auto &rule = context_->hyphenation_rule;
+    if (!hyphenation_cache_.Restore(text, length, rule, &result)) {
+      context_->hyphenator->Hyphenate(reinterpret_cast<const uint8_t *>(text),
+                                      length, &result);
+      hyphenation_cache_.Store(text, length, rule, result.data(),
+                               result.size());
+    }
+  }
 
-  std::string hyphenating_str(text, length);
+  auto &hyphenating_str = context_->hyphenating_str;
+  hyphenating_str.assign(text, length);
   auto it = result.rbegin();
   auto end = result.rend();
   while (it != end) {
@@ -1444,7 +2729,7 @@ int32_t FontManager::Hyphenate(const char *text, size_t length,
                                                // correctly in some cases.
 
       // Layout the text with a hyphen.
-      hb_buffer_clear_contents(harfbuzz_buf_);
+      hb_buffer_clear_contents(context_->harfbuzz_buf);
       auto width =
           LayoutText(hyphenating_str.data(), idx + 1, 0, 0, false, rewind);
 
@@ -1459,10 +2744,124 @@ int32_t FontManager::Hyphenate(const char *text, size_t length,
   }
 
   // Didn't find any hyphenation point, restore buffer state and return.
-  hb_buffer_clear_contents(harfbuzz_buf_);
+  hb_buffer_clear_contents(context_->harfbuzz_buf);
   return LayoutText(text, length, 0, 0, false, rewind);
 }
 
+void FontManager::SetupHyphenationPatternPath(const char *hyb_path) {
+  LayoutScope scope(this, true);
+  if (hyb_path != nullptr && hyb_path_ != hyb_path) {
+    hyb_path_ = hyb_path;
+    // Reopen patterns from the new path, which may hyphenate words
+    // differently.
+    context_->hyphenator = &soft_hyphenator_;
+    hyphenators_.clear();
+    hyphenation_cache_.Clear();
+  }
+  SelectHyphenator(locale_hyphenation_rule_);
+}
+
+void FontManager::SelectHyphenator(const std::string &rule) {
+  context_->hyphenation_rule = rule;
+  if (rule.empty() || hyb_path_.empty()) {
+    context_->hyphenator = &soft_hyphenator_;
+    return;
+  }
+  fplutil::MutexLock lock(*cache_mutex_);
+  auto &hyphenator = hyphenators_[rule];
+  if (hyphenator == nullptr) {
+    // Keep hyphenators failed to open too, so that the file isn't looked up
+    // again. They apply soft hyphens only.
+    hyphenator.reset(new Hyphenator());
+    std::string pattern_file = hyb_path_ + "/hyph-" + rule + ".hyb";
+    hyphenator->Open(pattern_file.c_str());
+  }
+  context_->hyphenator = hyphenator.get();
+}
+
+void FontManager::SelectHyphenator(const FontBufferParameters &parameters) {
+  auto &locale = parameters.get_hyphenation_locale();
+  if (locale.empty()) {
+    SelectHyphenator(locale_hyphenation_rule_);
+    return;
+  }
+  auto info = FindLocale(locale.c_str());
+  if (info == nullptr) {
+    // Lookup with the language.
+    auto language = locale.substr(0, locale.find("-"));
+    info = FindLocale(language.c_str());
+  }
+  SelectHyphenator(info && info->hyphenation ? info->hyphenation
+                                             : locale_hyphenation_rule_);
+}
+
+// Convert hyphenation results of a word, which are per codepoint, to flags
+// per byte.
+static void SetHyphenationPoints(const char *word, size_t length,
+                                 const uint8_t *result, size_t count,
+                                 uint8_t *points) {
+  size_t idx = 0;
+  for (size_t i = 0; i < count && idx < length; ++i) {
+    if (result[i]) {
+      points[idx] = 1;
+    }
+    ub_get_next_char_utf8(reinterpret_cast<const uint8_t *>(word), length,
+                          &idx);
+  }
+}
+
+void FontManager::HyphenateParagraph(const char *text, size_t length,
+                                     std::vector<uint8_t> *hyphenation_points) {
+  LayoutScope scope(this);
+  SelectHyphenator(locale_hyphenation_rule_);
+  hyphenation_points->assign(length, 0);
+  auto points = hyphenation_points->data();
+
+  // Restore cached words, and collect other words to hyphenate them at once.
+  // Hyphenators and the cache are shared by layouts in all threads.
+  fplutil::MutexLock lock(*cache_mutex_);
+  auto &rule = context_->hyphenation_rule;
+  context_->hyphenation_words.clear();
+  size_t start = 0;
+  while (start < length) {
+    while (start < length && std::isspace(text[start])) ++start;
+    auto end = start;
+    while (end < length && !std::isspace(text[end])) ++end;
+    if (end > start) {
+      auto word = text + start;
+      if (hyphenation_cache_.Restore(word, end - start, rule,
+                                     &context_->hyphenation_result)) {
+        SetHyphenationPoints(word, end - start,
+                             context_->hyphenation_result.data(),
+                             context_->hyphenation_result.size(),
+                             points + start);
+      } else {
+        Hyphenator::WordRange range = {start, end - start};
+        context_->hyphenation_words.push_back(range);
+      }
+    }
+    start = end;
+  }
+  if (context_->hyphenation_words.empty()) {
+    return;
+  }
+
+  context_->hyphenator->HyphenateWords(
+      reinterpret_cast<const uint8_t *>(text), context_->hyphenation_words,
+      &context_->hyphenation_result, &context_->hyphenation_offsets);
+  for (size_t i = 0; i < context_->hyphenation_words.size(); ++i) {
+    auto &range = context_->hyphenation_words[i];
+    auto result =
+        context_->hyphenation_result.data() + context_->hyphenation_offsets[i];
+    auto count = context_->hyphenation_offsets[i + 1] -
+                 context_->hyphenation_offsets[i];
+    hyphenation_cache_.Store(text + range.start, range.length, rule, result,
+                             count);
+    SetHyphenationPoints(text + range.start, range.length, result, count,
+                         points + range.start);
+  }
+}
+
 bool FontManager::UpdateMetrics(int32_t top, int32_t height,
                                 const FontMetrics &current_metrics,
                                 FontMetrics *new_metrics) {
@@ -1485,6 +2884,7 @@ bool FontManager::UpdateMetrics(int32_t top, int32_t height,
 }
 
 void FontManager::SetLocale(const char *locale) {
+  LayoutScope scope(this, true);
   if (locale_ == locale) {
     return;
   }
@@ -1507,9 +2907,9 @@ void FontManager::SetLocale(const char *locale) {
   if (layout_info != nullptr) {
     SetLayoutDirection(layout_info->direction);
     SetScript(layout_info->script);
-    hyphenation_rule_ =
+    locale_hyphenation_rule_ =
         layout_info->hyphenation ? layout_info->hyphenation : "";
-    SetupHyphenationPatternPath(nullptr);
+    SelectHyphenator(locale_hyphenation_rule_);
   }
   locale_ = locale;
 
@@ -1525,57 +2925,117 @@ void FontManager::SetScript(const char *script) {
 }
 
 void FontManager::SetLanguageSettings() {
-  assert(harfbuzz_buf_);
+  assert(context_->harfbuzz_buf);
   // Set harfbuzz settings.
-  hb_buffer_set_direction(harfbuzz_buf_,
+  hb_buffer_set_direction(context_->harfbuzz_buf,
                           layout_direction_ == kTextLayoutDirectionRTL
                               ? HB_DIRECTION_RTL
                               : HB_DIRECTION_LTR);
-  hb_buffer_set_script(harfbuzz_buf_, static_cast<hb_script_t>(script_));
-  hb_buffer_set_language(harfbuzz_buf_, hb_language_);
+  hb_buffer_set_script(context_->harfbuzz_buf,
+                       static_cast<hb_script_t>(script_));
+  hb_buffer_set_language(context_->harfbuzz_buf, hb_language_);
 }
 
 const GlyphCacheEntry *FontManager::GetCachedEntry(uint32_t code_point,
                                                    uint32_t ysize,
                                                    GlyphFlags flags,
                                                    ErrorType *error) {
-  auto &face_data = current_font_->GetFaceData();
+  auto &face_data = context_->current_font->GetFaceData();
   GlyphKey key(face_data.get_font_id(), code_point, ysize, flags);
   auto cache = glyph_cache_->Find(key);
+  if (cache == nullptr && context_->defer_glyphs) {
+    // The glyph is added by GetBuffers() in the order of the requests.
+    return GetPlaceholderEntry(face_data, key, error);
+  }
+  text_pipeline_counters_.Add(TextPipelineCounters::kGlyphLookups);
+  text_pipeline_counters_.Add(cache != nullptr
+                                  ? TextPipelineCounters::kGlyphHits
+                                  : TextPipelineCounters::kGlyphMisses);
+  if (cache != nullptr && glyph_cache_->get_pinning() &&
+      !cache->get_row()->get_pinned()) {
+    // Move the glyph cached before pinning to a pinned row.
+    cache = glyph_cache_->Pin(key);
+    if (cache == nullptr) {
+      LogInfo("Glyph cache is full. Need to flush and re-create.\n");
+      *error = kErrorTypeCacheIsFull;
+      return nullptr;
+    }
+  }
+
+  if (cache == nullptr && disk_cache_) {
+    // Restore the glyph from the disk cache.
+    GlyphCacheEntry entry;
+    auto image = disk_cache_->Find(face_data.get_font_hash(), key, &entry);
+    if (image != nullptr) {
+      cache = glyph_cache_->Set(image, key, entry);
+      if (cache == nullptr) {
+        LogInfo("Glyph cache is full. Need to flush and re-create.\n");
+        *error = kErrorTypeCacheIsFull;
+        return nullptr;
+      }
+    }
+  }
 
   if (cache == nullptr) {
-    auto face = face_data.get_face();
-    auto ft_flags = FT_LOAD_RENDER;
+    auto face = face_data.GetInstance()->get_face();
+    if (flags & kGlyphFlagsMultiChannelSDF && FT_IS_SCALABLE(face) &&
+        !FT_HAS_COLOR(face)) {
+      return GenerateMultiChannelSDF(face_data, key, error);
+    }
+    if (glyph_rasterizer_ && FT_IS_SCALABLE(face) && !FT_HAS_COLOR(face)) {
+      return ReserveCachedEntry(face_data, key, error);
+    }
+    // Color glyphs are scaled from the bitmap cached at the first use.
+    const ColorGlyphStrike *strike = nullptr;
     if (FT_HAS_COLOR(face)) {
-      ft_flags |= FT_LOAD_COLOR;
-    }
-    if (!FT_IS_SCALABLE(face)) {
-      // Selecting first bitmap font for now.
-      // TODO: Select optimal font size when available.
-      FT_Select_Size(face, 0);
-    }
-    // Load glyph using harfbuzz layout information.
-    // Note that harfbuzz takes care of ligatures.
-    FT_Error err = FT_Load_Glyph(face, code_point, ft_flags);
-    if (err) {
-      // Error. This could happen typically the loaded font does not support
-      // particular glyph.
-      LogInfo("Can't load glyph %c FT_Error:%d\n", code_point, err);
-      *error = kErrorTypeMissingGlyph;
-      return nullptr;
+      strike = color_glyph_cache_->Find(face_data.get_font_id(), code_point);
+    }
+    FT_GlyphSlot g = face->glyph;
+    float bitmap_left = 0.0f;
+    if (strike == nullptr) {
+      auto ft_flags = FT_LOAD_RENDER;
+      if (FT_HAS_COLOR(face)) {
+        ft_flags |= FT_LOAD_COLOR;
+      }
+      if (!FT_IS_SCALABLE(face)) {
+        // Selecting first bitmap font for now.
+        // TODO: Select optimal font size when available.
+        FT_Select_Size(face, 0);
+      }
+      // Load glyph using harfbuzz layout information.
+      // Note that harfbuzz takes care of ligatures.
+      FT_Error err;
+      {
+        FLATUI_TRACE_SCOPE("FontManager::RasterizeGlyph", code_point);
+        ScopedTextPipelineTimer timer(&text_pipeline_counters_,
+                                      TextPipelineCounters::kRasterizeTime);
+        err = FT_Load_Glyph(face, code_point, ft_flags);
+      }
+      if (err) {
+        // Error. This could happen typically the loaded font does not support
+        // particular glyph.
+        LogInfo("Can't load glyph %c FT_Error:%d\n", code_point, err);
+        *error = kErrorTypeMissingGlyph;
+        return nullptr;
+      }
+      bitmap_left = g->bitmap_left +
+                    static_cast<float>(g->lsb_delta) / kFreeTypeUnit;
+      if (g->bitmap.pixel_mode == FT_PIXEL_MODE_BGRA) {
+        strike = color_glyph_cache_->Store(
+            face_data.get_font_id(), code_point, g->bitmap.buffer,
+            g->bitmap.width, g->bitmap.rows, g->bitmap.pitch, bitmap_left,
+            g->advance.x);
+      }
     }
 
     // Store the glyph to cache.
-    FT_GlyphSlot g = face->glyph;
     GlyphCacheEntry entry;
     entry.set_code_point(code_point);
-    bool color_glyph = g->bitmap.pixel_mode == FT_PIXEL_MODE_BGRA;
-    float bitmap_left = g->bitmap_left +
-                        static_cast<float>(g->lsb_delta) / kFreeTypeUnit;
+    bool color_glyph = strike != nullptr;
 
     // Does not support SDF for color glyphs.
-    if (flags & (kGlyphFlagsOuterSDF | kGlyphFlagsInnerSDF) &&
-        g->bitmap.width && g->bitmap.rows && !color_glyph) {
+    if (!color_glyph && flags & (kGlyphFlagsOuterSDF | kGlyphFlagsInnerSDF) &&
+        g->bitmap.width && g->bitmap.rows) {
       // Adjust a glyph size and an offset with a padding.
       entry.set_offset(vec2(bitmap_left - kGlyphCachePaddingSDF,
                             g->bitmap_top + kGlyphCachePaddingSDF));
@@ -1583,7 +3043,20 @@ const GlyphCacheEntry *FontManager::GetCachedEntry(uint32_t code_point,
                            g->bitmap.rows + kGlyphCachePaddingSDF * 2));
       entry.set_advance(vec2i(g->advance.x / kFreeTypeUnit, 0));
       cache = glyph_cache_->Set(nullptr, key, entry);
-      if (cache != nullptr) {
+      auto gpu_computer = sdf_computer_->get_gpu_computer();
+      if (cache != nullptr && gpu_computer != nullptr &&
+          gpu_computer->get_supported() && glyph_cache_->SetGpuResident(key)) {
+        // Let the GPU generate SDF in the rendering pass.
+        std::unique_ptr<GpuDistanceJob> job(new GpuDistanceJob());
+        job->key = key;
+        job->entry = entry;
+        job->font_hash = face_data.get_font_hash();
+        job->bitmap_size = vec2i(g->bitmap.width, g->bitmap.rows);
+        job->size = cache->get_size();
+        gpu_computer->Enqueue(std::move(job), g->bitmap.buffer,
+                              g->bitmap.pitch);
+        return cache;
+      } else if (cache != nullptr) {
         // Generates SDF.
         auto buffer = glyph_cache_->get_monochrome_buffer();
         auto pos = cache->get_pos();
@@ -1593,50 +3066,38 @@ const GlyphCacheEntry *FontManager::GetCachedEntry(uint32_t code_point,
                           vec2i(g->bitmap.width, g->bitmap.rows),
                           kGlyphCachePaddingSDF, g->bitmap.width);
         Grid<uint8_t> dest(p, cache->get_size(), 0, stride);
+        FLATUI_TRACE_SCOPE("FontManager::GenerateSDF", code_point);
+        ScopedTextPipelineTimer timer(&text_pipeline_counters_,
+                                      TextPipelineCounters::kSdfTime);
         sdf_computer_->Compute(src, &dest, flags);
       }
     } else {
       if (color_glyph) {
         // FreeType returns fixed sized bitmap for color glyphs.
         // Rescale bitmap here for better quality and performance.
-        auto glyph_scale = static_cast<float>(ysize) / g->bitmap.rows;
-        int32_t new_width = static_cast<int32_t>(g->bitmap.width * glyph_scale);
-        int32_t new_height = static_cast<int32_t>(g->bitmap.rows * glyph_scale);
+        auto &base = strike->levels[0];
+        auto glyph_scale = static_cast<float>(ysize) / base.height;
+        int32_t new_width = static_cast<int32_t>(base.width * glyph_scale);
+        int32_t new_height = static_cast<int32_t>(base.height * glyph_scale);
         int32_t new_advance =
-            static_cast<int32_t>(g->advance.x * glyph_scale / kFreeTypeUnit);
-        std::unique_ptr<uint8_t[]> out_buffer(
-            new uint8_t[new_width * new_height * sizeof(uint32_t)]);
-
-        // TODO: Evaluate generating mipmap for a dirty rect and see
-        // it would improve performance and produces acceptable quality.
-        stbir_resize_uint8(g->bitmap.buffer, g->bitmap.width, g->bitmap.rows, 0,
-                           out_buffer.get(), new_width, new_height, 0,
-                           sizeof(uint32_t));
-
-        if (glyph_cache_->SupportsColorGlyphs()) {
+            static_cast<int32_t>(strike->advance * glyph_scale / kFreeTypeUnit);
+
+        // Copy the color glyph's alpha into the monochrome buffer when the
+        // cache has no color buffer. Otherwise this will cause the entire font
+        // buffer to fail.
+        bool alpha_only = !glyph_cache_->SupportsColorGlyphs();
+        auto image = color_glyph_cache_->Scale(*strike, new_width, new_height,
+                                               alpha_only);
+        if (!alpha_only) {
           entry.set_color_glyph(true);
-        } else {
-          // Copy the color glyph's alpha into the monochrome buffer.  Otherwise
-          // this will cause the entire font buffer to fail.
-          std::unique_ptr<uint8_t[]> mono_buffer(
-              new uint8_t[new_width * new_height]);
-          const uint32_t* src =
-              reinterpret_cast<const uint32_t*>(out_buffer.get());
-          uint8_t* dst = mono_buffer.get();
-
-          for (int i = 0; i < new_width * new_height; ++i, ++src, ++dst) {
-            *dst = static_cast<uint8_t>((*src) >> 24);
-          }
-
-          out_buffer = std::move(mono_buffer);
         }
 
         const float kEmojiBaseLine = 0.85f;
-        entry.set_offset(vec2(bitmap_left * glyph_scale,
+        entry.set_offset(vec2(strike->bitmap_left * glyph_scale,
                               new_height * kEmojiBaseLine));
         entry.set_size(vec2i(new_width, new_height));
         entry.set_advance(vec2i(new_advance, 0));
-        cache = glyph_cache_->Set(out_buffer.get(), key, entry);
+        cache = glyph_cache_->Set(image, key, entry);
       } else {
         entry.set_offset(vec2(bitmap_left, g->bitmap_top));
         entry.set_size(vec2i(g->bitmap.width, g->bitmap.rows));
@@ -1652,13 +3113,391 @@ const GlyphCacheEntry *FontManager::GetCachedEntry(uint32_t code_point,
       *error = kErrorTypeCacheIsFull;
       return nullptr;
     }
+
+    if (!color_glyph) {
+      auto buffer = glyph_cache_->get_monochrome_buffer();
+      auto pos = cache->get_pos();
+      auto stride = buffer->get_size().x;
+      AddToDiskCache(face_data.get_font_hash(), key, *cache,
+                     buffer->get(pos.z) + pos.x + pos.y * stride, stride);
+    }
+  }
+
+  return cache;
+}
+
+bool FontManager::LoadGlyphMetrics(const FaceData &face_data,
+                                   const GlyphKey &key, GlyphCacheEntry *entry,
+                                   vec2i *origin, vec2i *bitmap_size,
+                                   ErrorType *error) {
+  // Load the outline only to retrieve metrics.
+  auto face = face_data.GetInstance()->get_face();
+  auto code_point = key.get_code_point();
+  FT_Error err = FT_Load_Glyph(face, code_point, FT_LOAD_NO_BITMAP);
+  if (err) {
+    LogInfo("Can't load glyph %c FT_Error:%d\n", code_point, err);
+    *error = kErrorTypeMissingGlyph;
+    return false;
+  }
+
+  // Calculate bitmap bounds in the same way as FreeType's renderer, rounding
+  // the control box of the outline to the pixel grid.
+  FT_GlyphSlot g = face->glyph;
+  FT_BBox cbox;
+  FT_Outline_Get_CBox(&g->outline, &cbox);
+  auto x_min = cbox.xMin & ~(kFreeTypeUnit - 1);
+  auto y_min = cbox.yMin & ~(kFreeTypeUnit - 1);
+  auto x_max = (cbox.xMax + kFreeTypeUnit - 1) & ~(kFreeTypeUnit - 1);
+  auto y_max = (cbox.yMax + kFreeTypeUnit - 1) & ~(kFreeTypeUnit - 1);
+  *origin = vec2i(static_cast<int32_t>(x_min / kFreeTypeUnit),
+                  static_cast<int32_t>(y_max / kFreeTypeUnit));
+  *bitmap_size =
+      vec2i(static_cast<int32_t>((x_max - x_min) / kFreeTypeUnit),
+            static_cast<int32_t>((y_max - y_min) / kFreeTypeUnit));
+  float bitmap_left =
+      origin->x + static_cast<float>(g->lsb_delta) / kFreeTypeUnit;
+
+  entry->set_code_point(code_point);
+  entry->set_advance(vec2i(g->advance.x / kFreeTypeUnit, 0));
+  if (key.get_flags() & (kGlyphFlagsOuterSDF | kGlyphFlagsInnerSDF) &&
+      bitmap_size->x && bitmap_size->y) {
+    // Adjust a glyph size and an offset with a padding.
+    entry->set_offset(vec2(bitmap_left - kGlyphCachePaddingSDF,
+                           origin->y + kGlyphCachePaddingSDF));
+    entry->set_size(*bitmap_size + vec2i(kGlyphCachePaddingSDF * 2,
+                                         kGlyphCachePaddingSDF * 2));
+  } else {
+    entry->set_offset(vec2(bitmap_left, static_cast<float>(origin->y)));
+    entry->set_size(*bitmap_size);
+  }
+  return true;
+}
+
+const GlyphCacheEntry *FontManager::GetPlaceholderEntry(
+    const FaceData &face_data, const GlyphKey &key, ErrorType *error) {
+  auto &indices = context_->placeholder_indices;
+  auto &glyphs = context_->placeholder_glyphs;
+  auto it = indices.find(key);
+  if (it != indices.end()) {
+    return &glyphs[it->second].entry;
+  }
+
+  // Metrics of bitmap fonts and color glyphs come from rendered images.
+  auto face = face_data.GetInstance()->get_face();
+  if (!FT_IS_SCALABLE(face) || FT_HAS_COLOR(face) ||
+      key.get_flags() & kGlyphFlagsMultiChannelSDF) {
+    *error = kErrorTypeGlyphDeferred;
+    return nullptr;
+  }
+
+  PlaceholderGlyph glyph;
+  vec2i origin;
+  vec2i bitmap_size;
+  if (!LoadGlyphMetrics(face_data, key, &glyph.entry, &origin, &bitmap_size,
+                        error)) {
+    return nullptr;
+  }
+  glyph.key = key;
+  glyph.face_id = context_->current_font->GetCurrentFaceId();
+  indices[key] = glyphs.size();
+  glyphs.push_back(glyph);
+  return &glyphs.back().entry;
+}
+
+const GlyphCacheEntry *FontManager::ReserveCachedEntry(
+    const FaceData &face_data, const GlyphKey &key, ErrorType *error) {
+  GlyphCacheEntry entry;
+  vec2i origin;
+  vec2i bitmap_size;
+  if (!LoadGlyphMetrics(face_data, key, &entry, &origin, &bitmap_size,
+                        error)) {
+    return nullptr;
+  }
+
+  // Reserve a cleared region until the image arrives.
+  auto size = entry.get_size();
+  placeholder_image_.assign(size.x * size.y, 0);
+  auto cache = glyph_cache_->Set(
+      placeholder_image_.size() ? placeholder_image_.data() : nullptr, key,
+      entry);
+  if (cache == nullptr) {
+    LogInfo("Glyph cache is full. Need to flush and re-create.\n");
+    *error = kErrorTypeCacheIsFull;
+    return nullptr;
+  }
+
+  if (size.x && size.y) {
+    std::unique_ptr<GlyphRasterJob> job(new GlyphRasterJob());
+    job->key = key;
+    job->entry = entry;
+    job->font_hash = face_data.get_font_hash();
+    job->font_data = face_data.get_font_data();
+    job->font_data_size = face_data.get_font_size();
+    job->face_index = face_data.get_face_index();
+    job->origin = origin;
+    job->bitmap_size = bitmap_size;
+    job->size = size;
+    job->succeeded = false;
+    glyph_rasterizer_->Enqueue(std::move(job));
+  } else {
+    AddToDiskCache(face_data.get_font_hash(), key, entry, nullptr, 0);
+  }
+  return cache;
+}
+
+const GlyphCacheEntry *FontManager::GenerateMultiChannelSDF(
+    const FaceData &face_data, const GlyphKey &key, ErrorType *error) {
+  // Load the outline without hinting, which would distort the shape when the
+  // glyph is scaled from the cached size.
+  auto face = face_data.GetInstance()->get_face();
+  auto code_point = key.get_code_point();
+  FT_Error err =
+      FT_Load_Glyph(face, code_point, FT_LOAD_NO_BITMAP | FT_LOAD_NO_HINTING);
+  if (err) {
+    LogInfo("Can't load glyph %c FT_Error:%d\n", code_point, err);
+    *error = kErrorTypeMissingGlyph;
+    return nullptr;
   }
 
+  // Calculate bitmap bounds in the same way as ReserveCachedEntry().
+  FT_GlyphSlot g = face->glyph;
+  FT_BBox cbox;
+  FT_Outline_Get_CBox(&g->outline, &cbox);
+  auto x_min = cbox.xMin & ~(kFreeTypeUnit - 1);
+  auto y_min = cbox.yMin & ~(kFreeTypeUnit - 1);
+  auto x_max = (cbox.xMax + kFreeTypeUnit - 1) & ~(kFreeTypeUnit - 1);
+  auto y_max = (cbox.yMax + kFreeTypeUnit - 1) & ~(kFreeTypeUnit - 1);
+  vec2i origin(static_cast<int32_t>(x_min / kFreeTypeUnit),
+               static_cast<int32_t>(y_max / kFreeTypeUnit));
+  vec2i bitmap_size(static_cast<int32_t>((x_max - x_min) / kFreeTypeUnit),
+                    static_cast<int32_t>((y_max - y_min) / kFreeTypeUnit));
+
+  GlyphCacheEntry entry;
+  entry.set_code_point(code_point);
+  entry.set_advance(vec2i(g->advance.x / kFreeTypeUnit, 0));
+  if (!bitmap_size.x || !bitmap_size.y) {
+    // Glyphs without a shape (e.g. spaces) only need metrics.
+    entry.set_offset(vec2(static_cast<float>(origin.x),
+                          static_cast<float>(origin.y)));
+  } else {
+    entry.set_offset(vec2(origin - vec2i(kGlyphCachePaddingSDF,
+                                         -kGlyphCachePaddingSDF)));
+    entry.set_size(bitmap_size + vec2i(kGlyphCachePaddingSDF * 2,
+                                       kGlyphCachePaddingSDF * 2));
+    entry.set_multi_channel_sdf(true);
+  }
+  auto cache = glyph_cache_->Set(nullptr, key, entry);
+  if (cache == nullptr) {
+    LogInfo("Glyph cache is full. Need to flush and re-create.\n");
+    *error = kErrorTypeCacheIsFull;
+    return nullptr;
+  }
+  if (!entry.get_multi_channel_sdf()) {
+    return cache;
+  }
+
+  // Generate the distance field directly into the reserved region.
+  if (msdf_generator_ == nullptr) {
+    msdf_generator_.reset(new MsdfGenerator());
+  }
+  auto outline_origin = entry.get_offset();
+  if (!msdf_generator_->LoadOutline(g->outline, outline_origin)) {
+    LogInfo("Can't decompose the outline of glyph %c\n", code_point);
+    return cache;
+  }
+  auto buffer = glyph_cache_->get_msdf_buffer();
+  auto pos = cache->get_pos();
+  auto stride = buffer->get_size().x;
+  auto p = buffer->get(pos.z & ~kGlyphFormatsMask) +
+           (pos.x + pos.y * stride) * buffer->get_element_size();
+  FLATUI_TRACE_SCOPE("FontManager::GenerateMultiChannelSDF", code_point);
+  ScopedTextPipelineTimer timer(&text_pipeline_counters_,
+                                TextPipelineCounters::kSdfTime);
+  msdf_generator_->Generate(p, cache->get_size(), stride);
   return cache;
 }
 
-int32_t FontManager::ConvertSize(int32_t original_ysize) {
-  if (size_selector_ != nullptr) {
+void FontManager::CommitRasterizedGlyphs() {
+  if (!glyph_rasterizer_) {
+    return;
+  }
+  std::vector<std::unique_ptr<GlyphRasterJob>> jobs;
+  glyph_rasterizer_->GetCompletedJobs(&jobs);
+  for (auto &job : jobs) {
+    // The entry may have been evicted while the glyph is rendered. In that
+    // case, the glyph is reserved again when a FontBuffer using it is
+    // reconstructed.
+    if (job->succeeded &&
+        glyph_cache_->UpdateImage(job->key, job->size, job->image.get())) {
+      AddToDiskCache(job->font_hash, job->key, job->entry, job->image.get(),
+                     job->size.x);
+    }
+  }
+}
+
+void FontManager::CommitDistanceFields() {
+  auto gpu_computer = sdf_computer_->get_gpu_computer();
+  if (gpu_computer == nullptr) {
+    return;
+  }
+  // The textures already have the distance fields, and the cache buffer
+  // receives them so that they survive re-uploads and compactions.
+  std::vector<std::unique_ptr<GpuDistanceJob>> jobs;
+  gpu_computer->GetCompletedJobs(&jobs);
+  for (auto &job : jobs) {
+    if (glyph_cache_->UpdateImage(job->key, job->size, job->image.get())) {
+      AddToDiskCache(job->font_hash, job->key, job->entry, job->image.get(),
+                     job->size.x);
+    }
+  }
+}
+
+void FontManager::AddToDiskCache(HashedId font_hash, const GlyphKey &key,
+                                 const GlyphCacheEntry &entry,
+                                 const uint8_t *image, int32_t stride) {
+  if (!disk_cache_) {
+    return;
+  }
+  // Outputs of unknown distance computers can't be validated in following
+  // runs.
+  if (key.get_flags() & (kGlyphFlagsOuterSDF | kGlyphFlagsInnerSDF) &&
+      sdf_computer_->get_version() == kDistanceComputerVersionUnknown) {
+    return;
+  }
+  disk_cache_->Add(font_hash, key, entry, image, stride);
+}
+
+void FontManager::SetShapingCacheSize(size_t size) {
+  fplutil::MutexLock lock(*cache_mutex_);
+  shaping_cache_->set_capacity(size);
+}
+
+void FontManager::SetWordBreakCacheSize(size_t size) {
+  fplutil::MutexLock lock(*cache_mutex_);
+  word_break_cache_->set_capacity(size);
+}
+
+void FontManager::SetColorGlyphCacheSize(size_t size) {
+  fplutil::MutexLock lock(*cache_mutex_);
+  color_glyph_cache_->set_capacity(size);
+}
+
+void FontManager::SetHtmlCacheSize(size_t size) {
+  fplutil::MutexLock lock(*cache_mutex_);
+  html_cache_->set_capacity(size);
+}
+
+bool FontManager::EnableDiskCache(const char *file_name) {
+  fplutil::MutexLock lock(*cache_mutex_);
+  disk_cache_.reset();
+  if (file_name == nullptr) {
+    return false;
+  }
+  disk_cache_.reset(new GlyphDiskCache());
+  if (!disk_cache_->Open(file_name, sdf_computer_->get_version())) {
+    disk_cache_.reset();
+    return false;
+  }
+  return true;
+}
+
+bool FontManager::SaveDiskCache() {
+  fplutil::MutexLock lock(*cache_mutex_);
+  if (!disk_cache_ || !disk_cache_->is_dirty()) {
+    return true;
+  }
+  return disk_cache_->Save();
+}
+
+bool FontManager::SaveGlyphAtlas(const char *file_name) {
+  fplutil::MutexLock lock(*cache_mutex_);
+  if (glyph_cache_->get_last_flush_revision() != kNeverFlushed) {
+    LogError("Glyphs have been evicted from the glyph cache. "
+             "Increase the cache size to save the glyph atlas.\n");
+    return false;
+  }
+  std::string data;
+  glyph_cache_->SaveAtlas(&data);
+  if (!fplbase::SaveFile(file_name, data)) {
+    LogError("Can't save glyph atlas: %s\n", file_name);
+    return false;
+  }
+  return true;
+}
+
+bool FontManager::LoadGlyphAtlas(const char *file_name) {
+  std::string data;
+  if (!fplbase::LoadFile(file_name, &data)) {
+    LogError("Can't load glyph atlas: %s\n", file_name);
+    return false;
+  }
+  fplutil::MutexLock lock(*cache_mutex_);
+  return glyph_cache_->LoadPinnedAtlas(data.data(), data.size());
+}
+
+bool FontManager::PrewarmGlyphs(const char *text, float size,
+                                GlyphFlags flags) {
+  return CacheGlyphs(text, size, flags, false);
+}
+
+bool FontManager::PinGlyphs(const char *text, float size, GlyphFlags flags) {
+  return CacheGlyphs(text, size, flags, true);
+}
+
+void FontManager::UnpinGlyphs() {
+  fplutil::MutexLock lock(*cache_mutex_);
+  glyph_cache_->UnpinAll();
+}
+
+bool FontManager::CacheGlyphs(const char *text, float size, GlyphFlags flags,
+                              bool pin) {
+  // Glyphs are pinned by the layout, without layouts in other threads.
+  LayoutScope scope(this, true);
+  if (context_->current_font == nullptr) {
+    LogError("No font is selected to cache glyphs.\n");
+    return false;
+  }
+  auto length = static_cast<uint32_t>(strlen(text));
+  FontBufferParameters parameters(context_->current_font->GetFontId(),
+                                  HashId(text), size, mathfu::kZeros2i,
+                                  kTextAlignmentLeft, flags, false, false);
+  for (auto retry = 0; retry < 2; ++retry) {
+    ErrorType error = kErrorTypeSuccess;
+    {
+      // The buffer is discarded, only the glyphs stay in the cache.
+      FontBuffer buffer(length, false);
+      FontBufferContext ctx;
+      ctx.SetAttribute(FontBufferAttributes());
+      context_->line_width = 0;
+      {
+        fplutil::MutexLock lock(*cache_mutex_);
+        glyph_cache_->set_pinning(pin);
+      }
+      auto ret = FillBuffer(text, length, parameters, &buffer, &ctx, nullptr,
+                            &error);
+      fplutil::MutexLock lock(*cache_mutex_);
+      glyph_cache_->set_pinning(false);
+      // Release the rows while holding the lock, before the buffer goes away.
+      buffer.ReleaseCacheRowReference();
+      if (ret != nullptr) {
+        return true;
+      }
+    }
+    if (error != kErrorTypeCacheIsFull) {
+      break;
+    }
+    // Flush glyph cache & Upload a texture, and try again.
+    FlushAndUpdate();
+  }
+  LogError("Glyphs of '%s' with size:%f can't be cached.\n", text, size);
+  return false;
+}
+
+int32_t FontManager::ConvertSize(int32_t original_ysize, GlyphFlags flags) {
+  if (flags & kGlyphFlagsMultiChannelSDF) {
+    // Multi-channel SDF glyphs are cached in one size and scaled to any size.
+    return msdf_glyph_size_;
+  } else if (size_selector_ != nullptr) {
     return size_selector_(original_ysize);
   } else {
     return original_ysize;
@@ -1671,6 +3510,77 @@ void FontManager::EnableColorGlyph() {
   glyph_cache_->EnableColorGlyph();
 }
 
+void FontManager::SetGlyphCachePacking(GlyphCachePacking packing) {
+  fplutil::MutexLock lock(*cache_mutex_);
+  glyph_cache_->set_packing(packing);
+  atlas_last_flush_revision_ = glyph_cache_->get_last_flush_revision();
+}
+
+void FontManager::EnableGlyphCacheCompaction(bool enable) {
+  fplutil::MutexLock lock(*cache_mutex_);
+  glyph_cache_->set_compaction(enable);
+}
+
+void FontManager::SetGlyphCacheUploadMode(GlyphCacheUploadMode mode) {
+  fplutil::MutexLock lock(*cache_mutex_);
+  glyph_cache_->set_upload_mode(mode);
+}
+
+void FontManager::SetGlyphCacheMaxSlices(int32_t max_slices) {
+  fplutil::MutexLock lock(*cache_mutex_);
+  glyph_cache_->set_max_slices(max_slices);
+}
+
+int32_t FontManager::GetGlyphCacheMaxSlices() const {
+  fplutil::MutexLock lock(*cache_mutex_);
+  return glyph_cache_->get_max_slices();
+}
+
+void FontManager::EnableGlyphCacheSliceRelease(int32_t idle_passes) {
+  fplutil::MutexLock lock(*cache_mutex_);
+  slice_release_passes_ = std::max(idle_passes, 0);
+}
+
+void FontManager::EnableGlyphInstances(bool enable) {
+  if (enable && !FontVertexBuffer::IsInstancingSupported()) {
+    LogInfo("Instanced draws are not supported, glyph instances are "
+            "disabled.\n");
+    enable = false;
+  }
+  glyph_instances_ = enable;
+}
+
+void FontManager::EnableAsyncGlyphRasterization(int32_t num_workers) {
+  fplutil::MutexLock lock(*cache_mutex_);
+  if (glyph_rasterizer_) {
+    // Commit glyphs in flight before stopping workers.
+    glyph_rasterizer_->Wait();
+    CommitRasterizedGlyphs();
+    glyph_rasterizer_.reset();
+  }
+  if (num_workers > 0) {
+    glyph_rasterizer_.reset(
+        new GlyphRasterizer(num_workers, DistanceComputerFactory,
+                            sdf_reserve_size_, &text_pipeline_counters_));
+    if (!glyph_rasterizer_->get_num_workers()) {
+      LogError("Failed to start glyph rasterization workers.\n");
+      glyph_rasterizer_.reset();
+    }
+  }
+}
+
+void FontManager::EnableParallelLayout(int32_t num_workers) {
+  layout_workers_.reset();
+  if (num_workers > 0) {
+    layout_workers_.reset(new LayoutWorkers(num_workers));
+  }
+}
+
+bool FontManager::HasPendingGlyphs() {
+  fplutil::MutexLock lock(*cache_mutex_);
+  return glyph_rasterizer_ && glyph_rasterizer_->HasPendingJobs();
+}
+
 FontBufferStatus FontManager::GetFontBufferStatus(const FontBuffer &font_buffer)
     const {
   if (font_buffer.get_revision() <= atlas_last_flush_revision_) {
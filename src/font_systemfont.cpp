@@ -41,6 +41,7 @@
 #include "TargetConditionals.h"
 #endif
 #include "font_manager.h"
+#include "internal/glyph_rasterizer.h"
 
 using fplbase::LogInfo;
 using fplbase::LogError;
@@ -313,7 +314,6 @@ static bool CGFontToSFNT(CGFontRef font, std::string* data) {
 // Open specified font by name and return the raw data.
 // Current implementation works on macOS/iOS.
 #ifdef __APPLE__
-#if TARGET_OS_IPHONE
 
 /// @brief Ensures a directory exists at a URL.
 /// @return Returns true if it was able to ensure the directory exists.
@@ -360,10 +360,24 @@ static int DeleteDirectory(char *path) {
   return nftw(path, NftwRemove, 64, FTW_DEPTH | FTW_PHYS);
 }
 
-static const void* OpenFontByName(CFStringRef name,
-                                  int32_t offset,
-                                  int32_t *size) {
-  const void* returnValue = nullptr;
+static bool GetPath(CFURLRef url, std::string* path) {
+  cf_ptr<CFStringRef> cf_path(
+      CFURLCopyFileSystemPath(url, kCFURLPOSIXPathStyle));
+  char pathBuffer[1024];
+  if (!CFStringGetCString(cf_path.get(), pathBuffer, sizeof(pathBuffer),
+                          kCFStringEncodingUTF8)) {
+    return false;
+  }
+  *path = pathBuffer;
+  return true;
+}
+
+/// @brief Set up the directory caching SFNT data converted from CGFonts.
+/// The cache is kept in Library/Caches/flatui-fonts/<darwin version>, and
+/// caches of other OS versions are deleted, since system fonts may be updated
+/// with the OS.
+/// @return Returns the path of the directory, or an empty string on failure.
+static std::string CreateFontCacheDirectory() {
   cf_ptr<CFURLRef> homeUrl(CFCopyHomeDirectoryURL());
   cf_ptr<CFURLRef> libraryUrl(
       CFURLCreateCopyAppendingPathComponent(nullptr,
@@ -385,7 +399,7 @@ static const void* OpenFontByName(CFStringRef name,
   char darwinVersion[256];
   if (!GetDarwinVersion(darwinVersion, sizeof(darwinVersion))) {
     LogError("OpenFontByName: unable to get darwin version");
-    return nullptr;
+    return std::string();
   }
 
   cf_ptr<CFStringRef> cfDarwinVersion(
@@ -402,89 +416,101 @@ static const void* OpenFontByName(CFStringRef name,
   // Delete cache if invalidated by new operating system version.
   if (CFURLResourceIsReachable(fontsUrl.get(), nullptr) &&
         !CFURLResourceIsReachable(darwinVersionUrl.get(), nullptr)) {
-    cf_ptr<CFStringRef> fontsPath(
-        CFURLCopyFileSystemPath(fontsUrl.get(),
-                                kCFURLPOSIXPathStyle));
-
-    char fontsPathBuffer[1024];
-    Boolean didGetCString = CFStringGetCString(fontsPath.get(),
-                                               fontsPathBuffer,
-                                               1024,
-                                               kCFStringEncodingUTF8);
-    if (!didGetCString) {
-      return nullptr;
+    std::string fontsPath;
+    if (!GetPath(fontsUrl.get(), &fontsPath)) {
+      return std::string();
     }
 
-    int err = DeleteDirectory(fontsPathBuffer);
+    std::vector<char> fontsPathBuffer(fontsPath.begin(), fontsPath.end());
+    fontsPathBuffer.push_back('\0');
+    int err = DeleteDirectory(fontsPathBuffer.data());
     if (0 != err) {
-      return nullptr;
+      return std::string();
     }
   }
 
   bool didEnsureFontsUrl = EnsureDirectory(fontsUrl.get());
   if (!didEnsureFontsUrl) {
     LogError("OpenFontByName: unable ensure fonts directory exists");
-    return nullptr;
+    return std::string();
   }
 
   bool didEnsureDarwinVersionUrl = EnsureDirectory(darwinVersionUrl.get());
   if (!didEnsureDarwinVersionUrl) {
     LogError("OpenFontByName: unable ensure darwin version directory exists");
-    return nullptr;
+    return std::string();
   }
 
-  cf_ptr<CFURLRef> cacheUrl(
-      CFURLCreateCopyAppendingPathComponent(nullptr,
-                                            darwinVersionUrl.get(),
-                                            name,
-                                            true));
-
-  cf_ptr<CFStringRef> cachePath(
-      CFURLCopyFileSystemPath(cacheUrl.get(),
-                              kCFURLPOSIXPathStyle));
-  char pathBuffer[1024];
-  Boolean didGetCString = CFStringGetCString(cachePath.get(),
-                                             pathBuffer,
-                                             1024,
-                                             kCFStringEncodingUTF8);
-  if (!didGetCString) {
+  std::string path;
+  if (!GetPath(darwinVersionUrl.get(), &path)) {
     LogError("OpenFontByName: unable to get cstring from cfstringref");
+    return std::string();
+  }
+  return path;
+}
+
+/// @brief Get the directory caching SFNT data.
+/// The directory is set up only once in a process, since the OS version
+/// can't change while the app is running.
+static const std::string& GetFontCacheDirectory() {
+  static const std::string directory = CreateFontCacheDirectory();
+  return directory;
+}
+
+static bool OpenFontByName(CFStringRef name, std::string* dest);
+
+/// @brief Map the SFNT data of a font from the cache, creating the cache entry
+/// with CGFontToSFNT() if it doesn't exist yet.
+static const void* OpenFontByName(const char* font_name,
+                                  int32_t offset,
+                                  int32_t *size) {
+  auto& directory = GetFontCacheDirectory();
+  if (directory.empty()) {
     return nullptr;
   }
+  auto path = directory + "/" + font_name;
 
-  // Check to see if file exists.
-  Boolean isReachable = CFURLResourceIsReachable(cacheUrl.get(), nullptr);
-  if (!isReachable) {
-    cf_ptr<CGFontRef> cgfont(CGFontCreateWithFontName(name));
-    if (cgfont.get() == nullptr) {
-      LogError("OpenFontByName: unable to open cgfont");
-      return nullptr;
-    }
+  // Cache hit. This is the common case after the first launch.
+  auto returnValue = fplbase::MapFile(path.c_str(), offset, size);
+  if (returnValue) {
+    return returnValue;
+  }
 
-    // Load the font file of assets.
-    std::string sfntData;
-    bool didConvert = CGFontToSFNT(cgfont.get(), &sfntData);
-    if (!didConvert) {
-      LogError("OpenFontByName: unable to convert to sfnt");
-      return nullptr;
-    }
+  cf_ptr<CFStringRef> name(CFStringCreateWithCString(
+      kCFAllocatorDefault, font_name, kCFStringEncodingUTF8));
+  std::string sfntData;
+  if (!OpenFontByName(name.get(), &sfntData)) {
+    LogError("OpenFontByName: unable to convert to sfnt");
+    return nullptr;
+  }
 
-    std::ofstream outfile;
-    outfile.open(pathBuffer);
-    if (outfile.bad()) {
+  // Write to a temporary file and rename it, so a partially written file is
+  // never mapped when the app is killed while writing the cache.
+  auto temp_path = path + ".tmp";
+  {
+    std::ofstream outfile(temp_path.c_str(),
+                          std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!outfile.is_open()) {
       LogError("OpenFontByName: unable to open output file");
       return nullptr;
     }
-    outfile << sfntData;
+    outfile.write(sfntData.c_str(), sfntData.size());
+    if (!outfile.good()) {
+      LogError("OpenFontByName: unable to write output file");
+      outfile.close();
+      remove(temp_path.c_str());
+      return nullptr;
+    }
+  }
+  if (rename(temp_path.c_str(), path.c_str())) {
+    LogError("OpenFontByName: unable to rename output file");
+    remove(temp_path.c_str());
+    return nullptr;
   }
 
-  returnValue = fplbase::MapFile(pathBuffer, offset, size);
-
-  return returnValue;
+  return fplbase::MapFile(path.c_str(), offset, size);
 }
 
-#endif  // TARGET_OS_IPHONE
-
 static bool OpenFontByName(CFStringRef name, std::string* dest) {
   auto cgfont = CGFontCreateWithFontName(name);
   if (cgfont == nullptr) {
@@ -501,16 +527,137 @@ static bool OpenFontByName(CFStringRef name, std::string* dest) {
 // Open system's default font with a fallback list.
 bool FontManager::OpenSystemFont() {
 #ifdef __APPLE__
-  return OpenSystemFontApple();
+  auto ret = OpenSystemFontApple();
 #elif defined(__ANDROID__)
-  return OpenSystemFontAndroid();
+  auto ret = OpenSystemFontAndroid();
 #else   // __APPLE__ || __ANDROID__
   fplbase::LogInfo("OpenSystemFont() not implemented on the platform");
-  return false;
+  auto ret = false;
 #endif  // __APPLE__ || __ANDROID__
+  if (!ret) {
+    return ret;
+  }
+
+  // Keep the first font open, since it's used for the base line and the
+  // underline of the system font. Others are opened when they are needed
+  // in a layout, and may be closed by the eviction or the memory budget.
+  // Faces whose cmap couldn't be read directly are unloaded here.
+  system_fallback_faces_.clear();
+  for (auto it = system_fallback_list_.begin();
+       it != system_fallback_list_.end(); ++it) {
+    auto face = map_faces_.find(it->get_name())->second.get();
+    if (!system_fallback_faces_.empty() && system_font_eviction_passes_ > 0) {
+      ReleaseFaceInstances(*face);
+      face->Unload();
+    }
+    system_fallback_faces_.push_back(face);
+  }
+  if (fallback_font_budget_ != kMemoryBudgetUnlimited) {
+    TrimSystemFontFaces(fallback_font_budget_);
+  }
+  return ret;
+}
+
+bool FontManager::OpenFallbackCoverage(const FontFamily& family) {
+  if (map_faces_.find(family.get_name()) != map_faces_.end()) {
+    return Open(family);
+  }
+  std::unique_ptr<FaceData> face(new FaceData());
+  if (!face->LoadCmap(family)) {
+    return Open(family);
+  }
+
+  face->AddRef();
+  auto insert = map_faces_.insert(
+      std::pair<std::string, std::unique_ptr<FaceData>>(family.get_name(),
+                                                        std::move(face)));
+  HbFont::Open(*insert.first->second, &font_cache_);
+  return true;
+}
+
+void FontManager::LoadSystemFontFace(FaceData* face) {
+  face->set_last_used(glyph_cache_->get_counter());
+  if (face->is_loaded()) {
+    return;
+  }
+
+  // Faces in system_fallback_faces_ are in the order of the fallback list.
+  for (size_t i = 0; i < system_fallback_faces_.size(); ++i) {
+    if (system_fallback_faces_[i] == face) {
+      if (!face->Open(*ft_, system_fallback_list_[i])) {
+        fplbase::LogError("Can't reopen a system font: %s",
+                          system_fallback_list_[i].get_name().c_str());
+      }
+      return;
+    }
+  }
+}
+
+void FontManager::EvictSystemFontFaces() {
+  if (fallback_font_budget_ != kMemoryBudgetUnlimited) {
+    TrimSystemFontFaces(fallback_font_budget_);
+  }
+  if (system_font_eviction_passes_ <= 0) {
+    return;
+  }
+  auto counter = glyph_cache_->get_counter();
+  for (size_t i = 1; i < system_fallback_faces_.size(); ++i) {
+    auto face = system_fallback_faces_[i];
+    if (!face->is_loaded() ||
+        counter - face->get_last_used() <=
+            static_cast<uint32_t>(system_font_eviction_passes_)) {
+      continue;
+    }
+
+    // Cancel glyph rasterizations using the font data before releasing it.
+    if (glyph_rasterizer_) {
+      glyph_rasterizer_->CloseFont(face->get_font_data());
+    }
+    // Close the faces of the font data in layout contexts too.
+    ReleaseFaceInstances(*face);
+    face->Unload();
+  }
+}
+
+void FontManager::TrimSystemFontFaces(size_t budget) {
+  size_t size = 0;
+  for (size_t i = 1; i < system_fallback_faces_.size(); ++i) {
+    auto face = system_fallback_faces_[i];
+    size += face->get_mapped_data_size() + face->get_copied_data_size();
+  }
+
+  auto counter = glyph_cache_->get_counter();
+  while (size > budget) {
+    // Find the least recently used face, keeping faces used in the current
+    // and the previous pass.
+    FaceData *lru_face = nullptr;
+    for (size_t i = 1; i < system_fallback_faces_.size(); ++i) {
+      auto face = system_fallback_faces_[i];
+      if (!face->is_loaded() || counter - face->get_last_used() <= 1) {
+        continue;
+      }
+      if (lru_face == nullptr ||
+          counter - face->get_last_used() >
+              counter - lru_face->get_last_used()) {
+        lru_face = face;
+      }
+    }
+    if (lru_face == nullptr) {
+      break;
+    }
+
+    if (glyph_rasterizer_) {
+      glyph_rasterizer_->CloseFont(lru_face->get_font_data());
+    }
+    size -= lru_face->get_mapped_data_size() +
+            lru_face->get_copied_data_size();
+    ReleaseFaceInstances(*lru_face);
+    lru_face->Unload();
+  }
 }
 
 bool FontManager::CloseSystemFont() {
+  system_fallback_faces_.clear();
 #ifdef __APPLE__
   return CloseSystemFontApple();
 #elif defined(__ANDROID__)
@@ -552,7 +699,7 @@ bool FontManager::OpenSystemFontApple() {
   // Iterate through the list and load each font.
   bool ret = false;
   // A set used to check a font coverage while loading system fonts.
-  std::set<FT_ULong> font_coverage;
+  CodepointCoverage font_coverage;
   const int32_t kStringLength = 128;
   char str[kStringLength];
 
@@ -572,10 +719,13 @@ bool FontManager::OpenSystemFontApple() {
                            kCFStringEncodingUTF8)) {
       LogInfoProxy("Font name %s", str);
       FontFamily family(str, true);
-      if (Open(family)) {
+      // Fonts after the first one are opened when they are needed.
+      auto lazy =
+          system_font_eviction_passes_ > 0 && !system_fallback_list_.empty();
+      if (lazy ? OpenFallbackCoverage(family) : Open(family)) {
         // Retrieve the font size for an information.
         auto it = map_faces_.find(family.get_name());
-        if (UpdateFontCoverage(it->second->get_face(), &font_coverage)) {
+        if (UpdateFontCoverage(*it->second, &font_coverage)) {
           total_size += it->second->get_font_size();
 
           system_fallback_list_.push_back(family);
@@ -701,7 +851,7 @@ bool FontManager::OpenSystemFontAndroid() {
   // Generates a font name list.
   auto ret = false;
   // A set used to check a font coverage while loading system fonts.
-  std::set<FT_ULong> font_coverage;
+  CodepointCoverage font_coverage;
 #ifdef FLATUI_PROFILE_SYSTEM_FONT_SEARCH
   auto start = std::chrono::system_clock::now();
 #endif  // FLATUI_PROFILE_SYSTEM_FONT_SEARCH
@@ -739,10 +889,13 @@ bool FontManager::OpenSystemFontAndroid() {
   auto font_it = font_list.begin();
   auto font_end = font_list.end();
   while (font_it != font_end) {
-    if (Open(*font_it)) {
+    // Fonts after the first one are opened when they are needed.
+    auto lazy =
+        system_font_eviction_passes_ > 0 && !system_fallback_list_.empty();
+    if (lazy ? OpenFallbackCoverage(*font_it) : Open(*font_it)) {
       // Retrieve the font size for an information.
       auto face = map_faces_.find(font_it->get_name());
-      if (UpdateFontCoverage(face->second->get_face(), &font_coverage)) {
+      if (UpdateFontCoverage(*face->second, &font_coverage)) {
         total_size += face->second->get_font_size();
         system_fallback_list_.push_back(std::move(*font_it));
         ret = true;
@@ -805,47 +958,25 @@ bool FontManager::CloseSystemFontAndroid() {
 }
 #endif  // __ANDROID__
 
-bool FontManager::UpdateFontCoverage(FT_Face face,
-                                     std::set<FT_ULong>* font_coverage) {
-  auto has_new_coverage = false;
-  FT_UInt index = 0;
-  FT_ULong code = FT_Get_First_Char(face, &index);
-  int32_t new_glyph = 0;
-  while (index != 0) {
-    if (font_coverage->find(code) == font_coverage->end()) {
-      has_new_coverage = true;
-      font_coverage->insert(code);
-      new_glyph++;
-    }
-    code = FT_Get_Next_Char(face, code, &index);
-  }
+bool FontManager::UpdateFontCoverage(const FaceData& face,
+                                     CodepointCoverage* font_coverage) {
+  auto new_glyph = font_coverage->Merge(face.get_coverage());
 #ifdef FLATUI_VERBOSE_LOGGING
   fplbase::LogInfo("Has %d new glyphs", new_glyph);
 #endif  // FLATUI_VERBOSE_LOGGING
-  return has_new_coverage;
+  return new_glyph > 0;
 }
 
 const void* FaceData::OpenFontByName(const char* font_name,
                                      int32_t offset,
                                      int32_t *size) {
 #ifdef __APPLE__
-#if TARGET_OS_IPHONE
-  // Open the font using CGFont API and create font data from them.
-  auto name = CFStringCreateWithCString(kCFAllocatorDefault, font_name,
-                                        kCFStringEncodingUTF8);
-  const void* ret = flatui::OpenFontByName(name, offset, size);
+  // Map the font data cached from CGFont API.
+  const void* ret = flatui::OpenFontByName(font_name, offset, size);
   if (!ret) {
     LogInfo("Can't load font resource: %s\n", font_name);
   }
-  CFRelease(name);
   return ret;
-#else  // TARGET_OS_IPHONE
-  (void)font_name;
-  (void)offset;
-  (void)size;
-  fplbase::LogInfo("OpenFontByName() not implemented on the platform.");
-  return nullptr;
-#endif  // TARGET_OS_IPHONE
 #else   // __APPLE__
   (void)font_name;
   (void)offset;
@@ -873,4 +1004,28 @@ bool FaceData::OpenFontByName(const char* font_name, std::string* dest) {
   return false;
 #endif  // __APPLE__
 }
+
+bool FaceData::OpenCmapByName(const char* font_name, std::string* dest) {
+#ifdef __APPLE__
+  cf_ptr<CFStringRef> name(CFStringCreateWithCString(
+      kCFAllocatorDefault, font_name, kCFStringEncodingUTF8));
+  auto cgfont = CGFontCreateWithFontName(name.get());
+  if (cgfont == nullptr) {
+    return false;
+  }
+  auto table = CGFontCopyTableForTag(cgfont, kCTFontTableCmap);
+  CFRelease(cgfont);
+  if (table == nullptr) {
+    return false;
+  }
+  dest->assign(reinterpret_cast<const char*>(CFDataGetBytePtr(table)),
+               CFDataGetLength(table));
+  CFRelease(table);
+  return true;
+#else   // __APPLE__
+  (void)font_name;
+  (void)dest;
+  return false;
+#endif  // __APPLE__
+}
 }  // namespace flatui
@@ -15,6 +15,7 @@
 #include "precompiled.h"
 
 #include <cctype>
+#include <cstring>
 #include <sstream>
 
 #if defined(FLATUI_HAS_GUMBO)
@@ -62,7 +63,6 @@ std::string &TrimHtmlWhitespace(const char *text, bool trim_leading_whitespace,
   return *out;
 }
 
-#if defined(FLATUI_HAS_GUMBO)
 // Remove trailing whitespace. Then add a `prefix` if there is any preceeding
 // text.
 static std::string &StartHtmlLine(const char *prefix, std::string *out) {
@@ -102,101 +102,645 @@ static bool ParseColorValue(const char *value, uint32_t *color) {
   return true;
 }
 
+// Elements that change the conversion of HTML into sections.
+enum HtmlTag {
+  kHtmlTagA,
+  kHtmlTagFont,
+  kHtmlTagP,
+  kHtmlTagHeading,
+  kHtmlTagHr,
+  kHtmlTagBr,
+  kHtmlTagOther,
+};
+
+// Attributes of an element used in the conversion. nullptr when the attribute
+// is not specified.
+struct HtmlAttributes {
+  HtmlAttributes()
+      : href(nullptr), face(nullptr), color(nullptr), size(nullptr) {}
+  const char *href;
+  const char *face;
+  const char *color;
+  const char *size;
+};
+
+// Font settings outside of an element, restored at the end of the element.
+struct HtmlFontSetting {
+  std::string face;
+  uint32_t color;
+  int32_t size;
+};
+
+// Prefix processing of an element, shared by the Gumbo tree walker and the
+// subset parser so that both produce the same sections.
+static void StartHtmlElement(HtmlTag tag, const HtmlAttributes &attributes,
+                             std::vector<HtmlSection> *s,
+                             HtmlSection *current_setting,
+                             HtmlFontSetting *original) {
+  original->face = current_setting->face();
+  original->color = current_setting->color();
+  original->size = current_setting->size();
+
+  switch (tag) {
+    case kHtmlTagA: {
+      // Record the link address.
+      if (attributes.href != nullptr) {
+        // Start a new section for the anchor.
+        if (!s->back().text().empty()) {
+          s->push_back(HtmlSection());
+        }
+        s->back().set_link(attributes.href);
+      }
+      break;
+    }
+    case kHtmlTagFont: {
+      // Start a new section for the font tag.
+      bool new_params = attributes.face != nullptr ||
+                        attributes.color != nullptr ||
+                        attributes.size != nullptr;
+      if (new_params && !s->back().text().empty()) {
+        s->push_back(HtmlSection());
+      }
+      if (attributes.face != nullptr) {
+        // Keep current setting and update font face setting.
+        s->back().set_face(attributes.face);
+        current_setting->set_face(attributes.face);
+      } else {
+        s->back().set_face(current_setting->face());
+      }
+      if (attributes.color != nullptr) {
+        uint32_t color_value = kDefaultColor;
+        if (ParseColorValue(attributes.color, &color_value)) {
+          // Keep current setting and update font face setting.
+          s->back().set_color(color_value);
+          current_setting->set_color(color_value);
+        } else {
+          LogInfo("Failed to parse a value: %s", attributes.color);
+        }
+      } else {
+        s->back().set_color(current_setting->color());
+      }
+      if (attributes.size != nullptr) {
+        auto value =
+            static_cast<int>(std::strtol(attributes.size, nullptr, 10));
+        if (value) {
+          // Convert the virtual size to physical size.
+          value = VirtualToPhysical(vec2(0, value)).y;
+
+          // Keep current setting and update font face setting.
+          s->back().set_size(value);
+          current_setting->set_size(value);
+        } else {
+          LogInfo("Failed to parse a value: %s", attributes.size);
+        }
+      } else {
+        s->back().set_size(current_setting->size());
+      }
+      break;
+    }
+    case kHtmlTagP:
+    case kHtmlTagHeading:  // fallthrough
+      StartHtmlLine("\n\n", &s->back().text());
+      break;
+
+    default:
+      break;
+  }
+}
+
+// Postfix processing of an element.
+static void EndHtmlElement(HtmlTag tag, const HtmlFontSetting &original,
+                           std::vector<HtmlSection> *s,
+                           HtmlSection *current_setting) {
+  switch (tag) {
+    case kHtmlTagA:
+      // Start a new section for the non-anchor.
+      s->push_back(HtmlSection());
+      break;
+    case kHtmlTagFont: {
+      // Restore the font setting if it's changed.
+      bool new_params = s->back().face() != original.face ||
+                        s->back().color() != original.color ||
+                        s->back().size() != original.size;
+      if (new_params) {
+        s->push_back(HtmlSection());
+      }
+
+      // Restore settings.
+      current_setting->set_face(original.face);
+      s->back().set_face(original.face);
+      current_setting->set_color(original.color);
+      s->back().set_color(original.color);
+      current_setting->set_size(original.size);
+      s->back().set_size(original.size);
+      break;
+    }
+    case kHtmlTagHr:
+    case kHtmlTagP:  // fallthrough
+      s->back().text().append("\n\n");
+      break;
+
+    case kHtmlTagHeading:  // fallthrough
+    case kHtmlTagBr:
+      s->back().text().append("\n");
+      break;
+
+    default:
+      break;
+  }
+}
+
+// Appends text to the sections with whitespace collapsed as
+// TrimHtmlWhitespace() does, one character at a time, so that the subset
+// parser can decode the text while appending it.
+class HtmlTextWriter {
+ public:
+  HtmlTextWriter()
+      : out_(nullptr),
+        skip_space_(false),
+        in_space_(false),
+        has_space_(false),
+        has_text_(false) {}
+
+  // Start a text run at the end of the sections.
+  void Start(std::vector<HtmlSection> *s) {
+    out_ = &s->back().text();
+    skip_space_ = ShouldTrimLeadingWhitespace(*s);
+    in_space_ = false;
+    has_space_ = false;
+    has_text_ = false;
+  }
+
+  void Put(char c) {
+    if (std::isspace(c)) {
+      if (!skip_space_ && !in_space_) {
+        out_->push_back(' ');
+        in_space_ = true;
+        has_space_ = true;
+      }
+    } else {
+      out_->push_back(c);
+      skip_space_ = false;
+      in_space_ = false;
+      has_text_ = true;
+    }
+  }
+
+  // Check if the run only added a space. Such runs are whitespace nodes in
+  // Gumbo's tree, where they may be placed differently by the tree
+  // construction, so the subset parser leaves them to Gumbo.
+  bool IsWhitespaceOnly() const { return has_space_ && !has_text_; }
+
+ private:
+  std::string *out_;
+  bool skip_space_;
+  bool in_space_;
+  bool has_space_;
+  bool has_text_;
+};
+
+// Names of elements the subset parser understands.
+struct HtmlTagName {
+  const char *name;
+  HtmlTag tag;
+  // Elements such as <br> never have children.
+  bool is_void;
+  // Elements such as <html> and <body> don't affect the sections.
+  bool is_ignored;
+};
+static const HtmlTagName kHtmlTagNames[] = {
+    {"a", kHtmlTagA, false, false},
+    {"b", kHtmlTagOther, false, false},
+    {"body", kHtmlTagOther, false, true},
+    {"br", kHtmlTagBr, true, false},
+    {"em", kHtmlTagOther, false, false},
+    {"font", kHtmlTagFont, false, false},
+    {"h1", kHtmlTagHeading, false, false},
+    {"h2", kHtmlTagHeading, false, false},
+    {"h3", kHtmlTagHeading, false, false},
+    {"h4", kHtmlTagHeading, false, false},
+    {"h5", kHtmlTagHeading, false, false},
+    {"h6", kHtmlTagHeading, false, false},
+    {"hr", kHtmlTagHr, true, false},
+    {"html", kHtmlTagOther, false, true},
+    {"i", kHtmlTagOther, false, false},
+    {"p", kHtmlTagP, false, false},
+    {"strong", kHtmlTagOther, false, false},
+    {"u", kHtmlTagOther, false, false},
+};
+
+// Compare the first `length` characters of `text` with a lowercase string,
+// ignoring the case of `text`.
+static bool EqualIgnoringCase(const char *text, const char *lowercase,
+                              size_t length) {
+  for (size_t i = 0; i < length; ++i) {
+    if (std::tolower(static_cast<unsigned char>(text[i])) != lowercase[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static const HtmlTagName *FindHtmlTagName(const char *name, size_t length) {
+  for (size_t i = 0; i < FPL_ARRAYSIZE(kHtmlTagNames); ++i) {
+    auto tag_name = kHtmlTagNames[i].name;
+    if (strlen(tag_name) == length &&
+        EqualIgnoringCase(name, tag_name, length)) {
+      return &kHtmlTagNames[i];
+    }
+  }
+  return nullptr;
+}
+
+static bool IsHtmlSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\f' || c == '\r';
+}
+
+static bool IsHtmlAlpha(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// Encode a codepoint in UTF-8. Returns the # of bytes written to `out`.
+static int32_t EncodeUtf8(uint32_t code_point, char *out) {
+  if (code_point < 0x80) {
+    out[0] = static_cast<char>(code_point);
+    return 1;
+  } else if (code_point < 0x800) {
+    out[0] = static_cast<char>(0xc0 | (code_point >> 6));
+    out[1] = static_cast<char>(0x80 | (code_point & 0x3f));
+    return 2;
+  } else if (code_point < 0x10000) {
+    out[0] = static_cast<char>(0xe0 | (code_point >> 12));
+    out[1] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+    out[2] = static_cast<char>(0x80 | (code_point & 0x3f));
+    return 3;
+  }
+  out[0] = static_cast<char>(0xf0 | (code_point >> 18));
+  out[1] = static_cast<char>(0x80 | ((code_point >> 12) & 0x3f));
+  out[2] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+  out[3] = static_cast<char>(0x80 | (code_point & 0x3f));
+  return 4;
+}
+
+// Decode a character reference at `*p`, which points to '&'.
+// A '&' not starting a reference is decoded as is. Returns false for
+// references the subset parser doesn't handle the same way as Gumbo would
+// (unknown names, references without ';', or codepoints Gumbo replaces).
+// On success, `*p` is advanced past the reference and the decoded UTF-8 bytes
+// are written to `out`.
+static bool DecodeHtmlReference(const char **p, char *out, int32_t *length) {
+  struct NamedReference {
+    const char *name;
+    char value[3];
+  };
+  static const NamedReference kNamedReferences[] = {
+      {"amp;", "&"},       {"apos;", "'"}, {"gt;", ">"}, {"lt;", "<"},
+      {"nbsp;", "\xc2\xa0"}, {"quot;", "\""},
+  };
+
+  auto t = *p + 1;
+  if (*t != '#' && !IsHtmlAlpha(*t) && !(*t >= '0' && *t <= '9')) {
+    // Not a reference.
+    out[0] = '&';
+    *length = 1;
+    *p = t;
+    return true;
+  }
+
+  if (*t == '#') {
+    ++t;
+    auto hex = *t == 'x' || *t == 'X';
+    if (hex) ++t;
+    uint32_t code_point = 0;
+    auto start = t;
+    for (; t - start < 8; ++t) {
+      uint32_t digit;
+      if (*t >= '0' && *t <= '9') {
+        digit = *t - '0';
+      } else if (hex && *t >= 'a' && *t <= 'f') {
+        digit = *t - 'a' + 10;
+      } else if (hex && *t >= 'A' && *t <= 'F') {
+        digit = *t - 'A' + 10;
+      } else {
+        break;
+      }
+      code_point = code_point * (hex ? 16 : 10) + digit;
+    }
+    if (t == start || *t != ';') return false;
+    // Only codepoints Gumbo passes through as is.
+    bool valid = (code_point >= 0x20 && code_point < 0x7f) ||
+                 (code_point >= 0xa0 && code_point < 0xd800) ||
+                 (code_point >= 0xe000 && code_point < 0xfdd0) ||
+                 (code_point >= 0xfdf0 && code_point <= 0x10ffff &&
+                  (code_point & 0xfffe) != 0xfffe);
+    if (!valid) return false;
+    *length = EncodeUtf8(code_point, out);
+    *p = t + 1;
+    return true;
+  }
+
+  for (size_t i = 0; i < FPL_ARRAYSIZE(kNamedReferences); ++i) {
+    auto &reference = kNamedReferences[i];
+    auto name_length = strlen(reference.name);
+    if (!strncmp(t, reference.name, name_length)) {
+      *length = static_cast<int32_t>(strlen(reference.value));
+      memcpy(out, reference.value, *length);
+      *p = t + name_length;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Parse an attribute value at `*p`, decoding character references.
+static bool ParseHtmlAttributeValue(const char **p, std::string *value) {
+  auto t = *p;
+  char quote = 0;
+  if (*t == '"' || *t == '\'') {
+    quote = *t++;
+  }
+  for (;;) {
+    auto c = *t;
+    // Gumbo normalizes CR in values.
+    if (!c || c == '\r') return false;
+    if (quote) {
+      if (c == quote) {
+        ++t;
+        break;
+      }
+    } else {
+      if (IsHtmlSpace(c) || c == '>') break;
+      if (c == '"' || c == '\'' || c == '<' || c == '=' || c == '`') {
+        return false;
+      }
+    }
+    if (c == '&') {
+      char decoded[4];
+      int32_t length;
+      if (!DecodeHtmlReference(&t, decoded, &length)) return false;
+      value->append(decoded, length);
+    } else {
+      value->push_back(c);
+      ++t;
+    }
+  }
+  if (!quote && value->empty()) return false;
+  *p = t;
+  return true;
+}
+
+// Parse a start or end tag at `*p`, which points to '<'.
+// Only attributes used in the conversion are returned in `values`, in the
+// order of `href`, `face`, `color` and `size`.
+static bool ParseHtmlTag(const char **p, const HtmlTagName **tag_name,
+                         bool *end_tag, std::string values[4],
+                         HtmlAttributes *attributes) {
+  static const char *kAttributeNames[] = {"href", "face", "color", "size"};
+  auto t = *p + 1;
+  *end_tag = *t == '/';
+  if (*end_tag) ++t;
+
+  auto name = t;
+  while (*t && !IsHtmlSpace(*t) && *t != '/' && *t != '>') ++t;
+  *tag_name = FindHtmlTagName(name, t - name);
+  if (*tag_name == nullptr) return false;
+
+  bool found[4] = {false, false, false, false};
+  for (;;) {
+    while (IsHtmlSpace(*t)) ++t;
+    if (*t == '>') {
+      ++t;
+      break;
+    }
+    // A self-closing flag is ignored for HTML elements, as done by Gumbo.
+    if (*t == '/' && t[1] == '>') {
+      t += 2;
+      break;
+    }
+    // Attributes on end tags are errors Gumbo recovers from on its own way.
+    if (!*t || *t == '/' || *t == '=' || *end_tag) return false;
+
+    auto attribute = t;
+    while (*t && !IsHtmlSpace(*t) && *t != '/' && *t != '>' && *t != '=') {
+      if (*t == '"' || *t == '\'' || *t == '<') return false;
+      ++t;
+    }
+    auto attribute_length = static_cast<size_t>(t - attribute);
+    while (IsHtmlSpace(*t)) ++t;
+
+    std::string value;
+    if (*t == '=') {
+      ++t;
+      while (IsHtmlSpace(*t)) ++t;
+      if (!ParseHtmlAttributeValue(&t, &value)) return false;
+    }
+
+    // The first of duplicated attributes is used.
+    for (int32_t i = 0; i < 4; ++i) {
+      if (!found[i] && strlen(kAttributeNames[i]) == attribute_length &&
+          EqualIgnoringCase(attribute, kAttributeNames[i], attribute_length)) {
+        found[i] = true;
+        values[i].swap(value);
+        break;
+      }
+    }
+  }
+
+  if (found[0]) attributes->href = values[0].c_str();
+  if (found[1]) attributes->face = values[1].c_str();
+  if (found[2]) attributes->color = values[2].c_str();
+  if (found[3]) attributes->size = values[3].c_str();
+  *p = t;
+  return true;
+}
+
+// Skip a comment or a doctype at `*p`, which points to "<!".
+static bool SkipHtmlMarkup(const char **p) {
+  auto t = *p + 2;
+  if (!strncmp(t, "--", 2)) {
+    t += 2;
+    // Comments ended abruptly are handled differently by Gumbo.
+    if (*t == '>' || !strncmp(t, "->", 2)) return false;
+    auto end = strstr(t, "-->");
+    if (end == nullptr) return false;
+    for (auto c = t; c + 4 <= end; ++c) {
+      if (!strncmp(c, "--!>", 4)) return false;
+    }
+    *p = end + 3;
+    return true;
+  }
+  if (EqualIgnoringCase(t, "doctype", 7)) {
+    auto end = strchr(t, '>');
+    if (end == nullptr) return false;
+    *p = end + 1;
+    return true;
+  }
+  return false;
+}
+
+bool ParseHtmlSubset(const char *html, std::vector<HtmlSection> *s) {
+  // Ensure there is an HtmlSection that can be appended to.
+  assert(s->empty());
+  s->push_back(HtmlSection());
+
+  // Open elements, innermost last.
+  const int32_t kMaxDepth = 32;
+  struct OpenElement {
+    const HtmlTagName *tag_name;
+    HtmlFontSetting original;
+  };
+  OpenElement stack[kMaxDepth];
+  int32_t depth = 0;
+
+  HtmlSection current_setting;
+  HtmlTextWriter writer;
+  bool in_text = false;
+  std::string values[4];
+  auto p = html;
+  while (*p) {
+    char decoded[4];
+    int32_t length = 1;
+    decoded[0] = *p;
+    auto markup = *p == '<' && (IsHtmlAlpha(p[1]) || p[1] == '/' ||
+                                p[1] == '!' || p[1] == '?');
+    if (markup && in_text && writer.IsWhitespaceOnly()) break;
+
+    if (*p == '<' && (IsHtmlAlpha(p[1]) || p[1] == '/')) {
+      const HtmlTagName *tag_name;
+      bool end_tag;
+      HtmlAttributes attributes;
+      if (!ParseHtmlTag(&p, &tag_name, &end_tag, values, &attributes)) break;
+      in_text = false;
+      if (tag_name->is_ignored) continue;
+
+      if (end_tag) {
+        // Only well nested elements are handled here. Gumbo recovers from
+        // misnested tags by restructuring the tree.
+        if (tag_name->is_void || !depth ||
+            stack[depth - 1].tag_name != tag_name) {
+          break;
+        }
+        --depth;
+        EndHtmlElement(tag_name->tag, stack[depth].original, s,
+                       &current_setting);
+        continue;
+      }
+
+      // Gumbo implicitly closes paragraphs and headings on these elements,
+      // and nested anchors.
+      bool implicit_end = false;
+      for (int32_t i = 0; i < depth; ++i) {
+        auto open_tag = stack[i].tag_name->tag;
+        if (((tag_name->tag == kHtmlTagP || tag_name->tag == kHtmlTagHeading ||
+              tag_name->tag == kHtmlTagHr) &&
+             (open_tag == kHtmlTagP || open_tag == kHtmlTagHeading)) ||
+            (tag_name->tag == kHtmlTagA && open_tag == kHtmlTagA)) {
+          implicit_end = true;
+        }
+      }
+      if (implicit_end || depth == kMaxDepth) break;
+
+      StartHtmlElement(tag_name->tag, attributes, s, &current_setting,
+                       &stack[depth].original);
+      if (tag_name->is_void) {
+        EndHtmlElement(tag_name->tag, stack[depth].original, s,
+                       &current_setting);
+      } else {
+        stack[depth++].tag_name = tag_name;
+      }
+      continue;
+    } else if (*p == '<' && p[1] == '!') {
+      if (!SkipHtmlMarkup(&p)) break;
+      in_text = false;
+      continue;
+    } else if (*p == '<' && p[1] == '?') {
+      break;
+    } else if (*p == '&') {
+      if (!DecodeHtmlReference(&p, decoded, &length)) break;
+    } else {
+      ++p;
+    }
+
+    if (!in_text) {
+      writer.Start(s);
+      in_text = true;
+    }
+    for (int32_t i = 0; i < length; ++i) {
+      writer.Put(decoded[i]);
+    }
+  }
+
+  if (*p || (in_text && writer.IsWhitespaceOnly())) {
+    // The HTML is out of the subset.
+    s->clear();
+    return false;
+  }
+
+  // Close elements left open at the end of the HTML.
+  while (depth) {
+    --depth;
+    EndHtmlElement(stack[depth].tag_name->tag, stack[depth].original, s,
+                   &current_setting);
+  }
+
+  // Prune empty last section.
+  if (s->back().text().empty()) {
+    s->pop_back();
+  }
+  return true;
+}
+
+#if defined(FLATUI_HAS_GUMBO)
+static HtmlTag GetHtmlTag(GumboTag tag) {
+  switch (tag) {
+    case GUMBO_TAG_A:
+      return kHtmlTagA;
+    case GUMBO_TAG_FONT:
+      return kHtmlTagFont;
+    case GUMBO_TAG_P:
+      return kHtmlTagP;
+    case GUMBO_TAG_H1:
+    case GUMBO_TAG_H2:  // fallthrough
+    case GUMBO_TAG_H3:  // fallthrough
+    case GUMBO_TAG_H4:  // fallthrough
+    case GUMBO_TAG_H5:  // fallthrough
+    case GUMBO_TAG_H6:  // fallthrough
+      return kHtmlTagHeading;
+    case GUMBO_TAG_HR:
+      return kHtmlTagHr;
+    case GUMBO_TAG_BR:
+      return kHtmlTagBr;
+    default:
+      return kHtmlTagOther;
+  }
+}
+
+static const char *GetGumboAttribute(const GumboElement &element,
+                                     const char *name) {
+  GumboAttribute *attribute = gumbo_get_attribute(&element.attributes, name);
+  return attribute != nullptr ? attribute->value : nullptr;
+}
+
 static void GumboTreeToHtmlSections(const GumboNode *node,
                                     std::vector<HtmlSection> *s,
                                     HtmlSection *current_setting) {
-  auto original_face = current_setting->face();
-  auto original_color = current_setting->color();
-  auto original_size = current_setting->size();
-
   switch (node->type) {
     // Process non-text elements, possibly recursing into child nodes.
     case GUMBO_NODE_ELEMENT: {
       const GumboElement &element = node->v.element;
+      auto tag = GetHtmlTag(element.tag);
+      HtmlAttributes attributes;
+      if (tag == kHtmlTagA) {
+        attributes.href = GetGumboAttribute(element, "href");
+      } else if (tag == kHtmlTagFont) {
+        attributes.face = GetGumboAttribute(element, "face");
+        attributes.color = GetGumboAttribute(element, "color");
+        attributes.size = GetGumboAttribute(element, "size");
+      }
 
       // Tree prefix processing.
-      switch (element.tag) {
-        case GUMBO_TAG_A: {
-          // Record the link address.
-          GumboAttribute *href =
-              gumbo_get_attribute(&element.attributes, "href");
-          if (href != nullptr) {
-            // Start a new section for the anchor.
-            if (!s->back().text().empty()) {
-              s->push_back(HtmlSection());
-            }
-            s->back().set_link(href->value);
-          }
-          break;
-        }
-        case GUMBO_TAG_FONT: {
-          // Record the properties.
-          GumboAttribute *face =
-              gumbo_get_attribute(&element.attributes, "face");
-          GumboAttribute *color =
-              gumbo_get_attribute(&element.attributes, "color");
-          GumboAttribute *size =
-              gumbo_get_attribute(&element.attributes, "size");
-
-          // Start a new section for the font tag.
-          bool new_params =
-              face != nullptr || color != nullptr || size != nullptr;
-          if (new_params && !s->back().text().empty()) {
-            s->push_back(HtmlSection());
-          }
-          if (face != nullptr) {
-            // Keep current setting and update font face setting.
-            original_face = current_setting->face();
-            s->back().set_face(face->value);
-            current_setting->set_face(face->value);
-          } else {
-            s->back().set_face(current_setting->face());
-          }
-          if (color != nullptr) {
-            uint32_t color_value = kDefaultColor;
-            if (ParseColorValue(color->value, &color_value)) {
-              // Keep current setting and update font face setting.
-              original_color = current_setting->color();
-              s->back().set_color(color_value);
-              current_setting->set_color(color_value);
-            } else {
-              LogInfo("Failed to parse a value: %s", color->value);
-            }
-          } else {
-            s->back().set_color(current_setting->color());
-          }
-          if (size != nullptr) {
-            auto value =
-                static_cast<int>(std::strtol(size->value, nullptr, 10));
-            if (value) {
-              // Convert the virtual size to physical size.
-              value = VirtualToPhysical(vec2(0, value)).y;
-
-              // Keep current setting and update font face setting.
-              original_size = current_setting->size();
-              s->back().set_size(value);
-              current_setting->set_size(value);
-            } else {
-              LogInfo("Failed to parse a value: %s", size->value);
-            }
-          } else {
-            s->back().set_size(current_setting->size());
-          }
-          break;
-        }
-        case GUMBO_TAG_P:
-        case GUMBO_TAG_H1:  // fallthrough
-        case GUMBO_TAG_H2:  // fallthrough
-        case GUMBO_TAG_H3:  // fallthrough
-        case GUMBO_TAG_H4:  // fallthrough
-        case GUMBO_TAG_H5:  // fallthrough
-        case GUMBO_TAG_H6:  // fallthrough
-          StartHtmlLine("\n\n", &s->back().text());
-          break;
-
-        default:
-          break;
-      }
+      HtmlFontSetting original;
+      StartHtmlElement(tag, attributes, s, current_setting, &original);
 
       // Tree children processing via recursion.
       for (unsigned int i = 0; i < element.children.length; ++i) {
@@ -206,47 +750,7 @@ static void GumboTreeToHtmlSections(const GumboNode *node,
       }
 
       // Tree postfix processing.
-      switch (element.tag) {
-        case GUMBO_TAG_A:
-          // Start a new section for the non-anchor.
-          s->push_back(HtmlSection());
-          break;
-        case GUMBO_TAG_FONT: {
-          // Restore the font setting if it's changed.
-          bool new_params = s->back().face() != original_face ||
-                            s->back().color() != original_color ||
-                            s->back().size() != original_size;
-          if (new_params) {
-            s->push_back(HtmlSection());
-          }
-
-          // Restore settings.
-          current_setting->set_face(original_face);
-          s->back().set_face(original_face);
-          current_setting->set_color(original_color);
-          s->back().set_color(original_color);
-          current_setting->set_size(original_size);
-          s->back().set_size(original_size);
-          break;
-        }
-        case GUMBO_TAG_HR:
-        case GUMBO_TAG_P:  // fallthrough
-          s->back().text().append("\n\n");
-          break;
-
-        case GUMBO_TAG_H1:  // fallthrough
-        case GUMBO_TAG_H2:  // fallthrough
-        case GUMBO_TAG_H3:  // fallthrough
-        case GUMBO_TAG_H4:  // fallthrough
-        case GUMBO_TAG_H5:  // fallthrough
-        case GUMBO_TAG_H6:  // fallthrough
-        case GUMBO_TAG_BR:
-          s->back().text().append("\n");
-          break;
-
-        default:
-          break;
-      }
+      EndHtmlElement(tag, original, s, current_setting);
       break;
     }
 
@@ -268,10 +772,8 @@ static void GumboTreeToHtmlSections(const GumboNode *node,
       break;
   }
 }
-#endif  // defined(FLATUI_HAS_GUMBO)
 
-bool ParseHtml(const char *html, std::vector<HtmlSection> *s) {
-#if defined(FLATUI_HAS_GUMBO)
+static bool ParseHtmlWithGumbo(const char *html, std::vector<HtmlSection> *s) {
   // Ensure there is an HtmlSection that can be appended to.
   assert(s->empty());
   s->push_back(HtmlSection());
@@ -287,22 +789,34 @@ bool ParseHtml(const char *html, std::vector<HtmlSection> *s) {
     s->pop_back();
   }
   return true;
+}
+#endif  // defined(FLATUI_HAS_GUMBO)
+
+bool ParseHtml(const char *html, std::vector<HtmlSection> *s) {
+  // Most rich texts only use the subset of HTML handled without building a
+  // DOM. Full documents fall back to Gumbo.
+  if (ParseHtmlSubset(html, s)) {
+    return true;
+  }
+#if defined(FLATUI_HAS_GUMBO)
+  return ParseHtmlWithGumbo(html, s);
 #else
-  (void)html;
-  (void)s;
   return false;
 #endif  // defined(FLATUI_HAS_GUMBO)
 }
 
-static size_t NumUnderlineVertices(const FontBuffer &buffer) {
+size_t GetUnderlineVertexCount(const FontBuffer &buffer) {
   const int32_t kUnderlineVerticesPerGlyph = 2;
   const int32_t kExtraUnderlineVerticesPerInfo = 2;
   size_t num_verts = 0;
   auto &slices = buffer.get_slices();
   for (size_t i = 0; i < slices.size(); ++i) {
-    auto regions = slices.at(i).get_underline_info();
+    if (!slices[i].get_underline()) {
+      continue;
+    }
+    auto &regions = slices[i].get_underline_info();
     for (size_t i = 0; i < regions.size(); ++i) {
-      auto info = regions[i];
+      auto &info = regions[i];
       num_verts += (info.end_vertex_index_ - info.start_vertex_index_ + 2) *
                    kUnderlineVerticesPerGlyph;
       num_verts += kExtraUnderlineVerticesPerInfo;
@@ -316,24 +830,22 @@ static size_t NumUnderlineVertices(const FontBuffer &buffer) {
   return num_verts;
 }
 
-std::vector<vec3_packed> GenerateUnderlineVertices(const FontBuffer &buffer,
-                                                   const mathfu::vec2 &pos,
-                                                   bool reverse) {
-  std::vector<vec3_packed> vec;
-  auto num_verts = NumUnderlineVertices(buffer);
-  if (!num_verts) {
-    return vec;
+size_t GenerateUnderlineVertices(const FontBuffer &buffer,
+                                 const mathfu::vec2 &pos, vec3_packed *out,
+                                 size_t capacity, bool reverse) {
+  auto num_verts = GetUnderlineVertexCount(buffer);
+  if (!num_verts || num_verts > capacity) {
+    return 0;
   }
-  vec.reserve(num_verts);
   auto &slices = buffer.get_slices();
   auto &vertices = buffer.get_vertices();
-  bool degenerated_triangle = false;
+  size_t count = 0;
   for (size_t i = 0; i < slices.size(); ++i) {
-    if (slices.at(i).get_underline()) {
+    if (slices[i].get_underline()) {
       // Generate underline strips.
-      auto regions = slices.at(i).get_underline_info();
+      auto &regions = slices[i].get_underline_info();
       for (size_t i = 0; i < regions.size(); ++i) {
-        auto info = regions[i];
+        auto &info = regions[i];
         auto y_start = info.y_pos_.x + pos.y;
         auto y_end = y_start + info.y_pos_.y;
         int start_vertex_index = info.start_vertex_index_;
@@ -345,39 +857,50 @@ std::vector<vec3_packed> GenerateUnderlineVertices(const FontBuffer &buffer,
           index_direction = -1;
         }
 
-        if (degenerated_triangle) {
+        if (count) {
           // Add degenerated triangle to connect multiple strips.
-          auto start_pos = vec3(vertices.at(start_vertex_index *
-                                            kVerticesPerGlyph).position_);
-          vec.push_back(vec.back());
-          vec.push_back(vec3_packed(vec3(start_pos.x + pos.x, y_start, 0.f)));
+          auto &start_pos =
+              vertices.at(start_vertex_index * kVerticesPerGlyph).position_;
+          out[count] = out[count - 1];
+          out[count + 1] =
+              vec3_packed(vec3(start_pos.data[0] + pos.x, y_start, 0.f));
+          count += 2;
         }
 
         // Add vertices.
         for (int i = 0; i <= index_count; ++i) {
           int idx = start_vertex_index + i * index_direction;
-          auto strip_pos = vec3(vertices.at(idx * kVerticesPerGlyph).position_);
-          vec.push_back(vec3_packed(vec3(strip_pos.x + pos.x, y_start, 0.f)));
-          vec.push_back(vec3_packed(vec3(strip_pos.x + pos.x, y_end, 0.f)));
+          auto &strip_pos = vertices.at(idx * kVerticesPerGlyph).position_;
+          out[count++] =
+              vec3_packed(vec3(strip_pos.data[0] + pos.x, y_start, 0.f));
+          out[count++] =
+              vec3_packed(vec3(strip_pos.data[0] + pos.x, y_end, 0.f));
         }
 
         // Add last 2 vertices.
-        auto end_pos =
-            vec3(vertices.at(end_vertex_index * kVerticesPerGlyph +
-                             kVerticesPerGlyph - 1).position_);
-        vec.push_back(vec3_packed(vec3(end_pos.x + pos.x, y_start, 0.f)));
-        vec.push_back(vec3_packed(vec3(end_pos.x + pos.x, y_end, 0.f)));
-
-        degenerated_triangle = true;
+        auto &end_pos = vertices.at(end_vertex_index * kVerticesPerGlyph +
+                                    kVerticesPerGlyph - 1).position_;
+        out[count++] = vec3_packed(vec3(end_pos.data[0] + pos.x, y_start, 0.f));
+        out[count++] = vec3_packed(vec3(end_pos.data[0] + pos.x, y_end, 0.f));
       }
     }
   }
-  assert(num_verts == vec.size());
+  assert(num_verts == count);
+  return count;
+}
+
+std::vector<vec3_packed> GenerateUnderlineVertices(const FontBuffer &buffer,
+                                                   const mathfu::vec2 &pos,
+                                                   bool reverse) {
+  std::vector<vec3_packed> vec(GetUnderlineVertexCount(buffer));
+  if (!vec.empty()) {
+    GenerateUnderlineVertices(buffer, pos, vec.data(), vec.size(), reverse);
+  }
   return vec;
 }
 
-static void NumPaddedUnderlineVertices(const FontBuffer &buffer,
-                                       size_t* num_verts, size_t* num_indices) {
+void GetPaddedUnderlineVertexCount(const FontBuffer &buffer,
+                                   size_t *num_verts, size_t *num_indices) {
   *num_verts = 0;
   *num_indices = 0;
   const int32_t kUnderlineVerticesPerGlyph = 2;
@@ -397,24 +920,21 @@ static void NumPaddedUnderlineVertices(const FontBuffer &buffer,
 
 bool GeneratePaddedUnderlineVertices(
     const FontBuffer &buffer, const mathfu::vec2 &pos,
-    const mathfu::vec2 &padding, std::vector<mathfu::vec3>* positions,
-    std::vector<mathfu::vec2>* tex_coords, std::vector<uint16_t>* indices,
-    bool reverse) {
+    const mathfu::vec2 &padding, mathfu::vec3 *positions,
+    mathfu::vec2 *tex_coords, uint16_t *indices, size_t vertex_capacity,
+    size_t index_capacity, bool reverse) {
   size_t num_verts, num_indices;
-  NumPaddedUnderlineVertices(buffer, &num_verts, &num_indices);
-  if (num_verts == 0 || num_indices == 0) {
+  GetPaddedUnderlineVertexCount(buffer, &num_verts, &num_indices);
+  if (num_verts == 0 || num_indices == 0 || num_verts > vertex_capacity ||
+      num_indices > index_capacity) {
     return false;
   }
-  positions->clear();
-  positions->reserve(num_verts);
-  tex_coords->clear();
-  tex_coords->reserve(num_verts);
-  indices->clear();
-  indices->reserve(num_indices);
 
   const int32_t kUnderlineVerticesPerGlyph = 2;
   const auto& slices = buffer.get_slices();
   const auto& vertices = buffer.get_vertices();
+  size_t vertex_count = 0;
+  size_t index_count = 0;
   for (size_t i = 0; i < slices.size(); ++i) {
     const auto& regions = slices[i].get_underline_info();
     for (size_t i = 0; i < regions.size(); ++i) {
@@ -433,59 +953,77 @@ bool GeneratePaddedUnderlineVertices(
         std::swap(start_vertex_index, end_vertex_index);
         index_direction = -1;
       }
-      const size_t start_index = positions->size();
+      const size_t start_index = vertex_count;
 
       // Add first 2 vertices.
       const float tex_x_start =
           vertices[start_vertex_index * kVerticesPerGlyph].position_.x + pos.x;
-      positions->emplace_back(tex_x_start - padding.x, y_start, 0.f);
-      positions->emplace_back(tex_x_start - padding.x, y_end, 0.f);
+      positions[vertex_count++] = vec3(tex_x_start - padding.x, y_start, 0.f);
+      positions[vertex_count++] = vec3(tex_x_start - padding.x, y_end, 0.f);
 
       // Add middle vertices.
       for (int i = 1; i < num_glyphs; ++i) {
         const int idx = start_vertex_index + i * index_direction;
         const vec3_packed& strip_pos =
             vertices[idx * kVerticesPerGlyph].position_;
-        positions->emplace_back(strip_pos.x + pos.x, y_start, 0.f);
-        positions->emplace_back(strip_pos.x + pos.x, y_end, 0.f);
+        positions[vertex_count++] = vec3(strip_pos.x + pos.x, y_start, 0.f);
+        positions[vertex_count++] = vec3(strip_pos.x + pos.x, y_end, 0.f);
       }
 
       // Add last 2 vertices.
       const int end_idx =
           (end_vertex_index + 1) * kVerticesPerGlyph + kVertexOfRightEdge;
       const float tex_x_end = vertices[end_idx].position_.x + pos.x;
-      positions->emplace_back(tex_x_end + padding.x, y_start, 0.f);
-      positions->emplace_back(tex_x_end + padding.x, y_end, 0.f);
+      positions[vertex_count++] = vec3(tex_x_end + padding.x, y_start, 0.f);
+      positions[vertex_count++] = vec3(tex_x_end + padding.x, y_end, 0.f);
 
       // Add tex_coords for every position, such that tex_x/y_start is (0,0) and
       // tex_x/y_end is (1,1).
       const float y_size = tex_y_end - tex_y_start;
       const float x_size = tex_x_end - tex_x_start;
-      while (tex_coords->size() < positions->size()) {
-        const auto& p = positions->at(tex_coords->size());
-        tex_coords->emplace_back((p.x - tex_x_start) / x_size,
-                                 (p.y - tex_y_start) / y_size);
+      for (size_t j = start_index; j < vertex_count; ++j) {
+        const auto& p = positions[j];
+        tex_coords[j] = vec2((p.x - tex_x_start) / x_size,
+                             (p.y - tex_y_start) / y_size);
       }
 
       // Add indices.
       for (int i = 0; i < num_glyphs; ++i) {
         const uint16_t index =
             static_cast<uint16_t>(start_index + i * kUnderlineVerticesPerGlyph);
-        indices->emplace_back(index);
-        indices->emplace_back(static_cast<uint16_t>(index + 1));
-        indices->emplace_back(static_cast<uint16_t>(index + 2));
+        indices[index_count++] = index;
+        indices[index_count++] = static_cast<uint16_t>(index + 1);
+        indices[index_count++] = static_cast<uint16_t>(index + 2);
 
         // Keep same winding order.
-        indices->emplace_back(static_cast<uint16_t>(index + 2));
-        indices->emplace_back(static_cast<uint16_t>(index + 1));
-        indices->emplace_back(static_cast<uint16_t>(index + 3));
+        indices[index_count++] = static_cast<uint16_t>(index + 2);
+        indices[index_count++] = static_cast<uint16_t>(index + 1);
+        indices[index_count++] = static_cast<uint16_t>(index + 3);
       }
     }
   }
-  assert(num_verts == positions->size());
-  assert(num_verts == tex_coords->size());
-  assert(num_indices == indices->size());
+  assert(num_verts == vertex_count);
+  assert(num_indices == index_count);
   return true;
 }
 
+bool GeneratePaddedUnderlineVertices(
+    const FontBuffer &buffer, const mathfu::vec2 &pos,
+    const mathfu::vec2 &padding, std::vector<mathfu::vec3>* positions,
+    std::vector<mathfu::vec2>* tex_coords, std::vector<uint16_t>* indices,
+    bool reverse) {
+  size_t num_verts, num_indices;
+  GetPaddedUnderlineVertexCount(buffer, &num_verts, &num_indices);
+  if (num_verts == 0 || num_indices == 0) {
+    return false;
+  }
+  // Resizing keeps the allocations of vectors reused across calls.
+  positions->resize(num_verts);
+  tex_coords->resize(num_verts);
+  indices->resize(num_indices);
+  return GeneratePaddedUnderlineVertices(
+      buffer, pos, padding, positions->data(), tex_coords->data(),
+      indices->data(), num_verts, num_indices, reverse);
+}
+
 }  // namespace flatui
@@ -0,0 +1,201 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "precompiled.h"
+
+#include <algorithm>
+#include "flatui/font_manager.h"
+#include "fplbase/glplatform.h"
+#include "fplbase/renderer.h"
+#include "internal/font_vertex_buffer.h"
+
+// Instanced draws are available in OpenGL ES 3.0 and OpenGL 3.3. On Windows,
+// FPLBase doesn't load entry points of the APIs.
+#if defined(GL_VERTEX_ATTRIB_ARRAY_DIVISOR) && !defined(_WIN32)
+#define FLATUI_GLYPH_INSTANCING (1)
+#endif  // GL_VERTEX_ATTRIB_ARRAY_DIVISOR
+
+namespace flatui {
+
+// Retrieve the quad index buffer object shared by all vertex buffers. The
+// buffer object is created at the first use and kept while the application
+// runs.
+static GLuint GetQuadIndexBuffer() {
+  static GLuint handle = 0;
+  if (handle == 0) {
+    GL_CALL(glGenBuffers(1, &handle));
+    GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, handle));
+    GL_CALL(glBufferData(
+        GL_ELEMENT_ARRAY_BUFFER,
+        kMaxQuadIndicesGlyphs * FontBuffer::kIndiciesPerCodePoint *
+            sizeof(uint16_t),
+        GetQuadIndices(), GL_STATIC_DRAW));
+  }
+  return handle;
+}
+
+#ifdef FLATUI_GLYPH_INSTANCING
+// Retrieve the buffer object of quad corners shared by all vertex buffers
+// drawing glyph instances. The corners are in the order of FontVertex emitted
+// by FontBuffer::AddVertices(), so that a triangle strip has the winding of
+// the quad indices.
+static GLuint GetQuadCornerBuffer() {
+  static GLuint handle = 0;
+  if (handle == 0) {
+    static const uint8_t kCorners[] = {0, 0, 0, 1, 1, 0, 1, 1};
+    GL_CALL(glGenBuffers(1, &handle));
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, handle));
+    GL_CALL(glBufferData(GL_ARRAY_BUFFER, sizeof(kCorners), kCorners,
+                         GL_STATIC_DRAW));
+  }
+  return handle;
+}
+#endif  // FLATUI_GLYPH_INSTANCING
+
+FontVertexBuffer::FontVertexBuffer()
+    : capacity_(0), packed_vertices_(false) {
+  GLuint handle;
+  GL_CALL(glGenBuffers(1, &handle));
+  handle_ = handle;
+}
+
+FontVertexBuffer::~FontVertexBuffer() {
+  GLuint handle = handle_;
+  GL_CALL(glDeleteBuffers(1, &handle));
+}
+
+void FontVertexBuffer::Update(const void *vertices, size_t size) {
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, handle_));
+  if (size > capacity_) {
+    GL_CALL(glBufferData(GL_ARRAY_BUFFER, size, vertices, GL_STATIC_DRAW));
+    capacity_ = size;
+  } else if (size) {
+    GL_CALL(glBufferSubData(GL_ARRAY_BUFFER, 0, size, vertices));
+  }
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+}
+
+void FontVertexBuffer::Bind(bool packed_vertices) {
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, handle_));
+  GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, GetQuadIndexBuffer()));
+  GL_CALL(glEnableVertexAttribArray(fplbase::Mesh::kAttributePosition));
+  GL_CALL(glEnableVertexAttribArray(fplbase::Mesh::kAttributeTexCoord));
+  packed_vertices_ = packed_vertices;
+}
+
+void FontVertexBuffer::SetVertexPointers(uint32_t start_glyph) {
+  if (packed_vertices_) {
+    auto stride = static_cast<GLsizei>(sizeof(PackedFontVertex));
+    auto offset = static_cast<size_t>(start_glyph) *
+                  FontBuffer::kVerticesPerCodePoint * sizeof(PackedFontVertex);
+    GL_CALL(glVertexAttribPointer(
+        fplbase::Mesh::kAttributePosition, 2, GL_FLOAT, GL_FALSE, stride,
+        reinterpret_cast<const void *>(
+            offset + offsetof(PackedFontVertex, position_))));
+    GL_CALL(glVertexAttribPointer(
+        fplbase::Mesh::kAttributeTexCoord, 2, GL_UNSIGNED_SHORT, GL_TRUE,
+        stride, reinterpret_cast<const void *>(
+                    offset + offsetof(PackedFontVertex, uv_))));
+  } else {
+    auto stride = static_cast<GLsizei>(sizeof(FontVertex));
+    auto offset = static_cast<size_t>(start_glyph) *
+                  FontBuffer::kVerticesPerCodePoint * sizeof(FontVertex);
+    GL_CALL(glVertexAttribPointer(
+        fplbase::Mesh::kAttributePosition, 3, GL_FLOAT, GL_FALSE, stride,
+        reinterpret_cast<const void *>(offset +
+                                       offsetof(FontVertex, position_))));
+    GL_CALL(glVertexAttribPointer(
+        fplbase::Mesh::kAttributeTexCoord, 2, GL_FLOAT, GL_FALSE, stride,
+        reinterpret_cast<const void *>(offset + offsetof(FontVertex, uv_))));
+  }
+}
+
+void FontVertexBuffer::Draw(uint32_t start_glyph, uint32_t glyph_count) {
+  // The vertex pointers are moved to the first glyph of each draw, so that
+  // glyphs beyond the 16 bit quad indices are addressed from index 0.
+  for (uint32_t start = 0; start < glyph_count;
+       start += kMaxQuadIndicesGlyphs) {
+    auto count = std::min(glyph_count - start, kMaxQuadIndicesGlyphs);
+    SetVertexPointers(start_glyph + start);
+    GL_CALL(glDrawElements(
+        GL_TRIANGLES,
+        static_cast<GLsizei>(count * FontBuffer::kIndiciesPerCodePoint),
+        GL_UNSIGNED_SHORT, nullptr));
+  }
+}
+
+void FontVertexBuffer::Unbind() {
+  GL_CALL(glDisableVertexAttribArray(fplbase::Mesh::kAttributePosition));
+  GL_CALL(glDisableVertexAttribArray(fplbase::Mesh::kAttributeTexCoord));
+  GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+}
+
+void FontVertexBuffer::BindInstances() {
+#ifdef FLATUI_GLYPH_INSTANCING
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, GetQuadCornerBuffer()));
+  GL_CALL(glEnableVertexAttribArray(fplbase::Mesh::kAttributeTexCoordAlt));
+  GL_CALL(glVertexAttribPointer(fplbase::Mesh::kAttributeTexCoordAlt, 2,
+                                GL_UNSIGNED_BYTE, GL_FALSE, 0, nullptr));
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, handle_));
+  GL_CALL(glEnableVertexAttribArray(fplbase::Mesh::kAttributePosition));
+  GL_CALL(glEnableVertexAttribArray(fplbase::Mesh::kAttributeTexCoord));
+  GL_CALL(glVertexAttribDivisor(fplbase::Mesh::kAttributePosition, 1));
+  GL_CALL(glVertexAttribDivisor(fplbase::Mesh::kAttributeTexCoord, 1));
+#endif  // FLATUI_GLYPH_INSTANCING
+}
+
+void FontVertexBuffer::DrawInstances(uint32_t start_glyph,
+                                     uint32_t glyph_count) {
+#ifdef FLATUI_GLYPH_INSTANCING
+  // OpenGL ES 3.0 has no base instance, so the instance attributes are
+  // pointed at the start of the range.
+  auto stride = static_cast<GLsizei>(sizeof(GlyphInstance));
+  auto offset = start_glyph * sizeof(GlyphInstance);
+  GL_CALL(glVertexAttribPointer(
+      fplbase::Mesh::kAttributePosition, 4, GL_FLOAT, GL_FALSE, stride,
+      reinterpret_cast<const void *>(offset + offsetof(GlyphInstance, rect_))));
+  GL_CALL(glVertexAttribPointer(
+      fplbase::Mesh::kAttributeTexCoord, 4, GL_UNSIGNED_SHORT, GL_TRUE, stride,
+      reinterpret_cast<const void *>(offset + offsetof(GlyphInstance, uv_))));
+  GL_CALL(glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4,
+                                static_cast<GLsizei>(glyph_count)));
+#else
+  (void)start_glyph;
+  (void)glyph_count;
+#endif  // FLATUI_GLYPH_INSTANCING
+}
+
+void FontVertexBuffer::UnbindInstances() {
+#ifdef FLATUI_GLYPH_INSTANCING
+  GL_CALL(glVertexAttribDivisor(fplbase::Mesh::kAttributePosition, 0));
+  GL_CALL(glVertexAttribDivisor(fplbase::Mesh::kAttributeTexCoord, 0));
+  GL_CALL(glDisableVertexAttribArray(fplbase::Mesh::kAttributePosition));
+  GL_CALL(glDisableVertexAttribArray(fplbase::Mesh::kAttributeTexCoord));
+  GL_CALL(glDisableVertexAttribArray(fplbase::Mesh::kAttributeTexCoordAlt));
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+#endif  // FLATUI_GLYPH_INSTANCING
+}
+
+bool FontVertexBuffer::IsInstancingSupported() {
+#ifdef FLATUI_GLYPH_INSTANCING
+  // OpenGL ES 2.0 doesn't support instanced draws.
+  auto renderer = fplbase::RendererBase::Get();
+  return renderer != nullptr &&
+         renderer->feature_level() >= fplbase::kFeatureLevel30;
+#else
+  return false;
+#endif  // FLATUI_GLYPH_INSTANCING
+}
+
+}  // namespace flatui
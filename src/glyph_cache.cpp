@@ -13,6 +13,10 @@
 // limitations under the License.
 #include "precompiled.h"
 
+#include <algorithm>
+#include <limits>
+
+#include "flatui/glyph_atlas_generated.h"
 #include "fplbase/fpl_common.h"
 #include "fplbase/utilities.h"
 #include "internal/flatui_util.h"
@@ -23,14 +27,34 @@ using fplbase::LogError;
 
 namespace flatui {
 
-GlyphCache::GlyphCache(const mathfu::vec2i& size, int32_t max_slices)
+// Helpers for dirty rects. A rect is stored as (left, top, right, bottom).
+static mathfu::vec4i Union(const mathfu::vec4i& a, const mathfu::vec4i& b) {
+  return mathfu::vec4i(mathfu::vec2i::Min(a.xy(), b.xy()),
+                       mathfu::vec2i::Max(a.zw(), b.zw()));
+}
+
+static int32_t Area(const mathfu::vec4i& rect) {
+  return (rect.z - rect.x) * (rect.w - rect.y);
+}
+
+GlyphCache::GlyphCache(const mathfu::vec2i& size, int32_t max_slices,
+                       GlyphCachePacking packing)
     : counter_(0),
       padding_(kDefaultGlyphCachePaddingX, kDefaultGlyphCachePaddingY),
       revision_(0),
-      last_flushed_revision_(kNeverFlushed) {
+      last_flushed_revision_(kNeverFlushed),
+      epoch_(0),
+      pinning_(false),
+      compaction_(false),
+      uploaded_revision_(0),
+      pipeline_counters_(nullptr) {
   // Round up cache sizes to power of 2.
   size_ = mathfu::RoundUpToPowerOf2(size);
   buffers_.Initialize(this, size_, max_slices);
+  buffers_.set_packing(packing);
+  color_buffers_.set_packing(packing);
+  msdf_buffers_.set_packing(packing);
+  msdf_buffers_.set_buffer_format(kGlyphFormatsMultiChannelSDF);
   max_slices_ = max_slices;
   // Create new cache buffer slice.
   buffers_.InsertNewBuffer();
@@ -45,21 +69,21 @@ const GlyphCacheEntry* GlyphCache::Find(const GlyphKey& key) {
   // Update debug variable.
   stats_.lookup_++;
 #endif  // GLYPH_CACHE_STATS
-  auto it = map_entries_.find(key);
-  if (it != map_entries_.end()) {
+  auto entry = map_entries_.Find(key);
+  if (entry != nullptr) {
     // Found an entry!
 
     // Mark the row as being used in current cycle.
-    it->second->it_row_->set_last_used_counter(counter_);
+    entry->it_row_->set_last_used_counter(counter_);
 
     // Update row LRU entry. The row is now most recently used.
-    it->second->buffer_->UpdateRowLRU(it->second->it_lru_row_);
+    entry->buffer_->UpdateRowLRU(entry->it_lru_row_);
 
 #ifdef GLYPH_CACHE_STATS
     // Update debug variable.
     stats_.hit_++;
 #endif  // GLYPH_CACHE_STATS
-    return it->second.get();
+    return entry;
   }
 
   // Didn't find a cached entry. A caller may call Store() function to store
@@ -89,31 +113,38 @@ const GlyphCacheEntry* GlyphCache::Set(const void* const image,
   }
 
   // Adjust requested height & width.
-  // Height is rounded up to multiple of kGlyphCacheHeightRound.
-  // Expecting kGlyphCacheHeightRound is base 2.
-  int32_t req_width = entry.get_size().x + padding_.x;
-  int32_t req_height =
-      ((entry.get_size().y + padding_.y + (kGlyphCacheHeightRound - 1)) &
-       ~(kGlyphCacheHeightRound - 1));
+  auto req_size = GetReservedSize(entry);
+  int32_t req_width = req_size.x;
+  int32_t req_height = req_size.y;
   // Find sufficient space in the buffer.
   GlyphCacheEntry::iterator_row it_row;
   GlyphCacheEntry* ret;
+  GlyphCacheBuffer<uint32_t>* rgba_buffer = nullptr;
+  if (entry.color_glyph_) {
+    rgba_buffer = &color_buffers_;
+  } else if (entry.multi_channel_sdf_) {
+    if (msdf_buffers_.get_size().x == 0) {
+      // Initialize the multi-channel SDF buffer.
+      msdf_buffers_.Initialize(this, size_, max_slices_);
+      msdf_buffers_.InsertNewBuffer();
+    }
+    rgba_buffer = &msdf_buffers_;
+  }
   GlyphCacheBufferBase* buffer =
-      entry.color_glyph_
-          ? reinterpret_cast<GlyphCacheBufferBase*>(&color_buffers_)
+      rgba_buffer != nullptr
+          ? reinterpret_cast<GlyphCacheBufferBase*>(rgba_buffer)
           : reinterpret_cast<GlyphCacheBufferBase*>(&buffers_);
 
-  if (!buffer->FindRow(req_width, req_height, &it_row)) {
+  if (!buffer->FindRow(req_width, req_height, pinning_, &it_row)) {
     // Couldn't find sufficient row entry nor free space to create new row.
-    if (entry.color_glyph_ ? color_buffers_.PurgeCache(req_height)
-                           : buffers_.PurgeCache(req_height)) {
+    if (rgba_buffer != nullptr ? rgba_buffer->PurgeCache(req_height)
+                               : buffers_.PurgeCache(req_height)) {
       // Call the function recursively.
       return Set(image, key, entry);
     }
 #ifdef GLYPH_CACHE_STATS
     stats_.set_fail_++;
 #endif  // GLYPH_CACHE_STATS
-    // TODO: Try to flush multiple rows and merge them to free up space.
     // Now we don't have any space in the cache.
     // It's caller's responsivility to recover from the situation.
     // Possible work arounds are:
@@ -124,78 +155,506 @@ const GlyphCacheEntry* GlyphCache::Set(const void* const image,
   }
 
   // Create new entry in the look-up map.
-  auto pair =
-      map_entries_.insert(std::pair<GlyphKey, std::unique_ptr<GlyphCacheEntry>>(
-          key, std::unique_ptr<GlyphCacheEntry>(new GlyphCacheEntry(entry))));
-  auto it_entry = pair.first;
-  ret = it_entry->second.get();
+  ret = map_entries_.Insert(key, entry);
 
   // Reserve a region in the row.
-  auto pos = mathfu::vec3i(
-      it_row->Reserve(it_entry, mathfu::vec2i(req_width, req_height)),
-      it_row->get_y_pos(), it_row->get_slice() & ~kGlyphFormatsColor);
+  auto row_pos = it_row->Reserve(ret, req_size);
+  PlaceEntry(ret, buffer, it_row, row_pos, image);
+  if (pinning_) {
+    it_row->set_pinned(true);
+  }
+
+  // Update row LRU entry.
+  buffer->UpdateRowLRU(it_row->get_it_lru_row());
+  it_row->set_last_used_counter(counter_);
+
+  revision_ = counter_;
+  if (pipeline_counters_ != nullptr) {
+    pipeline_counters_->Add(TextPipelineCounters::kGlyphSets);
+  }
+
+  return ret;
+}
+
+bool GlyphCache::UpdateImage(const GlyphKey& key, const mathfu::vec2i& size,
+                             const void* const image) {
+  auto entry = map_entries_.Find(key);
+  if (entry == nullptr || entry->get_size().x != size.x ||
+      entry->get_size().y != size.y) {
+    return false;
+  }
+  auto pos = entry->get_pos();
+  pos.z &= ~kGlyphFormatsMask;
+  entry->buffer_->CopyImage(pos, reinterpret_cast<const uint8_t*>(image),
+                            entry);
+  const mathfu::vec4i dirty_rect(
+      mathfu::vec2i::Max(mathfu::kZeros2i, pos.xy() - mathfu::kOnes2i),
+      pos.xy() + entry->get_size() + padding_);
+  entry->buffer_->UpdateDirtyRect(pos.z, dirty_rect);
+  entry->gpu_resident_ = false;
+
+  revision_ = counter_;
+  return true;
+}
+
+bool GlyphCache::SetGpuResident(const GlyphKey& key) {
+  auto entry = map_entries_.Find(key);
+  if (entry == nullptr) {
+    return false;
+  }
+  entry->gpu_resident_ = true;
+  return true;
+}
+
+const GlyphCacheEntry* GlyphCache::FindGpuResident(const GlyphKey& key) const {
+  auto entry = map_entries_.Find(key);
+  return entry != nullptr && entry->gpu_resident_ ? entry : nullptr;
+}
+
+const GlyphCacheEntry* GlyphCache::SetPinned(const void* const image,
+                                             const GlyphKey& key,
+                                             const GlyphCacheEntry& entry) {
+  auto p = map_entries_.Find(key);
+  if (p != nullptr) {
+    if (p->get_row()->get_pinned()) {
+      return p;
+    }
+    // Move the glyph to a pinned row.
+    UnlinkEntry(p);
+  }
+
+  auto pinning = pinning_;
+  pinning_ = true;
+  auto ret = Set(image, key, entry);
+  pinning_ = pinning;
+  return ret;
+}
+
+const GlyphCacheEntry* GlyphCache::Pin(const GlyphKey& key) {
+  auto p = map_entries_.Find(key);
+  if (p == nullptr || p->get_row()->get_pinned()) {
+    return p;
+  }
+  std::vector<uint8_t> image;
+  CopyEntryImage(*p, &image);
+  GlyphCacheEntry entry = *p;
+  return SetPinned(image.size() ? image.data() : nullptr, key, entry);
+}
+
+void GlyphCache::UnpinAll() {
+  buffers_.UnpinRows();
+  color_buffers_.UnpinRows();
+  msdf_buffers_.UnpinRows();
+}
+
+void GlyphCache::CopyEntryImage(const GlyphCacheEntry& entry,
+                                std::vector<uint8_t>* image) const {
+  auto buffer = entry.buffer_;
+  auto pos = entry.get_pos();
+  auto size = entry.get_size();
+  auto element_size = buffer->get_element_size();
+  auto stride = buffer->get_size().x * element_size;
+  auto src = buffer->get(pos.z & ~kGlyphFormatsMask) + pos.x * element_size +
+             pos.y * stride;
+  image->resize(size.x * size.y * element_size);
+  for (int32_t y = 0; y < size.y; ++y) {
+    memcpy(image->data() + y * size.x * element_size, src + y * stride,
+           size.x * element_size);
+  }
+}
+
+void GlyphCache::SavePinnedGlyphs(const GlyphCacheBufferBase& buffer,
+                                  std::vector<PinnedGlyph>* glyphs) const {
+  auto& rows = buffer.get_rows();
+  for (auto row = rows.begin(); row != rows.end(); ++row) {
+    if (!row->get_pinned()) {
+      continue;
+    }
+    auto& entries = row->get_cached_entries();
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+      auto entry = *it;
+      PinnedGlyph glyph;
+      glyph.key = entry->key_;
+      glyph.code_point = entry->get_code_point();
+      glyph.size = entry->get_size();
+      glyph.offset = entry->get_offset();
+      glyph.advance = entry->get_advance();
+      glyph.color_glyph = entry->get_color_glyph();
+      glyph.multi_channel_sdf = entry->get_multi_channel_sdf();
+      CopyEntryImage(*entry, &glyph.image);
+      glyphs->push_back(std::move(glyph));
+    }
+  }
+}
+
+void GlyphCache::UnlinkEntry(GlyphCacheEntry* entry) {
+  auto it_row = entry->get_row();
+  auto& entries = it_row->get_cached_entries();
+  entries.erase(std::find(entries.begin(), entries.end(), entry));
+  map_entries_.Erase(entry);
+  if (entries.empty()) {
+    // Nothing left in the row. Make the whole row available again.
+    it_row->Initialize(it_row->get_slice(), it_row->get_y_pos(),
+                       it_row->get_size());
+  }
+
+  // FontBuffers referencing the entry need to be reconstructed.
+  last_flushed_revision_ = counter_;
+  epoch_++;
+}
+
+void GlyphCache::RestorePinnedGlyphs(const std::vector<PinnedGlyph>& glyphs) {
+  // Taller glyphs first, so that rows are packed as tight as possible.
+  std::vector<const PinnedGlyph*> sorted_glyphs;
+  for (auto it = glyphs.begin(); it != glyphs.end(); ++it) {
+    sorted_glyphs.push_back(&*it);
+  }
+  std::stable_sort(sorted_glyphs.begin(), sorted_glyphs.end(),
+                   [](const PinnedGlyph* a, const PinnedGlyph* b) {
+                     return a->size.y > b->size.y;
+                   });
+
+  auto pinning = pinning_;
+  pinning_ = true;
+  for (auto p = sorted_glyphs.begin(); p != sorted_glyphs.end(); ++p) {
+    auto it = *p;
+    GlyphCacheEntry entry;
+    entry.set_code_point(it->code_point);
+    entry.set_size(it->size);
+    entry.set_offset(it->offset);
+    entry.set_advance(it->advance);
+    entry.set_color_glyph(it->color_glyph);
+    entry.set_multi_channel_sdf(it->multi_channel_sdf);
+    if (Set(it->image.size() ? it->image.data() : nullptr, it->key, entry) ==
+        nullptr) {
+      LogError("Can't restore a pinned glyph. The cache is too small.");
+    }
+  }
+  pinning_ = pinning;
+}
+
+void GlyphCache::SaveAtlas(std::string* data) const {
+  flatbuffers::FlatBufferBuilder fbb;
+
+  // Glyphs in all rows of the monochrome buffer.
+  std::vector<flatui_data::AtlasGlyph> glyphs;
+  auto& rows = buffers_.get_rows();
+  for (auto row = rows.begin(); row != rows.end(); ++row) {
+    auto& entries = row->get_cached_entries();
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+      auto entry = *it;
+      if (entry->gpu_resident_) {
+        // The image is not in the buffer yet.
+        continue;
+      }
+      auto pos = entry->get_pos();
+      auto size = entry->get_size();
+      glyphs.push_back(flatui_data::AtlasGlyph(
+          entry->key_.get_font_id(), entry->key_.get_code_point(),
+          static_cast<uint16_t>(entry->key_.get_glyph_size()),
+          static_cast<uint16_t>(entry->key_.get_flags()),
+          static_cast<uint16_t>(pos.z & ~kGlyphFormatsMask),
+          static_cast<uint16_t>(pos.x), static_cast<uint16_t>(pos.y),
+          static_cast<uint16_t>(size.x), static_cast<uint16_t>(size.y),
+          static_cast<int16_t>(entry->get_advance().x),
+          entry->get_offset().x, entry->get_offset().y));
+    }
+  }
+
+  std::vector<flatbuffers::Offset<flatui_data::AtlasSlice>> slices;
+  for (int32_t i = 0; i < buffers_.get_num_slices(); ++i) {
+    slices.push_back(flatui_data::CreateAtlasSlice(
+        fbb, fbb.CreateVector(buffers_.get(i), size_.x * size_.y)));
+  }
+
+  auto atlas = flatui_data::CreateGlyphAtlas(
+      fbb, size_.x, size_.y, fbb.CreateVectorOfStructs(glyphs),
+      fbb.CreateVector(slices));
+  flatui_data::FinishGlyphAtlasBuffer(fbb, atlas);
+  data->assign(reinterpret_cast<const char*>(fbb.GetBufferPointer()),
+               fbb.GetSize());
+}
+
+bool GlyphCache::LoadPinnedAtlas(const void* data, size_t size) {
+  flatbuffers::Verifier verifier(reinterpret_cast<const uint8_t*>(data),
+                                 size);
+  if (!flatui_data::VerifyGlyphAtlasBuffer(verifier)) {
+    LogError("Invalid glyph atlas.");
+    return false;
+  }
+  auto atlas = flatui_data::GetGlyphAtlas(data);
+  if (atlas->glyphs() == nullptr || atlas->slices() == nullptr) {
+    return true;
+  }
+  auto glyphs = atlas->glyphs();
+  auto slices = atlas->slices();
+  auto width = atlas->width();
+  auto height = atlas->height();
+
+  // Store taller glyphs first so that rows are packed as tight as they were
+  // baked.
+  std::vector<const flatui_data::AtlasGlyph*> sorted_glyphs;
+  for (flatbuffers::uoffset_t i = 0; i < glyphs->size(); ++i) {
+    sorted_glyphs.push_back(glyphs->Get(i));
+  }
+  std::stable_sort(sorted_glyphs.begin(), sorted_glyphs.end(),
+                   [](const flatui_data::AtlasGlyph* a,
+                      const flatui_data::AtlasGlyph* b) {
+                     return a->height() > b->height();
+                   });
+
+  std::vector<uint8_t> image;
+  bool ret = true;
+  for (auto it = sorted_glyphs.begin(); it != sorted_glyphs.end(); ++it) {
+    auto glyph = *it;
+    if (glyph->slice() >= slices->size() ||
+        glyph->x() + glyph->width() > width ||
+        glyph->y() + glyph->height() > height) {
+      LogError("Invalid glyph in the glyph atlas.");
+      return false;
+    }
+    auto pixels = slices->Get(glyph->slice())->pixels();
+    if (pixels == nullptr ||
+        pixels->size() != static_cast<flatbuffers::uoffset_t>(width * height)) {
+      LogError("Invalid slice in the glyph atlas.");
+      return false;
+    }
+
+    // Copy the glyph image out of the slice.
+    image.resize(glyph->width() * glyph->height());
+    for (int32_t y = 0; y < glyph->height(); ++y) {
+      memcpy(image.data() + y * glyph->width(),
+             pixels->data() + glyph->x() + (glyph->y() + y) * width,
+             glyph->width());
+    }
+
+    GlyphKey key(glyph->font_id(), glyph->code_point(), glyph->glyph_size(),
+                 static_cast<GlyphFlags>(glyph->flags()));
+    GlyphCacheEntry entry;
+    entry.set_code_point(glyph->code_point());
+    entry.set_size(mathfu::vec2i(glyph->width(), glyph->height()));
+    entry.set_offset(mathfu::vec2(glyph->offset_x(), glyph->offset_y()));
+    entry.set_advance(mathfu::vec2i(glyph->advance(), 0));
+    if (SetPinned(image.size() ? image.data() : nullptr, key, entry) ==
+        nullptr) {
+      LogError("Glyph atlas doesn't fit in the glyph cache.");
+      ret = false;
+    }
+  }
+  return ret;
+}
+
+mathfu::vec2i GlyphCache::GetReservedSize(const GlyphCacheEntry& entry) const {
+  // Height is rounded up to multiple of kGlyphCacheHeightRound.
+  // Expecting kGlyphCacheHeightRound is base 2.
+  return mathfu::vec2i(
+      entry.get_size().x + padding_.x,
+      (entry.get_size().y + padding_.y + (kGlyphCacheHeightRound - 1)) &
+          ~(kGlyphCacheHeightRound - 1));
+}
+
+void GlyphCache::PlaceEntry(GlyphCacheEntry* entry,
+                            GlyphCacheBufferBase* buffer,
+                            GlyphCacheEntry::iterator_row it_row,
+                            const mathfu::vec2i& row_pos,
+                            const void* const image) {
+  auto pos = mathfu::vec3i(row_pos.x, it_row->get_y_pos() + row_pos.y,
+                           it_row->get_slice() & ~kGlyphFormatsMask);
 
   // Store given image into the buffer.
   if (image != nullptr) {
-    buffer->CopyImage(pos, reinterpret_cast<const uint8_t*>(image), ret);
+    buffer->CopyImage(pos, reinterpret_cast<const uint8_t*>(image), entry);
   }
   // Clear a padding region.
-  buffer->ClearPaddingRegion(pos, padding_, ret);
+  buffer->ClearPaddingRegion(pos, padding_, entry);
 
   // Dirty rect = region size + padding area + additional upper left/top line.
   const mathfu::vec4i dirty_rect(
       mathfu::vec2i::Max(mathfu::kZeros2i, pos.xy() - mathfu::kOnes2i),
-      pos.xy() + ret->get_size() + padding_);
+      pos.xy() + entry->get_size() + padding_);
   buffer->UpdateDirtyRect(pos.z, dirty_rect);
 
   // Update UV of the entry.
   mathfu::vec4 uv(
       mathfu::vec2(pos.xy()) / mathfu::vec2(size_),
-      mathfu::vec2(pos.xy() + entry.get_size()) / mathfu::vec2(size_));
-  ret->set_uv(uv);
+      mathfu::vec2(pos.xy() + entry->get_size()) / mathfu::vec2(size_));
+  entry->set_uv(uv);
 
   pos.z = it_row->get_slice();
-  ret->set_pos(pos);
+  entry->set_pos(pos);
 
   // Establish links.
-  ret->set_row(it_row);
-  ret->it_lru_row_ = it_row->get_it_lru_row();
-  ret->buffer_ = buffer;
-
-  // Update row LRU entry.
-  buffer->UpdateRowLRU(it_row->get_it_lru_row());
-  it_row->set_last_used_counter(counter_);
-
-  revision_ = counter_;
-
-  return ret;
+  entry->set_row(it_row);
+  entry->it_lru_row_ = it_row->get_it_lru_row();
+  entry->buffer_ = buffer;
 }
 
 bool GlyphCache::Flush() {
 #ifdef GLYPH_CACHE_STATS
   ResetStats();
 #endif  // GLYPH_CACHE_STATS
-  map_entries_.clear();
+  // Keep pinned glyphs to store them again.
+  std::vector<PinnedGlyph> pinned_glyphs;
+  SavePinnedGlyphs(buffers_, &pinned_glyphs);
+  SavePinnedGlyphs(color_buffers_, &pinned_glyphs);
+  SavePinnedGlyphs(msdf_buffers_, &pinned_glyphs);
+
+  map_entries_.Clear();
 
   // Clear buffers.
   buffers_.Reset();
   if (color_buffers_.get_num_slices()) {
     color_buffers_.Reset();
   }
+  if (msdf_buffers_.get_num_slices()) {
+    msdf_buffers_.Reset();
+  }
+  RestorePinnedGlyphs(pinned_glyphs);
 
   // Update cache revision.
   last_flushed_revision_ = counter_;
+  epoch_++;
   return true;
 }
 
+void GlyphCache::ResolveDirtyRect() {
+  if (get_upload_mode() == kGlyphCacheUploadModeAsync &&
+      GlyphCacheUploader::IsSupported()) {
+    if (uploader_ == nullptr) {
+      uploader_.reset(new GlyphCacheUploader());
+    }
+    // Retire completed uploads.
+    uploader_->Poll();
+    auto size = buffers_.GetStagingSize() + color_buffers_.GetStagingSize() +
+                msdf_buffers_.GetStagingSize();
+    if (size) {
+      auto staging = uploader_->Map(size);
+      if (staging == nullptr) {
+        // Staging buffers are still in use. Try again in next cycle.
+        uploaded_revision_ = uploader_->get_completed_revision();
+        return;
+      }
+      size_t offset = 0;
+      buffers_.StageDirtyRects(uploader_.get(), staging, &offset);
+      color_buffers_.StageDirtyRects(uploader_.get(), staging, &offset);
+      msdf_buffers_.StageDirtyRects(uploader_.get(), staging, &offset);
+      if (!uploader_->Submit(revision_)) {
+        // Upload again from the cache buffers.
+        buffers_.SetDirtyAll();
+        color_buffers_.SetDirtyAll();
+        msdf_buffers_.SetDirtyAll();
+      } else if (pipeline_counters_ != nullptr) {
+        pipeline_counters_->Add(TextPipelineCounters::kUploadBytes, size);
+      }
+    } else {
+      // Nothing to upload.
+      buffers_.set_dirty_state(false);
+      color_buffers_.set_dirty_state(false);
+      msdf_buffers_.set_dirty_state(false);
+    }
+    uploaded_revision_ = uploader_->get_pending()
+                             ? uploader_->get_completed_revision()
+                             : revision_;
+    return;
+  }
+
+  if (uploader_ != nullptr) {
+    // Retire uploads issued before the upload mode is changed.
+    uploader_->Poll();
+  }
+  auto bytes = buffers_.ResolveDirtyRect() +
+               color_buffers_.ResolveDirtyRect() +
+               msdf_buffers_.ResolveDirtyRect();
+  if (pipeline_counters_ != nullptr) {
+    pipeline_counters_->Add(TextPipelineCounters::kUploadBytes, bytes);
+  }
+  uploaded_revision_ = revision_;
+}
+
+int32_t GlyphCache::TrimSlices(size_t budget) {
+  int32_t removed = 0;
+  while (GetAtlasMemorySize() > budget && msdf_buffers_.RemoveLastSlice(1)) {
+    removed++;
+  }
+  while (GetAtlasMemorySize() > budget && color_buffers_.RemoveLastSlice(1)) {
+    removed++;
+  }
+  while (GetAtlasMemorySize() > budget && buffers_.RemoveLastSlice(1)) {
+    removed++;
+  }
+  return removed;
+}
+
+// Remove trailing slices of a buffer exceeding its max, and idle ones.
+template <typename T>
+static int32_t ReleaseSlices(GlyphCacheBuffer<T>* buffer,
+                             uint32_t idle_cycles) {
+  int32_t removed = 0;
+  while (buffer->get_num_slices() > buffer->get_num_max_slices() &&
+         buffer->RemoveLastSlice(1)) {
+    removed++;
+  }
+  while (idle_cycles && buffer->RemoveLastSlice(idle_cycles)) {
+    removed++;
+  }
+  return removed;
+}
+
+int32_t GlyphCache::ReleaseIdleSlices(uint32_t idle_cycles) {
+  return ReleaseSlices(&buffers_, idle_cycles) +
+         ReleaseSlices(&color_buffers_, idle_cycles) +
+         ReleaseSlices(&msdf_buffers_, idle_cycles);
+}
+
+void GlyphCache::set_max_slices(int32_t max_slices) {
+  max_slices_ = std::max(max_slices, 1);
+  buffers_.set_max_slices(max_slices_);
+  // Other buffers are initialized with the max on demand.
+  if (color_buffers_.get_size().x) {
+    color_buffers_.set_max_slices(max_slices_);
+  }
+  if (msdf_buffers_.get_size().x) {
+    msdf_buffers_.set_max_slices(max_slices_);
+  }
+}
+
+void GlyphCache::set_upload_mode(GlyphCacheUploadMode mode) {
+  buffers_.set_upload_mode(mode);
+  color_buffers_.set_upload_mode(mode);
+  msdf_buffers_.set_upload_mode(mode);
+}
+
+void GlyphCache::set_packing(GlyphCachePacking packing) {
+  if (packing == get_packing()) {
+    return;
+  }
+  buffers_.set_packing(packing);
+  color_buffers_.set_packing(packing);
+  msdf_buffers_.set_packing(packing);
+
+  // Existing rows are packed with the previous strategy. Start over.
+  Flush();
+}
+
 const GlyphCacheStats& GlyphCache::Status() {
 #ifdef GLYPH_CACHE_STATS
+  stats_.used_area_ = buffers_.GetUsedArea() + color_buffers_.GetUsedArea() +
+                      msdf_buffers_.GetUsedArea();
+  stats_.total_area_ = size_.x * size_.y * get_num_slices();
   LogInfo("Cache size: %dx%d", size_.x, size_.y);
   LogInfo("Cache slices: %d", get_num_slices());
-  LogInfo("Cached glyphs: %d", map_entries_.size());
+  LogInfo("Cached glyphs: %d", static_cast<int32_t>(map_entries_.size()));
   LogInfo("Cache hit: %d / %d", stats_.hit_, stats_.lookup_);
   LogInfo("Row flush: %d", stats_.row_flush_);
+  LogInfo("Row merge: %d", stats_.row_merge_);
+  LogInfo("Row compaction: %d", stats_.row_compaction_);
   LogInfo("Set fail: %d", stats_.set_fail_);
+  LogInfo("Atlas occupancy: %d / %d (%d%%)", stats_.used_area_,
+          stats_.total_area_,
+          stats_.total_area_ ? static_cast<int32_t>(
+                                   static_cast<int64_t>(stats_.used_area_) *
+                                   100 / stats_.total_area_)
+                             : 0);
 #endif  // GLYPH_CACHE_STATS
   return stats_;
 }
@@ -212,7 +671,7 @@ void GlyphCache::FlushCachedEntries(
     std::vector<GlyphCacheEntry::iterator>& entries) {
   // Erase cached glyphs from look-up map.
   for (auto entry = entries.begin(); entry != entries.end(); ++entry) {
-    map_entries_.erase(*entry);
+    map_entries_.Erase(*entry);
   }
 
   // Update cache revision.
@@ -232,10 +691,170 @@ void GlyphCache::ResetStats() {
   stats_.hit_ = 0;
   stats_.lookup_ = 0;
   stats_.row_flush_ = 0;
+  stats_.row_merge_ = 0;
+  stats_.row_compaction_ = 0;
   stats_.set_fail_ = 0;
+  stats_.used_area_ = 0;
+  stats_.total_area_ = 0;
 }
 #endif  // GLYPH_CACHE_STATS
 
+GlyphCacheEntry* GlyphCacheEntryMap::Find(const GlyphKey& key) const {
+  if (!size_) {
+    return nullptr;
+  }
+  return slots_[FindSlot(key)].entry;
+}
+
+GlyphCacheEntry* GlyphCacheEntryMap::Insert(const GlyphKey& key,
+                                            const GlyphCacheEntry& entry) {
+  // Keep the load factor under 1/2 so that probing sequences stay short.
+  if ((size_ + 1) * 2 > slots_.size()) {
+    Grow();
+  }
+  auto& slot = slots_[FindSlot(key)];
+  assert(slot.entry == nullptr);
+
+  auto p = AllocateEntry();
+  *p = entry;
+  p->key_ = key;
+  slot.key = key;
+  slot.entry = p;
+  size_++;
+  return p;
+}
+
+void GlyphCacheEntryMap::Erase(GlyphCacheEntry* entry) {
+  const size_t mask = slots_.size() - 1;
+  auto i = FindSlot(entry->key_);
+  assert(slots_[i].entry == entry);
+  slots_[i].entry = nullptr;
+  size_--;
+  free_entries_.push_back(entry);
+
+  // Back-shift following entries in the probing sequence to fill the hole.
+  auto j = i;
+  while (true) {
+    j = (j + 1) & mask;
+    if (slots_[j].entry == nullptr) {
+      break;
+    }
+    // Move the entry only when its home slot is not cyclically in (i, j].
+    auto home = slots_[j].key.Hash() & mask;
+    bool keep = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+    if (!keep) {
+      slots_[i] = slots_[j];
+      slots_[j].entry = nullptr;
+      i = j;
+    }
+  }
+}
+
+void GlyphCacheEntryMap::Clear() {
+  for (auto it = slots_.begin(); it != slots_.end(); ++it) {
+    it->entry = nullptr;
+  }
+  size_ = 0;
+
+  // Return all entries to the pool.
+  free_entries_.clear();
+  for (auto it = blocks_.begin(); it != blocks_.end(); ++it) {
+    for (size_t i = 0; i < kEntriesPerBlock; ++i) {
+      free_entries_.push_back(&(*it)[i]);
+    }
+  }
+}
+
+size_t GlyphCacheEntryMap::FindSlot(const GlyphKey& key) const {
+  const size_t mask = slots_.size() - 1;
+  auto i = key.Hash() & mask;
+  while (slots_[i].entry != nullptr && !(slots_[i].key == key)) {
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+void GlyphCacheEntryMap::Grow() {
+  std::vector<Slot> slots(slots_.empty() ? kInitialSlots : slots_.size() * 2);
+  slots_.swap(slots);
+  for (auto it = slots.begin(); it != slots.end(); ++it) {
+    if (it->entry != nullptr) {
+      slots_[FindSlot(it->key)] = *it;
+    }
+  }
+}
+
+GlyphCacheEntry* GlyphCacheEntryMap::AllocateEntry() {
+  if (free_entries_.empty()) {
+    // Allocate new block of entries.
+    blocks_.push_back(std::unique_ptr<GlyphCacheEntry[]>(
+        new GlyphCacheEntry[kEntriesPerBlock]));
+    auto block = blocks_.back().get();
+    for (size_t i = kEntriesPerBlock; i > 0; --i) {
+      free_entries_.push_back(&block[i - 1]);
+    }
+  }
+  auto entry = free_entries_.back();
+  free_entries_.pop_back();
+  return entry;
+}
+
+int32_t GlyphCacheRow::FindSkylinePosition(const mathfu::vec2i& size,
+                                           int32_t* y) const {
+  int32_t best_index = -1;
+  int32_t best_y = size_.y;
+  for (size_t i = 0; i < skyline_.size(); ++i) {
+    if (skyline_[i].x + size.x > size_.x) {
+      break;
+    }
+    // Find the top of the nodes the area would span over.
+    int32_t top = 0;
+    int32_t width = 0;
+    for (size_t j = i; width < size.x && top < best_y; ++j) {
+      top = std::max(top, skyline_[j].y);
+      width += skyline_[j].width;
+    }
+    if (top < best_y && top + size.y <= size_.y) {
+      best_index = static_cast<int32_t>(i);
+      best_y = top;
+    }
+  }
+  *y = best_y;
+  return best_index;
+}
+
+void GlyphCacheRow::AddSkylineNode(int32_t index, const mathfu::vec2i& pos,
+                                   const mathfu::vec2i& size) {
+  SkylineNode node = {pos.x, size.x, pos.y + size.y};
+  skyline_.insert(skyline_.begin() + index, node);
+
+  // Shrink or remove following nodes covered by the new node.
+  const int32_t right = pos.x + size.x;
+  for (auto it = skyline_.begin() + index + 1; it != skyline_.end();) {
+    if (it->x >= right) {
+      break;
+    }
+    auto covered = right - it->x;
+    if (it->width <= covered) {
+      it = skyline_.erase(it);
+      continue;
+    }
+    it->x += covered;
+    it->width -= covered;
+    break;
+  }
+
+  // Merge adjacent nodes in a same height.
+  for (size_t i = 1; i < skyline_.size();) {
+    if (skyline_[i - 1].y == skyline_[i].y) {
+      skyline_[i - 1].width += skyline_[i].width;
+      skyline_.erase(skyline_.begin() + i);
+    } else {
+      ++i;
+    }
+  }
+}
+
 void GlyphCacheBufferBase::Initialize(GlyphCache* cache,
                                       const mathfu::vec2i& size,
                                       int32_t max_slices) {
@@ -245,12 +864,16 @@ void GlyphCacheBufferBase::Initialize(GlyphCache* cache,
 }
 
 bool GlyphCacheBufferBase::FindRow(int32_t req_width, int32_t req_height,
+                                   bool pinned,
                                    GlyphCacheEntry::iterator_row* it_found) {
   // Look up the row map to retrieve a row iterator to start with.
   bool ret = false;
   auto it = map_row_.lower_bound(req_height);
   while (it != map_row_.end()) {
-    if (it->second->DoesFit(mathfu::vec2i(req_width, req_height))) {
+    // Pinned and regular glyphs are not mixed in a row.
+    if ((!it->second->get_num_glyphs() ||
+         it->second->get_pinned() == pinned) &&
+        it->second->DoesFit(mathfu::vec2i(req_width, req_height))) {
       break;
     }
     it++;
@@ -309,7 +932,7 @@ void GlyphCacheBufferBase::InsertNewRow(
   }
 
   // Insert new row.
-  auto it = list_row_.insert(pos, GlyphCacheRow(slice, y_pos, size));
+  auto it = list_row_.insert(pos, GlyphCacheRow(slice, y_pos, size, packing_));
   auto it_lru_row = lru_row_.insert(lru_row_.end(), it);
   auto it_map = map_row_.insert(
       std::pair<int32_t, GlyphCacheEntry::iterator_row>(size.y, it));
@@ -319,6 +942,162 @@ void GlyphCacheBufferBase::InsertNewRow(
   it->set_it_row_height_map(it_map);
 }
 
+bool GlyphCacheBufferBase::IsEvictable(const GlyphCacheRow& row) const {
+  return !row.get_num_glyphs() ||
+         (row.get_last_used_counter() != cache_->get_counter() &&
+          !row.get_pinned());
+}
+
+bool GlyphCacheBufferBase::MergeRows(int32_t req_height) {
+  // Sort rows by their positions.
+  std::vector<GlyphCacheEntry::iterator_row> rows;
+  rows.reserve(list_row_.size());
+  for (auto it = list_row_.begin(); it != list_row_.end(); ++it) {
+    rows.push_back(it);
+  }
+  std::sort(rows.begin(), rows.end(),
+            [](const GlyphCacheEntry::iterator_row& a,
+               const GlyphCacheEntry::iterator_row& b) {
+              if (a->get_slice() != b->get_slice()) {
+                return a->get_slice() < b->get_slice();
+              }
+              return a->get_y_pos() < b->get_y_pos();
+            });
+
+  // Find a run of adjacent evictable rows with sufficient height that holds
+  // the least number of glyphs.
+  size_t best_begin = 0;
+  size_t best_end = 0;
+  size_t best_glyphs = std::numeric_limits<size_t>::max();
+  for (size_t begin = 0; begin < rows.size(); ++begin) {
+    int32_t height = 0;
+    size_t glyphs = 0;
+    for (size_t end = begin; end < rows.size(); ++end) {
+      auto& row = *rows[end];
+      if (row.get_slice() != rows[begin]->get_slice() || !IsEvictable(row)) {
+        break;
+      }
+      height += row.get_size().y;
+      glyphs += row.get_num_glyphs();
+      if (glyphs >= best_glyphs) {
+        break;
+      }
+      if (height >= req_height) {
+        best_begin = begin;
+        best_end = end + 1;
+        best_glyphs = glyphs;
+        break;
+      }
+    }
+  }
+  // A single row is handled by PurgeCache().
+  if (best_end - best_begin < 2) {
+    return false;
+  }
+
+  // Flush rows and merge them into the first row. Evicting glyphs invalidates
+  // all FontBuffers as the eviction of a single row does, see MoveEntries().
+  auto it_row = rows[best_begin];
+  int32_t height = 0;
+  for (size_t i = best_begin; i < best_end; ++i) {
+    auto row = rows[i];
+    height += row->get_size().y;
+    if (row->get_num_glyphs()) {
+      row->InvalidateReferencingBuffers();
+      cache_->FlushCachedEntries(row->get_cached_entries());
+    }
+    if (row != it_row) {
+      // FontBuffers must not reference the row being removed.
+      row->ReleaseReferencesFromFontBuffers();
+      lru_row_.erase(row->get_it_lru_row());
+      map_row_.erase(row->get_it_row_height_map());
+      list_row_.erase(row);
+    }
+  }
+
+  const mathfu::vec2i size(size_.x, height);
+  map_row_.erase(it_row->get_it_row_height_map());
+  it_row->set_it_row_height_map(map_row_.insert(
+      std::pair<int32_t, GlyphCacheEntry::iterator_row>(height, it_row)));
+  it_row->Initialize(it_row->get_slice(), it_row->get_y_pos(), size);
+
+#ifdef GLYPH_CACHE_STATS
+  cache_->stats_.row_merge_++;
+#endif  // GLYPH_CACHE_STATS
+  return true;
+}
+
+bool GlyphCacheBufferBase::FindRowToMove(
+    const mathfu::vec2i& req_size, const GlyphCacheRow* exclude,
+    std::map<GlyphCacheRow*, GlyphCacheRow>* scratch,
+    GlyphCacheEntry::iterator_row* it_found) {
+  for (auto it = map_row_.lower_bound(req_size.y); it != map_row_.end();
+       ++it) {
+    auto row = it->second;
+    if (&*row == exclude || !row->get_num_glyphs() || row->get_pinned()) {
+      continue;
+    }
+    auto scratch_it = scratch->find(&*row);
+    if (scratch_it == scratch->end()) {
+      if (!row->DoesFit(req_size)) {
+        continue;
+      }
+      scratch_it = scratch->insert(std::make_pair(&*row, *row)).first;
+    }
+    if (scratch_it->second.DoesFit(req_size)) {
+      scratch_it->second.Reserve(nullptr, req_size);
+      *it_found = row;
+      return true;
+    }
+  }
+  return false;
+}
+
+void GlyphCacheBufferBase::SetDirtyAll() {
+  for (size_t i = 0; i < dirty_rects_.size(); ++i) {
+    dirty_rects_[i].clear();
+    dirty_rects_[i].push_back(mathfu::vec4i(mathfu::kZeros2i, size_));
+  }
+  dirty_ = !dirty_rects_.empty();
+}
+
+void GlyphCacheBufferBase::UnpinRows() {
+  for (auto it = list_row_.begin(); it != list_row_.end(); ++it) {
+    it->set_pinned(false);
+  }
+}
+
+size_t GlyphCacheBufferBase::GetNumPinnedGlyphs() const {
+  size_t glyphs = 0;
+  for (auto it = list_row_.begin(); it != list_row_.end(); ++it) {
+    if (it->get_pinned()) {
+      glyphs += it->get_num_glyphs();
+    }
+  }
+  return glyphs;
+}
+
+size_t GlyphCacheBufferBase::GetRowMemorySize() const {
+  // Each row has a node in the LRU list and the height map too.
+  size_t size = lru_row_.size() * sizeof(GlyphCacheEntry::iterator_row) * 2 +
+                dirty_rects_.capacity() * sizeof(dirty_rects_[0]);
+  for (auto it = list_row_.begin(); it != list_row_.end(); ++it) {
+    size += it->GetMemorySize();
+  }
+  for (auto it = dirty_rects_.begin(); it != dirty_rects_.end(); ++it) {
+    size += it->capacity() * sizeof(mathfu::vec4i);
+  }
+  return size;
+}
+
+int32_t GlyphCacheBufferBase::GetUsedArea() const {
+  int32_t area = 0;
+  for (auto it = list_row_.begin(); it != list_row_.end(); ++it) {
+    area += it->get_used_area();
+  }
+  return area;
+}
+
 void GlyphCacheBufferBase::UpdateRowLRU(
     std::list<GlyphCacheEntry::iterator_row>::iterator it) {
   lru_row_.splice(lru_row_.end(), lru_row_, it);
@@ -326,16 +1105,40 @@ void GlyphCacheBufferBase::UpdateRowLRU(
 
 void GlyphCacheBufferBase::UpdateDirtyRect(int32_t slice,
                                            const mathfu::vec4i& rect) {
-  if (!dirty_) {
-    // Initialize dirty rects.
-    for (size_t i = 0; i < dirty_rects_.size(); ++i) {
-      dirty_rects_[i] = mathfu::vec4i(size_, mathfu::kZeros2i);
+  dirty_ = true;
+  auto& rects = dirty_rects_[slice];
+  if (upload_mode_ == kGlyphCacheUploadModeFullWidth) {
+    // Track a bounding rect of dirty regions.
+    if (rects.empty()) {
+      rects.push_back(rect);
+    } else {
+      rects[0] = Union(rects[0], rect);
     }
+    return;
   }
 
-  dirty_ = true;
-  dirty_rects_[slice] =
-      mathfu::vec4i(mathfu::vec2i::Min(dirty_rects_[slice].xy(), rect.xy()),
-                    mathfu::vec2i::Max(dirty_rects_[slice].zw(), rect.zw()));
+  // Merge the rect into an existing rect if it doesn't increase the uploaded
+  // area (e.g. glyphs next to each other in a row).
+  auto area = Area(rect);
+  auto best = rects.end();
+  int32_t best_growth = std::numeric_limits<int32_t>::max();
+  for (auto it = rects.begin(); it != rects.end(); ++it) {
+    auto growth = Area(Union(*it, rect)) - Area(*it);
+    if (growth <= area) {
+      *it = Union(*it, rect);
+      return;
+    }
+    if (growth < best_growth) {
+      best = it;
+      best_growth = growth;
+    }
+  }
+
+  if (rects.size() < kGlyphCacheMaxDirtyRects) {
+    rects.push_back(rect);
+  } else {
+    // Merge into a rect with the least growth.
+    *best = Union(*best, rect);
+  }
 }
 }
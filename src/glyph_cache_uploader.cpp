@@ -0,0 +1,165 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "precompiled.h"
+
+#include "fplbase/glplatform.h"
+#include "fplbase/renderer.h"
+#include "fplbase/utilities.h"
+#include "internal/glyph_cache.h"
+
+using fplbase::LogError;
+
+// Pixel buffer objects and fences are available in OpenGL ES 3.0 and OpenGL
+// 3.2. On Windows, FPLBase doesn't load entry points of the APIs.
+#if defined(GL_PIXEL_UNPACK_BUFFER) && \
+    defined(GL_SYNC_GPU_COMMANDS_COMPLETE) && !defined(_WIN32)
+#define FLATUI_GLYPH_CACHE_PBO (1)
+#endif  // GL_PIXEL_UNPACK_BUFFER && GL_SYNC_GPU_COMMANDS_COMPLETE
+
+namespace flatui {
+
+GlyphCacheUploader::GlyphCacheUploader()
+    : current_(0), completed_revision_(kNeverFlushed) {
+  for (int32_t i = 0; i < kNumStagingBuffers; ++i) {
+    auto &buffer = staging_buffers_[i];
+    buffer.handle = 0;
+    buffer.capacity = 0;
+    buffer.fence = nullptr;
+    buffer.revision = kNeverFlushed;
+#ifdef FLATUI_GLYPH_CACHE_PBO
+    GLuint handle;
+    GL_CALL(glGenBuffers(1, &handle));
+    buffer.handle = handle;
+#endif  // FLATUI_GLYPH_CACHE_PBO
+  }
+}
+
+GlyphCacheUploader::~GlyphCacheUploader() {
+#ifdef FLATUI_GLYPH_CACHE_PBO
+  for (int32_t i = 0; i < kNumStagingBuffers; ++i) {
+    auto &buffer = staging_buffers_[i];
+    if (buffer.fence != nullptr) {
+      glDeleteSync(reinterpret_cast<GLsync>(buffer.fence));
+    }
+    GLuint handle = buffer.handle;
+    GL_CALL(glDeleteBuffers(1, &handle));
+  }
+#endif  // FLATUI_GLYPH_CACHE_PBO
+}
+
+bool GlyphCacheUploader::IsSupported() {
+#ifdef FLATUI_GLYPH_CACHE_PBO
+  // OpenGL ES 2.0 doesn't support pixel buffer objects.
+  auto renderer = fplbase::RendererBase::Get();
+  return renderer != nullptr &&
+         renderer->feature_level() >= fplbase::kFeatureLevel30;
+#else
+  return false;
+#endif  // FLATUI_GLYPH_CACHE_PBO
+}
+
+uint8_t *GlyphCacheUploader::Map(size_t size) {
+#ifdef FLATUI_GLYPH_CACHE_PBO
+  auto &buffer = staging_buffers_[current_];
+  if (buffer.fence != nullptr) {
+    // The GPU is still reading the buffer.
+    return nullptr;
+  }
+
+  GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.handle));
+  if (size > buffer.capacity) {
+    GL_CALL(glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr,
+                         GL_STREAM_DRAW));
+    buffer.capacity = size;
+  }
+  auto p = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  if (p == nullptr) {
+    GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+  }
+  return reinterpret_cast<uint8_t *>(p);
+#else
+  (void)size;
+  return nullptr;
+#endif  // FLATUI_GLYPH_CACHE_PBO
+}
+
+void GlyphCacheUploader::Upload(fplbase::Texture *texture,
+                                fplbase::TextureFormat format,
+                                const mathfu::vec4i &rect, size_t offset) {
+  UploadRequest request = {texture, format, rect, offset};
+  requests_.push_back(request);
+}
+
+bool GlyphCacheUploader::Submit(int32_t revision) {
+  bool ret = false;
+#ifdef FLATUI_GLYPH_CACHE_PBO
+  auto &buffer = staging_buffers_[current_];
+  // The buffer is still bound to GL_PIXEL_UNPACK_BUFFER since Map().
+  ret = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+  if (ret) {
+    // While the buffer is bound, the data pointer is an offset in the buffer.
+    for (auto it = requests_.begin(); it != requests_.end(); ++it) {
+      it->texture->UpdateTexture(
+          0, it->format, it->rect.x, it->rect.y, it->rect.z - it->rect.x,
+          it->rect.w - it->rect.y, reinterpret_cast<const void *>(it->offset));
+    }
+  } else {
+    // Contents of the buffer has been corrupted (e.g. by a display mode
+    // change).
+    LogError("Glyph cache staging buffer has been lost.");
+  }
+  GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+
+  buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  buffer.revision = revision;
+  current_ = (current_ + 1) % kNumStagingBuffers;
+#else
+  (void)revision;
+#endif  // FLATUI_GLYPH_CACHE_PBO
+  requests_.clear();
+  return ret;
+}
+
+bool GlyphCacheUploader::Poll() {
+#ifdef FLATUI_GLYPH_CACHE_PBO
+  // Fences are signaled in the order of submissions.
+  for (int32_t i = 0; i < kNumStagingBuffers; ++i) {
+    auto &buffer = staging_buffers_[(current_ + i) % kNumStagingBuffers];
+    if (buffer.fence == nullptr) {
+      continue;
+    }
+    auto fence = reinterpret_cast<GLsync>(buffer.fence);
+    auto result = glClientWaitSync(fence, 0, 0);
+    if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+      break;
+    }
+    glDeleteSync(fence);
+    buffer.fence = nullptr;
+    completed_revision_ = buffer.revision;
+  }
+#endif  // FLATUI_GLYPH_CACHE_PBO
+  return !get_pending();
+}
+
+bool GlyphCacheUploader::get_pending() const {
+  for (int32_t i = 0; i < kNumStagingBuffers; ++i) {
+    if (staging_buffers_[i].fence != nullptr) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace flatui
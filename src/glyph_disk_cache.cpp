@@ -0,0 +1,217 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "precompiled.h"
+
+#include "fplbase/utilities.h"
+#include "internal/glyph_disk_cache.h"
+
+using fplbase::LogError;
+using fplbase::LogInfo;
+
+namespace flatui {
+
+// 'FUGC' in the native byte order.
+static const uint32_t kDiskCacheMagic = 0x43475546;
+// Bump the version when changing the file layout.
+static const uint32_t kDiskCacheFormatVersion = 1;
+
+GlyphDiskCache::GlyphDiskCache()
+    : sdf_version_(0),
+      mapped_data_(nullptr),
+      mapped_size_(0),
+      records_(nullptr),
+      num_records_(0),
+      images_(nullptr) {}
+
+GlyphDiskCache::~GlyphDiskCache() { Close(); }
+
+bool GlyphDiskCache::Open(const char *file_name, uint32_t sdf_version) {
+  Close();
+  file_name_ = file_name;
+  sdf_version_ = sdf_version;
+
+  // Try to map the file first.
+  auto size = 0;
+  auto p = fplbase::MapFile(file_name, 0, &size);
+  if (p) {
+    mapped_data_ = p;
+    mapped_size_ = size;
+  } else {
+    // Fallback to regular file load.
+    if (!fplbase::LoadFile(file_name, &file_data_)) {
+      LogInfo("Creating a new glyph disk cache: %s\n", file_name);
+      return true;
+    }
+    p = file_data_.c_str();
+    size = static_cast<int32_t>(file_data_.size());
+  }
+
+  // Validate the contents.
+  auto bytes = static_cast<const uint8_t *>(p);
+  auto header = reinterpret_cast<const Header *>(bytes);
+  auto file_size = static_cast<size_t>(size);
+  if (file_size < sizeof(Header) || header->magic != kDiskCacheMagic ||
+      header->format_version != kDiskCacheFormatVersion ||
+      file_size - sizeof(Header) <
+          static_cast<size_t>(header->num_records) * sizeof(Record)) {
+    LogError("Discarding an invalid glyph disk cache: %s\n", file_name);
+    Close();
+    return true;
+  }
+  records_ = reinterpret_cast<const Record *>(bytes + sizeof(Header));
+  num_records_ = header->num_records;
+  images_ = bytes + sizeof(Header) + num_records_ * sizeof(Record);
+  auto images_size = file_size - (images_ - bytes);
+
+  for (size_t i = 0; i < num_records_; ++i) {
+    auto &record = records_[i];
+    auto image_size = static_cast<size_t>(record.size[0]) * record.size[1];
+    if (record.size[0] < 0 || record.size[1] < 0 ||
+        record.image_offset > images_size ||
+        images_size - record.image_offset < image_size) {
+      LogError("Corrupted glyph disk cache entry: %s\n", file_name);
+      continue;
+    }
+    // SDF images depend on the distance computer.
+    if (record.flags & (kGlyphFlagsOuterSDF | kGlyphFlagsInnerSDF) &&
+        header->sdf_version != sdf_version) {
+      continue;
+    }
+    map_records_.insert(std::make_pair(GetKey(record), i));
+  }
+  return true;
+}
+
+void GlyphDiskCache::Close() {
+  map_records_.clear();
+  added_records_.clear();
+  added_images_.clear();
+  records_ = nullptr;
+  num_records_ = 0;
+  images_ = nullptr;
+  if (mapped_data_) {
+    fplbase::UnmapFile(mapped_data_, mapped_size_);
+    mapped_data_ = nullptr;
+    mapped_size_ = 0;
+  } else {
+    file_data_.clear();
+  }
+}
+
+const uint8_t *GlyphDiskCache::Find(HashedId font_hash, const GlyphKey &key,
+                                    GlyphCacheEntry *entry) const {
+  auto it = map_records_.find(GlyphKey(font_hash, key.get_code_point(),
+                                       key.get_glyph_size(), key.get_flags()));
+  if (it == map_records_.end()) {
+    return nullptr;
+  }
+  auto &record = GetRecord(it->second);
+  entry->set_code_point(record.code_point);
+  entry->set_size(mathfu::vec2i(record.size[0], record.size[1]));
+  entry->set_offset(mathfu::vec2(record.offset[0], record.offset[1]));
+  entry->set_advance(mathfu::vec2i(record.advance[0], record.advance[1]));
+  return GetImage(it->second);
+}
+
+void GlyphDiskCache::Add(HashedId font_hash, const GlyphKey &key,
+                         const GlyphCacheEntry &entry, const uint8_t *image,
+                         int32_t stride) {
+  Record record;
+  record.font_hash = font_hash;
+  record.code_point = key.get_code_point();
+  record.glyph_size = key.get_glyph_size();
+  record.flags = key.get_flags();
+  auto index = num_records_ + added_records_.size();
+  if (!map_records_.insert(std::make_pair(GetKey(record), index)).second) {
+    return;
+  }
+
+  auto size = entry.get_size();
+  record.size[0] = size.x;
+  record.size[1] = size.y;
+  record.offset[0] = entry.get_offset().x;
+  record.offset[1] = entry.get_offset().y;
+  record.advance[0] = entry.get_advance().x;
+  record.advance[1] = entry.get_advance().y;
+  record.image_offset = static_cast<uint32_t>(added_images_.size());
+  added_records_.push_back(record);
+
+  added_images_.resize(added_images_.size() + size.x * size.y);
+  if (image != nullptr) {
+    auto dest = added_images_.data() + record.image_offset;
+    for (int32_t y = 0; y < size.y; ++y) {
+      memcpy(dest + y * size.x, image + y * stride, size.x);
+    }
+  }
+}
+
+bool GlyphDiskCache::Save() {
+  if (file_name_.empty()) {
+    return false;
+  }
+
+  // Serialize all entries, reassigning image offsets.
+  Header header;
+  header.magic = kDiskCacheMagic;
+  header.format_version = kDiskCacheFormatVersion;
+  header.sdf_version = sdf_version_;
+  header.num_records = static_cast<uint32_t>(map_records_.size());
+  std::vector<Record> records;
+  records.reserve(map_records_.size());
+  std::string images;
+  for (auto &it : map_records_) {
+    auto record = GetRecord(it.second);
+    auto image = GetImage(it.second);
+    record.image_offset = static_cast<uint32_t>(images.size());
+    images.append(reinterpret_cast<const char *>(image),
+                  record.size[0] * record.size[1]);
+    records.push_back(record);
+  }
+  std::string data(reinterpret_cast<const char *>(&header), sizeof(header));
+  if (!records.empty()) {
+    data.append(reinterpret_cast<const char *>(records.data()),
+                records.size() * sizeof(Record));
+  }
+  data.append(images);
+
+  // Release the mapping before overwriting the file.
+  auto file_name = file_name_;
+  auto sdf_version = sdf_version_;
+  Close();
+  if (!fplbase::SaveFile(file_name.c_str(), data)) {
+    LogError("Can't save glyph disk cache: %s\n", file_name.c_str());
+    Open(file_name.c_str(), sdf_version);
+    return false;
+  }
+  return Open(file_name.c_str(), sdf_version);
+}
+
+GlyphKey GlyphDiskCache::GetKey(const Record &record) {
+  return GlyphKey(record.font_hash, record.code_point, record.glyph_size,
+                  static_cast<GlyphFlags>(record.flags));
+}
+
+const GlyphDiskCache::Record &GlyphDiskCache::GetRecord(size_t index) const {
+  return index < num_records_ ? records_[index]
+                              : added_records_[index - num_records_];
+}
+
+const uint8_t *GlyphDiskCache::GetImage(size_t index) const {
+  return index < num_records_
+             ? images_ + records_[index].image_offset
+             : added_images_.data() +
+                   added_records_[index - num_records_].image_offset;
+}
+
+}  // namespace flatui
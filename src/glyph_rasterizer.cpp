@@ -0,0 +1,224 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "precompiled.h"
+
+// Freetype2 header
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "fplbase/utilities.h"
+#include "flatui/trace.h"
+#include "internal/glyph_rasterizer.h"
+
+using fplbase::LogError;
+using fplbase::LogInfo;
+using mathfu::vec2i;
+
+namespace flatui {
+
+GlyphRasterizer::GlyphRasterizer(int32_t num_workers,
+                                 DistanceComputer<uint8_t> *(*factory)(void),
+                                 const vec2i &sdf_reserve_size,
+                                 TextPipelineCounters *counters)
+    : busy_(0), terminate_(false), counters_(counters) {
+  for (int32_t i = 0; i < num_workers; ++i) {
+    std::unique_ptr<Worker> worker(new Worker());
+    FT_Error err = FT_Init_FreeType(&worker->ft);
+    if (err) {
+      LogError("Can't initialize freetype. FT_Error:%d\n", err);
+      continue;
+    }
+    worker->sdf_computer.reset(factory());
+    worker->sdf_computer->Reserve(sdf_reserve_size);
+    worker->scratch.reserve(sdf_reserve_size.x * sdf_reserve_size.y);
+    workers_.push_back(std::move(worker));
+  }
+
+  // Start threads after all workers are set up.
+  for (auto &worker : workers_) {
+    worker->thread = std::thread(&GlyphRasterizer::Run, this, worker.get());
+  }
+}
+
+GlyphRasterizer::~GlyphRasterizer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    terminate_ = true;
+    queue_.clear();
+  }
+  job_condition_.notify_all();
+
+  for (auto &worker : workers_) {
+    worker->thread.join();
+    for (auto &face : worker->faces) {
+      FT_Done_Face(face.second);
+    }
+    FT_Done_FreeType(worker->ft);
+  }
+}
+
+void GlyphRasterizer::Enqueue(std::unique_ptr<GlyphRasterJob> job) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(job));
+  }
+  job_condition_.notify_one();
+}
+
+void GlyphRasterizer::GetCompletedJobs(
+    std::vector<std::unique_ptr<GlyphRasterJob>> *jobs) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &job : completed_) {
+    jobs->push_back(std::move(job));
+  }
+  completed_.clear();
+}
+
+void GlyphRasterizer::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_condition_.wait(lock, [this] { return queue_.empty() && !busy_; });
+}
+
+void GlyphRasterizer::CloseFont(const void *font_data) {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  // Cancel queued jobs.
+  auto uses_font = [font_data](const std::unique_ptr<GlyphRasterJob> &job) {
+    return job->font_data == font_data;
+  };
+  queue_.erase(std::remove_if(queue_.begin(), queue_.end(), uses_font),
+               queue_.end());
+
+  // Wait for running jobs. Workers don't touch their faces while they are
+  // idle, so the faces can be released from this thread.
+  idle_condition_.wait(lock, [this] { return !busy_; });
+  completed_.erase(
+      std::remove_if(completed_.begin(), completed_.end(), uses_font),
+      completed_.end());
+  for (auto &worker : workers_) {
+    auto it = worker->faces.find(font_data);
+    if (it != worker->faces.end()) {
+      FT_Done_Face(it->second);
+      worker->faces.erase(it);
+    }
+  }
+}
+
+bool GlyphRasterizer::HasPendingJobs() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return !queue_.empty() || busy_ || !completed_.empty();
+}
+
+void GlyphRasterizer::Run(Worker *worker) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    job_condition_.wait(lock, [this] { return terminate_ || !queue_.empty(); });
+    if (terminate_) {
+      break;
+    }
+    auto job = std::move(queue_.front());
+    queue_.pop_front();
+    busy_++;
+
+    // Rasterize the glyph without holding the lock.
+    lock.unlock();
+    job->succeeded = Rasterize(worker, job.get());
+    lock.lock();
+
+    completed_.push_back(std::move(job));
+    busy_--;
+    if (queue_.empty() && !busy_) {
+      idle_condition_.notify_all();
+    }
+  }
+}
+
+FT_Face GlyphRasterizer::GetFace(Worker *worker, const GlyphRasterJob &job) {
+  auto it = worker->faces.find(job.font_data);
+  if (it != worker->faces.end()) {
+    return it->second;
+  }
+  FT_Face face;
+  FT_Error err = FT_New_Memory_Face(
+      worker->ft, reinterpret_cast<const unsigned char *>(job.font_data),
+      static_cast<FT_Long>(job.font_data_size), job.face_index, &face);
+  if (err) {
+    LogError("Failed to initialize font in a worker. FT_Error:%d\n", err);
+    return nullptr;
+  }
+  worker->faces[job.font_data] = face;
+  return face;
+}
+
+bool GlyphRasterizer::Rasterize(Worker *worker, GlyphRasterJob *job) {
+  FLATUI_TRACE_SCOPE("GlyphRasterizer::Rasterize", job->key.get_code_point());
+  auto face = GetFace(worker, *job);
+  if (face == nullptr) {
+    return false;
+  }
+  FT_Set_Pixel_Sizes(face, 0, job->key.get_glyph_size());
+  FT_Error err;
+  {
+    ScopedTextPipelineTimer timer(counters_,
+                                  TextPipelineCounters::kRasterizeTime);
+    err = FT_Load_Glyph(face, job->key.get_code_point(),
+                        FT_LOAD_RENDER | FT_LOAD_NO_BITMAP);
+  }
+  if (err) {
+    LogInfo("Can't load glyph %c FT_Error:%d\n", job->key.get_code_point(),
+            err);
+    return false;
+  }
+
+  // The rendered bitmap may differ from the bounds computed at the layout by a
+  // pixel, so copy it into the reserved bounds with clipping.
+  FT_GlyphSlot g = face->glyph;
+  auto sdf = job->key.get_flags() & (kGlyphFlagsOuterSDF | kGlyphFlagsInnerSDF);
+  auto &bitmap_size = job->bitmap_size;
+  auto num_pixels = bitmap_size.x * bitmap_size.y;
+  uint8_t *bitmap;
+  if (sdf) {
+    worker->scratch.resize(num_pixels);
+    bitmap = worker->scratch.data();
+  } else {
+    job->image.reset(new uint8_t[num_pixels]);
+    bitmap = job->image.get();
+  }
+  memset(bitmap, 0, num_pixels);
+
+  auto offset = vec2i(g->bitmap_left - job->origin.x,
+                      job->origin.y - g->bitmap_top);
+  auto start = vec2i::Max(offset, mathfu::kZeros2i);
+  auto end = vec2i::Min(offset + vec2i(static_cast<int32_t>(g->bitmap.width),
+                                       static_cast<int32_t>(g->bitmap.rows)),
+                        bitmap_size);
+  for (int32_t y = start.y; y < end.y; ++y) {
+    auto src = g->bitmap.buffer + (y - offset.y) * g->bitmap.pitch;
+    std::copy(src + start.x - offset.x, src + end.x - offset.x,
+              bitmap + y * bitmap_size.x + start.x);
+  }
+
+  if (sdf) {
+    // Generates SDF.
+    job->image.reset(new uint8_t[job->size.x * job->size.y]);
+    Grid<uint8_t> src(bitmap, bitmap_size, kGlyphCachePaddingSDF,
+                      bitmap_size.x);
+    Grid<uint8_t> dest(job->image.get(), job->size, 0, job->size.x);
+    ScopedTextPipelineTimer timer(counters_, TextPipelineCounters::kSdfTime);
+    worker->sdf_computer->Compute(src, &dest, job->key.get_flags());
+  }
+  return true;
+}
+
+}  // namespace flatui
@@ -0,0 +1,414 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "precompiled.h"
+
+#include "fplbase/glplatform.h"
+#include "fplbase/renderer.h"
+#include "fplbase/utilities.h"
+#include "internal/gpu_distance_computer.h"
+
+using fplbase::LogError;
+using fplbase::LogInfo;
+
+// Compute shaders and shader storage buffers are available in OpenGL ES 3.1
+// and OpenGL 4.3. On Windows, FPLBase doesn't load entry points of the APIs.
+#if defined(GL_COMPUTE_SHADER) && defined(GL_SHADER_STORAGE_BUFFER) && \
+    defined(GL_SYNC_GPU_COMMANDS_COMPLETE) && !defined(_WIN32)
+#define FLATUI_GPU_DISTANCE_COMPUTER (1)
+#endif  // GL_COMPUTE_SHADER && GL_SHADER_STORAGE_BUFFER
+
+namespace flatui {
+
+#ifdef FLATUI_GPU_DISTANCE_COMPUTER
+// Each invocation computes 4 horizontally adjacent pixels packed in a uint, so
+// a work group covers 32x8 pixels of a glyph. Work groups in z are glyphs.
+static const int32_t kWorkGroupWidth = 32;
+static const int32_t kWorkGroupHeight = 8;
+
+// The shader finds nearest seeds of the EuclideanDistanceComputer within a
+// radius, which is large enough that distances beyond it are clamped in the
+// output.
+static const char kDistanceShader[] =
+    "layout(local_size_x = 8, local_size_y = 8) in;\n"
+    "struct Job {\n"
+    "  ivec4 source;  // bitmap width, height, offset, SDF padding.\n"
+    "  ivec4 dest;    // region width, height, offset, inner distance flag.\n"
+    "};\n"
+    "layout(std430, binding = 0) readonly buffer Jobs { Job jobs[]; };\n"
+    "layout(std430, binding = 1) readonly buffer Sources { uint sources[]; "
+    "};\n"
+    "layout(std430, binding = 2) writeonly buffer Distances {\n"
+    "  uint distances[];\n"
+    "};\n"
+    "const int kRadius = 9;\n"
+    "const float kInfinite = 1e20;\n"
+    "float Coverage(ivec4 source, ivec2 p) {\n"
+    "  ivec2 b = p - ivec2(source.w);\n"
+    "  if (any(lessThan(b, ivec2(0))) ||\n"
+    "      any(greaterThanEqual(b, source.xy))) {\n"
+    "    return 0.0;\n"
+    "  }\n"
+    "  int i = source.z + b.x + b.y * source.x;\n"
+    "  uint v = (sources[i >> 2] >> uint((i & 3) * 8)) & 0xffu;\n"
+    "  return float(v) / 255.0;\n"
+    "}\n"
+    "uint Distance(Job job, ivec2 p) {\n"
+    "  if (p.x >= job.dest.x) {\n"
+    "    return 0u;\n"
+    "  }\n"
+    "  float v = Coverage(job.source, p);\n"
+    "  float outer = v > 0.0 ? (1.0 - v) * (1.0 - v) : kInfinite;\n"
+    "  float inner = v < 1.0 ? v * v : kInfinite;\n"
+    "  ivec2 lo = max(p - ivec2(kRadius), ivec2(0));\n"
+    "  ivec2 hi = min(p + ivec2(kRadius), job.dest.xy - ivec2(1));\n"
+    "  for (int y = lo.y; y <= hi.y; ++y) {\n"
+    "    for (int x = lo.x; x <= hi.x; ++x) {\n"
+    "      float s = Coverage(job.source, ivec2(x, y));\n"
+    "      vec2 d = vec2(x - p.x, y - p.y);\n"
+    "      float squared = dot(d, d);\n"
+    "      if (s > 0.0) outer = min(outer, squared + (1.0 - s) * (1.0 - s));\n"
+    "      if (s < 1.0) inner = min(inner, squared + s * s);\n"
+    "    }\n"
+    "  }\n"
+    "  float value = v >= 1.0 ? 0.0 : sqrt(outer) - 0.5;\n"
+    "  if (job.dest.w != 0 && v > 0.0) value -= sqrt(inner) - 0.5;\n"
+    "  return uint(clamp(value * -16.0 + 127.0, 0.0, 255.0));\n"
+    "}\n"
+    "void main() {\n"
+    "  Job job = jobs[gl_WorkGroupID.z];\n"
+    "  ivec2 p = ivec2(gl_GlobalInvocationID.xy) * ivec2(4, 1);\n"
+    "  int stride = (job.dest.x + 3) / 4;\n"
+    "  if (p.x >= job.dest.x || p.y >= job.dest.y) {\n"
+    "    return;\n"
+    "  }\n"
+    "  distances[job.dest.z + p.x / 4 + p.y * stride] =\n"
+    "      Distance(job, p) | (Distance(job, p + ivec2(1, 0)) << 8) |\n"
+    "      (Distance(job, p + ivec2(2, 0)) << 16) |\n"
+    "      (Distance(job, p + ivec2(3, 0)) << 24);\n"
+    "}\n";
+
+// Size of a distance field with scanlines padded to 4 bytes.
+static size_t GetPackedSize(const mathfu::vec2i &size) {
+  return static_cast<size_t>((size.x + 3) & ~3) * size.y;
+}
+#endif  // FLATUI_GPU_DISTANCE_COMPUTER
+
+GpuDistanceComputer::GpuDistanceComputer()
+    : program_(0),
+      job_buffer_(0),
+      source_buffer_(0),
+      supported_(true),
+      initialized_(false) {
+#ifndef FLATUI_GPU_DISTANCE_COMPUTER
+  supported_ = false;
+#endif  // FLATUI_GPU_DISTANCE_COMPUTER
+}
+
+GpuDistanceComputer::~GpuDistanceComputer() {
+#ifdef FLATUI_GPU_DISTANCE_COMPUTER
+  if (!initialized_) {
+    return;
+  }
+  for (auto it = batches_.begin(); it != batches_.end(); ++it) {
+    glDeleteSync(reinterpret_cast<GLsync>(it->fence));
+    free_buffers_.push_back(it->buffer);
+  }
+  for (auto it = free_buffers_.begin(); it != free_buffers_.end(); ++it) {
+    GLuint handle = *it;
+    GL_CALL(glDeleteBuffers(1, &handle));
+  }
+  GLuint handles[] = {job_buffer_, source_buffer_};
+  GL_CALL(glDeleteBuffers(2, handles));
+  if (program_) {
+    GL_CALL(glDeleteProgram(program_));
+  }
+#endif  // FLATUI_GPU_DISTANCE_COMPUTER
+}
+
+void GpuDistanceComputer::Enqueue(std::unique_ptr<GpuDistanceJob> job,
+                                  const uint8_t *bitmap, int32_t pitch) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  job->source_offset = sources_.size();
+  auto width = job->bitmap_size.x;
+  sources_.resize(sources_.size() + width * job->bitmap_size.y);
+  for (int32_t y = 0; y < job->bitmap_size.y; ++y) {
+    memcpy(&sources_[job->source_offset + y * width], bitmap + y * pitch,
+           width);
+  }
+  queue_.push_back(std::move(job));
+}
+
+bool GpuDistanceComputer::InitializeProgram() {
+#ifdef FLATUI_GPU_DISTANCE_COMPUTER
+  initialized_ = true;
+  auto renderer = fplbase::RendererBase::Get();
+  if (renderer == nullptr ||
+      renderer->feature_level() < fplbase::kFeatureLevel30) {
+    return false;
+  }
+  GLint major = 0;
+  GLint minor = 0;
+  GL_CALL(glGetIntegerv(GL_MAJOR_VERSION, &major));
+  GL_CALL(glGetIntegerv(GL_MINOR_VERSION, &minor));
+  auto version = reinterpret_cast<const char *>(glGetString(GL_VERSION));
+  bool gles = version != nullptr && strstr(version, "OpenGL ES") != nullptr;
+  auto required = gles ? 31 : 43;
+  if (major * 10 + minor < required) {
+    return false;
+  }
+
+  const char *sources[] = {
+      gles ? "#version 310 es\nprecision highp float;\nprecision highp int;\n"
+           : "#version 430\n",
+      kDistanceShader};
+  auto shader = glCreateShader(GL_COMPUTE_SHADER);
+  GL_CALL(glShaderSource(shader, 2, sources, nullptr));
+  GL_CALL(glCompileShader(shader));
+  GLint status = GL_FALSE;
+  GL_CALL(glGetShaderiv(shader, GL_COMPILE_STATUS, &status));
+  if (status == GL_TRUE) {
+    program_ = glCreateProgram();
+    GL_CALL(glAttachShader(program_, shader));
+    GL_CALL(glLinkProgram(program_));
+    GL_CALL(glGetProgramiv(program_, GL_LINK_STATUS, &status));
+  }
+  if (status != GL_TRUE) {
+    char log[512];
+    if (program_) {
+      glGetProgramInfoLog(program_, sizeof(log), nullptr, log);
+      glDeleteProgram(program_);
+      program_ = 0;
+    } else {
+      glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+    }
+    LogError("Can't build the distance field shader: %s", log);
+  }
+  GL_CALL(glDeleteShader(shader));
+  if (!program_) {
+    return false;
+  }
+
+  GLuint handles[2];
+  GL_CALL(glGenBuffers(2, handles));
+  job_buffer_ = handles[0];
+  source_buffer_ = handles[1];
+  return true;
+#else
+  return false;
+#endif  // FLATUI_GPU_DISTANCE_COMPUTER
+}
+
+void GpuDistanceComputer::ComputeInCPU() {
+  std::vector<std::unique_ptr<GpuDistanceJob>> jobs;
+  std::vector<uint8_t> sources;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs.swap(queue_);
+    sources.swap(sources_);
+  }
+  for (auto it = jobs.begin(); it != jobs.end(); ++it) {
+    auto &job = *it;
+    ComputeJob(job.get(), &sources[job->source_offset]);
+    completed_.push_back(std::move(job));
+  }
+}
+
+void GpuDistanceComputer::ComputeJob(GpuDistanceJob *job,
+                                     const uint8_t *source) {
+  job->image.reset(new uint8_t[job->size.x * job->size.y]);
+  Grid<uint8_t> src(const_cast<uint8_t *>(source), job->bitmap_size,
+                    kGlyphCachePaddingSDF, job->bitmap_size.x);
+  Grid<uint8_t> dest(job->image.get(), job->size, 0, job->size.x);
+  fallback_.Compute(src, &dest, job->key.get_flags());
+}
+
+void GpuDistanceComputer::Dispatch(GlyphCache *cache) {
+  if (supported_ && !initialized_ && !InitializeProgram()) {
+    LogInfo("Compute shaders are not available. Computing SDF in the CPU.");
+    supported_ = false;
+  }
+  if (!supported_) {
+    ComputeInCPU();
+    return;
+  }
+#ifdef FLATUI_GPU_DISTANCE_COMPUTER
+  PollBatches();
+
+  std::vector<std::unique_ptr<GpuDistanceJob>> jobs;
+  std::vector<uint8_t> sources;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queue_.empty()) {
+      return;
+    }
+    jobs.swap(queue_);
+    sources.swap(sources_);
+  }
+  // Sources are padded to be read as uints.
+  sources.resize((sources.size() + 3) & ~3);
+  GL_CALL(glBindBuffer(GL_SHADER_STORAGE_BUFFER, source_buffer_));
+  GL_CALL(glBufferData(GL_SHADER_STORAGE_BUFFER, sources.size(),
+                       sources.data(), GL_STREAM_DRAW));
+
+  // Skip glyphs evicted since they were queued.
+  auto buffer = cache->get_monochrome_buffer();
+  Batch batch;
+  batch.size = 0;
+  std::vector<GLint> params;
+  mathfu::vec2i max_size = mathfu::kZeros2i;
+  for (auto it = jobs.begin(); it != jobs.end(); ++it) {
+    auto &job = *it;
+    auto entry = cache->FindGpuResident(job->key);
+    if (entry == nullptr) {
+      continue;
+    }
+    if (!fplbase::ValidTextureHandle(
+            buffer->get_texture(entry->get_pos().z & ~kGlyphFormatsColor)
+                ->id())) {
+      // The texture is allocated with a deferred upload of the cache buffer.
+      // Compute the glyph in the CPU, and let it be uploaded as well.
+      ComputeJob(job.get(), &sources[job->source_offset]);
+      completed_.push_back(std::move(job));
+      continue;
+    }
+    GLint job_params[] = {
+        job->bitmap_size.x,
+        job->bitmap_size.y,
+        static_cast<GLint>(job->source_offset),
+        kGlyphCachePaddingSDF,
+        job->size.x,
+        job->size.y,
+        static_cast<GLint>(batch.size / 4),
+        job->key.get_flags() & kGlyphFlagsInnerSDF ? 1 : 0,
+    };
+    params.insert(params.end(), job_params,
+                  job_params + sizeof(job_params) / sizeof(job_params[0]));
+    max_size = mathfu::vec2i::Max(max_size, job->size);
+    batch.offsets.push_back(batch.size);
+    batch.size += GetPackedSize(job->size);
+    batch.jobs.push_back(std::move(job));
+  }
+  if (batch.jobs.empty()) {
+    return;
+  }
+
+  if (free_buffers_.empty()) {
+    GLuint handle;
+    GL_CALL(glGenBuffers(1, &handle));
+    free_buffers_.push_back(handle);
+  }
+  batch.buffer = free_buffers_.back();
+  free_buffers_.pop_back();
+
+  // Compute all glyphs in one dispatch. Keep the program bound by the
+  // renderer, which tracks its own state.
+  GLint saved_program = 0;
+  GL_CALL(glGetIntegerv(GL_CURRENT_PROGRAM, &saved_program));
+  GL_CALL(glBindBuffer(GL_SHADER_STORAGE_BUFFER, job_buffer_));
+  GL_CALL(glBufferData(GL_SHADER_STORAGE_BUFFER, params.size() * sizeof(GLint),
+                       params.data(), GL_STREAM_DRAW));
+  GL_CALL(glBindBuffer(GL_SHADER_STORAGE_BUFFER, batch.buffer));
+  GL_CALL(glBufferData(GL_SHADER_STORAGE_BUFFER, batch.size, nullptr,
+                       GL_STREAM_READ));
+  GL_CALL(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, job_buffer_));
+  GL_CALL(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, source_buffer_));
+  GL_CALL(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, batch.buffer));
+  GL_CALL(glUseProgram(program_));
+  GL_CALL(glDispatchCompute(
+      (max_size.x + kWorkGroupWidth - 1) / kWorkGroupWidth,
+      (max_size.y + kWorkGroupHeight - 1) / kWorkGroupHeight,
+      static_cast<GLuint>(batch.jobs.size())));
+  GL_CALL(glUseProgram(saved_program));
+  GL_CALL(glMemoryBarrier(GL_PIXEL_BUFFER_BARRIER_BIT |
+                          GL_BUFFER_UPDATE_BARRIER_BIT));
+  GL_CALL(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+
+  // Copy distance fields to the atlas textures without leaving the GPU.
+  // Scanlines of the fields are padded to 4 bytes.
+  GLint saved_alignment = 4;
+  GL_CALL(glGetIntegerv(GL_UNPACK_ALIGNMENT, &saved_alignment));
+  GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+  GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, batch.buffer));
+  for (size_t i = 0; i < batch.jobs.size(); ++i) {
+    auto &job = batch.jobs[i];
+    auto pos = cache->FindGpuResident(job->key)->get_pos();
+    buffer->get_texture(pos.z & ~kGlyphFormatsColor)
+        ->UpdateTexture(0, buffer->get_texture_format(), pos.x, pos.y,
+                        job->size.x, job->size.y,
+                        reinterpret_cast<const void *>(batch.offsets[i]));
+  }
+  GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+  GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, saved_alignment));
+
+  batch.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  batches_.push_back(std::move(batch));
+#else
+  (void)cache;
+#endif  // FLATUI_GPU_DISTANCE_COMPUTER
+}
+
+void GpuDistanceComputer::PollBatches() {
+#ifdef FLATUI_GPU_DISTANCE_COMPUTER
+  // Fences are signaled in the order of dispatches.
+  size_t done = 0;
+  for (; done < batches_.size(); ++done) {
+    auto &batch = batches_[done];
+    auto fence = reinterpret_cast<GLsync>(batch.fence);
+    auto result = glClientWaitSync(fence, 0, 0);
+    if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+      break;
+    }
+    glDeleteSync(fence);
+
+    GL_CALL(glBindBuffer(GL_COPY_READ_BUFFER, batch.buffer));
+    auto p = reinterpret_cast<const uint8_t *>(glMapBufferRange(
+        GL_COPY_READ_BUFFER, 0, batch.size, GL_MAP_READ_BIT));
+    if (p != nullptr) {
+      for (size_t i = 0; i < batch.jobs.size(); ++i) {
+        auto &job = batch.jobs[i];
+        auto width = job->size.x;
+        auto stride = (width + 3) & ~3;
+        job->image.reset(new uint8_t[width * job->size.y]);
+        for (int32_t y = 0; y < job->size.y; ++y) {
+          memcpy(job->image.get() + y * width,
+                 p + batch.offsets[i] + y * stride, width);
+        }
+        completed_.push_back(std::move(job));
+      }
+      glUnmapBuffer(GL_COPY_READ_BUFFER);
+    } else {
+      // The glyphs are left GPU resident, and laid out again after their
+      // eviction.
+      LogError("Can't read back distance fields.");
+    }
+    GL_CALL(glBindBuffer(GL_COPY_READ_BUFFER, 0));
+    free_buffers_.push_back(batch.buffer);
+  }
+  batches_.erase(batches_.begin(), batches_.begin() + done);
+#endif  // FLATUI_GPU_DISTANCE_COMPUTER
+}
+
+void GpuDistanceComputer::GetCompletedJobs(
+    std::vector<std::unique_ptr<GpuDistanceJob>> *jobs) {
+  PollBatches();
+  jobs->swap(completed_);
+  completed_.clear();
+}
+
+bool GpuDistanceComputer::HasPendingJobs() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return !queue_.empty() || !batches_.empty() || !completed_.empty();
+}
+
+}  // namespace flatui
@@ -13,6 +13,8 @@
 // limitations under the License.
 #include "precompiled.h"
 
+#include <atomic>
+
 // Freetype2 header
 #include <ft2build.h>
 #include FT_FREETYPE_H
@@ -33,17 +35,11 @@
 #include "internal/flatui_util.h"
 #include "internal/hb_complex_font.h"
 
-#ifdef __APPLE__
-#include "TargetConditionals.h"
-#endif  // __APPLE__
-
+// Fonts opened by name are converted to SFNT data once and cached on disk, so
+// later launches map the cache instead of converting them again.
 static const bool kShouldMapFontByName =
 #ifdef __APPLE__
-#if TARGET_OS_IPHONE
   true;
-#else  // TARGET_OS_IPHONE
-  false;
-#endif  // TARGET_OS_IPHONE
 #else
   false;
 #endif  // __APPLE__
@@ -67,6 +63,12 @@ HbFont *HbComplexFont::Open(HashedId id, std::vector<FaceData *> *vec,
   auto font = static_cast<HbComplexFont *>(insert.first->second.get());
   font->faces_ = *vec;
   font->complex_font_id_ = id;
+
+  std::vector<const CodepointCoverage *> coverages;
+  for (auto it = vec->begin(); it != vec->end(); ++it) {
+    coverages.push_back(&(*it)->get_coverage());
+  }
+  font->face_map_.Build(coverages);
   return font;
 }
 
@@ -99,7 +101,8 @@ void HbComplexFont::OverrideCallbacks(int32_t i) {
   hb_font_funcs_set_glyph_name_func(table, HbGetName, this, NullCallback);
   hb_font_funcs_make_immutable(table);
 
-  hb_font_set_funcs(faces_[i]->get_hb_font(), table, faces_[i], NullCallback);
+  hb_font_set_funcs(faces_[i]->GetInstance()->get_hb_font(), table, faces_[i],
+                    NullCallback);
 }
 
 int32_t HbComplexFont::AnalyzeFontFaceRun(const char *text, size_t length,
@@ -116,23 +119,16 @@ int32_t HbComplexFont::AnalyzeFontFaceRun(const char *text, size_t length,
                                          length, &i);
     // Current face has a priority since we want to have longer run for a font.
     if (current_face != static_cast<size_t>(kIndexInvalid) &&
-        FT_Get_Char_Index(faces_[current_face]->get_face(), unicode)) {
+        faces_[current_face]->get_coverage().Contains(unicode)) {
       (*font_data_index)[text_idx] = current_face;
     } else {
       // Check if any font has the glyph.
-      size_t face_idx = 0;
-      for (face_idx = 0; face_idx < faces_.size(); ++face_idx) {
-        if (face_idx != current_face &&
-            FT_Get_Char_Index(faces_[face_idx]->get_face(), unicode)) {
-          (*font_data_index)[text_idx] = face_idx;
-          if (face_idx != current_face) {
-            run++;
-            current_face = face_idx;
-          }
-          break;
-        }
-      }
-      if (face_idx == faces_.size()) {
+      auto face_idx = face_map_.Find(unicode);
+      if (face_idx != kIndexInvalid) {
+        (*font_data_index)[text_idx] = face_idx;
+        run++;
+        current_face = face_idx;
+      } else {
         fplbase::LogError("Requested glyph %x didn't match any font.", unicode);
       }
     }
@@ -141,8 +137,43 @@ int32_t HbComplexFont::AnalyzeFontFaceRun(const char *text, size_t length,
   return run;
 }
 
+int32_t HbComplexFont::AnalyzeFontFaceRun(
+    const DecodedText &text, std::vector<int32_t> *font_data_index) const {
+  font_data_index->resize(text.get_length());
+  std::fill(font_data_index->begin(), font_data_index->end(), kIndexInvalid);
+  auto run = 0;
+  size_t current_face = kIndexInvalid;
+  auto codepoints = text.get_codepoints();
+  auto offsets = text.get_offsets();
+  for (size_t i = 0; i < text.get_count(); ++i) {
+    auto unicode = codepoints[i];
+    auto text_idx = offsets[i];
+    // Current face has a priority since we want to have longer run for a font.
+    if (current_face != static_cast<size_t>(kIndexInvalid) &&
+        faces_[current_face]->get_coverage().Contains(unicode)) {
+      (*font_data_index)[text_idx] = current_face;
+    } else {
+      // Check if any font has the glyph.
+      auto face_idx = face_map_.Find(unicode);
+      if (face_idx != kIndexInvalid) {
+        (*font_data_index)[text_idx] = face_idx;
+        run++;
+        current_face = face_idx;
+      } else {
+        fplbase::LogError("Requested glyph %x didn't match any font.", unicode);
+      }
+    }
+  }
+  return run;
+}
+
 const FaceData &HbComplexFont::GetFaceData() const {
-  return *faces_[current_face_index_];
+  return *faces_[GetState()->face_index];
+}
+
+HbComplexFont::State *HbComplexFont::GetState() const {
+  auto instances = FaceInstances::GetSelected();
+  return instances != nullptr ? instances->GetState(*this) : &state_;
 }
 
 int32_t HbComplexFont::GetBaseLine(int32_t size) const {
@@ -167,7 +198,9 @@ mathfu::vec2i HbComplexFont::GetUnderline(int32_t size) const {
                        underline_thickness + 0.5f);
 }
 
-void HbComplexFont::SetPixelSize(uint32_t size) { pixel_size_ = size; }
+void HbComplexFont::SetPixelSize(uint32_t size) {
+  GetState()->pixel_size = size;
+}
 
 hb_bool_t HbComplexFont::HbGetGlyph(hb_font_t *font, void *font_data,
                                     hb_codepoint_t unicode,
@@ -176,9 +209,9 @@ hb_bool_t HbComplexFont::HbGetGlyph(hb_font_t *font, void *font_data,
   (void)font;
   (void)font_data;
   auto p = static_cast<HbComplexFont *>(user_data);
-  auto &face_data = p->GetFaceData();
+  auto instance = p->GetFaceData().GetInstance();
   auto code_point =
-      p->GetGlyph(face_data.get_face(), unicode, variation_selector);
+      p->GetGlyph(instance->get_face(), unicode, variation_selector);
   if (!code_point) {
     return false;
   }
@@ -194,8 +227,8 @@ hb_position_t HbComplexFont::HbGetHorizontalAdvance(hb_font_t *font,
   (void)font_data;
   if (!glyph) return 0;
   auto p = static_cast<HbComplexFont *>(user_data);
-  auto &face_data = p->GetFaceData();
-  return p->GetGlyphAdvance(face_data.get_face(), glyph, face_data.get_scale(),
+  auto instance = p->GetFaceData().GetInstance();
+  return p->GetGlyphAdvance(instance->get_face(), glyph, instance->get_scale(),
                             FT_LOAD_DEFAULT | FT_LOAD_NO_HINTING);
 }
 
@@ -206,9 +239,9 @@ hb_position_t HbComplexFont::HbGetVerticalAdvance(hb_font_t *font,
   (void)font;
   (void)font_data;
   auto p = static_cast<HbComplexFont *>(user_data);
-  auto &face_data = p->GetFaceData();
+  auto instance = p->GetFaceData().GetInstance();
   return p->GetGlyphAdvance(
-      face_data.get_face(), glyph, face_data.get_scale(),
+      instance->get_face(), glyph, instance->get_scale(),
       FT_LOAD_DEFAULT | FT_LOAD_NO_HINTING | FT_LOAD_VERTICAL_LAYOUT);
 }
 
@@ -220,10 +253,10 @@ hb_bool_t HbComplexFont::HbGetVerticalOrigin(hb_font_t *font, void *font_data,
   (void)font_data;
   if (!glyph) return false;
   auto p = static_cast<HbComplexFont *>(user_data);
-  auto &face_data = p->GetFaceData();
+  auto instance = p->GetFaceData().GetInstance();
   mathfu::vec2i origin;
-  auto scale = face_data.get_scale();
-  auto b = p->GetGlyphVerticalOrigin(face_data.get_face(), glyph,
+  auto scale = instance->get_scale();
+  auto b = p->GetGlyphVerticalOrigin(instance->get_face(), glyph,
                                      mathfu::vec2i(scale, scale), &origin);
   *x = origin.x;
   *y = origin.y;
@@ -238,11 +271,11 @@ hb_position_t HbComplexFont::HbGetHorizontalKerning(hb_font_t *font,
   (void)font;
   (void)font_data;
   auto p = static_cast<HbComplexFont *>(user_data);
-  auto &face_data = p->GetFaceData();
+  auto instance = p->GetFaceData().GetInstance();
 
   uint32_t x_ppem, y_ppem;
-  hb_font_get_ppem(p->GetHbFont(), &x_ppem, &y_ppem);
-  return p->GetGlyphHorizontalKerning(face_data.get_face(), left_glyph,
+  hb_font_get_ppem(instance->get_hb_font(), &x_ppem, &y_ppem);
+  return p->GetGlyphHorizontalKerning(instance->get_face(), left_glyph,
                                       right_glyph, x_ppem);
 }
 
@@ -253,8 +286,8 @@ hb_bool_t HbComplexFont::HbGetExtents(hb_font_t *font, void *font_data,
   (void)font;
   (void)font_data;
   auto p = static_cast<HbComplexFont *>(user_data);
-  auto &face_data = p->GetFaceData();
-  return p->GetGlyphExtents(face_data.get_face(), glyph, extents);
+  auto instance = p->GetFaceData().GetInstance();
+  return p->GetGlyphExtents(instance->get_face(), glyph, extents);
 }
 
 hb_bool_t HbComplexFont::HgGetContourPoint(hb_font_t *font, void *font_data,
@@ -265,8 +298,8 @@ hb_bool_t HbComplexFont::HgGetContourPoint(hb_font_t *font, void *font_data,
   (void)font;
   (void)font_data;
   auto p = static_cast<HbComplexFont *>(user_data);
-  auto &face_data = p->GetFaceData();
-  return p->GetGlyphContourPoint(face_data.get_face(), glyph, point_index, x,
+  auto instance = p->GetFaceData().GetInstance();
+  return p->GetGlyphContourPoint(instance->get_face(), glyph, point_index, x,
                                  y);
 }
 
@@ -276,8 +309,8 @@ hb_bool_t HbComplexFont::HbGetName(hb_font_t *font, void *font_data,
   (void)font;
   (void)font_data;
   auto p = static_cast<HbComplexFont *>(user_data);
-  auto &face_data = p->GetFaceData();
-  return p->GetGlyphName(face_data.get_face(), glyph, name, size);
+  auto instance = p->GetFaceData().GetInstance();
+  return p->GetGlyphName(instance->get_face(), glyph, name, size);
 }
 
 void HbComplexFont::SetCurrentFaceIndex(int32_t index) {
@@ -285,10 +318,11 @@ void HbComplexFont::SetCurrentFaceIndex(int32_t index) {
   if (index == kIndexInvalid) {
     index = 0;
   }
-  current_face_index_ = index;
-  OverrideCallbacks(current_face_index_);
+  auto state = GetState();
+  state->face_index = index;
+  OverrideCallbacks(index);
   // Set font size to the active font.
-  faces_[current_face_index_]->SetSize(pixel_size_);
+  faces_[index]->GetInstance()->SetSize(state->pixel_size);
 }
 
 HbFont::~HbFont() {}
@@ -347,9 +381,13 @@ mathfu::vec2i HbFont::GetUnderline(int32_t size) const {
                        underline_thickness + 0.5f);
 }
 
-void HbFont::SetPixelSize(uint32_t size) { face_data_->SetSize(size); }
+void HbFont::SetPixelSize(uint32_t size) {
+  face_data_->GetInstance()->SetSize(size);
+}
 
-uint32_t HbFont::GetPixelSize() const { return face_data_->GetSize(); }
+uint32_t HbFont::GetPixelSize() const {
+  return face_data_->GetInstance()->GetSize();
+}
 
 const FaceData &HbFont::GetFaceData() const { return *face_data_; }
 
@@ -455,15 +493,32 @@ bool HbFont::GetGlyphName(FT_Face face, hb_codepoint_t glyph, char *name,
   return (size && *name == 0) ? false : (ret != 0);
 }
 
+// Retrieve the index of the face in a font file.
+static int32_t GetFaceIndex(const FontFamily &family) {
+  return family.is_font_collection() ? family.get_index() : 0;
+}
+
+// Record the codepoints covered by the cmap of a face.
+static void BuildCoverage(FT_Face face, CodepointCoverage *coverage) {
+  FT_UInt glyph_index = 0;
+  FT_ULong code = FT_Get_First_Char(face, &glyph_index);
+  while (glyph_index != 0) {
+    coverage->Insert(static_cast<uint32_t>(code));
+    code = FT_Get_Next_Char(face, code, &glyph_index);
+  }
+}
+
 bool FaceData::Open(FT_Library ft, const FontFamily &family) {
+  return LoadFile(family) && Initialize(ft, family);
+}
+
+bool FaceData::LoadFile(const FontFamily &family) {
   const char *font_name = family.get_name().c_str();
   auto by_name = family.is_family_name();
 
   // Load the font file of assets.
-  auto index = 0;
   if (family.is_font_collection()) {
     font_name = family.get_original_name().c_str();
-    index = family.get_index();
   }
   // Try to map the file first.
   auto size = 0;
@@ -474,18 +529,16 @@ bool FaceData::Open(FT_Library ft, const FontFamily &family) {
   } else if (by_name) {
     if (kShouldMapFontByName) {
       p = OpenFontByName(font_name, 0, &size);
-      if (!p) {
-        LogError("Can't load font resource: %s\n", font_name);
-        return false;
-      }
+    }
+    if (p) {
       mapped_data_ = p;
       font_size_ = size;
     } else {
+      // The cache is not available. Convert the font in memory.
       if (!OpenFontByName(font_name, &font_data_)) {
         LogError("Can't load font resource: %s\n", font_name);
         return false;
       }
-      p = font_data_.c_str();
       font_size_ = font_data_.size();
     }
   } else {
@@ -494,29 +547,95 @@ bool FaceData::Open(FT_Library ft, const FontFamily &family) {
       // Fallback to open the specified font as a font name.
       return false;
     }
-    p = font_data_.c_str();
     font_size_ = font_data_.size();
   }
-  // Open the font using FreeType API.
-  FT_Error err =
-      FT_New_Memory_Face(ft, reinterpret_cast<const unsigned char *>(p),
-                         static_cast<FT_Long>(get_font_size()), index, &face_);
+  return true;
+}
+
+bool FaceData::LoadCoverage(FT_Library ft, const FontFamily &family) {
+  FT_Face face = nullptr;
+  FT_Error err = FT_New_Memory_Face(
+      ft, static_cast<const unsigned char *>(get_font_data()),
+      static_cast<FT_Long>(get_font_size()), GetFaceIndex(family), &face);
+  if (err) {
+    LogError("Failed to initialize font:%s FT_Error:%d\n",
+             family.get_name().c_str(), err);
+    return false;
+  }
+  coverage_.Clear();
+  BuildCoverage(face, &coverage_);
+  FT_Done_Face(face);
+  return true;
+}
+
+bool FaceData::LoadCmap(const FontFamily &family) {
+  auto index = GetFaceIndex(family);
+  coverage_.Clear();
+
+  // Pages of the mapped file other than the table directory and the cmap
+  // table are never read.
+  auto ret = false;
+  auto size = 0;
+  auto p = fplbase::MapFile(family.get_original_name().c_str(), 0, &size);
+  if (p) {
+    ret = coverage_.InsertFontCmap(p, size, index);
+    fplbase::UnmapFile(p, size);
+  } else if (family.is_family_name()) {
+    std::string cmap;
+    ret = OpenCmapByName(family.get_name().c_str(), &cmap) &&
+          coverage_.InsertCmap(cmap.c_str(), cmap.size());
+  }
+  if (!ret) {
+    coverage_.Clear();
+    return false;
+  }
+  face_index_ = index;
+  font_id_ = HashId(family.get_name().c_str());
+  return true;
+}
+
+// Counter of face loads, giving each load a unique ID.
+static std::atomic<uint32_t> load_counter(0);
+
+bool FaceData::Initialize(FT_Library ft, const FontFamily &family) {
+  const char *font_name = family.is_font_collection()
+                              ? family.get_original_name().c_str()
+                              : family.get_name().c_str();
+  auto index = GetFaceIndex(family);
+  auto p = get_font_data();
+  face_index_ = index;
+
+  // Open the font using FreeType API, and create harfbuzz font information
+  // from the FreeType face.
+  auto err = instance_.Open(ft, *this);
   if (err) {
     // Failed to open font.
     LogError("Failed to initialize font:%s FT_Error:%d\n", font_name, err);
     return false;
   }
+  load_id_ = ++load_counter;
 
-  // Create harfbuzz font information from the FreeType face.
-  harfbuzz_font_ = hb_ft_font_create(face_, NULL);
-  if (!harfbuzz_font_) {
-    Close();
-    return false;
+  // Record the codepoints covered by the face, so that fallback faces can be
+  // looked up without querying the cmap of each face. The coverage is kept
+  // when the face is unloaded.
+  if (coverage_.empty()) {
+    BuildCoverage(instance_.get_face(), &coverage_);
   }
 
   // Set up parameters.
   font_id_ = HashId(family.get_name().c_str());
 
+  // Identify the font contents with the head of the file, which includes the
+  // table directory with checksums of all tables, the file size and the face
+  // index.
+  const int32_t kFontHashLength = 4096;
+  font_hash_ = HashId(static_cast<const char *>(p),
+                      std::min(font_size_, kFontHashLength));
+  font_hash_ = HashId(reinterpret_cast<const char *>(&font_size_),
+                      sizeof(font_size_), font_hash_);
+  font_hash_ =
+      HashId(reinterpret_cast<const char *>(&index), sizeof(index), font_hash_);
+
   return true;
 }
 
@@ -526,36 +645,382 @@ void FaceData::Close() {
     return;
   }
 
+  Unload();
+  coverage_.Clear();
+}
+
+void FaceData::Unload() {
   // Remove the font data associated to this face data.
+  instance_.Close();
+  if (mapped_data_) {
+    fplbase::UnmapFile(mapped_data_, font_size_);
+    mapped_data_ = nullptr;
+  } else {
+    // Release the memory too, not only the contents.
+    std::string().swap(font_data_);
+  }
+}
+
+FaceInstance *FaceData::GetInstance() const {
+  auto instances = FaceInstances::GetSelected();
+  return instances != nullptr ? instances->Get(*this) : &instance_;
+}
+
+FaceInstance::FaceInstance()
+    : face_(nullptr),
+      harfbuzz_font_(nullptr),
+      scale_(1 << kHbFixedPointPrecision),
+      current_size_(0) {}
+
+FaceInstance::~FaceInstance() { Close(); }
+
+int32_t FaceInstance::Open(FT_Library ft, const FaceData &face) {
+  Close();
+  FT_Error err = FT_New_Memory_Face(
+      ft, static_cast<const unsigned char *>(face.get_font_data()),
+      static_cast<FT_Long>(face.get_font_size()), face.get_face_index(),
+      &face_);
+  if (err) {
+    face_ = nullptr;
+    return err;
+  }
+  harfbuzz_font_ = hb_ft_font_create(face_, NULL);
+  if (!harfbuzz_font_) {
+    Close();
+    return FT_Err_Out_Of_Memory;
+  }
+  return 0;
+}
+
+void FaceInstance::Close() {
   if (harfbuzz_font_) {
     hb_font_destroy(harfbuzz_font_);
     harfbuzz_font_ = nullptr;
   }
-
   if (face_) {
     FT_Done_Face(face_);
     face_ = nullptr;
   }
-  if (mapped_data_) {
-    fplbase::UnmapFile(mapped_data_, font_size_);
-    mapped_data_ = nullptr;
-  } else {
-    font_data_.clear();
+
+  // A reopened face needs its size to be set again.
+  current_size_ = 0;
+  scale_ = 1 << kHbFixedPointPrecision;
+  simple_glyphs_.reset();
+}
+
+SimpleGlyphTable *FaceInstance::GetSimpleGlyphTable() {
+  if (!simple_glyphs_ && face_ != nullptr && harfbuzz_font_ != nullptr) {
+    simple_glyphs_.reset(new SimpleGlyphTable());
+    simple_glyphs_->Initialize(face_, harfbuzz_font_);
   }
+  return simple_glyphs_.get();
 }
 
-void FaceData::SetSize(uint32_t size) {
+void FaceInstance::SetSize(uint32_t size) {
   assert(size);
   if (current_size_ == size) return;
 
-  FT_Set_Pixel_Sizes(get_face(), 0, size);
-  if (!FT_IS_SCALABLE(get_face())) {
+  FT_Set_Pixel_Sizes(face_, 0, size);
+  if (!FT_IS_SCALABLE(face_)) {
     // TODO:Choose the closest size if multiple sizes are available.
-    auto available_size = get_face()->available_sizes[0].height;
-    set_scale((static_cast<uint64_t>(size) << kHbFixedPointPrecision) /
-              available_size);
+    auto available_size = face_->available_sizes[0].height;
+    scale_ = (static_cast<uint64_t>(size) << kHbFixedPointPrecision) /
+             available_size;
   }
   current_size_ = size;
 }
 
+// FaceInstances used by layouts in the calling thread.
+static thread_local FaceInstances *selected_instances = nullptr;
+
+FaceInstances::FaceInstances() : ft_(nullptr) {}
+
+FaceInstances::~FaceInstances() { Clear(); }
+
+FaceInstances *FaceInstances::Select(FaceInstances *instances) {
+  auto previous = selected_instances;
+  selected_instances = instances;
+  return previous;
+}
+
+FaceInstances *FaceInstances::GetSelected() { return selected_instances; }
+
+FaceInstance *FaceInstances::Get(const FaceData &face) {
+  auto it = faces_.find(&face);
+  if (it != faces_.end() && it->second.load_id == face.get_load_id()) {
+    return it->second.instance.get();
+  }
+  if (!face.is_loaded()) {
+    return &face.instance_;
+  }
+  if (ft_ == nullptr) {
+    FT_Error err = FT_Init_FreeType(&ft_);
+    if (err) {
+      LogError("Can't initialize freetype. FT_Error:%d\n", err);
+      ft_ = nullptr;
+      return &face.instance_;
+    }
+  }
+
+  // Open the face, or open it again when the FaceData has been reloaded.
+  // FreeType doesn't read the font data to close the face of the previous
+  // load, so it's closed here even if the data has been released.
+  auto &entry = faces_[&face];
+  if (!entry.instance) {
+    entry.instance.reset(new FaceInstance());
+  }
+  auto err = entry.instance->Open(ft_, face);
+  if (err) {
+    LogError("Failed to open an instance of a font face. FT_Error:%d\n", err);
+    faces_.erase(&face);
+    return &face.instance_;
+  }
+  entry.load_id = face.get_load_id();
+  return entry.instance.get();
+}
+
+HbComplexFont::State *FaceInstances::GetState(const HbComplexFont &font) {
+  auto &state = fonts_[&font];
+  // Reset the state of a font opened again at the same address.
+  if (state.font_id != font.GetFontId()) {
+    state = HbComplexFont::State();
+    state.font_id = font.GetFontId();
+  }
+  return &state;
+}
+
+void FaceInstances::Release(const FaceData &face) { faces_.erase(&face); }
+
+void FaceInstances::Clear() {
+  faces_.clear();
+  fonts_.clear();
+  if (ft_ != nullptr) {
+    FT_Done_FreeType(ft_);
+    ft_ = nullptr;
+  }
+}
+
+size_t FaceInstances::GetMemorySize() const {
+  auto size = sizeof(*this) +
+              faces_.size() * (sizeof(*faces_.begin()) + sizeof(FaceInstance)) +
+              fonts_.size() * sizeof(*fonts_.begin());
+  for (auto it = faces_.begin(); it != faces_.end(); ++it) {
+    size += it->second.instance->get_simple_glyph_table_size();
+  }
+  return size;
+}
+
+// A position of SimpleGlyphTable not looked up yet, or of a pair needing
+// shaping.
+static const hb_position_t kUnknownPosition =
+    std::numeric_limits<hb_position_t>::min();
+
+// Max # of kerning pairs kept in a SimpleGlyphTable.
+static const size_t kMaxSimpleKerningPairs = 4096;
+
+static uint32_t MakePairKey(uint32_t size, uint32_t left, uint32_t right) {
+  return size << 16 | left << 8 | right;
+}
+
+// Add glyphs of lookups of the features to the set.
+static void CollectLookupGlyphs(hb_face_t *face, hb_tag_t table,
+                                const hb_tag_t *features, hb_set_t *lookups,
+                                hb_set_t *glyphs) {
+  hb_set_clear(lookups);
+  hb_ot_layout_collect_lookups(face, table, nullptr, nullptr, features,
+                               lookups);
+  hb_codepoint_t index = HB_SET_VALUE_INVALID;
+  while (hb_set_next(lookups, &index)) {
+    hb_ot_layout_lookup_collect_glyphs(face, table, index, glyphs, glyphs,
+                                       glyphs, nullptr);
+  }
+}
+
+// Decode a Latin-1 code point from UTF-8 text.
+static bool DecodeLatin1(const char *text, size_t length, size_t *index,
+                         uint32_t *code_point) {
+  auto c = static_cast<uint8_t>(text[*index]);
+  if (c < 0x80) {
+    *code_point = c;
+    *index += 1;
+    return true;
+  }
+  if ((c == 0xc2 || c == 0xc3) && *index + 1 < length) {
+    auto c2 = static_cast<uint8_t>(text[*index + 1]);
+    if ((c2 & 0xc0) == 0x80) {
+      *code_point = (c & 0x1f) << 6 | (c2 & 0x3f);
+      *index += 2;
+      return true;
+    }
+  }
+  return false;
+}
+
+SimpleGlyphTable::SimpleGlyphTable()
+    : kerning_(false), pair_buffer_(hb_buffer_create()) {
+  memset(glyphs_, 0, sizeof(glyphs_));
+}
+
+SimpleGlyphTable::~SimpleGlyphTable() { hb_buffer_destroy(pair_buffer_); }
+
+void SimpleGlyphTable::Initialize(FT_Face face, hb_font_t *font) {
+  // Lookups of features HarfBuzz applies by default to left-to-right runs
+  // of simple scripts, other than kerning, in any script and language.
+  static const hb_tag_t kSubstitutionFeatures[] = {
+      HB_TAG('c', 'c', 'm', 'p'), HB_TAG('l', 'o', 'c', 'l'),
+      HB_TAG('r', 'v', 'r', 'n'), HB_TAG('r', 'l', 'i', 'g'),
+      HB_TAG('r', 'c', 'l', 't'), HB_TAG('c', 'a', 'l', 't'),
+      HB_TAG('c', 'l', 'i', 'g'), HB_TAG('l', 'i', 'g', 'a'),
+      HB_TAG('l', 't', 'r', 'a'), HB_TAG('l', 't', 'r', 'm'),
+      HB_TAG_NONE};
+  static const hb_tag_t kPositioningFeatures[] = {
+      HB_TAG('m', 'a', 'r', 'k'), HB_TAG('m', 'k', 'm', 'k'),
+      HB_TAG('c', 'u', 'r', 's'), HB_TAG('d', 'i', 's', 't'),
+      HB_TAG('a', 'b', 'v', 'm'), HB_TAG('b', 'l', 'w', 'm'),
+      HB_TAG_NONE};
+  auto hb_face = hb_font_get_face(font);
+  auto lookups = hb_set_create();
+  auto shaped_glyphs = hb_set_create();
+  CollectLookupGlyphs(hb_face, HB_OT_TAG_GSUB, kSubstitutionFeatures, lookups,
+                      shaped_glyphs);
+  CollectLookupGlyphs(hb_face, HB_OT_TAG_GPOS, kPositioningFeatures, lookups,
+                      shaped_glyphs);
+
+  for (uint32_t i = 0; i < kNumCodePoints; ++i) {
+    glyphs_[i] = 0;
+    // Control characters and the soft hyphen need shaping.
+    if (i < 0x20 || (i >= 0x7f && i < 0xa0) || i == 0xad) {
+      continue;
+    }
+    auto glyph = FT_Get_Char_Index(face, i);
+    if (glyph && !hb_set_has(shaped_glyphs, glyph)) {
+      glyphs_[i] = glyph;
+    }
+  }
+  hb_set_destroy(shaped_glyphs);
+  hb_set_destroy(lookups);
+
+  // Pairs are kerned with GPOS lookups, or the legacy kern table.
+  kerning_ = hb_ot_layout_has_positioning(hb_face) || FT_HAS_KERNING(face);
+  advances_.clear();
+  kerning_pairs_.clear();
+}
+
+hb_position_t SimpleGlyphTable::GetAdvance(hb_font_t *font, uint32_t size,
+                                           uint32_t code_point) {
+  auto &advances = advances_[size];
+  if (advances.empty()) {
+    advances.resize(kNumCodePoints, kUnknownPosition);
+  }
+  auto &advance = advances[code_point];
+  if (advance == kUnknownPosition) {
+    advance = hb_font_get_glyph_h_advance(font, glyphs_[code_point]);
+  }
+  return advance;
+}
+
+bool SimpleGlyphTable::GetKerning(hb_font_t *font, hb_buffer_t *buffer,
+                                  uint32_t size, uint32_t left,
+                                  uint32_t right, hb_position_t *kerning) {
+  if (!kerning_) {
+    *kerning = 0;
+    return true;
+  }
+
+  auto key = MakePairKey(size, left, right);
+  auto it = kerning_pairs_.find(key);
+  if (it == kerning_pairs_.end()) {
+    // Shape the pair, and take its kerning if HarfBuzz only adjusted the
+    // advance of the left glyph.
+    hb_segment_properties_t properties;
+    hb_buffer_get_segment_properties(buffer, &properties);
+    hb_buffer_clear_contents(pair_buffer_);
+    hb_buffer_set_segment_properties(pair_buffer_, &properties);
+    const uint32_t pair[] = {left, right};
+    hb_buffer_add_utf32(pair_buffer_, pair, 2, 0, 2);
+    hb_shape(font, pair_buffer_, nullptr, 0);
+
+    uint32_t count;
+    auto infos = hb_buffer_get_glyph_infos(pair_buffer_, &count);
+    auto positions = hb_buffer_get_glyph_positions(pair_buffer_, &count);
+    auto value = kUnknownPosition;
+    if (count == 2 && infos[0].codepoint == glyphs_[left] &&
+        infos[1].codepoint == glyphs_[right] && !positions[0].x_offset &&
+        !positions[0].y_offset && !positions[0].y_advance &&
+        !positions[1].x_offset && !positions[1].y_offset &&
+        !positions[1].y_advance &&
+        positions[1].x_advance == GetAdvance(font, size, right)) {
+      value = positions[0].x_advance - GetAdvance(font, size, left);
+    }
+
+    if (kerning_pairs_.size() >= kMaxSimpleKerningPairs) {
+      kerning_pairs_.clear();
+    }
+    it = kerning_pairs_.insert(std::make_pair(key, value)).first;
+  }
+  *kerning = it->second;
+  return it->second != kUnknownPosition;
+}
+
+size_t SimpleGlyphTable::GetMemorySize() const {
+  return sizeof(*this) +
+         advances_.size() * (sizeof(*advances_.begin()) +
+                             kNumCodePoints * sizeof(hb_position_t)) +
+         kerning_pairs_.size() * sizeof(*kerning_pairs_.begin());
+}
+
+bool HbFont::LayoutSimpleRun(const char *text, size_t length,
+                             hb_buffer_t *buffer) {
+  auto instance = GetFaceData().GetInstance();
+  auto table = instance->GetSimpleGlyphTable();
+  if (table == nullptr || !length) {
+    return false;
+  }
+  auto font = instance->get_hb_font();
+  auto size = instance->GetSize();
+
+  // Check the code points and the pairs of the run, and count its glyphs.
+  uint32_t count = 0;
+  uint32_t code_point = 0;
+  uint32_t previous = 0;
+  hb_position_t kerning;
+  for (size_t i = 0; i < length; ++count) {
+    if (!DecodeLatin1(text, length, &i, &code_point) ||
+        !table->GetGlyph(code_point) ||
+        (count && !table->GetKerning(font, buffer, size, previous, code_point,
+                                     &kerning))) {
+      return false;
+    }
+    previous = code_point;
+  }
+
+  // Fill the buffer as hb_shape() would do.
+  hb_buffer_set_content_type(buffer, HB_BUFFER_CONTENT_TYPE_GLYPHS);
+  if (!hb_buffer_set_length(buffer, count)) {
+    hb_buffer_set_content_type(buffer, HB_BUFFER_CONTENT_TYPE_UNICODE);
+    return false;
+  }
+  uint32_t glyph_count;
+  auto infos = hb_buffer_get_glyph_infos(buffer, &glyph_count);
+  auto positions = hb_buffer_get_glyph_positions(buffer, &glyph_count);
+  size_t index = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    auto cluster = static_cast<uint32_t>(index);
+    DecodeLatin1(text, length, &index, &code_point);
+    infos[i].codepoint = table->GetGlyph(code_point);
+    infos[i].mask = 0;
+    infos[i].cluster = cluster;
+    positions[i].x_advance = table->GetAdvance(font, size, code_point);
+    positions[i].y_advance = 0;
+    positions[i].x_offset = 0;
+    positions[i].y_offset = 0;
+    if (i) {
+      table->GetKerning(font, buffer, size, previous, code_point, &kerning);
+      positions[i - 1].x_advance += kerning;
+    }
+    previous = code_point;
+  }
+  return true;
+}
+
 }  // namespace flatui
@@ -130,8 +130,8 @@ bool Hyphenator::Open(const char* hyb_name) {
       fplbase::LogError("Can't load hyphenation pattern: %s\n", hyb_name);
       return false;
     }
-    p = pattern_file_.c_str();
-    size_ = pattern_file_.size();
+    pattern_data_ = reinterpret_cast<const uint8_t*>(pattern_file_.c_str());
+    size_ = static_cast<int32_t>(pattern_file_.size());
   }
   return true;
 }
@@ -146,6 +146,7 @@ bool Hyphenator::Close() {
     pattern_data_ = nullptr;
   } else {
     pattern_file_.clear();
+    pattern_data_ = nullptr;
   }
   return true;
 }
@@ -153,11 +154,30 @@ bool Hyphenator::Close() {
 void Hyphenator::Hyphenate(const uint8_t* word, size_t len,
                            std::vector<uint8_t>* result) {
   result->clear();
+  AppendHyphenation(word, len, result);
+}
+
+void Hyphenator::HyphenateWords(const uint8_t* text,
+                                const std::vector<WordRange>& words,
+                                std::vector<uint8_t>* results,
+                                std::vector<size_t>* offsets) {
+  results->clear();
+  offsets->clear();
+  for (auto it = words.begin(); it != words.end(); ++it) {
+    offsets->push_back(results->size());
+    AppendHyphenation(text + it->start, it->length, results);
+  }
+  offsets->push_back(results->size());
+}
+
+void Hyphenator::AppendHyphenation(const uint8_t* word, size_t len,
+                                   std::vector<uint8_t>* result) {
   if (pattern_data_ != nullptr && len >= kMinPrefix + kMinSuffix) {
-    std::vector<uint16_t> alpha_codes;
-    if (AlphabetLookup(word, len, &alpha_codes)) {
-      result->resize(alpha_codes.size() - 2);
-      HyphenateFromCodes(alpha_codes, result);
+    alpha_codes_.clear();
+    if (AlphabetLookup(word, len, &alpha_codes_)) {
+      auto start = result->size();
+      result->resize(start + alpha_codes_.size() - 2, 0);
+      HyphenateFromCodes(alpha_codes_, result->data() + start);
       return;
     }
     // TODO: try NFC normalization
@@ -237,7 +257,7 @@ bool Hyphenator::AlphabetLookup(const uint8_t* word, size_t len,
  * Note: len here is the padded length including 0 codes at start and end.
  **/
 void Hyphenator::HyphenateFromCodes(const std::vector<uint16_t>& codes,
-                                    std::vector<uint8_t>* result) {
+                                    uint8_t* result) {
   const Header* header = GetHeader();
   const Trie* trie = header->trieTable();
   const Pattern* pattern = header->patternTable();
@@ -275,7 +295,7 @@ void Hyphenator::HyphenateFromCodes(const std::vector<uint16_t>& codes,
         auto start = std::max(kMinPrefix - offset, 0);
         auto end = std::min(pat_len, static_cast<int32_t>(maxOffset) - offset);
         for (auto k = start; k < end; k++) {
-          result->at(offset + k) = std::max(result->at(offset + k), pat_buf[k]);
+          result[offset + k] = std::max(result[offset + k], pat_buf[k]);
         }
       }
     }
@@ -284,8 +304,71 @@ void Hyphenator::HyphenateFromCodes(const std::vector<uint16_t>& codes,
   // Since the above calculation does not modify values outside
   // [kMinPrefix, len - kMinSuffix], they are left as 0.
   for (size_t i = kMinPrefix; i < maxOffset; i++) {
-    result->at(i) &= 1;
+    result[i] &= 1;
+  }
+}
+
+bool HyphenationCache::Restore(const char* word, size_t length,
+                               const std::string& language,
+                               std::vector<uint8_t>* result) {
+  auto it = map_entries_.find(GetKey(word, length, language));
+  if (it == map_entries_.end()) {
+    return false;
+  }
+  auto& entry = *it->second;
+  if (entry.language != language || entry.word.size() != length ||
+      memcmp(entry.word.data(), word, length)) {
+    return false;
+  }
+
+  // Mark the entry as most recently used.
+  lru_entries_.splice(lru_entries_.begin(), lru_entries_, it->second);
+  result->assign(entry.result.begin(), entry.result.end());
+  return true;
+}
+
+void HyphenationCache::Store(const char* word, size_t length,
+                             const std::string& language,
+                             const uint8_t* result, size_t count) {
+  if (capacity_ == 0) {
+    return;
+  }
+
+  auto key = GetKey(word, length, language);
+  auto it = map_entries_.find(key);
+  if (it != map_entries_.end()) {
+    // Replace an entry whose word collided with the key.
+    lru_entries_.erase(it->second);
+    map_entries_.erase(it);
+  } else if (lru_entries_.size() >= capacity_) {
+    map_entries_.erase(lru_entries_.back().key);
+    lru_entries_.pop_back();
+  }
+
+  lru_entries_.push_front(Entry());
+  auto& entry = lru_entries_.front();
+  entry.key = key;
+  entry.word.assign(word, length);
+  entry.language = language;
+  entry.result.assign(result, result + count);
+  map_entries_[key] = lru_entries_.begin();
+}
+
+void HyphenationCache::set_capacity(size_t capacity) {
+  capacity_ = capacity;
+  while (lru_entries_.size() > capacity_) {
+    map_entries_.erase(lru_entries_.back().key);
+    lru_entries_.pop_back();
+  }
+}
+
+size_t HyphenationCache::GetMemorySize() const {
+  size_t size = 0;
+  for (auto it = lru_entries_.begin(); it != lru_entries_.end(); ++it) {
+    size += sizeof(*it) + it->word.capacity() + it->language.capacity() +
+            it->result.capacity();
   }
+  return size;
 }
 
 }  // namespace flatui
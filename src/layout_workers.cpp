@@ -0,0 +1,86 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "precompiled.h"
+
+#include "internal/layout_workers.h"
+
+namespace flatui {
+
+LayoutWorkers::LayoutWorkers(int32_t num_workers)
+    : task_(nullptr), count_(0), next_(0), busy_(0), terminate_(false) {
+  for (int32_t i = 0; i < num_workers; ++i) {
+    threads_.push_back(std::thread(&LayoutWorkers::Work, this));
+  }
+}
+
+LayoutWorkers::~LayoutWorkers() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    terminate_ = true;
+  }
+  task_condition_.notify_all();
+
+  for (auto &thread : threads_) {
+    thread.join();
+  }
+}
+
+void LayoutWorkers::Run(size_t count,
+                        const std::function<void(size_t)> &task) {
+  std::lock_guard<std::mutex> run_lock(run_mutex_);
+  std::unique_lock<std::mutex> lock(mutex_);
+  task_ = &task;
+  count_ = count;
+  next_ = 0;
+  task_condition_.notify_all();
+
+  // The calling thread takes tasks too, instead of just waiting.
+  RunTasks(&lock);
+  idle_condition_.wait(lock, [this] { return !busy_; });
+  task_ = nullptr;
+  count_ = 0;
+  next_ = 0;
+}
+
+void LayoutWorkers::Work() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    task_condition_.wait(lock,
+                         [this] { return terminate_ || next_ < count_; });
+    if (terminate_) {
+      break;
+    }
+    RunTasks(&lock);
+  }
+}
+
+void LayoutWorkers::RunTasks(std::unique_lock<std::mutex> *lock) {
+  while (next_ < count_) {
+    auto index = next_++;
+    auto task = task_;
+    busy_++;
+
+    // Run the task without holding the lock.
+    lock->unlock();
+    (*task)(index);
+    lock->lock();
+
+    busy_--;
+    if (next_ >= count_ && !busy_) {
+      idle_condition_.notify_all();
+    }
+  }
+}
+
+}  // namespace flatui
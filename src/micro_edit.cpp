@@ -14,6 +14,7 @@
 
 #include "precompiled.h"
 #include "flatui/flatui.h"
+#include "flatui/internal/decoded_text.h"
 #include "flatui/internal/micro_edit.h"
 #include "linebreak.h"
 
@@ -40,47 +41,81 @@ void MicroEdit::Initialize(std::string *text, EditorMode mode) {
 }
 
 void MicroEdit::UpdateWordBreakInfo() {
-  if (!text_->length()) {
-    num_characters_ = 0;
-    wordbreak_index_ = 0;
-    return;
-  }
-
-  wordbreak_info_.resize(text_->length());
-  set_linebreaks_utf8(reinterpret_cast<const utf8_t *>(text_->c_str()),
-                      text_->length(), language_.c_str(), &wordbreak_info_[0]);
+  wordbreak_info_.clear();
+  character_offsets_.clear();
+  UpdateWordBreakInfo(0, 0, text_->length());
+}
 
-  // Count number of characters.
-  auto num_characters = 1;
-  for (size_t i = 1; i < wordbreak_info_.size(); ++i) {
-    if (wordbreak_info_[i - 1] != LINEBREAK_INSIDEACHAR) {
-      num_characters++;
+void MicroEdit::UpdateWordBreakInfo(size_t start, size_t removed,
+                                    size_t inserted) {
+  // Line breaking doesn't look across mandatory breaks, so re-run libunibreak
+  // from the head of the paragraph including the character before the edit,
+  // to the end of the paragraph including the character after it.
+  auto old_length = wordbreak_info_.size();
+  size_t begin = 0;
+  for (auto i = std::min(start, old_length); i > 1; --i) {
+    if (wordbreak_info_[i - 2] == LINEBREAK_MUSTBREAK) {
+      begin = i - 1;
+      break;
+    }
+  }
+  auto old_end = old_length;
+  for (auto i = start + removed; i < old_length; ++i) {
+    if (wordbreak_info_[i] == LINEBREAK_MUSTBREAK) {
+      old_end = i + 1;
+      break;
     }
   }
-  num_characters_ = num_characters;
+  auto new_end = old_end - removed + inserted;
+
+  // Update the word breaking info of the paragraph.
+  std::vector<char> info(new_end - begin);
+  if (!info.empty()) {
+    set_linebreaks_utf8(
+        reinterpret_cast<const utf8_t *>(text_->c_str() + begin), info.size(),
+        language_.c_str(), &info[0]);
+  }
+  wordbreak_info_.erase(wordbreak_info_.begin() + begin,
+                        wordbreak_info_.begin() + old_end);
+  wordbreak_info_.insert(wordbreak_info_.begin() + begin, info.begin(),
+                         info.end());
+
+  // Update offsets of characters in the paragraph, and shift the following
+  // ones.
+  auto first = std::lower_bound(character_offsets_.begin(),
+                                character_offsets_.end(),
+                                static_cast<int32_t>(begin));
+  auto last = std::lower_bound(first, character_offsets_.end(),
+                               static_cast<int32_t>(old_end));
+  auto delta = static_cast<int32_t>(inserted) - static_cast<int32_t>(removed);
+  for (auto it = last; it != character_offsets_.end(); ++it) {
+    *it += delta;
+  }
+  std::vector<int32_t> offsets;
+  for (size_t i = 0; i < info.size(); ++i) {
+    if (!i || info[i - 1] != LINEBREAK_INSIDEACHAR) {
+      offsets.push_back(static_cast<int32_t>(begin + i));
+    }
+  }
+  first = character_offsets_.erase(first, last);
+  character_offsets_.insert(first, offsets.begin(), offsets.end());
 
+  num_characters_ = static_cast<int32_t>(character_offsets_.size());
   UpdateWordBreakIndex();
 }
 
+int32_t MicroEdit::GetCharacterIndex(size_t offset) const {
+  return static_cast<int32_t>(
+      std::lower_bound(character_offsets_.begin(), character_offsets_.end(),
+                       static_cast<int32_t>(offset)) -
+      character_offsets_.begin());
+}
+
 void MicroEdit::UpdateWordBreakIndex() {
-  // TODO: Update for a better look up rather than a linear search.
-  // Check for the last caret position.
-  if (caret_pos_ == num_characters_) {
+  if (caret_pos_ >= num_characters_) {
     wordbreak_index_ = static_cast<int32_t>(wordbreak_info_.size());
-    return;
-  }
-
-  wordbreak_index_ = 0;
-  auto current_pos = 1;
-  for (size_t i = 1; i < wordbreak_info_.size(); ++i) {
-    if (wordbreak_info_[i - 1] != LINEBREAK_INSIDEACHAR) {
-      if (caret_pos_ == current_pos) {
-        // Update an index of wordbreak info for the current caret position.
-        wordbreak_index_ = static_cast<int32_t>(i);
-        break;
-      }
-      current_pos++;
-    }
+  } else {
+    wordbreak_index_ = character_offsets_[caret_pos_];
   }
 }
 
@@ -102,19 +137,19 @@ bool MicroEdit::MoveCaretVertical(int32_t offset) {
 }
 
 bool MicroEdit::MoveCaretInLine(CaretPosition position) {
-  // Pick current row.
-  auto start_of_line = buffer_->GetCaretPositions().begin();
-  auto end_of_line = buffer_->GetCaretPositions().end();
-  auto pos = buffer_->GetCaretPositions()[GetCaretPosition()];
-  PickRow(pos, &start_of_line, &end_of_line);
+  if (buffer_ == nullptr) return false;
+  // Look up current row.
+  auto row = buffer_->FindCaretLine(GetCaretPosition());
+  if (row < 0) return false;
+  auto &line = buffer_->GetCaretLines()[row];
 
-  ptrdiff_t index = 0;
+  int32_t index = 0;
   if (position == kTailOfLine) {
-    index = std::distance(buffer_->GetCaretPositions().begin(), end_of_line);
+    index = static_cast<int32_t>(line.end) - 1;
   } else if (position == kHeadOfLine) {
-    index = std::distance(buffer_->GetCaretPositions().begin(), start_of_line);
+    index = static_cast<int32_t>(line.start);
   }
-  return SetCaret(static_cast<int32_t>(index));
+  return SetCaret(index);
 }
 
 bool MicroEdit::MoveCaretToWordBoundary(bool forward) {
@@ -186,28 +221,24 @@ bool MicroEdit::ShowCaret(float delta_time) {
 
 void MicroEdit::InsertText(const std::string &text) {
   caret_timer_ = 0.0f;
-  text_->insert(wordbreak_index_, text);
-  caret_pos_ += GetNumCharacters(text);
+  size_t start = wordbreak_index_;
+  text_->insert(start, text);
   expected_caret_x_position_ = kCaretPosInvalid;
-  UpdateWordBreakInfo();
+  UpdateWordBreakInfo(start, 0, text.length());
+  // Move the caret after the inserted text.
+  caret_pos_ = GetCharacterIndex(start + text.length());
+  UpdateWordBreakIndex();
 }
 
 void MicroEdit::RemoveText(int32_t num_remove) {
   caret_timer_ = 0.0f;
-  for (auto i = 0; i < num_remove; ++i) {
-    // Remove 1 character from the buffer.
-    auto num_to_erase = 1;
-    auto erase_index = wordbreak_index_;
-    while (erase_index < static_cast<int32_t>(text_->size()) &&
-           wordbreak_info_[erase_index++] == LINEBREAK_INSIDEACHAR) {
-      num_to_erase++;
-    };
-    text_->erase(wordbreak_index_, num_to_erase);
-    wordbreak_info_.erase(
-        wordbreak_info_.begin() + wordbreak_index_,
-        wordbreak_info_.begin() + wordbreak_index_ + num_to_erase);
-  }
-  UpdateWordBreakInfo();
+  auto end_pos = std::min(caret_pos_ + num_remove, num_characters_);
+  size_t start = wordbreak_index_;
+  size_t end = end_pos < num_characters_ ? character_offsets_[end_pos]
+                                         : text_->length();
+  if (end <= start) return;
+  text_->erase(start, end - start);
+  UpdateWordBreakInfo(start, end - start, 0);
 }
 
 int32_t MicroEdit::GetNumCharacters(const std::string &text) {
@@ -215,7 +246,12 @@ int32_t MicroEdit::GetNumCharacters(const std::string &text) {
   if (!text.length()) {
     return 0;
   }
+  size_t count;
+  if (CountCodepoints(text.c_str(), text.length(), &count)) {
+    return static_cast<int32_t>(count);
+  }
 
+  // Count characters the way libunibreak decodes a malformed text.
   std::vector<char> v(text.length());
   set_linebreaks_utf8(reinterpret_cast<const utf8_t *>(text.c_str()),
                       text.length(), language_.c_str(), &v[0]);
@@ -330,49 +366,48 @@ int32_t MicroEdit::Pick(const vec2i &pointer_position, float offset) {
     return kCaretPosInvalid;
   }
 
+  auto &lines = buffer_->GetCaretLines();
+  if (lines.empty()) {
+    return kCaretPosInvalid;
+  }
+
   // Pick a row first.
-  auto start_it = buffer_->GetCaretPositions().begin();
-  auto end_it = buffer_->GetCaretPositions().end();
-  auto buffer_begin = start_it;
-  auto buffer_end = end_it;
-  PickRow(pointer_position, &start_it, &end_it);
+  auto num_rows = static_cast<int32_t>(lines.size());
+  auto row = PickRow(pointer_position);
 
   // Pick previous/next row based on the offset value.
   if (offset < 0) {
-    if (start_it == buffer_begin) {
+    if (row == 0) {
       return kCaretPosInvalid;
     }
-    end_it = start_it - 1;
-    start_it = buffer_begin;
-    PickRow(*end_it, &start_it, &end_it);
+    row--;
   } else if (offset > 0) {
-    if (end_it == buffer_end - 1) {
+    if (row + 1 >= num_rows) {
       return kCaretPosInvalid;
     }
-    start_it = end_it + 1;
-    end_it = buffer_end - 1;
-    PickRow(*start_it, &start_it, &end_it);
+    row++;
+  } else if (row == num_rows) {
+    // Pick the last row for a pointer below the text.
+    row--;
   }
 
   // And pick a column.
-  return PickColumn(pointer_position, start_it, end_it);
+  return PickColumn(pointer_position, lines[row]);
 }
 
-void MicroEdit::PickRow(const vec2i &pointer_position,
-                        std::vector<vec2i>::const_iterator *start_it,
-                        std::vector<vec2i>::const_iterator *end_it) {
-  // Perform a binary search in the caret position buffer.
-  auto compare = [](const vec2i &lhs, const vec2i &rhs) {
-    return lhs.y < rhs.y;
-  };
-  *start_it = std::lower_bound(*start_it, *end_it, pointer_position, compare);
-  if (*start_it < *end_it)
-    *end_it = std::upper_bound(*start_it, *end_it, **start_it, compare) - 1;
+int32_t MicroEdit::PickRow(const vec2i &pointer_position) {
+  auto &lines = buffer_->GetCaretLines();
+  auto it = std::lower_bound(lines.begin(), lines.end(), pointer_position.y,
+                             [](const CaretLine &line, int32_t y) {
+                               return line.max_y < y;
+                             });
+  return static_cast<int32_t>(it - lines.begin());
 }
 
 int32_t MicroEdit::PickColumn(const vec2i &pointer_position,
-                              std::vector<vec2i>::const_iterator start_it,
-                              std::vector<vec2i>::const_iterator end_it) {
+                              const CaretLine &line) {
+  auto start_it = buffer_->GetCaretPositions().begin() + line.start;
+  auto end_it = buffer_->GetCaretPositions().begin() + line.end - 1;
   auto compare = [this](const vec2i &lhs, const vec2i &rhs) -> bool {
     if (direction_ == kTextLayoutDirectionRTL) {
       return lhs.x > rhs.x;
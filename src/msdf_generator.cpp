@@ -0,0 +1,689 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "precompiled.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_OUTLINE_H
+
+#include "internal/msdf_generator.h"
+
+using mathfu::vec2;
+using mathfu::vec2i;
+
+namespace flatui {
+
+// Scale and bias of distances in the image, which match single channel SDF
+// glyphs generated by the distance computers.
+static const float kMsdfDistanceScale = 16.0f;
+static const float kMsdfDistanceBias = 127.5f;
+
+// Edges meeting at an angle where the sine of the angle between their
+// directions exceeds this (sin(3 rad)) are treated as a corner.
+static const float kMsdfCornerThreshold = 0.14112f;
+
+// Neighboring pixels whose two channels change more than this distance in
+// pixels are regarded as clashing.
+static const float kMsdfClashThreshold = 1.001f;
+
+// Parameters of the nearest point search on cubic curves.
+static const int32_t kCubicSearchStarts = 4;
+static const int32_t kCubicSearchSteps = 4;
+
+static float Cross(const vec2& a, const vec2& b) {
+  return a.x * b.y - a.y * b.x;
+}
+
+static float Dot(const vec2& a, const vec2& b) {
+  return vec2::DotProduct(a, b);
+}
+
+static float NonZeroSign(float value) { return value > 0.0f ? 1.0f : -1.0f; }
+
+static vec2 Normalize(const vec2& v) {
+  auto length = v.Length();
+  return length != 0.0f ? v / length : vec2(0.0f, 1.0f);
+}
+
+static vec2 Mix(const vec2& a, const vec2& b, float t) {
+  return a + (b - a) * t;
+}
+
+// Solve a x^2 + b x + c = 0. Returns # of solutions.
+static int32_t SolveQuadratic(double x[2], double a, double b, double c) {
+  if (a == 0.0 || fabs(b) > 1e12 * fabs(a)) {
+    if (b == 0.0) {
+      return 0;
+    }
+    x[0] = -c / b;
+    return 1;
+  }
+  auto discriminant = b * b - 4.0 * a * c;
+  if (discriminant > 0.0) {
+    discriminant = sqrt(discriminant);
+    x[0] = (-b + discriminant) / (2.0 * a);
+    x[1] = (-b - discriminant) / (2.0 * a);
+    return 2;
+  } else if (discriminant == 0.0) {
+    x[0] = -b / (2.0 * a);
+    return 1;
+  }
+  return 0;
+}
+
+// Solve x^3 + a x^2 + b x + c = 0. Returns # of solutions.
+static int32_t SolveNormalizedCubic(double x[3], double a, double b,
+                                    double c) {
+  const double kPi = 3.14159265358979323846;
+  auto a2 = a * a;
+  auto q = (a2 - 3.0 * b) / 9.0;
+  auto r = (a * (2.0 * a2 - 9.0 * b) + 27.0 * c) / 54.0;
+  auto r2 = r * r;
+  auto q3 = q * q * q;
+  a /= 3.0;
+  if (r2 < q3) {
+    auto t = acos(std::max(-1.0, std::min(1.0, r / sqrt(q3))));
+    q = -2.0 * sqrt(q);
+    x[0] = q * cos(t / 3.0) - a;
+    x[1] = q * cos((t + 2.0 * kPi) / 3.0) - a;
+    x[2] = q * cos((t - 2.0 * kPi) / 3.0) - a;
+    return 3;
+  }
+  auto u = (r < 0.0 ? 1.0 : -1.0) * pow(fabs(r) + sqrt(r2 - q3), 1.0 / 3.0);
+  auto v = u == 0.0 ? 0.0 : q / u;
+  x[0] = (u + v) - a;
+  if (u == v || fabs(u - v) < 1e-12 * fabs(u + v)) {
+    x[1] = -0.5 * (u + v) - a;
+    return 2;
+  }
+  return 1;
+}
+
+// Solve a x^3 + b x^2 + c x + d = 0. Returns # of solutions.
+static int32_t SolveCubic(double x[3], double a, double b, double c,
+                          double d) {
+  if (a != 0.0) {
+    auto bn = b / a;
+    // Above the ratio, the error is smaller when a is treated as 0.
+    if (fabs(bn) < 1e6) {
+      return SolveNormalizedCubic(x, bn, c / a, d / a);
+    }
+  }
+  return SolveQuadratic(x, b, c, d);
+}
+
+vec2 MsdfEdge::Point(float t) const {
+  switch (degree) {
+    case 1:
+      return Mix(points[0], points[1], t);
+    case 2:
+      return Mix(Mix(points[0], points[1], t), Mix(points[1], points[2], t),
+                 t);
+    default: {
+      auto p12 = Mix(points[1], points[2], t);
+      return Mix(Mix(Mix(points[0], points[1], t), p12, t),
+                 Mix(p12, Mix(points[2], points[3], t), t), t);
+    }
+  }
+}
+
+vec2 MsdfEdge::Direction(float t) const {
+  switch (degree) {
+    case 1:
+      return points[1] - points[0];
+    case 2: {
+      auto tangent = Mix(points[1] - points[0], points[2] - points[1], t);
+      if (tangent.x == 0.0f && tangent.y == 0.0f) {
+        return points[2] - points[0];
+      }
+      return tangent;
+    }
+    default: {
+      auto tangent = Mix(Mix(points[1] - points[0], points[2] - points[1], t),
+                         Mix(points[2] - points[1], points[3] - points[2], t),
+                         t);
+      if (tangent.x == 0.0f && tangent.y == 0.0f) {
+        if (t == 0.0f) return points[2] - points[0];
+        if (t == 1.0f) return points[3] - points[1];
+      }
+      return tangent;
+    }
+  }
+}
+
+MsdfEdge::Distance MsdfEdge::GetDistance(const vec2& p, float* param) const {
+  Distance ret;
+  if (degree == 1) {
+    auto aq = p - points[0];
+    auto ab = points[1] - points[0];
+    *param = Dot(aq, ab) / Dot(ab, ab);
+    auto eq = points[*param > 0.5f ? 1 : 0] - p;
+    auto endpoint_distance = eq.Length();
+    if (*param > 0.0f && *param < 1.0f) {
+      auto ortho_distance = Cross(aq, ab) / ab.Length();
+      if (fabsf(ortho_distance) < endpoint_distance) {
+        ret.distance = ortho_distance;
+        ret.dot = 0.0f;
+        return ret;
+      }
+    }
+    ret.distance = NonZeroSign(Cross(aq, ab)) * endpoint_distance;
+    ret.dot = fabsf(Dot(Normalize(ab), Normalize(eq)));
+    return ret;
+  }
+
+  // Start with the distances to the end points.
+  auto qa = points[0] - p;
+  auto end = points[degree];
+  auto dir = Direction(0.0f);
+  auto min_distance = NonZeroSign(Cross(dir, qa)) * qa.Length();
+  *param = -Dot(qa, dir) / Dot(dir, dir);
+  dir = Direction(1.0f);
+  auto distance = (end - p).Length();
+  if (distance < fabsf(min_distance)) {
+    min_distance = NonZeroSign(Cross(dir, end - p)) * distance;
+    *param = 1.0f + Dot(p - end, dir) / Dot(dir, dir);
+  }
+
+  auto ab = points[1] - points[0];
+  auto br = points[2] - points[1] - ab;
+  if (degree == 2) {
+    // The nearest point is where the derivative of the squared distance is 0,
+    // which is a root of a cubic equation.
+    double t[3];
+    auto solutions = SolveCubic(
+        t, Dot(br, br), 3.0 * Dot(ab, br), 2.0 * Dot(ab, ab) + Dot(qa, br),
+        Dot(qa, ab));
+    for (int32_t i = 0; i < solutions; ++i) {
+      auto ti = static_cast<float>(t[i]);
+      if (ti > 0.0f && ti < 1.0f) {
+        auto qe = qa + ab * (2.0f * ti) + br * (ti * ti);
+        distance = qe.Length();
+        if (distance <= fabsf(min_distance)) {
+          min_distance = NonZeroSign(Cross(ab + br * ti, qe)) * distance;
+          *param = ti;
+        }
+      }
+    }
+  } else {
+    // Search the nearest point with Newton's method from a few starts.
+    auto as = (points[3] - points[2]) - (points[2] - points[1]) - br;
+    for (int32_t i = 0; i <= kCubicSearchStarts; ++i) {
+      auto t = static_cast<float>(i) / kCubicSearchStarts;
+      auto qe = qa + ab * (3.0f * t) + br * (3.0f * t * t) + as * (t * t * t);
+      for (int32_t step = 0; step < kCubicSearchSteps; ++step) {
+        auto d1 = ab * 3.0f + br * (6.0f * t) + as * (3.0f * t * t);
+        auto d2 = br * 6.0f + as * (6.0f * t);
+        auto denominator = Dot(d1, d1) + Dot(qe, d2);
+        if (denominator == 0.0f) break;
+        t -= Dot(qe, d1) / denominator;
+        if (t <= 0.0f || t >= 1.0f) break;
+        qe = qa + ab * (3.0f * t) + br * (3.0f * t * t) + as * (t * t * t);
+        distance = qe.Length();
+        if (distance < fabsf(min_distance)) {
+          d1 = ab * 3.0f + br * (6.0f * t) + as * (3.0f * t * t);
+          min_distance = NonZeroSign(Cross(d1, qe)) * distance;
+          *param = t;
+        }
+      }
+    }
+  }
+
+  ret.distance = min_distance;
+  if (*param >= 0.0f && *param <= 1.0f) {
+    ret.dot = 0.0f;
+  } else if (*param < 0.5f) {
+    ret.dot = fabsf(Dot(Normalize(Direction(0.0f)), Normalize(qa)));
+  } else {
+    ret.dot = fabsf(Dot(Normalize(Direction(1.0f)), Normalize(end - p)));
+  }
+  return ret;
+}
+
+void MsdfEdge::ToPseudoDistance(const vec2& p, float param,
+                                Distance* distance) const {
+  if (param < 0.0f) {
+    auto dir = Normalize(Direction(0.0f));
+    auto aq = p - points[0];
+    if (Dot(aq, dir) < 0.0f) {
+      auto pseudo_distance = Cross(aq, dir);
+      if (fabsf(pseudo_distance) <= fabsf(distance->distance)) {
+        distance->distance = pseudo_distance;
+        distance->dot = 0.0f;
+      }
+    }
+  } else if (param > 1.0f) {
+    auto dir = Normalize(Direction(1.0f));
+    auto bq = p - points[degree];
+    if (Dot(bq, dir) > 0.0f) {
+      auto pseudo_distance = Cross(bq, dir);
+      if (fabsf(pseudo_distance) <= fabsf(distance->distance)) {
+        distance->distance = pseudo_distance;
+        distance->dot = 0.0f;
+      }
+    }
+  }
+}
+
+void MsdfEdge::Split(float t, MsdfEdge* first, MsdfEdge* second) const {
+  // de Casteljau's algorithm.
+  vec2 p[4];
+  for (int32_t i = 0; i <= degree; ++i) {
+    p[i] = points[i];
+  }
+  first->degree = second->degree = degree;
+  first->color = second->color = color;
+  first->points[0] = p[0];
+  second->points[degree] = p[degree];
+  for (int32_t k = 1; k <= degree; ++k) {
+    for (int32_t i = 0; i <= degree - k; ++i) {
+      p[i] = Mix(p[i], p[i + 1], t);
+    }
+    first->points[k] = p[0];
+    second->points[degree - k] = p[degree - k];
+  }
+}
+
+void MsdfGenerator::Clear() {
+  edges_.clear();
+  contours_.clear();
+  current_ = mathfu::kZeros2f;
+  colored_ = false;
+}
+
+void MsdfGenerator::CloseContour() {
+  if (contours_.empty() || contours_.back() == edges_.size()) {
+    return;
+  }
+  auto start = edges_[contours_.back()].points[0];
+  if (current_.x != start.x || current_.y != start.y) {
+    LineTo(start);
+  }
+}
+
+void MsdfGenerator::MoveTo(const vec2& p) {
+  CloseContour();
+  if (contours_.empty() || contours_.back() != edges_.size()) {
+    contours_.push_back(edges_.size());
+  }
+  current_ = p;
+}
+
+void MsdfGenerator::AddEdge(int32_t degree, const vec2* points) {
+  if (contours_.empty()) {
+    contours_.push_back(0);
+  }
+  MsdfEdge edge;
+  edge.degree = degree;
+  edge.points[0] = current_;
+  for (int32_t i = 0; i < degree; ++i) {
+    edge.points[i + 1] = points[i];
+  }
+  edge.color = kMsdfEdgeColorWhite;
+  edges_.push_back(edge);
+  current_ = points[degree - 1];
+  colored_ = false;
+}
+
+void MsdfGenerator::LineTo(const vec2& p) {
+  // Skip degenerate edges.
+  if (p.x == current_.x && p.y == current_.y) {
+    return;
+  }
+  AddEdge(1, &p);
+}
+
+void MsdfGenerator::QuadraticTo(const vec2& control, const vec2& p) {
+  const vec2 points[] = {control, p};
+  AddEdge(2, points);
+}
+
+void MsdfGenerator::CubicTo(const vec2& control1, const vec2& control2,
+                            const vec2& p) {
+  const vec2 points[] = {control1, control2, p};
+  AddEdge(3, points);
+}
+
+// Decomposes a FreeType outline into the generator.
+struct OutlineDecomposer {
+  MsdfGenerator* generator;
+  vec2 origin;
+
+  vec2 Convert(const FT_Vector* v) const {
+    // Outlines are in 26.6 fixed point with y up.
+    return vec2(static_cast<float>(v->x) / 64.0f - origin.x,
+                origin.y - static_cast<float>(v->y) / 64.0f);
+  }
+
+  static int MoveTo(const FT_Vector* to, void* user) {
+    auto p = static_cast<OutlineDecomposer*>(user);
+    p->generator->MoveTo(p->Convert(to));
+    return 0;
+  }
+  static int LineTo(const FT_Vector* to, void* user) {
+    auto p = static_cast<OutlineDecomposer*>(user);
+    p->generator->LineTo(p->Convert(to));
+    return 0;
+  }
+  static int ConicTo(const FT_Vector* control, const FT_Vector* to,
+                     void* user) {
+    auto p = static_cast<OutlineDecomposer*>(user);
+    p->generator->QuadraticTo(p->Convert(control), p->Convert(to));
+    return 0;
+  }
+  static int CubicTo(const FT_Vector* control1, const FT_Vector* control2,
+                     const FT_Vector* to, void* user) {
+    auto p = static_cast<OutlineDecomposer*>(user);
+    p->generator->CubicTo(p->Convert(control1), p->Convert(control2),
+                          p->Convert(to));
+    return 0;
+  }
+};
+
+bool MsdfGenerator::LoadOutline(const FT_Outline& outline,
+                                const vec2& origin) {
+  Clear();
+  OutlineDecomposer decomposer;
+  decomposer.generator = this;
+  decomposer.origin = origin;
+  FT_Outline_Funcs funcs;
+  funcs.move_to = OutlineDecomposer::MoveTo;
+  funcs.line_to = OutlineDecomposer::LineTo;
+  funcs.conic_to = OutlineDecomposer::ConicTo;
+  funcs.cubic_to = OutlineDecomposer::CubicTo;
+  funcs.shift = 0;
+  funcs.delta = 0;
+  auto err = FT_Outline_Decompose(const_cast<FT_Outline*>(&outline), &funcs,
+                                  &decomposer);
+  if (err) {
+    Clear();
+    return false;
+  }
+  CloseContour();
+  return true;
+}
+
+// Switch the channels of an edge to another pair of channels. The result
+// doesn't share a channel with `banned` when it's a pair of channels.
+static int32_t SwitchColor(int32_t color, int32_t banned) {
+  auto combined = color & banned;
+  if (combined == kMsdfEdgeColorRed || combined == kMsdfEdgeColorGreen ||
+      combined == kMsdfEdgeColorBlue) {
+    return combined ^ kMsdfEdgeColorWhite;
+  }
+  if (color == kMsdfEdgeColorBlack || color == kMsdfEdgeColorWhite) {
+    return kMsdfEdgeColorCyan;
+  }
+  auto shifted = color << 1;
+  return (shifted | shifted >> 3) & kMsdfEdgeColorWhite;
+}
+
+static bool IsCorner(const vec2& a, const vec2& b) {
+  return Dot(a, b) <= 0.0f || fabsf(Cross(a, b)) > kMsdfCornerThreshold;
+}
+
+void MsdfGenerator::ColorEdges() {
+  CloseContour();
+  std::vector<MsdfEdge> edges;
+  std::vector<size_t> contours;
+  std::vector<size_t> corners;
+  for (size_t c = 0; c < contours_.size(); ++c) {
+    auto begin = contours_[c];
+    auto end = c + 1 < contours_.size() ? contours_[c + 1] : edges_.size();
+    auto count = end - begin;
+    if (!count) {
+      continue;
+    }
+    contours.push_back(edges.size());
+
+    // Find corners. A corner is indexed by the edge starting at it.
+    corners.clear();
+    auto prev_direction = Normalize(edges_[end - 1].Direction(1.0f));
+    for (size_t i = 0; i < count; ++i) {
+      auto& edge = edges_[begin + i];
+      if (IsCorner(prev_direction, Normalize(edge.Direction(0.0f)))) {
+        corners.push_back(i);
+      }
+      prev_direction = Normalize(edge.Direction(1.0f));
+    }
+
+    if (corners.empty()) {
+      // A smooth contour. All channels hold the same distance.
+      for (size_t i = 0; i < count; ++i) {
+        edges.push_back(edges_[begin + i]);
+        edges.back().color = kMsdfEdgeColorWhite;
+      }
+    } else if (corners.size() == 1) {
+      // A teardrop shape. Spread three colors around the corner, splitting
+      // edges when there are less than three.
+      const int32_t colors[] = {kMsdfEdgeColorCyan, kMsdfEdgeColorWhite,
+                                kMsdfEdgeColorMagenta};
+      auto corner = corners[0];
+      std::vector<MsdfEdge> parts;
+      if (count >= 3) {
+        for (size_t i = 0; i < count; ++i) {
+          parts.push_back(edges_[begin + (corner + i) % count]);
+        }
+      } else {
+        for (size_t i = 0; i < count; ++i) {
+          MsdfEdge first, rest, second, third;
+          edges_[begin + (corner + i) % count].Split(1.0f / 3.0f, &first,
+                                                     &rest);
+          rest.Split(0.5f, &second, &third);
+          parts.push_back(first);
+          parts.push_back(second);
+          parts.push_back(third);
+        }
+      }
+      auto n = parts.size();
+      for (size_t i = 0; i < n; ++i) {
+        // Trichotomy of the parts, symmetrical around the corner.
+        auto index = static_cast<int32_t>(
+            3.0f + 2.875f * i / (n - 1) - 1.4375f + 0.5f) - 2;
+        parts[i].color = colors[std::max(0, std::min(2, index))];
+        edges.push_back(parts[i]);
+      }
+    } else {
+      // Switch colors at each corner. The last spline gets a color different
+      // from the first one.
+      size_t spline = 0;
+      auto start = corners[0];
+      auto color = SwitchColor(kMsdfEdgeColorWhite, kMsdfEdgeColorBlack);
+      auto initial_color = color;
+      for (size_t i = 0; i < count; ++i) {
+        auto index = (start + i) % count;
+        if (spline + 1 < corners.size() && corners[spline + 1] == index) {
+          ++spline;
+          color = SwitchColor(color, spline == corners.size() - 1
+                                         ? initial_color
+                                         : kMsdfEdgeColorBlack);
+        }
+        edges.push_back(edges_[begin + index]);
+        edges.back().color = color;
+      }
+    }
+  }
+  edges_.swap(edges);
+  contours_.swap(contours);
+  current_ = edges_.empty() ? mathfu::kZeros2f : edges_.back().Point(1.0f);
+  colored_ = true;
+}
+
+// Check if interpolating the pixels produces an edge in the median of their
+// channels that doesn't exist in the shape, i.e. two channels cross the edge
+// in opposite directions while both pixels are on a same side.
+static bool PixelClash(const float* a, const float* b, float threshold) {
+  auto a_inside = (a[0] > 0.0f) + (a[1] > 0.0f) + (a[2] > 0.0f) >= 2;
+  auto b_inside = (b[0] > 0.0f) + (b[1] > 0.0f) + (b[2] > 0.0f) >= 2;
+  if (a_inside != b_inside) {
+    return false;
+  }
+  // Changes between all channels inside or outside are not clashes.
+  if ((a[0] > 0.0f && a[1] > 0.0f && a[2] > 0.0f) ||
+      (a[0] < 0.0f && a[1] < 0.0f && a[2] < 0.0f) ||
+      (b[0] > 0.0f && b[1] > 0.0f && b[2] > 0.0f) ||
+      (b[0] < 0.0f && b[1] < 0.0f && b[2] < 0.0f)) {
+    return false;
+  }
+
+  // Find the two channels crossing the edge, and the remaining one.
+  auto crosses = [a, b](int32_t i) {
+    return (a[i] > 0.0f) != (b[i] > 0.0f) && (a[i] < 0.0f) != (b[i] < 0.0f);
+  };
+  int32_t ca, cb, cc;
+  if (crosses(0)) {
+    ca = 0;
+    if (crosses(1)) {
+      cb = 1;
+      cc = 2;
+    } else if (crosses(2)) {
+      cb = 2;
+      cc = 1;
+    } else {
+      return false;
+    }
+  } else if (crosses(1) && crosses(2)) {
+    ca = 1;
+    cb = 2;
+    cc = 0;
+  } else {
+    return false;
+  }
+
+  // Only the pixel farther from the edge is flagged.
+  return fabsf(a[ca] - b[ca]) >= threshold &&
+         fabsf(a[cb] - b[cb]) >= threshold && fabsf(a[cc]) >= fabsf(b[cc]);
+}
+
+void MsdfGenerator::CorrectErrors(const vec2i& size) {
+  const float kDiagonalScale = 1.41421356f;
+  auto width = size.x;
+  auto height = size.y;
+  auto pixel = [this, width](int32_t x, int32_t y) {
+    return &distances_[(x + y * width) * kMsdfChannels];
+  };
+  for (int32_t pass = 0; pass < 2; ++pass) {
+    // Check horizontal and vertical neighbors first, and then diagonal ones.
+    clashes_.clear();
+    for (int32_t y = 0; y < height; ++y) {
+      for (int32_t x = 0; x < width; ++x) {
+        auto p = pixel(x, y);
+        bool clash;
+        if (pass == 0) {
+          clash =
+              (x > 0 && PixelClash(p, pixel(x - 1, y), kMsdfClashThreshold)) ||
+              (x < width - 1 &&
+               PixelClash(p, pixel(x + 1, y), kMsdfClashThreshold)) ||
+              (y > 0 && PixelClash(p, pixel(x, y - 1), kMsdfClashThreshold)) ||
+              (y < height - 1 &&
+               PixelClash(p, pixel(x, y + 1), kMsdfClashThreshold));
+        } else {
+          auto threshold = kMsdfClashThreshold * kDiagonalScale;
+          clash = (x > 0 && y > 0 &&
+                   PixelClash(p, pixel(x - 1, y - 1), threshold)) ||
+                  (x < width - 1 && y > 0 &&
+                   PixelClash(p, pixel(x + 1, y - 1), threshold)) ||
+                  (x > 0 && y < height - 1 &&
+                   PixelClash(p, pixel(x - 1, y + 1), threshold)) ||
+                  (x < width - 1 && y < height - 1 &&
+                   PixelClash(p, pixel(x + 1, y + 1), threshold));
+        }
+        if (clash) {
+          clashes_.push_back(x + y * width);
+        }
+      }
+    }
+
+    for (auto it = clashes_.begin(); it != clashes_.end(); ++it) {
+      auto p = &distances_[*it * kMsdfChannels];
+      auto median = std::max(std::min(p[0], p[1]),
+                             std::min(std::max(p[0], p[1]), p[2]));
+      p[0] = p[1] = p[2] = median;
+    }
+  }
+}
+
+void MsdfGenerator::Generate(uint8_t* dest, const vec2i& size,
+                             int32_t stride) {
+  if (!colored_) {
+    ColorEdges();
+  }
+
+  // Flip signs so that inside of the shape is positive, regardless of the
+  // orientation of contours. The orientation is given by the signed area of
+  // the control polygons, which has the sign of the area of outer contours.
+  float area = 0.0f;
+  for (auto it = edges_.begin(); it != edges_.end(); ++it) {
+    for (int32_t i = 0; i < it->degree; ++i) {
+      area += Cross(it->points[i], it->points[i + 1]);
+    }
+  }
+  auto sign = area > 0.0f ? -1.0f : 1.0f;
+
+  const MsdfEdge::Distance kFarDistance = {
+      -std::numeric_limits<float>::max(), 0.0f};
+  distances_.resize(size.x * size.y * kMsdfChannels);
+  for (int32_t y = 0; y < size.y; ++y) {
+    for (int32_t x = 0; x < size.x; ++x) {
+      // Find the nearest edge of each channel, and the nearest edge overall.
+      vec2 p(x + 0.5f, y + 0.5f);
+      MsdfEdge::Distance min_distances[4] = {kFarDistance, kFarDistance,
+                                             kFarDistance, kFarDistance};
+      const MsdfEdge* nearest_edges[3] = {nullptr, nullptr, nullptr};
+      float params[3] = {0.0f, 0.0f, 0.0f};
+      for (auto it = edges_.begin(); it != edges_.end(); ++it) {
+        float param;
+        auto distance = it->GetDistance(p, &param);
+        for (int32_t c = 0; c < 3; ++c) {
+          if (it->color & (1 << c) && distance < min_distances[c]) {
+            min_distances[c] = distance;
+            nearest_edges[c] = &*it;
+            params[c] = param;
+          }
+        }
+        if (distance < min_distances[3]) {
+          min_distances[3] = distance;
+        }
+      }
+
+      // Color channels use pseudo distances to extend edges beyond corners.
+      auto d = &distances_[(x + y * size.x) * kMsdfChannels];
+      for (int32_t c = 0; c < 3; ++c) {
+        if (nearest_edges[c] != nullptr) {
+          nearest_edges[c]->ToPseudoDistance(p, params[c], &min_distances[c]);
+        }
+        d[c] = min_distances[c].distance * sign;
+      }
+      d[3] = min_distances[3].distance * sign;
+    }
+  }
+
+  CorrectErrors(size);
+
+  for (int32_t y = 0; y < size.y; ++y) {
+    auto d = &distances_[y * size.x * kMsdfChannels];
+    auto p = dest + y * stride * kMsdfChannels;
+    for (int32_t i = 0; i < size.x * kMsdfChannels; ++i) {
+      auto value =
+          mathfu::Clamp(d[i] * kMsdfDistanceScale + kMsdfDistanceBias, 0.0f,
+                        255.0f);
+      p[i] = static_cast<uint8_t>(value);
+    }
+  }
+}
+
+}  // namespace flatui
@@ -0,0 +1,123 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+
+#include "fplbase/glplatform.h"
+#include "fplbase/utilities.h"
+#include "internal/render_cache.h"
+
+using fplbase::LogError;
+
+namespace flatui {
+
+RenderCache::RenderCache()
+    : framebuffer_(0),
+      texture_(0),
+      size_(mathfu::kZeros2i),
+      saved_framebuffer_(0),
+      content_hash_(0),
+      valid_(false) {
+  for (size_t i = 0; i < sizeof(saved_viewport_) / sizeof(saved_viewport_[0]);
+       ++i) {
+    saved_viewport_[i] = 0;
+  }
+}
+
+bool RenderCache::Begin(const mathfu::vec2i &size) {
+  valid_ = false;
+  if (size.x <= 0 || size.y <= 0) return false;
+
+  GLint framebuffer;
+  GL_CALL(glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer));
+  saved_framebuffer_ = framebuffer;
+  GLint viewport[4];
+  GL_CALL(glGetIntegerv(GL_VIEWPORT, viewport));
+  for (int i = 0; i < 4; ++i) saved_viewport_[i] = viewport[i];
+
+  if (size.x != size_.x || size.y != size_.y) {
+    // (Re)create the offscreen target.
+    Release();
+    GLuint texture;
+    GL_CALL(glGenTextures(1, &texture));
+    GL_CALL(glBindTexture(GL_TEXTURE_2D, texture));
+    GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+    GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+    GL_CALL(
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GL_CALL(
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size.x, size.y, 0, GL_RGBA,
+                         GL_UNSIGNED_BYTE, nullptr));
+    texture_ = texture;
+
+    GLuint framebuffer;
+    GL_CALL(glGenFramebuffers(1, &framebuffer));
+    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer));
+    GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                   GL_TEXTURE_2D, texture, 0));
+    framebuffer_ = framebuffer;
+    size_ = size;
+
+    auto status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+      LogError("Failed to create a render cache target: 0x%x", status);
+      Release();
+      GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, saved_framebuffer_));
+      return false;
+    }
+  } else {
+    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_));
+  }
+
+  GL_CALL(glViewport(0, 0, size.x, size.y));
+  GL_CALL(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
+  GL_CALL(glClear(GL_COLOR_BUFFER_BIT));
+
+  // Accumulate alpha so that the target holds premultiplied colors.
+  GL_CALL(glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE,
+                              GL_ONE_MINUS_SRC_ALPHA));
+  return true;
+}
+
+void RenderCache::End(size_t content_hash) {
+  GL_CALL(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+  GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, saved_framebuffer_));
+  GL_CALL(glViewport(saved_viewport_[0], saved_viewport_[1],
+                     saved_viewport_[2], saved_viewport_[3]));
+  content_hash_ = content_hash;
+  valid_ = true;
+}
+
+void RenderCache::BindTexture() const {
+  GL_CALL(glActiveTexture(GL_TEXTURE0));
+  GL_CALL(glBindTexture(GL_TEXTURE_2D, texture_));
+}
+
+void RenderCache::Release() {
+  if (framebuffer_) {
+    GLuint framebuffer = framebuffer_;
+    GL_CALL(glDeleteFramebuffers(1, &framebuffer));
+    framebuffer_ = 0;
+  }
+  if (texture_) {
+    GLuint texture = texture_;
+    GL_CALL(glDeleteTextures(1, &texture));
+    texture_ = 0;
+  }
+  size_ = mathfu::kZeros2i;
+  valid_ = false;
+}
+
+}  // namespace flatui
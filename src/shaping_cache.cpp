@@ -0,0 +1,233 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "precompiled.h"
+
+#include "internal/shaping_cache.h"
+
+namespace flatui {
+
+bool ShapingCache::Restore(const ShapingKey &key, const char *text,
+                           size_t length, hb_buffer_t *buffer) {
+  auto it = map_entries_.find(key);
+  if (it == map_entries_.end()) {
+    return false;
+  }
+  auto &entry = *it->second;
+  if (entry.text.size() != length ||
+      memcmp(entry.text.data(), text, length)) {
+    return false;
+  }
+
+  // Mark the entry as most recently used.
+  lru_entries_.splice(lru_entries_.begin(), lru_entries_, it->second);
+
+  // Fill the buffer as hb_shape() would do.
+  auto count = static_cast<uint32_t>(entry.infos.size());
+  hb_buffer_set_content_type(buffer, HB_BUFFER_CONTENT_TYPE_GLYPHS);
+  if (!hb_buffer_set_length(buffer, count)) {
+    return false;
+  }
+  uint32_t glyph_count;
+  auto infos = hb_buffer_get_glyph_infos(buffer, &glyph_count);
+  auto positions = hb_buffer_get_glyph_positions(buffer, &glyph_count);
+  if (count) {
+    memcpy(infos, entry.infos.data(), count * sizeof(hb_glyph_info_t));
+    memcpy(positions, entry.positions.data(),
+           count * sizeof(hb_glyph_position_t));
+  }
+  return true;
+}
+
+void ShapingCache::Store(const ShapingKey &key, const char *text,
+                         size_t length, hb_buffer_t *buffer) {
+  if (capacity_ == 0) {
+    return;
+  }
+
+  auto it = map_entries_.find(key);
+  if (it != map_entries_.end()) {
+    // Replace an entry whose text collided with the key.
+    lru_entries_.erase(it->second);
+    map_entries_.erase(it);
+  } else if (lru_entries_.size() >= capacity_) {
+    map_entries_.erase(lru_entries_.back().key);
+    lru_entries_.pop_back();
+  }
+
+  uint32_t glyph_count;
+  auto infos = hb_buffer_get_glyph_infos(buffer, &glyph_count);
+  auto positions = hb_buffer_get_glyph_positions(buffer, &glyph_count);
+  lru_entries_.push_front(Entry());
+  auto &entry = lru_entries_.front();
+  entry.key = key;
+  entry.text.assign(text, length);
+  entry.infos.assign(infos, infos + glyph_count);
+  entry.positions.assign(positions, positions + glyph_count);
+  map_entries_[key] = lru_entries_.begin();
+}
+
+void ShapingCache::set_capacity(size_t capacity) {
+  capacity_ = capacity;
+  while (lru_entries_.size() > capacity_) {
+    map_entries_.erase(lru_entries_.back().key);
+    lru_entries_.pop_back();
+  }
+}
+
+size_t ShapingCache::GetMemorySize() const {
+  size_t size = 0;
+  for (auto it = lru_entries_.begin(); it != lru_entries_.end(); ++it) {
+    size += sizeof(*it) + it->text.capacity() +
+            it->infos.capacity() * sizeof(hb_glyph_info_t) +
+            it->positions.capacity() * sizeof(hb_glyph_position_t);
+  }
+  return size;
+}
+
+bool WordBreakCache::Restore(const char *text, size_t length,
+                             const std::string &language, HashedId font_id,
+                             std::vector<char> *wordbreak_info,
+                             std::vector<int32_t> *fontface_index,
+                             int32_t *num_runs) {
+  auto it = map_entries_.find(GetKey(text, length, language, font_id));
+  if (it == map_entries_.end()) {
+    return false;
+  }
+  auto &entry = *it->second;
+  if (entry.font_id != font_id || entry.language != language ||
+      entry.text.size() != length || memcmp(entry.text.data(), text, length)) {
+    return false;
+  }
+
+  // Mark the entry as most recently used.
+  lru_entries_.splice(lru_entries_.begin(), lru_entries_, it->second);
+  *wordbreak_info = entry.wordbreak_info;
+  *fontface_index = entry.fontface_index;
+  *num_runs = entry.num_runs;
+  return true;
+}
+
+void WordBreakCache::Store(const char *text, size_t length,
+                           const std::string &language, HashedId font_id,
+                           const std::vector<char> &wordbreak_info,
+                           const std::vector<int32_t> &fontface_index,
+                           int32_t num_runs) {
+  if (capacity_ == 0) {
+    return;
+  }
+
+  auto key = GetKey(text, length, language, font_id);
+  auto it = map_entries_.find(key);
+  if (it != map_entries_.end()) {
+    // Replace an entry whose text collided with the key.
+    lru_entries_.erase(it->second);
+    map_entries_.erase(it);
+  } else if (lru_entries_.size() >= capacity_) {
+    map_entries_.erase(lru_entries_.back().key);
+    lru_entries_.pop_back();
+  }
+
+  lru_entries_.push_front(Entry());
+  auto &entry = lru_entries_.front();
+  entry.key = key;
+  entry.text.assign(text, length);
+  entry.language = language;
+  entry.font_id = font_id;
+  entry.wordbreak_info = wordbreak_info;
+  entry.fontface_index = fontface_index;
+  entry.num_runs = num_runs;
+  map_entries_[key] = lru_entries_.begin();
+}
+
+void WordBreakCache::set_capacity(size_t capacity) {
+  capacity_ = capacity;
+  while (lru_entries_.size() > capacity_) {
+    map_entries_.erase(lru_entries_.back().key);
+    lru_entries_.pop_back();
+  }
+}
+
+size_t WordBreakCache::GetMemorySize() const {
+  size_t size = 0;
+  for (auto it = lru_entries_.begin(); it != lru_entries_.end(); ++it) {
+    size += sizeof(*it) + it->text.capacity() + it->language.capacity() +
+            it->wordbreak_info.capacity() +
+            it->fontface_index.capacity() * sizeof(int32_t);
+  }
+  return size;
+}
+
+HtmlCache::SectionsPtr HtmlCache::Find(const char *html) {
+  auto it = map_entries_.find(HashId(html));
+  if (it == map_entries_.end()) {
+    return nullptr;
+  }
+  auto &entry = *it->second;
+  if (entry.html != html) {
+    return nullptr;
+  }
+
+  // Mark the entry as most recently used.
+  lru_entries_.splice(lru_entries_.begin(), lru_entries_, it->second);
+  return entry.sections;
+}
+
+void HtmlCache::Store(const char *html, const SectionsPtr &sections) {
+  if (capacity_ == 0) {
+    return;
+  }
+
+  auto key = HashId(html);
+  auto it = map_entries_.find(key);
+  if (it != map_entries_.end()) {
+    // Replace an entry whose HTML collided with the key.
+    lru_entries_.erase(it->second);
+    map_entries_.erase(it);
+  } else if (lru_entries_.size() >= capacity_) {
+    map_entries_.erase(lru_entries_.back().key);
+    lru_entries_.pop_back();
+  }
+
+  lru_entries_.push_front(Entry());
+  auto &entry = lru_entries_.front();
+  entry.key = key;
+  entry.html = html;
+  entry.sections = sections;
+  map_entries_[key] = lru_entries_.begin();
+}
+
+void HtmlCache::set_capacity(size_t capacity) {
+  capacity_ = capacity;
+  while (lru_entries_.size() > capacity_) {
+    map_entries_.erase(lru_entries_.back().key);
+    lru_entries_.pop_back();
+  }
+}
+
+size_t HtmlCache::GetMemorySize() const {
+  size_t size = 0;
+  for (auto it = lru_entries_.begin(); it != lru_entries_.end(); ++it) {
+    size += sizeof(*it) + it->html.capacity();
+    if (it->sections != nullptr) {
+      size += it->sections->capacity() * sizeof(HtmlSection);
+      for (auto section = it->sections->begin();
+           section != it->sections->end(); ++section) {
+        size += section->text().capacity() + section->link().capacity();
+      }
+    }
+  }
+  return size;
+}
+
+}  // namespace flatui
@@ -0,0 +1,355 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "precompiled.h"
+
+#include <limits>
+#include "internal/simd_antialias_distance_computer.h"
+
+// NEON is used only on AArch64 since ARMv7 NEON doesn't have IEEE compliant
+// division and square root.
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FLATUI_SIMD_SSE2 (1)
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FLATUI_SIMD_NEON (1)
+#endif
+
+namespace flatui {
+
+#if defined(FLATUI_SIMD_SSE2) || defined(FLATUI_SIMD_NEON)
+
+namespace {
+
+// Thin wrappers of 4 wide float operations.
+#if defined(FLATUI_SIMD_SSE2)
+typedef __m128 Float4;
+typedef __m128 Mask4;
+
+inline Float4 Splat(float f) { return _mm_set1_ps(f); }
+inline Float4 Load(const float *p) { return _mm_loadu_ps(p); }
+inline void Store(float *p, Float4 v) { _mm_storeu_ps(p, v); }
+inline Float4 Add(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+inline Float4 Sub(Float4 a, Float4 b) { return _mm_sub_ps(a, b); }
+inline Float4 Mul(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+inline Float4 Div(Float4 a, Float4 b) { return _mm_div_ps(a, b); }
+inline Float4 Sqrt(Float4 a) { return _mm_sqrt_ps(a); }
+inline Float4 Min(Float4 a, Float4 b) { return _mm_min_ps(a, b); }
+inline Float4 Max(Float4 a, Float4 b) { return _mm_max_ps(a, b); }
+inline Float4 Abs(Float4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+inline Mask4 Less(Float4 a, Float4 b) { return _mm_cmplt_ps(a, b); }
+inline Mask4 LessEqual(Float4 a, Float4 b) { return _mm_cmple_ps(a, b); }
+inline Mask4 Equal(Float4 a, Float4 b) { return _mm_cmpeq_ps(a, b); }
+inline Mask4 IsNan(Float4 a) { return _mm_cmpunord_ps(a, a); }
+inline Mask4 Or(Mask4 a, Mask4 b) { return _mm_or_ps(a, b); }
+inline Mask4 And(Mask4 a, Mask4 b) { return _mm_and_ps(a, b); }
+inline Float4 Select(Mask4 mask, Float4 a, Float4 b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Load 4 vec2s into separate X and Y vectors.
+inline void LoadVec2(const float *p, Float4 *x, Float4 *y) {
+  auto a = _mm_loadu_ps(p);
+  auto b = _mm_loadu_ps(p + 4);
+  *x = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+  *y = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+// Store X and Y vectors as 4 vec2s.
+inline void StoreVec2(float *p, Float4 x, Float4 y) {
+  _mm_storeu_ps(p, _mm_unpacklo_ps(x, y));
+  _mm_storeu_ps(p + 4, _mm_unpackhi_ps(x, y));
+}
+
+// Truncate values in range of 0 - 255 and store them as bytes.
+inline void StoreBytes(uint8_t *p, Float4 v) {
+  auto i = _mm_cvttps_epi32(v);
+  i = _mm_packs_epi32(i, i);
+  i = _mm_packus_epi16(i, i);
+  auto bytes = _mm_cvtsi128_si32(i);
+  memcpy(p, &bytes, sizeof(bytes));
+}
+#else   // FLATUI_SIMD_NEON
+typedef float32x4_t Float4;
+typedef uint32x4_t Mask4;
+
+inline Float4 Splat(float f) { return vdupq_n_f32(f); }
+inline Float4 Load(const float *p) { return vld1q_f32(p); }
+inline void Store(float *p, Float4 v) { vst1q_f32(p, v); }
+inline Float4 Add(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+inline Float4 Sub(Float4 a, Float4 b) { return vsubq_f32(a, b); }
+inline Float4 Mul(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+inline Float4 Div(Float4 a, Float4 b) { return vdivq_f32(a, b); }
+inline Float4 Sqrt(Float4 a) { return vsqrtq_f32(a); }
+inline Float4 Min(Float4 a, Float4 b) { return vminq_f32(a, b); }
+inline Float4 Max(Float4 a, Float4 b) { return vmaxq_f32(a, b); }
+inline Float4 Abs(Float4 a) { return vabsq_f32(a); }
+inline Mask4 Less(Float4 a, Float4 b) { return vcltq_f32(a, b); }
+inline Mask4 LessEqual(Float4 a, Float4 b) { return vcleq_f32(a, b); }
+inline Mask4 Equal(Float4 a, Float4 b) { return vceqq_f32(a, b); }
+inline Mask4 IsNan(Float4 a) { return vmvnq_u32(vceqq_f32(a, a)); }
+inline Mask4 Or(Mask4 a, Mask4 b) { return vorrq_u32(a, b); }
+inline Mask4 And(Mask4 a, Mask4 b) { return vandq_u32(a, b); }
+inline Float4 Select(Mask4 mask, Float4 a, Float4 b) {
+  return vbslq_f32(mask, a, b);
+}
+
+inline void LoadVec2(const float *p, Float4 *x, Float4 *y) {
+  auto v = vld2q_f32(p);
+  *x = v.val[0];
+  *y = v.val[1];
+}
+
+inline void StoreVec2(float *p, Float4 x, Float4 y) {
+  float32x4x2_t v = {{x, y}};
+  vst2q_f32(p, v);
+}
+
+inline void StoreBytes(uint8_t *p, Float4 v) {
+  auto i = vmovn_u32(vcvtq_u32_f32(v));
+  auto b = vmovn_u16(vcombine_u16(i, i));
+  auto bytes = vget_lane_u32(vreinterpret_u32_u8(b), 0);
+  memcpy(p, &bytes, sizeof(bytes));
+}
+#endif  // FLATUI_SIMD_NEON
+
+// 4 wide version of FastAntialiasDistanceComputer::ApproximateDistanceToEdge.
+// All branches are evaluated and the results are selected per lane.
+inline Float4 ApproximateDistanceToEdge4(Float4 value, Float4 gx, Float4 gy) {
+  const auto zero = Splat(0.0f);
+  const auto half = Splat(0.5f);
+  const auto one = Splat(1.0f);
+  auto linear = Sub(half, value);
+  auto use_linear = Or(Equal(gx, zero), Equal(gy, zero));
+
+  // Normalize the gradient in the first octant.
+  gx = Abs(gx);
+  gy = Abs(gy);
+  auto inv_length = Div(one, Sqrt(Add(Mul(gx, gx), Mul(gy, gy))));
+  gx = Mul(gx, inv_length);
+  gy = Mul(gy, inv_length);
+  use_linear = Or(use_linear, Or(IsNan(gx), IsNan(gy)));
+  auto g_max = Max(gx, gy);
+  auto g_min = Min(gx, gy);
+
+  auto gradient_value = Div(Mul(half, g_min), g_max);
+  auto sum = Add(g_max, g_min);
+  auto product = Mul(Mul(Splat(2.0f), g_max), g_min);
+  auto low = Sub(Mul(half, sum), Sqrt(Mul(product, value)));
+  auto mid = Mul(Sub(half, value), g_max);
+  auto high = Add(Mul(Splat(-0.5f), sum), Sqrt(Mul(product, Sub(one, value))));
+  auto dist = Select(Less(value, gradient_value), low,
+                     Select(Less(value, Sub(one, gradient_value)), mid, high));
+  return Select(use_linear, linear, dist);
+}
+
+}  // namespace
+
+static_assert(sizeof(vec2) == sizeof(float) * 2,
+              "Kernels expect vec2 to be tightly packed.");
+
+bool SimdAntialiasDistanceComputer::IsSupported() { return true; }
+
+void SimdAntialiasDistanceComputer::ComputeGradients() {
+  const auto w = image_->GetWidth();
+  const auto h = image_->GetHeight();
+
+  // Expand the image with its padding, so that kernels don't need bounds
+  // checks.
+  const auto padding = image_->get_padding();
+  const auto stride = image_->get_stride();
+  const auto original_size = image_->GetOriginalSize();
+  const auto data = image_->get_data();
+  image_values_.assign(w * h, 0.0f);
+  for (auto y = 0; y < original_size.y; ++y) {
+    auto dest = &image_values_[(y + padding) * w + padding];
+    auto src = data + y * stride;
+    for (auto x = 0; x < original_size.x; ++x) {
+      dest[x] = src[x];
+    }
+  }
+  if (image_->get_invert()) {
+    FastAntialiasDistanceComputer<uint8_t>::ComputeGradients();
+    return;
+  }
+
+  // Same filter as FilterPixel(). Terms with 0 coefficients are skipped,
+  // which can only change the sign of a zero gradient.
+  static const float kSqrt2 = sqrtf(2.0f);
+  const auto sqrt2 = Splat(kSqrt2);
+  const auto minus_sqrt2 = Splat(-kSqrt2);
+  const auto zero = Splat(0.0f);
+  const auto one = Splat(1.0f);
+  const auto max_value = Splat(std::numeric_limits<uint8_t>::max());
+  auto gradients = reinterpret_cast<float *>(gradients_.get_data());
+  for (auto y = 1; y < h - 1; ++y) {
+    const float *r0 = &image_values_[(y - 1) * w];
+    const float *r1 = r0 + w;
+    const float *r2 = r1 + w;
+    auto x = 1;
+    for (; x + 4 <= w - 1; x += 4) {
+      auto v00 = Load(r0 + x - 1);
+      auto v01 = Load(r0 + x);
+      auto v02 = Load(r0 + x + 1);
+      auto v10 = Load(r1 + x - 1);
+      auto v11 = Load(r1 + x);
+      auto v12 = Load(r1 + x + 1);
+      auto v20 = Load(r2 + x - 1);
+      auto v21 = Load(r2 + x);
+      auto v22 = Load(r2 + x + 1);
+
+      auto gx = Sub(v02, v00);
+      gx = Add(gx, Mul(minus_sqrt2, v10));
+      gx = Add(gx, Mul(sqrt2, v12));
+      gx = Sub(gx, v20);
+      gx = Add(gx, v22);
+
+      auto gy = Sub(Mul(minus_sqrt2, v01), v00);
+      gy = Sub(gy, v02);
+      gy = Add(gy, v20);
+      gy = Add(gy, Mul(sqrt2, v21));
+      gy = Add(gy, v22);
+
+      auto inv_length = Div(one, Sqrt(Add(Mul(gx, gx), Mul(gy, gy))));
+      gx = Mul(gx, inv_length);
+      gy = Mul(gy, inv_length);
+
+      // If the pixel is fully on or off, leave the gradient as (0,0).
+      auto edge = And(Less(zero, v11), Less(v11, max_value));
+      StoreVec2(gradients + (y * w + x) * 2, Select(edge, gx, zero),
+                Select(edge, gy, zero));
+    }
+    for (; x < w - 1; ++x) {
+      auto pos = vec2i(x, y);
+      auto value = image_->Get(pos);
+      if (value > std::numeric_limits<uint8_t>::min() &&
+          value < std::numeric_limits<uint8_t>::max()) {
+        gradients_.Set(pos, FilterPixel(pos));
+      }
+    }
+  }
+}
+
+void SimdAntialiasDistanceComputer::InitializeDistanceGrid() {
+  const auto w = image_->GetWidth();
+  const auto h = image_->GetHeight();
+  if (static_cast<int32_t>(image_values_.size()) != w * h) {
+    FastAntialiasDistanceComputer<uint8_t>::InitializeDistanceGrid();
+    return;
+  }
+
+  const auto zero = Splat(0.0f);
+  const auto one = Splat(1.0f);
+  const auto max_value = Splat(std::numeric_limits<uint8_t>::max());
+  const auto max_gradient = Splat(std::numeric_limits<float>::max());
+  const auto large_distance = Splat(kLargeDistance);
+  const auto invert = image_->get_invert();
+  const auto invert_gradients = gradients_.get_invert();
+  auto gradients = reinterpret_cast<const float *>(gradients_.get_data());
+  auto distances = distances_->get_data();
+  const auto count = w * h;
+  auto i = 0;
+  for (; i + 4 <= count; i += 4) {
+    auto v = Load(&image_values_[i]);
+    if (invert) {
+      v = Sub(max_value, v);
+    }
+    v = Div(v, max_value);
+    Float4 gx, gy;
+    LoadVec2(gradients + i * 2, &gx, &gy);
+    if (invert_gradients) {
+      gx = Sub(max_gradient, gx);
+      gy = Sub(max_gradient, gy);
+    }
+    auto dist = ApproximateDistanceToEdge4(v, gx, gy);
+    dist = Select(LessEqual(one, v), zero, dist);
+    dist = Select(LessEqual(v, zero), large_distance, dist);
+    Store(distances + i, dist);
+  }
+  for (; i < count; ++i) {
+    auto pos = vec2i(i % w, i / w);
+    auto v = static_cast<float>(image_->Get(pos)) /
+             std::numeric_limits<uint8_t>::max();
+    auto dist = v <= 0.0f ? kLargeDistance
+                          : v >= 1.0f ? 0.0f : ApproximateDistanceToEdge(
+                                                   v, gradients_.Get(pos));
+    distances_->Set(pos, dist);
+  }
+}
+
+void SimdAntialiasDistanceComputer::StoreDistances(bool inner_distance) {
+  if (destination_->get_padding() || destination_->get_invert()) {
+    FastAntialiasDistanceComputer<uint8_t>::StoreDistances(inner_distance);
+    return;
+  }
+  const auto w = image_->GetWidth();
+  const auto size = vec2i::Min(image_->GetSize(),
+                               destination_->GetOriginalSize());
+  const auto stride = destination_->get_stride();
+  auto dest = destination_->get_data();
+  auto distances = distances_->get_data();
+  auto outer_distances = outer_distances_.get_data();
+
+  // Don't return negative distances.
+  const float kSDFMultiplier = -16.0f;
+  const auto mid =
+      static_cast<float>((std::numeric_limits<uint8_t>::max() +
+                          std::numeric_limits<uint8_t>::min()) /
+                         2);
+  const auto min_value =
+      static_cast<float>(std::numeric_limits<uint8_t>::min());
+  const auto max_value =
+      static_cast<float>(std::numeric_limits<uint8_t>::max());
+  for (auto y = 0; y < size.y; ++y) {
+    auto x = 0;
+    for (; x + 4 <= size.x; x += 4) {
+      auto value = Load(distances + y * w + x);
+      if (inner_distance) {
+        value = Sub(Load(outer_distances + y * w + x), value);
+      }
+      value = Add(Mul(value, Splat(kSDFMultiplier)), Splat(mid));
+      value = Max(Splat(min_value), Min(value, Splat(max_value)));
+      StoreBytes(dest + y * stride + x, value);
+    }
+    for (; x < size.x; ++x) {
+      auto value = distances[y * w + x];
+      if (inner_distance) {
+        value = outer_distances[y * w + x] - value;
+      }
+      value = mathfu::Clamp(value * kSDFMultiplier + mid, min_value, max_value);
+      dest[y * stride + x] = static_cast<uint8_t>(value);
+    }
+  }
+}
+
+#else  // FLATUI_SIMD_SSE2 || FLATUI_SIMD_NEON
+
+bool SimdAntialiasDistanceComputer::IsSupported() { return false; }
+
+void SimdAntialiasDistanceComputer::ComputeGradients() {
+  FastAntialiasDistanceComputer<uint8_t>::ComputeGradients();
+}
+
+void SimdAntialiasDistanceComputer::InitializeDistanceGrid() {
+  FastAntialiasDistanceComputer<uint8_t>::InitializeDistanceGrid();
+}
+
+void SimdAntialiasDistanceComputer::StoreDistances(bool inner_distance) {
+  FastAntialiasDistanceComputer<uint8_t>::StoreDistances(inner_distance);
+}
+
+#endif  // FLATUI_SIMD_SSE2 || FLATUI_SIMD_NEON
+
+}  // namespace flatui
@@ -0,0 +1,121 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+#include "internal/spatial_index.h"
+
+namespace flatui {
+
+using mathfu::vec2i;
+
+void SpatialIndex::Clear(const vec2i &canvas_size) {
+  grid_size_ = vec2i(kCellsPerAxis, kCellsPerAxis);
+  cell_size_ = vec2i::Max(
+      (canvas_size + vec2i(kCellsPerAxis - 1)) / kCellsPerAxis,
+      mathfu::kOnes2i);
+  cells_.resize(kCellsPerAxis * kCellsPerAxis);
+  for (auto it = cells_.begin(); it != cells_.end(); ++it) {
+    it->clear();
+  }
+  items_.clear();
+  item_map_.clear();
+}
+
+vec2i SpatialIndex::CellOf(const vec2i &point) const {
+  auto cell = point / cell_size_;
+  return vec2i::Max(vec2i::Min(cell, grid_size_ - mathfu::kOnes2i),
+                    mathfu::kZeros2i);
+}
+
+void SpatialIndex::Insert(HashedId hash, const vec2i &pos, const vec2i &size) {
+  if (cells_.empty()) return;
+
+  Item item;
+  item.hash = hash;
+  item.min = pos;
+  item.max = pos + vec2i::Max(size, mathfu::kZeros2i);
+  auto index = static_cast<int32_t>(items_.size());
+  items_.push_back(item);
+  item_map_[hash] = index;
+
+  auto min_cell = CellOf(item.min);
+  auto max_cell = CellOf(vec2i::Max(item.max - mathfu::kOnes2i, item.min));
+  for (int32_t y = min_cell.y; y <= max_cell.y; ++y) {
+    for (int32_t x = min_cell.x; x <= max_cell.x; ++x) {
+      cells_[y * grid_size_.x + x].push_back(index);
+    }
+  }
+}
+
+HashedId SpatialIndex::FindNeighbor(HashedId hash,
+                                    const vec2i &direction) const {
+  auto it = item_map_.find(hash);
+  if (it == item_map_.end() || (!direction.x && !direction.y)) {
+    return kNullHash;
+  }
+  auto &from = items_[it->second];
+  // Centers are kept doubled to stay in integers.
+  auto center = from.min + from.max;
+  auto center_cell = CellOf((from.min + from.max) / 2);
+
+  HashedId best = kNullHash;
+  auto best_score = std::numeric_limits<int64_t>::max();
+  auto max_ring = std::max(grid_size_.x, grid_size_.y);
+  for (int32_t ring = 0; ring < max_ring; ++ring) {
+    // Elements in this ring or outer rings are at least `ring - 1` cells away
+    // on either axis, which also bounds their score from below.
+    auto min_distance = static_cast<int64_t>(ring - 1) * 2 *
+                        std::min(cell_size_.x, cell_size_.y);
+    if (best != kNullHash && min_distance >= best_score) break;
+
+    auto min_cell = center_cell - vec2i(ring);
+    auto max_cell = center_cell + vec2i(ring);
+    for (int32_t y = std::max(min_cell.y, 0);
+         y <= std::min(max_cell.y, grid_size_.y - 1); ++y) {
+      bool edge_row = y == min_cell.y || y == max_cell.y;
+      for (int32_t x = std::max(min_cell.x, 0);
+           x <= std::min(max_cell.x, grid_size_.x - 1); ++x) {
+        // Only visit the cells on the border of the ring.
+        if (!edge_row && x != min_cell.x && x != max_cell.x) {
+          x = max_cell.x - 1;
+          continue;
+        }
+        auto &cell = cells_[y * grid_size_.x + x];
+        for (auto index = cell.begin(); index != cell.end(); ++index) {
+          auto &item = items_[*index];
+          if (EqualId(item.hash, from.hash)) continue;
+          auto d = item.min + item.max - center;
+          auto along = static_cast<int64_t>(d.x) * direction.x +
+                       static_cast<int64_t>(d.y) * direction.y;
+          if (along <= 0) continue;
+          auto across = std::abs(static_cast<int64_t>(d.x) * direction.y -
+                                 static_cast<int64_t>(d.y) * direction.x);
+          auto score = along + 2 * across;
+          if (score < best_score) {
+            best_score = score;
+            best = item.hash;
+          }
+        }
+      }
+    }
+  }
+  return best;
+}
+
+}  // namespace flatui
@@ -0,0 +1,432 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks of the text and UI pipeline.
+// Each case prints the average time of an iteration in a line starting with
+// "BENCHMARK", so that results can be collected and compared between builds.
+// Run a subset with --gtest_filter, e.g. --gtest_filter=*GetBuffer*.
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Freetype2 header
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "flatbuffers/idl.h"
+#include "flatbuffers/util.h"
+#include "flatui/flatui.h"
+#include "flatui/flatui_common.h"
+#include "flatui/flatui_generated.h"
+#include "flatui/flatui_serialization.h"
+#include "flatui/font_manager.h"
+#include "flatui/internal/antialias_distance_computer.h"
+#include "flatui/internal/euclidean_distance_computer.h"
+#include "flatui/internal/fast_antialias_distance_computer.h"
+#include "flatui/internal/glyph_cache.h"
+#include "flatui/internal/simd_antialias_distance_computer.h"
+#include "fplbase/asset_manager.h"
+#include "fplbase/input.h"
+#include "fplbase/renderer.h"
+#include "fplbase/utilities.h"
+#include "gtest/gtest.h"
+
+using flatui::Grid;
+
+// Call a function with the iteration index `iterations` times, and print the
+// average time of a call.
+template <typename F>
+static void Measure(const char *name, int32_t iterations, const F &func) {
+  auto start = std::chrono::steady_clock::now();
+  for (int32_t i = 0; i < iterations; ++i) {
+    func(i);
+  }
+  std::chrono::duration<double, std::micro> elapsed =
+      std::chrono::steady_clock::now() - start;
+  printf("BENCHMARK %-40s %12.3f us/iteration\n", name,
+         elapsed.count() / iterations);
+}
+
+// Look up a sliding window of glyphs each frame, so that the cache keeps
+// evicting rows of glyphs that left the window. Glyphs have mixed heights to
+// exercise the row allocation.
+TEST(FlatUIBenchmark, GlyphCacheChurn) {
+  const int32_t kFrames = 10000;
+  const uint32_t kGlyphsPerFrame = 64;
+  const uint32_t kWindowStep = 8;
+  const int32_t kHeights[] = {12, 16, 24, 32, 48};
+  const size_t kNumHeights = sizeof(kHeights) / sizeof(kHeights[0]);
+  const flatui::GlyphCachePacking kPackings[] = {
+      flatui::kGlyphCachePackingRow, flatui::kGlyphCachePackingSkyline};
+  const char *kNames[] = {"GlyphCache::Find/Set row",
+                          "GlyphCache::Find/Set skyline"};
+
+  for (size_t p = 0; p < sizeof(kPackings) / sizeof(kPackings[0]); ++p) {
+    flatui::GlyphCache cache(mathfu::vec2i(256, 256), 2, kPackings[p]);
+    int32_t flushes = 0;
+    Measure(kNames[p], kFrames, [&](int32_t frame) {
+      cache.Update();
+      auto first = static_cast<uint32_t>(frame) * kWindowStep;
+      for (auto code_point = first; code_point < first + kGlyphsPerFrame;
+           ++code_point) {
+        auto height = kHeights[code_point % kNumHeights];
+        flatui::GlyphKey key(flatui::HashId("font"), code_point, height,
+                             flatui::kGlyphFlagsNone);
+        if (cache.Find(key) != nullptr) continue;
+        flatui::GlyphCacheEntry entry;
+        entry.set_code_point(code_point);
+        entry.set_size(mathfu::vec2i(height * 3 / 4, height));
+        if (cache.Set(nullptr, key, entry) == nullptr) {
+          // The cache is fragmented. Flush it as FontManager does.
+          cache.Flush();
+          ++flushes;
+          cache.Set(nullptr, key, entry);
+        }
+      }
+    });
+    printf("          %d flushes\n", flushes);
+  }
+}
+
+// Compute SDFs of real glyph bitmaps with all CPU distance computers.
+TEST(FlatUIBenchmark, DistanceComputerGlyphs) {
+  ASSERT_TRUE(fplbase::ChangeToUpstreamDir("../", "assets"));
+  FT_Library ft;
+  FT_Face face;
+  ASSERT_EQ(0, FT_Init_FreeType(&ft));
+  ASSERT_EQ(0, FT_New_Face(ft, "fonts/Roboto-Regular.ttf", 0, &face));
+
+  flatui::AntialiasDistanceComputer<uint8_t> antialias;
+  flatui::FastAntialiasDistanceComputer<uint8_t> fast;
+  flatui::SimdAntialiasDistanceComputer simd;
+  flatui::EuclideanDistanceComputer<uint8_t> euclidean;
+  struct Computer {
+    const char *name;
+    flatui::DistanceComputer<uint8_t> *computer;
+  };
+  const Computer kComputers[] = {{"Antialias", &antialias},
+                                 {"FastAntialias", &fast},
+                                 {"SimdAntialias", &simd},
+                                 {"Euclidean", &euclidean}};
+  const int32_t kGlyphSizes[] = {16, 32, 64, 128};
+  const char kText[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+  const auto kFlags = static_cast<flatui::GlyphFlags>(
+      flatui::kGlyphFlagsOuterSDF | flatui::kGlyphFlagsInnerSDF);
+  const int32_t kPadding = flatui::kGlyphCachePaddingSDF;
+
+  for (auto glyph_size : kGlyphSizes) {
+    // Render all glyphs first so that only the SDF generation is measured.
+    FT_Set_Pixel_Sizes(face, 0, glyph_size);
+    std::vector<std::vector<uint8_t>> images;
+    std::vector<mathfu::vec2i> sizes;
+    for (auto c = kText; *c; ++c) {
+      ASSERT_EQ(0, FT_Load_Char(face, *c, FT_LOAD_RENDER));
+      auto &bitmap = face->glyph->bitmap;
+      mathfu::vec2i size(bitmap.width, bitmap.rows);
+      std::vector<uint8_t> image(size.x * size.y);
+      for (int32_t y = 0; y < size.y; ++y) {
+        std::copy(bitmap.buffer + y * bitmap.pitch,
+                  bitmap.buffer + y * bitmap.pitch + size.x,
+                  image.begin() + y * size.x);
+      }
+      images.push_back(std::move(image));
+      sizes.push_back(size);
+    }
+    for (auto &c : kComputers) {
+      char name[64];
+      snprintf(name, sizeof(name), "%s %dpx", c.name, glyph_size);
+      std::vector<uint8_t> sdf;
+      Measure(name, static_cast<int32_t>(images.size()), [&](int32_t i) {
+        auto dest_size = sizes[i] + mathfu::vec2i(kPadding * 2, kPadding * 2);
+        sdf.resize(dest_size.x * dest_size.y);
+        Grid<uint8_t> src(images[i].data(), sizes[i], kPadding, sizes[i].x);
+        Grid<uint8_t> dest(sdf.data(), dest_size, 0, dest_size.x);
+        c.computer->Compute(src, &dest, kFlags);
+      });
+    }
+  }
+
+  FT_Done_Face(face);
+  FT_Done_FreeType(ft);
+}
+
+class FlatUIPipelineBenchmark : public ::testing::Test {
+ public:
+  MATHFU_DEFINE_CLASS_SIMD_AWARE_NEW_DELETE
+
+ protected:
+  static void SetUpTestCase() {       // Called once, before any tests.
+    flatui::SetErrorOutputCount(-1);  // Disable error count limit.
+  }
+
+  virtual void SetUp() {
+    renderer_.Initialize(mathfu::vec2i(800, 600), "FlatUI benchmarks");
+    input_.Initialize();
+
+    // Set the local directory to the assets folder.
+    bool result = fplbase::ChangeToUpstreamDir("../", "assets");
+    assert(result);
+    (void)result;
+
+    assetman_ = new fplbase::AssetManager(renderer_);
+    font_manager_ = new flatui::FontManager();
+    font_manager_->Open("fonts/NotoNaskhArabic-Regular.ttf");
+    font_manager_->Open("fonts/NotoSansCJKjp-Bold.otf");
+    font_manager_->SelectFont("fonts/NotoSansCJKjp-Bold.otf");
+    next_text_id_ = 1;
+  }
+
+  virtual void TearDown() {
+    delete font_manager_;
+    delete assetman_;
+    renderer_.ShutDown();
+  }
+
+  // Parameters of a text laid out in `width`, or in a single line if it's 0.
+  flatui::FontBufferParameters Parameters(flatui::HashedId text_id,
+                                          int32_t width, bool rtl) {
+    return flatui::FontBufferParameters(
+        font_manager_->GetCurrentFont()->GetFontId(), text_id, 24.0f,
+        mathfu::vec2i(width, 0), flatui::kTextAlignmentLeft,
+        flatui::kGlyphFlagsNone, false, true, false, rtl);
+  }
+
+  // Measure retrieving a FontBuffer, both laid out from scratch and hitting
+  // the FontBuffer cache.
+  void MeasureGetBuffer(const char *name, const char *text, int32_t width,
+                        bool rtl, bool html) {
+    const int32_t kIterations = 1000;
+    auto get_buffer = [&](const flatui::FontBufferParameters &parameters) {
+      auto buffer =
+          html ? font_manager_->GetHtmlBuffer(text, parameters)
+               : font_manager_->GetBuffer(text, strlen(text), parameters);
+      EXPECT_NE(nullptr, buffer) << name;
+      return buffer;
+    };
+
+    // Rasterize glyphs of the text in advance, so that the layout itself is
+    // measured.
+    font_manager_->StartLayoutPass();
+    auto cached = get_buffer(Parameters(next_text_id_++, width, rtl));
+    font_manager_->StartRenderPass();
+
+    std::string label = std::string("GetBuffer layout ") + name;
+    Measure(label.c_str(), kIterations, [&](int32_t) {
+      auto buffer = get_buffer(Parameters(next_text_id_++, width, rtl));
+      font_manager_->ReleaseBuffer(buffer);
+    });
+
+    // `cached` keeps the buffer alive, so the lookups hit the cache.
+    auto parameters = Parameters(next_text_id_ - 1, width, rtl);
+    label = std::string("GetBuffer cached ") + name;
+    Measure(label.c_str(), kIterations, [&](int32_t) {
+      font_manager_->ReleaseBuffer(get_buffer(parameters));
+    });
+    font_manager_->ReleaseBuffer(cached);
+  }
+
+  fplbase::Renderer renderer_;
+  fplbase::InputSystem input_;
+  fplbase::AssetManager *assetman_;
+  flatui::FontManager *font_manager_;
+  flatui::HashedId next_text_id_;
+};
+
+TEST_F(FlatUIPipelineBenchmark, GetBuffer) {
+  const char kShort[] = "Play Game";
+  const char kParagraph[] =
+      "FlatUI is an immediate mode C++ GUI library for games and graphical "
+      "applications. Its aim is to be simple, efficient, and easy to use. "
+      "Besides the library itself, FlatUI also comes with a FontManager that "
+      "renders text with HarfBuzz and FreeType, line breaking and "
+      "hyphenation, signed distance fields and a glyph cache that keeps the "
+      "glyphs in use in a texture atlas shared by all texts.";
+  const char kCJK[] =
+      "\xE3\x81\x93\xE3\x82\x93\xE3\x81\xAB\xE3\x81\xA1\xE3\x81\xAF\xE4\xB8"
+      "\x96\xE7\x95\x8C\xE3\x80\x82\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E\xE3"
+      "\x81\xAE\xE6\x96\x87\xE7\xAB\xA0\xE3\x82\x92\xE8\xA1\xA8\xE7\xA4\xBA"
+      "\xE3\x81\x97\xE3\x81\xBE\xE3\x81\x99\xE3\x80\x82\xE6\xBC\xA2\xE5\xAD"
+      "\x97\xE3\x80\x81\xE3\x81\xB2\xE3\x82\x89\xE3\x81\x8C\xE3\x81\xAA\xE3"
+      "\x80\x81\xE3\x82\xAB\xE3\x82\xBF\xE3\x82\xAB\xE3\x83\x8A\xE3\x80\x82";
+  const char kRTL[] =
+      "\xD9\x85\xD8\xB1\xD8\xAD\xD8\xA8\xD8\xA7 \xD8\xA8\xD8\xA7\xD9\x84\xD8"
+      "\xB9\xD8\xA7\xD9\x84\xD9\x85 \xD9\x87\xD8\xB0\xD8\xA7 \xD9\x86\xD8\xB5"
+      " \xD8\xB9\xD8\xB1\xD8\xA8\xD9\x8A \xD9\x85\xD9\x86 \xD8\xA7\xD9\x84"
+      "\xD9\x8A\xD9\x85\xD9\x8A\xD9\x86 \xD8\xA5\xD9\x84\xD9\x89 \xD8\xA7"
+      "\xD9\x84\xD9\x8A\xD8\xB3\xD8\xA7\xD8\xB1";
+  const char kHtml[] =
+      "<p>FlatUI renders <b>basic</b> HTML, with <a href=\"link1\">links</a> "
+      "and paragraphs.</p><p>A second paragraph with "
+      "<a href=\"link2\">another link</a>.<br>And a line break.</p>";
+
+  MeasureGetBuffer("short", kShort, 0, false, false);
+  MeasureGetBuffer("paragraph", kParagraph, 600, false, false);
+  MeasureGetBuffer("CJK", kCJK, 600, false, false);
+  MeasureGetBuffer("HTML", kHtml, 600, false, true);
+
+  font_manager_->SetLocale("ar");
+  font_manager_->SelectFont("fonts/NotoNaskhArabic-Regular.ttf");
+  MeasureGetBuffer("RTL", kRTL, 600, true, false);
+}
+
+// Frames laying out a sliding window of labels in a small glyph cache, so that
+// glyphs of labels that left the window are evicted. With the compaction,
+// rows are freed up by moving glyphs instead of flushing the cache, and all
+// FontBuffers re-resolve their glyphs in following frames.
+TEST_F(FlatUIPipelineBenchmark, GlyphCacheCompaction) {
+  const int32_t kFrames = 200;
+  const int32_t kLabels = 32;
+  const int32_t kCharsPerLabel = 4;
+  const float kSizes[] = {16.0f, 24.0f, 32.0f, 48.0f};
+  const int32_t kNumSizes = sizeof(kSizes) / sizeof(kSizes[0]);
+
+  // Label i has CJK ideographs starting at U+4E00 + i * kCharsPerLabel.
+  auto label = [](int32_t index) {
+    std::string text;
+    for (int32_t c = 0; c < kCharsPerLabel; ++c) {
+      auto code_point = 0x4E00 + index * kCharsPerLabel + c;
+      text += static_cast<char>(0xE0 | (code_point >> 12));
+      text += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+      text += static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+    return text;
+  };
+
+  const bool kCompactions[] = {false, true};
+  const char *kNames[] = {"Sliding labels with flushes",
+                          "Sliding labels with compaction"};
+  for (size_t i = 0; i < sizeof(kCompactions) / sizeof(kCompactions[0]);
+       ++i) {
+    flatui::FontManager font_manager(mathfu::vec2i(256, 256), 1);
+    font_manager.Open("fonts/NotoSansCJKjp-Bold.otf");
+    font_manager.EnableGlyphCacheCompaction(kCompactions[i]);
+    font_manager.EnableTextPipelineStats(true);
+    Measure(kNames[i], kFrames, [&](int32_t frame) {
+      font_manager.StartLayoutPass();
+      for (int32_t l = frame; l < frame + kLabels; ++l) {
+        auto text = label(l);
+        flatui::FontBufferParameters parameters(
+            font_manager.GetCurrentFont()->GetFontId(),
+            flatui::HashId(text.c_str()), kSizes[l % kNumSizes],
+            mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+            flatui::kGlyphFlagsNone, false, false);
+        font_manager.GetBuffer(text.c_str(), text.length(), parameters);
+      }
+      font_manager.StartRenderPass();
+    });
+    printf("          %llu glyphs rasterized\n",
+           static_cast<unsigned long long>(
+               font_manager.GetTextPipelineStats().glyph_sets));
+  }
+}
+
+// A frame of `flatui::Run()` with a list of labels and buttons.
+TEST_F(FlatUIPipelineBenchmark, RunFrame) {
+  const int32_t kFrames = 100;
+  const int32_t kWidgetCounts[] = {10, 100, 1000};
+
+  for (auto count : kWidgetCounts) {
+    std::vector<std::string> texts;
+    for (int32_t i = 0; i < count; ++i) {
+      texts.push_back("Item " + flatbuffers::NumToString(i));
+    }
+    auto gui = [&]() {
+      flatui::SetVirtualResolution(1000);
+      flatui::StartGroup(flatui::kLayoutVerticalLeft, 2.0f, "list");
+      for (int32_t i = 0; i < count; ++i) {
+        if (i % 2) {
+          flatui::Label(texts[i].c_str(), 16.0f);
+        } else {
+          flatui::TextButton(texts[i].c_str(), 16.0f, flatui::Margin(2.0f));
+        }
+      }
+      flatui::EndGroup();
+    };
+
+    // Warm up the glyph and FontBuffer caches, so that steady state frames
+    // are measured.
+    flatui::Run(*assetman_, *font_manager_, input_, gui);
+
+    char name[64];
+    snprintf(name, sizeof(name), "Run %d widgets", count);
+    Measure(name, kFrames, [&](int32_t) {
+      flatui::Run(*assetman_, *font_manager_, input_, gui);
+    });
+  }
+}
+
+// Frames of the first menu of the serialization sample.
+TEST_F(FlatUIPipelineBenchmark, CreateFlatUIFromData) {
+  const int32_t kFrames = 1000;
+  // custom_widgets::Type_ChangeMenuButton of the serialization sample.
+  const uint32_t kChangeMenuButton = 0;
+
+  std::string json, schema, custom_widgets;
+  ASSERT_TRUE(flatbuffers::LoadFile("serialization/first_menu.json", false,
+                                    &json) &&
+              flatbuffers::LoadFile("schemas/custom_widgets.fbs", false,
+                                    &custom_widgets) &&
+              flatbuffers::LoadFile("schemas/flatui.fbs", false, &schema));
+  flatbuffers::Parser parser;
+  const char *include_directories[] = {"schemas", nullptr};
+  ASSERT_TRUE(parser.Parse(schema.c_str(), include_directories) &&
+              parser.Parse(custom_widgets.c_str()) &&
+              parser.Parse(json.c_str()));
+  auto data = parser.builder_.GetBufferPointer();
+
+  flatui::RegisterCustomWidget(
+      kChangeMenuButton,
+      [](const flatui_data::FlatUIElement *element, fplbase::AssetManager *,
+         flatui::FlatUIHandler, flatui::DynamicData *) {
+        flatui::StartGroup(flatui::kLayoutVerticalLeft);
+        flatui::TextButton(element->text()->c_str(), element->size(),
+                           flatui::Margin(2.0f));
+        flatui::EndGroup();
+      });
+  std::string edit_text("Edit me!");
+  flatui::RegisterStringData("first menu edit text", &edit_text);
+
+  // Load textures of the menu before measuring.
+  flatui::Run(*assetman_, *font_manager_, input_,
+              [&]() { flatui::CreateFlatUIFromData(data, assetman_); });
+  while (!assetman_->TryFinalize()) {
+    renderer_.AdvanceFrame(input_.minimized(), input_.Time());
+  }
+
+  Measure("CreateFlatUIFromData first_menu", kFrames, [&](int32_t) {
+    flatui::Run(*assetman_, *font_manager_, input_,
+                [&]() { flatui::CreateFlatUIFromData(data, assetman_); });
+  });
+
+  flatui::CompiledFlatUI compiled;
+  ASSERT_TRUE(compiled.Compile(data, assetman_));
+  Measure("CompiledFlatUI first_menu", kFrames, [&](int32_t) {
+    flatui::Run(*assetman_, *font_manager_, input_,
+                [&]() { compiled.Create(); });
+  });
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Dummy entry to link the benchmarks in Android successfully.
+extern "C" int FPL_main(int /*argc*/, char ** /*argv*/) { return 0; }
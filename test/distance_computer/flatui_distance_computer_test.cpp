@@ -0,0 +1,361 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+// Freetype2 header
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "fplbase/utilities.h"
+#include "flatui/internal/antialias_distance_computer.h"
+#include "flatui/internal/euclidean_distance_computer.h"
+#include "flatui/internal/fast_antialias_distance_computer.h"
+#include "flatui/internal/gpu_distance_computer.h"
+#include "flatui/internal/msdf_generator.h"
+#include "flatui/internal/simd_antialias_distance_computer.h"
+#include "gtest/gtest.h"
+
+using flatui::Grid;
+
+class FlatUIDistanceComputerTest : public ::testing::Test {
+ protected:
+  // Create an antialiased image of a ring, which has edges in all directions
+  // on both sides.
+  std::vector<uint8_t> CreateRing(const mathfu::vec2i &size) {
+    std::vector<uint8_t> image(size.x * size.y);
+    const float kSubSamples = 4.0f;
+    auto center = mathfu::vec2(size) * 0.5f;
+    auto outer = std::min(size.x, size.y) * 0.45f;
+    auto inner = outer * 0.5f;
+    for (int32_t y = 0; y < size.y; ++y) {
+      for (int32_t x = 0; x < size.x; ++x) {
+        int32_t coverage = 0;
+        for (int32_t sy = 0; sy < kSubSamples; ++sy) {
+          for (int32_t sx = 0; sx < kSubSamples; ++sx) {
+            auto p = mathfu::vec2((x + (sx + 0.5f) / kSubSamples),
+                                  (y + (sy + 0.5f) / kSubSamples));
+            auto d = (p - center).Length();
+            coverage += d < outer && d > inner;
+          }
+        }
+        image[x + y * size.x] = static_cast<uint8_t>(
+            coverage * 255 / static_cast<int32_t>(kSubSamples * kSubSamples));
+      }
+    }
+    return image;
+  }
+
+  // Create an SDF of the ring created by CreateRing() from analytic distances
+  // to its edges.
+  std::vector<uint8_t> CreateRingDistances(const mathfu::vec2i &size,
+                                           flatui::GlyphFlags flags) {
+    const int32_t kPadding = flatui::kGlyphCachePaddingSDF;
+    auto dest_size = size + mathfu::vec2i(kPadding * 2, kPadding * 2);
+    std::vector<uint8_t> sdf(dest_size.x * dest_size.y);
+    auto center = mathfu::vec2(size) * 0.5f;
+    auto outer = std::min(size.x, size.y) * 0.45f;
+    auto inner = outer * 0.5f;
+    for (int32_t y = 0; y < dest_size.y; ++y) {
+      for (int32_t x = 0; x < dest_size.x; ++x) {
+        auto p = mathfu::vec2(x - kPadding + 0.5f, y - kPadding + 0.5f);
+        auto r = (p - center).Length();
+        auto distance = 0.0f;
+        if (r > outer) {
+          distance = r - outer;
+        } else if (r < inner) {
+          distance = inner - r;
+        } else if (flags & flatui::kGlyphFlagsInnerSDF) {
+          distance = -std::min(outer - r, r - inner);
+        }
+        sdf[x + y * dest_size.x] = static_cast<uint8_t>(
+            mathfu::Clamp(distance * -16.0f + 127.0f, 0.0f, 255.0f));
+      }
+    }
+    return sdf;
+  }
+
+  // Compute an SDF of the image with a computer.
+  std::vector<uint8_t> Compute(flatui::DistanceComputer<uint8_t> *computer,
+                               std::vector<uint8_t> *image,
+                               const mathfu::vec2i &size,
+                               flatui::GlyphFlags flags) {
+    const int32_t kPadding = flatui::kGlyphCachePaddingSDF;
+    auto dest_size = size + mathfu::vec2i(kPadding * 2, kPadding * 2);
+    std::vector<uint8_t> sdf(dest_size.x * dest_size.y);
+    Grid<uint8_t> src(image->data(), size, kPadding, size.x);
+    Grid<uint8_t> dest(sdf.data(), dest_size, 0, dest_size.x);
+    computer->Compute(src, &dest, flags);
+    return sdf;
+  }
+
+  // Compute SDFs of the image with the scalar and vectorized computers and
+  // returns the max difference.
+  int32_t Compare(std::vector<uint8_t> *image, const mathfu::vec2i &size,
+                  flatui::GlyphFlags flags) {
+    flatui::FastAntialiasDistanceComputer<uint8_t> scalar;
+    flatui::SimdAntialiasDistanceComputer simd;
+    return MaxDifference(Compute(&scalar, image, size, flags),
+                         Compute(&simd, image, size, flags));
+  }
+
+  static int32_t MaxDifference(const std::vector<uint8_t> &a,
+                               const std::vector<uint8_t> &b) {
+    int32_t max_difference = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+      max_difference = std::max(max_difference, abs(a[i] - b[i]));
+    }
+    return max_difference;
+  }
+};
+
+// Vectorized kernels produce same distances as scalar ones.
+TEST_F(FlatUIDistanceComputerTest, TestSimdOuterDistance) {
+  // Use widths that aren't multiple of 4, to exercise the remainder loops.
+  const mathfu::vec2i kSizes[] = {mathfu::vec2i(32, 32), mathfu::vec2i(13, 21),
+                                  mathfu::vec2i(70, 45)};
+  for (auto &size : kSizes) {
+    auto image = CreateRing(size);
+    EXPECT_GE(1, Compare(&image, size, flatui::kGlyphFlagsOuterSDF));
+  }
+}
+
+TEST_F(FlatUIDistanceComputerTest, TestSimdInnerDistance) {
+  const mathfu::vec2i kSizes[] = {mathfu::vec2i(32, 32), mathfu::vec2i(13, 21),
+                                  mathfu::vec2i(70, 45)};
+  for (auto &size : kSizes) {
+    auto image = CreateRing(size);
+    EXPECT_GE(1, Compare(&image, size,
+                         static_cast<flatui::GlyphFlags>(
+                             flatui::kGlyphFlagsOuterSDF |
+                             flatui::kGlyphFlagsInnerSDF)));
+  }
+}
+
+// Euclidean distance transform is exact for binary images.
+TEST_F(FlatUIDistanceComputerTest, TestEuclideanBinaryImage) {
+  // Left half is covered.
+  const mathfu::vec2i kSize(16, 16);
+  std::vector<uint8_t> image(kSize.x * kSize.y);
+  for (int32_t y = 0; y < kSize.y; ++y) {
+    for (int32_t x = 0; x < kSize.x / 2; ++x) {
+      image[x + y * kSize.x] = 255;
+    }
+  }
+  flatui::EuclideanDistanceComputer<uint8_t> computer;
+  auto sdf = Compute(&computer, &image, kSize,
+                     static_cast<flatui::GlyphFlags>(
+                         flatui::kGlyphFlagsOuterSDF |
+                         flatui::kGlyphFlagsInnerSDF));
+
+  // Pixels around the center edge are (x - edge) away from it, in the padded
+  // image.
+  const int32_t kPadding = flatui::kGlyphCachePaddingSDF;
+  const int32_t kWidth = kSize.x + kPadding * 2;
+  const int32_t edge = kPadding + kSize.x / 2;
+  for (int32_t x = edge - 4; x < kWidth; ++x) {
+    auto distance = x + 0.5f - edge;
+    auto expected = mathfu::Clamp(distance * -16.0f + 127.0f, 0.0f, 255.0f);
+    EXPECT_EQ(static_cast<int32_t>(expected),
+              sdf[x + (kPadding + kSize.y / 2) * kWidth]);
+  }
+}
+
+// Euclidean distance transform approximates distances of antialiased images
+// within a pixel, and at least as well as the propagation based computer.
+TEST_F(FlatUIDistanceComputerTest, TestEuclideanRing) {
+  const mathfu::vec2i kSize(48, 48);
+  auto image = CreateRing(kSize);
+  flatui::FastAntialiasDistanceComputer<uint8_t> fast;
+  flatui::EuclideanDistanceComputer<uint8_t> euclidean;
+  const flatui::GlyphFlags kFlags[] = {
+      flatui::kGlyphFlagsOuterSDF,
+      static_cast<flatui::GlyphFlags>(flatui::kGlyphFlagsOuterSDF |
+                                      flatui::kGlyphFlagsInnerSDF)};
+  for (auto flags : kFlags) {
+    auto expected = CreateRingDistances(kSize, flags);
+    auto euclidean_error =
+        MaxDifference(expected, Compute(&euclidean, &image, kSize, flags));
+    EXPECT_GE(16, euclidean_error);
+    EXPECT_GE(MaxDifference(expected, Compute(&fast, &image, kSize, flags)),
+              euclidean_error);
+  }
+}
+
+// Computers reusing scratch buffers from larger images produce same distances
+// as fresh ones.
+TEST_F(FlatUIDistanceComputerTest, TestReusedBuffers) {
+  const mathfu::vec2i kLargeSize(70, 45);
+  const mathfu::vec2i kSmallSize(13, 21);
+  const auto kFlags = static_cast<flatui::GlyphFlags>(
+      flatui::kGlyphFlagsOuterSDF | flatui::kGlyphFlagsInnerSDF);
+  auto large_image = CreateRing(kLargeSize);
+  auto small_image = CreateRing(kSmallSize);
+
+  flatui::AntialiasDistanceComputer<uint8_t> antialias;
+  flatui::FastAntialiasDistanceComputer<uint8_t> fast;
+  flatui::SimdAntialiasDistanceComputer simd;
+  flatui::EuclideanDistanceComputer<uint8_t> euclidean;
+  flatui::DistanceComputer<uint8_t> *computers[] = {&antialias, &fast, &simd,
+                                                   &euclidean};
+  for (auto computer : computers) {
+    auto expected = Compute(computer, &small_image, kSmallSize, kFlags);
+    computer->Reserve(kLargeSize);
+    Compute(computer, &large_image, kLargeSize, kFlags);
+    EXPECT_EQ(expected, Compute(computer, &small_image, kSmallSize, kFlags));
+  }
+}
+
+// GPU distance computer computes Euclidean distances in the CPU when it's
+// used through the DistanceComputer interface.
+TEST_F(FlatUIDistanceComputerTest, TestGpuFallback) {
+  const mathfu::vec2i kSize(30, 24);
+  const auto kFlags = static_cast<flatui::GlyphFlags>(
+      flatui::kGlyphFlagsOuterSDF | flatui::kGlyphFlagsInnerSDF);
+  auto image = CreateRing(kSize);
+  flatui::GpuDistanceComputer gpu;
+  flatui::EuclideanDistanceComputer<uint8_t> euclidean;
+  EXPECT_EQ(Compute(&euclidean, &image, kSize, kFlags),
+            Compute(&gpu, &image, kSize, kFlags));
+  EXPECT_EQ(&gpu, gpu.get_gpu_computer());
+  EXPECT_EQ(nullptr, euclidean.get_gpu_computer());
+}
+
+// Multi-channel SDF keeps corners of a square sharp when it's magnified, in
+// both contour orientations.
+TEST_F(FlatUIDistanceComputerTest, TestMultiChannelSDF) {
+  const int32_t kSize = 24;
+  const int32_t kChannels = flatui::kMsdfChannels;
+  const mathfu::vec2 kCorners[] = {
+      mathfu::vec2(4.0f, 4.0f), mathfu::vec2(20.0f, 4.0f),
+      mathfu::vec2(20.0f, 20.0f), mathfu::vec2(4.0f, 20.0f)};
+  // Median of bilinearly interpolated channels, as the shader samples it.
+  auto sample = [](const std::vector<uint8_t> &image, float x, float y) {
+    auto x0 = static_cast<int32_t>(floorf(x - 0.5f));
+    auto y0 = static_cast<int32_t>(floorf(y - 0.5f));
+    auto fx = x - 0.5f - x0;
+    auto fy = y - 0.5f - y0;
+    float c[3];
+    for (int32_t i = 0; i < 3; ++i) {
+      auto p = &image[(x0 + y0 * kSize) * kChannels + i];
+      auto q = p + kSize * kChannels;
+      c[i] = (p[0] * (1.0f - fx) + p[kChannels] * fx) * (1.0f - fy) +
+             (q[0] * (1.0f - fx) + q[kChannels] * fx) * fy;
+    }
+    return std::max(std::min(c[0], c[1]),
+                    std::min(std::max(c[0], c[1]), c[2]));
+  };
+  for (int32_t clockwise = 0; clockwise < 2; ++clockwise) {
+    flatui::MsdfGenerator generator;
+    generator.MoveTo(kCorners[0]);
+    for (int32_t i = 1; i < 4; ++i) {
+      generator.LineTo(kCorners[clockwise ? i : 4 - i]);
+    }
+    std::vector<uint8_t> image(kSize * kSize * kChannels);
+    generator.Generate(image.data(), mathfu::vec2i(kSize, kSize), kSize);
+    // The contour is closed with the 4th edge.
+    EXPECT_EQ(4U, generator.get_num_edges());
+
+    // All channels are inside at the center, and outside at the image corner.
+    auto center = &image[(12 + 12 * kSize) * kChannels];
+    for (int32_t i = 0; i < kChannels; ++i) {
+      EXPECT_LT(127, center[i]);
+      EXPECT_GT(127, image[i]);
+    }
+
+    // Reconstructed shape matches the square in 8x magnification.
+    int32_t errors = 0;
+    for (float y = 2.0f; y < 22.0f; y += 0.125f) {
+      for (float x = 2.0f; x < 22.0f; x += 0.125f) {
+        auto distance = (sample(image, x, y) - 127.5f) / 16.0f;
+        if (fabsf(distance) < 0.15f) continue;
+        bool inside = x > 4.0f && x < 20.0f && y > 4.0f && y < 20.0f;
+        errors += inside != (distance > 0.0f);
+      }
+    }
+    EXPECT_EQ(0, errors);
+  }
+}
+
+// Compares all distance computers on real glyph bitmaps.
+// Disabled by default, run with --gtest_also_run_disabled_tests.
+TEST_F(FlatUIDistanceComputerTest, DISABLED_BenchmarkGlyphs) {
+  ASSERT_TRUE(fplbase::ChangeToUpstreamDir("../", "assets"));
+  FT_Library ft;
+  FT_Face face;
+  ASSERT_EQ(0, FT_Init_FreeType(&ft));
+  ASSERT_EQ(0, FT_New_Face(ft, "fonts/Roboto-Regular.ttf", 0, &face));
+
+  flatui::AntialiasDistanceComputer<uint8_t> antialias;
+  flatui::FastAntialiasDistanceComputer<uint8_t> fast;
+  flatui::SimdAntialiasDistanceComputer simd;
+  flatui::EuclideanDistanceComputer<uint8_t> euclidean;
+  struct Computer {
+    const char *name;
+    flatui::DistanceComputer<uint8_t> *computer;
+  };
+  const Computer kComputers[] = {{"Antialias", &antialias},
+                                 {"FastAntialias", &fast},
+                                 {"SimdAntialias", &simd},
+                                 {"Euclidean", &euclidean}};
+  const int32_t kGlyphSizes[] = {32, 64, 128};
+  const char kText[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+  const auto kFlags = static_cast<flatui::GlyphFlags>(
+      flatui::kGlyphFlagsOuterSDF | flatui::kGlyphFlagsInnerSDF);
+
+  for (auto glyph_size : kGlyphSizes) {
+    // Render all glyphs first so that only the SDF generation is measured.
+    FT_Set_Pixel_Sizes(face, 0, glyph_size);
+    std::vector<std::vector<uint8_t>> images;
+    std::vector<mathfu::vec2i> sizes;
+    for (auto c = kText; *c; ++c) {
+      ASSERT_EQ(0, FT_Load_Char(face, *c, FT_LOAD_RENDER));
+      auto &bitmap = face->glyph->bitmap;
+      mathfu::vec2i size(bitmap.width, bitmap.rows);
+      std::vector<uint8_t> image(size.x * size.y);
+      for (int32_t y = 0; y < size.y; ++y) {
+        std::copy(bitmap.buffer + y * bitmap.pitch,
+                  bitmap.buffer + y * bitmap.pitch + size.x,
+                  image.begin() + y * size.x);
+      }
+      images.push_back(std::move(image));
+      sizes.push_back(size);
+    }
+    for (auto &c : kComputers) {
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < images.size(); ++i) {
+        Compute(c.computer, &images[i], sizes[i], kFlags);
+      }
+      std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+      printf("%4dpx %-14s %8.3f ms/glyph\n", glyph_size, c.name,
+             elapsed.count() / images.size());
+    }
+  }
+
+  FT_Done_Face(face);
+  FT_Done_FreeType(ft);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Dummy entry to link the test in Android successfully.
+extern "C" int FPL_main(int /*argc*/, char ** /*argv*/) { return 0; }
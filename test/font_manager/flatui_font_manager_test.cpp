@@ -0,0 +1,810 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Freetype2 header
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "flatui/font_manager.h"
+#include "flatui/internal/codepoint_coverage.h"
+#include "flatui/internal/flatui_util.h"
+#include "flatui/internal/hb_complex_font.h"
+#include "fplbase/renderer.h"
+#include "fplbase/utilities.h"
+#include "fplutil/main.h"
+#include "gtest/gtest.h"
+
+// Tests of memory management and resource sharing of FontManager.
+class FlatUIFontManagerTest : public ::testing::Test {
+ public:
+  MATHFU_DEFINE_CLASS_SIMD_AWARE_NEW_DELETE
+
+ protected:
+  virtual void SetUp() {
+    renderer_.Initialize(mathfu::vec2i(800, 600), "FlatUI test");
+
+    font_manager_ = new flatui::FontManager(mathfu::vec2i(256, 256), 2);
+
+    // Set the local directory to the assets folder for this sample.
+    bool result = fplbase::ChangeToUpstreamDir("../", "assets");
+    assert(result);
+    (void)result;
+
+    font_manager_->Open("fonts/NotoSansCJKjp-Bold.otf");
+  }
+
+  virtual void TearDown() {
+    delete font_manager_;
+    renderer_.ShutDown();
+  }
+
+  fplbase::Renderer renderer_;
+  flatui::FontManager *font_manager_;
+};
+
+// Memory usage is reported per category, and trimmed or capped with budgets.
+TEST_F(FlatUIFontManagerTest, TestMemoryUsage) {
+  const char text[] = "Lorem ipsum dolor sit amet";
+  auto parameter = flatui::FontBufferParameters(
+      font_manager_->GetCurrentFont()->GetFontId(), flatui::HashId(text),
+      static_cast<float>(48), mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+      flatui::kGlyphFlagsNone, true, false);
+  ASSERT_NE(nullptr, font_manager_->GetBuffer(text, strlen(text), parameter));
+
+  auto usage = font_manager_->GetMemoryUsage();
+  EXPECT_LE(256U * 256, usage.atlas_monochrome);
+  EXPECT_LT(0U, usage.glyph_entries);
+  EXPECT_LT(0U, usage.font_buffers);
+  EXPECT_LT(0U, usage.mapped_font_data + usage.copied_font_data);
+  EXPECT_LT(0U, usage.harfbuzz_fonts);
+  EXPECT_LT(0U, usage.layout_caches);
+  EXPECT_LT(usage.font_buffers + usage.atlas_monochrome, usage.total());
+
+  // Buffers used in the current or the previous pass are kept.
+  font_manager_->TrimMemory(flatui::kMemoryTrimLevelModerate);
+  EXPECT_EQ(usage.font_buffers, font_manager_->GetMemoryUsage().font_buffers);
+
+  for (int32_t i = 0; i < 2; ++i) {
+    font_manager_->StartLayoutPass();
+    font_manager_->StartRenderPass();
+  }
+  font_manager_->TrimMemory(flatui::kMemoryTrimLevelComplete);
+  usage = font_manager_->GetMemoryUsage();
+  EXPECT_EQ(0U, usage.font_buffers);
+  EXPECT_EQ(0U, usage.layout_caches);
+
+  flatui::FontMemoryBudget budget;
+  budget.font_buffers = 1024;
+  budget.atlas = 256 * 256;
+  font_manager_->SetMemoryBudget(budget);
+  EXPECT_EQ(1024U, font_manager_->GetFontBufferCacheBudget());
+  EXPECT_EQ(256U * 256, font_manager_->GetMemoryBudget().atlas);
+  EXPECT_EQ(flatui::kMemoryBudgetUnlimited,
+            font_manager_->GetMemoryBudget().fallback_font_data);
+}
+
+// FontManagers created from shared resources share faces and glyphs.
+TEST_F(FlatUIFontManagerTest, TestSharedResources) {
+  auto resources = font_manager_->GetSharedResources();
+  ASSERT_NE(nullptr, resources.get());
+  std::unique_ptr<flatui::FontManager> font_manager2(
+      new flatui::FontManager(resources));
+  EXPECT_FALSE(font_manager2->FontLoaded());
+
+  // The font opened by the first manager is selected in the second one
+  // without mapping it again.
+  auto usage = font_manager_->GetMemoryUsage();
+  ASSERT_TRUE(font_manager2->Open("fonts/NotoSansCJKjp-Bold.otf"));
+  EXPECT_TRUE(font_manager2->FontLoaded());
+  EXPECT_EQ(usage.mapped_font_data + usage.copied_font_data,
+            font_manager2->GetMemoryUsage().mapped_font_data +
+                font_manager2->GetMemoryUsage().copied_font_data);
+
+  const char text[] = "Lorem ipsum dolor sit amet";
+  auto parameter = flatui::FontBufferParameters(
+      font_manager_->GetCurrentFont()->GetFontId(), flatui::HashId(text),
+      static_cast<float>(48), mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+      flatui::kGlyphFlagsNone, true, false);
+  ASSERT_NE(nullptr, font_manager_->GetBuffer(text, strlen(text), parameter));
+  font_manager_->StartLayoutPass();
+  font_manager_->StartRenderPass();
+
+  // Glyphs rasterized for the first manager are found in the shared cache.
+  font_manager2->EnableTextPipelineStats(true);
+  auto buffer = font_manager2->GetBuffer(text, strlen(text), parameter);
+  ASSERT_NE(nullptr, buffer);
+  auto stats = font_manager2->GetTextPipelineStats();
+  EXPECT_LT(0U, stats.glyph_hits);
+  EXPECT_EQ(0U, stats.glyph_misses);
+  EXPECT_EQ(font_manager_->GetMemoryUsage().atlas_monochrome,
+            font_manager2->GetMemoryUsage().atlas_monochrome);
+
+  // The glyph cache ticks once per pass of the managers.
+  font_manager2->StartLayoutPass();
+  font_manager2->StartRenderPass();
+  EXPECT_EQ(flatui::kFontBufferStatusReady,
+            font_manager2->GetFontBufferStatus(*buffer));
+
+  // Faces stay open until both managers close them, and the resources are
+  // released with the last manager.
+  font_manager_->Close("fonts/NotoSansCJKjp-Bold.otf");
+  EXPECT_TRUE(font_manager2->SelectFont("fonts/NotoSansCJKjp-Bold.otf"));
+  font_manager2.reset();
+  EXPECT_EQ(2, resources.use_count());
+}
+
+// Non-ref-counted buffers are evicted in LRU order when the cache exceeds its
+// budget, except buffers used in the current or the previous pass.
+TEST_F(FlatUIFontManagerTest, TestFontBufferCacheEviction) {
+  const char *texts[] = {"Text one", "Text two", "Text six"};
+  std::vector<flatui::FontBufferParameters> parameters;
+  for (size_t i = 0; i < 3; ++i) {
+    parameters.push_back(flatui::FontBufferParameters(
+        font_manager_->GetCurrentFont()->GetFontId(), flatui::HashId(texts[i]),
+        static_cast<float>(32), mathfu::vec2i(0, 0),
+        flatui::kTextAlignmentLeft, flatui::kGlyphFlagsNone, false, false));
+  }
+  auto get_buffer = [&](size_t i) {
+    return font_manager_->GetBuffer(texts[i], strlen(texts[i]), parameters[i]);
+  };
+  auto &stats = font_manager_->GetFontBufferCacheStats();
+  for (size_t i = 0; i < 3; ++i) {
+    ASSERT_NE(nullptr, get_buffer(i));
+  }
+  EXPECT_EQ(3u, stats.misses);
+  EXPECT_EQ(0u, stats.hits);
+  EXPECT_EQ(3u, stats.num_buffers);
+  EXPECT_LT(0u, stats.bytes);
+
+  // Buffers used in the current pass are kept.
+  auto bytes = stats.bytes;
+  font_manager_->SetFontBufferCacheBudget(1);
+  EXPECT_EQ(0u, stats.evictions);
+  EXPECT_EQ(3u, stats.num_buffers);
+  EXPECT_EQ(bytes, stats.bytes);
+  font_manager_->SetFontBufferCacheBudget(flatui::kFontBufferCacheUnlimited);
+
+  // Buffers used in the previous pass are kept as well.
+  font_manager_->StartLayoutPass();
+  font_manager_->StartRenderPass();
+  font_manager_->SetFontBufferCacheBudget(1);
+  EXPECT_EQ(0u, stats.evictions);
+  font_manager_->SetFontBufferCacheBudget(flatui::kFontBufferCacheUnlimited);
+
+  // Use the first buffer again, so that the second one is the least recently
+  // used, and evict a single buffer.
+  font_manager_->StartLayoutPass();
+  font_manager_->StartRenderPass();
+  ASSERT_NE(nullptr, get_buffer(0));
+  EXPECT_EQ(1u, stats.hits);
+  font_manager_->SetFontBufferCacheBudget(bytes - 1);
+  EXPECT_EQ(1u, stats.evictions);
+  EXPECT_EQ(2u, stats.num_buffers);
+  EXPECT_GE(bytes - 1, stats.bytes);
+  ASSERT_NE(nullptr, get_buffer(2));
+  EXPECT_EQ(2u, stats.hits);
+  EXPECT_EQ(3u, stats.misses);
+  ASSERT_NE(nullptr, get_buffer(1));
+  EXPECT_EQ(4u, stats.misses);
+
+  // Only buffers used in the current pass fit in a tiny budget. The counters
+  // are reset without touching the cache.
+  for (int32_t i = 0; i < 2; ++i) {
+    font_manager_->StartLayoutPass();
+    font_manager_->StartRenderPass();
+  }
+  ASSERT_NE(nullptr, get_buffer(1));
+  font_manager_->SetFontBufferCacheBudget(1);
+  EXPECT_EQ(1u, stats.num_buffers);
+  EXPECT_EQ(3u, stats.evictions);
+  font_manager_->ResetFontBufferCacheStats();
+  EXPECT_EQ(0u, stats.hits);
+  EXPECT_EQ(0u, stats.misses);
+  EXPECT_EQ(0u, stats.evictions);
+  EXPECT_EQ(1u, stats.num_buffers);
+  EXPECT_LT(0u, stats.bytes);
+}
+
+// Buffers laid out before a glyph cache flush patch their UVs in place, and
+// map glyphs to the same UVs as buffers laid out after the flush.
+TEST_F(FlatUIFontManagerTest, TestPatchUVAfterFlush) {
+  const char text[] = "Lorem ipsum dolor sit amet";
+  auto font_id = font_manager_->GetCurrentFont()->GetFontId();
+  auto parameter = flatui::FontBufferParameters(
+      font_id, flatui::HashId("patched"), static_cast<float>(48),
+      mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+      flatui::kGlyphFlagsNone, true, false);
+  const flatui::FontBuffer *buffer =
+      font_manager_->GetBuffer(text, strlen(text), parameter);
+  ASSERT_NE(nullptr, buffer);
+  auto vertices = buffer->get_vertices();
+  auto num_slices = buffer->get_slices().size();
+  auto num_ranges = buffer->get_glyph_ranges(0).size();
+
+  // Cache other glyphs first after the flush, so that glyphs of the buffer
+  // move in the slice.
+  font_manager_->FlushAndUpdate();
+  EXPECT_EQ(flatui::kFontBufferStatusNeedReconstruct,
+            font_manager_->GetFontBufferStatus(*buffer));
+  const char other[] = "The quick brown fox";
+  auto other_parameter = flatui::FontBufferParameters(
+      font_id, flatui::HashId(other), static_cast<float>(48),
+      mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+      flatui::kGlyphFlagsNone, true, false);
+  ASSERT_NE(nullptr,
+            font_manager_->GetBuffer(other, strlen(other), other_parameter));
+
+  // The buffer is updated in place.
+  EXPECT_EQ(buffer, font_manager_->GetBuffer(text, strlen(text), parameter));
+  EXPECT_NE(flatui::kFontBufferStatusNeedReconstruct,
+            font_manager_->GetFontBufferStatus(*buffer));
+  EXPECT_EQ(num_slices, buffer->get_slices().size());
+  EXPECT_EQ(num_ranges, buffer->get_glyph_ranges(0).size());
+  auto &patched = buffer->get_vertices();
+  ASSERT_EQ(vertices.size(), patched.size());
+  auto moved = false;
+  for (size_t i = 0; i < patched.size(); ++i) {
+    EXPECT_EQ(vertices[i].position_.data[0], patched[i].position_.data[0]);
+    EXPECT_EQ(vertices[i].position_.data[1], patched[i].position_.data[1]);
+    moved |= vertices[i].uv_.data[0] != patched[i].uv_.data[0] ||
+             vertices[i].uv_.data[1] != patched[i].uv_.data[1];
+  }
+  EXPECT_TRUE(moved);
+
+  // A buffer laid out now uses the same UVs.
+  parameter = flatui::FontBufferParameters(
+      font_id, flatui::HashId("fresh"), static_cast<float>(48),
+      mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+      flatui::kGlyphFlagsNone, true, false);
+  auto fresh = font_manager_->GetBuffer(text, strlen(text), parameter);
+  ASSERT_NE(nullptr, fresh);
+  ASSERT_EQ(fresh->get_vertices().size(), patched.size());
+  EXPECT_EQ(0, memcmp(fresh->get_vertices().data(), patched.data(),
+                      patched.size() * sizeof(patched[0])));
+}
+
+// Buffers laid out with glyph instances have an instance per glyph matching
+// its vertices, also after the UVs are patched by a glyph cache flush.
+TEST_F(FlatUIFontManagerTest, TestGlyphInstances) {
+  font_manager_->EnableGlyphInstances(true);
+  if (!font_manager_->GlyphInstancesEnabled()) {
+    // Instanced draws aren't supported by the renderer.
+    return;
+  }
+  auto expect_instances = [](const flatui::FontBuffer &buffer) {
+    auto &vertices = buffer.get_vertices();
+    auto &instances = buffer.get_glyph_instances();
+    ASSERT_EQ(vertices.size() / 4, instances.size());
+    for (size_t i = 0; i < instances.size(); ++i) {
+      flatui::GlyphInstance expected(&vertices[i * 4]);
+      EXPECT_EQ(0, memcmp(&expected, &instances[i], sizeof(expected))) << i;
+    }
+  };
+
+  const char text[] = "Lorem ipsum dolor sit amet";
+  auto font_id = font_manager_->GetCurrentFont()->GetFontId();
+  auto parameter = flatui::FontBufferParameters(
+      font_id, flatui::HashId("instanced"), static_cast<float>(48),
+      mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+      flatui::kGlyphFlagsNone, true, false);
+  const flatui::FontBuffer *buffer =
+      font_manager_->GetBuffer(text, strlen(text), parameter);
+  ASSERT_NE(nullptr, buffer);
+  EXPECT_TRUE(buffer->HasGlyphInstances());
+  EXPECT_FALSE(buffer->HasPackedVertices());
+  expect_instances(*buffer);
+
+  font_manager_->FlushAndUpdate();
+  const char other[] = "The quick brown fox";
+  auto other_parameter = flatui::FontBufferParameters(
+      font_id, flatui::HashId(other), static_cast<float>(48),
+      mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+      flatui::kGlyphFlagsNone, true, false);
+  ASSERT_NE(nullptr,
+            font_manager_->GetBuffer(other, strlen(other), other_parameter));
+  EXPECT_EQ(buffer, font_manager_->GetBuffer(text, strlen(text), parameter));
+  expect_instances(*buffer);
+
+  // Buffers laid out after the mode is disabled don't have instances.
+  font_manager_->EnableGlyphInstances(false);
+  parameter = flatui::FontBufferParameters(
+      font_id, flatui::HashId("vertices"), static_cast<float>(48),
+      mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+      flatui::kGlyphFlagsNone, true, false);
+  buffer = font_manager_->GetBuffer(text, strlen(text), parameter);
+  ASSERT_NE(nullptr, buffer);
+  EXPECT_FALSE(buffer->HasGlyphInstances());
+}
+
+// Values are hashed without over-reading small types, and 0 is a valid input.
+TEST_F(FlatUIFontManagerTest, TestHashCombine) {
+  struct {
+    bool value;
+    uint8_t padding[3];
+  } a = {true, {0, 0, 0}}, b = {true, {1, 2, 3}};
+  EXPECT_EQ(flatui::HashCombine<bool>(0, a.value),
+            flatui::HashCombine<bool>(0, b.value));
+  EXPECT_NE(flatui::HashCombine<bool>(0, true),
+            flatui::HashCombine<bool>(0, false));
+  EXPECT_NE(flatui::HashCombine<int32_t>(0, 0),
+            flatui::HashCombine<int32_t>(1, 0));
+
+  // Parameters of different texts have different hashes.
+  auto parameter = flatui::FontBufferParameters(
+      font_manager_->GetCurrentFont()->GetFontId(), flatui::HashId("a"),
+      static_cast<float>(32), mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+      flatui::kGlyphFlagsNone, false, false);
+  auto parameter2 = parameter;
+  EXPECT_EQ(parameter(parameter), parameter(parameter2));
+  parameter2 = flatui::FontBufferParameters(
+      font_manager_->GetCurrentFont()->GetFontId(), flatui::HashId("b"),
+      static_cast<float>(32), mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+      flatui::kGlyphFlagsNone, false, false);
+  EXPECT_NE(parameter(parameter), parameter(parameter2));
+}
+
+// Codepoints read from the cmap table of a font file, without opening the
+// face, are the ones recorded from the FreeType face.
+TEST_F(FlatUIFontManagerTest, TestCmapCoverage) {
+  FT_Library ft;
+  ASSERT_EQ(0, FT_Init_FreeType(&ft));
+  const char *fonts[] = {
+      "fonts/LuckiestGuy.ttf",           "fonts/NotoColorEmoji.ttf",
+      "fonts/NotoNaskhArabic-Regular.ttf", "fonts/NotoSansCJKjp-Bold.otf",
+      "fonts/NovaRound.ttf",             "fonts/Roboto-Regular.ttf",
+  };
+  for (size_t i = 0; i < sizeof(fonts) / sizeof(fonts[0]); ++i) {
+    flatui::FontFamily family(fonts[i]);
+    flatui::FaceData opened;
+    ASSERT_TRUE(opened.Open(ft, family)) << fonts[i];
+    flatui::FaceData lazy;
+    ASSERT_TRUE(lazy.LoadCmap(family)) << fonts[i];
+    EXPECT_FALSE(lazy.is_loaded());
+    EXPECT_EQ(opened.get_font_id(), lazy.get_font_id());
+
+    // Opening the face later keeps the coverage.
+    for (auto pass = 0; pass < 2; ++pass) {
+      auto &expected = opened.get_coverage();
+      auto &coverage = lazy.get_coverage();
+      EXPECT_FALSE(coverage.empty());
+      for (uint32_t c = 0; c <= 0x10ffff; ++c) {
+        if (expected.Contains(c) != coverage.Contains(c)) {
+          ADD_FAILURE() << fonts[i] << " U+" << std::hex << c;
+          break;
+        }
+      }
+      if (pass == 0) {
+        ASSERT_TRUE(lazy.Open(ft, family));
+        EXPECT_TRUE(lazy.is_loaded());
+      }
+    }
+    opened.Close();
+    lazy.Close();
+  }
+
+  const char kNotFont[] = "not a font file";
+  flatui::CodepointCoverage coverage;
+  EXPECT_FALSE(coverage.InsertFontCmap(kNotFont, sizeof(kNotFont), 0));
+  EXPECT_TRUE(coverage.empty());
+  FT_Done_FreeType(ft);
+}
+
+// Codepoints map to the first face covering them, including faces after the
+// ones stored in the face map.
+TEST_F(FlatUIFontManagerTest, TestFallbackFaceMap) {
+  std::vector<flatui::CodepointCoverage> coverages(300);
+  std::vector<const flatui::CodepointCoverage *> faces;
+  for (uint32_t i = 0; i < coverages.size(); ++i) {
+    // Faces overlap, and cover a codepoint out of the BMP.
+    for (uint32_t c = i * 7; c < i * 7 + 10; ++c) coverages[i].Insert(c);
+    coverages[i].Insert(0x20000 + i * 3);
+    faces.push_back(&coverages[i]);
+  }
+  flatui::CodepointFaceMap map;
+  map.Build(faces);
+
+  const uint32_t ranges[][2] = {{0, 0x900}, {0x20000, 0x20400}};
+  for (size_t range = 0; range < 2; ++range) {
+    for (auto c = ranges[range][0]; c < ranges[range][1]; ++c) {
+      int32_t expected = -1;
+      for (size_t i = 0; i < coverages.size() && expected < 0; ++i) {
+        if (coverages[i].Contains(c)) expected = static_cast<int32_t>(i);
+      }
+      EXPECT_EQ(expected, map.Find(c)) << c;
+    }
+  }
+
+  // Merging counts the codepoints a fallback face adds.
+  flatui::CodepointCoverage merged;
+  EXPECT_EQ(11, merged.Merge(coverages[0]));
+  EXPECT_EQ(8, merged.Merge(coverages[1]));
+  EXPECT_EQ(0, merged.Merge(coverages[0]));
+}
+
+// Fonts opened in the background are published with their callbacks, and
+// lay out as fonts opened synchronously.
+TEST_F(FlatUIFontManagerTest, TestOpenAsync) {
+  std::map<std::string, bool> results;
+  auto open = [&](const char *font_name) {
+    font_manager_->OpenAsync(font_name, [&results, font_name](bool result) {
+      results[font_name] = result;
+    });
+  };
+
+  // Fonts already open are opened synchronously.
+  open("fonts/NotoSansCJKjp-Bold.otf");
+  EXPECT_EQ(1u, results.size());
+  EXPECT_TRUE(results["fonts/NotoSansCJKjp-Bold.otf"]);
+
+  // Other fonts can't be selected until they are published.
+  open("fonts/LuckiestGuy.ttf");
+  open("fonts/NoSuchFont.ttf");
+  EXPECT_TRUE(font_manager_->HasPendingFonts());
+  EXPECT_EQ(1u, results.size());
+  EXPECT_FALSE(font_manager_->SelectFont("fonts/LuckiestGuy.ttf"));
+  font_manager_->WaitForFonts();
+  EXPECT_FALSE(font_manager_->HasPendingFonts());
+  EXPECT_EQ(3u, results.size());
+  EXPECT_TRUE(results["fonts/LuckiestGuy.ttf"]);
+  EXPECT_FALSE(results["fonts/NoSuchFont.ttf"]);
+  ASSERT_TRUE(font_manager_->SelectFont("fonts/LuckiestGuy.ttf"));
+
+  flatui::FontManager font_manager2(mathfu::vec2i(256, 256), 2);
+  ASSERT_TRUE(font_manager2.Open("fonts/LuckiestGuy.ttf"));
+  const char text[] = "Async";
+  flatui::FontBuffer *buffers[2];
+  flatui::FontManager *managers[] = {font_manager_, &font_manager2};
+  for (auto i = 0; i < 2; ++i) {
+    auto parameter = flatui::FontBufferParameters(
+        managers[i]->GetCurrentFont()->GetFontId(), flatui::HashId(text),
+        static_cast<float>(32), mathfu::vec2i(0, 0),
+        flatui::kTextAlignmentLeft, flatui::kGlyphFlagsNone, false, false);
+    buffers[i] = managers[i]->GetBuffer(text, strlen(text), parameter);
+    ASSERT_NE(nullptr, buffers[i]);
+  }
+  auto &a = buffers[0]->get_vertices();
+  auto &b = buffers[1]->get_vertices();
+  ASSERT_EQ(b.size(), a.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    EXPECT_EQ(b[i].position_.data[0], a[i].position_.data[0]) << i;
+    EXPECT_EQ(b[i].position_.data[1], a[i].position_.data[1]) << i;
+  }
+  EXPECT_TRUE(font_manager_->Close("fonts/LuckiestGuy.ttf"));
+}
+
+#ifdef __APPLE__
+// SFNT data of a font opened by name is mapped from the cache after the first
+// conversion, with the contents converted from the CGFont.
+TEST_F(FlatUIFontManagerTest, TestFontByNameCache) {
+  const char kFontName[] = "Helvetica";
+  flatui::FaceData face;
+  std::string converted;
+  ASSERT_TRUE(face.OpenFontByName(kFontName, &converted));
+  for (auto i = 0; i < 2; ++i) {
+    int32_t size = 0;
+    auto mapped = face.OpenFontByName(kFontName, 0, &size);
+    ASSERT_NE(nullptr, mapped);
+    ASSERT_EQ(converted.size(), static_cast<size_t>(size));
+    EXPECT_EQ(0, memcmp(converted.c_str(), mapped, size));
+    fplbase::UnmapFile(mapped, size);
+  }
+}
+#endif  // __APPLE__
+
+// Each thread lays out texts with the font selected in the thread.
+TEST_F(FlatUIFontManagerTest, TestMultiThreadFontSelection) {
+  font_manager_->Open("fonts/LuckiestGuy.ttf");
+  font_manager_->SelectFont("fonts/NotoSansCJKjp-Bold.otf");
+  auto main_font = font_manager_->GetCurrentFont();
+
+  auto layout_test = [this, main_font](const char *font_name) {
+    // Threads start with the font of the main thread.
+    EXPECT_EQ(main_font, font_manager_->GetCurrentFont());
+    font_manager_->SelectFont(font_name);
+    auto font = font_manager_->GetCurrentFont();
+    const char text[] = "Text";
+    for (int32_t i = 0; i < 32; ++i) {
+      auto parameter = flatui::FontBufferParameters(
+          font->GetFontId(), flatui::HashId(text), static_cast<float>(16 + i),
+          mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+          flatui::kGlyphFlagsNone, false, true);
+      auto buffer = font_manager_->GetBuffer(text, strlen(text), parameter);
+      ASSERT_NE(nullptr, buffer);
+      EXPECT_TRUE(buffer->Verify());
+      EXPECT_EQ(font, font_manager_->GetCurrentFont());
+      font_manager_->ReleaseBuffer(buffer);
+    }
+    font_manager_->ReleaseLayoutContext();
+  };
+
+  std::thread thread1(layout_test, "fonts/LuckiestGuy.ttf");
+  std::thread thread2(layout_test, "fonts/NotoSansCJKjp-Bold.otf");
+  thread1.join();
+  thread2.join();
+
+  // Selecting fonts in the threads doesn't change the font of this thread.
+  EXPECT_EQ(main_font, font_manager_->GetCurrentFont());
+}
+
+// Buffers laid out while another thread flushes the glyph cache don't keep
+// UVs of evicted glyphs.
+TEST_F(FlatUIFontManagerTest, TestMultiThreadFlush) {
+  const char text[] = "Text";
+  const int32_t kNumSizes = 16;
+  auto font_id = font_manager_->GetCurrentFont()->GetFontId();
+  auto make_parameter = [font_id, text](int32_t i, const char *id) {
+    return flatui::FontBufferParameters(
+        font_id, flatui::HashId(text, flatui::HashId(id)),
+        static_cast<float>(16 + i), mathfu::vec2i(0, 0),
+        flatui::kTextAlignmentLeft, flatui::kGlyphFlagsNone, true, true);
+  };
+
+  std::atomic<bool> done(false);
+  std::vector<flatui::FontBuffer *> buffers(kNumSizes);
+  std::thread thread([&]() {
+    for (int32_t i = 0; i < kNumSizes; ++i) {
+      buffers[i] = font_manager_->GetBuffer(text, strlen(text),
+                                            make_parameter(i, "threaded"));
+    }
+    font_manager_->ReleaseLayoutContext();
+    done = true;
+  });
+  while (!done) {
+    font_manager_->FlushAndUpdate();
+  }
+  thread.join();
+
+  // Buffers found in the buffer cache are resolved again if they are stale,
+  // and have the vertices of new layouts.
+  for (int32_t i = 0; i < kNumSizes; ++i) {
+    ASSERT_NE(nullptr, buffers[i]);
+    EXPECT_EQ(buffers[i],
+              font_manager_->GetBuffer(text, strlen(text),
+                                       make_parameter(i, "threaded")));
+    auto fresh = font_manager_->GetBuffer(text, strlen(text),
+                                          make_parameter(i, "fresh"));
+    ASSERT_NE(nullptr, fresh);
+    auto &vertices = buffers[i]->get_vertices();
+    ASSERT_EQ(fresh->get_vertices().size(), vertices.size());
+    EXPECT_EQ(0, memcmp(fresh->get_vertices().data(), vertices.data(),
+                        vertices.size() * sizeof(flatui::FontVertex)));
+    font_manager_->ReleaseBuffer(buffers[i]);
+    font_manager_->ReleaseBuffer(buffers[i]);
+    font_manager_->ReleaseBuffer(fresh);
+  }
+}
+
+// GetBuffers() returns the buffers GetBuffer() returns for each request.
+TEST_F(FlatUIFontManagerTest, TestGetBuffers) {
+  const char *texts[] = {"Score", "Name", "Score", "Rank"};
+  const size_t num = sizeof(texts) / sizeof(texts[0]);
+  std::vector<flatui::FontBufferRequest> requests;
+  for (size_t i = 0; i < num; ++i) {
+    requests.push_back(flatui::FontBufferRequest(
+        texts[i], strlen(texts[i]),
+        flatui::FontBufferParameters(
+            font_manager_->GetCurrentFont()->GetFontId(),
+            flatui::HashId(texts[i]), static_cast<float>(32),
+            mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+            flatui::kGlyphFlagsNone, true, true)));
+  }
+  flatui::FontBuffer *buffers[num];
+  font_manager_->GetBuffers(requests.data(), num, buffers);
+
+  // Requests with the same parameters share a buffer.
+  EXPECT_EQ(buffers[0], buffers[2]);
+  EXPECT_EQ(2u, buffers[0]->get_ref_count());
+  for (size_t i = 0; i < num; ++i) {
+    ASSERT_NE(nullptr, buffers[i]);
+    EXPECT_TRUE(buffers[i]->Verify());
+    EXPECT_EQ(buffers[i], font_manager_->GetBuffer(texts[i], strlen(texts[i]),
+                                                   requests[i].parameters));
+    font_manager_->ReleaseBuffer(buffers[i]);
+  }
+  for (size_t i = 0; i < num; ++i) {
+    font_manager_->ReleaseBuffer(buffers[i]);
+  }
+}
+
+// GetBuffers() with parallel layouts returns the buffers of sequential
+// layouts, whether glyphs are in the glyph cache or not.
+TEST_F(FlatUIFontManagerTest, TestGetBuffersInParallel) {
+  font_manager_->EnableParallelLayout(2);
+  const char *texts[] = {"Score", "Name", "Score", "Rank", "Level", "Time"};
+  const size_t num = sizeof(texts) / sizeof(texts[0]);
+  auto make_requests = [this, texts, num](const char *id) {
+    std::vector<flatui::FontBufferRequest> requests;
+    for (size_t i = 0; i < num; ++i) {
+      requests.push_back(flatui::FontBufferRequest(
+          texts[i], strlen(texts[i]),
+          flatui::FontBufferParameters(
+              font_manager_->GetCurrentFont()->GetFontId(),
+              flatui::HashId(texts[i], flatui::HashId(id)),
+              static_cast<float>(32), mathfu::vec2i(0, 0),
+              flatui::kTextAlignmentLeft, flatui::kGlyphFlagsNone, true,
+              true)));
+    }
+    return requests;
+  };
+
+  // Glyphs are added to the glyph cache by the first call, and the second
+  // call lays out texts with the cached glyphs in the workers.
+  auto cold_requests = make_requests("cold");
+  auto warm_requests = make_requests("warm");
+  flatui::FontBuffer *cold[num];
+  flatui::FontBuffer *warm[num];
+  font_manager_->GetBuffers(cold_requests.data(), num, cold);
+  font_manager_->GetBuffers(warm_requests.data(), num, warm);
+
+  EXPECT_EQ(cold[0], cold[2]);
+  EXPECT_EQ(warm[0], warm[2]);
+  EXPECT_EQ(2u, warm[0]->get_ref_count());
+  for (size_t i = 0; i < num; ++i) {
+    ASSERT_NE(nullptr, cold[i]);
+    ASSERT_NE(nullptr, warm[i]);
+    EXPECT_NE(cold[i], warm[i]);
+    EXPECT_TRUE(warm[i]->Verify());
+    EXPECT_EQ(cold[i]->get_vertices().size(), warm[i]->get_vertices().size());
+    EXPECT_EQ(warm[i],
+              font_manager_->GetBuffer(texts[i], strlen(texts[i]),
+                                       warm_requests[i].parameters));
+    font_manager_->ReleaseBuffer(warm[i]);
+  }
+  for (size_t i = 0; i < num; ++i) {
+    font_manager_->ReleaseBuffer(cold[i]);
+    font_manager_->ReleaseBuffer(warm[i]);
+  }
+  font_manager_->EnableParallelLayout(0);
+}
+
+// GetBuffers() with parallel layouts adds glyphs missing in the glyph cache
+// in the order of the requests, without laying out the texts again.
+TEST_F(FlatUIFontManagerTest, TestGetBuffersInParallelUncachedGlyphs) {
+  font_manager_->EnableAsyncGlyphRasterization(1);
+  font_manager_->EnableParallelLayout(2);
+  const char *texts[] = {"Alpha", "Bravo", "Charlie", "Delta", "Alpha"};
+  const size_t num = sizeof(texts) / sizeof(texts[0]);
+  auto make_requests = [this, texts, num](const char *id, bool ref_count) {
+    std::vector<flatui::FontBufferRequest> requests;
+    for (size_t i = 0; i < num; ++i) {
+      requests.push_back(flatui::FontBufferRequest(
+          texts[i], strlen(texts[i]),
+          flatui::FontBufferParameters(
+              font_manager_->GetCurrentFont()->GetFontId(),
+              flatui::HashId(texts[i], flatui::HashId(id)),
+              static_cast<float>(32), mathfu::vec2i(0, 0),
+              flatui::kTextAlignmentLeft, flatui::kGlyphFlagsNone, ref_count,
+              true)));
+    }
+    return requests;
+  };
+
+  // Each request misses the buffer cache once, in the look up before the
+  // layout. A text laid out again would miss it for the second time, while
+  // the repeated request finds the buffer of the first one.
+  auto parallel_requests = make_requests("parallel", true);
+  flatui::FontBuffer *parallel[num];
+  font_manager_->ResetFontBufferCacheStats();
+  font_manager_->GetBuffers(parallel_requests.data(), num, parallel);
+  EXPECT_EQ(num, font_manager_->GetFontBufferCacheStats().misses);
+  EXPECT_EQ(1u, font_manager_->GetFontBufferCacheStats().hits);
+  EXPECT_EQ(parallel[0], parallel[4]);
+
+  // Sequential layouts with the glyphs added by the parallel layouts have
+  // the same vertices.
+  font_manager_->EnableParallelLayout(0);
+  auto sequential_requests = make_requests("sequential", false);
+  flatui::FontBuffer *sequential[num];
+  font_manager_->GetBuffers(sequential_requests.data(), num, sequential);
+  for (size_t i = 0; i < num; ++i) {
+    ASSERT_NE(nullptr, parallel[i]);
+    ASSERT_NE(nullptr, sequential[i]);
+    EXPECT_TRUE(parallel[i]->Verify());
+    auto &vertices = parallel[i]->get_vertices();
+    ASSERT_EQ(sequential[i]->get_vertices().size(), vertices.size());
+    EXPECT_EQ(0, memcmp(sequential[i]->get_vertices().data(), vertices.data(),
+                        vertices.size() * sizeof(flatui::FontVertex)));
+    font_manager_->ReleaseBuffer(parallel[i]);
+  }
+  font_manager_->EnableAsyncGlyphRasterization(0);
+}
+
+// Released buffers are reused for new buffers with cleared contents.
+TEST_F(FlatUIFontManagerTest, TestBufferPool) {
+  auto font_id = font_manager_->GetCurrentFont()->GetFontId();
+  auto create = [this, font_id](const char *text) {
+    auto parameter = flatui::FontBufferParameters(
+        font_id, flatui::HashId(text), static_cast<float>(32),
+        mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+        flatui::kGlyphFlagsNone, false, true);
+    return font_manager_->GetBuffer(text, strlen(text), parameter);
+  };
+  auto buffer = create("Pool");
+  ASSERT_NE(nullptr, buffer);
+  EXPECT_EQ(16U, buffer->get_vertices().size());
+  font_manager_->ReleaseBuffer(buffer);
+
+  auto reused = create("Reused");
+  EXPECT_EQ(buffer, reused);
+  EXPECT_TRUE(reused->Verify());
+  EXPECT_EQ(1U, reused->get_ref_count());
+  EXPECT_EQ(24U, reused->get_vertices().size());
+
+  // The pool is empty while the buffer is in use.
+  auto another = create("Pool");
+  EXPECT_NE(reused, another);
+  EXPECT_EQ(16U, another->get_vertices().size());
+  font_manager_->ReleaseBuffer(another);
+  font_manager_->ReleaseBuffer(reused);
+}
+
+// Text pipeline counters are collected only while they are enabled.
+TEST_F(FlatUIFontManagerTest, TestTextPipelineStats) {
+  const char text[] = "Lorem ipsum dolor sit amet";
+  auto parameter = flatui::FontBufferParameters(
+      font_manager_->GetCurrentFont()->GetFontId(), flatui::HashId(text),
+      static_cast<float>(48), mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+      flatui::kGlyphFlagsNone, false, true);
+  auto buffer = font_manager_->GetBuffer(text, strlen(text), parameter);
+  auto stats = font_manager_->GetTextPipelineStats();
+  EXPECT_EQ(0u, stats.glyph_lookups);
+  EXPECT_EQ(0u, stats.shaped_runs);
+  EXPECT_EQ(1u, stats.buffer_misses);
+  font_manager_->ReleaseBuffer(buffer);
+
+  font_manager_->EnableTextPipelineStats(true);
+  const char text2[] = "consectetur adipiscing elit";
+  parameter = flatui::FontBufferParameters(
+      font_manager_->GetCurrentFont()->GetFontId(), flatui::HashId(text2),
+      static_cast<float>(48), mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+      flatui::kGlyphFlagsNone, false, true);
+  buffer = font_manager_->GetBuffer(text2, strlen(text2), parameter);
+  stats = font_manager_->GetTextPipelineStats();
+  EXPECT_LT(0u, stats.glyph_lookups);
+  EXPECT_LT(0u, stats.glyph_hits);
+  EXPECT_LT(0u, stats.glyph_misses);
+  EXPECT_EQ(stats.glyph_lookups, stats.glyph_hits + stats.glyph_misses);
+  EXPECT_LT(0u, stats.glyph_sets);
+  EXPECT_GE(stats.glyph_misses, stats.glyph_sets);
+  EXPECT_LT(0u, stats.shaped_runs);
+
+  // A cached buffer doesn't look up glyphs.
+  EXPECT_EQ(buffer, font_manager_->GetBuffer(text2, strlen(text2), parameter));
+  auto cached_stats = font_manager_->GetTextPipelineStats();
+  EXPECT_EQ(stats.glyph_lookups, cached_stats.glyph_lookups);
+  EXPECT_EQ(stats.buffer_hits + 1, cached_stats.buffer_hits);
+
+  font_manager_->ResetTextPipelineStats();
+  stats = font_manager_->GetTextPipelineStats();
+  EXPECT_EQ(0u, stats.glyph_lookups);
+  EXPECT_EQ(0u, stats.buffer_misses);
+  font_manager_->ReleaseBuffer(buffer);
+  font_manager_->ReleaseBuffer(buffer);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Dummy entry to link the test in Android successfully.
+extern "C" int FPL_main(int /*argc*/, char ** /*argv*/) { return 0; }
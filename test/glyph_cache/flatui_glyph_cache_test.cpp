@@ -0,0 +1,586 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "flatui/internal/color_glyph_cache.h"
+#include "flatui/internal/glyph_cache.h"
+#include "flatui/internal/glyph_disk_cache.h"
+#include "gtest/gtest.h"
+
+class FlatUIGlyphCacheTest : public ::testing::Test {
+ protected:
+  // Cache a glyph with a given size and returns the cached entry.
+  const flatui::GlyphCacheEntry *SetGlyph(flatui::GlyphCache *cache,
+                                          uint32_t code_point,
+                                          const mathfu::vec2i &size) {
+    flatui::GlyphKey key(flatui::HashId("font"), code_point, size.y,
+                         flatui::kGlyphFlagsNone);
+    flatui::GlyphCacheEntry entry;
+    entry.set_code_point(code_point);
+    entry.set_size(size);
+    return cache->Set(nullptr, key, entry);
+  }
+
+  // Fill a cache with glyphs in mixed heights until it gets full, and returns
+  // the cached entries.
+  std::vector<const flatui::GlyphCacheEntry *> FillCache(
+      flatui::GlyphCache *cache) {
+    static const mathfu::vec2i kSizes[] = {
+        mathfu::vec2i(20, 30), mathfu::vec2i(10, 13), mathfu::vec2i(10, 13),
+        mathfu::vec2i(8, 6),
+    };
+    std::vector<const flatui::GlyphCacheEntry *> entries;
+    const size_t num_sizes = sizeof(kSizes) / sizeof(kSizes[0]);
+    for (uint32_t i = 0;; ++i) {
+      auto entry = SetGlyph(cache, i, kSizes[i % num_sizes]);
+      if (entry == nullptr) {
+        break;
+      }
+      entries.push_back(entry);
+    }
+    return entries;
+  }
+};
+
+static bool Overlaps(const flatui::GlyphCacheEntry *a,
+                     const flatui::GlyphCacheEntry *b) {
+  auto a_pos = a->get_pos();
+  auto b_pos = b->get_pos();
+  if (a_pos.z != b_pos.z) {
+    return false;
+  }
+  return a_pos.x < b_pos.x + b->get_size().x &&
+         b_pos.x < a_pos.x + a->get_size().x &&
+         a_pos.y < b_pos.y + b->get_size().y &&
+         b_pos.y < a_pos.y + a->get_size().y;
+}
+
+TEST_F(FlatUIGlyphCacheTest, TestSetAndFind) {
+  flatui::GlyphCache cache(mathfu::vec2i(256, 256), 1);
+  auto entry = SetGlyph(&cache, 'a', mathfu::vec2i(12, 16));
+  ASSERT_NE(nullptr, entry);
+
+  flatui::GlyphKey key(flatui::HashId("font"), 'a', 16,
+                       flatui::kGlyphFlagsNone);
+  EXPECT_EQ(entry, cache.Find(key));
+
+  flatui::GlyphKey other_key(flatui::HashId("font"), 'b', 16,
+                             flatui::kGlyphFlagsNone);
+  EXPECT_EQ(nullptr, cache.Find(other_key));
+
+  cache.Flush();
+  EXPECT_EQ(nullptr, cache.Find(key));
+}
+
+TEST_F(FlatUIGlyphCacheTest, TestSkylinePacking) {
+  flatui::GlyphCache row_cache(mathfu::vec2i(256, 256), 1);
+  flatui::GlyphCache skyline_cache(mathfu::vec2i(256, 256), 1,
+                                   flatui::kGlyphCachePackingSkyline);
+  auto row_entries = FillCache(&row_cache);
+  auto skyline_entries = FillCache(&skyline_cache);
+
+  // Skyline packing stacks shorter glyphs in taller rows.
+  EXPECT_GT(skyline_entries.size(), row_entries.size());
+
+  // Make sure cached glyphs don't overlap.
+  for (size_t i = 0; i < skyline_entries.size(); ++i) {
+    for (size_t j = i + 1; j < skyline_entries.size(); ++j) {
+      ASSERT_FALSE(Overlaps(skyline_entries[i], skyline_entries[j]));
+    }
+  }
+}
+
+TEST_F(FlatUIGlyphCacheTest, TestChangePacking) {
+  flatui::GlyphCache cache(mathfu::vec2i(256, 256), 1);
+  SetGlyph(&cache, 'a', mathfu::vec2i(12, 16));
+
+  // Changing the packing strategy flushes existing entries.
+  cache.set_packing(flatui::kGlyphCachePackingSkyline);
+  EXPECT_EQ(flatui::kGlyphCachePackingSkyline, cache.get_packing());
+  flatui::GlyphKey key(flatui::HashId("font"), 'a', 16,
+                       flatui::kGlyphFlagsNone);
+  EXPECT_EQ(nullptr, cache.Find(key));
+}
+
+TEST_F(FlatUIGlyphCacheTest, TestMergeRows) {
+  flatui::GlyphCache cache(mathfu::vec2i(256, 256), 1);
+
+  // Fill the cache with rows of short glyphs.
+  std::vector<const flatui::GlyphCacheEntry *> entries;
+  for (uint32_t i = 0; i < 256 / flatui::kGlyphCacheHeightRound / 2; ++i) {
+    auto entry = SetGlyph(&cache, i, mathfu::vec2i(240, 6));
+    ASSERT_NE(nullptr, entry);
+    entries.push_back(entry);
+  }
+
+  // A taller glyph needs adjacent rows to be merged in next cycle.
+  EXPECT_EQ(nullptr, SetGlyph(&cache, 'a', mathfu::vec2i(20, 20)));
+  cache.Update();
+  auto entry = SetGlyph(&cache, 'a', mathfu::vec2i(20, 20));
+  ASSERT_NE(nullptr, entry);
+
+  // Only merged rows are flushed.
+  int32_t num_flushed = 0;
+  for (uint32_t i = 0; i < entries.size(); ++i) {
+    flatui::GlyphKey key(flatui::HashId("font"), i, 6,
+                         flatui::kGlyphFlagsNone);
+    auto p = cache.Find(key);
+    if (p == nullptr) {
+      num_flushed++;
+    } else {
+      ASSERT_FALSE(Overlaps(entry, p));
+    }
+  }
+  EXPECT_EQ(3, num_flushed);
+}
+
+TEST_F(FlatUIGlyphCacheTest, TestTrimSlices) {
+  flatui::GlyphCache cache(mathfu::vec2i(256, 256), 2);
+  auto entries = FillCache(&cache);
+  ASSERT_EQ(2, cache.get_num_slices());
+  std::vector<flatui::GlyphKey> keys;
+  std::vector<int32_t> slices;
+  for (uint32_t i = 0; i < entries.size(); ++i) {
+    keys.push_back(flatui::GlyphKey(flatui::HashId("font"), i,
+                                    entries[i]->get_size().y,
+                                    flatui::kGlyphFlagsNone));
+    slices.push_back(entries[i]->get_pos().z);
+  }
+  EXPECT_EQ(2U * 256 * 256, cache.GetAtlasMemorySize());
+  EXPECT_LT(0U, cache.GetMetadataMemorySize());
+
+  // Slices used in the current or the previous cycle are kept.
+  EXPECT_EQ(0, cache.TrimSlices(0));
+  cache.Update();
+  EXPECT_EQ(0, cache.TrimSlices(0));
+
+  // The first slice is never removed.
+  cache.Update();
+  EXPECT_EQ(1, cache.TrimSlices(0));
+  EXPECT_EQ(1, cache.get_num_slices());
+  EXPECT_EQ(256U * 256, cache.GetAtlasMemorySize());
+
+  // Only glyphs in the removed slice are flushed.
+  for (size_t i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(slices[i] == 0, cache.Find(keys[i]) != nullptr);
+  }
+}
+
+TEST_F(FlatUIGlyphCacheTest, TestReleaseIdleSlices) {
+  flatui::GlyphCache cache(mathfu::vec2i(256, 256), 2);
+  FillCache(&cache);
+  ASSERT_EQ(2, cache.get_num_slices());
+
+  // Slices are kept until they are idle for given cycles.
+  EXPECT_EQ(0, cache.ReleaseIdleSlices(0));
+  for (int32_t i = 0; i < 3; ++i) {
+    cache.Update();
+    EXPECT_EQ(0, cache.ReleaseIdleSlices(3));
+  }
+  cache.Update();
+  EXPECT_EQ(1, cache.ReleaseIdleSlices(3));
+  EXPECT_EQ(1, cache.get_num_slices());
+
+  // Slices are allocated on demand again.
+  FillCache(&cache);
+  EXPECT_EQ(2, cache.get_num_slices());
+
+  // A lowered max removes slices beyond it once they are not in use.
+  cache.set_max_slices(1);
+  EXPECT_EQ(0, cache.ReleaseIdleSlices(0));
+  cache.Update();
+  cache.Update();
+  EXPECT_EQ(1, cache.ReleaseIdleSlices(0));
+  FillCache(&cache);
+  EXPECT_EQ(1, cache.get_num_slices());
+
+  // A raised max allows more slices.
+  cache.set_max_slices(3);
+  FillCache(&cache);
+  EXPECT_EQ(3, cache.get_num_slices());
+}
+
+TEST_F(FlatUIGlyphCacheTest, TestCompaction) {
+  flatui::GlyphCache cache(mathfu::vec2i(256, 256), 1);
+  cache.set_compaction(true);
+
+  // Create rows with 8, 12 and 236 pixels height.
+  std::vector<const flatui::GlyphCacheEntry *> entries;
+  entries.push_back(SetGlyph(&cache, 0, mathfu::vec2i(20, 6)));
+  entries.push_back(SetGlyph(&cache, 1, mathfu::vec2i(20, 10)));
+  entries.push_back(SetGlyph(&cache, 2, mathfu::vec2i(200, 235)));
+  for (size_t i = 0; i < entries.size(); ++i) {
+    ASSERT_NE(nullptr, entries[i]);
+  }
+  auto uv = entries[0]->get_uv();
+
+  // All rows are in use. The first two rows are freed up by moving glyphs to
+  // the last row, and merged.
+  auto entry = SetGlyph(&cache, 'a', mathfu::vec2i(60, 14));
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ(0, entry->get_pos().y);
+
+  // Moved glyphs are still in the cache with updated UVs.
+  for (uint32_t i = 0; i < entries.size(); ++i) {
+    flatui::GlyphKey key(flatui::HashId("font"), i, entries[i]->get_size().y,
+                         flatui::kGlyphFlagsNone);
+    EXPECT_EQ(entries[i], cache.Find(key));
+    EXPECT_FALSE(Overlaps(entry, entries[i]));
+  }
+  EXPECT_NE(uv.y, entries[0]->get_uv().y);
+  EXPECT_EQ(cache.get_counter(),
+            static_cast<uint32_t>(cache.get_last_flush_revision()));
+}
+
+TEST_F(FlatUIGlyphCacheTest, TestDirtyRects) {
+  flatui::GlyphCache cache(mathfu::vec2i(256, 256), 1);
+  auto buffer = cache.get_monochrome_buffer();
+
+  // Full width mode tracks a bounding rect.
+  SetGlyph(&cache, 0, mathfu::vec2i(20, 6));
+  SetGlyph(&cache, 1, mathfu::vec2i(20, 30));
+  EXPECT_EQ(1U, buffer->get_dirty_rects(0).size());
+  cache.ResolveDirtyRect();
+  EXPECT_FALSE(cache.get_dirty_state());
+  EXPECT_EQ(0U, buffer->get_dirty_rects(0).size());
+
+  // Sub rect mode tracks disjoint rects.
+  cache.set_upload_mode(flatui::kGlyphCacheUploadModeSubRect);
+  auto entry0 = SetGlyph(&cache, 2, mathfu::vec2i(20, 6));
+  auto entry1 = SetGlyph(&cache, 3, mathfu::vec2i(20, 6));
+  SetGlyph(&cache, 4, mathfu::vec2i(200, 30));
+  auto &rects = buffer->get_dirty_rects(0);
+  ASSERT_EQ(2U, rects.size());
+  EXPECT_EQ(entry0->get_pos().x - 1, rects[0].x);
+  EXPECT_EQ(entry1->get_pos().x + entry1->get_size().x + 1, rects[0].z);
+
+  // Rects are merged when they exceed the limit.
+  for (uint32_t i = 0; i < flatui::kGlyphCacheMaxDirtyRects * 2; ++i) {
+    SetGlyph(&cache, 100 + i, mathfu::vec2i(20, 60 + i * 4));
+  }
+  EXPECT_GE(flatui::kGlyphCacheMaxDirtyRects, rects.size());
+  cache.ResolveDirtyRect();
+  EXPECT_EQ(0U, rects.size());
+}
+
+TEST_F(FlatUIGlyphCacheTest, TestAsyncUploadFallback) {
+  flatui::GlyphCache cache(mathfu::vec2i(256, 256), 1);
+  cache.set_upload_mode(flatui::kGlyphCacheUploadModeAsync);
+
+  // Without a renderer supporting pixel buffer objects, textures are updated
+  // synchronously.
+  SetGlyph(&cache, 0, mathfu::vec2i(20, 6));
+  EXPECT_TRUE(cache.get_dirty_state());
+  cache.ResolveDirtyRect();
+  EXPECT_FALSE(cache.get_dirty_state());
+  EXPECT_EQ(cache.get_revision(), cache.get_uploaded_revision());
+}
+
+TEST_F(FlatUIGlyphCacheTest, TestUpdateImage) {
+  flatui::GlyphCache cache(mathfu::vec2i(256, 256), 1);
+  auto entry = SetGlyph(&cache, 'a', mathfu::vec2i(4, 2));
+  ASSERT_NE(nullptr, entry);
+  cache.ResolveDirtyRect();
+
+  // Replacing the image of a reserved entry makes the cache dirty.
+  const uint8_t image[] = {1, 2, 3, 4, 5, 6, 7, 8};
+  flatui::GlyphKey key(flatui::HashId("font"), 'a', 2,
+                       flatui::kGlyphFlagsNone);
+  cache.Update();
+  EXPECT_TRUE(cache.UpdateImage(key, entry->get_size(), image));
+  EXPECT_TRUE(cache.get_dirty_state());
+  EXPECT_EQ(cache.get_counter(), static_cast<uint32_t>(cache.get_revision()));
+  auto buffer = cache.get_monochrome_buffer();
+  auto pos = entry->get_pos();
+  auto p = buffer->get(pos.z) + pos.x + pos.y * buffer->get_size().x;
+  EXPECT_EQ(0, memcmp(p, image, 4));
+  EXPECT_EQ(0, memcmp(p + buffer->get_size().x, image + 4, 4));
+
+  // Images of evicted or different sized entries are discarded.
+  EXPECT_FALSE(cache.UpdateImage(key, mathfu::vec2i(2, 4), image));
+  cache.Flush();
+  EXPECT_FALSE(cache.UpdateImage(key, mathfu::vec2i(4, 2), image));
+}
+
+// Glyphs saved in a disk cache are restored from the file.
+TEST_F(FlatUIGlyphCacheTest, TestDiskCache) {
+  const char kFileName[] = "flatui_glyph_disk_cache_test.bin";
+  const flatui::HashedId kFontHash = flatui::HashId("font contents");
+  const uint32_t kSDFVersion = 1;
+  remove(kFileName);
+
+  // Add a normal glyph and an SDF glyph. The image is stored without stride.
+  const uint8_t image[] = {1, 2, 3, 0, 4, 5, 6, 0};
+  flatui::GlyphCacheEntry entry;
+  entry.set_code_point('a');
+  entry.set_size(mathfu::vec2i(3, 2));
+  entry.set_offset(mathfu::vec2(1.5f, 2.0f));
+  entry.set_advance(mathfu::vec2i(4, 0));
+  flatui::GlyphKey key(flatui::HashId("font"), 'a', 2,
+                       flatui::kGlyphFlagsNone);
+  flatui::GlyphKey sdf_key(flatui::HashId("font"), 'a', 2,
+                           flatui::kGlyphFlagsOuterSDF);
+  {
+    flatui::GlyphDiskCache disk_cache;
+    ASSERT_TRUE(disk_cache.Open(kFileName, kSDFVersion));
+    EXPECT_EQ(0U, disk_cache.get_num_entries());
+    disk_cache.Add(kFontHash, key, entry, image, 4);
+    disk_cache.Add(kFontHash, sdf_key, entry, image, 4);
+    EXPECT_TRUE(disk_cache.is_dirty());
+    ASSERT_TRUE(disk_cache.Save());
+    EXPECT_FALSE(disk_cache.is_dirty());
+  }
+
+  // The font id of keys is replaced with the hash of font contents.
+  flatui::GlyphDiskCache disk_cache;
+  ASSERT_TRUE(disk_cache.Open(kFileName, kSDFVersion));
+  EXPECT_EQ(2U, disk_cache.get_num_entries());
+  flatui::GlyphCacheEntry restored;
+  EXPECT_EQ(nullptr,
+            disk_cache.Find(flatui::HashId("other font"), key, &restored));
+  auto p = disk_cache.Find(kFontHash, key, &restored);
+  ASSERT_NE(nullptr, p);
+  const uint8_t expected[] = {1, 2, 3, 4, 5, 6};
+  EXPECT_EQ(0, memcmp(p, expected, sizeof(expected)));
+  EXPECT_EQ(static_cast<uint32_t>('a'), restored.get_code_point());
+  EXPECT_EQ(3, restored.get_size().x);
+  EXPECT_EQ(2, restored.get_size().y);
+  EXPECT_EQ(1.5f, restored.get_offset().x);
+  EXPECT_EQ(4, restored.get_advance().x);
+  EXPECT_NE(nullptr, disk_cache.Find(kFontHash, sdf_key, &restored));
+
+  // SDF glyphs generated by another distance computer are discarded.
+  ASSERT_TRUE(disk_cache.Open(kFileName, kSDFVersion + 1));
+  EXPECT_NE(nullptr, disk_cache.Find(kFontHash, key, &restored));
+  EXPECT_EQ(nullptr, disk_cache.Find(kFontHash, sdf_key, &restored));
+  disk_cache.Close();
+  remove(kFileName);
+}
+
+// Pinned glyphs are not evicted nor flushed.
+TEST_F(FlatUIGlyphCacheTest, TestPinnedGlyphs) {
+  flatui::GlyphCache cache(mathfu::vec2i(256, 256), 1);
+  const uint8_t image[] = {1, 2, 3, 4, 5, 6, 7, 8};
+  flatui::GlyphCacheEntry entry;
+  entry.set_code_point('p');
+  entry.set_size(mathfu::vec2i(4, 2));
+  flatui::GlyphKey key(flatui::HashId("pinned font"), 'p', 2,
+                       flatui::kGlyphFlagsNone);
+  auto pinned = cache.SetPinned(image, key, entry);
+  ASSERT_NE(nullptr, pinned);
+  EXPECT_TRUE(pinned->get_row()->get_pinned());
+  EXPECT_EQ(1U, cache.GetNumPinnedGlyphs());
+
+  // Regular glyphs are not stored in the pinned row.
+  auto entries = FillCache(&cache);
+  ASSERT_FALSE(entries.empty());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    EXPECT_NE(&*pinned->get_row(), &*entries[i]->get_row());
+  }
+
+  // Rows are evicted in following cycles, except the pinned row.
+  for (uint32_t i = 0; i < 16; ++i) {
+    cache.Update();
+    ASSERT_NE(nullptr, SetGlyph(&cache, 1000 + i, mathfu::vec2i(200, 60)));
+  }
+  EXPECT_EQ(pinned, cache.Find(key));
+
+  // Pinned glyphs are restored after a flush.
+  cache.Flush();
+  EXPECT_EQ(nullptr, cache.Find(flatui::GlyphKey(flatui::HashId("font"), 0,
+                                                 30, flatui::kGlyphFlagsNone)));
+  pinned = cache.Find(key);
+  ASSERT_NE(nullptr, pinned);
+  auto buffer = cache.get_monochrome_buffer();
+  auto pos = pinned->get_pos();
+  auto p = buffer->get(pos.z) + pos.x + pos.y * buffer->get_size().x;
+  EXPECT_EQ(0, memcmp(p, image, 4));
+  EXPECT_EQ(0, memcmp(p + buffer->get_size().x, image + 4, 4));
+
+  // A regular glyph is moved to a pinned row with its image.
+  flatui::GlyphKey regular_key(flatui::HashId("font"), 'a', 2,
+                               flatui::kGlyphFlagsNone);
+  const uint8_t regular_image[] = {8, 7, 6, 5, 4, 3, 2, 1};
+  entry.set_code_point('a');
+  auto regular = cache.Set(regular_image, regular_key, entry);
+  ASSERT_NE(nullptr, regular);
+  EXPECT_FALSE(regular->get_row()->get_pinned());
+  auto moved = cache.Pin(regular_key);
+  ASSERT_NE(nullptr, moved);
+  EXPECT_TRUE(moved->get_row()->get_pinned());
+  EXPECT_EQ(moved, cache.Find(regular_key));
+  pos = moved->get_pos();
+  p = buffer->get(pos.z) + pos.x + pos.y * buffer->get_size().x;
+  EXPECT_EQ(0, memcmp(p, regular_image, 4));
+  EXPECT_EQ(0, memcmp(p + buffer->get_size().x, regular_image + 4, 4));
+  EXPECT_EQ(2U, cache.GetNumPinnedGlyphs());
+
+  // Glyphs set in the pinning mode go to pinned rows.
+  flatui::GlyphKey mode_key(flatui::HashId("font"), 'b', 2,
+                            flatui::kGlyphFlagsNone);
+  entry.set_code_point('b');
+  cache.set_pinning(true);
+  auto pinned_by_mode = cache.Set(regular_image, mode_key, entry);
+  cache.set_pinning(false);
+  ASSERT_NE(nullptr, pinned_by_mode);
+  EXPECT_TRUE(pinned_by_mode->get_row()->get_pinned());
+  EXPECT_EQ(3U, cache.GetNumPinnedGlyphs());
+
+  // Unpinned glyphs are flushed.
+  cache.UnpinAll();
+  EXPECT_EQ(0U, cache.GetNumPinnedGlyphs());
+  cache.Flush();
+  EXPECT_EQ(nullptr, cache.Find(key));
+}
+
+// Glyphs saved in an atlas are loaded as pinned glyphs.
+TEST_F(FlatUIGlyphCacheTest, TestGlyphAtlas) {
+  flatui::GlyphCache cache(mathfu::vec2i(256, 256), 2);
+  std::vector<uint8_t> image(12 * 20);
+  for (size_t i = 0; i < image.size(); ++i) {
+    image[i] = static_cast<uint8_t>(i);
+  }
+  for (uint32_t i = 0; i < 8; ++i) {
+    flatui::GlyphCacheEntry entry;
+    entry.set_code_point(i);
+    entry.set_size(mathfu::vec2i(12, 10 + i));
+    entry.set_offset(mathfu::vec2(1.0f, 2.5f));
+    entry.set_advance(mathfu::vec2i(14, 0));
+    flatui::GlyphKey key(flatui::HashId("font"), i, 16,
+                         flatui::kGlyphFlagsOuterSDF);
+    ASSERT_NE(nullptr, cache.Set(image.data(), key, entry));
+  }
+  std::string data;
+  cache.SaveAtlas(&data);
+
+  flatui::GlyphCache loaded(mathfu::vec2i(256, 256), 1);
+  EXPECT_FALSE(loaded.LoadPinnedAtlas(data.data(), 4));
+  ASSERT_TRUE(loaded.LoadPinnedAtlas(data.data(), data.size()));
+  EXPECT_EQ(8U, loaded.GetNumPinnedGlyphs());
+  auto buffer = loaded.get_monochrome_buffer();
+  for (uint32_t i = 0; i < 8; ++i) {
+    flatui::GlyphKey key(flatui::HashId("font"), i, 16,
+                         flatui::kGlyphFlagsOuterSDF);
+    auto entry = loaded.Find(key);
+    ASSERT_NE(nullptr, entry);
+    EXPECT_TRUE(entry->get_row()->get_pinned());
+    EXPECT_EQ(i, entry->get_code_point());
+    EXPECT_EQ(12, entry->get_size().x);
+    EXPECT_EQ(static_cast<int32_t>(10 + i), entry->get_size().y);
+    EXPECT_EQ(2.5f, entry->get_offset().y);
+    EXPECT_EQ(14, entry->get_advance().x);
+    auto pos = entry->get_pos();
+    auto p = buffer->get(pos.z) + pos.x + pos.y * buffer->get_size().x;
+    for (int32_t y = 0; y < entry->get_size().y; ++y) {
+      EXPECT_EQ(0, memcmp(p + y * buffer->get_size().x, &image[y * 12], 12));
+    }
+  }
+}
+
+// Multi-channel SDF glyphs are stored in their own RGBA slices.
+TEST_F(FlatUIGlyphCacheTest, TestMultiChannelSDFGlyph) {
+  flatui::GlyphCache cache(mathfu::vec2i(256, 256), 2);
+  flatui::GlyphCacheEntry entry;
+  entry.set_code_point('a');
+  entry.set_size(mathfu::vec2i(12, 16));
+  entry.set_multi_channel_sdf(true);
+  flatui::GlyphKey key(flatui::HashId("font"), 'a', 32,
+                       flatui::kGlyphFlagsMultiChannelSDF);
+  auto cached = cache.Set(nullptr, key, entry);
+  ASSERT_NE(nullptr, cached);
+  EXPECT_TRUE(cached->get_multi_channel_sdf());
+  auto slice = cached->get_pos().z;
+  EXPECT_EQ(flatui::kGlyphFormatsMultiChannelSDF,
+            slice & flatui::kGlyphFormatsMask);
+  EXPECT_EQ(0, slice & ~flatui::kGlyphFormatsMask);
+  EXPECT_EQ(1, cache.get_msdf_buffer()->get_num_slices());
+  EXPECT_EQ(fplbase::kFormat8888,
+            cache.get_msdf_buffer()->get_texture_format());
+
+  // A same glyph without the flag is a different monochrome entry.
+  flatui::GlyphKey sdf_key(flatui::HashId("font"), 'a', 32,
+                           flatui::kGlyphFlagsOuterSDF);
+  EXPECT_EQ(nullptr, cache.Find(sdf_key));
+  entry.set_multi_channel_sdf(false);
+  std::vector<uint8_t> image(12 * 16);
+  auto mono = cache.Set(image.data(), sdf_key, entry);
+  ASSERT_NE(nullptr, mono);
+  EXPECT_EQ(0, mono->get_pos().z & flatui::kGlyphFormatsMask);
+}
+
+// Color glyph strikes are cached with their mip chain in LRU order.
+TEST_F(FlatUIGlyphCacheTest, TestColorGlyphCache) {
+  flatui::ColorGlyphCache cache;
+  cache.set_capacity(2);
+  const int32_t kSize = 64;
+  const int32_t kPitch = kSize * 4 + 8;
+  std::vector<uint8_t> bitmap(kPitch * kSize);
+  for (int32_t y = 0; y < kSize; ++y) {
+    for (int32_t x = 0; x < kSize; ++x) {
+      // Alternate the alpha of columns, so that mip levels average to 128.
+      bitmap[y * kPitch + x * 4 + 3] = x & 1 ? 255 : 1;
+    }
+  }
+  auto font_id = flatui::HashId("emoji font");
+  auto strike = cache.Store(font_id, 'a', bitmap.data(), kSize, kSize, kPitch,
+                            1.5f, 640);
+  ASSERT_NE(nullptr, strike);
+  EXPECT_EQ(strike, cache.Find(font_id, 'a'));
+  EXPECT_EQ(nullptr, cache.Find(font_id, 'b'));
+  EXPECT_EQ(nullptr, cache.Find(flatui::HashId("font"), 'a'));
+  EXPECT_EQ(1.5f, strike->bitmap_left);
+  EXPECT_EQ(640, strike->advance);
+
+  // Levels halve the size down to 8 pixels.
+  ASSERT_EQ(4U, strike->levels.size());
+  EXPECT_EQ(kSize, strike->levels[0].height);
+  EXPECT_EQ(8, strike->levels[3].width);
+  EXPECT_EQ(8, strike->levels[3].height);
+  EXPECT_EQ(128, strike->levels[1].pixels[3]);
+
+  // A size matching a level is copied from it.
+  auto alpha = cache.Scale(*strike, 32, 32, true);
+  for (int32_t i = 0; i < 32 * 32; ++i) {
+    ASSERT_EQ(128, alpha[i]);
+  }
+  EXPECT_EQ(strike->levels[2].pixels.data(),
+            cache.Scale(*strike, 16, 16, false));
+
+  // The least recently used glyph is evicted.
+  cache.Store(font_id, 'b', bitmap.data(), kSize, kSize, kPitch, 0.0f, 0);
+  EXPECT_NE(nullptr, cache.Find(font_id, 'a'));
+  cache.Store(font_id, 'c', bitmap.data(), kSize, kSize, kPitch, 0.0f, 0);
+  EXPECT_EQ(2U, cache.size());
+  EXPECT_NE(nullptr, cache.Find(font_id, 'a'));
+  EXPECT_EQ(nullptr, cache.Find(font_id, 'b'));
+
+  // Strikes are still built when the cache is disabled.
+  cache.set_capacity(0);
+  EXPECT_EQ(0U, cache.size());
+  EXPECT_NE(nullptr, cache.Store(font_id, 'a', bitmap.data(), kSize, kSize,
+                                 kPitch, 0.0f, 0));
+  EXPECT_EQ(nullptr, cache.Find(font_id, 'a'));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Dummy entry to link the test in Android successfully.
+extern "C" int FPL_main(int /*argc*/, char ** /*argv*/) { return 0; }
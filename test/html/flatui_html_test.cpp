@@ -14,6 +14,8 @@
 
 #include "src/font_util.cpp"  // Include cpp to test its internal functions.
 
+#include <chrono>
+
 #include "flatui/flatui_generated.h"
 #include "flatui/font_util.h"
 #include "fplutil/main.h"
@@ -163,114 +165,121 @@ static void CheckHtmlParsing(const char* html, const HtmlSection* sections,
   }
 }
 
+static const char kBasicHtml[] =
+    "<!DOCTYPE html>\n"
+    "<html>\n"
+    "<body>\n"
+    "\n"
+    "<h1>My First Heading</h1>\n"
+    "<p>My first paragraph.</p>\n"
+    "\n"
+    "</body>\n"
+    "</html>\n";
+
 TEST_F(FlatUIHtmlTest, Basic) {
-  static const char kHtml[] =
-      "<!DOCTYPE html>\n"
-      "<html>\n"
-      "<body>\n"
-      "\n"
-      "<h1>My First Heading</h1>\n"
-      "<p>My first paragraph.</p>\n"
-      "\n"
-      "</body>\n"
-      "</html>\n";
   static const HtmlSection kParsed[] = {
       HtmlSection("My First Heading\n\n"
                   "My first paragraph.\n\n")};
-  CheckHtmlParsing(kHtml, kParsed, FPL_ARRAYSIZE(kParsed));
+  CheckHtmlParsing(kBasicHtml, kParsed, FPL_ARRAYSIZE(kParsed));
 }
 
+static const char kLinkHtml[] =
+    "<!DOCTYPE html>\n"
+    "<html>\n"
+    "<body>\n"
+    "<a href=\"http://address\">Link Text</a>\n"
+    "</body>\n"
+    "</html>\n";
+
 TEST_F(FlatUIHtmlTest, Link) {
-  static const char kHtml[] =
-      "<!DOCTYPE html>\n"
-      "<html>\n"
-      "<body>\n"
-      "<a href=\"http://address\">Link Text</a>\n"
-      "</body>\n"
-      "</html>\n";
   static const HtmlSection kParsed[] = {
       HtmlSection("Link Text", "http://address")};
-  CheckHtmlParsing(kHtml, kParsed, FPL_ARRAYSIZE(kParsed));
+  CheckHtmlParsing(kLinkHtml, kParsed, FPL_ARRAYSIZE(kParsed));
 }
 
+static const char kAnchorSpaceHtml[] =
+    "<!DOCTYPE html>\n"
+    "<html>\n"
+    "<body>\n"
+    "<a href=\"http://address\">Link Text</a> following text\n"
+    "</body>\n"
+    "</html>\n";
+
 TEST_F(FlatUIHtmlTest, AnchorSpace) {
-  static const char kHtml[] =
-      "<!DOCTYPE html>\n"
-      "<html>\n"
-      "<body>\n"
-      "<a href=\"http://address\">Link Text</a> following text\n"
-      "</body>\n"
-      "</html>\n";
   static const HtmlSection kParsed[] = {
       HtmlSection("Link Text", "http://address"),
       HtmlSection(" following text ")};
-  CheckHtmlParsing(kHtml, kParsed, FPL_ARRAYSIZE(kParsed));
+  CheckHtmlParsing(kAnchorSpaceHtml, kParsed, FPL_ARRAYSIZE(kParsed));
 }
 
+static const char kAnchorAfterParagraphHtml[] =
+    "<!DOCTYPE html>\n"
+    "<html>\n"
+    "<body>\n"
+    "<p>Some paragraph.</p>\n"
+    "<a href=\"http://foo\">    Link text   </a>\n"
+    "</body>\n"
+    "</html>\n";
+
 TEST_F(FlatUIHtmlTest, AnchorAfterParagraph) {
-  static const char kHtml[] =
-      "<!DOCTYPE html>\n"
-      "<html>\n"
-      "<body>\n"
-      "<p>Some paragraph.</p>\n"
-      "<a href=\"http://foo\">    Link text   </a>\n"
-      "</body>\n"
-      "</html>\n";
   static const HtmlSection kParsed[] = {
       HtmlSection("Some paragraph.\n\n"),
       HtmlSection("Link text ", "http://foo")
   };
-  CheckHtmlParsing(kHtml, kParsed, FPL_ARRAYSIZE(kParsed));
+  CheckHtmlParsing(kAnchorAfterParagraphHtml, kParsed, FPL_ARRAYSIZE(kParsed));
 }
 
+static const char kParagraphNoWhitespaceHtml[] =
+    "<!DOCTYPE html>\n"
+    "<html>\n"
+    "<body>\n"
+    "Normal text<p>Paragraph text</p>\n"
+    "</body>\n"
+    "</html>\n";
+
 TEST_F(FlatUIHtmlTest, ParagraphNoWhitespace) {
-  static const char kHtml[] =
-      "<!DOCTYPE html>\n"
-      "<html>\n"
-      "<body>\n"
-      "Normal text<p>Paragraph text</p>\n"
-      "</body>\n"
-      "</html>\n";
   static const HtmlSection kParsed[] = {
       HtmlSection("Normal text\n\nParagraph text\n\n")};
-  CheckHtmlParsing(kHtml, kParsed, FPL_ARRAYSIZE(kParsed));
+  CheckHtmlParsing(kParagraphNoWhitespaceHtml, kParsed, FPL_ARRAYSIZE(kParsed));
 }
 
+static const char kDropLeadingNewLinesHtml[] =
+    "<!DOCTYPE html>\n"
+    "<html>\n"
+    "<body>\n"
+    "<p>Paragraph</p>\n\n\n\n"
+    "Break<br>\n"
+    "</body>\n"
+    "</html>\n";
+
 TEST_F(FlatUIHtmlTest, DropLeadingNewLines) {
-  static const char kHtml[] =
-      "<!DOCTYPE html>\n"
-      "<html>\n"
-      "<body>\n"
-      "<p>Paragraph</p>\n\n\n\n"
-      "Break<br>\n"
-      "</body>\n"
-      "</html>\n";
   static const HtmlSection kParsed[] = {
       HtmlSection("Paragraph\n\n"
                   "Break\n"),
   };
-  CheckHtmlParsing(kHtml, kParsed, FPL_ARRAYSIZE(kParsed));
+  CheckHtmlParsing(kDropLeadingNewLinesHtml, kParsed, FPL_ARRAYSIZE(kParsed));
 }
 
+static const char kSpacingHtml[] =
+    "<!DOCTYPE html>\n"
+    "<html>\n"
+    "<body>\n"
+    "<h1>H1 heading</h1>\n"
+    "<h2>H2 heading</h2>\n"
+    "<h3>H3 heading</h3>\n"
+    "<h4>H4 heading</h4>\n"
+    "<h5>H5 heading</h5>\n"
+    "Single tag paragraph<p>\n"
+    "<p>Complete paragraph</p>\n"
+    "Break<br>\n"
+    "Two breaks<br><br>\n"
+    "Break<br>then text\n"
+    "Horiontal rule<hr>\n"
+    "plenty\n of \n\nnewlines\n  \nand\nmore  newlines"
+    "</body>\n"
+    "</html>\n";
+
 TEST_F(FlatUIHtmlTest, Spacing) {
-  static const char kHtml[] =
-      "<!DOCTYPE html>\n"
-      "<html>\n"
-      "<body>\n"
-      "<h1>H1 heading</h1>\n"
-      "<h2>H2 heading</h2>\n"
-      "<h3>H3 heading</h3>\n"
-      "<h4>H4 heading</h4>\n"
-      "<h5>H5 heading</h5>\n"
-      "Single tag paragraph<p>\n"
-      "<p>Complete paragraph</p>\n"
-      "Break<br>\n"
-      "Two breaks<br><br>\n"
-      "Break<br>then text\n"
-      "Horiontal rule<hr>\n"
-      "plenty\n of \n\nnewlines\n  \nand\nmore  newlines"
-      "</body>\n"
-      "</html>\n";
   static const HtmlSection kParsed[] = {
       HtmlSection("H1 heading\n\n"
                   "H2 heading\n\n"
@@ -284,63 +293,65 @@ TEST_F(FlatUIHtmlTest, Spacing) {
                   "Break\nthen text "
                   "Horiontal rule\n\n"
                   "plenty of newlines and more newlines ")};
-  CheckHtmlParsing(kHtml, kParsed, FPL_ARRAYSIZE(kParsed));
+  CheckHtmlParsing(kSpacingHtml, kParsed, FPL_ARRAYSIZE(kParsed));
 }
 
+static const char kSpecialCharactersHtml[] =
+    "<!DOCTYPE html>\n"
+    "<html>\n"
+    "<body>\n"
+    "&lt;&gt;&amp;&quot;&apos;\n"
+    "</body>\n"
+    "</html>\n";
+
 TEST_F(FlatUIHtmlTest, SpecialCharacters) {
-  static const char kHtml[] =
-      "<!DOCTYPE html>\n"
-      "<html>\n"
-      "<body>\n"
-      "&lt;&gt;&amp;&quot;&apos;\n"
-      "</body>\n"
-      "</html>\n";
   static const HtmlSection kParsed[] = {HtmlSection("<>&\"' ")};
-  CheckHtmlParsing(kHtml, kParsed, FPL_ARRAYSIZE(kParsed));
+  CheckHtmlParsing(kSpecialCharactersHtml, kParsed, FPL_ARRAYSIZE(kParsed));
 }
 
+static const char kManyLinksHtml[] =
+    "<tbody>\n"
+    "<tr>\n"
+    "<td style=\"width: 132px; height: 207px;\" nowrap>\n"
+    "<div style=\"text-align: center;\"><b>EZ TEMPLATING<br>\n"
+    "<br>\n"
+    "</b></div>\n"
+    "<a "
+    "href=\"https://sites.google.com/a/google.com/google-code/ez-templates/"
+    "ezt-introduction\">Introduction</a><br>\n"
+    "<a "
+    "href=\"https://sites.google.com/a/google.com/google-code/ez-templates/"
+    "faq\">FAQ</a><br>\n"
+    "<br>\n"
+    "<a "
+    "href=\"https://sites.google.com/a/google.com/google-code/ez-templates/"
+    "directory-structure\">Directory Structure</a><br>\n"
+    "<a "
+    "href=\"https://sites.google.com/a/google.com/google-code/ez-templates/"
+    "markup-rules\">Markup Rules</a>\n"
+    "<br>\n"
+    "<br>\n"
+    "<a "
+    "href=\"https://sites.google.com/a/google.com/google-code/ez-templates/"
+    "ezt-doc-page\">Set up Doc Pages</a>\n"
+    "<br>\n"
+    "<a "
+    "href=\"https://sites.google.com/a/google.com/google-code/ez-templates/"
+    "ezt-home-page\">Set up a Home Page</a>\n"
+    "<br>\n"
+    "<br>\n"
+    "<b>HTML / CSS Reference</b><br>\n"
+    "<a "
+    "href=\"https://sites.google.com/a/google.com/google-code/ez-templates/"
+    "ezt-reference\">Reference</a><br>\n"
+    "<br>\n"
+    "<a "
+    "href=\"https://sites.google.com/a/google.com/google-code/ez-templates/"
+    "tips-tricks\">Tips and Tricks</a></td>\n"
+    "</tr>\n"
+    "</tbody>\n";
+
 TEST_F(FlatUIHtmlTest, ManyLinks) {
-  static const char kHtml[] =
-      "<tbody>\n"
-      "<tr>\n"
-      "<td style=\"width: 132px; height: 207px;\" nowrap>\n"
-      "<div style=\"text-align: center;\"><b>EZ TEMPLATING<br>\n"
-      "<br>\n"
-      "</b></div>\n"
-      "<a "
-      "href=\"https://sites.google.com/a/google.com/google-code/ez-templates/"
-      "ezt-introduction\">Introduction</a><br>\n"
-      "<a "
-      "href=\"https://sites.google.com/a/google.com/google-code/ez-templates/"
-      "faq\">FAQ</a><br>\n"
-      "<br>\n"
-      "<a "
-      "href=\"https://sites.google.com/a/google.com/google-code/ez-templates/"
-      "directory-structure\">Directory Structure</a><br>\n"
-      "<a "
-      "href=\"https://sites.google.com/a/google.com/google-code/ez-templates/"
-      "markup-rules\">Markup Rules</a>\n"
-      "<br>\n"
-      "<br>\n"
-      "<a "
-      "href=\"https://sites.google.com/a/google.com/google-code/ez-templates/"
-      "ezt-doc-page\">Set up Doc Pages</a>\n"
-      "<br>\n"
-      "<a "
-      "href=\"https://sites.google.com/a/google.com/google-code/ez-templates/"
-      "ezt-home-page\">Set up a Home Page</a>\n"
-      "<br>\n"
-      "<br>\n"
-      "<b>HTML / CSS Reference</b><br>\n"
-      "<a "
-      "href=\"https://sites.google.com/a/google.com/google-code/ez-templates/"
-      "ezt-reference\">Reference</a><br>\n"
-      "<br>\n"
-      "<a "
-      "href=\"https://sites.google.com/a/google.com/google-code/ez-templates/"
-      "tips-tricks\">Tips and Tricks</a></td>\n"
-      "</tr>\n"
-      "</tbody>\n";
   static const HtmlSection kParsed[] = {
       HtmlSection("EZ TEMPLATING\n\n"),
       HtmlSection("Introduction",
@@ -371,8 +382,107 @@ TEST_F(FlatUIHtmlTest, ManyLinks) {
                                        "https://sites.google.com/a/google.com/"
                                        "google-code/ez-templates/tips-tricks"),
   };
-  CheckHtmlParsing(kHtml, kParsed, FPL_ARRAYSIZE(kParsed));
+  CheckHtmlParsing(kManyLinksHtml, kParsed, FPL_ARRAYSIZE(kParsed));
+}
+
+static const char kSubsetHtml[] =
+    "Hello <font face=\"Roboto\" color=\"#ff0000\">red <b>bold</b></font>"
+    " &amp; <a href='http://address'>link</a>!<br/><!-- comment -->&#x263A;";
+
+TEST_F(FlatUIHtmlTest, Subset) {
+  std::vector<HtmlSection> s;
+  ASSERT_TRUE(flatui::ParseHtmlSubset(kSubsetHtml, &s));
+  ASSERT_EQ(5u, s.size());
+  EXPECT_EQ(std::string("Hello "), s[0].text());
+  EXPECT_EQ(std::string("red bold"), s[1].text());
+  EXPECT_EQ(std::string("Roboto"), s[1].face());
+  EXPECT_EQ(0xff0000ffu, s[1].color());
+  EXPECT_EQ(std::string(" & "), s[2].text());
+  EXPECT_EQ(std::string(""), s[2].face());
+  EXPECT_EQ(std::string("link"), s[3].text());
+  EXPECT_EQ(std::string("http://address"), s[3].link());
+  EXPECT_EQ(std::string("!\n\xe2\x98\xba"), s[4].text());
+}
+
+// HTML the subset parser can't handle the same way as Gumbo.
+TEST_F(FlatUIHtmlTest, SubsetFallback) {
+  std::vector<HtmlSection> s;
+  // Elements out of the subset.
+  EXPECT_FALSE(flatui::ParseHtmlSubset(kManyLinksHtml, &s));
+  EXPECT_TRUE(s.empty());
+  // Misnested tags.
+  EXPECT_FALSE(flatui::ParseHtmlSubset("<b><p>text</b></p>", &s));
+  // Implicitly closed paragraphs.
+  EXPECT_FALSE(flatui::ParseHtmlSubset(kSpacingHtml, &s));
+  // Unknown character references.
+  EXPECT_FALSE(flatui::ParseHtmlSubset("&copy;", &s));
+}
+
+#if defined(FLATUI_HAS_GUMBO)
+struct HtmlInput {
+  const char* name;
+  const char* html;
+};
+static const HtmlInput kHtmlInputs[] = {
+    {"Basic", kBasicHtml},
+    {"Link", kLinkHtml},
+    {"AnchorSpace", kAnchorSpaceHtml},
+    {"AnchorAfterParagraph", kAnchorAfterParagraphHtml},
+    {"ParagraphNoWhitespace", kParagraphNoWhitespaceHtml},
+    {"DropLeadingNewLines", kDropLeadingNewLinesHtml},
+    {"Spacing", kSpacingHtml},
+    {"SpecialCharacters", kSpecialCharactersHtml},
+    {"ManyLinks", kManyLinksHtml},
+    {"Subset", kSubsetHtml},
+};
+
+// The subset parser gives the same sections as Gumbo for HTML it handles.
+TEST_F(FlatUIHtmlTest, SubsetMatchesGumbo) {
+  for (size_t i = 0; i < FPL_ARRAYSIZE(kHtmlInputs); ++i) {
+    std::vector<HtmlSection> subset;
+    if (!flatui::ParseHtmlSubset(kHtmlInputs[i].html, &subset)) continue;
+    std::vector<HtmlSection> gumbo;
+    flatui::ParseHtmlWithGumbo(kHtmlInputs[i].html, &gumbo);
+    ASSERT_EQ(gumbo.size(), subset.size()) << kHtmlInputs[i].name;
+    for (size_t j = 0; j < gumbo.size(); ++j) {
+      EXPECT_EQ(gumbo[j].text(), subset[j].text()) << kHtmlInputs[i].name;
+      EXPECT_EQ(gumbo[j].link(), subset[j].link()) << kHtmlInputs[i].name;
+      EXPECT_EQ(gumbo[j].face(), subset[j].face()) << kHtmlInputs[i].name;
+      EXPECT_EQ(gumbo[j].size(), subset[j].size()) << kHtmlInputs[i].name;
+      EXPECT_EQ(gumbo[j].color(), subset[j].color()) << kHtmlInputs[i].name;
+    }
+  }
+}
+
+// Compares the subset parser with Gumbo on the inputs above.
+// Disabled by default, run with --gtest_also_run_disabled_tests.
+TEST_F(FlatUIHtmlTest, DISABLED_BenchmarkParseHtml) {
+  const int32_t kIterations = 10000;
+  for (size_t i = 0; i < FPL_ARRAYSIZE(kHtmlInputs); ++i) {
+    auto html = kHtmlInputs[i].html;
+    bool handled = false;
+    auto start = std::chrono::steady_clock::now();
+    for (int32_t j = 0; j < kIterations; ++j) {
+      std::vector<HtmlSection> s;
+      handled = flatui::ParseHtmlSubset(html, &s);
+    }
+    std::chrono::duration<double, std::micro> subset =
+        std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (int32_t j = 0; j < kIterations; ++j) {
+      std::vector<HtmlSection> s;
+      flatui::ParseHtmlWithGumbo(html, &s);
+    }
+    std::chrono::duration<double, std::micro> gumbo =
+        std::chrono::steady_clock::now() - start;
+
+    printf("%-22s subset %8.3f us  gumbo %8.3f us%s\n", kHtmlInputs[i].name,
+           subset.count() / kIterations, gumbo.count() / kIterations,
+           handled ? "" : "  (falls back to gumbo)");
+  }
 }
+#endif  // defined(FLATUI_HAS_GUMBO)
 
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,184 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "flatui/internal/flatui_layout.h"
+#include "flatui/internal/spatial_index.h"
+#include "gtest/gtest.h"
+
+class FlatUILayoutTest : public ::testing::Test {
+ protected:
+  // Layout rows of elements in nested groups, and return positions of the
+  // elements in the second pass.
+  std::vector<mathfu::vec2i> Layout(flatui::LayoutStorage *storage,
+                                    int32_t rows) {
+    std::vector<mathfu::vec2i> positions;
+    flatui::LayoutManager layout(mathfu::vec2i(1000, 1000), storage);
+    layout.Run([&]() {
+      layout.StartGroup(flatui::kDirVertical, flatui::kAlignLeft, 2.0f,
+                        flatui::HashId("list"));
+      for (int32_t i = 0; i < rows; ++i) {
+        layout.StartGroup(flatui::kDirHorizontal, flatui::kAlignTop, 0.0f,
+                          flatui::HashId("row"));
+        layout.Element(mathfu::vec2(20.0f, 10.0f), flatui::HashId("element"),
+                       [&](const mathfu::vec2i &pos, const mathfu::vec2i &) {
+                         positions.push_back(pos);
+                       });
+        layout.EndGroup();
+      }
+      layout.EndGroup();
+    });
+    return positions;
+  }
+};
+
+// Layouts with the same or fewer elements reuse the memory of the storage.
+TEST_F(FlatUILayoutTest, StorageReuse) {
+  flatui::LayoutStorage storage;
+  auto positions = Layout(&storage, 100);
+  EXPECT_EQ(1u, storage.allocation_count);
+  EXPECT_LT(0u, storage.elements.capacity());
+  EXPECT_LT(0u, storage.group_stack.capacity());
+
+  // Steady-state layouts don't allocate.
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(positions, Layout(&storage, 100));
+    Layout(&storage, 50);
+  }
+  EXPECT_EQ(1u, storage.allocation_count);
+
+  // A larger layout grows the containers.
+  Layout(&storage, 1000);
+  EXPECT_EQ(2u, storage.allocation_count);
+}
+
+// The storage doesn't change the result of the layout.
+TEST_F(FlatUILayoutTest, StorageLayout) {
+  flatui::LayoutStorage storage;
+  Layout(&storage, 10);
+  auto positions = Layout(&storage, 3);
+  EXPECT_EQ(Layout(nullptr, 3), positions);
+  ASSERT_EQ(3u, positions.size());
+  EXPECT_EQ(0, positions[0].y);
+  EXPECT_EQ(positions[0].y + 10 + 2, positions[1].y);
+}
+
+// Neighbors found in the spatial index are the nearest elements found by
+// scoring all elements.
+TEST_F(FlatUILayoutTest, SpatialIndexNeighbors) {
+  struct Rect {
+    flatui::HashedId hash;
+    mathfu::vec2i pos;
+    mathfu::vec2i size;
+  };
+  // Score of `to` from `from` in the direction, or -1 if it's not in the
+  // direction. Centers are doubled, as in SpatialIndex.
+  auto score = [](const Rect &from, const Rect &to,
+                  const mathfu::vec2i &direction) -> int64_t {
+    auto d = to.pos * 2 + to.size - from.pos * 2 - from.size;
+    auto along = static_cast<int64_t>(d.x) * direction.x +
+                 static_cast<int64_t>(d.y) * direction.y;
+    if (along <= 0) return -1;
+    return along + 2 * llabs(static_cast<int64_t>(d.x) * direction.y -
+                             static_cast<int64_t>(d.y) * direction.x);
+  };
+
+  // Rects in various sizes, some of them crossing the canvas border.
+  const mathfu::vec2i canvas(800, 600);
+  std::vector<Rect> rects;
+  uint32_t seed = 1;
+  auto random = [&seed](int32_t n) {
+    seed = seed * 1103515245 + 12345;
+    return static_cast<int32_t>((seed >> 16) % n);
+  };
+  for (int32_t i = 0; i < 200; ++i) {
+    Rect rect;
+    rect.hash = flatui::HashId(reinterpret_cast<const char *>(&i),
+                               static_cast<int32_t>(sizeof(i)));
+    rect.pos = mathfu::vec2i(random(canvas.x + 100) - 50,
+                             random(canvas.y + 100) - 50);
+    rect.size = mathfu::vec2i(random(100) + 1, random(50) + 1);
+    rects.push_back(rect);
+  }
+
+  const mathfu::vec2i directions[] = {
+      mathfu::vec2i(1, 0), mathfu::vec2i(-1, 0), mathfu::vec2i(0, 1),
+      mathfu::vec2i(0, -1)};
+  flatui::SpatialIndex index;
+  // The index gives the same results when it's rebuilt in its storage.
+  for (int32_t frame = 0; frame < 2; ++frame) {
+    index.Clear(canvas);
+    for (auto it = rects.begin(); it != rects.end(); ++it) {
+      index.Insert(it->hash, it->pos, it->size);
+    }
+    for (auto from = rects.begin(); from != rects.end(); ++from) {
+      ASSERT_TRUE(index.Contains(from->hash));
+      for (size_t i = 0; i < sizeof(directions) / sizeof(directions[0]);
+           ++i) {
+        int64_t best = -1;
+        for (auto to = rects.begin(); to != rects.end(); ++to) {
+          auto s = to == from ? -1 : score(*from, *to, directions[i]);
+          if (s >= 0 && (best < 0 || s < best)) best = s;
+        }
+        auto found = index.FindNeighbor(from->hash, directions[i]);
+        if (best < 0) {
+          EXPECT_EQ(flatui::kNullHash, found);
+          continue;
+        }
+        // Elements with the same score are equally near.
+        auto to = rects.begin();
+        while (to != rects.end() && to->hash != found) ++to;
+        ASSERT_NE(rects.end(), to);
+        EXPECT_EQ(best, score(*from, *to, directions[i]));
+      }
+    }
+  }
+
+  // Elements not in the index have no neighbors.
+  EXPECT_FALSE(index.Contains(flatui::HashId("missing")));
+  EXPECT_EQ(flatui::kNullHash, index.FindNeighbor(flatui::HashId("missing"),
+                                                  directions[0]));
+}
+
+// ConstHashId() computes the hashes of HashId() at compile time.
+static_assert(flatui::ConstHashId("") == flatui::kInitialHashValue,
+              "ConstHashId of the empty string");
+static_assert(flatui::ConstHashId("a") == 0x8601ec8c, "ConstHashId of a");
+static_assert(flatui::ConstHashId("list") == 0x69748141,
+              "ConstHashId of list");
+static_assert(flatui::ConstHashId("ok_button") == 0xe19c3404,
+              "ConstHashId of ok_button");
+
+TEST_F(FlatUILayoutTest, ConstHashId) {
+  const char *ids[] = {"", "a", "list", "ok_button", "\xe6\x97\xa5"};
+  EXPECT_EQ(flatui::HashId(ids[0]), flatui::ConstHashId(""));
+  EXPECT_EQ(flatui::HashId(ids[1]), flatui::ConstHashId("a"));
+  EXPECT_EQ(flatui::HashId(ids[2]), flatui::ConstHashId("list"));
+  EXPECT_EQ(flatui::HashId(ids[3]), flatui::ConstHashId("ok_button"));
+  EXPECT_EQ(flatui::HashId(ids[4]), flatui::ConstHashId("\xe6\x97\xa5"));
+  // Seeded hashes match as well.
+  EXPECT_EQ(flatui::HashId("button", flatui::HashId("list")),
+            flatui::ConstHashId("button", flatui::ConstHashId("list")));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Dummy entry to link the test in Android successfully.
+extern "C" int FPL_main(int /*argc*/, char ** /*argv*/) { return 0; }
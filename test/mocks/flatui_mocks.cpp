@@ -96,14 +96,34 @@ void SetTextDirection(const TextLayoutDirection) {}
 
 void SetMargin(const Margin&) {}
 
+void Image(const fplbase::Texture&, float, HashedId) {}
+
+void HtmlLabel(const char*, float, const mathfu::vec2&, TextAlignment,
+               HashedId) {}
+
+Event Edit(float, const mathfu::vec2&, HashedId, EditStatus*, std::string*) {
+  return kEventNone;
+}
+
+Event Edit(float, const mathfu::vec2&, TextAlignment, HashedId, EditStatus*,
+           std::string*) {
+  return kEventNone;
+}
+
+void StartGroup(Layout, float, HashedId) {}
+
 Event CheckEvent() { return kEventNone; }
 
 Event CheckEvent(bool) { return kEventNone; }
 
 void SetDefaultFocus();
 
+void EnableSpatialNavigation(bool) {}
+
 void CapturePointer(const char*) {}
 
+void CapturePointer(HashedId) {}
+
 void ReleasePointer() {}
 
 ssize_t GetCapturedPointerIndex() { return 0; }
@@ -122,6 +142,10 @@ void CustomElement(
     const mathfu::vec2&, const char*,
     const std::function<void(const mathfu::vec2i&, const mathfu::vec2i)>) {}
 
+void CustomElement(
+    const mathfu::vec2&, HashedId,
+    const std::function<void(const mathfu::vec2i&, const mathfu::vec2i)>) {}
+
 void RenderTexture(const fplbase::Texture&, const mathfu::vec2i,
                    const mathfu::vec2i) {}
 
@@ -145,4 +169,41 @@ const FlatUIVersion* GetFlatUIVersion() { return &fake_version; }
 
 void SetDepthTest(bool) {}
 
+void EnableDrawBatching(bool) {}
+
+void VirtualList(const mathfu::vec2&, mathfu::vec2*, int32_t, float,
+                 const std::function<void(int32_t)>&) {}
+
+void VirtualList(const mathfu::vec2&, mathfu::vec2*, int32_t,
+                 const std::function<float(int32_t)>&,
+                 const std::function<void(int32_t)>&) {}
+
+RenderStateStats fake_render_state_stats;
+const RenderStateStats& GetRenderStateStats() {
+  return fake_render_state_stats;
+}
+
+const RenderStateStats& GetFrameRenderStateStats() {
+  return fake_render_state_stats;
+}
+
+void ResetRenderStateStats() {}
+
+void EnableRetainedLayout(bool) {}
+
+void InvalidateLayout() {}
+
+uint32_t GetLayoutAllocationCount() { return 0; }
+
+void EnableRenderCache(bool) {}
+
+void InvalidateRenderCache() {}
+
+RenderCacheStats fake_render_cache_stats;
+const RenderCacheStats& GetRenderCacheStats() {
+  return fake_render_cache_stats;
+}
+
+void EnableTextMultiChannelSDF(bool, float) {}
+
 }  // flatui
@@ -0,0 +1,439 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <assert.h>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "flatui/flatui.h"
+#include "flatui/font_manager.h"
+#include "fplbase/asset_manager.h"
+#include "fplbase/input.h"
+#include "fplbase/renderer.h"
+#include "fplbase/utilities.h"
+#include "fplutil/main.h"
+#include "gtest/gtest.h"
+#include "motive/engine.h"
+
+// Tests of frames run with flatui::Run().
+class FlatUIRunTest : public ::testing::Test {
+ public:
+  MATHFU_DEFINE_CLASS_SIMD_AWARE_NEW_DELETE
+
+ protected:
+  virtual void SetUp() {
+    renderer_.Initialize(mathfu::vec2i(800, 600), "FlatUI test");
+    input_.Initialize();
+
+    // Set the local directory to the assets folder for this sample.
+    bool result = fplbase::ChangeToUpstreamDir("../", "assets");
+    assert(result);
+    (void)result;
+
+    assetman_ = new fplbase::AssetManager(renderer_);
+    font_manager_ = new flatui::FontManager();
+    font_manager_->Open("fonts/NotoSansCJKjp-Bold.otf");
+    for (int32_t i = 0; i < 10; ++i) {
+      texts_.push_back("Item " + std::to_string(i));
+    }
+  }
+
+  virtual void TearDown() {
+    // Settings persist across frames, so reset them for following tests.
+    flatui::EnableRetainedLayout(false);
+    flatui::EnableRenderCache(false);
+    delete font_manager_;
+    delete assetman_;
+    renderer_.ShutDown();
+  }
+
+  // Run a frame, and return its render state counters.
+  flatui::RenderStateStats Run(const std::function<void()> &gui) {
+    flatui::Run(*assetman_, *font_manager_, input_, gui);
+    return flatui::GetFrameRenderStateStats();
+  }
+
+  // Define a list of labels.
+  void Labels() {
+    flatui::SetVirtualResolution(1000);
+    flatui::StartGroup(flatui::kLayoutVerticalLeft, 2.0f, "list");
+    for (auto it = texts_.begin(); it != texts_.end(); ++it) {
+      flatui::Label(it->c_str(), 16.0f);
+    }
+    flatui::EndGroup();
+  }
+
+  fplbase::Renderer renderer_;
+  fplbase::InputSystem input_;
+  fplbase::AssetManager *assetman_;
+  flatui::FontManager *font_manager_;
+  std::vector<std::string> texts_;
+};
+
+// Labels drawn with the draw batching take fewer draw calls than labels drawn
+// one by one.
+TEST_F(FlatUIRunTest, TestDrawBatching) {
+  // Cache glyphs first, so that atlas updates don't flush batches.
+  Run([&]() { Labels(); });
+  auto unbatched = Run([&]() { Labels(); });
+  EXPECT_LE(texts_.size(), unbatched.draw_calls);
+  EXPECT_EQ(1u, unbatched.frames);
+
+  auto batched = Run([&]() {
+    flatui::EnableDrawBatching(true);
+    Labels();
+  });
+  EXPECT_LT(0u, batched.draw_calls);
+  EXPECT_LT(batched.draw_calls, unbatched.draw_calls);
+
+  // The setting is reset every frame.
+  EXPECT_EQ(unbatched.draw_calls, Run([&]() { Labels(); }).draw_calls);
+}
+
+// Labels sharing the atlas texture and the text color skip redundant texture
+// binds and uniform uploads.
+TEST_F(FlatUIRunTest, TestRenderStateStats) {
+  Run([&]() { Labels(); });
+  flatui::ResetRenderStateStats();
+  auto frame = Run([&]() { Labels(); });
+  EXPECT_LT(0u, frame.skipped_texture_binds);
+  EXPECT_LT(frame.texture_binds, texts_.size());
+  EXPECT_LT(0u, frame.skipped_uniform_uploads);
+  EXPECT_LT(0u, frame.uniform_uploads);
+
+  // Counters accumulate over frames until they are reset.
+  Run([&]() { Labels(); });
+  auto &total = flatui::GetRenderStateStats();
+  EXPECT_EQ(2u, total.frames);
+  EXPECT_EQ(2 * frame.skipped_texture_binds, total.skipped_texture_binds);
+  EXPECT_EQ(2 * frame.skipped_uniform_uploads, total.skipped_uniform_uploads);
+  flatui::ResetRenderStateStats();
+  EXPECT_EQ(0u, flatui::GetRenderStateStats().frames);
+  EXPECT_EQ(0u, flatui::GetRenderStateStats().skipped_uniform_uploads);
+}
+
+// Frames retain a layout once two layout passes in a row give the same
+// elements, and lay out again when the layout is invalidated or changes.
+TEST_F(FlatUIRunTest, TestRetainedLayout) {
+  flatui::EnableRetainedLayout(true);
+  int32_t calls = 0;
+  size_t count = texts_.size();
+  auto gui = [&]() {
+    ++calls;
+    flatui::SetVirtualResolution(1000);
+    flatui::StartGroup(flatui::kLayoutVerticalLeft, 2.0f, "list");
+    for (size_t i = 0; i < count; ++i) {
+      flatui::Label(texts_[i].c_str(), 16.0f);
+    }
+    flatui::EndGroup();
+  };
+  Run(gui);
+  auto laid_out = Run(gui);
+  EXPECT_EQ(4, calls);
+
+  // Retained frames only run the render pass, and draw the same.
+  calls = 0;
+  auto retained = Run(gui);
+  EXPECT_EQ(1, calls);
+  EXPECT_EQ(laid_out.draw_calls, retained.draw_calls);
+  Run(gui);
+  EXPECT_EQ(2, calls);
+
+  // An invalidated layout runs the layout pass in the next frame only.
+  flatui::InvalidateLayout();
+  calls = 0;
+  Run(gui);
+  EXPECT_EQ(2, calls);
+  Run(gui);
+  EXPECT_EQ(3, calls);
+
+  // A render pass finding other elements drops the retained layout, and the
+  // next frames lay out until the layout is stable again.
+  count = texts_.size() - 1;
+  calls = 0;
+  Run(gui);
+  EXPECT_EQ(1, calls);
+  Run(gui);
+  Run(gui);
+  EXPECT_EQ(5, calls);
+  Run(gui);
+  EXPECT_EQ(6, calls);
+
+  // Layouts aren't retained once the mode is disabled.
+  flatui::EnableRetainedLayout(false);
+  calls = 0;
+  Run(gui);
+  Run(gui);
+  EXPECT_EQ(4, calls);
+}
+
+// Frames drawing the same as the cached frame draw the cached UI, and frames
+// with changes or an invalidated cache render the UI again.
+TEST_F(FlatUIRunTest, TestRenderCache) {
+  Run([&]() { Labels(); });
+  flatui::EnableRenderCache(true);
+  auto stats = flatui::GetRenderCacheStats();
+  Run([&]() { Labels(); });
+  EXPECT_EQ(stats.hits, flatui::GetRenderCacheStats().hits);
+  EXPECT_EQ(stats.misses + 1, flatui::GetRenderCacheStats().misses);
+
+  // The cached frame is drawn with a single quad.
+  auto frame = Run([&]() { Labels(); });
+  EXPECT_EQ(stats.hits + 1, flatui::GetRenderCacheStats().hits);
+  EXPECT_EQ(1u, frame.draw_calls);
+
+  // Invalidated or changed frames are rendered again.
+  flatui::InvalidateRenderCache();
+  Run([&]() { Labels(); });
+  EXPECT_EQ(stats.misses + 2, flatui::GetRenderCacheStats().misses);
+  texts_[0] = "Changed";
+  Run([&]() { Labels(); });
+  EXPECT_EQ(stats.misses + 3, flatui::GetRenderCacheStats().misses);
+  Run([&]() { Labels(); });
+  EXPECT_EQ(stats.hits + 2, flatui::GetRenderCacheStats().hits);
+  EXPECT_EQ(stats.misses + 3, flatui::GetRenderCacheStats().misses);
+}
+
+// Virtual lists define only the items around the scrolling window, at the
+// same positions as in a scrolling group of all the items.
+TEST_F(FlatUIRunTest, TestVirtualList) {
+  const int32_t kCount = 1000;
+  const mathfu::vec2 window(100.0f, 100.0f);
+  bool fixed_height = true;
+  std::function<float(int32_t)> height = [&fixed_height](int32_t i) {
+    return fixed_height || i % 3 == 0 ? 30.0f : 20.0f;
+  };
+  std::set<int32_t> defined;
+  std::map<int32_t, mathfu::vec2i> positions;
+  auto item = [&](int32_t i) {
+    defined.insert(i);
+    flatui::CustomElement(
+        mathfu::vec2(50.0f, height(i)), "item",
+        [&positions, i](const mathfu::vec2i &pos, const mathfu::vec2i &) {
+          positions[i] = pos;
+        });
+  };
+  // Lay out the items in a virtual list, or all of them in a scrolling group.
+  auto list = [&](bool virtual_list, mathfu::vec2 *offset) {
+    flatui::SetVirtualResolution(600);
+    flatui::StartGroup(flatui::kLayoutVerticalLeft, 0.0f, "list");
+    if (virtual_list && fixed_height) {
+      flatui::VirtualList(window, offset, kCount, 30.0f, item);
+    } else if (virtual_list) {
+      flatui::VirtualList(window, offset, kCount, height, item);
+    } else {
+      flatui::StartScroll(window, offset);
+      for (int32_t i = 0; i < kCount; ++i) item(i);
+      flatui::EndScroll();
+    }
+    flatui::EndGroup();
+  };
+
+  const float offsets[] = {0.0f, 15.0f, 500.0f, 10000.0f};
+  for (auto pass = 0; pass < 2; ++pass) {
+    fixed_height = pass == 0;
+    for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); ++i) {
+      mathfu::vec2 scroll_offset(0.0f, offsets[i]);
+      positions.clear();
+      Run([&]() { list(false, &scroll_offset); });
+      auto expected = positions;
+
+      mathfu::vec2 offset(0.0f, offsets[i]);
+      defined.clear();
+      positions.clear();
+      Run([&]() { list(true, &offset); });
+      EXPECT_EQ(scroll_offset.y, offset.y);
+      ASSERT_FALSE(defined.empty());
+
+      // Items covering the window and a few around it are defined.
+      auto first = *defined.begin();
+      auto last = *defined.rbegin();
+      EXPECT_EQ(static_cast<size_t>(last - first + 1), defined.size());
+      EXPECT_GE(15u, defined.size());
+      float start = 0.0f;
+      for (auto j = 0; j < first; ++j) start += height(j);
+      EXPECT_LE(start, offsets[i]);
+      for (auto j = first; j <= last; ++j) start += height(j);
+      EXPECT_TRUE(last == kCount - 1 || start >= offsets[i] + window.y);
+
+      // Rendered items are where they are in the scrolling group.
+      for (auto it = positions.begin(); it != positions.end(); ++it) {
+        auto pos = expected.find(it->first);
+        ASSERT_NE(expected.end(), pos) << it->first;
+        EXPECT_EQ(pos->second.x, it->second.x) << it->first;
+        EXPECT_EQ(pos->second.y, it->second.y) << it->first;
+      }
+    }
+  }
+}
+
+// Animations keep their values while Animatable() is called every frame, and
+// are dropped after a frame without the call.
+TEST_F(FlatUIRunTest, TestAnimatable) {
+  motive::MotiveEngine engine;
+  const flatui::AnimCurveDescription curve(flatui::kAnimEaseInEaseOut, 10.0f,
+                                           100.0f, 0.5f);
+  std::map<std::string, float> values;
+  auto animate = [&](const char *id, float starting_value) {
+    values[id] = flatui::Animatable<float>(id, starting_value);
+  };
+  flatui::Run(*assetman_, *font_manager_, input_, &engine, [&]() {
+    animate("b", 1.0f);
+    animate("a", 2.0f);
+    animate("c", 3.0f);
+  });
+  EXPECT_EQ(1.0f, values["b"]);
+  EXPECT_EQ(2.0f, values["a"]);
+  EXPECT_EQ(3.0f, values["c"]);
+
+  flatui::Run(*assetman_, *font_manager_, input_, &engine, [&]() {
+    animate("c", 0.0f);
+    animate("a", 0.0f);
+    animate("b", 0.0f);
+    flatui::StartAnimation<float>("a", 10.0f, 0.0f, curve);
+  });
+  EXPECT_EQ(1.0f, values["b"]);
+  EXPECT_EQ(2.0f, values["a"]);
+  EXPECT_EQ(3.0f, values["c"]);
+
+  // "b" isn't animated in this frame, so it's gone in the next one.
+  engine.AdvanceFrame(flatui::kSecondsToMotiveTime);
+  flatui::Run(*assetman_, *font_manager_, input_, &engine, [&]() {
+    animate("a", 0.0f);
+    animate("c", 0.0f);
+  });
+  EXPECT_NEAR(10.0f, values["a"], 0.01f);
+  EXPECT_EQ(3.0f, values["c"]);
+  flatui::Run(*assetman_, *font_manager_, input_, &engine, [&]() {
+    animate("b", 5.0f);
+    animate("c", 0.0f);
+  });
+  EXPECT_EQ(5.0f, values["b"]);
+  EXPECT_EQ(3.0f, values["c"]);
+}
+
+// Sprites are drawn until their draw function returns true in a render pass,
+// including sprites added by another sprite, and are dropped after a frame
+// without DrawSprites().
+TEST_F(FlatUIRunTest, TestSprites) {
+  motive::MotiveEngine engine;
+  bool added = false;
+  int32_t draws = 0;
+  int32_t child_draws = 0;
+  int active = -1;
+  std::vector<flatui::SequenceId> sequences;
+  auto gui = [&](bool draw_sprites) {
+    if (!added) {
+      added = true;
+      sequences.push_back(flatui::AddSprite("fx", [&](flatui::SequenceId) {
+        return ++draws >= 4;
+      }));
+      sequences.push_back(flatui::AddSprite("fx", [&](flatui::SequenceId) {
+        if (sequences.size() == 2) {
+          sequences.push_back(flatui::AddSprite("fx", [&](flatui::SequenceId) {
+            ++child_draws;
+            return true;
+          }));
+        }
+        return false;
+      }));
+    }
+    if (draw_sprites) flatui::DrawSprites("fx");
+    active = flatui::NumActiveSprites("fx");
+  };
+  auto run = [&](bool draw_sprites) {
+    flatui::Run(*assetman_, *font_manager_, input_, &engine,
+                [&]() { gui(draw_sprites); });
+  };
+
+  // The child sprite is drawn in the loop it's added in, and is done after
+  // the render pass.
+  run(true);
+  ASSERT_EQ(3u, sequences.size());
+  EXPECT_EQ(sequences[0] + 1, sequences[1]);
+  EXPECT_EQ(sequences[1] + 1, sequences[2]);
+  EXPECT_EQ(2, draws);
+  EXPECT_EQ(2, child_draws);
+  EXPECT_EQ(2, active);
+
+  run(true);
+  EXPECT_EQ(4, draws);
+  EXPECT_EQ(1, active);
+
+  run(false);
+  EXPECT_EQ(1, active);
+  run(false);
+  EXPECT_EQ(0, active);
+  EXPECT_EQ(4, draws);
+  EXPECT_EQ(2, child_draws);
+}
+
+// World panels share draw batches, and keep their own retained layouts.
+TEST_F(FlatUIRunTest, TestWorldPanels) {
+  flatui::EnableRetainedLayout(true);
+  const size_t kCount = 8;
+  std::vector<int32_t> calls(kCount, 0);
+  std::vector<flatui::WorldPanel> panels(kCount);
+  for (size_t i = 0; i < kCount; ++i) {
+    auto &panel = panels[i];
+    panel.id = flatui::HashId(texts_[i].c_str());
+    panel.canvas_size = mathfu::vec2i(200, 50);
+    panel.transform = mathfu::mat4::FromTranslationVector(
+        mathfu::vec3(0.0f, 60.0f * i, 0.0f));
+    panel.gui_definition = [this, &calls, i]() {
+      ++calls[i];
+      flatui::StartGroup(flatui::kLayoutVerticalLeft, 0.0f, "panel");
+      flatui::Label(texts_[i].c_str(), 16.0f);
+      flatui::EndGroup();
+    };
+  }
+  const auto view_projection =
+      mathfu::mat4::Ortho(0.0f, 800.0f, 600.0f, 0.0f, -1.0f, 1.0f);
+  auto run = [&](size_t first) {
+    flatui::RunWorldPanels(*assetman_, *font_manager_, input_,
+                           view_projection, &panels[first], kCount - first);
+    return flatui::GetFrameRenderStateStats();
+  };
+
+  // Labels of all panels are drawn in fewer draw calls than panels, and
+  // the panels add up to one frame.
+  run(0);
+  auto laid_out = run(0);
+  EXPECT_EQ(1u, laid_out.frames);
+  EXPECT_LT(0u, laid_out.draw_calls);
+  EXPECT_GT(kCount, laid_out.draw_calls);
+  for (size_t i = 0; i < kCount; ++i) EXPECT_EQ(4, calls[i]) << i;
+
+  // Each panel retains its layout.
+  auto retained = run(0);
+  EXPECT_EQ(laid_out.draw_calls, retained.draw_calls);
+  for (size_t i = 0; i < kCount; ++i) EXPECT_EQ(5, calls[i]) << i;
+
+  // The layout of a panel not rendered in a frame is dropped.
+  run(1);
+  EXPECT_EQ(5, calls[0]);
+  run(0);
+  EXPECT_EQ(7, calls[0]);
+  for (size_t i = 1; i < kCount; ++i) EXPECT_EQ(7, calls[i]) << i;
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Dummy entry to link the test in Android successfully.
+extern "C" int FPL_main(int /*argc*/, char ** /*argv*/) { return 0; }
@@ -1478,6 +1478,89 @@ TEST_F(FlatUISerializationTest, TestCreateFlatUIFromData) {
       error_output);
 }
 
+TEST_F(FlatUISerializationTest, TestCompiledFlatUI) {
+  // Mock the `fplbase::LogError` function to assert it is called.
+  fplbase::FplbaseMocks& fplbase_mocks = fplbase::FplbaseMocks::get_mocks();
+
+  // Used to capture the error output of the `LogError` mock.
+  std::string error_output;
+
+  EXPECT_CALL(fplbase_mocks, LogError(_, _))
+      .WillRepeatedly(SaveArg<0>(&error_output));
+
+  flatui::CompiledFlatUI compiled;
+  ASSERT_FALSE(compiled.Compile(nullptr));
+  ASSERT_EQ(
+      "\"CompiledFlatUI::Compile\" requires that \"flatui_data\" is not a"
+      " \"nullptr\".",
+      error_output);
+  ASSERT_TRUE(compiled.empty());
+
+  // Create a fake FlatBuffer data with a group of a label, and a label that
+  // is missing its `ysize` field.
+  flatbuffers::FlatBufferBuilder builder;
+  auto label_id = builder.CreateString("compiled label ID");
+  auto label_text = builder.CreateString("compiled label text");
+  auto invalid_id = builder.CreateString("compiled invalid ID");
+  auto group_id = builder.CreateString("compiled group ID");
+
+  flatui_data::FlatUIElementBuilder label_builder(builder);
+  label_builder.add_type(flatui_data::Type_Label);
+  label_builder.add_id(label_id);
+  label_builder.add_text(label_text);
+  label_builder.add_ysize(10.0f);
+  auto label_offset = label_builder.Finish();
+
+  flatui_data::FlatUIElementBuilder invalid_builder(builder);
+  invalid_builder.add_type(flatui_data::Type_Label);
+  invalid_builder.add_id(invalid_id);
+  invalid_builder.add_text(label_text);
+  auto invalid_offset = invalid_builder.Finish();
+
+  std::vector<flatbuffers::Offset<flatui_data::FlatUIElement>> children_vector;
+  children_vector.push_back(label_offset);
+  children_vector.push_back(invalid_offset);
+  auto children = builder.CreateVector(children_vector);
+
+  flatui_data::FlatUIElementBuilder group_builder(builder);
+  group_builder.add_type(flatui_data::Type_Group);
+  group_builder.add_id(group_id);
+  group_builder.add_layout(flatui_data::Layout_VerticalLeft);
+  group_builder.add_elements(children);
+  auto group_offset = group_builder.Finish();
+
+  std::vector<flatbuffers::Offset<flatui_data::FlatUIElement>> elements_vector;
+  elements_vector.push_back(group_offset);
+  auto elements = builder.CreateVector(elements_vector);
+
+  flatui_data::FlatUIBuilder flatui_builder(builder);
+  flatui_builder.add_elements(elements);
+  builder.Finish(flatui_builder.Finish());
+
+  // The invalid label is reported once, when the data is compiled.
+  error_output.clear();
+  ASSERT_TRUE(compiled.Compile(builder.GetBufferPointer()));
+  ASSERT_EQ(std::string("Required field \"ysize\" is missing for FlatUI"
+                        " element with ID \"%s\"."),
+            error_output);
+  ASSERT_FALSE(compiled.empty());
+
+  // Mock calls to `flatui` library functions.
+  flatui::FlatUIMocks& flatui_mocks = flatui::FlatUIMocks::get_mocks();
+
+  EXPECT_CALL(flatui_mocks, StartGroup(flatui::kLayoutVerticalLeft, _, _))
+      .Times(2);
+  EXPECT_CALL(flatui_mocks, Label(_, 10.0f)).Times(2);
+  EXPECT_CALL(flatui_mocks, EndGroup()).Times(2);
+  error_output.clear();
+  compiled.Create();
+  compiled.Create();
+  ASSERT_TRUE(error_output.empty());
+
+  compiled.Clear();
+  ASSERT_TRUE(compiled.empty());
+}
+
 TEST_F(FlatUISerializationTest, TestHasDynamicData) {
   bool result = flatui::HasDynamicData("This should be a fake ID",
                                        flatui::DynamicData::kIntData);
@@ -27,11 +27,17 @@ LOCAL_SRC_FILES := \
   ../mocks/fplbase_mocks.cpp \
   $(FLATUI_DIR)/src/font_manager.cpp \
   $(FLATUI_DIR)/src/font_systemfont.cpp \
+  $(FLATUI_DIR)/src/font_vertex_buffer.cpp \
   $(FLATUI_DIR)/src/font_util.cpp \
   $(FLATUI_DIR)/src/glyph_cache.cpp \
+  $(FLATUI_DIR)/src/glyph_cache_uploader.cpp \
+  $(FLATUI_DIR)/src/glyph_disk_cache.cpp \
+  $(FLATUI_DIR)/src/glyph_rasterizer.cpp \
   $(FLATUI_DIR)/src/hb_complex_font.cpp \
   $(FLATUI_DIR)/src/micro_edit.cpp \
   $(FLATUI_DIR)/src/script_table.cpp \
+  $(FLATUI_DIR)/src/shaping_cache.cpp \
+  $(FLATUI_DIR)/src/simd_antialias_distance_computer.cpp \
   $(FLATUI_DIR)/src/version.cpp
 
 LOCAL_C_INCLUDES := \
@@ -0,0 +1,699 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <limits>
+#include <string>
+#include <vector>
+#include "flatui/flatui.h"
+#include "flatui/font_manager.h"
+#include "flatui/font_util.h"
+#include "flatui/internal/decoded_text.h"
+#include "flatui/internal/micro_edit.h"
+#include "fplbase/renderer.h"
+#include "fplbase/utilities.h"
+#include "fplutil/main.h"
+#include "gtest/gtest.h"
+#include "linebreak.h"
+
+// Tests of text layouts of FontManager.
+class FlatUITextLayoutTest : public ::testing::Test {
+ public:
+  MATHFU_DEFINE_CLASS_SIMD_AWARE_NEW_DELETE
+
+ protected:
+  virtual void SetUp() {
+    renderer_.Initialize(mathfu::vec2i(800, 600), "FlatUI test");
+
+    font_manager_ = new flatui::FontManager(mathfu::vec2i(256, 256), 2);
+
+    // Set the local directory to the assets folder for this sample.
+    bool result = fplbase::ChangeToUpstreamDir("../", "assets");
+    assert(result);
+    (void)result;
+
+    font_manager_->Open("fonts/NotoSansCJKjp-Bold.otf");
+  }
+
+  virtual void TearDown() {
+    delete font_manager_;
+    renderer_.ShutDown();
+  }
+
+  // Lay out a text in a new non-ref-counted buffer identified by the id, and
+  // return a copy of its vertices.
+  std::vector<flatui::FontVertex> Layout(const char *text, const char *id,
+                                         const mathfu::vec2i &size,
+                                         float ysize = 48.0f) {
+    auto parameter = flatui::FontBufferParameters(
+        font_manager_->GetCurrentFont()->GetFontId(), flatui::HashId(id),
+        ysize, size, flatui::kTextAlignmentLeft, flatui::kGlyphFlagsNone, true,
+        false);
+    auto buffer = font_manager_->GetBuffer(text, strlen(text), parameter);
+    EXPECT_NE(nullptr, buffer);
+    return buffer ? buffer->get_vertices() : std::vector<flatui::FontVertex>();
+  }
+
+  // Check that two layouts place glyphs at the same positions.
+  static void ExpectSamePositions(const std::vector<flatui::FontVertex> &a,
+                                  const std::vector<flatui::FontVertex> &b) {
+    ASSERT_EQ(a.size(), b.size());
+    for (size_t i = 0; i < a.size(); ++i) {
+      EXPECT_EQ(a[i].position_.data[0], b[i].position_.data[0]) << i;
+      EXPECT_EQ(a[i].position_.data[1], b[i].position_.data[1]) << i;
+    }
+  }
+
+  fplbase::Renderer renderer_;
+  flatui::FontManager *font_manager_;
+};
+
+// Simple runs laid out without HarfBuzz are placed as shaped runs.
+TEST_F(FlatUITextLayoutTest, TestSimpleTextLayout) {
+  const char text[] = "Score: 1234567890 AVAWAY";
+  auto parameter = flatui::FontBufferParameters(
+      font_manager_->GetCurrentFont()->GetFontId(), flatui::HashId(text),
+      static_cast<float>(48), mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+      flatui::kGlyphFlagsNone, true, false);
+  font_manager_->SetShapingCacheSize(0);
+  font_manager_->EnableTextPipelineStats(true);
+  auto shaped = font_manager_->GetBuffer(text, strlen(text), parameter);
+  ASSERT_NE(nullptr, shaped);
+  auto shaped_vertices = shaped->get_vertices();
+  auto stats = font_manager_->GetTextPipelineStats();
+  EXPECT_EQ(0u, stats.simple_runs);
+
+  // Lay out the text again in another buffer.
+  font_manager_->EnableSimpleTextLayout(true);
+  font_manager_->ResetTextPipelineStats();
+  parameter = flatui::FontBufferParameters(
+      font_manager_->GetCurrentFont()->GetFontId(), flatui::HashId("simple"),
+      static_cast<float>(48), mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+      flatui::kGlyphFlagsNone, true, false);
+  auto simple = font_manager_->GetBuffer(text, strlen(text), parameter);
+  ASSERT_NE(nullptr, simple);
+  ASSERT_NE(shaped, simple);
+  auto simple_stats = font_manager_->GetTextPipelineStats();
+  EXPECT_EQ(stats.shaped_runs, simple_stats.shaped_runs +
+                                   simple_stats.simple_runs);
+
+  auto &vertices = simple->get_vertices();
+  ASSERT_EQ(shaped_vertices.size(), vertices.size());
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    EXPECT_EQ(shaped_vertices[i].position_.data[0],
+              vertices[i].position_.data[0]);
+    EXPECT_EQ(shaped_vertices[i].position_.data[1],
+              vertices[i].position_.data[1]);
+  }
+
+  // Text outside Latin-1 is shaped.
+  const char text2[] = "\xE3\x81\x82\xE3\x81\x84";
+  parameter = flatui::FontBufferParameters(
+      font_manager_->GetCurrentFont()->GetFontId(), flatui::HashId(text2),
+      static_cast<float>(48), mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+      flatui::kGlyphFlagsNone, true, false);
+  font_manager_->ResetTextPipelineStats();
+  ASSERT_NE(nullptr, font_manager_->GetBuffer(text2, strlen(text2), parameter));
+  stats = font_manager_->GetTextPipelineStats();
+  EXPECT_EQ(0u, stats.simple_runs);
+  EXPECT_LT(0u, stats.shaped_runs);
+}
+
+// Texts laid out again restore shaped runs from the shaping cache, and give
+// the same layout as texts shaped again.
+TEST_F(FlatUITextLayoutTest, TestShapingCache) {
+  const char text[] = "Lorem ipsum dolor sit amet";
+  const mathfu::vec2i size(0, 0);
+  font_manager_->EnableTextPipelineStats(true);
+  auto shaped = Layout(text, "shaped", size);
+  auto stats = font_manager_->GetTextPipelineStats();
+  EXPECT_LT(0u, stats.shaped_runs);
+  auto memory = font_manager_->GetMemoryUsage().layout_caches;
+  EXPECT_LT(0u, memory);
+
+  // A buffer missing the FontBuffer cache restores the shaped run.
+  font_manager_->ResetTextPipelineStats();
+  ExpectSamePositions(shaped, Layout(text, "restored", size));
+  stats = font_manager_->GetTextPipelineStats();
+  EXPECT_EQ(1u, stats.buffer_misses);
+  EXPECT_EQ(0u, stats.shaped_runs);
+  EXPECT_EQ(memory, font_manager_->GetMemoryUsage().layout_caches);
+
+  // Another glyph size is shaped again.
+  font_manager_->ResetTextPipelineStats();
+  Layout(text, "larger", size, 64.0f);
+  EXPECT_LT(0u, font_manager_->GetTextPipelineStats().shaped_runs);
+
+  // Closing the font clears the cache, since a font reopened with the name
+  // may have other glyphs.
+  ASSERT_TRUE(font_manager_->Close("fonts/NotoSansCJKjp-Bold.otf"));
+  ASSERT_TRUE(font_manager_->Open("fonts/NotoSansCJKjp-Bold.otf"));
+  font_manager_->ResetTextPipelineStats();
+  ExpectSamePositions(shaped, Layout(text, "reopened", size));
+  EXPECT_LT(0u, font_manager_->GetTextPipelineStats().shaped_runs);
+
+  // Without the cache, each layout shapes the text.
+  font_manager_->SetShapingCacheSize(0);
+  for (auto i = 0; i < 2; ++i) {
+    font_manager_->ResetTextPipelineStats();
+    ExpectSamePositions(shaped,
+                        Layout(text, i ? "uncached2" : "uncached1", size));
+    EXPECT_LT(0u, font_manager_->GetTextPipelineStats().shaped_runs);
+  }
+}
+
+// Reflows of a wrapped text restore its word breaks and shaped words, and
+// give the same layout as a text broken into words again.
+TEST_F(FlatUITextLayoutTest, TestWordBreakCache) {
+  const char text[] = "Lorem ipsum dolor sit amet, consectetur adipiscing elit";
+  const float ysize = 24.0f;
+  font_manager_->EnableTextPipelineStats(true);
+  Layout(text, "narrow", mathfu::vec2i(200, 0), ysize);
+  auto memory = font_manager_->GetMemoryUsage().layout_caches;
+  EXPECT_LT(0u, memory);
+
+  // A reflow in a wider box only runs the line breaker.
+  font_manager_->ResetTextPipelineStats();
+  auto reflowed = Layout(text, "wide", mathfu::vec2i(300, 0), ysize);
+  EXPECT_EQ(0u, font_manager_->GetTextPipelineStats().shaped_runs);
+  EXPECT_EQ(memory, font_manager_->GetMemoryUsage().layout_caches);
+
+  // Trimming memory clears the caches.
+  font_manager_->TrimMemory(flatui::kMemoryTrimLevelComplete);
+  EXPECT_EQ(0u, font_manager_->GetMemoryUsage().layout_caches);
+  font_manager_->ResetTextPipelineStats();
+  ExpectSamePositions(reflowed,
+                      Layout(text, "trimmed", mathfu::vec2i(300, 0), ysize));
+  EXPECT_LT(0u, font_manager_->GetTextPipelineStats().shaped_runs);
+
+  // Layouts without the caches match too.
+  font_manager_->SetWordBreakCacheSize(0);
+  font_manager_->SetShapingCacheSize(0);
+  EXPECT_EQ(0u, font_manager_->GetMemoryUsage().layout_caches);
+  ExpectSamePositions(reflowed,
+                      Layout(text, "uncached", mathfu::vec2i(300, 0), ysize));
+  EXPECT_EQ(0u, font_manager_->GetMemoryUsage().layout_caches);
+}
+
+// HTML laid out again restores its parsed sections from the HTML cache, and
+// gives the same layout as HTML parsed again.
+TEST_F(FlatUITextLayoutTest, TestHtmlCache) {
+  const char html[] =
+      "<p>Lorem ipsum dolor</p><p>sit <a href=\"amet\">amet</a></p>";
+  // Leave only the HTML cache in the layout caches.
+  font_manager_->SetShapingCacheSize(0);
+  font_manager_->SetWordBreakCacheSize(0);
+  auto font_id = font_manager_->GetCurrentFont()->GetFontId();
+  auto parameter = flatui::FontBufferParameters(
+      font_id, flatui::HashId("parsed"), 24.0f, mathfu::vec2i(300, 0),
+      flatui::kTextAlignmentLeft, flatui::kGlyphFlagsNone, true, false);
+  auto buffer = font_manager_->GetHtmlBuffer(html, parameter);
+  ASSERT_NE(nullptr, buffer);
+  auto parsed = buffer->get_vertices();
+  auto memory = font_manager_->GetMemoryUsage().layout_caches;
+  EXPECT_LT(0u, memory);
+
+  // A layout in another size restores the sections.
+  parameter = flatui::FontBufferParameters(
+      font_id, flatui::HashId("restored"), 24.0f, mathfu::vec2i(400, 0),
+      flatui::kTextAlignmentLeft, flatui::kGlyphFlagsNone, true, false);
+  ASSERT_NE(nullptr, font_manager_->GetHtmlBuffer(html, parameter));
+  EXPECT_EQ(memory, font_manager_->GetMemoryUsage().layout_caches);
+
+  // Another HTML is parsed and cached.
+  parameter = flatui::FontBufferParameters(
+      font_id, flatui::HashId("another"), 24.0f, mathfu::vec2i(300, 0),
+      flatui::kTextAlignmentLeft, flatui::kGlyphFlagsNone, true, false);
+  ASSERT_NE(nullptr, font_manager_->GetHtmlBuffer("<p>Lorem</p>", parameter));
+  EXPECT_LT(memory, font_manager_->GetMemoryUsage().layout_caches);
+
+  // Without the cache, the HTML is parsed again to the same layout.
+  font_manager_->SetHtmlCacheSize(0);
+  EXPECT_EQ(0u, font_manager_->GetMemoryUsage().layout_caches);
+  parameter = flatui::FontBufferParameters(
+      font_id, flatui::HashId("uncached"), 24.0f, mathfu::vec2i(300, 0),
+      flatui::kTextAlignmentLeft, flatui::kGlyphFlagsNone, true, false);
+  buffer = font_manager_->GetHtmlBuffer(html, parameter);
+  ASSERT_NE(nullptr, buffer);
+  ExpectSamePositions(parsed, buffer->get_vertices());
+  EXPECT_EQ(0u, font_manager_->GetMemoryUsage().layout_caches);
+}
+
+// Paragraphs hyphenated again restore words from the hyphenation cache, and
+// give the same hyphenation points as words hyphenated again.
+TEST_F(FlatUITextLayoutTest, TestHyphenationCache) {
+  // Without hyphenation patterns, words are hyphenated at soft hyphens.
+  const char text[] = "hy\xC2\xADphen\xC2\xADation of re\xC2\xADflows";
+  const size_t length = strlen(text);
+  std::vector<uint8_t> expected(length, 0);
+  for (auto p = strstr(text, "\xC2\xAD"); p; p = strstr(p + 1, "\xC2\xAD")) {
+    expected[p - text] = 1;
+  }
+
+  std::vector<uint8_t> points;
+  font_manager_->HyphenateParagraph(text, length, &points);
+  EXPECT_EQ(expected, points);
+  auto memory = font_manager_->GetMemoryUsage().hyphenation;
+
+  // Words hyphenated again are restored.
+  points.clear();
+  font_manager_->HyphenateParagraph(text, length, &points);
+  EXPECT_EQ(expected, points);
+  const char reflows[] = "re\xC2\xADflows";
+  font_manager_->HyphenateParagraph(reflows, strlen(reflows), &points);
+  EXPECT_EQ(std::vector<uint8_t>(expected.end() - strlen(reflows),
+                                 expected.end()),
+            points);
+  EXPECT_EQ(memory, font_manager_->GetMemoryUsage().hyphenation);
+
+  // A new word is hyphenated and cached.
+  const char word[] = "lay\xC2\xADout";
+  font_manager_->HyphenateParagraph(word, strlen(word), &points);
+  EXPECT_EQ(1u, points[3]);
+  EXPECT_LT(memory, font_manager_->GetMemoryUsage().hyphenation);
+
+  // Without the cache, words are hyphenated to the same points.
+  font_manager_->SetHyphenationCacheSize(0);
+  EXPECT_GT(memory, font_manager_->GetMemoryUsage().hyphenation);
+  font_manager_->HyphenateParagraph(text, length, &points);
+  EXPECT_EQ(expected, points);
+}
+
+// Decoded texts give the same line breaks as libunibreak's UTF-8 decoding,
+// and the same layout as texts decoded by HarfBuzz.
+TEST_F(FlatUITextLayoutTest, TestDecodedText) {
+  const char text[] =
+      "The quick brown fox \xE3\x81\x82\xE3\x81\x84 jumps over "
+      "\xC3\xA9t\xC3\xA9 the lazy dog. \xE6\x97\xA5\xE6\x9C\xAC";
+  auto length = strlen(text);
+  flatui::DecodedText decoded_text;
+  decoded_text.Decode(text, length);
+  ASSERT_TRUE(decoded_text.is_well_formed());
+  size_t count;
+  ASSERT_TRUE(flatui::CountCodepoints(text, length, &count));
+  EXPECT_EQ(count, decoded_text.get_count());
+  EXPECT_TRUE(decoded_text.Contains(text + 4, 5));
+  EXPECT_FALSE(decoded_text.Contains(text + 21, 2));
+
+  std::vector<char> breaks;
+  decoded_text.SetLineBreaks("en", &breaks);
+  std::vector<char> expected(length + 1);
+  set_linebreaks_utf8(reinterpret_cast<const utf8_t *>(text), length + 1,
+                      "en", &expected[0]);
+  EXPECT_EQ(expected, breaks);
+
+  // Malformed texts are left to libunibreak and HarfBuzz.
+  const char malformed[] = "abc\xE3\x81";
+  decoded_text.Decode(malformed, strlen(malformed));
+  EXPECT_FALSE(decoded_text.is_well_formed());
+  EXPECT_FALSE(flatui::CountCodepoints(malformed, strlen(malformed), &count));
+
+  // Multi line layouts shape words from the decoded text.
+  auto parameter = flatui::FontBufferParameters(
+      font_manager_->GetCurrentFont()->GetFontId(), flatui::HashId(text),
+      static_cast<float>(32), mathfu::vec2i(200, 0),
+      flatui::kTextAlignmentLeft, flatui::kGlyphFlagsNone, true, false);
+  font_manager_->SetShapingCacheSize(0);
+  auto buffer = font_manager_->GetBuffer(text, length, parameter);
+  ASSERT_NE(nullptr, buffer);
+  auto &lines = buffer->GetCaretLines();
+  ASSERT_LT(1u, lines.size());
+  EXPECT_EQ(buffer->GetCaretPositions().size(), lines.back().end);
+}
+
+// Typing at the end of a multi line text relays out the last lines only, and
+// gives the same buffer as laying out the whole text.
+TEST_F(FlatUITextLayoutTest, TestEditBuffer) {
+  std::string text =
+      "The quick brown fox jumps over the lazy dog. The quick brown fox "
+      "jumps over the lazy dog. The quick brown fox jumps over the lazy";
+  auto make_parameter = [&](const std::string &id) {
+    return flatui::FontBufferParameters(
+        font_manager_->GetCurrentFont()->GetFontId(),
+        flatui::HashId(id.c_str()), static_cast<float>(32),
+        mathfu::vec2i(200, 0), flatui::kTextAlignmentLeft,
+        flatui::kGlyphFlagsNone, true, false);
+  };
+  auto parameter = make_parameter(text);
+  ASSERT_NE(nullptr,
+            font_manager_->GetBuffer(text.c_str(), text.length(), parameter));
+  font_manager_->EnableTextPipelineStats(true);
+
+  const char typed[] = " dog. The end.";
+  for (size_t i = 0; typed[i]; ++i) {
+    auto edit_start = text.length();
+    text += typed[i];
+    auto edit_parameter = make_parameter(text);
+    font_manager_->ResetTextPipelineStats();
+    auto edited = font_manager_->EditBuffer(
+        parameter, text.c_str(), text.length(), edit_parameter, edit_start);
+    ASSERT_NE(nullptr, edited);
+    auto edit_lookups = font_manager_->GetTextPipelineStats().glyph_lookups;
+
+    font_manager_->ResetTextPipelineStats();
+    auto fresh = font_manager_->GetBuffer(text.c_str(), text.length(),
+                                          make_parameter(text + "fresh"));
+    ASSERT_NE(nullptr, fresh);
+    ASSERT_NE(edited, fresh);
+    // Only the last lines have been laid out again.
+    EXPECT_GT(font_manager_->GetTextPipelineStats().glyph_lookups,
+              edit_lookups);
+
+    auto &states = edited->get_line_states();
+    auto &fresh_states = fresh->get_line_states();
+    ASSERT_EQ(fresh_states.size(), states.size());
+    for (size_t j = 0; j < states.size(); ++j) {
+      EXPECT_EQ(fresh_states[j].text_index, states[j].text_index);
+      EXPECT_EQ(fresh_states[j].glyph_count, states[j].glyph_count);
+      EXPECT_EQ(fresh_states[j].caret_count, states[j].caret_count);
+      EXPECT_EQ(fresh_states[j].line_count, states[j].line_count);
+    }
+    ASSERT_EQ(fresh->get_glyph_count(), edited->get_glyph_count());
+    auto &vertices = edited->get_vertices();
+    auto &fresh_vertices = fresh->get_vertices();
+    ASSERT_EQ(fresh_vertices.size(), vertices.size());
+    for (size_t j = 0; j < vertices.size(); ++j) {
+      EXPECT_EQ(fresh_vertices[j].position_.data[0],
+                vertices[j].position_.data[0]);
+      EXPECT_EQ(fresh_vertices[j].position_.data[1],
+                vertices[j].position_.data[1]);
+    }
+    EXPECT_EQ(fresh->GetCaretPositions().size(),
+              edited->GetCaretPositions().size());
+    EXPECT_EQ(fresh->GetCaretLines().size(), edited->GetCaretLines().size());
+    parameter = edit_parameter;
+  }
+}
+
+// Buffers hyphenated with different locales are cached separately.
+TEST_F(FlatUITextLayoutTest, TestHyphenationLocale) {
+  const char text[] = "hyphenation";
+  auto parameter = flatui::FontBufferParameters(
+      font_manager_->GetCurrentFont()->GetFontId(), flatui::HashId(text),
+      static_cast<float>(48), mathfu::vec2i(100, 0),
+      flatui::kTextAlignmentLeft, flatui::kGlyphFlagsNone, true, true, true);
+  auto parameter_de = parameter;
+  parameter_de.set_hyphenation_locale("de-DE");
+  EXPECT_FALSE(parameter == parameter_de);
+  EXPECT_FALSE(parameter.HasSameLayout(parameter_de));
+
+  auto buffer = font_manager_->GetBuffer(text, strlen(text), parameter);
+  auto buffer_de = font_manager_->GetBuffer(text, strlen(text), parameter_de);
+  EXPECT_NE(buffer, buffer_de);
+  EXPECT_EQ(buffer_de,
+            font_manager_->GetBuffer(text, strlen(text), parameter_de));
+
+  font_manager_->ReleaseBuffer(buffer_de);
+  font_manager_->ReleaseBuffer(buffer_de);
+  font_manager_->ReleaseBuffer(buffer);
+}
+
+// Caret positions of a multi line buffer are recorded per line.
+TEST_F(FlatUITextLayoutTest, TestCaretLines) {
+  const char text[] = "Lorem ipsum dolor sit amet, consectetur adipiscing elit";
+  auto parameter = flatui::FontBufferParameters(
+      font_manager_->GetCurrentFont()->GetFontId(), flatui::HashId(text),
+      static_cast<float>(48), mathfu::vec2i(200, 0),
+      flatui::kTextAlignmentLeft, flatui::kGlyphFlagsNone, true, true);
+  auto buffer = font_manager_->GetBuffer(text, strlen(text), parameter);
+  ASSERT_TRUE(buffer->HasCaretPositions());
+
+  auto &lines = buffer->GetCaretLines();
+  ASSERT_LT(1u, lines.size());
+  EXPECT_EQ(0u, lines.front().start);
+  EXPECT_EQ(buffer->GetCaretPositions().size(), lines.back().end);
+  for (size_t i = 0; i < lines.size(); ++i) {
+    EXPECT_LT(lines[i].start, lines[i].end);
+    EXPECT_LE(lines[i].min_y, lines[i].max_y);
+    if (i) {
+      EXPECT_EQ(lines[i - 1].end, lines[i].start);
+      EXPECT_LT(lines[i - 1].max_y, lines[i].min_y);
+    }
+    EXPECT_EQ(static_cast<int32_t>(i), buffer->FindCaretLine(lines[i].start));
+    EXPECT_EQ(static_cast<int32_t>(i), buffer->FindCaretLine(lines[i].end - 1));
+  }
+  EXPECT_EQ(-1, buffer->FindCaretLine(lines.back().end));
+  font_manager_->ReleaseBuffer(buffer);
+}
+
+// Bounds merged from cached glyph bounds match extents of the vertices.
+TEST_F(FlatUITextLayoutTest, TestCalculateBounds) {
+  const char text[] = "Lorem ipsum dolor sit amet, consectetur adipiscing elit";
+  auto parameter = flatui::FontBufferParameters(
+      font_manager_->GetCurrentFont()->GetFontId(), flatui::HashId(text),
+      static_cast<float>(48), mathfu::vec2i(200, 0),
+      flatui::kTextAlignmentLeft, flatui::kGlyphFlagsNone, false, true);
+  auto buffer = font_manager_->GetBuffer(text, strlen(text), parameter);
+  ASSERT_NE(nullptr, buffer);
+  auto &vertices = buffer->get_vertices();
+  auto extents = [&vertices](int32_t start, int32_t end) {
+    auto min = mathfu::vec2(std::numeric_limits<float>::infinity());
+    auto max = -min;
+    for (auto i = start * 4; i < end * 4; ++i) {
+      auto position = mathfu::vec2(vertices[i].position_.data);
+      min = mathfu::vec2::Min(min, position);
+      max = mathfu::vec2::Max(max, position);
+    }
+    return mathfu::vec4(min, max);
+  };
+  auto merge = [](const std::vector<mathfu::vec4> &bounds) {
+    auto merged = bounds.front();
+    for (auto it = bounds.begin(); it != bounds.end(); ++it) {
+      merged = mathfu::vec4(mathfu::vec2::Min(merged.xy(), it->xy()),
+                            mathfu::vec2::Max(merged.zw(), it->zw()));
+    }
+    return merged;
+  };
+
+  // Each glyph.
+  auto count = buffer->get_glyph_count();
+  for (int32_t i = 0; i < count; ++i) {
+    auto bounds = buffer->CalculateBounds(i, i + 1);
+    ASSERT_EQ(1u, bounds.size());
+    EXPECT_EQ(extents(i, i + 1), bounds[0]);
+  }
+
+  // Ranges over multiple lines, starting and ending in the middle of lines.
+  auto all = buffer->CalculateBounds(0, count);
+  ASSERT_LT(1u, all.size());
+  EXPECT_EQ(extents(0, count), merge(all));
+  for (size_t i = 1; i < all.size(); ++i) {
+    EXPECT_LT(all[i - 1].y, all[i].y);
+  }
+  auto partial = buffer->CalculateBounds(1, count - 1);
+  EXPECT_EQ(all.size(), partial.size());
+  EXPECT_EQ(extents(1, count - 1), merge(partial));
+  font_manager_->ReleaseBuffer(buffer);
+}
+
+// A single line text exceeding the width ends with the ellipsis within the
+// width.
+TEST_F(FlatUITextLayoutTest, TestEllipsis) {
+  const char text[] = "Lorem ipsum dolor sit amet, consectetur adipiscing elit";
+  const char ellipsis[] = "...";
+  font_manager_->SetTextEllipsis(ellipsis);
+  auto parameter = flatui::FontBufferParameters(
+      font_manager_->GetCurrentFont()->GetFontId(), flatui::HashId(text),
+      static_cast<float>(48), mathfu::vec2i(200, 48),
+      flatui::kTextAlignmentLeft, flatui::kGlyphFlagsNone, false, true);
+  auto buffer = font_manager_->GetBuffer(text, strlen(text), parameter);
+  ASSERT_NE(nullptr, buffer);
+  EXPECT_TRUE(buffer->HasEllipsis());
+
+  auto count = buffer->get_glyph_count();
+  auto ellipsis_length = static_cast<int32_t>(strlen(ellipsis));
+  ASSERT_LT(ellipsis_length, count);
+  EXPECT_GT(static_cast<int32_t>(strlen(text)), count);
+  auto &vertices = buffer->get_vertices();
+  for (auto it = vertices.begin(); it != vertices.end(); ++it) {
+    EXPECT_GE(200.0f, it->position_.data[0]);
+  }
+  font_manager_->ReleaseBuffer(buffer);
+}
+
+// Underline geometry written into caller memory is the geometry returned in
+// vectors, and nothing is written when the memory is too small.
+TEST_F(FlatUITextLayoutTest, TestUnderlineVertices) {
+  const char html[] =
+      "<p><a href=\"a\">Lorem ipsum</a> dolor <a href=\"b\">sit amet, "
+      "consectetur adipiscing</a> elit</p>";
+  auto parameter = flatui::FontBufferParameters(
+      font_manager_->GetCurrentFont()->GetFontId(), flatui::HashId(html),
+      24.0f, mathfu::vec2i(200, 0), flatui::kTextAlignmentLeft,
+      flatui::kGlyphFlagsNone, true, false);
+  const flatui::FontBuffer *buffer =
+      font_manager_->GetHtmlBuffer(html, parameter);
+  ASSERT_NE(nullptr, buffer);
+  const mathfu::vec2 pos(10.0f, 20.0f);
+  const mathfu::vec2 padding(2.0f, 3.0f);
+
+  for (auto reverse = 0; reverse < 2; ++reverse) {
+    auto strip = flatui::GenerateUnderlineVertices(*buffer, pos, reverse != 0);
+    auto count = flatui::GetUnderlineVertexCount(*buffer);
+    ASSERT_LT(0u, count);
+    ASSERT_EQ(count, strip.size());
+
+    // The offset moves all vertices.
+    auto origin = flatui::GenerateUnderlineVertices(
+        *buffer, mathfu::kZeros2f, reverse != 0);
+    ASSERT_EQ(count, origin.size());
+    for (size_t i = 0; i < count; ++i) {
+      EXPECT_EQ(origin[i].data[0] + pos.x, strip[i].data[0]) << i;
+      EXPECT_EQ(origin[i].data[1] + pos.y, strip[i].data[1]) << i;
+    }
+
+    const mathfu::vec3_packed kUnused(mathfu::vec3(-1.0f));
+    std::vector<mathfu::vec3_packed> out(count + 1, kUnused);
+    EXPECT_EQ(0u, flatui::GenerateUnderlineVertices(
+                      *buffer, pos, out.data(), count - 1, reverse != 0));
+    EXPECT_EQ(-1.0f, out[0].data[0]);
+    EXPECT_EQ(count, flatui::GenerateUnderlineVertices(
+                         *buffer, pos, out.data(), count, reverse != 0));
+    EXPECT_EQ(0, memcmp(strip.data(), out.data(), count * sizeof(out[0])));
+    EXPECT_EQ(-1.0f, out[count].data[0]);
+
+    // Vectors reused across calls are resized to the mesh.
+    std::vector<mathfu::vec3> positions(1000);
+    std::vector<mathfu::vec2> tex_coords(1000);
+    std::vector<uint16_t> indices(1000);
+    ASSERT_TRUE(flatui::GeneratePaddedUnderlineVertices(
+        *buffer, pos, padding, &positions, &tex_coords, &indices,
+        reverse != 0));
+    size_t num_verts, num_indices;
+    flatui::GetPaddedUnderlineVertexCount(*buffer, &num_verts, &num_indices);
+    ASSERT_EQ(num_verts, positions.size());
+    ASSERT_EQ(num_verts, tex_coords.size());
+    ASSERT_EQ(num_indices, indices.size());
+    EXPECT_EQ(0u, num_indices % 3);
+    for (auto it = indices.begin(); it != indices.end(); ++it) {
+      EXPECT_GT(num_verts, *it);
+    }
+
+    std::vector<mathfu::vec3> position_array(num_verts);
+    std::vector<mathfu::vec2> tex_coord_array(num_verts);
+    std::vector<uint16_t> index_array(num_indices, 0xffff);
+    EXPECT_FALSE(flatui::GeneratePaddedUnderlineVertices(
+        *buffer, pos, padding, position_array.data(), tex_coord_array.data(),
+        index_array.data(), num_verts, num_indices - 1, reverse != 0));
+    EXPECT_EQ(0xffff, index_array[0]);
+    ASSERT_TRUE(flatui::GeneratePaddedUnderlineVertices(
+        *buffer, pos, padding, position_array.data(), tex_coord_array.data(),
+        index_array.data(), num_verts, num_indices, reverse != 0));
+    EXPECT_EQ(indices, index_array);
+    for (size_t i = 0; i < num_verts; ++i) {
+      EXPECT_EQ(positions[i].x, position_array[i].x) << i;
+      EXPECT_EQ(positions[i].y, position_array[i].y) << i;
+      EXPECT_EQ(tex_coords[i].x, tex_coord_array[i].x) << i;
+      EXPECT_EQ(tex_coords[i].y, tex_coord_array[i].y) << i;
+    }
+  }
+
+  // Texts without links have no underline.
+  parameter = flatui::FontBufferParameters(
+      font_manager_->GetCurrentFont()->GetFontId(), flatui::HashId("plain"),
+      24.0f, mathfu::vec2i(200, 0), flatui::kTextAlignmentLeft,
+      flatui::kGlyphFlagsNone, true, false);
+  buffer = font_manager_->GetHtmlBuffer("<p>Lorem ipsum</p>", parameter);
+  ASSERT_NE(nullptr, buffer);
+  EXPECT_EQ(0u, flatui::GetUnderlineVertexCount(*buffer));
+  EXPECT_TRUE(flatui::GenerateUnderlineVertices(*buffer, pos).empty());
+  std::vector<mathfu::vec3> positions;
+  std::vector<mathfu::vec2> tex_coords;
+  std::vector<uint16_t> indices;
+  EXPECT_FALSE(flatui::GeneratePaddedUnderlineVertices(
+      *buffer, pos, padding, &positions, &tex_coords, &indices));
+  EXPECT_TRUE(positions.empty());
+}
+
+namespace flatui {
+
+// Tests of MicroEdit, with access to its word breaking info.
+class FlatUIMicroEditTest : public ::testing::Test {
+ protected:
+  // FontManager initializes libunibreak otherwise.
+  virtual void SetUp() { init_linebreak(); }
+
+  static const std::vector<char> &wordbreak_info(const MicroEdit &edit) {
+    return edit.wordbreak_info_;
+  }
+  static const std::vector<int32_t> &character_offsets(const MicroEdit &edit) {
+    return edit.character_offsets_;
+  }
+  static int32_t num_characters(const MicroEdit &edit) {
+    return edit.num_characters_;
+  }
+  static void UpdateWordBreakInfo(MicroEdit *edit, size_t start,
+                                  size_t removed, size_t inserted) {
+    edit->UpdateWordBreakInfo(start, removed, inserted);
+  }
+};
+
+// Word breaks updated around an edit match the ones of the whole edited text.
+TEST_F(FlatUIMicroEditTest, TestIncrementalWordBreaks) {
+  struct Edit {
+    const char *text;
+    size_t start;
+    size_t removed;
+    const char *inserted;
+  };
+  const Edit edits[] = {
+      // Inserts at the head, at a break boundary, in a word, and at the end.
+      {"hello world", 0, 0, "oh "},
+      {"hello world", 5, 0, "!"},
+      {"hello world", 6, 0, "big "},
+      {"hello world", 2, 0, " "},
+      {"hello world", 11, 0, " again"},
+      {"one two", 7, 0, "\nthree"},
+      // Deletes joining two words, across a break, and of a whole word.
+      {"hello world", 5, 1, ""},
+      {"hello world", 3, 5, ""},
+      {"hello world", 6, 5, ""},
+      // Edits removing, adding and replacing mandatory breaks.
+      {"hello\nworld", 5, 1, ""},
+      {"hello world", 5, 1, "\n"},
+      {"abc\ndef\nghi", 4, 3, "xyz jk"},
+      {"abc\ndef\nghi", 2, 7, ""},
+      // Multi byte characters.
+      {"\xe6\x97\xa5\xe6\x9c\xac \xe8\xaa\x9e", 3, 0, "\xe3\x81\xae"},
+      {"\xe6\x97\xa5\xe6\x9c\xac \xe8\xaa\x9e", 3, 4, ""},
+      // Removing the whole text.
+      {"hello", 0, 5, ""},
+  };
+  for (size_t i = 0; i < sizeof(edits) / sizeof(edits[0]); ++i) {
+    auto &edit = edits[i];
+    std::string text = edit.text;
+    MicroEdit incremental;
+    incremental.Initialize(&text, kMultipleLines);
+    text.replace(edit.start, edit.removed, edit.inserted);
+    UpdateWordBreakInfo(&incremental, edit.start, edit.removed,
+                        strlen(edit.inserted));
+
+    std::string edited_text = text;
+    MicroEdit full;
+    full.Initialize(&edited_text, kMultipleLines);
+    EXPECT_EQ(wordbreak_info(full), wordbreak_info(incremental)) << i;
+    EXPECT_EQ(character_offsets(full), character_offsets(incremental)) << i;
+    EXPECT_EQ(num_characters(full), num_characters(incremental)) << i;
+  }
+}
+
+}  // namespace flatui
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Dummy entry to link the test in Android successfully.
+extern "C" int FPL_main(int /*argc*/, char ** /*argv*/) { return 0; }
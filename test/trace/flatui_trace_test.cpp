@@ -0,0 +1,111 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+#include "flatui/font_manager.h"
+#include "flatui/trace.h"
+#include "fplbase/renderer.h"
+#include "fplbase/utilities.h"
+#include "fplutil/main.h"
+#include "gtest/gtest.h"
+
+// Tests of trace events emitted through a TraceListener.
+class FlatUITraceTest : public ::testing::Test {
+ public:
+  MATHFU_DEFINE_CLASS_SIMD_AWARE_NEW_DELETE
+
+ protected:
+  virtual void SetUp() {
+    renderer_.Initialize(mathfu::vec2i(800, 600), "FlatUI test");
+
+    font_manager_ = new flatui::FontManager(mathfu::vec2i(256, 256), 2);
+
+    // Set the local directory to the assets folder for this sample.
+    bool result = fplbase::ChangeToUpstreamDir("../", "assets");
+    assert(result);
+    (void)result;
+
+    font_manager_->Open("fonts/NotoSansCJKjp-Bold.otf");
+  }
+
+  virtual void TearDown() {
+    delete font_manager_;
+    renderer_.ShutDown();
+  }
+
+  fplbase::Renderer renderer_;
+  flatui::FontManager *font_manager_;
+};
+
+// Records trace events of FontManager.
+class TestTraceListener : public flatui::TraceListener {
+ public:
+  TestTraceListener() : depth(0), max_depth(0) {}
+  void BeginEvent(const char *name, flatui::HashedId id) {
+    names.insert(name);
+    ids.push_back(id);
+    max_depth = std::max(max_depth, ++depth);
+  }
+  void EndEvent(const char *) { --depth; }
+
+  std::set<std::string> names;
+  std::vector<flatui::HashedId> ids;
+  int32_t depth;
+  int32_t max_depth;
+};
+
+// Layouts emit nested trace events while a listener is set.
+TEST_F(FlatUITraceTest, TestTraceEvents) {
+  TestTraceListener listener;
+  flatui::SetTraceListener(&listener);
+  const char text[] = "Lorem ipsum dolor sit amet";
+  auto parameter = flatui::FontBufferParameters(
+      font_manager_->GetCurrentFont()->GetFontId(), flatui::HashId(text),
+      static_cast<float>(48), mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+      flatui::kGlyphFlagsNone, false, true);
+  auto buffer = font_manager_->GetBuffer(text, strlen(text), parameter);
+  flatui::SetTraceListener(nullptr);
+  ASSERT_NE(nullptr, buffer);
+
+  EXPECT_EQ(0, listener.depth);
+  EXPECT_LT(1, listener.max_depth);
+  EXPECT_EQ(1u, listener.names.count("FontManager::FillBuffer"));
+  EXPECT_EQ(1u, listener.names.count("FontManager::LayoutText"));
+  EXPECT_EQ(1u, listener.names.count("FontManager::RasterizeGlyph"));
+  ASSERT_FALSE(listener.ids.empty());
+  EXPECT_EQ(flatui::HashId(text), listener.ids.front());
+
+  // No events without a listener.
+  auto count = listener.ids.size();
+  font_manager_->ReleaseBuffer(buffer);
+  const char text2[] = "consectetur adipiscing elit";
+  parameter = flatui::FontBufferParameters(
+      font_manager_->GetCurrentFont()->GetFontId(), flatui::HashId(text2),
+      static_cast<float>(48), mathfu::vec2i(0, 0), flatui::kTextAlignmentLeft,
+      flatui::kGlyphFlagsNone, false, true);
+  buffer = font_manager_->GetBuffer(text2, strlen(text2), parameter);
+  EXPECT_EQ(count, listener.ids.size());
+  font_manager_->ReleaseBuffer(buffer);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Dummy entry to link the test in Android successfully.
+extern "C" int FPL_main(int /*argc*/, char ** /*argv*/) { return 0; }
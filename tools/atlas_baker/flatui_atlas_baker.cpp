@@ -0,0 +1,199 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// flatui_atlas_baker renders glyphs of a character set with given fonts and
+// sizes offline, and writes them to a glyph atlas file that is loaded with
+// FontManager::LoadGlyphAtlas(). Glyphs in the atlas are pinned in the glyph
+// cache, so that texts using them don't need FreeType nor SDF generation in
+// the first frame.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "flatui/font_manager.h"
+#include "flatui/glyph_atlas_generated.h"
+#include "fplbase/utilities.h"
+
+using flatui::FontBufferParameters;
+using flatui::FontManager;
+using flatui::GlyphFlags;
+using flatui::HashId;
+using mathfu::vec2i;
+
+static const int32_t kDefaultCacheSize = 1024;
+static const int32_t kDefaultMaxSlices = 4;
+
+static void PrintUsage() {
+  fprintf(stderr,
+          "Usage: flatui_atlas_baker [options] output_file\n"
+          "  --font <file>        Font to bake glyphs with. Can be repeated.\n"
+          "  --size <pixels>      Glyph size. Can be repeated.\n"
+          "  --sdf                Bake glyphs with outer SDF.\n"
+          "  --inner-sdf          Bake glyphs with inner and outer SDF.\n"
+          "  --chars <utf8>       Characters to bake.\n"
+          "  --chars-file <file>  UTF-8 text file of characters to bake.\n"
+          "  --cache-size <n>     Width and height of atlas slices. "
+          "(Default %d)\n"
+          "  --slices <n>         Max number of atlas slices. (Default %d)\n"
+          "  --dump <prefix>      Write atlas slices as PGM images.\n"
+          "Each line of the characters is laid out as is, so that ligatures\n"
+          "in the lines are baked, and each character is baked alone too.\n"
+          "Sizes are glyph sizes after a size selector of FontManager, and\n"
+          "fonts need to be opened with the same names in the application.\n",
+          kDefaultCacheSize, kDefaultMaxSlices);
+}
+
+// Build texts to lay out from the character set. Each character is separated
+// with spaces so that it is shaped alone.
+static std::vector<std::string> BuildTexts(const std::string &chars) {
+  std::vector<std::string> texts;
+  std::string separated;
+  size_t line_start = 0;
+  for (size_t i = 0; i <= chars.size(); ++i) {
+    if (i == chars.size() || chars[i] == '\n') {
+      if (i > line_start) {
+        texts.push_back(chars.substr(line_start, i - line_start));
+      }
+      line_start = i + 1;
+      continue;
+    }
+    // Insert a space before a leading byte of a UTF-8 sequence.
+    if ((chars[i] & 0xc0) != 0x80 && !separated.empty()) {
+      separated += ' ';
+    }
+    separated += chars[i];
+  }
+  if (!separated.empty()) {
+    texts.push_back(separated);
+  }
+  return texts;
+}
+
+// Write slices in the atlas file as PGM images.
+static bool DumpSlices(const char *atlas_file, const char *prefix) {
+  std::string data;
+  if (!fplbase::LoadFile(atlas_file, &data)) {
+    return false;
+  }
+  auto atlas = flatui_data::GetGlyphAtlas(data.data());
+  if (atlas->slices() == nullptr) {
+    return true;
+  }
+  for (flatbuffers::uoffset_t i = 0; i < atlas->slices()->size(); ++i) {
+    auto pixels = atlas->slices()->Get(i)->pixels();
+    char header[64];
+    snprintf(header, sizeof(header), "P5\n%d %d\n255\n", atlas->width(),
+             atlas->height());
+    std::string image(header);
+    image.append(reinterpret_cast<const char *>(pixels->data()),
+                 pixels->size());
+    auto file_name = std::string(prefix) + std::to_string(i) + ".pgm";
+    if (!fplbase::SaveFile(file_name.c_str(), image)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  std::vector<const char *> fonts;
+  std::vector<int32_t> sizes;
+  int32_t flags = flatui::kGlyphFlagsNone;
+  std::string chars;
+  int32_t cache_size = kDefaultCacheSize;
+  int32_t max_slices = kDefaultMaxSlices;
+  const char *dump_prefix = nullptr;
+  const char *output_file = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (!strcmp(arg, "--font") && has_value) {
+      fonts.push_back(argv[++i]);
+    } else if (!strcmp(arg, "--size") && has_value) {
+      sizes.push_back(atoi(argv[++i]));
+    } else if (!strcmp(arg, "--sdf")) {
+      flags |= flatui::kGlyphFlagsOuterSDF;
+    } else if (!strcmp(arg, "--inner-sdf")) {
+      flags |= flatui::kGlyphFlagsOuterSDF | flatui::kGlyphFlagsInnerSDF;
+    } else if (!strcmp(arg, "--chars") && has_value) {
+      chars += argv[++i];
+      chars += '\n';
+    } else if (!strcmp(arg, "--chars-file") && has_value) {
+      std::string file_chars;
+      if (!fplbase::LoadFile(argv[++i], &file_chars)) {
+        fprintf(stderr, "Can't load %s\n", argv[i]);
+        return 1;
+      }
+      chars += file_chars;
+      chars += '\n';
+    } else if (!strcmp(arg, "--cache-size") && has_value) {
+      cache_size = atoi(argv[++i]);
+    } else if (!strcmp(arg, "--slices") && has_value) {
+      max_slices = atoi(argv[++i]);
+    } else if (!strcmp(arg, "--dump") && has_value) {
+      dump_prefix = argv[++i];
+    } else if (arg[0] != '-' && output_file == nullptr) {
+      output_file = arg;
+    } else {
+      PrintUsage();
+      return 1;
+    }
+  }
+  if (fonts.empty() || sizes.empty() || chars.empty() ||
+      output_file == nullptr || cache_size <= 0 || max_slices <= 0) {
+    PrintUsage();
+    return 1;
+  }
+
+  // Lay out all texts in one layout pass. Glyphs are rendered synchronously
+  // and no textures are uploaded, so a renderer is not needed.
+  FontManager font_manager(vec2i(cache_size, cache_size), max_slices);
+  font_manager.StartLayoutPass();
+  auto texts = BuildTexts(chars);
+  for (auto font = fonts.begin(); font != fonts.end(); ++font) {
+    if (!font_manager.Open(*font) || !font_manager.SelectFont(*font)) {
+      fprintf(stderr, "Can't open font %s\n", *font);
+      return 1;
+    }
+    for (auto size = sizes.begin(); size != sizes.end(); ++size) {
+      for (auto text = texts.begin(); text != texts.end(); ++text) {
+        FontBufferParameters parameters(
+            HashId(*font), HashId(text->c_str()), static_cast<float>(*size),
+            vec2i(0, 0), flatui::kTextAlignmentLeft,
+            static_cast<GlyphFlags>(flags), false, false);
+        if (font_manager.GetBuffer(text->c_str(), text->size(), parameters) ==
+            nullptr) {
+          fprintf(stderr, "Glyphs don't fit in the atlas. "
+                          "Increase --cache-size or --slices.\n");
+          return 1;
+        }
+      }
+    }
+  }
+
+  if (!font_manager.SaveGlyphAtlas(output_file)) {
+    fprintf(stderr, "Can't write %s\n", output_file);
+    return 1;
+  }
+  if (dump_prefix != nullptr && !DumpSlices(output_file, dump_prefix)) {
+    fprintf(stderr, "Can't write atlas images.\n");
+    return 1;
+  }
+  return 0;
+}